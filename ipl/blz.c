@@ -33,7 +33,8 @@ const blz_footer *blz_get_footer(const unsigned char *compData, unsigned int com
 }
 
 // From https://github.com/SciresM/hactool/blob/master/kip.c which is exactly how kernel does it, thanks SciresM!
-int blz_uncompress_inplace(unsigned char *dataBuf, unsigned int compSize, const blz_footer *footer) 
+// Kept as the reference for blz_uncompress_inplace.
+int blz_uncompress_inplace_ref(unsigned char *dataBuf, unsigned int compSize, const blz_footer *footer)
 {
 	u32 addl_size = footer->addl_size;
 	u32 header_size = footer->header_size;
@@ -82,6 +83,96 @@ int blz_uncompress_inplace(unsigned char *dataBuf, unsigned int compSize, const
 	return 1;
 }
 
+/*
+ * Same output as blz_uncompress_inplace_ref. A flag byte of all literals away from both ends is
+ * copied in one go and matches that cannot overlap within a word are copied a word at a time.
+ * Built as ARM code, the hot loop is too branchy for Thumb on the BPMP.
+ */
+int IRAM_FAST blz_uncompress_inplace(unsigned char *dataBuf, unsigned int compSize, const blz_footer *footer)
+{
+	u32 addl_size = footer->addl_size;
+	u32 header_size = footer->header_size;
+	u32 cmp_and_hdr_size = footer->cmp_and_hdr_size;
+
+	unsigned char *cmp_start = &dataBuf[compSize] - cmp_and_hdr_size;
+	u32 cmp_ofs = cmp_and_hdr_size - header_size;
+	u32 out_ofs = cmp_and_hdr_size + addl_size;
+
+	while (out_ofs)
+	{
+		if (cmp_ofs < 1)
+			return 0; // Out of bounds.
+
+		u32 control = cmp_start[--cmp_ofs];
+
+		// 8 literals. Copied top down like one by one, so an overlap behaves the same.
+		if (!control && cmp_ofs >= 8 && out_ofs >= 8)
+		{
+			unsigned char *dst = &cmp_start[out_ofs];
+			const unsigned char *src = &cmp_start[cmp_ofs];
+			dst[-1] = src[-1];
+			dst[-2] = src[-2];
+			dst[-3] = src[-3];
+			dst[-4] = src[-4];
+			dst[-5] = src[-5];
+			dst[-6] = src[-6];
+			dst[-7] = src[-7];
+			dst[-8] = src[-8];
+			out_ofs -= 8;
+			cmp_ofs -= 8;
+			continue;
+		}
+
+		for (u32 i = 0; i < 8; i++)
+		{
+			if (control & 0x80)
+			{
+				if (cmp_ofs < 2)
+					return 0; // Out of bounds.
+
+				cmp_ofs -= 2;
+				u32 seg_val = ((u32)(cmp_start[cmp_ofs + 1]) << 8) | cmp_start[cmp_ofs];
+				u32 seg_size = ((seg_val >> 12) & 0xF) + 3;
+				u32 seg_ofs = (seg_val & 0x0FFF) + 3;
+				if (out_ofs < seg_size) // Kernel restricts segment copy to stay in bounds.
+					seg_size = out_ofs;
+
+				out_ofs -= seg_size;
+
+				// Copies run upwards from a source seg_ofs above, words are fine once they cannot overlap.
+				unsigned char *dst = &cmp_start[out_ofs];
+				if (!(((u32)dst | seg_ofs) & 3))
+				{
+					u32 *dst32 = (u32 *)dst;
+					const u32 *src32 = (const u32 *)(dst + seg_ofs);
+					for (u32 j = seg_size >> 2; j; j--)
+						*dst32++ = *src32++;
+					dst = (unsigned char *)dst32;
+					seg_size &= 3;
+				}
+				while (seg_size--)
+				{
+					*dst = dst[seg_ofs];
+					dst++;
+				}
+			}
+			else
+			{
+				// Copy directly.
+				if (cmp_ofs < 1)
+					return 0; // Out of bounds.
+
+				cmp_start[--out_ofs] = cmp_start[--cmp_ofs];
+			}
+			control <<= 1;
+			if (out_ofs == 0) // Blz works backwards, so if it reaches byte 0, it's done.
+				return 1;
+		}
+	}
+
+	return 1;
+}
+
 int blz_uncompress_srcdest(const unsigned char *compData, unsigned int compDataLen, unsigned char *dstData, unsigned int dstSize)
 {
 	blz_footer footer;
@@ -30,6 +30,8 @@ typedef struct _blz_footer
 const blz_footer *blz_get_footer(const unsigned char *compData, unsigned int compDataLen, blz_footer *outFooter);
 // Returns 0 on failure.
 int blz_uncompress_inplace(unsigned char *dataBuf, unsigned int compSize, const blz_footer *footer);
+// Byte by byte reference of the above, returns 0 on failure.
+int blz_uncompress_inplace_ref(unsigned char *dataBuf, unsigned int compSize, const blz_footer *footer);
 // Returns 0 on failure.
 int blz_uncompress_srcdest(const unsigned char *compData, unsigned int compDataLen, unsigned char *dstData, unsigned int dstSize);
 
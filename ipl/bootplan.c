@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "bootplan.h"
+#include "heap.h"
+#include "pkg2.h"
+#include "util.h"
+
+extern void *sd_file_read(char *path, u32 *fsize);
+extern int sd_save_to_file(void *buf, u32 size, const char *filename);
+
+// Header with the version string, and package2's RSA signature plus its decrypted header.
+#define BOOTPLAN_PKG1_KEY_SIZE 0x20
+#define BOOTPLAN_PKG2_KEY_SIZE 0x200
+
+// crc of the plan as loaded, so an unchanged one is not written again.
+static u32 _bootplan_loaded_crc = 0;
+
+static u32 _bootplan_crc(const bootplan_t *plan)
+{
+	return crc32c(&plan->key, sizeof(bootplan_t) - 8);
+}
+
+u32 bootplan_key(const void *pkg1, const void *pkg2, ini_sec_t *cfg)
+{
+	// The header carries the section hashes, so it pins the kernel and every INI1 KIP.
+	u32 key = crc32c(pkg1, BOOTPLAN_PKG1_KEY_SIZE);
+	key = crc32c_update(key, pkg2, BOOTPLAN_PKG2_KEY_SIZE);
+
+	if (cfg)
+	{
+		LIST_FOREACH_ENTRY(ini_kv_t, kv, &cfg->kvs, link)
+		{
+			key = crc32c_update(key, kv->key, strlen(kv->key) + 1);
+			key = crc32c_update(key, kv->val, strlen(kv->val) + 1);
+		}
+	}
+
+	return key;
+}
+
+int bootplan_load(bootplan_t *plan, u32 key)
+{
+	u32 size = 0;
+	bootplan_t *buf = (bootplan_t *)sd_file_read(BOOTPLAN_PATH, &size);
+
+	int res = buf && size == sizeof(bootplan_t) && buf->magic == BOOTPLAN_MAGIC && buf->key == key &&
+		buf->num_kips <= BOOTPLAN_MAX_KIPS && buf->crc == _bootplan_crc(buf);
+
+	if (res)
+	{
+		memcpy(plan, buf, sizeof(bootplan_t));
+		_bootplan_loaded_crc = plan->crc;
+	}
+	else
+	{
+		memset(plan, 0, sizeof(bootplan_t));
+		plan->magic = BOOTPLAN_MAGIC;
+		plan->key = key;
+		_bootplan_loaded_crc = 0;
+	}
+
+	free(buf);
+	return res;
+}
+
+void bootplan_apply_kips(const bootplan_t *plan, link_t *info)
+{
+	u32 idx = 0;
+	LIST_FOREACH_ENTRY(pkg2_kip1_info_t, ki, info, link)
+	{
+		if (idx >= plan->num_kips)
+			break;
+
+		const bootplan_kip_t *kip = &plan->kips[idx++];
+		if (ki->from_ini1 && kip->hashed && !memcmp(kip->name, ki->kip1->name, sizeof(kip->name)))
+		{
+			memcpy(ki->hash, kip->hash, sizeof(ki->hash));
+			ki->hashed = 1;
+		}
+	}
+}
+
+void bootplan_record_kips(bootplan_t *plan, link_t *info)
+{
+	u32 idx = 0;
+	LIST_FOREACH_ENTRY(pkg2_kip1_info_t, ki, info, link)
+	{
+		// Merged KIPs replace in place or go to the end, so INI1 positions hold.
+		if (idx >= BOOTPLAN_MAX_KIPS)
+			break;
+
+		bootplan_kip_t *kip = &plan->kips[idx++];
+		memcpy(kip->name, ki->kip1->name, sizeof(kip->name));
+		kip->hashed = ki->from_ini1 && ki->hashed;
+		if (kip->hashed)
+			memcpy(kip->hash, ki->hash, sizeof(kip->hash));
+		else
+			memset(kip->hash, 0, sizeof(kip->hash));
+	}
+	plan->num_kips = idx;
+}
+
+void bootplan_save(bootplan_t *plan)
+{
+	plan->crc = _bootplan_crc(plan);
+	if (plan->crc == _bootplan_loaded_crc)
+		return;
+
+	if (!sd_save_to_file(plan, sizeof(bootplan_t), BOOTPLAN_PATH))
+		_bootplan_loaded_crc = plan->crc;
+}
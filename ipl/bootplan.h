@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BOOTPLAN_H_
+#define _BOOTPLAN_H_
+
+#include "types.h"
+#include "list.h"
+#include "ini.h"
+
+#define BOOTPLAN_PATH "bootplan.bin"
+#define BOOTPLAN_MAGIC 0x4E4C5042 // "BPLN"
+#define BOOTPLAN_MAX_KIPS 16
+
+typedef struct _bootplan_kip_t
+{
+	u8 name[12];
+	u32 hashed;
+	u8 hash[0x20];
+} bootplan_kip_t;
+
+/*
+ * What a launch derived from package1, package2 and the boot entry, so that
+ * the next one with the same inputs skips it. Only facts about the inputs
+ * are kept, the tables they are looked up in stay live.
+ */
+typedef struct _bootplan_t
+{
+	u32 magic;
+	u32 crc;        // Over everything after it.
+	u32 key;        // See bootplan_key().
+	u32 kernel_crc; // crc32c of the package2 kernel for pkg2_identify(), 0 if not computed.
+	u32 num_kips;
+	bootplan_kip_t kips[BOOTPLAN_MAX_KIPS]; // INI1 KIPs in package2 order.
+} bootplan_t;
+
+/*! crc32c over the package1 header, the package2 signature and header, and the boot entry. */
+u32 bootplan_key(const void *pkg1, const void *pkg2, ini_sec_t *cfg);
+/*! Fills plan with the one recorded for key. Returns 0 and an empty plan for key if there is none. */
+int bootplan_load(bootplan_t *plan, u32 key);
+/*! Hands the known hashes to the INI1 KIPs in info. */
+void bootplan_apply_kips(const bootplan_t *plan, link_t *info);
+/*! Takes over the INI1 KIP hashes known by now. */
+void bootplan_record_kips(bootplan_t *plan, link_t *info);
+/*! Writes plan to SD if it differs from the loaded one. */
+void bootplan_save(bootplan_t *plan);
+
+#endif
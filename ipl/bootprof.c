@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "bootprof.h"
+#include "trace.h"
+#include "util.h"
+#include "ff.h"
+
+extern int sd_mounted;
+
+static bootprof_t *_bootprof = (bootprof_t *)BOOTPROF_ADDR;
+
+static u32 _bootprof_crc()
+{
+	return crc32c(&_bootprof->done, sizeof(bootprof_t) - 8);
+}
+
+static int _bootprof_valid()
+{
+	return _bootprof->magic == BOOTPROF_MAGIC && _bootprof->num_stages <= BOOTPROF_MAX_STAGES &&
+		_bootprof->crc == _bootprof_crc();
+}
+
+void bootprof_start()
+{
+	bootprof_flush();
+
+	memset(_bootprof, 0, sizeof(bootprof_t));
+	_bootprof->magic = BOOTPROF_MAGIC;
+	_bootprof->start_us = get_tmr_us();
+	_bootprof->last_us = _bootprof->start_us;
+	_bootprof->crc = _bootprof_crc();
+}
+
+void bootprof_stage(const char *name)
+{
+	if (_bootprof->magic != BOOTPROF_MAGIC || _bootprof->done || _bootprof->num_stages >= BOOTPROF_MAX_STAGES)
+		return;
+
+	u32 now = get_tmr_us();
+	trace_event(name, now - _bootprof->last_us, _bootprof->num_stages);
+	bootprof_stage_t *st = &_bootprof->stages[_bootprof->num_stages++];
+	strncpy(st->name, name, BOOTPROF_NAME_LEN - 1);
+	st->elapsed_us = now - _bootprof->last_us;
+	_bootprof->last_us = now;
+	_bootprof->crc = _bootprof_crc();
+}
+
+void bootprof_end()
+{
+	if (_bootprof->magic != BOOTPROF_MAGIC)
+		return;
+
+	_bootprof->done = 1;
+	_bootprof->crc = _bootprof_crc();
+}
+
+const bootprof_t *bootprof_get()
+{
+	if (!_bootprof_valid() || !_bootprof->done)
+		return NULL;
+
+	return _bootprof;
+}
+
+const bootprof_t *bootprof_peek()
+{
+	if (!_bootprof_valid())
+		return NULL;
+
+	return _bootprof;
+}
+
+void bootprof_flush()
+{
+	if (!sd_mounted || !_bootprof_valid() || !_bootprof->done)
+		return;
+
+	FIL fp;
+	if (f_open(&fp, BOOTPROF_LOG_PATH, FA_WRITE | FA_OPEN_APPEND) == FR_OK)
+	{
+		f_printf(&fp, "[boot %u]\n", _bootprof->start_us);
+		for (u32 i = 0; i < _bootprof->num_stages; i++)
+			f_printf(&fp, "%-20s %10u us\n", _bootprof->stages[i].name, _bootprof->stages[i].elapsed_us);
+		f_printf(&fp, "%-20s %10u us\n\n", "total", _bootprof->last_us - _bootprof->start_us);
+		f_close(&fp);
+	}
+
+	// Log it once, even if the write failed.
+	_bootprof->magic = 0;
+}
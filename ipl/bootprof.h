@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BOOTPROF_H_
+#define _BOOTPROF_H_
+
+#include "types.h"
+
+/*! Reserved DRAM between the stack and the heap, so a finished profile outlives the launch. */
+#define BOOTPROF_ADDR 0x9001F000
+#define BOOTPROF_MAGIC 0x46504248 // HBPF.
+#define BOOTPROF_MAX_STAGES 24
+#define BOOTPROF_NAME_LEN 20
+#define BOOTPROF_LOG_PATH "boot_prof.log"
+
+typedef struct _bootprof_stage_t
+{
+	char name[BOOTPROF_NAME_LEN];
+	u32 elapsed_us;
+} bootprof_stage_t;
+
+typedef struct _bootprof_t
+{
+	u32 magic;
+	u32 crc;
+	u32 done;
+	u32 num_stages;
+	u32 start_us;
+	u32 last_us;
+	bootprof_stage_t stages[BOOTPROF_MAX_STAGES];
+} bootprof_t;
+
+/*! Starts a new profile, after logging the previous one if the SD card is mounted. */
+void bootprof_start();
+/*! Records the time spent since the previous stage. */
+void bootprof_stage(const char *name);
+/*! Marks the profile as complete, so it gets logged on the next mount. */
+void bootprof_end();
+/*! Returns the complete profile not logged yet, or NULL. */
+const bootprof_t *bootprof_get();
+/*! Returns the profile not logged yet, complete or still running, or NULL. */
+const bootprof_t *bootprof_peek();
+/*! Appends a complete profile to BOOTPROF_LOG_PATH and drops it. */
+void bootprof_flush();
+
+#endif
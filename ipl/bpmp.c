@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2018 naehrwert
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bpmp.h"
+#include "ccplex.h"
+#include "clock.h"
+#include "max7762x.h"
+#include "sensors.h"
+#include "t210.h"
+#include "util.h"
+
+typedef struct _bpmp_mmu_entry_t
+{
+	u32 min_addr;
+	u32 max_addr;
+	u32 attr;
+	u32 rsvd;
+} bpmp_mmu_entry_t;
+
+// Everything else goes through the uncached fallback entry. That keeps MMIO
+// and the CCPLEX mailbox, which the BPMP polls, out of the cache.
+static const bpmp_mmu_entry_t _bpmp_mmu_entries[] = {
+	{ 0x40000000, 0x4003FFFF,           MMU_EN_READ | MMU_EN_WRITE | MMU_EN_EXEC | MMU_EN_CACHED, 0 }, // IRAM, our code.
+	{ 0x80000000, CCPLEX_MBOX_ADDR - 1, MMU_EN_READ | MMU_EN_WRITE | MMU_EN_EXEC | MMU_EN_CACHED, 0 }  // DRAM up to and including the framebuffer.
+};
+
+static void _bpmp_cache_maint(u32 op, u32 addr)
+{
+	BPMP_CACHE(BPMP_CACHE_INT_CLEAR) = CACHE_INT_MAINT_DONE;
+	BPMP_CACHE(BPMP_CACHE_MAINT_ADDR) = addr;
+	BPMP_CACHE(BPMP_CACHE_MAINT_REQ) = CACHE_MAINT_WAY_BITMAP(0xF) | op;
+	while (!(BPMP_CACHE(BPMP_CACHE_INT_RAW_EVENT) & CACHE_INT_MAINT_DONE))
+		;
+	BPMP_CACHE(BPMP_CACHE_INT_CLEAR) = BPMP_CACHE(BPMP_CACHE_INT_RAW_EVENT);
+}
+
+static void _bpmp_cache_range(u32 op_line, u32 op_way, const void *buf, u32 size)
+{
+	if (!size || !bpmp_cache_enabled())
+		return;
+
+	if (size > BPMP_CACHE_RANGE_MAX)
+	{
+		_bpmp_cache_maint(op_way, 0);
+		return;
+	}
+
+	u32 addr = (u32)buf & ~(BPMP_CACHE_LINE_SIZE - 1);
+	u32 end = (u32)buf + size;
+	for (; addr < end; addr += BPMP_CACHE_LINE_SIZE)
+		_bpmp_cache_maint(op_line, addr);
+}
+
+int bpmp_cache_enabled()
+{
+	return BPMP_CACHE(BPMP_CACHE_CONFIG) & CACHE_CFG_ENABLE;
+}
+
+void bpmp_cache_enable()
+{
+	if (bpmp_cache_enabled())
+		return;
+
+	BPMP_CACHE(BPMP_CACHE_MMU_CMD) = MMU_CMD_INIT;
+	BPMP_CACHE(BPMP_CACHE_MMU_FALLBACK_ENTRY) = MMU_EN_READ | MMU_EN_WRITE | MMU_EN_EXEC;
+	BPMP_CACHE(BPMP_CACHE_MMU_CFG) = MMU_CFG_SEQ_EN | MMU_CFG_TLB_EN | MMU_CFG_ABORT_STORE_LAST;
+
+	BPMP_CACHE(BPMP_CACHE_INT_MASK) = 0xFFFFFFFF;
+	BPMP_CACHE(BPMP_CACHE_INT_CLEAR) = BPMP_CACHE(BPMP_CACHE_INT_RAW_EVENT);
+	BPMP_CACHE(BPMP_CACHE_CONFIG) = 0;
+
+	for (u32 i = 0; i < sizeof(_bpmp_mmu_entries) / sizeof(bpmp_mmu_entry_t); i++)
+	{
+		volatile bpmp_mmu_entry_t *entry = (bpmp_mmu_entry_t *)(BPMP_CACHE_BASE + BPMP_CACHE_MMU_SHADOW_ENTRY) + i;
+		entry->min_addr = _bpmp_mmu_entries[i].min_addr;
+		entry->max_addr = _bpmp_mmu_entries[i].max_addr;
+		entry->attr = _bpmp_mmu_entries[i].attr;
+		BPMP_CACHE(BPMP_CACHE_MMU_SHADOW_COPY_MASK) |= 1 << i;
+	}
+	BPMP_CACHE(BPMP_CACHE_MMU_CMD) = MMU_CMD_COPY_SHADOW;
+
+	_bpmp_cache_maint(BPMP_MAINT_INVALID_WAY, 0);
+
+	// Write-through, so a device reading memory never misses a dirty line and the display always scans out what was drawn.
+	BPMP_CACHE(BPMP_CACHE_CONFIG) = CACHE_CFG_ENABLE | CACHE_CFG_FORCE_WRITE_THROUGH | CACHE_CFG_DISABLE_SAMELINE;
+
+	// Lines can get allocated while the cache turns on, drop them again.
+	_bpmp_cache_maint(BPMP_MAINT_INVALID_WAY, 0);
+}
+
+void bpmp_cache_disable()
+{
+	if (!bpmp_cache_enabled())
+		return;
+
+	_bpmp_cache_maint(BPMP_MAINT_CLEAN_INVALID_WAY, 0);
+	BPMP_CACHE(BPMP_CACHE_CONFIG) = 0;
+}
+
+void bpmp_cache_clean(const void *buf, u32 size)
+{
+	// Also drains the write buffer, which write-through alone doesn't.
+	_bpmp_cache_range(BPMP_MAINT_CLEAN_PHY, BPMP_MAINT_CLEAN_WAY, buf, size);
+}
+
+void bpmp_cache_invalidate(const void *buf, u32 size)
+{
+	_bpmp_cache_range(BPMP_MAINT_INVALID_PHY, BPMP_MAINT_INVALID_WAY, buf, size);
+}
+
+typedef struct _bpmp_clk_t
+{
+	u32 pllc4_divn; // With DIVM 4, off a 38.4MHz oscillator.
+	u32 sd0_uv;     // Core rail for the rate. Setting it waits for the PMIC to ramp.
+} bpmp_clk_t;
+
+// PLLC4_OUT3 divides by 1.5.
+static const bpmp_clk_t _bpmp_clks[BPMP_CLK_MAX] = {
+	{  0, 1125000 },
+	{ 85, 1175000 }
+};
+
+static u32 _bpmp_clk_fid = BPMP_CLK_NORMAL;
+static u32 _bpmp_clk_system_rate;
+
+static int _bpmp_pllc4_enable(u32 divn)
+{
+	CLOCK(CLK_RST_CONTROLLER_PLLC4_BASE) &= ~(1 << 18); // Leave IDDQ.
+	usleep(5);
+	CLOCK(CLK_RST_CONTROLLER_PLLC4_BASE) = (divn << 8) | 4; // DIVP 1.
+	CLOCK(CLK_RST_CONTROLLER_PLLC4_BASE) |= 1 << 30;
+
+	u32 timeout = get_tmr_us() + 1000;
+	while (!(CLOCK(CLK_RST_CONTROLLER_PLLC4_BASE) & (1 << 27)))
+		if (get_tmr_us() > timeout)
+			return 0;
+
+	// OUT3 ratio 1 divides by 1.5, then take it out of reset.
+	CLOCK(CLK_RST_CONTROLLER_PLLC4_OUT) = (1 << 8) | 2;
+	usleep(2);
+	CLOCK(CLK_RST_CONTROLLER_PLLC4_OUT) |= 1;
+
+	return 1;
+}
+
+static void _bpmp_pllc4_disable()
+{
+	CLOCK(CLK_RST_CONTROLLER_PLLC4_OUT) &= ~3;
+	CLOCK(CLK_RST_CONTROLLER_PLLC4_BASE) &= ~(1 << 30);
+	CLOCK(CLK_RST_CONTROLLER_PLLC4_BASE) |= 1 << 18;
+}
+
+void bpmp_clk_rate_set(u32 fid)
+{
+	if (fid >= BPMP_CLK_MAX)
+		fid = BPMP_CLK_MAX - 1;
+	if (fid == _bpmp_clk_fid)
+		return;
+
+	// Always pass through PLLP, so PLLC4 can be reprogrammed.
+	if (_bpmp_clk_fid != BPMP_CLK_NORMAL)
+	{
+		CLOCK(CLK_RST_CONTROLLER_SCLK_BURST_POLICY) = (CLOCK(CLK_RST_CONTROLLER_SCLK_BURST_POLICY) & 0xFFFF8888) | 0x3333;
+		usleep(2);
+		CLOCK(CLK_RST_CONTROLLER_CLK_SYSTEM_RATE) = _bpmp_clk_system_rate;
+		_bpmp_pllc4_disable();
+		// Voltage comes down only after the clock did.
+		max77620_regulator_set_voltage(REGULATOR_SD0, _bpmp_clks[BPMP_CLK_NORMAL].sd0_uv);
+		_bpmp_clk_fid = BPMP_CLK_NORMAL;
+	}
+
+	if (fid == BPMP_CLK_NORMAL)
+		return;
+
+	// And goes up before the clock does.
+	if (!max77620_regulator_set_voltage(REGULATOR_SD0, _bpmp_clks[fid].sd0_uv))
+		return;
+	if (!_bpmp_pllc4_enable(_bpmp_clks[fid].pllc4_divn))
+	{
+		_bpmp_pllc4_disable();
+		max77620_regulator_set_voltage(REGULATOR_SD0, _bpmp_clks[BPMP_CLK_NORMAL].sd0_uv);
+		return;
+	}
+
+	// APB stays at or below the 136MHz it gets from PLLP: PCLK = HCLK / 4, the largest divider.
+	_bpmp_clk_system_rate = CLOCK(CLK_RST_CONTROLLER_CLK_SYSTEM_RATE);
+	CLOCK(CLK_RST_CONTROLLER_CLK_SYSTEM_RATE) = (_bpmp_clk_system_rate & ~3) | 3;
+	usleep(2);
+	CLOCK(CLK_RST_CONTROLLER_SCLK_BURST_POLICY) = (CLOCK(CLK_RST_CONTROLLER_SCLK_BURST_POLICY) & 0xFFFF8888) | 0x3323;
+	_bpmp_clk_fid = fid;
+}
+
+u32 bpmp_clk_rate_get()
+{
+	return _bpmp_clk_fid;
+}
+
+u32 bpmp_clk_boost()
+{
+	u32 prev = _bpmp_clk_fid;
+	const sensors_t *sensors = sensors_get(SENSORS_MAX_AGE_MS);
+
+	// A fuel gauge that doesn't answer gets the benefit of the doubt.
+	u32 fid = BPMP_CLK_MAX_BOOST;
+	if ((sensors->valid & SENSORS_BATT_VALID) && (sensors->batt_temp > BPMP_BOOST_MAX_TEMP ||
+		(sensors->batt_percent >> 8) < BPMP_BOOST_MIN_CHARGE))
+		fid = BPMP_CLK_NORMAL;
+
+	if (fid > prev)
+		bpmp_clk_rate_set(fid);
+
+	return prev;
+}
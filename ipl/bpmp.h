@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 naehrwert
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BPMP_H_
+#define _BPMP_H_
+
+#include "types.h"
+
+#define BPMP_CACHE_BASE 0x50040000
+#define BPMP_CACHE(off) (*(vu32 *)(BPMP_CACHE_BASE + (off)))
+
+/*! Cache controller registers. */
+#define BPMP_CACHE_CONFIG 0x0
+#define  CACHE_CFG_ENABLE (1 << 0)
+#define  CACHE_CFG_FORCE_WRITE_THROUGH (1 << 3)
+#define  CACHE_CFG_DISABLE_SAMELINE (1 << 16)
+#define BPMP_CACHE_MAINT_ADDR 0x20
+#define BPMP_CACHE_MAINT_REQ 0x28
+#define  CACHE_MAINT_WAY_BITMAP(x) ((x) << 8)
+#define BPMP_CACHE_INT_MASK 0x40
+#define BPMP_CACHE_INT_CLEAR 0x44
+#define BPMP_CACHE_INT_RAW_EVENT 0x48
+#define  CACHE_INT_MAINT_DONE (1 << 0)
+#define BPMP_CACHE_MMU_FALLBACK_ENTRY 0xA0
+#define BPMP_CACHE_MMU_SHADOW_COPY_MASK 0xA4
+#define BPMP_CACHE_MMU_CFG 0xAC
+#define  MMU_CFG_SEQ_EN (1 << 1)
+#define  MMU_CFG_TLB_EN (1 << 2)
+#define  MMU_CFG_ABORT_STORE_LAST (1 << 4)
+#define BPMP_CACHE_MMU_CMD 0xB0
+#define  MMU_CMD_INIT 1
+#define  MMU_CMD_COPY_SHADOW 2
+#define BPMP_CACHE_MMU_SHADOW_ENTRY 0x400
+
+/*! MMU region attributes. */
+#define MMU_EN_CACHED (1 << 0)
+#define MMU_EN_EXEC (1 << 1)
+#define MMU_EN_READ (1 << 2)
+#define MMU_EN_WRITE (1 << 3)
+
+/*! Maintenance operations, by physical address or over all ways. */
+#define BPMP_MAINT_CLEAN_PHY 1
+#define BPMP_MAINT_INVALID_PHY 2
+#define BPMP_MAINT_CLEAN_INVALID_PHY 3
+#define BPMP_MAINT_CLEAN_WAY 17
+#define BPMP_MAINT_INVALID_WAY 18
+#define BPMP_MAINT_CLEAN_INVALID_WAY 19
+
+#define BPMP_CACHE_LINE_SIZE 0x20
+/*! Past this size a whole-cache operation is cheaper than walking the lines. */
+#define BPMP_CACHE_RANGE_MAX 0x2000
+
+/*! BPMP/SCLK rates. Boosts come from PLLC4_OUT3, NORMAL is PLLP. */
+#define BPMP_CLK_NORMAL 0    // 408MHz.
+#define BPMP_CLK_MAX_BOOST 1 // 544MHz. APB can't divide a faster SCLK below 136MHz.
+#define BPMP_CLK_MAX 2
+
+/*! No boost when the battery is this hot (0.1 C) or this empty (%). */
+#define BPMP_BOOST_MAX_TEMP 450
+#define BPMP_BOOST_MIN_CHARGE 10
+
+void bpmp_cache_enable();
+void bpmp_cache_disable();
+int bpmp_cache_enabled();
+/*! Before a device reads a buffer: push CPU writes out to DRAM. */
+void bpmp_cache_clean(const void *buf, u32 size);
+/*! After a device wrote a buffer: drop the stale lines. */
+void bpmp_cache_invalidate(const void *buf, u32 size);
+void bpmp_clk_rate_set(u32 fid);
+u32 bpmp_clk_rate_get();
+/*! Raises the clock as far as the battery allows. Returns the rate to go back to with bpmp_clk_rate_set(). */
+u32 bpmp_clk_boost();
+
+#endif
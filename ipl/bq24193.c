@@ -20,13 +20,27 @@
 #include "i2c.h"
 #include "util.h"
 
-int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
+static const u8 _bq24193_prop_regs[] = {
+	BQ24193_InputSource, BQ24193_InputSource, BQ24193_PORConfig, BQ24193_ChrgCurr,
+	BQ24193_ChrgVolt, BQ24193_ChrgVolt, BQ24193_IRCompThermal, BQ24193_Status,
+	BQ24193_FaultReg, BQ24193_VendorPart, BQ24193_VendorPart
+};
+
+int bq24193_read_regs(u8 *regs)
+{
+	if (!i2c_recv_buf(regs, BQ24193_NUM_REGS, I2C_1, BQ24193_I2C_ADDR, BQ24193_InputSource))
+		return -1;
+
+	return 0;
+}
+
+int bq24193_get_property_regs(const u8 *regs, enum BQ24193_reg_prop prop, int *value)
 {
 	u8 data;
 
 	switch (prop) {
 		case BQ24193_InputVoltageLimit: // Input voltage limit (mV).
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_InputSource);
+			data = regs[BQ24193_InputSource];
 			data = (data & BQ24193_INCONFIG_VINDPM_MASK) >> 3;
 			*value += ((data >> 0) & 1) ? 80 : 0;
 			*value += ((data >> 1) & 1) ? 160 : 0;
@@ -35,7 +49,7 @@ int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
 			*value += 3880;
 			break;
 		case BQ24193_InputCurrentLimit: // Input current limit (mA).
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_InputSource);
+			data = regs[BQ24193_InputSource];
 			data &= BQ24193_INCONFIG_INLIMIT_MASK;
 			switch (data)
 			{
@@ -66,13 +80,13 @@ int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
 			}
 			break;
 		case BQ24193_SystemMinimumVoltage: // Minimum system voltage limit (mV).
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_PORConfig);
+			data = regs[BQ24193_PORConfig];
 			*value = (data & BQ24193_PORCONFIG_SYSMIN_MASK) >> 1;
 			*value *= 100;
 			*value += 3000;
 			break;
 		case BQ24193_FastChargeCurrentLimit: // Fast charge current limit (mA).
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_ChrgCurr);
+			data = regs[BQ24193_ChrgCurr];
 			data = (data & BQ24193_CHRGCURR_ICHG_MASK) >> 2;
 			*value += ((data >> 0) & 1) ? 64 : 0;
 			*value += ((data >> 1) & 1) ? 128 : 0;
@@ -81,13 +95,13 @@ int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
 			*value += ((data >> 4) & 1) ? 1024 : 0;
 			*value += ((data >> 5) & 1) ? 2048 : 0;
 			*value += 512;
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_ChrgCurr);
+			data = regs[BQ24193_ChrgCurr];
 			data &= BQ24193_CHRGCURR_20PCT_MASK;
 			if (data)
 				*value = *value * 20 / 100; // Fast charge current limit is 20%.
 			break;
 		case BQ24193_ChargeVoltageLimit: // Charge voltage limit (mV).
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_ChrgVolt);
+			data = regs[BQ24193_ChrgVolt];
 			data = (data & BQ24193_CHRGVOLT_VREG) >> 2; 
 			*value += ((data >> 0) & 1) ? 16 : 0;
 			*value += ((data >> 1) & 1) ? 32 : 0;
@@ -98,7 +112,7 @@ int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
 			*value += 3504;
 			break;
 		case BQ24193_RechargeThreshold: // Recharge voltage threshold less than voltage limit (mV).
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_ChrgVolt);
+			data = regs[BQ24193_ChrgVolt];
 			data &= BQ24193_IRTHERMAL_THERM_MASK;
 			if (data)
 				*value = 300;
@@ -106,7 +120,7 @@ int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
 				*value = 100;
 			break;
 		case BQ24193_ThermalRegulation: // Thermal regulation threshold (oC).
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_IRCompThermal);
+			data = regs[BQ24193_IRCompThermal];
 			data &= BQ24193_IRTHERMAL_THERM_MASK;
 			switch (data)
 			{
@@ -125,19 +139,19 @@ int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
 			}
 			break;
 		case BQ24193_ChargeStatus: // 0: Not charging, 1: Pre-charge, 2: Fast charging, 3: Charge termination done
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_Status);
+			data = regs[BQ24193_Status];
 			*value = (data & BQ24193_STATUS_CHRG_MASK) >> 4;
 			break;
 		case BQ24193_TempStatus: // 0: Normal, 2: Warm, 3: Cool, 5: Cold, 6: Hot.
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_FaultReg);
+			data = regs[BQ24193_FaultReg];
 			*value = data & BQ24193_FAULT_THERM_MASK;
 			break;
 		case BQ24193_DevID: // Dev ID.
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_VendorPart);
+			data = regs[BQ24193_VendorPart];
 			*value = data & BQ24193_VENDORPART_DEV_MASK;
 			break;
 		case BQ24193_ProductNumber: // Product number.
-			data = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, BQ24193_VendorPart);
+			data = regs[BQ24193_VendorPart];
 			*value = (data & BQ24193_VENDORPART_PN_MASK) >> 3;
 			break;
 		default:
@@ -146,6 +160,19 @@ int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
 	return 0;
 }
 
+int bq24193_get_property(enum BQ24193_reg_prop prop, int *value)
+{
+	u8 regs[BQ24193_NUM_REGS];
+
+	if (prop > BQ24193_ProductNumber)
+		return -1;
+
+	u32 reg = _bq24193_prop_regs[prop];
+	regs[reg] = i2c_recv_byte(I2C_1, BQ24193_I2C_ADDR, reg);
+
+	return bq24193_get_property_regs(regs, prop, value);
+}
+
 void bq24193_fake_battery_removal()
 {
 	u8  value;
@@ -19,6 +19,8 @@
 #ifndef __BQ24193_H_
 #define __BQ24193_H_
 
+#include "types.h"
+
 #define BQ24193_I2C_ADDR 0x6B
 
 // REG 0 masks.
@@ -99,6 +101,8 @@ enum BQ24193_reg {
 	BQ24193_VendorPart      = 0x0A,
 };
 
+#define BQ24193_NUM_REGS 11
+
 enum BQ24193_reg_prop {
 	BQ24193_InputVoltageLimit,      // REG 0.
 	BQ24193_InputCurrentLimit,      // REG 0.
@@ -114,6 +118,9 @@ enum BQ24193_reg_prop {
 };
 
 int bq24193_get_property(enum BQ24193_reg_prop prop, int *value);
+// Burst read all BQ24193_NUM_REGS registers, for decoding several properties at once.
+int bq24193_read_regs(u8 *regs);
+int bq24193_get_property_regs(const u8 *regs, enum BQ24193_reg_prop prop, int *value);
 void bq24193_fake_battery_removal();
 
 #endif /* __BQ24193_H_ */
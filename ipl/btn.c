@@ -18,9 +18,14 @@
 #include "btn.h"
 #include "i2c.h"
 #include "gpio.h"
+#include "idle.h"
 #include "t210.h"
+#include "task.h"
+#include "trace.h"
 #include "util.h"
 
+extern void sd_card_poll();
+
 u32 btn_read()
 {
 	u32 res = 0;
@@ -47,6 +52,10 @@ u32 btn_wait()
 
 	do
 	{
+		trace_poll();
+		sd_card_poll();
+		idle_poll();
+		task_yield();
 		res = btn_read();
 		//Power button up, remove filter.
 		if (!(res & BTN_POWER) && pwr)
@@ -65,6 +74,10 @@ u32 btn_wait_timeout(u32 time_ms, u32 mask)
 
 	do
 	{
+		trace_poll();
+		sd_card_poll();
+		idle_poll();
+		task_yield();
 		if (!(res & mask))
 			res = btn_read() & mask;
 	} while (get_tmr_ms() < timeout);
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "ccplex.h"
+#include "bpmp.h"
+#include "cluster.h"
+#include "heap.h"
+#include "se.h"
+#include "util.h"
+
+#include "ccplex_worker.inl"
+
+#define CCPLEX_IMG_SIZE 0x2000
+#define CCPLEX_TTBR_OFF 0x1000
+#define CCPLEX_STEAL_OFF 0x1800
+#define CCPLEX_SCRATCH_OFF 0x1C00
+#define CCPLEX_DIGEST_OFF 0x1E00 // Digests written by the cores, CCPLEX_MAX_DIGESTS * 0x20 past the image.
+
+// Level 1 block descriptors, AP[1] set as required for the EL3 regime.
+#define CCPLEX_PTE_DEVICE 0x441
+#define CCPLEX_PTE_NORMAL 0x745
+#define CCPLEX_PTE_NORMAL_NC 0x749
+#define CCPLEX_PTE_XN_HI (1 << 22) // Bit 54.
+
+enum
+{
+	CCPLEX_OFF = 0,
+	CCPLEX_STARTING,
+	CCPLEX_READY,
+	CCPLEX_FAILED
+};
+
+static ccplex_mbox_t *const _mbox = (ccplex_mbox_t *)CCPLEX_MBOX_ADDR;
+static u32 *_ccplex_img = NULL;
+static u8 *_ccplex_digests = NULL;
+static u32 _ccplex_state = CCPLEX_OFF;
+static u32 _ccplex_seq = 0;
+// What the running job writes, dropped from the BPMP cache once it's done.
+static void *_ccplex_out = NULL;
+static u32 _ccplex_out_size = 0;
+static u32 _ccplex_start_time;
+
+int ccplex_worker_start()
+{
+	if (_ccplex_state != CCPLEX_OFF)
+		return _ccplex_state != CCPLEX_FAILED;
+
+	// Kept for the whole session, so stale I-cache lines can never alias other data.
+	if (!_ccplex_img)
+	{
+		_ccplex_img = (u32 *)memalign(0x1000, CCPLEX_IMG_SIZE + CCPLEX_MAX_DIGESTS * 0x20);
+		if (!_ccplex_img)
+			return 0;
+		_ccplex_digests = (u8 *)_ccplex_img + CCPLEX_IMG_SIZE;
+	}
+
+	memset(_ccplex_img, 0, CCPLEX_IMG_SIZE);
+	memcpy(_ccplex_img, _ccplex_worker, sizeof(_ccplex_worker));
+	_ccplex_img[2] = CCPLEX_MBOX_ADDR;
+	_ccplex_img[4] = (u32)_ccplex_img + CCPLEX_TTBR_OFF;
+	_ccplex_img[6] = (u32)_ccplex_img + CCPLEX_STEAL_OFF;
+	_ccplex_img[8] = (u32)_ccplex_img + CCPLEX_SCRATCH_OFF;
+
+	// 0-2GB is IROM/IRAM/MMIO, 2-3GB holds every buffer we hand out, 3-4GB is framebuffer and mailbox.
+	u32 *l1 = _ccplex_img + CCPLEX_TTBR_OFF / 4;
+	l1[0] = 0x00000000 | CCPLEX_PTE_DEVICE;
+	l1[1] = CCPLEX_PTE_XN_HI;
+	l1[2] = 0x40000000 | CCPLEX_PTE_DEVICE;
+	l1[3] = CCPLEX_PTE_XN_HI;
+	l1[4] = 0x80000000 | CCPLEX_PTE_NORMAL;
+	l1[6] = 0xC0000000 | CCPLEX_PTE_NORMAL_NC;
+
+	memset((void *)_mbox, 0, sizeof(ccplex_mbox_t));
+	_ccplex_seq = 0;
+
+	// All four cores leave reset together and run the same image.
+	bpmp_cache_clean(_ccplex_img, CCPLEX_IMG_SIZE);
+	_ccplex_out = NULL;
+	cluster_boot_cpu0((u32)_ccplex_img, 0);
+	cluster_power_secondary();
+	_ccplex_start_time = get_tmr_us();
+	_ccplex_state = CCPLEX_STARTING;
+
+	return 1;
+}
+
+static int _ccplex_self_test()
+{
+	// Catches a core without the crypto/CRC extensions or a broken cache setup, before any real data.
+	u8 *a = (u8 *)memalign(DMA_BUF_ALIGN, 0x100);
+	u8 *b = (u8 *)memalign(DMA_BUF_ALIGN, 0x100);
+	u8 hash[0x20];
+	int res = 1;
+
+	for (u32 i = 0; i < 0xC8; i++)
+		a[i] = b[i] = i * 7 + 3;
+
+	// Two blocks, each taking a different padding path.
+	if (!ccplex_submit(CCPLEX_OP_SHA256_MT, _ccplex_digests, a, 0xC8, 0x78))
+		res = 0;
+	ccplex_wait();
+	se_calc_sha256(hash, a, 0x78);
+	res &= !memcmp(hash, _ccplex_digests, 0x20);
+	se_calc_sha256(hash, a + 0x78, 0x50);
+	res &= !memcmp(hash, _ccplex_digests + 0x20, 0x20);
+
+	res &= ccplex_submit(CCPLEX_OP_MEMCMP_MT, b, a, 0xC8, 0x40) && ccplex_wait() == 0;
+	b[0xC0] ^= 1;
+	res &= ccplex_submit(CCPLEX_OP_MEMCMP_MT, b, a, 0xC8, 0x40) && ccplex_wait() == 1;
+
+	res &= ccplex_submit(CCPLEX_OP_CRC32C, NULL, a, 0xC8, ~0) && ~ccplex_wait() == crc32c(a, 0xC8);
+
+	free(a);
+	free(b);
+
+	return res;
+}
+
+static int _ccplex_ready()
+{
+	if (_ccplex_state == CCPLEX_STARTING)
+	{
+		// Wait for all cores, but settle for the ones that made it by the timeout.
+		u32 active = 0;
+		while (active != (1 << CCPLEX_MAX_CORES) - 1)
+		{
+			active = 0;
+			for (u32 i = 0; i < CCPLEX_MAX_CORES; i++)
+				if (_mbox->ready[i] == CCPLEX_WORKER_READY)
+					active |= 1 << i;
+
+			if (get_tmr_us() - _ccplex_start_time > CCPLEX_READY_TIMEOUT_US)
+				break;
+		}
+
+		// CPU0 is needed for everything.
+		_mbox->active = active;
+		_ccplex_state = (active & 1) ? CCPLEX_READY : CCPLEX_FAILED;
+
+		if (_ccplex_state == CCPLEX_READY && !_ccplex_self_test())
+			_ccplex_state = CCPLEX_FAILED;
+
+		// Don't try again this session.
+		if (_ccplex_state == CCPLEX_FAILED)
+			cluster_halt_cpu0();
+	}
+
+	return _ccplex_state == CCPLEX_READY;
+}
+
+void ccplex_worker_stop()
+{
+	if (_ccplex_state == CCPLEX_READY)
+	{
+		// Let the last job finish its writeback first.
+		ccplex_wait();
+		cluster_halt_cpu0();
+	}
+	else if (_ccplex_state == CCPLEX_STARTING)
+		cluster_halt_cpu0();
+	else
+		return;
+
+	_ccplex_state = CCPLEX_OFF;
+}
+
+u32 ccplex_worker_cores()
+{
+	if (!_ccplex_ready())
+		return 0;
+
+	u32 cores = 0;
+	for (u32 i = 0; i < CCPLEX_MAX_CORES; i++)
+		if (_mbox->active & (1 << i))
+			cores++;
+
+	return cores;
+}
+
+int ccplex_submit(u32 op, void *dst, const void *src, u32 size, u32 arg)
+{
+	if (_ccplex_state != CCPLEX_READY && !_ccplex_ready())
+		return 0;
+
+	// Split jobs are limited by the block counter.
+	if ((op == CCPLEX_OP_MEMCMP_MT || op == CCPLEX_OP_SHA256_MT) && (!arg || size / arg >= CCPLEX_MAX_BLOCKS))
+		return 0;
+
+	ccplex_wait();
+
+	// The cores read straight from DRAM.
+	bpmp_cache_clean(src, src ? size : 0);
+	if (op == CCPLEX_OP_MEMCMP_MT || op == CCPLEX_OP_MEMCMP)
+		bpmp_cache_clean(dst, size);
+	_ccplex_out = NULL;
+	if (op == CCPLEX_OP_MEMCPY || op == CCPLEX_OP_MEMSET)
+	{
+		_ccplex_out = dst;
+		_ccplex_out_size = size;
+	}
+	else if (op == CCPLEX_OP_SHA256_MT)
+	{
+		_ccplex_out = dst;
+		_ccplex_out_size = (size + arg - 1) / arg * 0x20;
+	}
+
+	_mbox->op = op;
+	_mbox->arg = arg;
+	_mbox->src = (u32)src;
+	_mbox->dst = (u32)dst;
+	_mbox->size = size;
+	_mbox->res = 0;
+	// The sequence write publishes the job.
+	_mbox->seq = ++_ccplex_seq;
+
+	return 1;
+}
+
+int ccplex_poll()
+{
+	for (u32 i = 0; i < CCPLEX_MAX_CORES; i++)
+		if ((_mbox->active & (1 << i)) && _mbox->done[i] != _ccplex_seq)
+			return 0;
+
+	return 1;
+}
+
+u32 ccplex_wait()
+{
+	while (!ccplex_poll())
+		;
+
+	if (_ccplex_out)
+	{
+		bpmp_cache_invalidate(_ccplex_out, _ccplex_out_size);
+		_ccplex_out = NULL;
+	}
+
+	return _mbox->res;
+}
+
+void ccplex_memcpy(void *dst, const void *src, u32 size)
+{
+	if (size < CCPLEX_MIN_JOB || !ccplex_submit(CCPLEX_OP_MEMCPY, dst, src, size, 0))
+	{
+		memcpy(dst, src, size);
+		return;
+	}
+	ccplex_wait();
+}
+
+int ccplex_memcmp(const void *a, const void *b, u32 size)
+{
+	// Enough blocks to keep every core busy and let the fast ones steal from the slow.
+	u32 blk = ALIGN(size / (CCPLEX_MAX_CORES * 4), DMA_BUF_ALIGN);
+	if (size < CCPLEX_MIN_JOB || !ccplex_submit(CCPLEX_OP_MEMCMP_MT, (void *)b, a, size, MAX(blk, 0x1000)))
+		return memcmp(a, b, size) ? 1 : 0;
+
+	return ccplex_wait();
+}
+
+u32 ccplex_crc32c(u32 crc, const void *buf, u32 size)
+{
+	// Same convention as crc32c_update, the worker runs on the raw register.
+	if (size < CCPLEX_MIN_JOB || !ccplex_submit(CCPLEX_OP_CRC32C, NULL, buf, size, ~crc))
+		return crc32c_update(crc, buf, size);
+
+	return ~ccplex_wait();
+}
+
+int ccplex_sha256_submit(const void *src, u32 size)
+{
+	if (size < CCPLEX_MIN_JOB)
+		return 0;
+
+	// A single block, so one core does it while the rest stay idle.
+	return ccplex_submit(CCPLEX_OP_SHA256_MT, _ccplex_digests, src, size, size);
+}
+
+void ccplex_sha256_finish(void *digest)
+{
+	ccplex_wait();
+	memcpy(digest, _ccplex_digests, 0x20);
+}
+
+void ccplex_sha256(void *digest, const void *src, u32 size)
+{
+	if (!ccplex_sha256_submit(src, size))
+	{
+		se_calc_sha256(digest, src, size);
+		return;
+	}
+	ccplex_sha256_finish(digest);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CCPLEX_H_
+#define _CCPLEX_H_
+
+#include "types.h"
+#include "memmap.h"
+
+/*! The worker maps 0xC0000000+ uncached, so the mailbox lives there, away from the framebuffer. */
+#define CCPLEX_MBOX_ADDR MEM_CCPLEX_START
+#define CCPLEX_WORKER_READY 0x43504C58 // XLPC.
+#define CCPLEX_READY_TIMEOUT_US 100000
+/*! Below this the power-up and cache maintenance cost more than the BPMP loop. */
+#define CCPLEX_MIN_JOB 0x10000
+
+#define CCPLEX_OP_MEMCPY 1
+#define CCPLEX_OP_MEMSET 2
+#define CCPLEX_OP_MEMCMP 3
+#define CCPLEX_OP_CRC32C 4
+#define CCPLEX_OP_MEMCMP_MT 5
+#define CCPLEX_OP_SHA256_MT 6
+
+#define CCPLEX_MAX_CORES 4
+/*! Split jobs tag the block counter with the job sequence, leaving 16 bits for blocks. */
+#define CCPLEX_MAX_BLOCKS 0xFFF0
+/*! Digests of a SHA-256 job land here first, so callers' buffers never share a line with the cores. */
+#define CCPLEX_MAX_DIGESTS 64
+
+typedef struct _ccplex_mbox_t
+{
+	vu32 seq;
+	vu32 op;
+	vu32 arg;
+	vu32 src;
+	vu32 dst;
+	vu32 size;
+	vu32 res;
+	vu32 active;
+	vu32 ready[CCPLEX_MAX_CORES];
+	vu32 done[CCPLEX_MAX_CORES];
+} ccplex_mbox_t;
+
+/*
+ * Jobs run on the A57 cores while the BPMP keeps going. Buffers must stay in DRAM
+ * below 0xC0000000 and must not be touched by the BPMP until the job is done.
+ * Cache lines straddling dst are written back whole, so keep dst cache aligned.
+ */
+int ccplex_worker_start();
+void ccplex_worker_stop();
+u32 ccplex_worker_cores();
+int ccplex_submit(u32 op, void *dst, const void *src, u32 size, u32 arg);
+int ccplex_poll();
+u32 ccplex_wait();
+
+// Run on the A57 cores when they are up, otherwise on the BPMP. ccplex_memcmp only tells equal (0) from different (1).
+void ccplex_memcpy(void *dst, const void *src, u32 size);
+int ccplex_memcmp(const void *a, const void *b, u32 size);
+u32 ccplex_crc32c(u32 crc, const void *buf, u32 size);
+void ccplex_sha256(void *digest, const void *src, u32 size);
+// SHA-256 of one chunk, overlapped with other BPMP work. Fails if the cores are not up.
+int ccplex_sha256_submit(const void *src, u32 size);
+void ccplex_sha256_finish(void *digest);
+
+#endif
@@ -0,0 +1,532 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * AArch64 worker for CPU0, started by ccplex_worker_start.
+ * The BPMP toolchain cannot build it, so it is kept pre-assembled.
+ * Rebuild with: llvm-mc -triple=aarch64 -mattr=+crc,+sha2,+neon -filetype=obj, then objcopy -O binary.
+ *
+ * Runs on all four cores. Each enables SMP coherency and an identity map
+ * (caches on), then loops on the mailbox. Ops 1-4 (memcpy, memset, memcmp,
+ * crc32c on the raw state in arg) run on CPU0. Ops 5 (memcmp) and 6 (SHA-256
+ * per block) are split into arg sized blocks that the active cores claim
+ * from a shared counter until none are left.
+ * Buffers are cleaned+invalidated to PoC before and after each job.
+ *
+ *     .text
+ *     .globl    _start
+ * _start:
+ *     b    entry
+ *     .word    0
+ * mbox_addr:
+ *     .quad    0
+ * ttbr_addr:
+ *     .quad    0
+ * steal_addr:
+ *     .quad    0
+ * scratch_addr:
+ *     .quad    0
+ *
+ *     // SHA-256 round helpers, t0/t1 alternate so the next add overlaps the rounds.
+ *     .macro    add_only, ev, rc, s0
+ *     mov    v26.16b, v24.16b
+ *     .ifeq    \ev
+ *     add    v23.4s, v\s0\().4s, \rc\().4s
+ *     sha256h    q24, q25, v22.4s
+ *     sha256h2    q25, q26, v22.4s
+ *     .else
+ *     .ifnb    \s0
+ *     add    v22.4s, v\s0\().4s, \rc\().4s
+ *     .endif
+ *     sha256h    q24, q25, v23.4s
+ *     sha256h2    q25, q26, v23.4s
+ *     .endif
+ *     .endm
+ *
+ *     .macro    add_update, ev, rc, s0, s1, s2, s3
+ *     sha256su0    v\s0\().4s, v\s1\().4s
+ *     add_only    \ev, \rc, \s1
+ *     sha256su1    v\s0\().4s, v\s2\().4s, v\s3\().4s
+ *     .endm
+ *
+ * entry:
+ *     // CPUECTLR.SMPEN, needed before the caches are enabled.
+ *     mrs    x0, S3_1_C15_C2_1
+ *     orr    x0, x0, #(1 << 6)
+ *     msr    S3_1_C15_C2_1, x0
+ *     // Don't trap FP/SIMD.
+ *     msr    cptr_el3, xzr
+ *     isb
+ *     ldr    x19, mbox_addr
+ *     ldr    x28, steal_addr
+ *     mrs    x27, mpidr_el1
+ *     and    x27, x27, #3
+ *     ldr    x26, scratch_addr
+ *     add    x26, x26, x27, lsl #7
+ *     // Identity map, 1GB blocks. MAIR: 0 device, 1 normal WB, 2 normal NC.
+ *     ldr    x0, ttbr_addr
+ *     msr    ttbr0_el3, x0
+ *     movz    x0, #0xFF00
+ *     movk    x0, #0x44, lsl #16
+ *     msr    mair_el3, x0
+ *     movz    x0, #0x3520
+ *     movk    x0, #0x8080, lsl #16
+ *     msr    tcr_el3, x0
+ *     isb
+ *     tlbi    alle3
+ *     ic    iallu
+ *     dsb    sy
+ *     isb
+ *     // MMU, D and I caches on, alignment checks off.
+ *     mrs    x0, sctlr_el3
+ *     bic    x0, x0, #(1 << 1)
+ *     orr    x0, x0, #(1 << 0)
+ *     orr    x0, x0, #(1 << 2)
+ *     orr    x0, x0, #(1 << 12)
+ *     msr    sctlr_el3, x0
+ *     isb
+ *     // Last seen sequence, then announce this core.
+ *     mov    w20, #0
+ *     movz    w0, #0x4C58
+ *     movk    w0, #0x4350, lsl #16
+ *     add    x1, x19, #32
+ *     str    w0, [x1, x27, lsl #2]
+ *     dsb    sy
+ *
+ *     // Mailbox: 0 seq, 4 op, 8 arg, 12 src, 16 dst, 20 size, 24 res, 28 active, 32 ready[4], 48 done[4].
+ * loop:
+ *     ldr    w21, [x19, #0]
+ *     cmp    w21, w20
+ *     b.eq    loop
+ *     dmb    sy
+ *     mov    w20, w21
+ *     // Cores outside the active mask sit the job out.
+ *     ldr    w0, [x19, #28]
+ *     lsr    w0, w0, w27
+ *     tbz    w0, #0, loop
+ *     ldr    w22, [x19, #4]
+ *     ldr    w4, [x19, #8]
+ *     ldr    w1, [x19, #12]
+ *     ldr    w2, [x19, #16]
+ *     ldr    w3, [x19, #20]
+ *     cmp    w22, #5
+ *     b.eq    op_memcmp_mt
+ *     cmp    w22, #6
+ *     b.eq    op_sha256_mt
+ *     // The rest runs on CPU0 only.
+ *     cbnz    x27, finish
+ *
+ *     // Drop stale lines of both buffers. The dst range is pushed out again when done.
+ *     mov    x24, x2
+ *     mov    x25, x3
+ *     mov    x0, x1
+ *     mov    x5, x3
+ *     cbz    x1, 1f
+ *     bl    civac
+ * 1:    mov    x0, x2
+ *     mov    x5, x3
+ *     cbz    x2, 2f
+ *     bl    civac
+ * 2:    mov    w23, #0
+ *     cmp    w22, #1
+ *     b.eq    op_memcpy
+ *     cmp    w22, #2
+ *     b.eq    op_memset
+ *     cmp    w22, #3
+ *     b.eq    op_memcmp
+ *     cmp    w22, #4
+ *     b.eq    op_crc32c
+ *     b    done
+ *
+ * op_memcpy:
+ * 1:    cmp    x3, #64
+ *     b.lo    2f
+ *     ldp    x6, x7, [x1]
+ *     ldp    x8, x9, [x1, #16]
+ *     ldp    x10, x11, [x1, #32]
+ *     ldp    x12, x13, [x1, #48]
+ *     add    x1, x1, #64
+ *     stp    x6, x7, [x2]
+ *     stp    x8, x9, [x2, #16]
+ *     stp    x10, x11, [x2, #32]
+ *     stp    x12, x13, [x2, #48]
+ *     add    x2, x2, #64
+ *     sub    x3, x3, #64
+ *     b    1b
+ * 2:    cbz    x3, done
+ *     ldrb    w6, [x1], #1
+ *     strb    w6, [x2], #1
+ *     sub    x3, x3, #1
+ *     b    2b
+ *
+ * op_memset:
+ *     and    x4, x4, #0xFF
+ *     orr    x4, x4, x4, lsl #8
+ *     orr    x4, x4, x4, lsl #16
+ *     orr    x4, x4, x4, lsl #32
+ * 1:    cmp    x3, #64
+ *     b.lo    2f
+ *     stp    x4, x4, [x2]
+ *     stp    x4, x4, [x2, #16]
+ *     stp    x4, x4, [x2, #32]
+ *     stp    x4, x4, [x2, #48]
+ *     add    x2, x2, #64
+ *     sub    x3, x3, #64
+ *     b    1b
+ * 2:    cbz    x3, done
+ *     strb    w4, [x2], #1
+ *     sub    x3, x3, #1
+ *     b    2b
+ *
+ * op_memcmp:
+ *     mov    x25, #0
+ * 1:    cmp    x3, #16
+ *     b.lo    2f
+ *     ldp    x6, x7, [x1], #16
+ *     ldp    x8, x9, [x2], #16
+ *     sub    x3, x3, #16
+ *     cmp    x6, x8
+ *     ccmp    x7, x9, #0, eq
+ *     b.eq    1b
+ *     b    3f
+ * 2:    cbz    x3, done
+ *     ldrb    w6, [x1], #1
+ *     ldrb    w7, [x2], #1
+ *     sub    x3, x3, #1
+ *     cmp    w6, w7
+ *     b.eq    2b
+ * 3:    mov    w23, #1
+ *     b    done
+ *
+ * op_crc32c:
+ *     mov    w23, w4
+ *     mov    x25, #0
+ * 1:    cmp    x3, #32
+ *     b.lo    2f
+ *     ldp    x6, x7, [x1], #16
+ *     ldp    x8, x9, [x1], #16
+ *     crc32cx    w23, w23, x6
+ *     crc32cx    w23, w23, x7
+ *     crc32cx    w23, w23, x8
+ *     crc32cx    w23, w23, x9
+ *     sub    x3, x3, #32
+ *     b    1b
+ * 2:    cbz    x3, done
+ *     ldrb    w6, [x1], #1
+ *     crc32cb    w23, w23, w6
+ *     sub    x3, x3, #1
+ *     b    2b
+ *
+ * done:
+ *     mov    x0, x24
+ *     mov    x5, x25
+ *     cbz    x0, 1f
+ *     bl    civac
+ * 1:    str    w23, [x19, #24]
+ *     dmb    sy
+ *     b    finish
+ *
+ *     // Split jobs: x10 src, x11 dst, x12 size, x13 block size. Blocks are claimed one at a time.
+ * op_memcmp_mt:
+ *     mov    x10, x1
+ *     mov    x11, x2
+ *     mov    x12, x3
+ *     mov    x13, x4
+ * mc_next:
+ *     // Stop early once any core found a difference.
+ *     ldr    w0, [x19, #24]
+ *     cbnz    w0, finish
+ *     bl    claim
+ *     bl    block_range
+ *     b.hs    finish
+ *     add    x1, x10, x14
+ *     add    x2, x11, x14
+ *     mov    x0, x1
+ *     mov    x5, x15
+ *     bl    civac
+ *     mov    x0, x2
+ *     mov    x5, x15
+ *     bl    civac
+ *     mov    x3, x15
+ * 1:    cmp    x3, #64
+ *     b.lo    2f
+ *     ld1    {v0.16b-v3.16b}, [x1], #64
+ *     ld1    {v4.16b-v7.16b}, [x2], #64
+ *     eor    v0.16b, v0.16b, v4.16b
+ *     eor    v1.16b, v1.16b, v5.16b
+ *     eor    v2.16b, v2.16b, v6.16b
+ *     eor    v3.16b, v3.16b, v7.16b
+ *     orr    v0.16b, v0.16b, v1.16b
+ *     orr    v2.16b, v2.16b, v3.16b
+ *     orr    v0.16b, v0.16b, v2.16b
+ *     umaxp    v0.4s, v0.4s, v0.4s
+ *     fmov    x0, d0
+ *     sub    x3, x3, #64
+ *     cbz    x0, 1b
+ *     b    3f
+ * 2:    cbz    x3, mc_next
+ *     ldrb    w6, [x1], #1
+ *     ldrb    w7, [x2], #1
+ *     sub    x3, x3, #1
+ *     cmp    w6, w7
+ *     b.eq    2b
+ * 3:    mov    w0, #1
+ *     str    w0, [x19, #24]
+ *     dsb    sy
+ *     b    finish
+ *
+ *     // One digest per block, stored at dst + index * 32.
+ * op_sha256_mt:
+ *     mov    x10, x1
+ *     mov    x11, x2
+ *     mov    x12, x3
+ *     mov    x13, x4
+ *     adr    x0, sha256_k
+ *     ld1    {v0.4s-v3.4s}, [x0], #64
+ *     ld1    {v4.4s-v7.4s}, [x0], #64
+ *     ld1    {v8.4s-v11.4s}, [x0], #64
+ *     ld1    {v12.4s-v15.4s}, [x0]
+ * sh_next:
+ *     bl    claim
+ *     bl    block_range
+ *     b.hs    finish
+ *     add    x1, x10, x14
+ *     mov    x0, x1
+ *     mov    x5, x15
+ *     bl    civac
+ *     adr    x0, sha256_h
+ *     ld1    {v20.4s, v21.4s}, [x0]
+ *     lsr    x3, x15, #6
+ *     bl    sha_blocks
+ *     // Tail and padding go through this core's scratch buffer.
+ *     mov    x0, x26
+ *     stp    xzr, xzr, [x0], #16
+ *     stp    xzr, xzr, [x0], #16
+ *     stp    xzr, xzr, [x0], #16
+ *     stp    xzr, xzr, [x0], #16
+ *     stp    xzr, xzr, [x0], #16
+ *     stp    xzr, xzr, [x0], #16
+ *     stp    xzr, xzr, [x0], #16
+ *     stp    xzr, xzr, [x0], #16
+ *     and    x3, x15, #63
+ *     mov    x0, x26
+ * 4:    cbz    x3, 5f
+ *     ldrb    w6, [x1], #1
+ *     strb    w6, [x0], #1
+ *     sub    x3, x3, #1
+ *     b    4b
+ * 5:    mov    w6, #0x80
+ *     strb    w6, [x0]
+ *     and    x3, x15, #63
+ *     lsl    x6, x15, #3
+ *     rev    x6, x6
+ *     mov    x7, #1
+ *     cmp    x3, #56
+ *     b.lo    6f
+ *     mov    x7, #2
+ * 6:    add    x0, x26, x7, lsl #6
+ *     stur    x6, [x0, #-8]
+ *     mov    x1, x26
+ *     mov    x3, x7
+ *     bl    sha_blocks
+ *     rev32    v20.16b, v20.16b
+ *     rev32    v21.16b, v21.16b
+ *     add    x0, x11, x9, lsl #5
+ *     st1    {v20.16b, v21.16b}, [x0]
+ *     mov    x5, #32
+ *     bl    civac
+ *     b    sh_next
+ *
+ * finish:
+ *     add    x0, x19, #48
+ *     str    w21, [x0, x27, lsl #2]
+ *     b    loop
+ *
+ * // x9 = next block of job w21. The counter is tagged with the job, so the first claim resets it.
+ * claim:
+ *     and    w6, w21, #0xFFFF
+ * 1:    ldaxr    w7, [x28]
+ *     lsr    w8, w7, #16
+ *     cmp    w8, w6
+ *     b.ne    2f
+ *     and    w9, w7, #0xFFFF
+ *     add    w8, w7, #1
+ *     b    3f
+ * 2:    mov    w9, #0
+ *     lsl    w8, w6, #16
+ *     orr    w8, w8, #1
+ * 3:    stlxr    w5, w8, [x28]
+ *     cbnz    w5, 1b
+ *     ret
+ *
+ * // x14 = block offset, x15 = block length. Flags HS when past the end.
+ * block_range:
+ *     mul    x14, x9, x13
+ *     sub    x15, x12, x14
+ *     cmp    x15, x13
+ *     csel    x15, x15, x13, lo
+ *     cmp    x14, x12
+ *     ret
+ *
+ * // x3 blocks at x1 into v20/v21. K is in v0-v15.
+ * sha_blocks:
+ *     cbz    x3, 9f
+ * 1:    ld1    {v16.16b-v19.16b}, [x1], #64
+ *     sub    x3, x3, #1
+ *     rev32    v16.16b, v16.16b
+ *     rev32    v17.16b, v17.16b
+ *     rev32    v18.16b, v18.16b
+ *     rev32    v19.16b, v19.16b
+ *     add    v22.4s, v16.4s, v0.4s
+ *     mov    v24.16b, v20.16b
+ *     mov    v25.16b, v21.16b
+ *     add_update    0,  v1, 16, 17, 18, 19
+ *     add_update    1,  v2, 17, 18, 19, 16
+ *     add_update    0,  v3, 18, 19, 16, 17
+ *     add_update    1,  v4, 19, 16, 17, 18
+ *     add_update    0,  v5, 16, 17, 18, 19
+ *     add_update    1,  v6, 17, 18, 19, 16
+ *     add_update    0,  v7, 18, 19, 16, 17
+ *     add_update    1,  v8, 19, 16, 17, 18
+ *     add_update    0,  v9, 16, 17, 18, 19
+ *     add_update    1, v10, 17, 18, 19, 16
+ *     add_update    0, v11, 18, 19, 16, 17
+ *     add_update    1, v12, 19, 16, 17, 18
+ *     add_only    0, v13, 17
+ *     add_only    1, v14, 18
+ *     add_only    0, v15, 19
+ *     add_only    1
+ *     add    v20.4s, v20.4s, v24.4s
+ *     add    v21.4s, v21.4s, v25.4s
+ *     cbnz    x3, 1b
+ * 9:    ret
+ *
+ * // Clean and invalidate [x0, x0 + x5) to PoC.
+ * civac:
+ *     cbz    x5, 2f
+ *     add    x5, x0, x5
+ *     bic    x0, x0, #63
+ * 1:    dc    civac, x0
+ *     add    x0, x0, #64
+ *     cmp    x0, x5
+ *     b.lo    1b
+ * 2:    dsb    sy
+ *     ret
+ *
+ *     .balign    16
+ * sha256_h:
+ *     .word    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a
+ *     .word    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+ * sha256_k:
+ *     .word    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5
+ *     .word    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5
+ *     .word    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3
+ *     .word    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174
+ *     .word    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc
+ *     .word    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da
+ *     .word    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7
+ *     .word    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967
+ *     .word    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13
+ *     .word    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85
+ *     .word    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3
+ *     .word    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070
+ *     .word    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5
+ *     .word    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3
+ *     .word    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208
+ *     .word    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+ */
+
+static const u32 _ccplex_worker[] = {
+	0x1400000A, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0xD539F220, 0xB27A0000,
+	0xD519F220, 0xD51E115F, 0xD5033FDF, 0x58FFFE73, 0x58FFFEDC, 0xD53800BB,
+	0x9240077B, 0x58FFFEBA, 0x8B1B1F5A, 0x58FFFDE0, 0xD51E2000, 0xD29FE000,
+	0xF2A00880, 0xD51EA200, 0xD286A400, 0xF2B01000, 0xD51E2040, 0xD5033FDF,
+	0xD50E871F, 0xD508751F, 0xD5033F9F, 0xD5033FDF, 0xD53E1000, 0x927EF800,
+	0xB2400000, 0xB27E0000, 0xB2740000, 0xD51E1000, 0xD5033FDF, 0x52800014,
+	0x52898B00, 0x72A86A00, 0x91008261, 0xB83B7820, 0xD5033F9F, 0xB9400275,
+	0x6B1402BF, 0x54FFFFC0, 0xD5033FBF, 0x2A1503F4, 0xB9401E60, 0x1ADB2400,
+	0x3607FF20, 0xB9400676, 0xB9400A64, 0xB9400E61, 0xB9401262, 0xB9401663,
+	0x710016DF, 0x54000CC0, 0x71001ADF, 0x54001200, 0xB500191B, 0xAA0203F8,
+	0xAA0303F9, 0xAA0103E0, 0xAA0303E5, 0xB4000041, 0x9400013E, 0xAA0203E0,
+	0xAA0303E5, 0xB4000042, 0x9400013A, 0x52800017, 0x710006DF, 0x54000100,
+	0x71000ADF, 0x54000320, 0x71000EDF, 0x54000500, 0x710012DF, 0x54000700,
+	0x14000048, 0xF101007F, 0x540001A3, 0xA9401C26, 0xA9412428, 0xA9422C2A,
+	0xA943342C, 0x91010021, 0xA9001C46, 0xA9012448, 0xA9022C4A, 0xA903344C,
+	0x91010042, 0xD1010063, 0x17FFFFF3, 0xB4000723, 0x38401426, 0x38001446,
+	0xD1000463, 0x17FFFFFC, 0x92401C84, 0xAA042084, 0xAA044084, 0xAA048084,
+	0xF101007F, 0x54000103, 0xA9001044, 0xA9011044, 0xA9021044, 0xA9031044,
+	0x91010042, 0xD1010063, 0x17FFFFF8, 0xB40004E3, 0x38001444, 0xD1000463,
+	0x17FFFFFD, 0xD2800019, 0xF100407F, 0x54000103, 0xA8C11C26, 0xA8C12448,
+	0xD1004063, 0xEB0800DF, 0xFA4900E0, 0x54FFFF20, 0x14000007, 0xB4000323,
+	0x38401426, 0x38401447, 0xD1000463, 0x6B0700DF, 0x54FFFF60, 0x52800037,
+	0x14000012, 0x2A0403F7, 0xD2800019, 0xF100807F, 0x54000123, 0xA8C11C26,
+	0xA8C12428, 0x9AC65EF7, 0x9AC75EF7, 0x9AC85EF7, 0x9AC95EF7, 0xD1008063,
+	0x17FFFFF7, 0xB40000A3, 0x38401426, 0x1AC652F7, 0xD1000463, 0x17FFFFFC,
+	0xAA1803E0, 0xAA1903E5, 0xB4000040, 0x940000E5, 0xB9001A77, 0xD5033FBF,
+	0x14000066, 0xAA0103EA, 0xAA0203EB, 0xAA0303EC, 0xAA0403ED, 0xB9401A60,
+	0x35000C00, 0x94000062, 0x9400006F, 0x54000BA2, 0x8B0E0141, 0x8B0E0162,
+	0xAA0103E0, 0xAA0F03E5, 0x940000D4, 0xAA0203E0, 0xAA0F03E5, 0x940000D1,
+	0xAA0F03E3, 0xF101007F, 0x540001E3, 0x4CDF2020, 0x4CDF2044, 0x6E241C00,
+	0x6E251C21, 0x6E261C42, 0x6E271C63, 0x4EA11C00, 0x4EA31C42, 0x4EA21C00,
+	0x6EA0A400, 0x9E660000, 0xD1010063, 0xB4FFFE40, 0x14000007, 0xB4FFFC43,
+	0x38401426, 0x38401447, 0xD1000463, 0x6B0700DF, 0x54FFFF60, 0x52800020,
+	0xB9001A60, 0xD5033F9F, 0x1400003A, 0xAA0103EA, 0xAA0203EB, 0xAA0303EC,
+	0xAA0403ED, 0x100018A0, 0x4CDF2800, 0x4CDF2804, 0x4CDF2808, 0x4C40280C,
+	0x94000033, 0x94000040, 0x540005C2, 0x8B0E0141, 0xAA0103E0, 0xAA0F03E5,
+	0x940000A6, 0x10001620, 0x4C40A814, 0xD346FDE3, 0x9400003D, 0xAA1A03E0,
+	0xA8817C1F, 0xA8817C1F, 0xA8817C1F, 0xA8817C1F, 0xA8817C1F, 0xA8817C1F,
+	0xA8817C1F, 0xA8817C1F, 0x924015E3, 0xAA1A03E0, 0xB40000A3, 0x38401426,
+	0x38001406, 0xD1000463, 0x17FFFFFC, 0x52801006, 0x39000006, 0x924015E3,
+	0xD37DF1E6, 0xDAC00CC6, 0xD2800027, 0xF100E07F, 0x54000043, 0xD2800047,
+	0x8B071B40, 0xF81F8006, 0xAA1A03E1, 0xAA0703E3, 0x9400001F, 0x6E200A94,
+	0x6E200AB5, 0x8B091560, 0x4C00A014, 0xD2800405, 0x9400007E, 0x17FFFFD1,
+	0x9100C260, 0xB83B7815, 0x17FFFF25, 0x12003EA6, 0x885FFF87, 0x53107CE8,
+	0x6B06011F, 0x54000081, 0x12003CE9, 0x110004E8, 0x14000004, 0x52800009,
+	0x53103CC8, 0x32000108, 0x8805FF88, 0x35FFFEA5, 0xD65F03C0, 0x9B0D7D2E,
+	0xCB0E018F, 0xEB0D01FF, 0x9A8D31EF, 0xEB0C01DF, 0xD65F03C0, 0xB4000C83,
+	0x4CDF2030, 0xD1000463, 0x6E200A10, 0x6E200A31, 0x6E200A52, 0x6E200A73,
+	0x4EA08616, 0x4EB41E98, 0x4EB51EB9, 0x5E282A30, 0x4EB81F1A, 0x4EA18637,
+	0x5E164338, 0x5E165359, 0x5E136250, 0x5E282A51, 0x4EB81F1A, 0x4EA28656,
+	0x5E174338, 0x5E175359, 0x5E106271, 0x5E282A72, 0x4EB81F1A, 0x4EA38677,
+	0x5E164338, 0x5E165359, 0x5E116212, 0x5E282A13, 0x4EB81F1A, 0x4EA48616,
+	0x5E174338, 0x5E175359, 0x5E126233, 0x5E282A30, 0x4EB81F1A, 0x4EA58637,
+	0x5E164338, 0x5E165359, 0x5E136250, 0x5E282A51, 0x4EB81F1A, 0x4EA68656,
+	0x5E174338, 0x5E175359, 0x5E106271, 0x5E282A72, 0x4EB81F1A, 0x4EA78677,
+	0x5E164338, 0x5E165359, 0x5E116212, 0x5E282A13, 0x4EB81F1A, 0x4EA88616,
+	0x5E174338, 0x5E175359, 0x5E126233, 0x5E282A30, 0x4EB81F1A, 0x4EA98637,
+	0x5E164338, 0x5E165359, 0x5E136250, 0x5E282A51, 0x4EB81F1A, 0x4EAA8656,
+	0x5E174338, 0x5E175359, 0x5E106271, 0x5E282A72, 0x4EB81F1A, 0x4EAB8677,
+	0x5E164338, 0x5E165359, 0x5E116212, 0x5E282A13, 0x4EB81F1A, 0x4EAC8616,
+	0x5E174338, 0x5E175359, 0x5E126233, 0x4EB81F1A, 0x4EAD8637, 0x5E164338,
+	0x5E165359, 0x4EB81F1A, 0x4EAE8656, 0x5E174338, 0x5E175359, 0x4EB81F1A,
+	0x4EAF8677, 0x5E164338, 0x5E165359, 0x4EB81F1A, 0x5E174338, 0x5E175359,
+	0x4EB88694, 0x4EB986B5, 0xB5FFF3C3, 0xD65F03C0, 0xB40000E5, 0x8B050005,
+	0x927AE400, 0xD50B7E20, 0x91010000, 0xEB05001F, 0x54FFFFA3, 0xD5033F9F,
+	0xD65F03C0, 0xD503201F, 0xD503201F, 0xD503201F, 0x6A09E667, 0xBB67AE85,
+	0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1,
+	0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+	0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786,
+	0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+	0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+	0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B,
+	0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A,
+	0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+	0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
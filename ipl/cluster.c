@@ -64,7 +64,7 @@ int _cluster_pmc_enable_partition(u32 part, u32 toggle)
 	return 1;
 }
 
-void cluster_boot_cpu0(u32 entry)
+void cluster_boot_cpu0(u32 entry, int lock)
 {
 	// Set ACTIVE_CLUSER to FAST.
 	FLOW_CTLR(FLOW_CTLR_BPMP_CLUSTER_CONTROL) &= 0xFFFFFFFE;
@@ -114,9 +114,12 @@ void cluster_boot_cpu0(u32 entry)
 	// Set reset vector.
 	SB(SB_AA64_RESET_LOW) = entry | 1;
 	SB(SB_AA64_RESET_HIGH) = 0;
-	// Non-secure reset vector write disable.
-	SB(SB_CSR) = 2;
-	(void)SB(SB_CSR);
+	// Non-secure reset vector write disable. Skipped for our own workers, so secmon can be booted later.
+	if (lock)
+	{
+		SB(SB_CSR) = 2;
+		(void)SB(SB_CSR);
+	}
 
 	// Clear MSELECT reset.
 	CLOCK(CLK_RST_CONTROLLER_RST_DEVICES_V) &= 0xFFFFFFF7;
@@ -125,3 +128,17 @@ void cluster_boot_cpu0(u32 entry)
 	// Clear CPU{0,1,2,3} POR and CORE, CX0, L2, and DBG reset.
 	CLOCK(CLK_RST_CONTROLLER_RST_CPUG_CMPLX_CLR) = 0x411F000F;
 }
+
+void cluster_halt_cpu0()
+{
+	// Put CPU{0,1,2,3} back into POR and CORE, CX0, L2, and DBG reset.
+	CLOCK(CLK_RST_CONTROLLER_RST_CPUG_CMPLX_SET) = 0x411F000F;
+}
+
+void cluster_power_secondary()
+{
+	// CE1, CE2 and CE3. They stay powered after a halt; secmon finds them in reset like cold ones.
+	_cluster_pmc_enable_partition(0x200, 9);
+	_cluster_pmc_enable_partition(0x400, 10);
+	_cluster_pmc_enable_partition(0x800, 11);
+}
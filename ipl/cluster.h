@@ -24,6 +24,14 @@
 #define FLOW_CTLR_RAM_REPAIR 0x40
 #define FLOW_CTLR_BPMP_CLUSTER_CONTROL 0x98
 
-void cluster_boot_cpu0(u32 entry);
+/*! HALT_COP_EVENTS wake events and modes. */
+#define HALT_COP_LIC_IRQ   (1 << 11)
+#define HALT_COP_USEC      (1 << 25)
+#define HALT_COP_WAITEVENT (2 << 29)
+#define HALT_COP_MAX_CNT   0xFF
+
+void cluster_boot_cpu0(u32 entry, int lock);
+void cluster_halt_cpu0();
+void cluster_power_secondary();
 
 #endif
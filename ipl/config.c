@@ -42,6 +42,9 @@ void set_default_configuration()
 	h_cfg.bootwait = 3;
 	h_cfg.customlogo = 0;
 	h_cfg.verification = 2;
+	h_cfg.backup_format = 0;
+	h_cfg.restore_cache = 0;
+	h_cfg.fastboot = 0;
 	h_cfg.se_keygen_done = 0;
 	h_cfg.sbar_time_keeping = 0;
 }
@@ -60,6 +63,8 @@ int create_config_entry()
 	{
 		if (f_open(&fp, "hekate_ipl.ini", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
 			return 0;
+		// Timestamps are fixed without an RTC, so drop the compiled copy explicitly.
+		ini_cache_invalidate("hekate_ipl.ini");
 		// Add config entry.
 		f_puts("[config]\nautoboot=", &fp);
 		itoa(h_cfg.autoboot, lbuf, 10);
@@ -73,6 +78,15 @@ int create_config_entry()
 		f_puts("\nverification=", &fp);
 		itoa(h_cfg.verification, lbuf, 10);
 		f_puts(lbuf, &fp);
+		f_puts("\nbackupformat=", &fp);
+		itoa(h_cfg.backup_format, lbuf, 10);
+		f_puts(lbuf, &fp);
+		f_puts("\nrestorecache=", &fp);
+		itoa(h_cfg.restore_cache, lbuf, 10);
+		f_puts(lbuf, &fp);
+		f_puts("\nfastboot=", &fp);
+		itoa(h_cfg.fastboot, lbuf, 10);
+		f_puts(lbuf, &fp);
 		f_puts("\n", &fp);
 
 		// Re-construct existing entries.
@@ -364,16 +378,73 @@ void config_customlogo()
 	btn_wait();
 }
 
+void config_fastboot()
+{
+	gfx_clear_grey(&gfx_ctxt, 0x1B);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	ment_t *ments = (ment_t *)malloc(sizeof(ment_t) * 5);
+	u32 *cb_values = (u32 *)malloc(sizeof(u32) * 2);
+
+	for (u32 j = 0; j < 2; j++)
+	{
+		cb_values[j] = j;
+		ments[j + 2].type = MENT_CHOICE;
+		ments[j + 2].data = &cb_values[j];
+	}
+
+	ments[0].type = MENT_BACK;
+	ments[0].caption = "Back";
+
+	ments[1].type = MENT_CHGLINE;
+
+	if (h_cfg.fastboot)
+	{
+		ments[2].caption = " Disable";
+		ments[3].caption = "*Enable";
+	}
+	else
+	{
+		ments[2].caption = "*Disable";
+		ments[3].caption = " Enable";
+	}
+
+	memset(&ments[4], 0, sizeof(ment_t));
+	menu_t menu = {ments, "Fast boot (no display)", 0, 0};
+
+	u32 *temp_fastboot = (u32 *)tui_do_menu(&gfx_con, &menu);
+	if (temp_fastboot != NULL)
+	{
+		gfx_clear_grey(&gfx_ctxt, 0x1B);
+		gfx_con_setpos(&gfx_con, 0, 0);
+
+		h_cfg.fastboot = *(u32 *)temp_fastboot;
+		// Save choice to ini file.
+		if (!create_config_entry())
+			gfx_puts(&gfx_con, "\nConfiguration was saved!\n");
+		else
+			EPRINTF("\nConfiguration saving failed!");
+		gfx_puts(&gfx_con, "\nPress any key...");
+	}
+
+	free(ments);
+	free(cb_values);
+
+	if (temp_fastboot == NULL)
+		return;
+	btn_wait();
+}
+
 void config_verification()
 {
 	gfx_clear_grey(&gfx_ctxt, 0x1B);
 	gfx_con_setpos(&gfx_con, 0, 0);
 
-	ment_t *ments = (ment_t *)malloc(sizeof(ment_t) * 6);
-	u32 *vr_values = (u32 *)malloc(sizeof(u32) * 3);
-	char *vr_text = (char *)malloc(64 * 3);
+	ment_t *ments = (ment_t *)malloc(sizeof(ment_t) * 7);
+	u32 *vr_values = (u32 *)malloc(sizeof(u32) * 4);
+	char *vr_text = (char *)malloc(64 * 4);
 
-	for (u32 j = 0; j < 3; j++)
+	for (u32 j = 0; j < 4; j++)
 	{
 		vr_values[j] = j;
 		ments[j + 2].type = MENT_CHOICE;
@@ -388,8 +459,9 @@ void config_verification()
 	memcpy(vr_text,       " Disable", 9);
 	memcpy(vr_text + 64,  " Sparse (Fast - Not  reliable)", 31);
 	memcpy(vr_text + 128, " Full   (Slow - 100% reliable)", 31);
+	memcpy(vr_text + 192, " Exact  (Fast - 100% reliable)", 31);
 
-	for (u32 i = 0; i < 3; i++)
+	for (u32 i = 0; i < 4; i++)
 	{
 		if (h_cfg.verification != i)
 		{
@@ -403,7 +475,7 @@ void config_verification()
 		}
 	}
 
-	memset(&ments[5], 0, sizeof(ment_t));
+	memset(&ments[6], 0, sizeof(ment_t));
 	menu_t menu = {ments, "Backup & Restore verification", 0, 0};
 
 	u32 *temp_verification = (u32 *)tui_do_menu(&gfx_con, &menu);
@@ -429,3 +501,124 @@ void config_verification()
 		return;
 	btn_wait();
 }
+
+void config_backup_format()
+{
+	gfx_clear_grey(&gfx_ctxt, 0x1B);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	ment_t *ments = (ment_t *)malloc(sizeof(ment_t) * 6);
+	u32 *bf_values = (u32 *)malloc(sizeof(u32) * 3);
+	char *bf_text = (char *)malloc(64 * 3);
+
+	for (u32 j = 0; j < 3; j++)
+	{
+		bf_values[j] = j;
+		ments[j + 2].type = MENT_CHOICE;
+		ments[j + 2].data = &bf_values[j];
+	}
+
+	ments[0].type = MENT_BACK;
+	ments[0].caption = "Back";
+
+	ments[1].type = MENT_CHGLINE;
+
+	memcpy(bf_text,       " Raw    (Plain image)", 22);
+	memcpy(bf_text + 64,  " Sparse (Skip zero chunks)", 27);
+	memcpy(bf_text + 128, " LZ     (Compressed, slower)", 29);
+
+	for (u32 i = 0; i < 3; i++)
+	{
+		if (h_cfg.backup_format != i)
+			bf_text[64 * i] = ' ';
+		else
+			bf_text[64 * i] = '*';
+		ments[2 + i].caption = bf_text + (i * 64);
+	}
+
+	memset(&ments[5], 0, sizeof(ment_t));
+	menu_t menu = {ments, "Backup format", 0, 0};
+
+	u32 *temp_backup_format = (u32 *)tui_do_menu(&gfx_con, &menu);
+	if (temp_backup_format != NULL)
+	{
+		gfx_clear_grey(&gfx_ctxt, 0x1B);
+		gfx_con_setpos(&gfx_con, 0, 0);
+
+		h_cfg.backup_format = *(u32 *)temp_backup_format;
+		// Save choice to ini file.
+		if (!create_config_entry())
+			gfx_puts(&gfx_con, "\nConfiguration was saved!\n");
+		else
+			EPRINTF("\nConfiguration saving failed!");
+		gfx_puts(&gfx_con, "\nPress any key...");
+	}
+
+	free(ments);
+	free(bf_values);
+	free(bf_text);
+
+	if (temp_backup_format == NULL)
+		return;
+	btn_wait();
+}
+
+void config_restore_cache()
+{
+	gfx_clear_grey(&gfx_ctxt, 0x1B);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	ment_t *ments = (ment_t *)malloc(sizeof(ment_t) * 5);
+	u32 *rc_values = (u32 *)malloc(sizeof(u32) * 2);
+	char *rc_text = (char *)malloc(64 * 2);
+
+	for (u32 j = 0; j < 2; j++)
+	{
+		rc_values[j] = j;
+		ments[j + 2].type = MENT_CHOICE;
+		ments[j + 2].data = &rc_values[j];
+	}
+
+	ments[0].type = MENT_BACK;
+	ments[0].caption = "Back";
+
+	ments[1].type = MENT_CHGLINE;
+
+	memcpy(rc_text,      " Direct (Every write committed)", 32);
+	memcpy(rc_text + 64, " Cached (eMMC cache, one flush)", 32);
+
+	for (u32 i = 0; i < 2; i++)
+	{
+		if (h_cfg.restore_cache != i)
+			rc_text[64 * i] = ' ';
+		else
+			rc_text[64 * i] = '*';
+		ments[2 + i].caption = rc_text + (i * 64);
+	}
+
+	memset(&ments[4], 0, sizeof(ment_t));
+	menu_t menu = {ments, "Restore write mode", 0, 0};
+
+	u32 *temp_restore_cache = (u32 *)tui_do_menu(&gfx_con, &menu);
+	if (temp_restore_cache != NULL)
+	{
+		gfx_clear_grey(&gfx_ctxt, 0x1B);
+		gfx_con_setpos(&gfx_con, 0, 0);
+
+		h_cfg.restore_cache = *(u32 *)temp_restore_cache;
+		// Save choice to ini file.
+		if (!create_config_entry())
+			gfx_puts(&gfx_con, "\nConfiguration was saved!\n");
+		else
+			EPRINTF("\nConfiguration saving failed!");
+		gfx_puts(&gfx_con, "\nPress any key...");
+	}
+
+	free(ments);
+	free(rc_values);
+	free(rc_text);
+
+	if (temp_restore_cache == NULL)
+		return;
+	btn_wait();
+}
@@ -25,6 +25,9 @@ typedef struct _hekate_config
 	u32 bootwait;
 	u32 customlogo;
 	u32 verification;
+	u32 backup_format;
+	u32 restore_cache;
+	u32 fastboot;
 	// Global temporary config.
 	int se_keygen_done;
 	u32 sbar_time_keeping;
@@ -36,5 +39,8 @@ void config_autoboot();
 void config_bootdelay();
 void config_customlogo();
 void config_verification();
+void config_backup_format();
+void config_restore_cache();
+void config_fastboot();
 
 #endif /* _CONFIG_H_ */
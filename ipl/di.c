@@ -30,6 +30,8 @@
 #include "di.inl"
 
 static u32 _display_ver = 0;
+static u32 *_display_fb = (u32 *)DISPLAY_FB_ADDR;
+static int _display_fb_on = 0;
 
 static void _display_dsi_wait(u32 timeout, u32 off, u32 mask)
 {
@@ -39,102 +41,152 @@ static void _display_dsi_wait(u32 timeout, u32 off, u32 mask)
 	usleep(5);
 }
 
-void display_init()
+// Panel bring-up, split at its fixed delays. Each one is a minimum, so a step may also run late.
+#define DISPLAY_INIT_STEPS 9
+
+static u32 _display_init_step = DISPLAY_INIT_STEPS;
+static u32 _display_init_due = 0;
+
+// Runs one step and returns the delay in us before the next one.
+static u32 _display_init_run(u32 step)
 {
-	// Power on.
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_LDO0_CFG, 0xD0); // Configure to 1.2V.
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_GPIO7, 0x09);
-
-	// Enable MIPI CAL, DSI, DISP1, HOST1X, UART_FST_MIPI_CAL, DSIA LP clocks.
-	CLOCK(CLK_RST_CONTROLLER_RST_DEV_H_CLR) = 0x1010000;
-	CLOCK(CLK_RST_CONTROLLER_CLK_ENB_H_SET) = 0x1010000;
-	CLOCK(CLK_RST_CONTROLLER_RST_DEV_L_CLR) = 0x18000000;
-	CLOCK(CLK_RST_CONTROLLER_CLK_ENB_L_SET) = 0x18000000;
-	CLOCK(CLK_RST_CONTROLLER_CLK_ENB_X_SET) = 0x20000;
-	CLOCK(CLK_RST_CONTROLLER_CLK_SOURCE_UART_FST_MIP_CAL) = 0xA;
-	CLOCK(CLK_RST_CONTROLLER_CLK_ENB_W_SET) = 0x80000;
-	CLOCK(CLK_RST_CONTROLLER_CLK_SOURCE_DSIA_LP) = 0xA;
-
-	// DPD idle.
-	PMC(APBDEV_PMC_IO_DPD_REQ) = 0x40000000;
-	PMC(APBDEV_PMC_IO_DPD2_REQ) = 0x40000000;
-
-	// Config pins.
-	PINMUX_AUX(PINMUX_AUX_NFC_EN) &= ~PINMUX_TRISTATE;
-	PINMUX_AUX(PINMUX_AUX_NFC_INT) &= ~PINMUX_TRISTATE;
-	PINMUX_AUX(PINMUX_AUX_LCD_BL_PWM) &= ~PINMUX_TRISTATE;
-	PINMUX_AUX(PINMUX_AUX_LCD_BL_EN) &= ~PINMUX_TRISTATE;
-	PINMUX_AUX(PINMUX_AUX_LCD_RST) &= ~PINMUX_TRISTATE;
-
-	gpio_config(GPIO_PORT_I, GPIO_PIN_0 | GPIO_PIN_1, GPIO_MODE_GPIO); // Backlight +-5V.
-	gpio_output_enable(GPIO_PORT_I, GPIO_PIN_0 | GPIO_PIN_1, GPIO_OUTPUT_ENABLE); // Backlight +-5V.
-	gpio_write(GPIO_PORT_I, GPIO_PIN_0, GPIO_HIGH); // Backlight +5V enable.
+	switch (step)
+	{
+	case 0:
+		// Power on.
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_LDO0_CFG, 0xD0); // Configure to 1.2V.
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_GPIO7, 0x09);
 
-	usleep(10000);
+		// Enable MIPI CAL, DSI, DISP1, HOST1X, UART_FST_MIPI_CAL, DSIA LP clocks.
+		CLOCK(CLK_RST_CONTROLLER_RST_DEV_H_CLR) = 0x1010000;
+		CLOCK(CLK_RST_CONTROLLER_CLK_ENB_H_SET) = 0x1010000;
+		CLOCK(CLK_RST_CONTROLLER_RST_DEV_L_CLR) = 0x18000000;
+		CLOCK(CLK_RST_CONTROLLER_CLK_ENB_L_SET) = 0x18000000;
+		CLOCK(CLK_RST_CONTROLLER_CLK_ENB_X_SET) = 0x20000;
+		CLOCK(CLK_RST_CONTROLLER_CLK_SOURCE_UART_FST_MIP_CAL) = 0xA;
+		CLOCK(CLK_RST_CONTROLLER_CLK_ENB_W_SET) = 0x80000;
+		CLOCK(CLK_RST_CONTROLLER_CLK_SOURCE_DSIA_LP) = 0xA;
 
-	gpio_write(GPIO_PORT_I, GPIO_PIN_1, GPIO_HIGH); // Backlight -5V enable.
+		// DPD idle.
+		PMC(APBDEV_PMC_IO_DPD_REQ) = 0x40000000;
+		PMC(APBDEV_PMC_IO_DPD2_REQ) = 0x40000000;
 
-	usleep(10000);
+		// Config pins.
+		PINMUX_AUX(PINMUX_AUX_NFC_EN) &= ~PINMUX_TRISTATE;
+		PINMUX_AUX(PINMUX_AUX_NFC_INT) &= ~PINMUX_TRISTATE;
+		PINMUX_AUX(PINMUX_AUX_LCD_BL_PWM) &= ~PINMUX_TRISTATE;
+		PINMUX_AUX(PINMUX_AUX_LCD_BL_EN) &= ~PINMUX_TRISTATE;
+		PINMUX_AUX(PINMUX_AUX_LCD_RST) &= ~PINMUX_TRISTATE;
 
-	gpio_config(GPIO_PORT_V, GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_2, GPIO_MODE_GPIO); // Backlight PWM, Enable, Reset.
-	gpio_output_enable(GPIO_PORT_V, GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_2, GPIO_OUTPUT_ENABLE);
-	gpio_write(GPIO_PORT_V, GPIO_PIN_1, GPIO_HIGH); // Backlight Enable enable.
+		gpio_config(GPIO_PORT_I, GPIO_PIN_0 | GPIO_PIN_1, GPIO_MODE_GPIO); // Backlight +-5V.
+		gpio_output_enable(GPIO_PORT_I, GPIO_PIN_0 | GPIO_PIN_1, GPIO_OUTPUT_ENABLE); // Backlight +-5V.
+		gpio_write(GPIO_PORT_I, GPIO_PIN_0, GPIO_HIGH); // Backlight +5V enable.
 
-	// Config display interface and display.
-	MIPI_CAL(0x60) = 0;
+		return 10000;
 
-	exec_cfg((u32 *)CLOCK_BASE, _display_config_1, 4);
-	exec_cfg((u32 *)DISPLAY_A_BASE, _display_config_2, 94);
-	exec_cfg((u32 *)DSI_BASE, _display_config_3, 60);
+	case 1:
+		gpio_write(GPIO_PORT_I, GPIO_PIN_1, GPIO_HIGH); // Backlight -5V enable.
 
-	usleep(10000);
+		return 10000;
 
-	gpio_write(GPIO_PORT_V, GPIO_PIN_2, GPIO_HIGH); // Backlight Reset enable.
+	case 2:
+		gpio_config(GPIO_PORT_V, GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_2, GPIO_MODE_GPIO); // Backlight PWM, Enable, Reset.
+		gpio_output_enable(GPIO_PORT_V, GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_2, GPIO_OUTPUT_ENABLE);
+		gpio_write(GPIO_PORT_V, GPIO_PIN_1, GPIO_HIGH); // Backlight Enable enable.
 
-	usleep(60000);
+		// Config display interface and display.
+		MIPI_CAL(0x60) = 0;
 
-	DSI(_DSIREG(DSI_BTA_TIMING)) = 0x50204;
-	DSI(_DSIREG(DSI_WR_DATA)) = 0x337;
-	DSI(_DSIREG(DSI_TRIGGER)) = DSI_TRIGGER_HOST;
-	_display_dsi_wait(250000, _DSIREG(DSI_TRIGGER), DSI_TRIGGER_HOST | DSI_TRIGGER_VIDEO);
+		exec_cfg((u32 *)CLOCK_BASE, _display_config_1, 4);
+		exec_cfg((u32 *)DISPLAY_A_BASE, _display_config_2, 94);
+		exec_cfg((u32 *)DSI_BASE, _display_config_3, 60);
 
-	DSI(_DSIREG(DSI_WR_DATA)) = 0x406;
-	DSI(_DSIREG(DSI_TRIGGER)) = DSI_TRIGGER_HOST;
-	_display_dsi_wait(250000, _DSIREG(DSI_TRIGGER), DSI_TRIGGER_HOST | DSI_TRIGGER_VIDEO);
+		return 10000;
 
-	DSI(_DSIREG(DSI_HOST_CONTROL)) = DSI_HOST_CONTROL_TX_TRIG_HOST | DSI_HOST_CONTROL_IMM_BTA | DSI_HOST_CONTROL_CS | DSI_HOST_CONTROL_ECC;
-	_display_dsi_wait(150000, _DSIREG(DSI_HOST_CONTROL), DSI_HOST_CONTROL_IMM_BTA);
+	case 3:
+		gpio_write(GPIO_PORT_V, GPIO_PIN_2, GPIO_HIGH); // Backlight Reset enable.
 
-	usleep(5000);
+		return 60000;
 
-	_display_ver = DSI(_DSIREG(DSI_RD_DATA));
-	if (_display_ver == 0x10)
-		exec_cfg((u32 *)DSI_BASE, _display_config_4, 43);
+	case 4:
+		DSI(_DSIREG(DSI_BTA_TIMING)) = 0x50204;
+		DSI(_DSIREG(DSI_WR_DATA)) = 0x337;
+		DSI(_DSIREG(DSI_TRIGGER)) = DSI_TRIGGER_HOST;
+		_display_dsi_wait(250000, _DSIREG(DSI_TRIGGER), DSI_TRIGGER_HOST | DSI_TRIGGER_VIDEO);
 
-	DSI(_DSIREG(DSI_WR_DATA)) = 0x1105;
-	DSI(_DSIREG(DSI_TRIGGER)) = DSI_TRIGGER_HOST;
+		DSI(_DSIREG(DSI_WR_DATA)) = 0x406;
+		DSI(_DSIREG(DSI_TRIGGER)) = DSI_TRIGGER_HOST;
+		_display_dsi_wait(250000, _DSIREG(DSI_TRIGGER), DSI_TRIGGER_HOST | DSI_TRIGGER_VIDEO);
 
-	usleep(180000);
+		DSI(_DSIREG(DSI_HOST_CONTROL)) = DSI_HOST_CONTROL_TX_TRIG_HOST | DSI_HOST_CONTROL_IMM_BTA | DSI_HOST_CONTROL_CS | DSI_HOST_CONTROL_ECC;
+		_display_dsi_wait(150000, _DSIREG(DSI_HOST_CONTROL), DSI_HOST_CONTROL_IMM_BTA);
 
-	DSI(_DSIREG(DSI_WR_DATA)) = 0x2905;
-	DSI(_DSIREG(DSI_TRIGGER)) = DSI_TRIGGER_HOST;
+		usleep(5000);
 
-	usleep(20000);
+		_display_ver = DSI(_DSIREG(DSI_RD_DATA));
+		if (_display_ver == 0x10)
+			exec_cfg((u32 *)DSI_BASE, _display_config_4, 43);
 
-	exec_cfg((u32 *)DSI_BASE, _display_config_5, 21);
-	exec_cfg((u32 *)CLOCK_BASE, _display_config_6, 3);
-	DISPLAY_A(_DIREG(DC_DISP_DISP_CLOCK_CONTROL)) = 4;
-	exec_cfg((u32 *)DSI_BASE, _display_config_7, 10);
+		DSI(_DSIREG(DSI_WR_DATA)) = 0x1105;
+		DSI(_DSIREG(DSI_TRIGGER)) = DSI_TRIGGER_HOST;
 
-	usleep(10000);
+		return 180000;
 
-	exec_cfg((u32 *)MIPI_CAL_BASE, _display_config_8, 6);
-	exec_cfg((u32 *)DSI_BASE, _display_config_9, 4);
-	exec_cfg((u32 *)MIPI_CAL_BASE, _display_config_10, 16);
+	case 5:
+		DSI(_DSIREG(DSI_WR_DATA)) = 0x2905;
+		DSI(_DSIREG(DSI_TRIGGER)) = DSI_TRIGGER_HOST;
 
-	usleep(10000);
+		return 20000;
+
+	case 6:
+		exec_cfg((u32 *)DSI_BASE, _display_config_5, 21);
+		exec_cfg((u32 *)CLOCK_BASE, _display_config_6, 3);
+		DISPLAY_A(_DIREG(DC_DISP_DISP_CLOCK_CONTROL)) = 4;
+		exec_cfg((u32 *)DSI_BASE, _display_config_7, 10);
+
+		return 10000;
+
+	case 7:
+		exec_cfg((u32 *)MIPI_CAL_BASE, _display_config_8, 6);
+		exec_cfg((u32 *)DSI_BASE, _display_config_9, 4);
+		exec_cfg((u32 *)MIPI_CAL_BASE, _display_config_10, 16);
+
+		return 10000;
+
+	case 8:
+		exec_cfg((u32 *)DISPLAY_A_BASE, _display_config_11, 113);
+		break;
+	}
+
+	return 0;
+}
+
+void display_init_start()
+{
+	_display_init_step = 0;
+	_display_init_due = get_tmr_us();
+}
+
+int display_init_poll()
+{
+	if (_display_init_step >= DISPLAY_INIT_STEPS)
+		return 1;
 
-	exec_cfg((u32 *)DISPLAY_A_BASE, _display_config_11, 113);
+	// Wrap-safe, the microsecond timer rolls over every 71 minutes.
+	if ((s32)(get_tmr_us() - _display_init_due) < 0)
+		return 0;
+
+	u32 delay = _display_init_run(_display_init_step++);
+	_display_init_due = get_tmr_us() + delay;
+
+	return _display_init_step >= DISPLAY_INIT_STEPS;
+}
+
+void display_init()
+{
+	display_init_start();
+	while (!display_init_poll())
+		;
 }
 
 void display_backlight(u8 enable)
@@ -144,6 +196,7 @@ void display_backlight(u8 enable)
 
 void display_end()
 {
+	_display_fb_on = 0;
 	display_backlight(0);
 
 	//TODO: figure out why this freezes.
@@ -200,6 +253,7 @@ void display_end()
 
 void display_color_screen(u32 color)
 {
+	_display_fb_on = 0;
 	exec_cfg((u32 *)DISPLAY_A_BASE, cfg_display_one_color, 8);
 
 	// Configure display to show single color.
@@ -217,11 +271,44 @@ void display_color_screen(u32 color)
 u32 *display_init_framebuffer()
 {
 	// Sanitize framebuffer area.
-	memset((u32 *)0xC0000000, 0, 0x3C0000);
+	memset(_display_fb, 0, DISPLAY_FB_SIZE);
 	// This configures the framebuffer @ 0xC0000000 with a resolution of 1280x720 (line stride 768).
 	exec_cfg((u32 *)DISPLAY_A_BASE, cfg_display_framebuffer, 32);
 
 	usleep(35000);
 
-	return (u32 *)0xC0000000;
+	// Keep scanning out whichever buffer was last flipped to.
+	_display_fb_on = 1;
+	if (_display_fb != (u32 *)DISPLAY_FB_ADDR)
+		display_flip(_display_fb);
+
+	return _display_fb;
+}
+
+u32 *display_resume_framebuffer()
+{
+	// The window is still configured, only bring it back to the default buffer.
+	_display_fb_on = 1;
+	display_flip(_display_fb);
+
+	return _display_fb;
+}
+
+int display_flip(u32 *fb)
+{
+	if (!_display_fb_on)
+		return 0;
+
+	DISPLAY_A(_DIREG(DC_CMD_DISPLAY_WINDOW_HEADER)) = WINDOW_A_SELECT;
+	DISPLAY_A(_DIREG(DC_WINBUF_START_ADDR)) = (u32)fb;
+	DISPLAY_A(_DIREG(DC_CMD_STATE_CONTROL)) = WIN_A_UPDATE;
+	DISPLAY_A(_DIREG(DC_CMD_STATE_CONTROL)) = WIN_A_ACT_REQ;
+
+	// The new address is latched at the next frame start, the old buffer is free after that.
+	u32 end = get_tmr_us() + 35000;
+	while (get_tmr_us() < end && DISPLAY_A(_DIREG(DC_CMD_STATE_CONTROL)) & WIN_A_ACT_REQ)
+		;
+	_display_fb = fb;
+
+	return 1;
 }
@@ -19,6 +19,7 @@
 #define _DI_H_
 
 #include "types.h"
+#include "memmap.h"
 
 /*! Display registers. */
 #define _DIREG(reg) ((reg) * 4)
@@ -338,7 +339,18 @@
 
 #define DSI_PAD_CONTROL_4 0x52
 
+/*! Framebuffers, the second one is the back buffer for page flipping. */
+#define DISPLAY_FB_ADDR      MEM_DISPLAY_START
+#define DISPLAY_FB_SIZE      0x3C0000
+#define DISPLAY_FB_BACK_ADDR (DISPLAY_FB_ADDR + DISPLAY_FB_SIZE)
+/*! Reserved after the framebuffers for pre-rendered UI graphics that must survive launch attempts. */
+#define DISPLAY_LOGO_ADDR    (DISPLAY_FB_BACK_ADDR + DISPLAY_FB_SIZE)
+
 void display_init();
+/*! Starts the panel bring-up without waiting on it. Its steps then run from display_init_poll(). */
+void display_init_start();
+/*! Runs the next bring-up step if its delay passed, never sleeps on it. Returns 1 once the panel is up. */
+int display_init_poll();
 void display_end();
 
 /*! Show one single color on the display. */
@@ -349,5 +361,9 @@ void display_backlight(u8 enable);
 
 /*! Init display in full 1280x720 resolution (B8G8R8A8, line stride 768, framebuffer size = 1280*768*4 bytes). */
 u32 *display_init_framebuffer();
+/*! Takes over a framebuffer left up by a relaunching payload, without touching the panel. */
+u32 *display_resume_framebuffer();
+/*! Scan out fb from the next frame on and wait for the switch. Returns 0 if the framebuffer isn't up. */
+int display_flip(u32 *fb);
 
 #endif
@@ -10,13 +10,18 @@
 #include <string.h>
 #include "diskio.h"		/* FatFs lower layer API */
 #include "sdmmc.h"
+#include "heap.h"
+#include "nx_emmc_fs.h"
 
 extern sdmmc_storage_t sd_storage;
+extern int sd_io_error;
 
 DSTATUS disk_status (
 	BYTE pdrv		/* Physical drive nmuber to identify the drive */
 )
 {
+	if (pdrv == NX_EMMC_FS_DRV)
+		return nx_emmc_fs_status();
 	return 0;
 }
 
@@ -24,9 +29,23 @@ DSTATUS disk_initialize (
 	BYTE pdrv				/* Physical drive nmuber to identify the drive */
 )
 {
+	if (pdrv == NX_EMMC_FS_DRV)
+		return nx_emmc_fs_status();
 	return 0;
 }
 
+/* Buffers FatFs hands us from IRAM (or unaligned) are bounced through this. */
+#define DISKIO_BOUNCE_SECTORS 32
+
+static u8 *_disk_bounce = NULL;
+
+static u8 *_disk_get_bounce()
+{
+	if (!_disk_bounce)
+		_disk_bounce = (u8 *)dma_malloc(DISKIO_BOUNCE_SECTORS * 512);
+	return _disk_bounce;
+}
+
 DRESULT disk_read (
 	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
 	BYTE *buff,		/* Data buffer to store read data */
@@ -34,15 +53,32 @@ DRESULT disk_read (
 	UINT count		/* Number of sectors to read */
 )
 {
-	if ((u32)buff >= 0x90000000)
-		return sdmmc_storage_read(&sd_storage, sector, count, buff) ? RES_OK : RES_ERROR;
-	u8 *buf = (u8 *)0x98000000; //TODO: define this somewhere.
-	if (sdmmc_storage_read(&sd_storage, sector, count, buf))
+	if (pdrv == NX_EMMC_FS_DRV)
+		return nx_emmc_fs_read(buff, sector, count);
+
+	if (dma_buf_ok(buff))
+	{
+		if (sdmmc_storage_read(&sd_storage, sector, count, buff))
+			return RES_OK;
+		sd_io_error = 1;
+		return RES_ERROR;
+	}
+
+	u8 *buf = _disk_get_bounce();
+	while (count)
 	{
-		memcpy(buff, buf, 512 * count);
-		return RES_OK;
+		u32 num = MIN(count, DISKIO_BOUNCE_SECTORS);
+		if (!sdmmc_storage_read(&sd_storage, sector, num, buf))
+		{
+			sd_io_error = 1;
+			return RES_ERROR;
+		}
+		memcpy(buff, buf, 512 * num);
+		buff += 512 * num;
+		sector += num;
+		count -= num;
 	}
-	return RES_ERROR;
+	return RES_OK;
 }
 
 DRESULT disk_write (
@@ -52,13 +88,32 @@ DRESULT disk_write (
 	UINT count			/* Number of sectors to write */
 )
 {
-	if ((u32)buff >= 0x90000000)
-		return sdmmc_storage_write(&sd_storage, sector, count, (void *)buff) ? RES_OK : RES_ERROR;
-	u8 *buf = (u8 *)0x98000000; //TODO: define this somewhere.
-	memcpy(buf, buff, 512 * count);
-	if (sdmmc_storage_write(&sd_storage, sector, count, buf))
-		return RES_OK;
-	return RES_ERROR;
+	if (pdrv == NX_EMMC_FS_DRV)
+		return nx_emmc_fs_write(buff, sector, count);
+
+	if (dma_buf_ok(buff))
+	{
+		if (sdmmc_storage_write(&sd_storage, sector, count, (void *)buff))
+			return RES_OK;
+		sd_io_error = 1;
+		return RES_ERROR;
+	}
+
+	u8 *buf = _disk_get_bounce();
+	while (count)
+	{
+		u32 num = MIN(count, DISKIO_BOUNCE_SECTORS);
+		memcpy(buf, buff, 512 * num);
+		if (!sdmmc_storage_write(&sd_storage, sector, num, buf))
+		{
+			sd_io_error = 1;
+			return RES_ERROR;
+		}
+		buff += 512 * num;
+		sector += num;
+		count -= num;
+	}
+	return RES_OK;
 }
 
 DRESULT disk_ioctl (
@@ -24,6 +24,10 @@
 
 #define EMC_DBG                                                 0x8
 #define EMC_CFG                                                 0xC
+#define  EMC_CFG_DYN_SELF_REF                                   (1 << 28)
+#define  EMC_CFG_DRAM_ACPD                                      (1 << 29)
+#define  EMC_CFG_DRAM_CLKSTOP_SR                                (1 << 30)
+#define  EMC_CFG_DRAM_CLKSTOP_PD                                (1u << 31)
 #define EMC_CONFIG_SAMPLE_DELAY                                 0x5f0
 #define EMC_CFG_UPDATE                                          0x5f4
 #define EMC_ADR_CFG                                             0x10
@@ -231,6 +235,7 @@
 #define EMC_COMP_PAD_SW_CTRL                                    0x57c
 #define EMC_REQ_CTRL                                            0x2b0
 #define EMC_EMC_STATUS                                          0x2b4
+#define  EMC_STATUS_TIMING_UPDATE_STALLED                       (1 << 23)
 #define EMC_CFG_2                                               0x2b8
 #define EMC_CFG_DIG_DLL                                         0x2bc
 #define EMC_CFG_DIG_DLL_PERIOD                                  0x2c0
@@ -1044,6 +1044,153 @@ static void clear_lock (	/* Clear lock entries of the volume */
 /*-----------------------------------------------------------------------*/
 /* Move/Flush disk access window in the filesystem object                */
 /*-----------------------------------------------------------------------*/
+#if FF_WIN_CACHE
+/* Sector cache behind the window, shared by all volumes. Entries are only
+   written back when they are evicted or their filesystem is synchronized. */
+
+typedef struct {
+	FATFS*	fs;		/* Owner volume (NULL:empty) */
+	DWORD	sect;	/* Cached sector (0xFFFFFFFF:empty) */
+	DWORD	stamp;	/* Last use, for LRU eviction */
+	BYTE	dirty;	/* Needs to be written back */
+} WCENT;
+
+static WCENT WcEnt[FF_WIN_CACHE];
+static BYTE* WcBuf;				/* FF_WIN_CACHE sectors */
+static DWORD WcClock, WcHits, WcMisses;
+
+
+static void wc_reset (	/* Drop the entries of a volume */
+	FATFS* fs
+)
+{
+	UINT i;
+
+
+	if (!WcBuf) {
+		WcBuf = ff_memalloc(FF_WIN_CACHE * FF_MAX_SS);
+		for (i = 0; i < FF_WIN_CACHE; i++) WcEnt[i].fs = 0;
+	}
+	for (i = 0; i < FF_WIN_CACHE; i++) {
+		if (!WcEnt[i].fs || WcEnt[i].fs == fs) {
+			WcEnt[i].fs = 0; WcEnt[i].sect = 0xFFFFFFFF; WcEnt[i].dirty = 0;
+		}
+	}
+	WcHits = WcMisses = 0;
+}
+
+
+static int wc_find (	/* Entry index or -1 */
+	FATFS* fs,
+	DWORD sect
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_WIN_CACHE; i++) {
+		if (WcEnt[i].fs == fs && WcEnt[i].sect == sect) return (int)i;
+	}
+	return -1;
+}
+
+
+#if !FF_FS_READONLY
+static FRESULT wc_flush_ent (	/* Returns FR_OK or FR_DISK_ERR */
+	UINT i
+)
+{
+	FATFS *fs = WcEnt[i].fs;
+	BYTE *buf = WcBuf + i * FF_MAX_SS;
+	DWORD sect = WcEnt[i].sect;
+
+
+	if (WcEnt[i].dirty) {
+		if (disk_write(fs->pdrv, buf, sect, 1) != RES_OK) return FR_DISK_ERR;
+		WcEnt[i].dirty = 0;
+		if (sect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
+			if (fs->n_fats == 2) disk_write(fs->pdrv, buf, sect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+		}
+	}
+	return FR_OK;
+}
+
+
+static FRESULT wc_flush (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs
+)
+{
+	UINT i;
+
+
+	if (!WcBuf) return FR_OK;
+	for (i = 0; i < FF_WIN_CACHE; i++) {
+		if (WcEnt[i].fs == fs && wc_flush_ent(i) != FR_OK) return FR_DISK_ERR;
+	}
+	return FR_OK;
+}
+
+
+static void wc_invalidate (	/* Drop cached copies of sectors written around the cache */
+	FATFS* fs,
+	DWORD sect,
+	DWORD cnt
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_WIN_CACHE; i++) {
+		if (WcEnt[i].fs == fs && WcEnt[i].sect - sect < cnt) {
+			WcEnt[i].fs = 0; WcEnt[i].sect = 0xFFFFFFFF; WcEnt[i].dirty = 0;
+		}
+	}
+}
+#endif
+
+
+static FRESULT wc_store (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs,
+	DWORD sect,
+	const BYTE* buf,
+	BYTE dirty
+)
+{
+	int i;
+	UINT n;
+
+
+	i = wc_find(fs, sect);
+	if (i < 0) {	/* Evict the least recently used entry */
+		for (i = 0, n = 0; n < FF_WIN_CACHE; n++) {
+			if (!WcEnt[n].fs) { i = (int)n; break; }
+			if ((LONG)(WcEnt[n].stamp - WcEnt[i].stamp) < 0) i = (int)n;	/* Older (wrap safe) */
+		}
+#if !FF_FS_READONLY
+		if (WcEnt[i].fs && wc_flush_ent((UINT)i) != FR_OK) return FR_DISK_ERR;
+#endif
+		WcEnt[i].fs = fs;
+		WcEnt[i].sect = sect;
+		WcEnt[i].dirty = 0;
+	}
+	mem_cpy(WcBuf + i * SS(fs), buf, SS(fs));
+	WcEnt[i].dirty |= dirty;
+	WcEnt[i].stamp = ++WcClock;
+	return FR_OK;
+}
+
+
+void f_wincache_stats (
+	DWORD* hits,	/* Pointer to return the number of window loads served by the cache */
+	DWORD* misses	/* Pointer to return the number of window loads from the drive */
+)
+{
+	*hits = WcHits;
+	*misses = WcMisses;
+}
+#endif	/* FF_WIN_CACHE */
+
+
 #if !FF_FS_READONLY
 static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 	FATFS* fs			/* Filesystem object */
@@ -1053,6 +1200,13 @@ static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	if (fs->wflag) {	/* Is the disk access window dirty */
+#if FF_WIN_CACHE
+		if (WcBuf) {	/* Defer the write-back to the cache */
+			res = wc_store(fs, fs->winsect, fs->win, 1);
+			if (res == FR_OK) fs->wflag = 0;
+			return res;
+		}
+#endif
 		if (disk_write(fs->pdrv, fs->win, fs->winsect, 1) == RES_OK) {	/* Write back the window */
 			fs->wflag = 0;	/* Clear window dirty flag */
 			if (fs->winsect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
@@ -1073,6 +1227,9 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 )
 {
 	FRESULT res = FR_OK;
+#if FF_WIN_CACHE
+	int i;
+#endif
 
 
 	if (sector != fs->winsect) {	/* Window offset changed? */
@@ -1080,10 +1237,25 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 		res = sync_window(fs);		/* Write-back changes */
 #endif
 		if (res == FR_OK) {			/* Fill sector window with new data */
+#if FF_WIN_CACHE
+			if (WcBuf && (i = wc_find(fs, sector)) >= 0) {	/* Cache hit */
+				mem_cpy(fs->win, WcBuf + i * SS(fs), SS(fs));
+				WcEnt[i].stamp = ++WcClock;
+				WcHits++;
+				fs->winsect = sector;
+				return FR_OK;
+			}
+#endif
 			if (disk_read(fs->pdrv, fs->win, sector, 1) != RES_OK) {
 				sector = 0xFFFFFFFF;	/* Invalidate window if read data is not valid */
 				res = FR_DISK_ERR;
 			}
+#if FF_WIN_CACHE
+			else if (WcBuf) {
+				WcMisses++;
+				res = wc_store(fs, sector, fs->win, 0);
+			}
+#endif
 			fs->winsect = sector;
 		}
 	}
@@ -1106,6 +1278,9 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	res = sync_window(fs);
+#if FF_WIN_CACHE
+	if (res == FR_OK) res = wc_flush(fs);	/* Write back the deferred sectors */
+#endif
 	if (res == FR_OK) {
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {	/* FAT32: Update FSInfo sector if needed */
 			/* Create FSInfo structure */
@@ -1117,6 +1292,9 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 			st_dword(fs->win + FSI_Nxt_Free, fs->last_clst);
 			/* Write it into the FSInfo sector */
 			fs->winsect = fs->volbase + 1;
+#if FF_WIN_CACHE
+			wc_invalidate(fs, fs->winsect, 1);
+#endif
 			disk_write(fs->pdrv, fs->win, fs->winsect, 1);
 			fs->fsi_flag = 0;
 		}
@@ -1659,6 +1837,9 @@ static FRESULT dir_clear (	/* Returns FR_OK or FR_DISK_ERR */
 
 	if (sync_window(fs) != FR_OK) return FR_DISK_ERR;	/* Flush disk access window */
 	sect = clst2sect(fs, clst);		/* Top of the cluster */
+#if FF_WIN_CACHE
+	wc_invalidate(fs, sect, fs->csize);	/* The cluster is cleared around the cache */
+#endif
 	fs->winsect = sect;				/* Set window to top of the cluster */
 	mem_set(fs->win, 0, SS(fs));	/* Clear window buffer */
 #if FF_USE_LFN == 3		/* Quick table clear by using multi-secter write */
@@ -3259,6 +3440,9 @@ static FRESULT find_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	/* Following code attempts to mount the volume. (analyze BPB and initialize the filesystem object) */
 
 	fs->fs_type = 0;					/* Clear the filesystem object */
+#if FF_WIN_CACHE
+	wc_reset(fs);						/* Cached sectors may be from another card */
+#endif
 	fs->pdrv = LD2PD(vol);				/* Bind the logical drive and a physical drive */
 	stat = disk_initialize(fs->pdrv);	/* Initialize the physical drive */
 	if (stat & STA_NOINIT) { 			/* Check if the initialization succeeded */
@@ -3552,6 +3736,9 @@ FRESULT f_mount (
 		if (!ff_del_syncobj(cfs->sobj)) return FR_INT_ERR;
 #endif
 		cfs->fs_type = 0;				/* Clear old fs object */
+#if FF_WIN_CACHE
+		if (WcBuf) wc_reset(cfs);		/* Its entries must not outlive it */
+#endif
 	}
 
 	if (fs) {
@@ -4601,6 +4788,10 @@ FRESULT f_readdir (
 			if (res == FR_NO_FILE) res = FR_OK;	/* Ignore end of directory */
 			if (res == FR_OK) {				/* A valid entry is found */
 				get_fileinfo(dp, fno);		/* Get the object information */
+#if !FF_FS_READONLY
+				dp->isect = dp->sect;		/* Remember the item for f_dirchmod */
+				dp->iofs = dp->dptr % SS(fs);
+#endif
 				res = dir_next(dp, 0);		/* Increment index for next */
 				if (res == FR_NO_FILE) res = FR_OK;	/* Ignore end of directory now */
 			}
@@ -4612,6 +4803,70 @@ FRESULT f_readdir (
 
 
 
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Change Attribute of the Last Read Directory Item                      */
+/*-----------------------------------------------------------------------*/
+/* Unlike f_chmod, the item is not looked up by path and the change is   */
+/* left in the window until f_syncdir, so a walk can batch its writes.   */
+
+FRESULT f_dirchmod (
+	DIR* dp,			/* Pointer to the open directory object */
+	BYTE attr,			/* Attribute bits */
+	BYTE mask			/* Attribute mask to change */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&dp->obj, &fs);	/* Check validity of the directory object */
+	if (res == FR_OK) {
+		mask &= AM_RDO|AM_HID|AM_SYS|AM_ARC;	/* Valid attribute mask */
+#if FF_FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {	/* The entry block of the item is still in dirbuf */
+			fs->dirbuf[XDIR_Attr] = (attr & mask) | (fs->dirbuf[XDIR_Attr] & (BYTE)~mask);
+			res = store_xdir(dp);
+			if (res == FR_OK) {
+				res = dir_next(dp, 0);	/* Move past the block again */
+				if (res == FR_NO_FILE) res = FR_OK;
+			}
+		} else
+#endif
+		{
+			res = move_window(fs, dp->isect);
+			if (res == FR_OK) {
+				fs->win[dp->iofs + DIR_Attr] = (attr & mask) | (fs->win[dp->iofs + DIR_Attr] & (BYTE)~mask);
+				fs->wflag = 1;
+			}
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Synchronize the Volume of a Directory                                 */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_syncdir (
+	DIR* dp				/* Pointer to the open directory object */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&dp->obj, &fs);	/* Check validity of the directory object */
+	if (res == FR_OK) res = sync_fs(fs);
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
 #if FF_USE_FIND
 /*-----------------------------------------------------------------------*/
 /* Find Next File                                                        */
@@ -4700,6 +4955,76 @@ FRESULT f_stat (
 
 
 #if !FF_FS_READONLY
+#if FF_USE_LFN == 3
+/*-----------------------------------------------------------------------*/
+/* Count free clusters of a FAT32/exFAT volume in bulk                   */
+/*-----------------------------------------------------------------------*/
+
+#define GETFREE_BULK_SECTS	128
+
+static FRESULT getfree_bulk (	/* FR_OK, FR_DISK_ERR or FR_INT_ERR:not enough core */
+	FATFS* fs,
+	DWORD* nfree
+)
+{
+	BYTE *buf;
+	DWORD sect, nent, cnt, w, *wp;
+	UINT n, i, nw;
+
+
+	buf = ff_memalloc(GETFREE_BULK_SECTS * SS(fs));
+	if (!buf) return FR_INT_ERR;
+
+#if !FF_FS_READONLY
+	/* Pending FAT/bitmap changes must be on the drive first */
+	if (sync_window(fs) != FR_OK) { ff_memfree(buf); return FR_DISK_ERR; }
+#if FF_WIN_CACHE
+	if (wc_flush(fs) != FR_OK) { ff_memfree(buf); return FR_DISK_ERR; }
+#endif
+#endif
+
+	cnt = 0;
+	if (fs->fs_type == FS_EXFAT) {	/* exFAT: One bit per cluster, bitmap assumed at cluster 2 */
+		sect = fs->database;
+		nent = fs->n_fatent - 2;
+	} else {						/* FAT32: One DWORD per entry, including the 2 reserved ones */
+		sect = fs->fatbase;
+		nent = fs->n_fatent;
+	}
+	while (nent) {
+		n = (fs->fs_type == FS_EXFAT) ? (nent + SS(fs) * 8 - 1) / (SS(fs) * 8) : (nent + SS(fs) / 4 - 1) / (SS(fs) / 4);
+		if (n > GETFREE_BULK_SECTS) n = GETFREE_BULK_SECTS;
+		if (disk_read(fs->pdrv, buf, sect, n) != RES_OK) { ff_memfree(buf); return FR_DISK_ERR; }
+		sect += n;
+		wp = (DWORD*)buf;
+		if (fs->fs_type == FS_EXFAT) {
+			nw = n * SS(fs) / 4;
+			for (i = 0; i < nw && nent; i++) {
+				w = ld_dword((BYTE*)&wp[i]);
+				if (nent < 32) {	/* Last partial word */
+					w |= 0xFFFFFFFF << nent;
+					cnt += 32 - __builtin_popcount(w);
+					nent = 0;
+				} else {
+					cnt += 32 - __builtin_popcount(w);
+					nent -= 32;
+				}
+			}
+		} else {
+			nw = n * SS(fs) / 4;
+			for (i = 0; i < nw && nent; i++, nent--) {
+				if ((ld_dword((BYTE*)&wp[i]) & 0x0FFFFFFF) == 0) cnt++;
+			}
+		}
+	}
+	ff_memfree(buf);
+
+	*nfree = cnt;
+	return FR_OK;
+}
+#endif
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
@@ -4720,63 +5045,72 @@ FRESULT f_getfree (
 	/* Get logical drive */
 	res = find_volume(&path, &fs, 0);
 	if (res == FR_OK) {
-		*fatfs = fs;				/* Return ptr to the fs object */
+		if (fatfs) *fatfs = fs;		/* Return ptr to the fs object */
 		/* If free_clst is valid, return it without full FAT scan */
 		if (fs->free_clst <= fs->n_fatent - 2) {
 			*nclst = fs->free_clst;
 		} else {
 			/* Scan FAT to obtain number of free clusters */
 			nfree = 0;
-			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
-				clst = 2; obj.fs = fs;
-				do {
-					stat = get_fat(&obj, clst);
-					if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
-					if (stat == 1) { res = FR_INT_ERR; break; }
-					if (stat == 0) nfree++;
-				} while (++clst < fs->n_fatent);
-			} else {
+			res = FR_INT_ERR;
+#if FF_USE_LFN == 3
+			/* exFAT/FAT32: Count in large multi-sector reads straight from the drive */
+			if (fs->fs_type == FS_EXFAT || fs->fs_type == FS_FAT32) res = getfree_bulk(fs, &nfree);
+#endif
+			if (res == FR_INT_ERR) {	/* Scan through the window */
+				res = FR_OK;
+				if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
+					clst = 2; obj.fs = fs;
+					do {
+						stat = get_fat(&obj, clst);
+						if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+						if (stat == 1) { res = FR_INT_ERR; break; }
+						if (stat == 0) nfree++;
+					} while (++clst < fs->n_fatent);
+				} else {
 #if FF_FS_EXFAT
-				if (fs->fs_type == FS_EXFAT) {	/* exFAT: Scan allocation bitmap */
-					BYTE bm;
-					UINT b;
-
-					clst = fs->n_fatent - 2;	/* Number of clusters */
-					sect = fs->database;		/* Assuming bitmap starts at cluster 2 */
-					i = 0;						/* Offset in the sector */
-					do {	/* Counts numbuer of bits with zero in the bitmap */
-						if (i == 0) {
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-						}
-						for (b = 8, bm = fs->win[i]; b && clst; b--, clst--) {
-							if (!(bm & 1)) nfree++;
-							bm >>= 1;
-						}
-						i = (i + 1) % SS(fs);
-					} while (clst);
-				} else
+					if (fs->fs_type == FS_EXFAT) {	/* exFAT: Scan allocation bitmap */
+						BYTE bm;
+						UINT b;
+
+						clst = fs->n_fatent - 2;	/* Number of clusters */
+						sect = fs->database;		/* Assuming bitmap starts at cluster 2 */
+						i = 0;						/* Offset in the sector */
+						do {	/* Counts numbuer of bits with zero in the bitmap */
+							if (i == 0) {
+								res = move_window(fs, sect++);
+								if (res != FR_OK) break;
+							}
+							for (b = 8, bm = fs->win[i]; b && clst; b--, clst--) {
+								if (!(bm & 1)) nfree++;
+								bm >>= 1;
+							}
+							i = (i + 1) % SS(fs);
+						} while (clst);
+					} else
 #endif
-				{	/* FAT16/32: Scan WORD/DWORD FAT entries */
-					clst = fs->n_fatent;	/* Number of entries */
-					sect = fs->fatbase;		/* Top of the FAT */
-					i = 0;					/* Offset in the sector */
-					do {	/* Counts numbuer of entries with zero in the FAT */
-						if (i == 0) {
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-						}
-						if (fs->fs_type == FS_FAT16) {
-							if (ld_word(fs->win + i) == 0) nfree++;
-							i += 2;
-						} else {
-							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
-							i += 4;
-						}
-						i %= SS(fs);
-					} while (--clst);
+					{	/* FAT16/32: Scan WORD/DWORD FAT entries */
+						clst = fs->n_fatent;	/* Number of entries */
+						sect = fs->fatbase;		/* Top of the FAT */
+						i = 0;					/* Offset in the sector */
+						do {	/* Counts numbuer of entries with zero in the FAT */
+							if (i == 0) {
+								res = move_window(fs, sect++);
+								if (res != FR_OK) break;
+							}
+							if (fs->fs_type == FS_FAT16) {
+								if (ld_word(fs->win + i) == 0) nfree++;
+								i += 2;
+							} else {
+								if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
+								i += 4;
+							}
+							i %= SS(fs);
+						} while (--clst);
+					}
 				}
 			}
+			if (res != FR_OK) LEAVE_FF(fs, res);
 			*nclst = nfree;			/* Return the free clusters */
 			fs->free_clst = nfree;	/* Now free_clst is valid */
 			fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
@@ -5529,6 +5863,66 @@ FRESULT f_expand (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Get the First Sector of a Contiguous File                             */
+/*-----------------------------------------------------------------------*/
+/* The caller may then access the file data directly on the drive, so   */
+/* the sector buffer of the file is flushed and invalidated.             */
+
+FRESULT f_contiguous (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD* sect		/* Pointer to return the first sector (0:not contiguous) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD clst, ncl, nxt;
+	FSIZE_t csz;
+
+
+	*sect = 0;
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	if (fp->obj.sclust == 0 || fp->obj.objsize == 0) LEAVE_FF(fs, FR_OK);	/* Nothing allocated */
+
+#if !FF_FS_TINY
+#if !FF_FS_READONLY
+	if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
+		if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+		fp->flag &= (BYTE)~FA_DIRTY;
+	}
+#endif
+	fp->sect = 0;					/* The buffered sector may be overwritten by the caller */
+#endif
+
+	csz = (FSIZE_t)fs->csize * SS(fs);
+	ncl = (DWORD)((fp->obj.objsize + csz - 1) / csz);	/* Number of clusters of the file */
+#if FF_FS_EXFAT
+	if (fp->obj.stat == 2) {		/* Contiguous chain without FAT */
+		*sect = clst2sect(fs, fp->obj.sclust);
+		LEAVE_FF(fs, FR_OK);
+	}
+#endif
+#if FF_USE_FASTSEEK
+	if (fp->cltbl) {				/* The link map has a single fragment if it is contiguous */
+		if (fp->cltbl[0] == 4 && fp->cltbl[1] >= ncl) *sect = clst2sect(fs, fp->cltbl[2]);
+		LEAVE_FF(fs, FR_OK);
+	}
+#endif
+	clst = fp->obj.sclust;
+	while (--ncl) {					/* Follow the chain */
+		nxt = get_fat(&fp->obj, clst);
+		if (nxt == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (nxt != clst + 1) LEAVE_FF(fs, FR_OK);	/* Fragmented */
+		clst = nxt;
+	}
+	*sect = clst2sect(fs, fp->obj.sclust);
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
 #if FF_USE_FORWARD
 /*-----------------------------------------------------------------------*/
 /* Forward Data to the Stream Directly                                   */
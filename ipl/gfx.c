@@ -18,6 +18,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include "gfx.h"
+#include "di.h"
 
 static const u8 _gfx_font[] = {
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // Char 032 ( )
@@ -123,22 +124,146 @@ void gfx_init_ctxt(gfx_ctxt_t *ctxt, u32 *fb, u32 width, u32 height, u32 stride)
 	ctxt->width = width;
 	ctxt->height = height;
 	ctxt->stride = stride;
+	ctxt->clean_col = 0;
+	ctxt->dirty_y0 = 0;
+	ctxt->dirty_y1 = height;
+	ctxt->fb_shown = fb;
+	ctxt->fb_hidden = NULL;
+	ctxt->sync_y0 = 0;
+	ctxt->sync_y1 = height;
+}
+
+static inline void _gfx_mark_sync(gfx_ctxt_t *ctxt, u32 y0, u32 y1)
+{
+	if (y0 < ctxt->sync_y0)
+		ctxt->sync_y0 = y0;
+	if (y1 > ctxt->sync_y1)
+		ctxt->sync_y1 = y1;
+}
+
+static inline void _gfx_mark_dirty(gfx_ctxt_t *ctxt, u32 y0, u32 y1)
+{
+	if (y0 < ctxt->dirty_y0)
+		ctxt->dirty_y0 = y0;
+	if (y1 > ctxt->dirty_y1)
+		ctxt->dirty_y1 = y1;
+	_gfx_mark_sync(ctxt, y0, y1);
+}
+
+static void _gfx_sync_rows(gfx_ctxt_t *ctxt, u32 *dst, const u32 *src)
+{
+	if (ctxt->sync_y0 < ctxt->sync_y1)
+		memcpy(dst + ctxt->sync_y0 * ctxt->stride, src + ctxt->sync_y0 * ctxt->stride,
+			(ctxt->sync_y1 - ctxt->sync_y0) * 4 * ctxt->stride);
+	ctxt->sync_y0 = ctxt->height;
+	ctxt->sync_y1 = 0;
+}
+
+void gfx_init_back_buffer(gfx_ctxt_t *ctxt, u32 *back)
+{
+	ctxt->fb_hidden = back;
+	ctxt->sync_y0 = 0;
+	ctxt->sync_y1 = ctxt->height;
+}
+
+void gfx_frame_begin(gfx_ctxt_t *ctxt)
+{
+	if (!ctxt->fb_hidden || ctxt->fb != ctxt->fb_shown)
+		return;
+
+	// Bring the hidden buffer up to date and draw the next frame there.
+	_gfx_sync_rows(ctxt, ctxt->fb_hidden, ctxt->fb_shown);
+	ctxt->fb = ctxt->fb_hidden;
+}
+
+void gfx_frame_end(gfx_ctxt_t *ctxt)
+{
+	if (!ctxt->fb_hidden || ctxt->fb != ctxt->fb_hidden)
+		return;
+
+	if (display_flip(ctxt->fb_hidden))
+	{
+		// The rows drawn in this frame are now stale in the old buffer.
+		ctxt->fb_hidden = ctxt->fb_shown;
+		ctxt->fb_shown = ctxt->fb;
+	}
+	else
+	{
+		// No scanout to flip, present by copying.
+		_gfx_sync_rows(ctxt, ctxt->fb_shown, ctxt->fb_hidden);
+		ctxt->fb = ctxt->fb_shown;
+	}
+}
+
+static void _gfx_fill_rows(gfx_ctxt_t *ctxt, u32 color, u32 y0, u32 y1)
+{
+	if (y0 >= y1)
+		return;
+
+	_gfx_mark_sync(ctxt, y0, y1);
+
+	u32 *fb = ctxt->fb + y0 * ctxt->stride;
+	if (color == (color & 0xFF) * 0x01010101)
+	{
+		memset(fb, color & 0xFF, (y1 - y0) * 4 * ctxt->stride);
+		return;
+	}
+
+	// Fill one row and replicate it with burst copies.
+	for (u32 i = 0; i < ctxt->stride; i++)
+		fb[i] = color;
+	for (u32 y = y0 + 1; y < y1; y++)
+		memcpy(ctxt->fb + y * ctxt->stride, fb, 4 * ctxt->stride);
+}
+
+static void _gfx_clear_rows(gfx_ctxt_t *ctxt, u32 color, u32 y0, u32 y1)
+{
+	if (y1 > ctxt->height)
+		y1 = ctxt->height;
+
+	if (color != ctxt->clean_col)
+	{
+		_gfx_fill_rows(ctxt, color, y0, y1);
+		if (!y0 && y1 == ctxt->height)
+		{
+			ctxt->clean_col = color;
+			ctxt->dirty_y0 = ctxt->height;
+			ctxt->dirty_y1 = 0;
+		}
+		else
+			_gfx_mark_dirty(ctxt, y0, y1);
+		return;
+	}
+
+	// Rows outside the dirty range already hold this color.
+	u32 d0 = ctxt->dirty_y0 > y0 ? ctxt->dirty_y0 : y0;
+	u32 d1 = ctxt->dirty_y1 < y1 ? ctxt->dirty_y1 : y1;
+	_gfx_fill_rows(ctxt, color, d0, d1);
+
+	if (y0 <= ctxt->dirty_y0 && ctxt->dirty_y0 < y1)
+		ctxt->dirty_y0 = y1;
+	if (y0 < ctxt->dirty_y1 && ctxt->dirty_y1 <= y1)
+		ctxt->dirty_y1 = y0;
+	if (ctxt->dirty_y0 >= ctxt->dirty_y1)
+	{
+		ctxt->dirty_y0 = ctxt->height;
+		ctxt->dirty_y1 = 0;
+	}
 }
 
 void gfx_clear_grey(gfx_ctxt_t *ctxt, u8 color)
 {
-	memset(ctxt->fb, color, 0x3C0000);
+	_gfx_clear_rows(ctxt, color * 0x01010101, 0, ctxt->height);
 }
 
 void gfx_clear_color(gfx_ctxt_t *ctxt, u32 color)
 {
-	for (u32 i = 0; i < ctxt->height * ctxt->stride; i++)
-		ctxt->fb[i] = color;
+	_gfx_clear_rows(ctxt, color, 0, ctxt->height);
 }
 
 void gfx_clear_partial_grey(gfx_ctxt_t *ctxt, u8 color, u32 pos_x, u32 height)
 {
-	memset(ctxt->fb + pos_x * ctxt->stride, color, height * 4 * ctxt->stride);
+	_gfx_clear_rows(ctxt, color * 0x01010101, pos_x, pos_x + height);
 }
 
 void gfx_con_init(gfx_con_t *con, gfx_ctxt_t *ctxt)
@@ -174,96 +299,190 @@ void gfx_con_setpos(gfx_con_t *con, u32 x, u32 y)
 	con->y = y;
 }
 
-void gfx_putc(gfx_con_t *con, char c)
+// Font rows are expanded a nibble at a time into spans cached per (size, fg, bg).
+#define GFX_SPAN_SLOTS 2
+
+typedef struct _gfx_span_t
+{
+	u32 fntsz;
+	u32 fgcol;
+	u32 bgcol;
+	u32 px[16][8];
+} gfx_span_t;
+
+typedef struct _gfx_span4_t
+{
+	u32 px[4];
+} gfx_span4_t;
+
+static gfx_span_t _gfx_spans[GFX_SPAN_SLOTS] IRAM_FAST_BSS;
+static u32 _gfx_span_next IRAM_FAST_BSS;
+
+static const gfx_span_t *_gfx_get_spans(gfx_con_t *con)
 {
-	// Duplicate code for performance reasons.
-	switch (con->fntsz)
+	gfx_span_t *sp;
+	for (u32 i = 0; i < GFX_SPAN_SLOTS; i++)
 	{
-	case 16:
-		if (c >= 32 && c <= 126)
-		{
-			u8 *cbuf = (u8 *)&_gfx_font[8 * (c - 32)];
-			u32 *fb = con->gfx_ctxt->fb + con->x + con->y * con->gfx_ctxt->stride;
+		sp = &_gfx_spans[i];
+		if (sp->fntsz == con->fntsz && sp->fgcol == con->fgcol && sp->bgcol == con->bgcol)
+			return sp;
+	}
 
-			for (u32 i = 0; i < 16; i+=2)
-			{
-				u8 v = *cbuf++;
-				for (u32 k = 0; k < 2; k++)
-				{
-					for (u32 j = 0; j < 8; j++)
-					{
-						if (v & 1)
-						{
-							*fb = con->fgcol;
-							fb++;
-							*fb = con->fgcol;
-						}
-						else if (con->fillbg)
-						{
-							*fb = con->bgcol;
-							fb++;
-							*fb = con->bgcol;
-						}
-						else
-							fb++;
-						v >>= 1;
-						fb++;
-					}
-					fb += con->gfx_ctxt->stride - 16;
-					v = *cbuf;
-				}
-			}
-			con->x += 16;
+	sp = &_gfx_spans[_gfx_span_next];
+	_gfx_span_next = (_gfx_span_next + 1) % GFX_SPAN_SLOTS;
+
+	u32 scale = con->fntsz == 16 ? 2 : 1;
+	for (u32 n = 0; n < 16; n++)
+		for (u32 j = 0; j < 4 * scale; j++)
+			sp->px[n][j] = (n >> (j / scale)) & 1 ? con->fgcol : con->bgcol;
+	sp->fntsz = con->fntsz;
+	sp->fgcol = con->fgcol;
+	sp->bgcol = con->bgcol;
+
+	return sp;
+}
+
+static void IRAM_FAST _gfx_blit_glyph(gfx_con_t *con, const gfx_span_t *sp, char c)
+{
+	const u8 *cbuf = &_gfx_font[8 * (c - 32)];
+	u32 stride = con->gfx_ctxt->stride;
+	u32 *fb = con->gfx_ctxt->fb + con->x + con->y * stride;
+
+	_gfx_mark_dirty(con->gfx_ctxt, con->y, con->y + con->fntsz);
+
+	if (con->fntsz == 16)
+	{
+		// Like the bit by bit path, the second line of a pair is taken from the next row.
+		for (u32 i = 0; i < 16; i++)
+		{
+			u8 v = cbuf[(i + 1) >> 1];
+			const gfx_span4_t *lo = (const gfx_span4_t *)sp->px[v & 0xF];
+			const gfx_span4_t *hi = (const gfx_span4_t *)sp->px[v >> 4];
+			gfx_span4_t *dst = (gfx_span4_t *)fb;
+			dst[0] = lo[0];
+			dst[1] = lo[1];
+			dst[2] = hi[0];
+			dst[3] = hi[1];
+			fb += stride;
 		}
-		else if (c == '\n')
+	}
+	else
+	{
+		for (u32 i = 0; i < 8; i++)
 		{
-			con->x = 0;
-			con->y +=16;
-			if (con->y > con->gfx_ctxt->height - 16)
-				con->y = 0;
+			gfx_span4_t *dst = (gfx_span4_t *)fb;
+			dst[0] = *(const gfx_span4_t *)sp->px[*cbuf & 0xF];
+			dst[1] = *(const gfx_span4_t *)sp->px[*cbuf++ >> 4];
+			fb += stride;
 		}
-		break;
-	case 8:
-	default:
-		if (c >= 32 && c <= 126)
+	}
+}
+
+static void IRAM_FAST _gfx_draw_glyph(gfx_con_t *con, char c)
+{
+	// Without a background only the set bits can be written.
+	u8 *cbuf = (u8 *)&_gfx_font[8 * (c - 32)];
+	u32 *fb = con->gfx_ctxt->fb + con->x + con->y * con->gfx_ctxt->stride;
+
+	_gfx_mark_dirty(con->gfx_ctxt, con->y, con->y + con->fntsz);
+
+	if (con->fntsz == 16)
+	{
+		for (u32 i = 0; i < 16; i+=2)
 		{
-			u8 *cbuf = (u8 *)&_gfx_font[8 * (c - 32)];
-			u32 *fb = con->gfx_ctxt->fb + con->x + con->y * con->gfx_ctxt->stride;
-			for (u32 i = 0; i < 8; i++)
+			u8 v = *cbuf++;
+			for (u32 k = 0; k < 2; k++)
 			{
-				u8 v = *cbuf++;
 				for (u32 j = 0; j < 8; j++)
 				{
 					if (v & 1)
-						*fb = con->fgcol;
-					else if (con->fillbg)
-						*fb = con->bgcol;
+					{
+						fb[0] = con->fgcol;
+						fb[1] = con->fgcol;
+					}
 					v >>= 1;
-					fb++;
+					fb += 2;
 				}
-				fb += con->gfx_ctxt->stride - 8;
+				fb += con->gfx_ctxt->stride - 16;
+				v = *cbuf;
 			}
-			con->x += 8;
 		}
-		else if (c == '\n')
+	}
+	else
+	{
+		for (u32 i = 0; i < 8; i++)
 		{
-			con->x = 0;
-			con->y += 8;
-			if (con->y > con->gfx_ctxt->height - 8)
-				con->y = 0;
+			u8 v = *cbuf++;
+			for (u32 j = 0; j < 8; j++)
+			{
+				if (v & 1)
+					*fb = con->fgcol;
+				v >>= 1;
+				fb++;
+			}
+			fb += con->gfx_ctxt->stride - 8;
 		}
-		break;
 	}
-	
 }
 
-void gfx_puts(gfx_con_t *con, const char *s)
+static void _gfx_newline(gfx_con_t *con)
 {
-	if (!s || con->mute)
+	u32 h = con->fntsz == 16 ? 16 : 8;
+
+	con->x = 0;
+	con->y += h;
+	if (con->y > con->gfx_ctxt->height - h)
+		con->y = 0;
+}
+
+void IRAM_FAST gfx_putc(gfx_con_t *con, char c)
+{
+	if (con->mute)
+	{
+		gfx_printf(con, "%c", c);
+		return;
+	}
+
+	if (c >= 32 && c <= 126)
+	{
+		if (con->fillbg)
+			_gfx_blit_glyph(con, _gfx_get_spans(con), c);
+		else
+			_gfx_draw_glyph(con, c);
+		con->x += con->fntsz == 16 ? 16 : 8;
+	}
+	else if (c == '\n')
+		_gfx_newline(con);
+}
+
+void IRAM_FAST gfx_puts(gfx_con_t *con, const char *s)
+{
+	if (!s)
+		return;
+	if (con->mute)
+	{
+		gfx_printf(con, "%s", s);
 		return;
+	}
+
+	// Colors and size can't change mid string, look the spans up once.
+	const gfx_span_t *sp = con->fillbg ? _gfx_get_spans(con) : NULL;
+	u32 w = con->fntsz == 16 ? 16 : 8;
 
 	for (; *s; s++)
-		gfx_putc(con, *s);
+	{
+		char c = *s;
+		if (c >= 32 && c <= 126)
+		{
+			if (sp)
+				_gfx_blit_glyph(con, sp, c);
+			else
+				_gfx_draw_glyph(con, c);
+			con->x += w;
+		}
+		else if (c == '\n')
+			_gfx_newline(con);
+	}
 }
 
 static void _gfx_putn(gfx_con_t *con, u32 v, int base, char fill, int fcnt)
@@ -313,15 +532,163 @@ void gfx_put_big_sep(gfx_con_t *con)
 	con->fntsz = prevFontSize;
 }
 
-void gfx_printf(gfx_con_t *con, const char *fmt, ...)
+// Muted output, kept as format pointer plus arguments. Strings are copied in, they may not outlive the call.
+#define GFX_LOG_WORDS    (GFX_LOG_SIZE / 4)
+#define GFX_LOG_MAX_ARGS 8
+#define GFX_LOG_STR_MAX  64
+
+static u32 _gfx_log_head = 0;
+static u32 _gfx_log_tail = 0;
+static u32 _gfx_log_count = 0;
+
+// Entry: format, number of args | length in words << 8, args, then the copied strings. 0 marks a wrap.
+static void _gfx_log_drop()
 {
-	if (con->mute)
+	u32 *log = (u32 *)GFX_LOG_ADDR;
+
+	_gfx_log_tail += log[_gfx_log_tail + 1] >> 8;
+	if (_gfx_log_tail >= GFX_LOG_WORDS || !log[_gfx_log_tail])
+		_gfx_log_tail = 0;
+	if (!--_gfx_log_count)
+		_gfx_log_tail = _gfx_log_head;
+}
+
+static u32 *_gfx_log_alloc(u32 len)
+{
+	u32 *log = (u32 *)GFX_LOG_ADDR;
+
+	if (_gfx_log_head + len > GFX_LOG_WORDS)
+	{
+		// The space left at the end is skipped, and so are the oldest entries in it.
+		while (_gfx_log_count && _gfx_log_tail >= _gfx_log_head)
+			_gfx_log_drop();
+		if (_gfx_log_head < GFX_LOG_WORDS)
+			log[_gfx_log_head] = 0;
+		_gfx_log_head = 0;
+		if (!_gfx_log_count)
+			_gfx_log_tail = 0;
+	}
+
+	while (_gfx_log_count && _gfx_log_tail >= _gfx_log_head && _gfx_log_tail < _gfx_log_head + len)
+		_gfx_log_drop();
+
+	u32 *ent = &log[_gfx_log_head];
+	_gfx_log_head += len;
+	_gfx_log_count++;
+
+	return ent;
+}
+
+static void _gfx_log(const char *fmt, va_list ap)
+{
+	u32 args[GFX_LOG_MAX_ARGS];
+	u32 num_args = 0;
+	u32 str_words = 0;
+	u32 str_mask = 0;
+
+	// Only the conversions are looked at, nothing gets formatted.
+	for (const char *p = fmt; *p && num_args < GFX_LOG_MAX_ARGS; p++)
+	{
+		if (*p != '%')
+			continue;
+		p++;
+		if ((*p >= '0' && *p <= '9') || *p == ' ')
+			p++;
+		if (*p >= '0' && *p <= '9')
+			p++;
+
+		switch (*p)
+		{
+		case 's':
+			args[num_args] = va_arg(ap, u32);
+			if (args[num_args])
+			{
+				str_words += (MIN(strlen((const char *)args[num_args]), GFX_LOG_STR_MAX) + 4) / 4;
+				str_mask |= 1 << num_args;
+			}
+			num_args++;
+			break;
+		case 'c':
+		case 'd':
+		case 'x':
+		case 'X':
+		case 'k':
+		case 'K':
+			args[num_args++] = va_arg(ap, u32);
+			break;
+		case '\0':
+			p--;
+			break;
+		}
+	}
+
+	u32 len = 2 + num_args + str_words;
+	if (len > GFX_LOG_WORDS)
 		return;
 
+	u32 *ent = _gfx_log_alloc(len);
+	ent[0] = (u32)fmt;
+	ent[1] = num_args | (len << 8);
+
+	char *str = (char *)&ent[2 + num_args];
+	for (u32 i = 0; i < num_args; i++)
+	{
+		ent[2 + i] = args[i];
+		if (!(str_mask & (1 << i)))
+			continue;
+
+		u32 slen = MIN(strlen((const char *)args[i]), GFX_LOG_STR_MAX);
+		memcpy(str, (const char *)args[i], slen);
+		str[slen] = 0;
+		ent[2 + i] = (u32)str;
+		str += (slen + 4) & ~3;
+	}
+}
+
+void gfx_con_log_reset()
+{
+	_gfx_log_head = 0;
+	_gfx_log_tail = 0;
+	_gfx_log_count = 0;
+}
+
+u32 gfx_con_log_count()
+{
+	return _gfx_log_count;
+}
+
+void gfx_con_log_replay(gfx_con_t *con)
+{
+	u32 *log = (u32 *)GFX_LOG_ADDR;
+	u32 pos = _gfx_log_tail;
+
+	for (u32 i = 0; i < _gfx_log_count; i++)
+	{
+		if (pos >= GFX_LOG_WORDS || !log[pos])
+			pos = 0;
+
+		u32 *ent = &log[pos];
+		u32 a[GFX_LOG_MAX_ARGS] = {0};
+		memcpy(a, &ent[2], (ent[1] & 0xFF) * 4);
+		// Surplus arguments are never read.
+		gfx_printf(con, (const char *)ent[0], a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+		pos += ent[1] >> 8;
+	}
+}
+
+void gfx_printf(gfx_con_t *con, const char *fmt, ...)
+{
 	va_list ap;
 	int fill, fcnt;
 
 	va_start(ap, fmt);
+	if (con->mute)
+	{
+		_gfx_log(fmt, ap);
+		va_end(ap);
+		return;
+	}
+
 	while(*fmt)
 	{
 		if(*fmt == '%')
@@ -449,6 +816,7 @@ static int abs(int x)
 
 void gfx_set_pixel(gfx_ctxt_t *ctxt, u32 x, u32 y, u32 color)
 {
+	_gfx_mark_dirty(ctxt, y, y + 1);
 	ctxt->fb[x + y * ctxt->stride] = color;
 }
 
@@ -479,6 +847,8 @@ void gfx_line(gfx_ctxt_t *ctxt, int x0, int y0, int x1, int y1, u32 color)
 
 void gfx_set_rect_grey(gfx_ctxt_t *ctxt, const u8 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y)
 {
+	_gfx_mark_dirty(ctxt, pos_y, pos_y + size_y);
+
 	u32 pos = 0;
 	for (u32 y = pos_y; y < (pos_y + size_y); y++)
 	{
@@ -493,6 +863,8 @@ void gfx_set_rect_grey(gfx_ctxt_t *ctxt, const u8 *buf, u32 size_x, u32 size_y,
 
 void gfx_set_rect_rgb(gfx_ctxt_t *ctxt, const u8 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y)
 {
+	_gfx_mark_dirty(ctxt, pos_y, pos_y + size_y);
+
 	u32 pos = 0;
 	for (u32 y = pos_y; y < (pos_y + size_y); y++)
 	{
@@ -506,22 +878,22 @@ void gfx_set_rect_rgb(gfx_ctxt_t *ctxt, const u8 *buf, u32 size_x, u32 size_y, u
 
 void gfx_set_rect_argb(gfx_ctxt_t *ctxt, const u32 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y)
 {
-	u32 pos = 0;
-	for (u32 y = pos_y; y < (pos_y + size_y); y++)
-	{
-		for (u32 x = pos_x; x < (pos_x + size_x); x++)
-		{
-			ctxt->fb[x + y*ctxt->stride] = buf[pos];
-			pos+=1;
-		}
-	}
+	_gfx_mark_dirty(ctxt, pos_y, pos_y + size_y);
+
+	for (u32 y = 0; y < size_y; y++)
+		memcpy(&ctxt->fb[pos_x + (pos_y + y) * ctxt->stride], &buf[y * size_x], size_x * 4);
+}
+
+void gfx_render_bmp_argb_rows(gfx_ctxt_t *ctxt, const u32 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y, u32 row, u32 num)
+{
+	// BMP rows are stored bottom-up, buf holds rows [row, row + num) of the image.
+	_gfx_mark_dirty(ctxt, pos_y + size_y - row - num, pos_y + size_y - row);
+
+	for (u32 i = 0; i < num; i++)
+		memcpy(&ctxt->fb[pos_x + (pos_y + size_y - 1 - row - i) * ctxt->stride], &buf[i * size_x], size_x * 4);
 }
 
 void gfx_render_bmp_argb(gfx_ctxt_t *ctxt, const u32 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y)
 {
-	for (u32 y = pos_y; y < (pos_y + size_y); y++)
-	{
-		for (u32 x = pos_x; x < (pos_x + size_x); x++)
-			ctxt->fb[x + y*ctxt->stride]  = buf[(size_y + pos_y - 1 - y ) * size_x + x - pos_x];
-	}
+	gfx_render_bmp_argb_rows(ctxt, buf, size_x, size_y, pos_x, pos_y, 0, size_y);
 }
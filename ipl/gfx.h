@@ -20,12 +20,24 @@
 
 #include "types.h"
 
+#define GFX_LOG_ADDR 0x90018000
+#define GFX_LOG_SIZE 0x4000
+
 typedef struct _gfx_ctxt_t
 {
 	u32 *fb;
 	u32 width;
 	u32 height;
 	u32 stride;
+	// Rows [dirty_y0, dirty_y1) may differ from clean_col, the rest is known to hold it.
+	u32 clean_col;
+	u32 dirty_y0;
+	u32 dirty_y1;
+	// With a back buffer, rows [sync_y0, sync_y1) differ between the shown and hidden buffer.
+	u32 *fb_shown;
+	u32 *fb_hidden;
+	u32 sync_y0;
+	u32 sync_y1;
 } gfx_ctxt_t;
 
 typedef struct _gfx_con_t
@@ -43,6 +55,9 @@ typedef struct _gfx_con_t
 } gfx_con_t;
 
 void gfx_init_ctxt(gfx_ctxt_t *ctxt, u32 *fb, u32 width, u32 height, u32 stride);
+void gfx_init_back_buffer(gfx_ctxt_t *ctxt, u32 *back);
+void gfx_frame_begin(gfx_ctxt_t *ctxt);
+void gfx_frame_end(gfx_ctxt_t *ctxt);
 void gfx_clear_grey(gfx_ctxt_t *ctxt, u8 color);
 void gfx_clear_partial_grey(gfx_ctxt_t *ctxt, u8 color, u32 pos_x, u32 height);
 void gfx_clear_color(gfx_ctxt_t *ctxt, u32 color);
@@ -54,6 +69,10 @@ void gfx_putc(gfx_con_t *con, char c);
 void gfx_puts(gfx_con_t *con, const char *s);
 void gfx_printf(gfx_con_t *con, const char *fmt, ...);
 void gfx_hexdump(gfx_con_t *con, u32 base, const u8 *buf, u32 len);
+/*! Output of a muted console is logged to a RAM ring, to be drawn if it turns out to be needed. */
+void gfx_con_log_reset();
+u32 gfx_con_log_count();
+void gfx_con_log_replay(gfx_con_t *con);
 
 void gfx_set_pixel(gfx_ctxt_t *ctxt, u32 x, u32 y, u32 color);
 void gfx_line(gfx_ctxt_t *ctxt, int x0, int y0, int x1, int y1, u32 color);
@@ -63,5 +82,6 @@ void gfx_set_rect_grey(gfx_ctxt_t *ctxt, const u8 *buf, u32 size_x, u32 size_y,
 void gfx_set_rect_rgb(gfx_ctxt_t *ctxt, const u8 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y);
 void gfx_set_rect_argb(gfx_ctxt_t *ctxt, const u32 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y);
 void gfx_render_bmp_argb(gfx_ctxt_t *ctxt, const u32 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y);
+void gfx_render_bmp_argb_rows(gfx_ctxt_t *ctxt, const u32 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos_y, u32 row, u32 num);
 
 #endif
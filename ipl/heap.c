@@ -14,123 +14,433 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+
 #include <string.h>
 #include "heap.h"
+#include "util.h"
+
+/*
+* Segregated-fit heap. Each block starts with a boundary tag holding its own size and the size of
+* the block before it, so both neighbors are found in O(1). Free blocks sit in one list per
+* power-of-two size class and a bitmap tracks the non-empty classes. The last block borders the
+* unallocated top of the heap, which grows on demand and shrinks back when that block is freed.
+*/
+
+#define HEAP_USED      1
+#define HEAP_ALIGN     0x10
+#define HEAP_MIN_BLOCK 0x20 // Tag and the smallest payload.
+#define HEAP_PANIC     0x48 // PMC scratch code when a heap would leave its region.
 
-typedef struct _hnode
+typedef struct _hblk
 {
-	int used;
-	u32 size;
-	struct _hnode *prev;
-	struct _hnode *next;
-} hnode_t;
+	u32 size;      // Whole block, tag included. Bit 0 is set while used.
+	u32 prev_size; // Size of the block right before, 0 for the first one.
+	struct _hblk *next; // Free list links, only valid while free.
+	struct _hblk *prev;
+} hblk_t;
 
 typedef struct _heap
 {
 	u32 start;
-	hnode_t *first;
+	u32 end;      // End of its memmap region. The top never goes past it.
+	u32 top;      // End of the last block.
+	hblk_t *last; // Block bordering the top, NULL if the heap is empty.
+	u32 bin_map;  // Bit n is set if bins[n] is not empty.
+	hblk_t *bins[HEAP_NUM_BINS];
+	u32 used;     // Bytes in used blocks, tags included.
+	u32 peak;
+	u32 allocs;
+	u32 total_allocs;
 } heap_t;
 
+#define BLK_SIZE(b) ((b)->size & ~HEAP_USED)
+#define BLK_NEXT(b) ((hblk_t *)((u32)(b) + BLK_SIZE(b)))
+#define BLK_PREV(b) ((hblk_t *)((u32)(b) - (b)->prev_size))
+
 static void _heap_create(heap_t *heap, u32 start)
 {
+	// A heap owns a whole fixed region of the layout, so growing it can never reach the next one.
+	const memmap_region_t *region = memmap_find((void *)start, 1);
+	if (!region || region->start != start || !region->fixed)
+		panic(HEAP_PANIC);
+
+	memset(heap, 0, sizeof(heap_t));
 	heap->start = start;
-	heap->first = NULL;
+	heap->end = region->end + 1;
+	heap->top = start;
+}
+
+static u32 _heap_bin(u32 size)
+{
+	return 31 - __builtin_clz(size);
+}
+
+static void _heap_link(heap_t *heap, hblk_t *blk)
+{
+	u32 bin = _heap_bin(blk->size);
+
+	blk->prev = NULL;
+	blk->next = heap->bins[bin];
+	if (blk->next)
+		blk->next->prev = blk;
+	heap->bins[bin] = blk;
+	heap->bin_map |= 1u << bin;
+}
+
+static void _heap_unlink(heap_t *heap, hblk_t *blk)
+{
+	u32 bin = _heap_bin(blk->size);
+
+	if (blk->prev)
+		blk->prev->next = blk->next;
+	else
+		heap->bins[bin] = blk->next;
+	if (blk->next)
+		blk->next->prev = blk->prev;
+
+	if (!heap->bins[bin])
+		heap->bin_map &= ~(1u << bin);
+}
+
+// Gives the end of a free block back to the free lists, if it is big enough for a block.
+static void _heap_split(heap_t *heap, hblk_t *blk, u32 size)
+{
+	u32 rem = blk->size - size;
+	if (rem < HEAP_MIN_BLOCK)
+		return;
+
+	hblk_t *new = (hblk_t *)((u32)blk + size);
+	new->size = rem;
+	new->prev_size = size;
+	blk->size = size;
+
+	if (heap->last == blk)
+		heap->last = new;
+	else
+		BLK_NEXT(new)->prev_size = rem;
+
+	_heap_link(heap, new);
 }
 
 static u32 _heap_alloc(heap_t *heap, u32 size, u32 alignment)
 {
-	hnode_t *node, *new;
-	int search = 1;
+	hblk_t *blk = NULL;
 
-	size = ALIGN(size, alignment);
+	size = ALIGN(size, alignment) + sizeof(hblk_t);
+	if (size < HEAP_MIN_BLOCK)
+		size = HEAP_MIN_BLOCK;
 
-	if (!heap->first)
+	// Any block of a bigger class fits. Only the own class needs a search.
+	u32 bin = _heap_bin(size);
+	u32 map = (bin + 1 < HEAP_NUM_BINS) ? heap->bin_map & ~((2u << bin) - 1) : 0;
+	if (map)
+		blk = heap->bins[__builtin_ctz(map)];
+	else
 	{
-		node = (hnode_t *)heap->start;
-		node->used = 1;
-		node->size = size;
-		node->prev = NULL;
-		node->next = NULL;
-		heap->first = node;
-
-		return (u32)node + sizeof(hnode_t);
+		for (blk = heap->bins[bin]; blk; blk = blk->next)
+			if (blk->size >= size)
+				break;
 	}
 
-	node = heap->first;
-	while (search)
+	if (blk)
 	{
-		if (!node->used && size + sizeof(hnode_t) < node->size)
-		{
-			new = (hnode_t *)((u32)node + sizeof(hnode_t) + size);
-
-			new->size = node->size - sizeof(hnode_t) - size;
-			node->size = size;
-			node->used = 1;
-			new->used = 0;
-			new->next = node->next;
-			new->prev = node;
-			node->next = new;
-
-			return (u32)node + sizeof(hnode_t);
-		}
-		if (node->next)
-			node = node->next;
-		else
-			search = 0;
+		_heap_unlink(heap, blk);
+		_heap_split(heap, blk, size);
+	}
+	else
+	{
+		// Grow the heap.
+		if (size > heap->end - heap->top)
+			panic(HEAP_PANIC);
+		blk = (hblk_t *)heap->top;
+		blk->size = size;
+		blk->prev_size = heap->last ? BLK_SIZE(heap->last) : 0;
+		heap->last = blk;
+		heap->top += size;
 	}
 
-	new = (hnode_t *)((u32)node + sizeof(hnode_t) + node->size);
-	new->used = 1;
-	new->size = size;
-	new->prev = node;
-	new->next = NULL;
-	node->next = new;
+	blk->size |= HEAP_USED;
 
-	return (u32)new + sizeof(hnode_t);
+	return (u32)blk + sizeof(hblk_t);
 }
 
 static void _heap_free(heap_t *heap, u32 addr)
 {
-	hnode_t *node = (hnode_t *)(addr - sizeof(hnode_t));
-	node->used = 0;
-	node = heap->first;
-	while (node)
+	hblk_t *blk = (hblk_t *)(addr - sizeof(hblk_t));
+	blk->size &= ~HEAP_USED;
+
+	// Merge with the next block.
+	if (heap->last != blk)
 	{
-		if (!node->used)
+		hblk_t *next = BLK_NEXT(blk);
+		if (!(next->size & HEAP_USED))
 		{
-			if (node->prev && !node->prev->used)
-			{
-				node->prev->size += node->size + sizeof(hnode_t);
-				node->prev->next = node->next;
-				if (node->next)
-					node->next->prev = node->prev;
-			}
+			_heap_unlink(heap, next);
+			if (heap->last == next)
+				heap->last = blk;
+			blk->size += next->size;
 		}
-		node = node->next;
 	}
+
+	// Merge with the previous block.
+	if (blk->prev_size)
+	{
+		hblk_t *prev = BLK_PREV(blk);
+		if (!(prev->size & HEAP_USED))
+		{
+			_heap_unlink(heap, prev);
+			if (heap->last == blk)
+				heap->last = prev;
+			prev->size += blk->size;
+			blk = prev;
+		}
+	}
+
+	// Give the block bordering the top back to it.
+	if (heap->last == blk)
+	{
+		heap->top = (u32)blk;
+		heap->last = blk->prev_size ? BLK_PREV(blk) : NULL;
+		return;
+	}
+
+	BLK_NEXT(blk)->prev_size = blk->size;
+	_heap_link(heap, blk);
+}
+
+// Allocates with a stronger alignment than HEAP_ALIGN, giving back the slack on both sides.
+static u32 _heap_alloc_aligned(heap_t *heap, u32 size, u32 alignment)
+{
+	if (alignment <= HEAP_ALIGN)
+		return _heap_alloc(heap, size, HEAP_ALIGN);
+
+	size = ALIGN(size, HEAP_ALIGN);
+	u32 addr = _heap_alloc(heap, size + alignment + HEAP_MIN_BLOCK, HEAP_ALIGN);
+	hblk_t *blk = (hblk_t *)(addr - sizeof(hblk_t));
+
+	// The slack in front must be able to hold a free block.
+	u32 aligned = ALIGN(addr, alignment);
+	if (aligned != addr && aligned - addr < HEAP_MIN_BLOCK)
+		aligned = ALIGN(addr + HEAP_MIN_BLOCK, alignment);
+
+	if (aligned != addr)
+	{
+		u32 front = aligned - addr;
+		hblk_t *new = (hblk_t *)(aligned - sizeof(hblk_t));
+		new->size = (BLK_SIZE(blk) - front) | HEAP_USED;
+		new->prev_size = front;
+		if (heap->last == blk)
+			heap->last = new;
+		else
+			BLK_NEXT(new)->prev_size = BLK_SIZE(new);
+		blk->size = front | HEAP_USED;
+		_heap_free(heap, addr);
+		blk = new;
+	}
+
+	// Free the tail past the requested size.
+	u32 need = size + sizeof(hblk_t);
+	if (BLK_SIZE(blk) - need >= HEAP_MIN_BLOCK)
+	{
+		hblk_t *rem = (hblk_t *)((u32)blk + need);
+		rem->size = (BLK_SIZE(blk) - need) | HEAP_USED;
+		rem->prev_size = need;
+		if (heap->last == blk)
+			heap->last = rem;
+		else
+			BLK_NEXT(rem)->prev_size = BLK_SIZE(rem);
+		blk->size = need | HEAP_USED;
+		_heap_free(heap, (u32)rem + sizeof(hblk_t));
+	}
+
+	return aligned;
 }
 
 static heap_t _heap;
+static heap_t _dma_heap;
+
+static heap_trace_t *_trace;
+static u32 _trace_on;
+static u32 _trace_cnt;
 
 void heap_init(u32 base)
 {
 	_heap_create(&_heap, base);
 }
 
+void dma_heap_init(u32 base)
+{
+	_heap_create(&_dma_heap, base);
+}
+
+static heap_t *_heap_of(void *buf)
+{
+	if (_dma_heap.start && (u32)buf >= _dma_heap.start)
+		return &_dma_heap;
+	return &_heap;
+}
+
+static void _heap_trace(u32 addr, u32 size, u32 tag)
+{
+	if (!_trace_on)
+		return;
+
+	heap_trace_t *t = &_trace[_trace_cnt % HEAP_TRACE_ENTRIES];
+	t->addr = addr;
+	t->size = size;
+	t->tag = tag;
+	_trace_cnt++;
+}
+
+// The tag is the caller's return address, so a trace maps back to call sites through the linker map.
+static void *_heap_alloc_tagged(heap_t *heap, u32 size, u32 alignment, u32 tag)
+{
+	u32 addr = _heap_alloc_aligned(heap, size, alignment);
+	hblk_t *blk = (hblk_t *)(addr - sizeof(hblk_t));
+
+	heap->used += BLK_SIZE(blk);
+	heap->peak = MAX(heap->peak, heap->used);
+	heap->allocs++;
+	heap->total_allocs++;
+	_heap_trace(addr, size, tag);
+
+	return (void *)addr;
+}
+
 void *malloc(u32 size)
 {
-	return (void *)_heap_alloc(&_heap, size, 0x10);
+	return _heap_alloc_tagged(&_heap, size, HEAP_ALIGN, (u32)__builtin_return_address(0));
 }
 
 void *calloc(u32 num, u32 size)
 {
-	void *res = (void *)_heap_alloc(&_heap, num * size, 0x10);
+	void *res = _heap_alloc_tagged(&_heap, num * size, HEAP_ALIGN, (u32)__builtin_return_address(0));
 	memset(res, 0, num * size);
 	return res;
 }
 
+void *memalign(u32 align, u32 size)
+{
+	return _heap_alloc_tagged(&_heap, size, align, (u32)__builtin_return_address(0));
+}
+
 void free(void *buf)
 {
-	if (buf != NULL)
-		_heap_free(&_heap, (u32)buf);
+	if (buf == NULL)
+		return;
+
+	heap_t *heap = _heap_of(buf);
+	hblk_t *blk = (hblk_t *)((u32)buf - sizeof(hblk_t));
+
+	heap->used -= BLK_SIZE(blk);
+	heap->allocs--;
+	_heap_trace((u32)buf, 0, (u32)__builtin_return_address(0));
+
+	_heap_free(heap, (u32)buf);
+}
+
+// Falls back to the main heap, which is DMA-reachable too, if the arena was not set up.
+static heap_t *_dma_heap_get()
+{
+	return _dma_heap.start ? &_dma_heap : &_heap;
+}
+
+void *dma_malloc(u32 size)
+{
+	return _heap_alloc_tagged(_dma_heap_get(), size, DMA_BUF_ALIGN, (u32)__builtin_return_address(0));
+}
+
+void *dma_calloc(u32 num, u32 size)
+{
+	void *res = _heap_alloc_tagged(_dma_heap_get(), num * size, DMA_BUF_ALIGN, (u32)__builtin_return_address(0));
+	memset(res, 0, num * size);
+	return res;
+}
+
+void *dma_memalign(u32 align, u32 size)
+{
+	return _heap_alloc_tagged(_dma_heap_get(), size, MAX(align, DMA_BUF_ALIGN), (u32)__builtin_return_address(0));
+}
+
+void heap_get_stats(heap_stats_t *stats, u32 dma)
+{
+	heap_t *heap = dma ? &_dma_heap : &_heap;
+
+	memset(stats, 0, sizeof(heap_stats_t));
+	stats->start = heap->start;
+	stats->top = heap->top;
+	stats->used = heap->used;
+	stats->peak = heap->peak;
+	stats->allocs = heap->allocs;
+	stats->total_allocs = heap->total_allocs;
+
+	for (u32 bin = 0; bin < HEAP_NUM_BINS; bin++)
+		for (hblk_t *blk = heap->bins[bin]; blk; blk = blk->next)
+		{
+			stats->bins[bin]++;
+			stats->free_blocks++;
+			stats->free_bytes += blk->size;
+			stats->largest_free = MAX(stats->largest_free, blk->size);
+		}
+}
+
+void heap_trace_start()
+{
+	// The ring itself is not traced or counted.
+	if (!_trace)
+		_trace = (heap_trace_t *)_heap_alloc(&_heap, HEAP_TRACE_ENTRIES * sizeof(heap_trace_t), HEAP_ALIGN);
+	_trace_cnt = 0;
+	_trace_on = 1;
+}
+
+void heap_trace_stop()
+{
+	_trace_on = 0;
+}
+
+u32 heap_trace_get(heap_trace_t *out, u32 max)
+{
+	u32 cnt = MIN(MIN(_trace_cnt, HEAP_TRACE_ENTRIES), max);
+	u32 first = _trace_cnt - cnt;
+
+	for (u32 i = 0; i < cnt; i++)
+		memcpy(&out[i], &_trace[(first + i) % HEAP_TRACE_ENTRIES], sizeof(heap_trace_t));
+
+	return cnt;
+}
+
+int dma_buf_ok(const void *buf)
+{
+	return ((u32)buf >= DMA_ADDR_START) && !((u32)buf & (DMA_ALIGN - 1));
+}
+
+void arena_init(arena_t *arena, u32 start, u32 size)
+{
+	arena->start = start;
+	arena->end = start + size;
+	arena->top = start;
+}
+
+void *arena_alloc(arena_t *arena, u32 size)
+{
+	// Cache line aligned, so any arena buffer can go to DMA.
+	u32 addr = ALIGN(arena->top, DMA_BUF_ALIGN);
+	if (size > arena->end - addr)
+		return NULL;
+
+	arena->top = addr + size;
+	return (void *)addr;
+}
+
+void *arena_calloc(arena_t *arena, u32 num, u32 size)
+{
+	void *res = arena_alloc(arena, num * size);
+	if (res)
+		memset(res, 0, num * size);
+	return res;
+}
+
+void arena_reset(arena_t *arena)
+{
+	arena->top = arena->start;
 }
@@ -18,10 +18,70 @@
 #define _HEAP_H_
 
 #include "types.h"
+#include "memmap.h"
 
 void heap_init(u32 base);
 void *malloc(u32 size);
 void *calloc(u32 num, u32 size);
+void *memalign(u32 align, u32 size);
 void free(void *buf);
 
+/*! Heap memory is DRAM at/above this address and can be handed to the SDMMC/SE DMA engines. */
+#define DMA_ADDR_START 0x90000000
+/*! ADMA2 descriptors need 8-byte aligned buffers. */
+#define DMA_ALIGN 8
+
+/*! Separate arena for buffers handed to the SDMMC/SE/TSEC engines, above the main heap and below the launch arena. */
+#define DMA_HEAP_START MEM_DMA_HEAP_START
+/*! Every DMA buffer starts on a cache line. TSEC wants 0x100 and asks for it with dma_memalign. */
+#define DMA_BUF_ALIGN 0x40
+
+void dma_heap_init(u32 base);
+void *dma_malloc(u32 size);
+void *dma_calloc(u32 num, u32 size);
+void *dma_memalign(u32 align, u32 size);
+int dma_buf_ok(const void *buf);
+
+#define HEAP_NUM_BINS      32
+#define HEAP_TRACE_ENTRIES 256
+
+typedef struct _heap_stats_t
+{
+	u32 start;
+	u32 top;          // End of the last block. Nothing above it is handed out.
+	u32 used;         // Bytes in used blocks, tags included.
+	u32 peak;
+	u32 allocs;       // Live allocations.
+	u32 total_allocs;
+	u32 free_blocks;
+	u32 free_bytes;
+	u32 largest_free;
+	u32 bins[HEAP_NUM_BINS]; // Free blocks per power-of-two size class.
+} heap_stats_t;
+
+typedef struct _heap_trace_t
+{
+	u32 addr;
+	u32 size; // 0 for a free.
+	u32 tag;  // Return address of the caller.
+} heap_trace_t;
+
+void heap_get_stats(heap_stats_t *stats, u32 dma);
+void heap_trace_start();
+void heap_trace_stop();
+u32 heap_trace_get(heap_trace_t *out, u32 max);
+
+/*! Bump allocator over a fixed region. Everything is released at once with arena_reset. */
+typedef struct _arena_t
+{
+	u32 start;
+	u32 end;
+	u32 top;
+} arena_t;
+
+void arena_init(arena_t *arena, u32 start, u32 size);
+void *arena_alloc(arena_t *arena, u32 size);
+void *arena_calloc(arena_t *arena, u32 num, u32 size);
+void arena_reset(arena_t *arena);
+
 #endif
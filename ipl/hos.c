@@ -22,34 +22,52 @@
 #include "hos.h"
 #include "sdmmc.h"
 #include "nx_emmc.h"
+#include "nx_image.h"
 #include "t210.h"
 #include "se.h"
 #include "se_t210.h"
 #include "pmc.h"
 #include "cluster.h"
+#include "ccplex.h"
+#include "bpmp.h"
 #include "heap.h"
+#include "irq.h"
+#include "memmap.h"
 #include "tsec.h"
 #include "pkg2.h"
 #include "nx_emmc.h"
 #include "util.h"
 #include "pkg1.h"
+#include "pkg1_cache.h"
 #include "pkg2.h"
 #include "ff.h"
 #include "di.h"
 #include "config.h"
 #include "mc.h"
+#include "bootplan.h"
+#include "bootprof.h"
+#include "statlog.h"
+#include "trace.h"
+#include "sdram.h"
 
 #include "gfx.h"
 extern gfx_ctxt_t gfx_ctxt;
 extern gfx_con_t gfx_con;
-extern void sd_unmount();
+extern void sd_end();
+extern int sd_file_read_to(FIL *fp, void *dst, u32 size);
 //#define DPRINTF(...) gfx_printf(&gfx_con, __VA_ARGS__)
 #define DPRINTF(...)
 
 extern hekate_config h_cfg;
 
+// Everything a launch attempt loads lives here, between the DMA heap and package2.
+#define LAUNCH_ARENA_START MEM_LAUNCH_START
+#define LAUNCH_ARENA_SIZE  ((u32)PKG2_LOAD_ADDR - LAUNCH_ARENA_START)
+
 typedef struct _launch_ctxt_t
 {
+	arena_t arena;
+
 	void *keyblob;
 
 	void *pkg1;
@@ -63,6 +81,13 @@ typedef struct _launch_ctxt_t
 
 	void *pkg2;
 	u32 pkg2_size;
+	u32 pkg2_lba;
+	u32 pkg2_read;
+	u32 pkg2_chunk;
+	u32 pkg2_done;
+	u32 pkg2_decrypt_mask;
+	int pkg2_pending;
+	int pkg2_inplace;
 
 	void *kernel;
 	u32 kernel_size;
@@ -72,6 +97,7 @@ typedef struct _launch_ctxt_t
 	int svcperm;
 	int debugmode;
 	int atmosphere;
+	int image; // Booting from a rawnand image on SD.
 } launch_ctxt_t;
 
 typedef struct _merge_kip_t
@@ -144,7 +170,7 @@ static void _se_lock()
 	gfx_hexdump(&gfx_con, SE_BASE, (void *)SE_BASE, 0x400);*/
 }
 
-int keygen(u8 *keyblob, u32 kb, void *tsec_fw)
+int keygen(u8 *keyblob, u32 kb)
 {
 	u8 tmp[0x10];
 
@@ -154,8 +180,8 @@ int keygen(u8 *keyblob, u32 kb, void *tsec_fw)
 	se_key_acc_ctrl(13, 0x15);
 	se_key_acc_ctrl(14, 0x15);
 
-	// Get TSEC key.
-	if (tsec_query(tmp, 1, tsec_fw) < 0)
+	// Get TSEC key, from the session cache after the first run.
+	if (pkg1_cache_tsec_key(tmp, 1) < 0)
 		return 0;
 
 	se_aes_key_set(13, tmp, 0x10);
@@ -169,15 +195,13 @@ int keygen(u8 *keyblob, u32 kb, void *tsec_fw)
 	// Clear SBK.
 	se_aes_key_clear(14);
 
-	//TODO: verify keyblob CMAC.
-	//se_aes_unwrap_key(11, 13, cmac_keyseed);
-	//se_aes_cmac(tmp, 0x10, 11, keyblob + 0x10, 0xA0);
-	//if (!memcmp(keyblob, tmp, 0x10))
-	//	return 0;
-
 	se_aes_crypt_block_ecb(13, 0, tmp, cmac_keyseed);
 	se_aes_unwrap_key(11, 13, cmac_keyseed);
 
+	// Verify keyblob CMAC.
+	if (!se_aes_cmac(11, tmp, 0x10, keyblob + 0x10, 0xA0) || memcmp(keyblob, tmp, 0x10))
+		return 0;
+
 	// Decrypt keyblob and set keyslots.
 	se_aes_crypt_ctr(13, keyblob + 0x20, 0x90, keyblob + 0x20, 0x90, keyblob + 0x10);
 	se_aes_key_set(11, keyblob + 0x20 + 0x80, 0x10); // Package1 key.
@@ -217,64 +241,57 @@ int keygen(u8 *keyblob, u32 kb, void *tsec_fw)
 
 static void _copy_bootconfig()
 {
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-
-	sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4);
+	sdmmc_storage_t *storage = nx_emmc_open(1);
+	if (!storage)
+		return;
 
 	// Read BCT.
-	u8 *buf = (u8 *)0x4003D000;
-	sdmmc_storage_set_mmc_partition(&storage, 1);
-	sdmmc_storage_read(&storage, 0, 0x3000 / NX_EMMC_BLOCKSIZE, buf);
+	u8 *buf = (u8 *)MEM_BCT_ADDR;
+	sdmmc_storage_read(storage, 0, MEM_BCT_SIZE / NX_EMMC_BLOCKSIZE, buf);
 
-	gfx_printf(&gfx_con, "Copied BCT to 0x4003D000\n");
+	gfx_printf(&gfx_con, "Copied BCT to %08X\n", MEM_BCT_ADDR);
 
-	sdmmc_storage_end(&storage);
+	nx_emmc_close();
 }
 
 static int _read_emmc_pkg1(launch_ctxt_t *ctxt)
 {
-	int res = 0;
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-
-	sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4);
+	const pkg1_cache_t *cache = pkg1_cache_get();
+	if (!cache)
+		return 0;
 
-	// Read package1.
-	ctxt->pkg1 = (u8 *)malloc(0x40000);
-	sdmmc_storage_set_mmc_partition(&storage, 1);
-	sdmmc_storage_read(&storage, 0x100000 / NX_EMMC_BLOCKSIZE, 0x40000 / NX_EMMC_BLOCKSIZE, ctxt->pkg1);
-	ctxt->pkg1_id = pkg1_identify(ctxt->pkg1);
+	// Package1 gets decrypted in place, so the launch works on a copy.
+	ctxt->pkg1 = (u8 *)arena_alloc(&ctxt->arena, PKG1_CACHE_SIZE);
+	memcpy(ctxt->pkg1, cache->pkg1, PKG1_CACHE_SIZE);
+	ctxt->pkg1_id = cache->pkg1_id;
 	if (!ctxt->pkg1_id)
 	{
 		gfx_printf(&gfx_con, "%kUnknown package1,\nVersion (= '%s').%k\n", 0xFFFF0000, (char *)ctxt->pkg1 + 0x10, 0xFFCCCCCC);
-		goto out;
+		return 0;
 	}
 	gfx_printf(&gfx_con, "Identified package1 ('%s'),\nKeyblob version %d\n\n", (char *)(ctxt->pkg1 + 0x10), ctxt->pkg1_id->kb);
 
-	// Read the correct keyblob.
-	ctxt->keyblob = (u8 *)calloc(NX_EMMC_BLOCKSIZE, 1);
-	sdmmc_storage_read(&storage, 0x180000 / NX_EMMC_BLOCKSIZE + ctxt->pkg1_id->kb, 1, ctxt->keyblob);
-
-	res = 1;
+	// Same for the keyblob, keygen decrypts it.
+	ctxt->keyblob = (u8 *)arena_alloc(&ctxt->arena, NX_EMMC_BLOCKSIZE);
+	memcpy(ctxt->keyblob, cache->keyblob, NX_EMMC_BLOCKSIZE);
 
-out:;
-	sdmmc_storage_end(&storage);
-	return res;
+	return 1;
 }
 
-static int _read_emmc_pkg2(launch_ctxt_t *ctxt)
+// package2 arrives in chunks, so that each one can be decrypted while the next is transferred.
+#define PKG2_READ_CHUNK 0x100000
+
+// Starts the package2 read. The transfer runs in the background until _read_emmc_pkg2_finish.
+static int _read_emmc_pkg2_start(launch_ctxt_t *ctxt)
 {
 	int res = 0;
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-
-	sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4);
-	sdmmc_storage_set_mmc_partition(&storage, 0);
+	sdmmc_storage_t *storage = nx_emmc_open(0);
+	if (!storage)
+		return 0;
 
 	// Parse eMMC GPT.
 	LIST_INIT(gpt);
-	nx_emmc_gpt_parse(&gpt, &storage);
+	nx_emmc_gpt_parse(&gpt, storage);
 	DPRINTF("Parsed GPT\n");
 	// Find package2 partition.
 	emmc_part_t *pkg2_part = nx_emmc_part_find(&gpt, "BCPKG2-1-Normal-Main");
@@ -282,51 +299,163 @@ static int _read_emmc_pkg2(launch_ctxt_t *ctxt)
 		goto out;
 
 	// Read in package2 header and get package2 real size.
-	//TODO: implement memalign for DMA buffers.
-	u8 *tmp = (u8 *)malloc(NX_EMMC_BLOCKSIZE);
-	nx_emmc_part_read(&storage, pkg2_part, 0x4000 / NX_EMMC_BLOCKSIZE, 1, tmp);
+	u8 *tmp = (u8 *)arena_alloc(&ctxt->arena, NX_EMMC_BLOCKSIZE);
+	nx_emmc_part_read(storage, pkg2_part, 0x4000 / NX_EMMC_BLOCKSIZE, 1, tmp);
 	u32 *hdr = (u32 *)(tmp + 0x100);
 	u32 pkg2_size = hdr[0] ^ hdr[2] ^ hdr[3];
-	free(tmp);
 	DPRINTF("pkg2 size on emmc is %08X\n", pkg2_size);
 	// Read in package2.
 	u32 pkg2_size_aligned = ALIGN(pkg2_size, NX_EMMC_BLOCKSIZE);
 	DPRINTF("pkg2 size aligned is %08X\n", pkg2_size_aligned);
-	ctxt->pkg2 = malloc(pkg2_size_aligned);
+	// Without a custom kernel, package2 is read straight to where it gets rebuilt
+	// and only what has to be patched is decrypted.
+	if (!ctxt->kernel)
+	{
+		ctxt->pkg2 = PKG2_LOAD_ADDR;
+		ctxt->pkg2_inplace = 1;
+		ctxt->pkg2_decrypt_mask = (ctxt->svcperm || ctxt->debugmode || ctxt->atmosphere) ? (1 << PKG2_SEC_KERNEL) : 0;
+	}
+	else
+	{
+		ctxt->pkg2 = arena_alloc(&ctxt->arena, pkg2_size_aligned);
+		ctxt->pkg2_decrypt_mask = PKG2_SEC_MASK_ALL;
+	}
+	if (!ctxt->pkg2)
+		goto out;
 	ctxt->pkg2_size = pkg2_size;
-	nx_emmc_part_read(&storage, pkg2_part, 0x4000 / NX_EMMC_BLOCKSIZE, 
-		pkg2_size_aligned / NX_EMMC_BLOCKSIZE, ctxt->pkg2);
+	ctxt->pkg2_lba = pkg2_part->lba_start + 0x4000 / NX_EMMC_BLOCKSIZE;
+
+	// Keep the session open while the transfer is in flight.
+	ctxt->pkg2_chunk = MIN(pkg2_size_aligned, PKG2_READ_CHUNK);
+	if (sdmmc_storage_submit(storage, ctxt->pkg2_lba, ctxt->pkg2_chunk / NX_EMMC_BLOCKSIZE, ctxt->pkg2, 0))
+	{
+		ctxt->pkg2_read = ctxt->pkg2_chunk;
+		ctxt->pkg2_pending = 1;
+		nx_emmc_gpt_free(&gpt);
+		return 1;
+	}
 
-	res = 1;
+	// Fall back to a blocking read.
+	res = nx_emmc_part_read(storage, pkg2_part, 0x4000 / NX_EMMC_BLOCKSIZE,
+		pkg2_size_aligned / NX_EMMC_BLOCKSIZE, ctxt->pkg2);
+	ctxt->pkg2_read = pkg2_size_aligned;
 
 out:;
 	nx_emmc_gpt_free(&gpt);
-	sdmmc_storage_end(&storage);
+	nx_emmc_close();
 	return res;
 }
 
-static int _config_warmboot(launch_ctxt_t *ctxt, const char *value)
+// Waits for package2 and decrypts it. Every chunk is decrypted while the next one is in flight.
+static int _read_emmc_pkg2_finish(launch_ctxt_t *ctxt)
 {
-	FIL fp;
-	if (f_open(&fp, value, FA_READ) != FR_OK)
+	if (!ctxt->pkg2)
 		return 0;
-	ctxt->warmboot_size = f_size(&fp);
-	ctxt->warmboot = malloc(ctxt->warmboot_size);
-	f_read(&fp, ctxt->warmboot, ctxt->warmboot_size, NULL);
-	f_close(&fp);
-	return 1;
+
+	int res = 1;
+	u8 *pkg2 = (u8 *)ctxt->pkg2;
+	u32 pkg2_size_aligned = ALIGN(ctxt->pkg2_size, NX_EMMC_BLOCKSIZE);
+	sdmmc_storage_t *storage = NULL;
+	if (ctxt->pkg2_pending)
+	{
+		storage = nx_emmc_open(0);
+		if (!storage)
+		{
+			// Only the reference of _read_emmc_pkg2_start is held.
+			ctxt->pkg2_pending = 0;
+			nx_emmc_close();
+			return 0;
+		}
+	}
+
+	while (ctxt->pkg2_pending)
+	{
+		u32 off = ctxt->pkg2_read - ctxt->pkg2_chunk;
+		ctxt->pkg2_pending = 0;
+		res = sdmmc_storage_complete(storage);
+
+		// Retry with a blocking read if the background transfer failed.
+		if (!res)
+			res = sdmmc_storage_read(storage, ctxt->pkg2_lba + off / NX_EMMC_BLOCKSIZE,
+				ctxt->pkg2_chunk / NX_EMMC_BLOCKSIZE, pkg2 + off);
+		if (!res)
+			break;
+
+		// Queue the next chunk, or read the rest in one go if that is refused.
+		u32 avail = ctxt->pkg2_read;
+		if (avail < pkg2_size_aligned)
+		{
+			ctxt->pkg2_chunk = MIN(pkg2_size_aligned - avail, PKG2_READ_CHUNK);
+			if (sdmmc_storage_submit(storage, ctxt->pkg2_lba + avail / NX_EMMC_BLOCKSIZE,
+				ctxt->pkg2_chunk / NX_EMMC_BLOCKSIZE, pkg2 + avail, 0))
+			{
+				ctxt->pkg2_read += ctxt->pkg2_chunk;
+				ctxt->pkg2_pending = 1;
+			}
+			else
+			{
+				res = sdmmc_storage_read(storage, ctxt->pkg2_lba + avail / NX_EMMC_BLOCKSIZE,
+					(pkg2_size_aligned - avail) / NX_EMMC_BLOCKSIZE, pkg2 + avail);
+				if (!res)
+					break;
+				ctxt->pkg2_read = pkg2_size_aligned;
+			}
+		}
+
+		if (!pkg2_decrypt_partial(pkg2, &ctxt->pkg2_done, avail, ctxt->pkg2_decrypt_mask))
+		{
+			res = 0;
+			break;
+		}
+	}
+
+	if (ctxt->pkg2_pending)
+	{
+		sdmmc_storage_complete(storage);
+		ctxt->pkg2_pending = 0;
+	}
+
+	// Drop the reference of _read_emmc_pkg2_start too.
+	if (storage)
+	{
+		nx_emmc_close();
+		nx_emmc_close();
+	}
+
+	if (res)
+		res = pkg2_decrypt_partial(pkg2, &ctxt->pkg2_done, ctxt->pkg2_read, ctxt->pkg2_decrypt_mask);
+
+	return res;
 }
 
-static int _config_secmon(launch_ctxt_t *ctxt, const char *value)
+static void *_launch_file_read(launch_ctxt_t *ctxt, const char *path, u32 *fsize)
 {
 	FIL fp;
-	if (f_open(&fp, value, FA_READ) != FR_OK)
-		return 0;
-	ctxt->secmon_size = f_size(&fp);
-	ctxt->secmon = malloc(ctxt->secmon_size);
-	f_read(&fp, ctxt->secmon, ctxt->secmon_size, NULL);
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+		return NULL;
+
+	u32 size = f_size(&fp);
+	void *buf = arena_alloc(&ctxt->arena, size);
+	if (buf && !sd_file_read_to(&fp, buf, size))
+		buf = NULL;
 	f_close(&fp);
-	return 1;
+
+	if (buf && fsize)
+		*fsize = size;
+
+	return buf;
+}
+
+static int _config_warmboot(launch_ctxt_t *ctxt, const char *value)
+{
+	ctxt->warmboot = _launch_file_read(ctxt, value, &ctxt->warmboot_size);
+	return ctxt->warmboot != NULL;
+}
+
+static int _config_secmon(launch_ctxt_t *ctxt, const char *value)
+{
+	ctxt->secmon = _launch_file_read(ctxt, value, &ctxt->secmon_size);
+	return ctxt->secmon != NULL;
 }
 
 static int _config_kernel(launch_ctxt_t *ctxt, const char *value)
@@ -334,27 +463,175 @@ static int _config_kernel(launch_ctxt_t *ctxt, const char *value)
 	FIL fp;
 	if (f_open(&fp, value, FA_READ) != FR_OK)
 		return 0;
+
+	// Read it straight into its place in the rebuilt package2.
 	ctxt->kernel_size = f_size(&fp);
-	ctxt->kernel = malloc(ctxt->kernel_size);
-	f_read(&fp, ctxt->kernel, ctxt->kernel_size, NULL);
+	ctxt->kernel = PKG2_KERNEL_SLOT;
+	if (!sd_file_read_to(&fp, ctxt->kernel, ctxt->kernel_size))
+	{
+		ctxt->kernel = NULL;
+		f_close(&fp);
+		return 0;
+	}
 	f_close(&fp);
+
 	return 1;
 }
 
+#define KIP1_DIR_MAX_FILES 64
+#define KIP1_DIR_MAX_PATH  128
+
+typedef struct _kip1_dir_ent_t
+{
+	char name[FF_MAX_LFN + 1];
+	u32 size;
+} kip1_dir_ent_t;
+
+static char _kip1_lower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+// Case insensitive, with '*' for any run of characters and '?' for any one.
+static int _kip1_name_match(const char *pat, const char *name)
+{
+	for (; *pat; pat++, name++)
+	{
+		if (*pat == '*')
+		{
+			for (; ; name++)
+			{
+				if (_kip1_name_match(pat + 1, name))
+					return 1;
+				if (!*name)
+					return 0;
+			}
+		}
+		if (!*name || (*pat != '?' && _kip1_lower(*pat) != _kip1_lower(*name)))
+			return 0;
+	}
+
+	return !*name;
+}
+
+static int _config_kip1_dir(launch_ctxt_t *ctxt, const char *value)
+{
+	// Folder, separator and the longest name.
+	char path[KIP1_DIR_MAX_PATH + 1 + FF_MAX_LFN + 1];
+	u32 len = strlen(value);
+	if (len > KIP1_DIR_MAX_PATH)
+		return 0;
+	memcpy(path, value, len + 1);
+
+	// A pattern in the last component filters the folder, a bare folder loads all of it.
+	const char *pattern = "*";
+	char *name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+	if (strchr(name, '*') || strchr(name, '?'))
+	{
+		pattern = value + (name - path);
+		if (name > path + 1)
+			name--;
+		*name = 0;
+	}
+	else if (len > 1 && path[len - 1] == '/')
+		path[len - 1] = 0;
+
+	DIR dir;
+	if (f_opendir(&dir, path) != FR_OK)
+		return 0;
+
+	// One pass over the folder, kept in name order so the merge order does not depend on the FAT.
+	kip1_dir_ent_t *ents = (kip1_dir_ent_t *)malloc(KIP1_DIR_MAX_FILES * sizeof(kip1_dir_ent_t));
+	FILINFO fno;
+	u32 num = 0;
+	u32 total = 0;
+	while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0])
+	{
+		if ((fno.fattrib & (AM_DIR | AM_HID)) || !_kip1_name_match(pattern, fno.fname))
+			continue;
+		if (num == KIP1_DIR_MAX_FILES)
+		{
+			gfx_printf(&gfx_con, "%kOnly the first %d kip1 of %s are loaded.%k\n", 0xFFFFDD00,
+				KIP1_DIR_MAX_FILES, value, 0xFFCCCCCC);
+			break;
+		}
+
+		u32 pos = num++;
+		while (pos && strcmp(ents[pos - 1].name, fno.fname) > 0)
+		{
+			ents[pos] = ents[pos - 1];
+			pos--;
+		}
+		strcpy(ents[pos].name, fno.fname);
+		ents[pos].size = fno.fsize;
+		total += ALIGN(ents[pos].size, DMA_BUF_ALIGN);
+	}
+	f_closedir(&dir);
+
+	// A single arena block holds every KIP and its list node, read back to back.
+	u8 *buf = (u8 *)arena_alloc(&ctxt->arena, total + num * sizeof(merge_kip_t));
+	merge_kip_t *mkip1 = (merge_kip_t *)(buf + total);
+	int res = buf != NULL;
+
+	u32 dirLen = strlen(path);
+	if (dirLen && path[dirLen - 1] != '/')
+		path[dirLen++] = '/';
+	for (u32 i = 0; res && i < num; i++)
+	{
+		strcpy(path + dirLen, ents[i].name);
+
+		FIL fp;
+		res = f_open(&fp, path, FA_READ) == FR_OK;
+		if (!res)
+			break;
+		res = f_size(&fp) == ents[i].size && sd_file_read_to(&fp, buf, ents[i].size);
+		f_close(&fp);
+		if (!res)
+			break;
+
+		mkip1[i].kip1 = buf;
+		list_append(&ctxt->kip1_list, &mkip1[i].link);
+		DPRINTF("Loaded kip1 %s from SD (size %08X)\n", ents[i].name, ents[i].size);
+		buf += ALIGN(ents[i].size, DMA_BUF_ALIGN);
+	}
+
+	free(ents);
+	return res;
+}
+
 static int _config_kip1(launch_ctxt_t *ctxt, const char *value)
 {
-	FIL fp;
-	if (f_open(&fp, value, FA_READ) != FR_OK)
+	// Folders and patterns such as /modules/*.kip load every matching file.
+	FILINFO fno;
+	if (strchr(value, '*') || strchr(value, '?') || (f_stat(value, &fno) == FR_OK && (fno.fattrib & AM_DIR)))
+		return _config_kip1_dir(ctxt, value);
+
+	u32 size;
+	void *kip1 = _launch_file_read(ctxt, value, &size);
+	if (!kip1)
 		return 0;
-	merge_kip_t *mkip1 = (merge_kip_t *)malloc(sizeof(merge_kip_t));
-	mkip1->kip1 = malloc(f_size(&fp));
-	f_read(&fp, mkip1->kip1, f_size(&fp), NULL);
-	DPRINTF("Loaded kip1 from SD (size %08X)\n", f_size(&fp));
-	f_close(&fp);
+	merge_kip_t *mkip1 = (merge_kip_t *)arena_alloc(&ctxt->arena, sizeof(merge_kip_t));
+	if (!mkip1)
+		return 0;
+	mkip1->kip1 = kip1;
+	DPRINTF("Loaded kip1 from SD (size %08X)\n", size);
 	list_append(&ctxt->kip1_list, &mkip1->link);
 	return 1;
 }
 
+static int _config_rawnand(launch_ctxt_t *ctxt, const char *value)
+{
+	// Package1 and package2 come from dir/BOOT0 and dir/rawnand.bin from here on.
+	if (!nx_image_attach(value))
+	{
+		gfx_printf(&gfx_con, "%kFailed to map rawnand image\n%s.%k\n", 0xFFFF0000, value, 0xFFCCCCCC);
+		return 0;
+	}
+	ctxt->image = 1;
+	return 1;
+}
+
 static int _config_svcperm(launch_ctxt_t *ctxt, const char *value)
 {
 	if (*value == '1')
@@ -396,7 +673,9 @@ static int _config_kip1patch(launch_ctxt_t *ctxt, const char *value)
 
 	if (ctxt->kip1_patches == NULL)
 	{
-		ctxt->kip1_patches = malloc(valueLen + 1);
+		ctxt->kip1_patches = arena_alloc(&ctxt->arena, valueLen + 1);
+		if (!ctxt->kip1_patches)
+			return 0;
 		memcpy(ctxt->kip1_patches, value, valueLen);
 		ctxt->kip1_patches[valueLen] = 0;
 	}
@@ -404,10 +683,10 @@ static int _config_kip1patch(launch_ctxt_t *ctxt, const char *value)
 	{
 		char *oldAlloc = ctxt->kip1_patches;
 		int oldSize = strlen(oldAlloc);
-		ctxt->kip1_patches = malloc(oldSize + 1 + valueLen + 1);
+		ctxt->kip1_patches = arena_alloc(&ctxt->arena, oldSize + 1 + valueLen + 1);
+		if (!ctxt->kip1_patches)
+			return 0;
 		memcpy(ctxt->kip1_patches, oldAlloc, oldSize);
-		free(oldAlloc);
-		oldAlloc = NULL;
 		ctxt->kip1_patches[oldSize++] = ',';
 		memcpy(&ctxt->kip1_patches[oldSize], value, valueLen);
 		ctxt->kip1_patches[oldSize + valueLen] = 0;
@@ -427,6 +706,7 @@ static const cfg_handler_t _config_handlers[] = {
 	{ "kernel", _config_kernel },
 	{ "kip1", _config_kip1 },
 	{ "kip1patch", _config_kip1patch },
+	{ "rawnand", _config_rawnand },
 	{ "fullsvcperm", _config_svcperm },
 	{ "debugmode", _config_debugmode },
 	{ "atmosphere", _config_atmosphere },
@@ -435,23 +715,18 @@ static const cfg_handler_t _config_handlers[] = {
 
 static int _config(launch_ctxt_t *ctxt, ini_sec_t *cfg)
 {
-	LIST_FOREACH_ENTRY(ini_kv_t, kv, &cfg->kvs, link)
-		for(u32 i = 0; _config_handlers[i].key; i++)
-			if (!strcmp(_config_handlers[i].key, kv->key) &&
-				!_config_handlers[i].handler(ctxt, kv->val))
+	// Repeated keys (kip1, kip1patch) are visited in file order.
+	for(u32 i = 0; _config_handlers[i].key; i++)
+		for (ini_kv_t *kv = ini_kv_find(cfg, _config_handlers[i].key); kv; kv = ini_kv_find_next(kv))
+			if (!_config_handlers[i].handler(ctxt, kv->val))
 				return 0;
 	return 1;
 }
 
 static void _free_launch_components(launch_ctxt_t *ctxt)
 {
-	free(ctxt->keyblob);
-	free(ctxt->pkg1);
-	free(ctxt->pkg2);
-	free(ctxt->warmboot);
-	free(ctxt->secmon);
-	free(ctxt->kernel);
-	free(ctxt->kip1_patches);
+	// One reset releases every buffer and list node of the attempt.
+	arena_reset(&ctxt->arena);
 }
 
 int hos_launch(ini_sec_t *cfg)
@@ -464,6 +739,10 @@ int hos_launch(ini_sec_t *cfg)
 
 	memset(&ctxt, 0, sizeof(launch_ctxt_t));
 	list_init(&ctxt.kip1_list);
+	arena_init(&ctxt.arena, LAUNCH_ARENA_START, LAUNCH_ARENA_SIZE);
+	bootprof_start();
+	// Decryption, KIP decompression and patching all run boosted.
+	u32 clk = bpmp_clk_boost();
 
 	if (!gfx_con.mute)
 		gfx_clear_grey(&gfx_ctxt, 0x1B);
@@ -471,23 +750,39 @@ int hos_launch(ini_sec_t *cfg)
 
 	// Try to parse config if present.
 	if (cfg && !_config(&ctxt, cfg))
-		return 0;
+		goto error;
+	bootprof_stage("config");
+
+	// The kernel will need hashing, so power up CPU0 while package1/2 are read.
+	if (ctxt.svcperm || ctxt.debugmode || ctxt.atmosphere)
+		ccplex_worker_start();
 
 	gfx_printf(&gfx_con, "Initializing...\n\n");
 
 	// Read package1 and the correct keyblob.
 	if (!_read_emmc_pkg1(&ctxt))
-		return 0;
+		goto error;
 
 	gfx_printf(&gfx_con, "Loaded package1 and keyblob\n");
+	bootprof_stage("pkg1 read");
+
+	// Start reading package2, it does not depend on the keys. The transfer overlaps with TSEC keygen.
+	if (!_read_emmc_pkg2_start(&ctxt))
+		goto error;
+	bootprof_stage("pkg2 read start");
 
 	// Generate keys.
 	if (!h_cfg.se_keygen_done)
 	{
-		keygen(ctxt.keyblob, ctxt.pkg1_id->kb, (u8 *)ctxt.pkg1 + ctxt.pkg1_id->tsec_off);
+		if (!keygen(ctxt.keyblob, ctxt.pkg1_id->kb))
+		{
+			gfx_printf(&gfx_con, "%kFailed to generate keys (corrupt keyblob?).%k\n", 0xFFFF0000, 0xFFCCCCCC);
+			goto error;
+		}
 		h_cfg.se_keygen_done = 1;
 		DPRINTF("Generated keys\n");
 	}
+	bootprof_stage("keygen");
 
 	// Decrypt and unpack package1 if we require parts of it.
 	if (!ctxt.warmboot || !ctxt.secmon)
@@ -496,6 +791,7 @@ int hos_launch(ini_sec_t *cfg)
 		pkg1_unpack((void *)ctxt.pkg1_id->warmboot_base, (void *)ctxt.pkg1_id->secmon_base, NULL, ctxt.pkg1_id, ctxt.pkg1);
 		gfx_printf(&gfx_con, "Decrypted and unpacked package1\n");
 	}
+	bootprof_stage("pkg1 decrypt/unpack");
 
 	// Replace 'warmboot.bin' if requested.
 	if (ctxt.warmboot)
@@ -517,20 +813,29 @@ int hos_launch(ini_sec_t *cfg)
 	}
 
 	gfx_printf(&gfx_con, "Loaded warmboot.bin and secmon\n");
+	bootprof_stage("warmboot/secmon");
 
-	// Read package2.
-	if (!_read_emmc_pkg2(&ctxt))
-		return 0;
+	// Wait for package2.
+	if (!_read_emmc_pkg2_finish(&ctxt))
+		goto error;
 
 	gfx_printf(&gfx_con, "Read package2\n");
+	bootprof_stage("pkg2 read/decrypt");
 
-	// Decrypt package2 and parse KIP1 blobs in INI1 section.
-	pkg2_hdr_t *pkg2_hdr = pkg2_decrypt(ctxt.pkg2);
+	// package2 was decrypted while it was read, as far as needed. Parse KIP1 blobs in INI1 section.
+	pkg2_hdr_t *pkg2_hdr = (pkg2_hdr_t *)((u8 *)ctxt.pkg2 + 0x100);
 
 	LIST_INIT(kip1_info);
-	pkg2_parse_kips(&kip1_info, pkg2_hdr);
+	pkg2_parse_kips(&kip1_info, pkg2_hdr, &ctxt.arena, ctxt.pkg2_inplace);
+
+	// What an earlier boot with the same package1/2 and boot entry found out.
+	bootplan_t plan;
+	if (bootplan_load(&plan, bootplan_key(ctxt.pkg1, ctxt.pkg2, cfg)))
+		DPRINTF("Using boot plan\n");
+	bootplan_apply_kips(&plan, &kip1_info);
 
 	gfx_printf(&gfx_con, "Parsed ini1\n");
+	bootprof_stage("kip parse");
 
 	// Use the kernel included in package2 in case we didn't load one already.
 	if (!ctxt.kernel)
@@ -540,8 +845,9 @@ int hos_launch(ini_sec_t *cfg)
 
 		if (ctxt.svcperm || ctxt.debugmode || ctxt.atmosphere)
 		{
-			u32 kernel_crc32 = crc32c(ctxt.kernel, ctxt.kernel_size);
-			ctxt.pkg2_kernel_id = pkg2_identify(kernel_crc32);
+			if (!plan.kernel_crc)
+				plan.kernel_crc = ccplex_crc32c(0, ctxt.kernel, ctxt.kernel_size);
+			ctxt.pkg2_kernel_id = pkg2_identify(plan.kernel_crc);
 
 			// In case a kernel patch option is set; allows to disable SVC verification or/and enable debug mode.
 			kernel_patch_t *kernel_patchset = ctxt.pkg2_kernel_id->kernel_patchset;
@@ -566,26 +872,45 @@ int hos_launch(ini_sec_t *cfg)
 		}
 	}
 
+	bootprof_stage("kernel id/patch");
+
 	// Merge extra KIP1s into loaded ones.
 	gfx_printf(&gfx_con, "%kPatching kernel initial processes%k\n", 0xFFFFBA00, 0xFFCCCCCC);
 	LIST_FOREACH_ENTRY(merge_kip_t, mki, &ctxt.kip1_list, link)
-		pkg2_merge_kip(&kip1_info, (pkg2_kip1_t *)mki->kip1);
+		pkg2_merge_kip(&kip1_info, (pkg2_kip1_t *)mki->kip1, &ctxt.arena);
+	bootprof_stage("kip merge");
 
 	// Patch kip1s in memory if needed.
-	const char* unappliedPatch = pkg2_patch_kips(&kip1_info, ctxt.kip1_patches);
+	const char* unappliedPatch = pkg2_patch_kips(&kip1_info, ctxt.kip1_patches, &ctxt.arena);
 	if (unappliedPatch != NULL)
 	{
 		gfx_printf(&gfx_con, "%kREQUESTED PATCH '%s' NOT APPLIED!%k\n", 0xFFFF0000, unappliedPatch, 0xFFCCCCCC);
-		sd_unmount(); // Just exiting is not enough until pkg2_patch_kips stops modifying the string passed into it.
+		sd_end(); // Just exiting is not enough until pkg2_patch_kips stops modifying the string passed into it.
 		while(1) {} // MUST stop here, because if user requests 'nogc' but it's not applied, their GC controller gets updated!
 	}
+	bootprof_stage("kip patch");
+
+	// Only written if this boot learned something new.
+	bootplan_record_kips(&plan, &kip1_info);
+	bootplan_save(&plan);
 
 	// Rebuild and encrypt package2.
-	pkg2_build_encrypt((void *)0xA9800000, ctxt.kernel, ctxt.kernel_size, &kip1_info);
+	if (ctxt.pkg2_inplace)
+	{
+		if (!pkg2_build_encrypt_inplace(pkg2_hdr, ctxt.pkg2_decrypt_mask & (1 << PKG2_SEC_KERNEL), &kip1_info))
+			goto error;
+	}
+	else
+		pkg2_build_encrypt(PKG2_LOAD_ADDR, ctxt.kernel, ctxt.kernel_size, &kip1_info);
 	gfx_printf(&gfx_con, "Rebuilt and loaded package2\n");
+	bootprof_stage("pkg2 rebuild/encrypt");
 
-	// Unmount SD card.
-	sd_unmount();
+	// Horizon takes over the statlog DRAM, so the launch is logged now, up to this stage.
+	statlog_boot(1, ctxt.pkg1_id->kb, ctxt.pkg2_size, ctxt.kernel_size);
+	statlog_flush();
+
+	// Unmount SD card and power it down, Horizon brings it up itself.
+	sd_end();
 
 	gfx_printf(&gfx_con, "\n%kBooting...%k\n", 0xFF96FF00, 0xFFCCCCCC);
 
@@ -636,7 +961,7 @@ int hos_launch(ini_sec_t *cfg)
 	_free_launch_components(&ctxt);
 
 	// Copy BCT if debug mode is enabled.
-	memset((void *)0x4003D000, 0, 0x3000);
+	memset((void *)MEM_BCT_ADDR, 0, MEM_BCT_SIZE);
 	if (ctxt.debugmode)
 		_copy_bootconfig(&ctxt);
 
@@ -650,6 +975,11 @@ int hos_launch(ini_sec_t *cfg)
 		*mb_exo_fw_no = exoFwNumber;
 	}
 
+	// All eMMC reads are done, power it down before handing off.
+	nx_emmc_end();
+	// The BPMP gets halted below, nothing may fire at it.
+	irq_end();
+
 	// Finalize MC carveout and lock SE before starting 'SecureMonitor'.
 	mc_config_carveout_finalize();
 	_se_lock();
@@ -666,10 +996,21 @@ int hos_launch(ini_sec_t *cfg)
 
 	display_backlight(0);
 
+	// CPU0 goes to secmon from a clean reset.
+	ccplex_worker_stop();
+	// Secmon finds everything in DRAM, and the mailbox it answers on is polled uncached.
+	bpmp_cache_disable();
+	// Hand off at the baseline clock and core voltage, DRAM as sdram_init() left it.
+	bpmp_clk_rate_set(BPMP_CLK_NORMAL);
+	sdram_perf_mode(0);
+
 	// Wait for secmon to get ready.
-	cluster_boot_cpu0(ctxt.pkg1_id->secmon_base);
+	cluster_boot_cpu0(ctxt.pkg1_id->secmon_base, 1);
 	while (!*mb_out)
 		usleep(1);
+	bootprof_stage("secmon handoff");
+	bootprof_end();
+	trace_flush();
 
 	//TODO: pkg1.1 locks PMC scratches, we can do that too at some point.
 	/*PMC(0x4) = 0x7FFFF3;
@@ -692,5 +1033,18 @@ int hos_launch(ini_sec_t *cfg)
 	while (1)
 		FLOW_CTLR(FLOW_CTLR_HALT_COP_EVENTS) = 0x50000000;
 
+error:
+	// Keep the stages that did run.
+	bootprof_stage("error");
+	bootprof_end();
+	statlog_boot(0, ctxt.pkg1_id ? ctxt.pkg1_id->kb : 0, ctxt.pkg2_size, ctxt.kernel_size);
+	bootprof_flush();
+
+	// Leave nothing behind, so a retry starts as clean as a fresh boot.
+	if (ctxt.image)
+		nx_image_detach();
+	ccplex_worker_stop();
+	_free_launch_components(&ctxt);
+	bpmp_clk_rate_set(clk);
 	return 0;
 }
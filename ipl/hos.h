@@ -21,6 +21,7 @@
 #include "ini.h"
 
 int hos_launch(ini_sec_t *cfg);
-int keygen(u8 *keyblob, u32 kb, void *tsec_fw);
+// The TSEC key comes from the package1 cache.
+int keygen(u8 *keyblob, u32 kb);
 
 #endif
@@ -19,6 +19,28 @@
 #include "i2c.h"
 #include "util.h"
 
+#define I2C_CNFG_NORMAL 0x2800
+#define I2C_CNFG_PACKET  0x2C00 // NEW_MASTER_FSM | PACKET_MODE_EN.
+
+#define I2C_TX_FIFO      0x14
+#define I2C_RX_FIFO      0x15
+#define I2C_FIFO_CONTROL 0x17
+#define I2C_FIFO_STATUS  0x18
+#define I2C_INT_STATUS   0x1A
+
+#define I2C_FIFO_FLUSH   3
+
+#define I2C_INT_ARB_LOST    (1 << 2)
+#define I2C_INT_NOACK       (1 << 3)
+#define I2C_INT_ALL_PACKETS (1 << 8)
+
+#define I2C_PKT_PROTOCOL_I2C (1 << 4)
+#define I2C_PKT_ID           (1 << 16)
+#define I2C_HDR_REPEAT_START (1 << 16)
+#define I2C_HDR_READ         (1 << 19)
+
+#define I2C_PKT_TIMEOUT_US 20000 // Without any FIFO progress.
+
 static u32 i2c_addrs[] = {
 	0x7000C000, 0x7000C400, 0x7000C500,
 	0x7000C700, 0x7000D000, 0x7000D100
@@ -46,7 +68,7 @@ static int _i2c_send_pkt(u32 idx, u32 x, u8 *buf, u32 size)
 	vu32 *base = (vu32 *)i2c_addrs[idx];
 	base[1] = x << 1; //Set x (send mode).
 	base[3] = tmp;    //Set value.
-	base[0] = (2 * size - 2) | 0x2800; //Set size and send mode.
+	base[0] = (2 * size - 2) | I2C_CNFG_NORMAL; //Set size and send mode.
 	_i2c_wait(base);  //Kick transaction.
 
 	base[0] = (base[0] & 0xFFFFFDFF) | 0x200;
@@ -114,6 +136,131 @@ int i2c_send_buf_small(u32 idx, u32 x, u32 y, u8 *buf, u32 size)
 	return _i2c_send_pkt(idx, x, tmp, size + 1);
 }
 
+static void _i2c_pkt_hdr(u32 *hdr, u32 idx, u32 x, u32 size, u32 flags)
+{
+	hdr[0] = I2C_PKT_PROTOCOL_I2C | (idx << 12) | I2C_PKT_ID;
+	hdr[1] = size - 1;
+	hdr[2] = (x << 1) | flags;
+}
+
+static void _i2c_pkt_flush(vu32 *base)
+{
+	base[I2C_FIFO_CONTROL] |= I2C_FIFO_FLUSH;
+	for (u32 i = 0; i < 20; i++)
+	{
+		if (!(base[I2C_FIFO_CONTROL] & I2C_FIFO_FLUSH))
+			break;
+		usleep(1);
+	}
+	base[I2C_INT_STATUS] = base[I2C_INT_STATUS];
+}
+
+/*
+ * Packet mode transfer. One write packet carrying register y and wbuf,
+ * optionally followed by a repeated start read packet of rsize bytes.
+ * The FIFOs are fed and drained while the controller shifts, so the
+ * size is only limited by the 12-bit packet length.
+ */
+static int _i2c_pkt_xfer(u32 idx, u32 x, u32 y, const u8 *wbuf, u32 wsize, u8 *rbuf, u32 rsize)
+{
+	if (wsize + 1 > I2C_PKT_MAX_SIZE || rsize > I2C_PKT_MAX_SIZE)
+		return 0;
+
+	vu32 *base = (vu32 *)i2c_addrs[idx];
+	u32 whdr[3], rhdr[3] = { 0 };
+
+	_i2c_pkt_hdr(whdr, idx, x, wsize + 1, rsize ? I2C_HDR_REPEAT_START : 0);
+	if (rsize)
+		_i2c_pkt_hdr(rhdr, idx, x, rsize, I2C_HDR_READ);
+
+	// Write header, register and payload words, then the read header.
+	u32 wwords = (wsize + 1 + 3) >> 2;
+	u32 tx_total = 3 + wwords + (rsize ? 3 : 0);
+	u32 tx_pos = 0;
+	u32 rx_pos = 0;
+
+	base[0] = I2C_CNFG_PACKET;
+	_i2c_wait(base);
+	_i2c_pkt_flush(base);
+
+	u32 timeout = get_tmr_us() + I2C_PKT_TIMEOUT_US;
+	while (1)
+	{
+		u32 isr = base[I2C_INT_STATUS];
+		if (isr & (I2C_INT_NOACK | I2C_INT_ARB_LOST))
+			break;
+
+		u32 fifo = base[I2C_FIFO_STATUS];
+		u32 tx_free = (fifo >> 4) & 0xF;
+		u32 rx_full = fifo & 0xF;
+
+		if ((tx_free && tx_pos < tx_total) || (rx_full && rx_pos < rsize))
+			timeout = get_tmr_us() + I2C_PKT_TIMEOUT_US;
+
+		for (; tx_free && tx_pos < tx_total; tx_free--, tx_pos++)
+		{
+			u32 word;
+			if (tx_pos < 3)
+				word = whdr[tx_pos];
+			else if (tx_pos < 3 + wwords)
+			{
+				// The register byte leads the payload.
+				u32 off = (tx_pos - 3) << 2;
+				u8 tmp[4] = { 0 };
+				for (u32 i = 0; i < 4; i++)
+				{
+					u32 pos = off + i;
+					if (!pos)
+						tmp[i] = y;
+					else if (pos <= wsize)
+						tmp[i] = wbuf[pos - 1];
+				}
+				memcpy(&word, tmp, 4);
+			}
+			else
+				word = rhdr[tx_pos - 3 - wwords];
+
+			base[I2C_TX_FIFO] = word;
+
+			// Completion is only meaningful once every packet is queued.
+			if (tx_pos == tx_total - 1)
+				base[I2C_INT_STATUS] = I2C_INT_ALL_PACKETS;
+		}
+
+		for (; rx_full && rx_pos < rsize; rx_full--, rx_pos += 4)
+		{
+			u32 word = base[I2C_RX_FIFO];
+			memcpy(rbuf + rx_pos, &word, MIN(4, rsize - rx_pos));
+		}
+
+		if (tx_pos == tx_total && rx_pos >= rsize && (base[I2C_INT_STATUS] & I2C_INT_ALL_PACKETS))
+		{
+			base[I2C_INT_STATUS] = base[I2C_INT_STATUS];
+			return 1;
+		}
+
+		if (get_tmr_us() > timeout)
+			break;
+	}
+
+	_i2c_pkt_flush(base);
+
+	return 0;
+}
+
+int i2c_send_buf(u32 idx, u32 x, u32 y, const u8 *buf, u32 size)
+{
+	return _i2c_pkt_xfer(idx, x, y, buf, size, NULL, 0);
+}
+
+int i2c_recv_buf(u8 *buf, u32 size, u32 idx, u32 x, u32 y)
+{
+	if (!size)
+		return 0;
+
+	return _i2c_pkt_xfer(idx, x, y, NULL, 0, buf, size);
+}
+
 int i2c_recv_buf_small(u8 *buf, u32 size, u32 idx, u32 x, u32 y)
 {
 	int res = _i2c_send_pkt(idx, x, (u8 *)&y, 1);
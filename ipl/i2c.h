@@ -26,9 +26,14 @@
 #define I2C_5 4
 #define I2C_6 5
 
+// Packet mode transfers, including the register byte on writes.
+#define I2C_PKT_MAX_SIZE 4096
+
 void i2c_init(u32 idx);
 int i2c_send_buf_small(u32 idx, u32 x, u32 y, u8 *buf, u32 size);
 int i2c_recv_buf_small(u8 *buf, u32 size, u32 idx, u32 x, u32 y);
+int i2c_send_buf(u32 idx, u32 x, u32 y, const u8 *buf, u32 size);
+int i2c_recv_buf(u8 *buf, u32 size, u32 idx, u32 x, u32 y);
 int i2c_send_byte(u32 idx, u32 x, u32 y, u8 b);
 u8 i2c_recv_byte(u32 idx, u32 x, u32 y);
 
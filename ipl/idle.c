@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "idle.h"
+#include "trace.h"
+#include "util.h"
+
+static idle_task_t _idle_tasks[IDLE_MAX_TASKS];
+static u32 _idle_num_tasks = 0;
+static u32 _idle_next_task = 0;
+static u32 _idle_next_ms = 0;
+static int _idle_enabled = 0;
+static int _idle_running = 0;
+
+int idle_add(const char *name, idle_task_fn_t run, u32 period_ms)
+{
+	if (_idle_num_tasks >= IDLE_MAX_TASKS)
+		return 0;
+
+	idle_task_t *task = &_idle_tasks[_idle_num_tasks++];
+	task->name = name;
+	task->run = run;
+	task->period_ms = period_ms;
+	task->state = 0;
+	task->next_ms = 0;
+	task->finished = 0;
+	task->steps = 0;
+	task->busy_us = 0;
+
+	return 1;
+}
+
+void idle_enable(int enable)
+{
+	_idle_enabled = enable;
+	if (enable)
+		_idle_next_ms = get_tmr_ms() + IDLE_SETTLE_MS;
+}
+
+static void _idle_step(idle_task_t *task)
+{
+	u32 start = get_tmr_us();
+
+	_idle_running = 1;
+	int res = task->run(&task->state);
+	_idle_running = 0;
+
+	task->steps++;
+	task->busy_us += get_tmr_us() - start;
+
+	if (res == IDLE_TASK_MORE)
+		return;
+
+	trace_event(task->name, res, task->steps);
+
+	// Failed one-shots are not retried, their consumer does the work itself.
+	task->state = 0;
+	if (task->period_ms)
+		task->next_ms = get_tmr_ms() + task->period_ms;
+	else
+		task->finished = 1;
+}
+
+static idle_task_t *_idle_pick(u32 now)
+{
+	for (u32 i = 0; i < _idle_num_tasks; i++)
+	{
+		u32 idx = (_idle_next_task + i) % _idle_num_tasks;
+		idle_task_t *task = &_idle_tasks[idx];
+		if (task->finished || (s32)(now - task->next_ms) < 0)
+			continue;
+
+		_idle_next_task = idx + 1;
+		return task;
+	}
+
+	return NULL;
+}
+
+void idle_poll()
+{
+	if (!_idle_enabled || _idle_running || !_idle_num_tasks)
+		return;
+
+	u32 now = get_tmr_ms();
+	if ((s32)(now - _idle_next_ms) < 0)
+		return;
+
+	idle_task_t *task = _idle_pick(now);
+	if (task)
+		_idle_step(task);
+
+	_idle_next_ms = get_tmr_ms() + IDLE_STEP_GAP_MS;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _IDLE_H_
+#define _IDLE_H_
+
+#include "types.h"
+
+#define IDLE_MAX_TASKS 8
+/*! Quiet time after entering a wait, so quick navigation never waits on a step. */
+#define IDLE_SETTLE_MS 250
+/*! Minimum gap between two steps, for the button polling in between. */
+#define IDLE_STEP_GAP_MS 10
+
+// Task step results.
+#define IDLE_TASK_MORE 0
+#define IDLE_TASK_DONE 1
+#define IDLE_TASK_FAIL 2
+
+/*
+ * A resumable work item. Every call does one small step and keeps its
+ * cursor in *state, which starts at 0.
+ */
+typedef int (*idle_task_fn_t)(u32 *state);
+
+typedef struct _idle_task_t
+{
+	const char *name;
+	idle_task_fn_t run;
+	u32 period_ms; // 0 for one-shot tasks, else rearm delay after finishing.
+	u32 state;
+	u32 next_ms;
+	u32 finished;
+	u32 steps;
+	u32 busy_us;
+} idle_task_t;
+
+/*! Registers a task. Returns 0 if the table is full. */
+int idle_add(const char *name, idle_task_fn_t run, u32 period_ms);
+/*! Idle work only runs while enabled, i.e. when no handler owns the storage. */
+void idle_enable(int enable);
+/*! Runs at most one step of the next due task. Called from the button wait loops. */
+void idle_poll();
+
+#endif
@@ -21,142 +21,431 @@
 #include "ff.h"
 #include "heap.h"
 
-static char *_strdup(char *str)
+#define INI_CACHE_NONE 0xFFFFFFFF
+
+typedef struct _ini_pool_t
+{
+	u32 refs;
+	arena_t arena;
+} ini_pool_t;
+
+u32 ini_hash(const char *str)
 {
-	char *res = malloc(strlen(str) + 1);
-	strcpy(res, str);
-	return res;
+	// FNV-1a.
+	u32 hash = 0x811C9DC5;
+	while (*str)
+		hash = (hash ^ (u8)*str++) * 0x01000193;
+
+	return hash;
 }
 
-int ini_parse(link_t *dst, char *ini_path)
+static ini_pool_t *_ini_pool_new(u32 sec_cnt, u32 kv_cnt, u32 data_size, ini_sec_t **secs, ini_kv_t **kvs, u8 **data)
+{
+	// One block per parse. Every section, kv and string of an ini lives in it.
+	u32 size = sec_cnt * sizeof(ini_sec_t) + kv_cnt * sizeof(ini_kv_t) + data_size + DMA_BUF_ALIGN * 3;
+	ini_pool_t *pool = (ini_pool_t *)malloc(sizeof(ini_pool_t) + size);
+	pool->refs = 1;
+	arena_init(&pool->arena, (u32)pool + sizeof(ini_pool_t), size);
+
+	*secs = (ini_sec_t *)arena_alloc(&pool->arena, sec_cnt * sizeof(ini_sec_t));
+	*kvs = (ini_kv_t *)arena_alloc(&pool->arena, kv_cnt * sizeof(ini_kv_t));
+	*data = (u8 *)arena_alloc(&pool->arena, data_size);
+
+	return pool;
+}
+
+static void _ini_pool_put(ini_pool_t *pool)
+{
+	if (--pool->refs == 0)
+		free(pool);
+}
+
+static void _ini_sec_init(ini_sec_t *sec, ini_pool_t *pool, char *name, u32 type, u32 color)
+{
+	sec->name = name;
+	sec->type = type;
+	sec->color = color;
+	sec->pool = pool;
+	list_init(&sec->kvs);
+	memset(sec->kv_hash, 0, sizeof(sec->kv_hash));
+}
+
+static void _ini_kv_add(ini_sec_t *sec, ini_kv_t *kv, char *key, char *val)
+{
+	kv->key = key;
+	kv->val = val;
+	kv->hash = ini_hash(key);
+	kv->hnext = NULL;
+	list_append(&sec->kvs, &kv->link);
+
+	// Chains keep file order. Repeated keys are interned to the first occurrence.
+	ini_kv_t **slot = &sec->kv_hash[kv->hash & (INI_KV_HASH_SIZE - 1)];
+	while (*slot)
+	{
+		if ((*slot)->hash == kv->hash && !strcmp((*slot)->key, key))
+			kv->key = (*slot)->key;
+		slot = &(*slot)->hnext;
+	}
+	*slot = kv;
+}
+
+ini_kv_t *ini_kv_find(ini_sec_t *sec, const char *key)
+{
+	if (sec == NULL)
+		return NULL;
+
+	u32 hash = ini_hash(key);
+	for (ini_kv_t *kv = sec->kv_hash[hash & (INI_KV_HASH_SIZE - 1)]; kv; kv = kv->hnext)
+		if (kv->hash == hash && !strcmp(kv->key, key))
+			return kv;
+
+	return NULL;
+}
+
+ini_kv_t *ini_kv_find_next(ini_kv_t *kv)
+{
+	for (ini_kv_t *next = kv->hnext; next; next = next->hnext)
+		if (next->key == kv->key)
+			return next;
+
+	return NULL;
+}
+
+char *ini_get_val(ini_sec_t *sec, const char *key)
+{
+	// A repeated key takes its last value.
+	ini_kv_t *kv = ini_kv_find(sec, key);
+	for (ini_kv_t *next = kv; next; next = ini_kv_find_next(next))
+		kv = next;
+
+	return kv ? kv->val : NULL;
+}
+
+static void _ini_cache_path(char *path, const char *ini_path)
+{
+	strcpy(path, ini_path);
+	strcat(path, ".bin");
+}
+
+static u32 _ini_cache_str(char *blob, u32 *pos, const char *str)
+{
+	if (str == NULL)
+		return INI_CACHE_NONE;
+
+	u32 off = *pos;
+	u32 len = strlen(str) + 1;
+	if (blob)
+		memcpy(blob + off, str, len);
+	*pos += len;
+
+	return off;
+}
+
+static int _ini_cache_load(link_t *dst, char *ini_path, FILINFO *fno)
 {
-	u32 lblen;
-	char lbuf[512];
+	char path[256];
 	FIL fp;
-	ini_sec_t *csec = NULL;
+	ini_cache_hdr_t hdr;
+	UINT br;
 
-	if (f_open(&fp, ini_path, FA_READ) != FR_OK)
+	_ini_cache_path(path, ini_path);
+	if (f_open(&fp, path, FA_READ) != FR_OK)
 		return 0;
 
-	do
+	if (f_read(&fp, &hdr, sizeof(hdr), &br) != FR_OK || br != sizeof(hdr) ||
+		hdr.magic != INI_CACHE_MAGIC || hdr.ini_size != fno->fsize ||
+		hdr.ini_time != ((u32)fno->fdate << 16 | fno->ftime))
+		goto out;
+
+	u32 body_size = hdr.sec_cnt * sizeof(ini_cache_sec_t) + hdr.kv_cnt * sizeof(ini_cache_kv_t) + hdr.str_size;
+	if (f_size(&fp) != sizeof(hdr) + body_size)
+		goto out;
+
+	// The strings stay in the raw file body, right after the live structs.
+	ini_sec_t *secs;
+	ini_kv_t *kvs;
+	u8 *body;
+	ini_pool_t *pool = _ini_pool_new(hdr.sec_cnt, hdr.kv_cnt, body_size, &secs, &kvs, &body);
+	if (f_read(&fp, body, body_size, &br) != FR_OK || br != body_size)
 	{
-		// Fetch one line.
-		lbuf[0] = 0;
-		f_gets(lbuf, 512, &fp);
-		lblen = strlen(lbuf);
+		_ini_pool_put(pool);
+		goto out;
+	}
+	f_close(&fp);
 
-		// Remove trailing newline.
-		if (lbuf[lblen - 1] == '\n')
-			lbuf[lblen - 1] = 0;
+	ini_cache_sec_t *csecs = (ini_cache_sec_t *)body;
+	ini_cache_kv_t *ckvs = (ini_cache_kv_t *)(csecs + hdr.sec_cnt);
+	char *strs = (char *)(ckvs + hdr.kv_cnt);
 
-		if (lblen > 2 && lbuf[0] == '[') // Create new section.
-		{
-			if (csec)
-			{
-				list_append(dst, &csec->link);
-				csec = NULL;
-			}
+	// Reject offsets outside the string blob before anything is linked into dst.
+	u32 kv_total = 0;
+	for (u32 i = 0; i < hdr.sec_cnt; i++)
+	{
+		if (csecs[i].name_off != INI_CACHE_NONE && csecs[i].name_off >= hdr.str_size)
+			goto bad;
+		kv_total += csecs[i].kv_cnt;
+	}
+	for (u32 i = 0; i < hdr.kv_cnt; i++)
+		if (ckvs[i].key_off >= hdr.str_size || ckvs[i].val_off >= hdr.str_size)
+			goto bad;
+	if (kv_total != hdr.kv_cnt || (hdr.str_size && strs[hdr.str_size - 1]))
+		goto bad;
 
-			u32 i;
-			for (i = 0; i < lblen && lbuf[i] != '\n' && lbuf[i] != ']'; i++)
-				;
-			lbuf[i] = 0;
+	u32 kv_idx = 0;
+	for (u32 i = 0; i < hdr.sec_cnt; i++)
+	{
+		_ini_sec_init(&secs[i], pool, (csecs[i].name_off == INI_CACHE_NONE) ? NULL : strs + csecs[i].name_off,
+			csecs[i].type, csecs[i].color);
 
-			csec = (ini_sec_t *)malloc(sizeof(ini_sec_t));
-			csec->name = _strdup(&lbuf[1]);
-			csec->type = INI_CHOICE;
-			list_init(&csec->kvs);
-		}
-		else if (lblen > 2 && lbuf[0] == '{') //Create new caption.
-		{
-			if (csec)
-			{
-				list_append(dst, &csec->link);
-				csec = NULL;
-			}
+		for (u32 j = 0; j < csecs[i].kv_cnt; j++, kv_idx++)
+			_ini_kv_add(&secs[i], &kvs[kv_idx], strs + ckvs[kv_idx].key_off, strs + ckvs[kv_idx].val_off);
+		list_append(dst, &secs[i].link);
+	}
+
+	// Nothing links the pool when there are no sections.
+	if (!hdr.sec_cnt)
+		_ini_pool_put(pool);
+
+	return 1;
+
+bad:
+	_ini_pool_put(pool);
+	return 0;
 
-			u32 i;
-			for (i = 0; i < lblen && lbuf[i] != '\n' && lbuf[i] != '}'; i++)
-				;
-			lbuf[i] = 0;
+out:
+	f_close(&fp);
+	return 0;
+}
+
+static void _ini_cache_save(link_t *src, char *ini_path, FILINFO *fno)
+{
+	char path[256];
+	FIL fp;
+	ini_cache_hdr_t hdr;
+	UINT bw;
 
-			csec = (ini_sec_t *)malloc(sizeof(ini_sec_t));
-			csec->name = _strdup(&lbuf[1]);
-			csec->type = INI_CAPTION;
-			csec->color = 0xFF0AB9E6;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = INI_CACHE_MAGIC;
+	hdr.ini_size = fno->fsize;
+	hdr.ini_time = (u32)fno->fdate << 16 | fno->ftime;
+
+	// Size everything first, so the image is built with a single allocation.
+	LIST_FOREACH_ENTRY(ini_sec_t, ini_sec, src, link)
+	{
+		hdr.sec_cnt++;
+		_ini_cache_str(NULL, &hdr.str_size, ini_sec->name);
+		LIST_FOREACH_ENTRY(ini_kv_t, kv, &ini_sec->kvs, link)
+		{
+			hdr.kv_cnt++;
+			_ini_cache_str(NULL, &hdr.str_size, kv->key);
+			_ini_cache_str(NULL, &hdr.str_size, kv->val);
 		}
-		else if (lblen > 2 && lbuf[0] == '#') //Create empty lines and comments.
+	}
+
+	u32 body_size = hdr.sec_cnt * sizeof(ini_cache_sec_t) + hdr.kv_cnt * sizeof(ini_cache_kv_t) + hdr.str_size;
+	u8 *body = (u8 *)malloc(body_size);
+	ini_cache_sec_t *csecs = (ini_cache_sec_t *)body;
+	ini_cache_kv_t *ckvs = (ini_cache_kv_t *)(csecs + hdr.sec_cnt);
+	char *strs = (char *)(ckvs + hdr.kv_cnt);
+	u32 str_pos = 0;
+
+	LIST_FOREACH_ENTRY(ini_sec_t, ini_sec, src, link)
+	{
+		csecs->name_off = _ini_cache_str(strs, &str_pos, ini_sec->name);
+		csecs->type = ini_sec->type;
+		csecs->color = ini_sec->color;
+		csecs->kv_cnt = 0;
+		LIST_FOREACH_ENTRY(ini_kv_t, kv, &ini_sec->kvs, link)
 		{
-			if (csec)
-			{
-				list_append(dst, &csec->link);
-				csec = NULL;
-			}
+			ckvs->key_off = _ini_cache_str(strs, &str_pos, kv->key);
+			ckvs->val_off = _ini_cache_str(strs, &str_pos, kv->val);
+			ckvs++;
+			csecs->kv_cnt++;
+		}
+		csecs++;
+	}
 
-			u32 i;
-			for (i = 0; i < lblen && lbuf[i] != '\n'; i++)
-				;
-			lbuf[i] = 0;
+	_ini_cache_path(path, ini_path);
+	if (f_open(&fp, path, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK)
+	{
+		int ok = f_write(&fp, &hdr, sizeof(hdr), &bw) == FR_OK && bw == sizeof(hdr);
+		ok = ok && f_write(&fp, body, body_size, &bw) == FR_OK && bw == body_size;
+		f_close(&fp);
+
+		// Never leave a truncated image behind.
+		if (!ok)
+			f_unlink(path);
+	}
+
+	free(body);
+}
+
+/*
+ * Walks the ini text line by line. With secs == NULL it only counts what the
+ * second pass will need, otherwise it terminates strings in place and links
+ * the sections into dst.
+ */
+static void _ini_parse_lines(char *text, u32 size, link_t *dst, ini_pool_t *pool,
+	ini_sec_t *secs, ini_kv_t *kvs, u32 *sec_cnt, u32 *kv_cnt)
+{
+	char *end = text + size;
+	ini_sec_t *csec = NULL;
+	u32 ctype = 0;
+	u32 nsec = 0;
+	u32 nkv = 0;
+
+	while (text < end)
+	{
+		char *line = text;
+		u32 len;
+		for (len = 0; line + len < end && line[len] != '\n'; len++)
+			;
+		text += len + 1;
 
-			csec = (ini_sec_t *)malloc(sizeof(ini_sec_t));
-			csec->name = _strdup(&lbuf[1]);
-			csec->type = INI_COMMENT;
+		// Length with the newline, like f_gets returns it.
+		u32 lblen = len + (line + len < end);
+		if (len && line[len - 1] == '\r')
+		{
+			len--;
+			lblen--;
 		}
+		if (secs)
+			line[len] = 0;
+
+		u32 type;
+		char term = 0;
+		if (lblen > 2 && line[0] == '[') // Create new section.
+		{
+			type = INI_CHOICE;
+			term = ']';
+		}
+		else if (lblen > 2 && line[0] == '{') // Create new caption.
+		{
+			type = INI_CAPTION;
+			term = '}';
+		}
+		else if (lblen > 2 && line[0] == '#') // Create empty lines and comments.
+			type = INI_COMMENT;
 		else if (lblen <= 1)
+			type = INI_NEWLINE;
+		else if (ctype == INI_CHOICE) // Extract key/value.
 		{
-			if (csec)
+			if (secs)
 			{
-				list_append(dst, &csec->link);
-				csec = NULL;
+				u32 i;
+				for (i = 0; i < len && line[i] != '='; i++)
+					;
+				char *val = &line[len];
+				if (i < len)
+				{
+					line[i] = 0;
+					val = &line[i + 1];
+				}
+				_ini_kv_add(csec, &kvs[nkv], line, val);
 			}
-
-			csec = (ini_sec_t *)malloc(sizeof(ini_sec_t));
-			csec->name = NULL;
-			csec->type = INI_NEWLINE;
+			nkv++;
+			continue;
 		}
-		else if (csec->type == INI_CHOICE) //Extract key/value.
+		else
+			continue;
+
+		if (secs)
 		{
-			u32 i;
-			for (i = 0; i < lblen && lbuf[i] != '\n' && lbuf[i] != '='; i++)
-				;
-			lbuf[i] = 0;
-
-			ini_kv_t *kv = (ini_kv_t *)malloc(sizeof(ini_kv_t));
-			kv->key = _strdup(&lbuf[0]);
-			kv->val = _strdup(&lbuf[i + 1]);
-			list_append(&csec->kvs, &kv->link);
+			char *name = NULL;
+			if (type != INI_NEWLINE)
+			{
+				u32 i;
+				for (i = 1; i < len && line[i] != term; i++)
+					;
+				line[i] = 0;
+				name = &line[1];
+			}
+
+			csec = &secs[nsec];
+			_ini_sec_init(csec, pool, name, type, (type == INI_CAPTION) ? 0xFF0AB9E6 : 0);
+			list_append(dst, &csec->link);
 		}
-	} while (!f_eof(&fp));
+		ctype = type;
+		nsec++;
+	}
+
+	*sec_cnt = nsec;
+	*kv_cnt = nkv;
+}
 
+static int _ini_parse_text(link_t *dst, char *ini_path, u32 size)
+{
+	FIL fp;
+	UINT br;
+
+	if (f_open(&fp, ini_path, FA_READ) != FR_OK)
+		return 0;
+
+	char *text = (char *)malloc(size + 1);
+	if (f_read(&fp, text, size, &br) != FR_OK || br != size)
+	{
+		f_close(&fp);
+		free(text);
+		return 0;
+	}
 	f_close(&fp);
 
-	if (csec)
-		list_append(dst, &csec->link);
+	// Count first, so the pool is allocated once at its exact size.
+	u32 sec_cnt, kv_cnt;
+	_ini_parse_lines(text, size, NULL, NULL, NULL, NULL, &sec_cnt, &kv_cnt);
+
+	ini_sec_t *secs;
+	ini_kv_t *kvs;
+	u8 *data;
+	ini_pool_t *pool = _ini_pool_new(sec_cnt, kv_cnt, size + 1, &secs, &kvs, &data);
+	memcpy(data, text, size);
+	data[size] = 0;
+	free(text);
+
+	_ini_parse_lines((char *)data, size, dst, pool, secs, kvs, &sec_cnt, &kv_cnt);
+
+	// Nothing links the pool when there are no sections.
+	if (!sec_cnt)
+		_ini_pool_put(pool);
+
+	return 1;
+}
+
+int ini_parse(link_t *dst, char *ini_path)
+{
+	FILINFO fno;
+
+	if (f_stat(ini_path, &fno) != FR_OK)
+		return 0;
+
+	if (_ini_cache_load(dst, ini_path, &fno))
+		return 1;
+
+	if (!_ini_parse_text(dst, ini_path, fno.fsize))
+		return 0;
+
+	_ini_cache_save(dst, ini_path, &fno);
 
 	return 1;
 }
 
+void ini_cache_invalidate(char *ini_path)
+{
+	char path[256];
+
+	_ini_cache_path(path, ini_path);
+	f_unlink(path);
+}
+
 void ini_free(link_t *dst)
 {
-	if (dst == NULL)
+	if (dst == NULL || dst->next == dst)
 		return;
 
-	LIST_FOREACH_ENTRY(ini_sec_t, ini_sec, dst, link)
-	{
-		if (ini_sec->type == INI_CHOICE)
-		{
-			LIST_FOREACH_ENTRY(ini_kv_t, kv, &ini_sec->kvs, link)
-			{
-				free(kv->key);
-				free(kv->val);
-				free(kv);
-			}
-		}
-		free(ini_sec->name);
-		free(ini_sec);
-	}
+	// All sections of one parse share a pool.
+	_ini_pool_put(CONTAINER_OF(dst->next, ini_sec_t, link)->pool);
 
-	dst = NULL;
+	list_init(dst);
 }
 
 ini_sec_t *ini_clone_section(ini_sec_t *cfg)
@@ -164,18 +453,10 @@ ini_sec_t *ini_clone_section(ini_sec_t *cfg)
 	if (cfg == NULL)
 		return NULL;
 
-	ini_sec_t *csec = (ini_sec_t *)malloc(sizeof(ini_sec_t));
-	list_init(&csec->kvs);
+	// Sections are immutable once parsed, so a clone only pins the pool.
+	cfg->pool->refs++;
 
-	LIST_FOREACH_ENTRY(ini_kv_t, kv, &cfg->kvs, link)
-	{
-		ini_kv_t *kvcfg = (ini_kv_t *)malloc(sizeof(ini_kv_t));
-		kvcfg->key = _strdup(kv->key);
-		kvcfg->val = _strdup(kv->val);
-		list_append(&csec->kvs, &kvcfg->link);
-	}
-
-	return csec;
+	return cfg;
 }
 
 void ini_free_section(ini_sec_t *cfg)
@@ -183,13 +464,5 @@ void ini_free_section(ini_sec_t *cfg)
 	if (cfg == NULL)
 		return;
 
-	LIST_FOREACH_ENTRY(ini_kv_t, kv, &cfg->kvs, link)
-	{
-		free(kv->key);
-		free(kv->val);
-		free(kv);
-	}
-	free(cfg);
-
-	cfg = NULL;
+	_ini_pool_put(cfg->pool);
 }
@@ -27,10 +27,14 @@
 #define INI_NEWLINE 0xFE
 #define INI_COMMENT 0xFF
 
+#define INI_KV_HASH_SIZE 8
+
 typedef struct _ini_kv_t
 {
 	char *key;
 	char *val;
+	u32 hash;
+	struct _ini_kv_t *hnext;
 	link_t link;
 } ini_kv_t;
 
@@ -41,12 +45,45 @@ typedef struct _ini_sec_t
 	link_t link;
 	u32 type;
 	u32 color;
+	struct _ini_pool_t *pool; // Owns every string and struct of the parse.
+	ini_kv_t *kv_hash[INI_KV_HASH_SIZE];
 } ini_sec_t;
 
+#define INI_CACHE_MAGIC 0x43494E49 // "INIC".
+
+typedef struct _ini_cache_hdr_t
+{
+	u32 magic;
+	u32 ini_size;
+	u32 ini_time;
+	u32 sec_cnt;
+	u32 kv_cnt;
+	u32 str_size;
+} ini_cache_hdr_t;
+
+typedef struct _ini_cache_sec_t
+{
+	u32 name_off;
+	u32 type;
+	u32 color;
+	u32 kv_cnt;
+} ini_cache_sec_t;
+
+typedef struct _ini_cache_kv_t
+{
+	u32 key_off;
+	u32 val_off;
+} ini_cache_kv_t;
+
 int ini_parse(link_t *dst, char *ini_path);
+void ini_cache_invalidate(char *ini_path);
 void ini_free(link_t *dst);
 ini_sec_t *ini_clone_section(ini_sec_t *cfg);
 void ini_free_section(ini_sec_t *cfg);
+u32 ini_hash(const char *str);
+ini_kv_t *ini_kv_find(ini_sec_t *sec, const char *key);
+ini_kv_t *ini_kv_find_next(ini_kv_t *kv);
+char *ini_get_val(ini_sec_t *sec, const char *key);
 
 #endif
 
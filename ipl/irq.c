@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "irq.h"
+#include "t210.h"
+
+/*! Interrupt controller registers, per 32 lines. */
+#define ICTLR_CTLR_SIZE     0x100
+#define ICTLR_VIRQ_COP      0x04
+#define ICTLR_COP_IER_SET   0x34
+#define ICTLR_COP_IER_CLR   0x38
+#define ICTLR_COP_IEP_CLASS 0x3C
+#define ICTLR_NUM_CTLRS     (IRQ_NUM / 32)
+
+// EVP vector the BPMP loads its PC from on an IRQ.
+#define EVP_COP_IRQ_VECTOR 0x218
+
+extern void irq_entry();
+
+typedef struct _irq_slot_t
+{
+	u32 irq;
+	irq_handler_t handler;
+	vu32 count;
+} irq_slot_t;
+
+static u32 _irq_stack[IRQ_STACK_SIZE / 4] __attribute__((aligned(8)));
+static irq_slot_t _irq_slots[IRQ_MAX_HANDLERS];
+static int _irq_active = 0;
+
+static irq_slot_t *_irq_slot_find(u32 irq)
+{
+	for (u32 i = 0; i < IRQ_MAX_HANDLERS; i++)
+		if (_irq_slots[i].handler && _irq_slots[i].irq == irq)
+			return &_irq_slots[i];
+	return NULL;
+}
+
+static void _irq_mask_all()
+{
+	for (u32 i = 0; i < ICTLR_NUM_CTLRS; i++)
+	{
+		ICTLR(i * ICTLR_CTLR_SIZE + ICTLR_COP_IER_CLR) = 0xFFFFFFFF;
+		// IRQ, not FIQ.
+		ICTLR(i * ICTLR_CTLR_SIZE + ICTLR_COP_IEP_CLASS) = 0;
+	}
+}
+
+void irq_dispatch()
+{
+	for (u32 i = 0; i < ICTLR_NUM_CTLRS; i++)
+	{
+		u32 pending = ICTLR(i * ICTLR_CTLR_SIZE + ICTLR_VIRQ_COP);
+		while (pending)
+		{
+			u32 bit = 31 - __builtin_clz(pending);
+			u32 irq = i * 32 + bit;
+			pending &= ~(1 << bit);
+
+			irq_slot_t *slot = _irq_slot_find(irq);
+			if (slot)
+			{
+				slot->handler(irq);
+				slot->count++;
+			}
+			else // Nobody to deassert it, keep it from storming.
+				ICTLR(i * ICTLR_CTLR_SIZE + ICTLR_COP_IER_CLR) = 1 << bit;
+		}
+	}
+}
+
+void irq_init()
+{
+	if (_irq_active)
+		return;
+
+	irq_cpu_disable();
+	_irq_mask_all();
+	irq_set_stack((u32)&_irq_stack[IRQ_STACK_SIZE / 4]);
+	EXCP_VEC(EVP_COP_IRQ_VECTOR) = (u32)irq_entry;
+	_irq_active = 1;
+	irq_cpu_restore(0);
+}
+
+void irq_end()
+{
+	if (!_irq_active)
+		return;
+
+	irq_cpu_disable();
+	_irq_mask_all();
+	for (u32 i = 0; i < IRQ_MAX_HANDLERS; i++)
+		_irq_slots[i].handler = NULL;
+	_irq_active = 0;
+}
+
+int irq_active()
+{
+	return _irq_active;
+}
+
+int irq_request(u32 irq, irq_handler_t handler)
+{
+	if (!_irq_active || irq >= IRQ_NUM)
+		return 0;
+
+	irq_slot_t *slot = _irq_slot_find(irq);
+	for (u32 i = 0; !slot && i < IRQ_MAX_HANDLERS; i++)
+	{
+		if (!_irq_slots[i].handler)
+		{
+			slot = &_irq_slots[i];
+			slot->irq = irq;
+		}
+	}
+	if (!slot)
+		return 0;
+
+	// Counts carry on over re-requests, waiters may hold a snapshot.
+	slot->handler = handler;
+	ICTLR((irq / 32) * ICTLR_CTLR_SIZE + ICTLR_COP_IER_SET) = 1 << (irq % 32);
+
+	return 1;
+}
+
+void irq_free(u32 irq)
+{
+	if (irq >= IRQ_NUM)
+		return;
+
+	ICTLR((irq / 32) * ICTLR_CTLR_SIZE + ICTLR_COP_IER_CLR) = 1 << (irq % 32);
+	irq_slot_t *slot = _irq_slot_find(irq);
+	if (slot)
+		slot->handler = NULL;
+}
+
+u32 irq_count(u32 irq)
+{
+	irq_slot_t *slot = _irq_slot_find(irq);
+	return slot ? slot->count : 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IRQ_H_
+#define _IRQ_H_
+
+#include "types.h"
+
+/*! Legacy interrupt controller lines. */
+#define IRQ_TMR1   0
+#define IRQ_SDMMC1 14
+#define IRQ_SDMMC2 15
+#define IRQ_SDMMC3 19
+#define IRQ_SDMMC4 31
+#define IRQ_SE     58
+#define IRQ_NUM    192
+
+#define IRQ_STACK_SIZE   0x200
+#define IRQ_MAX_HANDLERS 8
+
+/*! Called in IRQ mode, it must deassert the line before returning. */
+typedef void (*irq_handler_t)(u32 irq);
+
+/*! Installs the BPMP IRQ vector with every line masked. */
+void irq_init();
+/*! Masks everything and leaves the vector alone, before handing the BPMP over. */
+void irq_end();
+int irq_active();
+/*! Sets the handler of irq and unmasks it. Cheap when it is already set, 0 if no slot is free. */
+int irq_request(u32 irq, irq_handler_t handler);
+void irq_free(u32 irq);
+/*! Times irq was handled, waiters compare it with a snapshot taken before arming the device. */
+u32 irq_count(u32 irq);
+
+// start.S
+void irq_set_stack(u32 sp);
+u32 irq_cpu_disable();
+void irq_cpu_restore(u32 state);
+
+#endif
@@ -77,6 +77,8 @@
 * marcus.geelnard at home.se
 *************************************************************************/
 
+#include "lz.h"
+
 
 /*************************************************************************
 *                           INTERNAL FUNCTIONS                           *
@@ -112,6 +114,73 @@ static int _LZ_ReadVarSize( unsigned int * x, const unsigned char * buf )
 
 
 
+/*************************************************************************
+* _LZ_WriteVarSize() - Write unsigned integer with variable number of
+* bytes depending on value.
+*************************************************************************/
+
+static int _LZ_WriteVarSize( unsigned int x, unsigned char * buf )
+{
+    unsigned int y;
+    int num_bytes, i, b;
+
+    /* Determine number of bytes needed to store the number x */
+    y = x >> 3;
+    for( num_bytes = 5; num_bytes >= 2; -- num_bytes )
+    {
+        if( y & 0xfe000000 ) break;
+        y <<= 7;
+    }
+
+    /* Write all bytes, seven bits in each, with 8:th bit set for all */
+    /* but the last byte. */
+    for( i = num_bytes-1; i >= 0; -- i )
+    {
+        b = (x >> (i*7)) & 0x0000007f;
+        if( i > 0 )
+        {
+            b |= 0x00000080;
+        }
+        *buf ++ = (unsigned char) b;
+    }
+
+    /* Return number of bytes written */
+    return num_bytes;
+}
+
+
+/*************************************************************************
+* _LZ_VarSizeLen() - Number of bytes _LZ_WriteVarSize() needs for x.
+*************************************************************************/
+
+static unsigned int _LZ_VarSizeLen( unsigned int x )
+{
+    unsigned int num_bytes = 1;
+
+    while( x >>= 7 )
+    {
+        ++ num_bytes;
+    }
+
+    return num_bytes;
+}
+
+
+/*************************************************************************
+* _LZ_Hash() - Hash of the 4 bytes at buf (no unaligned access).
+*************************************************************************/
+
+static unsigned int _LZ_Hash( const unsigned char * buf )
+{
+    unsigned int x;
+
+    x = buf[ 0 ] | (buf[ 1 ] << 8) | (buf[ 2 ] << 16) | (buf[ 3 ] << 24);
+
+    return (x * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+
+
 /*************************************************************************
 *                            PUBLIC FUNCTIONS                            *
 *************************************************************************/
@@ -177,3 +246,114 @@ void LZ_Uncompress( const unsigned char *in, unsigned char *out,
     }
     while( inpos < insize );
 }
+
+
+/*************************************************************************
+* LZ_CompressFast() - Compress a block of data using an LZ77 coder.
+* Unlike the brute force search of the reference coder, only the last
+* position with the same 4 byte hash is tried, and literal runs that find
+* no matches are skipped over progressively faster. This trades some
+* compression ratio for a speed that keeps up with storage transfers.
+*  in      - Input (uncompressed) buffer.
+*  out     - Output (compressed) buffer. This buffer must be 0.4% larger
+*            than the input buffer, plus one byte.
+*  insize  - Number of input bytes.
+*  work    - Work buffer, LZ_WORK_SIZE bytes.
+* The function returns the size of the compressed data.
+*************************************************************************/
+
+unsigned int LZ_CompressFast( const unsigned char *in, unsigned char *out,
+    unsigned int insize, unsigned int *work )
+{
+    unsigned char marker, symbol;
+    unsigned int  inpos, outpos, i, step, misses, hash, cand;
+    unsigned int  length, offset, refsize;
+
+    /* Do we have anything to compress? */
+    if( insize < 1 )
+    {
+        return 0;
+    }
+
+    /* Use the least common byte symbol as marker (histogram in work) */
+    for( i = 0; i < 256; ++ i )
+    {
+        work[ i ] = 0;
+    }
+    for( i = 0; i < insize; ++ i )
+    {
+        ++ work[ in[ i ] ];
+    }
+    marker = 0;
+    for( i = 1; i < 256; ++ i )
+    {
+        if( work[ i ] < work[ marker ] )
+        {
+            marker = (unsigned char) i;
+        }
+    }
+
+    /* Clear the hash table */
+    for( i = 0; i < (1 << LZ_HASH_BITS); ++ i )
+    {
+        work[ i ] = 0xffffffff;
+    }
+
+    /* Remember the marker symbol for the decoder */
+    out[ 0 ] = marker;
+    outpos = 1;
+
+    /* Main compression loop */
+    inpos = 0;
+    misses = 0;
+    while( inpos < insize )
+    {
+        length = 0;
+        offset = 0;
+
+        /* Look up the previous occurrence of the next 4 bytes */
+        if( inpos + 4 <= insize )
+        {
+            hash = _LZ_Hash( &in[ inpos ] );
+            cand = work[ hash ];
+            work[ hash ] = inpos;
+
+            if( cand != 0xffffffff && (inpos - cand) <= LZ_MAX_OFFSET )
+            {
+                offset = inpos - cand;
+                while( (inpos + length) < insize &&
+                       in[ cand + length ] == in[ inpos + length ] )
+                {
+                    ++ length;
+                }
+            }
+        }
+
+        /* Only emit a reference if it is shorter than the literals */
+        refsize = 1 + _LZ_VarSizeLen( length ) + _LZ_VarSizeLen( offset );
+        if( length >= 4 && refsize < length )
+        {
+            out[ outpos ++ ] = marker;
+            outpos += _LZ_WriteVarSize( length, &out[ outpos ] );
+            outpos += _LZ_WriteVarSize( offset, &out[ outpos ] );
+            inpos += length;
+            misses = 0;
+        }
+        else
+        {
+            /* Copy literals, faster the longer nothing has matched */
+            step = 1 + (misses ++ >> 5);
+            for( i = 0; i < step && inpos < insize; ++ i )
+            {
+                symbol = in[ inpos ++ ];
+                out[ outpos ++ ] = symbol;
+                if( symbol == marker )
+                {
+                    out[ outpos ++ ] = 0;
+                }
+            }
+        }
+    }
+
+    return outpos;
+}
@@ -37,10 +37,24 @@ extern "C" {
 #endif
 
 
+/*************************************************************************
+* Constants
+*************************************************************************/
+
+#define LZ_HASH_BITS  14
+#define LZ_WORK_SIZE  ((1 << LZ_HASH_BITS) * sizeof(unsigned int))
+#define LZ_MAX_OFFSET 0x100000
+
+/* Worst case compressed size for insize bytes */
+#define LZ_COMPRESS_BOUND(insize) ((insize) + ((insize) >> 8) + 1)
+
+
 /*************************************************************************
 * Function prototypes
 *************************************************************************/
 
+unsigned int LZ_CompressFast( const unsigned char *in, unsigned char *out,
+                              unsigned int insize, unsigned int *work );
 void LZ_Uncompress( const unsigned char *in, unsigned char *out,
                     unsigned int insize );
 
@@ -45,17 +45,33 @@
 #include "tui.h"
 #include "heap.h"
 #include "list.h"
+#include "memmap.h"
 #include "nx_emmc.h"
+#include "nx_emmc_fs.h"
 #include "se.h"
 #include "se_t210.h"
 #include "hos.h"
 #include "pkg1.h"
+#include "pkg1_cache.h"
 #include "pkg2.h"
 #include "mmc.h"
 #include "blz.h"
+#include "lz.h"
 #include "max17050.h"
 #include "bq24193.h"
 #include "config.h"
+#include "nx_backup.h"
+#include "bootprof.h"
+#include "statlog.h"
+#include "ccplex.h"
+#include "bpmp.h"
+#include "trace.h"
+#include "usbd.h"
+#include "idle.h"
+#include "sensors.h"
+#include "power.h"
+#include "warm.h"
+#include "task.h"
 
 //TODO: ugly.
 gfx_ctxt_t gfx_ctxt;
@@ -70,19 +86,43 @@ gfx_con_t gfx_con;
 //TODO: ugly.
 sdmmc_t sd_sdmmc;
 sdmmc_storage_t sd_storage;
-FATFS sd_fs;
+FATFS *sd_fs;
 int sd_mounted;
+// Set by diskio on a failed transfer, so that the next sd_mount brings the card up again.
+int sd_io_error;
 
 #ifdef MENU_LOGO_ENABLE
-u8 *Kc_MENU_LOGO;
+u32 *Kc_MENU_LOGO = (u32 *)DISPLAY_LOGO_ADDR;
 #endif //MENU_LOGO_ENABLE
 
 hekate_config h_cfg;
 
+void sd_end()
+{
+	if (sd_mounted)
+	{
+		f_mount(NULL, "", 1);
+		sdmmc_storage_end(&sd_storage);
+		sd_mounted = 0;
+	}
+}
+
+static int _sd_inserted()
+{
+	// Card detect is active low. The pin is set up by the SDMMC1 init.
+	return !gpio_read(GPIO_PORT_Z, GPIO_PIN_1);
+}
+
 int sd_mount()
 {
+	// The card stays mounted between actions, it is only brought up again after a removal or an error.
 	if (sd_mounted)
-		return 1;
+	{
+		if (_sd_inserted() && !sd_io_error)
+			return 1;
+		sd_end();
+	}
+	sd_io_error = 0;
 
 	if (!sdmmc_storage_init_sd(&sd_storage, &sd_sdmmc, SDMMC_1, SDMMC_BUS_WIDTH_4, 11))
 	{
@@ -91,10 +131,15 @@ int sd_mount()
 	else
 	{
 		int res = 0;
-		res = f_mount(&sd_fs, "", 1);
+		//Keep the volume (and its sector window) in DMA-reachable memory.
+		if (!sd_fs)
+			sd_fs = (FATFS *)dma_calloc(1, sizeof(FATFS));
+		res = f_mount(sd_fs, "", 1);
 		if (res == FR_OK)
 		{
 			sd_mounted = 1;
+			bootprof_flush();
+			statlog_flush();
 			return 1;
 		}
 		else
@@ -108,39 +153,74 @@ int sd_mount()
 
 void sd_unmount()
 {
+	// Users close their files before letting go, so the volume is consistent for removal.
+	// Only pending logs are written, the card itself stays up for the next action.
 	if (sd_mounted)
 	{
-		f_mount(NULL, "", 1);
-		sdmmc_storage_end(&sd_storage);
-		sd_mounted = 0;
+		bootprof_flush();
+		statlog_flush();
+	}
+}
+
+void sd_card_poll()
+{
+	// A card pulled while mounted is noticed right away, so a swapped one never sees stale FatFs state.
+	if (sd_mounted && !_sd_inserted())
+		sd_end();
+}
+
+/*
+* Reads size bytes from the current position of an opened file straight into dst.
+* Whole sectors of a contiguous file go to DMA-reachable destinations in a single request,
+* everything else through FatFs. Returns 1 on success.
+*/
+int sd_file_read_to(FIL *fp, void *dst, u32 size)
+{
+	DWORD sect;
+	FSIZE_t pos = f_tell(fp);
+	u32 numSectors = size / NX_EMMC_BLOCKSIZE;
+	u8 *ptr = (u8 *)dst;
+
+	if (numSectors && !(pos % NX_EMMC_BLOCKSIZE) && pos + size <= f_size(fp) && dma_buf_ok(ptr) &&
+		!f_contiguous(fp, &sect) && sect)
+	{
+		if (!sdmmc_storage_read(&sd_storage, sect + (DWORD)(pos / NX_EMMC_BLOCKSIZE), numSectors, ptr))
+			return 0;
+		if (f_lseek(fp, pos + numSectors * NX_EMMC_BLOCKSIZE) != FR_OK)
+			return 0;
+		ptr += numSectors * NX_EMMC_BLOCKSIZE;
+		size -= numSectors * NX_EMMC_BLOCKSIZE;
 	}
+
+	UINT br = 0;
+	if (size && (f_read(fp, ptr, size, &br) != FR_OK || br != size))
+		return 0;
+
+	return 1;
 }
 
-void *sd_file_read(char *path)
+// Reads a whole file into a new buffer. The size is returned in fsize, if not NULL.
+void *sd_file_read(char *path, u32 *fsize)
 {
 	FIL fp;
 	if (f_open(&fp, path, FA_READ) != FR_OK)
 		return NULL;
 
 	u32 size = f_size(&fp);
-	void *buf = malloc(size);
+	void *buf = dma_malloc(size);
 
-	u8 *ptr = buf;
-	while (size > 0)
+	if (!sd_file_read_to(&fp, buf, size))
 	{
-		u32 rsize = MIN(size, 512 * 512);
-		if (f_read(&fp, ptr, rsize, NULL) != FR_OK)
-		{
-			free(buf);
-			return NULL;
-		}
-
-		ptr += rsize;
-		size -= rsize;
+		free(buf);
+		f_close(&fp);
+		return NULL;
 	}
 
 	f_close(&fp);
 
+	if (fsize)
+		*fsize = size;
+
 	return buf;
 }
 
@@ -164,8 +244,6 @@ int sd_save_to_file(void *buf, u32 size, const char *filename)
 
 void emmcsn_path_impl(char *path, char *sub_dir, char *filename, sdmmc_storage_t *storage)
 {
-	sdmmc_storage_t storage2;
-	sdmmc_t sdmmc;
 	char emmcSN[9];
 	int init_done = 0;
 
@@ -174,12 +252,13 @@ void emmcsn_path_impl(char *path, char *sub_dir, char *filename, sdmmc_storage_t
 
 	if (!storage)
 	{
-		if (!sdmmc_storage_init_mmc(&storage2, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4))
+		sdmmc_storage_t *storage2 = nx_emmc_open(0);
+		if (!storage2)
 			memcpy(emmcSN, "00000000", 9);
 		else
 		{
 			init_done = 1;
-			itoa(storage2.cid.serial, emmcSN, 16);
+			itoa(storage2->cid.serial, emmcSN, 16);
 		}
 	}
 	else
@@ -198,7 +277,7 @@ void emmcsn_path_impl(char *path, char *sub_dir, char *filename, sdmmc_storage_t
 	memcpy(path + strlen(path), filename, filename_len + 1);
 
 	if (init_done)
-		sdmmc_storage_end(&storage2);
+		nx_emmc_close();
 }
 
 void panic(u32 val)
@@ -338,7 +417,11 @@ void config_hw()
 	SYSREG(AHB_AHB_SPARE_REG) &= 0xFFFFFF9F;
 	PMC(APBDEV_PMC_SCRATCH49) = ((PMC(APBDEV_PMC_SCRATCH49) >> 1) << 1) & 0xFFFFFFFD;
 
-	mbist_workaround();
+	// Relaunched by a previous instance, which left the display clocks, MC and DRAM running.
+	u32 warm = warm_check();
+
+	if (!warm)
+		mbist_workaround();
 	clock_enable_se();
 
 	// Enable fuse clock.
@@ -346,7 +429,9 @@ void config_hw()
 	// Disable fuse programming.
 	fuse_disable_program();
 
-	mc_enable();
+	// Would switch the EMC clock source under trained DRAM.
+	if (!(warm & WARM_SDRAM))
+		mc_enable();
 
 	config_oscillators();
 	APB_MISC(APB_MISC_PP_PINMUX_GLOBAL) = 0;
@@ -368,24 +453,31 @@ void config_hw()
 	i2c_init(I2C_1);
 	i2c_init(I2C_5);
 
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_CNFGBBC, 0x40);
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_ONOFFCNFG1, 0x78);
-
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_CFG0, 0x38);
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_CFG1, 0x3A);
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_CFG2, 0x38);
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_LDO4, 0xF);
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_LDO8, 0xC7);
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_SD0, 0x4F);
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_SD1, 0x29);
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_SD3, 0x1B);
-
-	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_SD0, 42); //42 = (1125000 - 600000) / 12500 -> 1.125V
+	if (!(warm & WARM_PMIC))
+	{
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_CNFGBBC, 0x40);
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_ONOFFCNFG1, 0x78);
+
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_CFG0, 0x38);
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_CFG1, 0x3A);
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_CFG2, 0x38);
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_LDO4, 0xF);
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_LDO8, 0xC7);
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_SD0, 0x4F);
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_SD1, 0x29);
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_FPS_SD3, 0x1B);
+
+		i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_SD0, 42); //42 = (1125000 - 600000) / 12500 -> 1.125V
+	}
 
 	config_pmc_scratch();
 
 	CLOCK(CLK_RST_CONTROLLER_SCLK_BURST_POLICY) = (CLOCK(CLK_RST_CONTROLLER_SCLK_BURST_POLICY) & 0xFFFF8888) | 0x3333;
 
+	// Carveouts, training and the LP0 copy in the PMC scratches are all still in place.
+	if (warm & WARM_SDRAM)
+		return;
+
 	mc_config_carveout();
 
 	sdram_init();
@@ -499,10 +591,8 @@ void print_mmc_info()
 
 	static const u32 SECTORS_TO_MIB_COEFF = 11;
 
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-
-	if (!sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4))
+	sdmmc_storage_t *storage = nx_emmc_open(0);
+	if (!storage)
 	{
 		EPRINTF("Failed to init eMMC.");
 		goto out;
@@ -513,7 +603,7 @@ void print_mmc_info()
 		u32 speed;
 
 		gfx_printf(&gfx_con, "%kCID:%k\n", 0xFF00DDFF, 0xFFCCCCCC);
-		switch (storage.csd.mmca_vsn)
+		switch (storage->csd.mmca_vsn)
 		{
 		case 0: /* MMC v1.0 - v1.2 */
 		case 1: /* MMC v1.4 */
@@ -524,11 +614,11 @@ void print_mmc_info()
 				" FW rev:     %X\n"
 				" S/N:        %03X\n"
 				" Month/Year: %02d/%04d\n\n",
-				storage.cid.manfid,
-				storage.cid.prod_name[0], storage.cid.prod_name[1],	storage.cid.prod_name[2],
-				storage.cid.prod_name[3], storage.cid.prod_name[4],	storage.cid.prod_name[5],
-				storage.cid.prod_name[6], storage.cid.hwrev, storage.cid.fwrev,
-				storage.cid.serial, storage.cid.month, storage.cid.year);
+				storage->cid.manfid,
+				storage->cid.prod_name[0], storage->cid.prod_name[1],	storage->cid.prod_name[2],
+				storage->cid.prod_name[3], storage->cid.prod_name[4],	storage->cid.prod_name[5],
+				storage->cid.prod_name[6], storage->cid.hwrev, storage->cid.fwrev,
+				storage->cid.serial, storage->cid.month, storage->cid.year);
 			break;
 		case 2: /* MMC v2.0 - v2.2 */
 		case 3: /* MMC v3.1 - v3.3 */
@@ -541,23 +631,23 @@ void print_mmc_info()
 				" Prd Rev:    %X\n"
 				" S/N:        %04X\n"
 				" Month/Year: %02d/%04d\n\n",
-				storage.cid.manfid, storage.cid.card_bga, storage.cid.oemid,
-				storage.cid.prod_name[0], storage.cid.prod_name[1], storage.cid.prod_name[2],
-				storage.cid.prod_name[3], storage.cid.prod_name[4],	storage.cid.prod_name[5],
-				storage.cid.prv, storage.cid.serial, storage.cid.month, storage.cid.year);
+				storage->cid.manfid, storage->cid.card_bga, storage->cid.oemid,
+				storage->cid.prod_name[0], storage->cid.prod_name[1], storage->cid.prod_name[2],
+				storage->cid.prod_name[3], storage->cid.prod_name[4],	storage->cid.prod_name[5],
+				storage->cid.prv, storage->cid.serial, storage->cid.month, storage->cid.year);
 			break;
 		default:
-			EPRINTFARGS("eMMC has unknown MMCA version %d", storage.csd.mmca_vsn);
+			EPRINTFARGS("eMMC has unknown MMCA version %d", storage->csd.mmca_vsn);
 			break;
 		}
 
-		if (storage.csd.structure == 0)
+		if (storage->csd.structure == 0)
 			EPRINTF("Unknown CSD structure.");
 		else
 		{
 			gfx_printf(&gfx_con, "%kExtended CSD V1.%d:%k\n",
-				0xFF00DDFF, storage.ext_csd.ext_struct, 0xFFCCCCCC);
-			card_type = storage.ext_csd.card_type;
+				0xFF00DDFF, storage->ext_csd.ext_struct, 0xFFCCCCCC);
+			card_type = storage->ext_csd.card_type;
 			u8 card_type_support[96];
 			u8 pos_type = 0;
 			if (card_type & EXT_CSD_CARD_TYPE_HS_26)
@@ -601,16 +691,16 @@ void print_mmc_info()
 				" Max Rate:      %d MB/s (%d MHz)\n"
 				" Current Rate:  %d MB/s\n"
 				" Type Support:  ",
-				storage.csd.mmca_vsn, storage.ext_csd.rev, storage.ext_csd.dev_version, storage.csd.cmdclass,
-				storage.csd.capacity == (4096 * 512) ? "High" : "Low", speed & 0xFFFF, (speed >> 16) & 0xFFFF,
-				storage.csd.busspeed);
+				storage->csd.mmca_vsn, storage->ext_csd.rev, storage->ext_csd.dev_version, storage->csd.cmdclass,
+				storage->csd.capacity == (4096 * 512) ? "High" : "Low", speed & 0xFFFF, (speed >> 16) & 0xFFFF,
+				storage->csd.busspeed);
 			gfx_con.fntsz = 8;
 			gfx_printf(&gfx_con, "%s", card_type_support);
 			gfx_con.fntsz = 16;
 			gfx_printf(&gfx_con, "\n\n", card_type_support);
 
-			u32 boot_size = storage.ext_csd.boot_mult << 17;
-			u32 rpmb_size = storage.ext_csd.rpmb_mult << 17;
+			u32 boot_size = storage->ext_csd.boot_mult << 17;
+			u32 rpmb_size = storage->ext_csd.rpmb_mult << 17;
 			gfx_printf(&gfx_con, "%keMMC Partitions:%k\n", 0xFF00DDFF, 0xFFCCCCCC);
 			gfx_printf(&gfx_con, " 1: %kBOOT0      %k\n    Size: %5d KiB (LBA Sectors: 0x%07X)\n", 0xFF96FF00, 0xFFCCCCCC,
 				boot_size / 1024, boot_size / 1024 / 512);
@@ -622,13 +712,13 @@ void print_mmc_info()
 				rpmb_size / 1024, rpmb_size / 1024 / 512);
 			gfx_put_small_sep(&gfx_con);
 			gfx_printf(&gfx_con, " 0: %kGPP (USER) %k\n    Size: %5d MiB (LBA Sectors: 0x%07X)\n\n", 0xFF96FF00, 0xFFCCCCCC,
-				storage.sec_cnt >> SECTORS_TO_MIB_COEFF, storage.sec_cnt);
+				storage->sec_cnt >> SECTORS_TO_MIB_COEFF, storage->sec_cnt);
 			gfx_put_small_sep(&gfx_con);
 			gfx_printf(&gfx_con, "%kGPP (eMMC USER) partition table:%k\n", 0xFF00DDFF, 0xFFCCCCCC);
 
-			sdmmc_storage_set_mmc_partition(&storage, 0);
+			sdmmc_storage_set_mmc_partition(storage, 0);
 			LIST_INIT(gpt);
-			nx_emmc_gpt_parse(&gpt, &storage);
+			nx_emmc_gpt_parse(&gpt, storage);
 			int gpp_idx = 0;
 			LIST_FOREACH_ENTRY(emmc_part_t, part, &gpt, link)
 			{
@@ -639,11 +729,10 @@ void print_mmc_info()
 			}
 			nx_emmc_gpt_free(&gpt);
 		}
+		nx_emmc_close();
 	}
 
 out:
-	sdmmc_storage_end(&storage);
-
 	btn_wait();
 }
 
@@ -684,50 +773,151 @@ void print_sdcard_info()
 			" UHS Grade:      U%d\n"
 			" Video Class:    V%d\n"
 			" App perf class: A%d\n"
+			" AU Size:        %d KiB\n"
 			" Write Protect:  %d\n\n",
 			sd_storage.csd.cmdclass, capacity,
 			sd_storage.ssr.bus_width, sd_storage.csd.busspeed, sd_storage.csd.busspeed * 2,
 			sd_storage.ssr.speed_class, sd_storage.ssr.uhs_grade, sd_storage.ssr.video_class,
-			sd_storage.ssr.app_class, sd_storage.csd.write_protect);
+			sd_storage.ssr.app_class, sd_storage.ssr.au_size >> 1, sd_storage.csd.write_protect);
 
 		gfx_puts(&gfx_con, "Acquiring FAT volume info...\n\n");
-		f_getfree("", &sd_fs.free_clst, NULL);
+		f_getfree("", &sd_fs->free_clst, NULL);
 		gfx_printf(&gfx_con, "%kFound %s volume:%k\n Free:    %d MiB\n Cluster: %d KiB\n",
-				0xFF00DDFF, sd_fs.fs_type == FS_EXFAT ? "exFAT" : "FAT32", 0xFFCCCCCC,
-				sd_fs.free_clst * sd_fs.csize >> SECTORS_TO_MIB_COEFF, (sd_fs.csize > 1) ? (sd_fs.csize >> 1) : 512);
+				0xFF00DDFF, sd_fs->fs_type == FS_EXFAT ? "exFAT" : "FAT32", 0xFFCCCCCC,
+				sd_fs->free_clst * sd_fs->csize >> SECTORS_TO_MIB_COEFF, (sd_fs->csize > 1) ? (sd_fs->csize >> 1) : 512);
 		sd_unmount();
 	}
 
 	btn_wait();
 }
 
+static const char *_sdmmc_stats_names[SDMMC_STATS_CLASSES] = { "Read", "Write", "Status", "Switch", "Other" };
+
+static void _print_sdmmc_stats(const char *name, u32 id)
+{
+	const sdmmc_stats_t *st = sdmmc_get_stats(id);
+
+	gfx_printf(&gfx_con, "%k%s (SDMMC%d):%k\n", 0xFF00DDFF, name, id + 1, 0xFFCCCCCC);
+	gfx_printf(&gfx_con, " Bus:      type %d, %d kHz, %d-bit\n", st->bus_type, st->bus_khz,
+		st->bus_width == SDMMC_BUS_WIDTH_8 ? 8 : (st->bus_width == SDMMC_BUS_WIDTH_4 ? 4 : 1));
+	gfx_printf(&gfx_con, " Tuning:   %d runs, %d failed, %d cmds, %d reused, tap %d\n",
+		st->tunings, st->tuning_fails, st->tuning_iters, st->tuning_cached, st->tuned_tap);
+	gfx_printf(&gfx_con, " Errors:   %d CRC, %d timeout, %d ADMA, %d resets\n",
+		st->crc_errors, st->timeouts, st->adma_errors, st->resets);
+	gfx_printf(&gfx_con, " Recovery: %d retries, %d half clock\n", st->rw_retries, st->clk_slowdowns);
+	gfx_printf(&gfx_con, " Busy:     %d waits, %d ms\n", st->busy_waits, st->busy_us / 1000);
+
+	for (u32 i = 0; i < SDMMC_STATS_CLASSES; i++)
+	{
+		const sdmmc_cmd_stats_t *cmd = &st->cmds[i];
+		if (!cmd->count)
+			continue;
+
+		gfx_printf(&gfx_con, " %s: %d cmds, %d err, avg %d us, max %d us\n  us:", _sdmmc_stats_names[i],
+			cmd->count, cmd->errors, cmd->total_us / cmd->count, cmd->max_us);
+		for (u32 j = 0; j < SDMMC_STATS_BUCKETS; j++)
+			if (cmd->hist[j])
+				gfx_printf(&gfx_con, " %d:%d", 1 << j, cmd->hist[j]);
+		gfx_putc(&gfx_con, '\n');
+	}
+	gfx_putc(&gfx_con, '\n');
+}
+
+static void _save_sdmmc_stats(FIL *fp, const char *name, u32 id)
+{
+	const sdmmc_stats_t *st = sdmmc_get_stats(id);
+
+	f_printf(fp, "[%s]\nbus_type=%u\nbus_khz=%u\nbus_width=%u\n", name, st->bus_type, st->bus_khz, st->bus_width);
+	f_printf(fp, "tunings=%u\ntuning_fails=%u\ntuning_iters=%u\ntuning_cached=%u\ntuned_tap=%u\n",
+		st->tunings, st->tuning_fails, st->tuning_iters, st->tuning_cached, st->tuned_tap);
+	f_printf(fp, "crc_errors=%u\ntimeouts=%u\nadma_errors=%u\nresets=%u\n",
+		st->crc_errors, st->timeouts, st->adma_errors, st->resets);
+	f_printf(fp, "rw_retries=%u\nclk_slowdowns=%u\nbusy_waits=%u\nbusy_us=%u\n",
+		st->rw_retries, st->clk_slowdowns, st->busy_waits, st->busy_us);
+
+	for (u32 i = 0; i < SDMMC_STATS_CLASSES; i++)
+	{
+		const sdmmc_cmd_stats_t *cmd = &st->cmds[i];
+		f_printf(fp, "%s=%u,%u,%u,%u", _sdmmc_stats_names[i], cmd->count, cmd->errors, cmd->total_us, cmd->max_us);
+		// Bucket n counts commands that took 2^n us and up.
+		for (u32 j = 0; j < SDMMC_STATS_BUCKETS; j++)
+			f_printf(fp, ",%u", cmd->hist[j]);
+		f_puts("\n", fp);
+	}
+	f_puts("\n", fp);
+}
+
+void print_sdmmc_stats()
+{
+	while (1)
+	{
+		gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+		gfx_con_setpos(&gfx_con, 0, 0);
+		gfx_con.fntsz = 8;
+
+		_print_sdmmc_stats("SD Card", SDMMC_1);
+		_print_sdmmc_stats("eMMC", SDMMC_4);
+
+		gfx_puts(&gfx_con, "Counted since power on or the last clear.\n\n");
+		gfx_con.fntsz = 16;
+		gfx_puts(&gfx_con, "Press POWER to dump them to SD Card.\n");
+		gfx_puts(&gfx_con, "Press VOL+ to clear them.\nPress VOL- to go to the menu.\n");
+
+		u32 btn = btn_wait();
+		if (btn & BTN_VOL_UP)
+		{
+			sdmmc_clear_stats(SDMMC_1);
+			sdmmc_clear_stats(SDMMC_4);
+			continue;
+		}
+		if (!(btn & BTN_POWER))
+			break;
+
+		if (sd_mount())
+		{
+			char path[64];
+			FIL fp;
+			emmcsn_path_impl(path, "/Dumps", "sdmmc_stats.txt", NULL);
+			if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK)
+			{
+				_save_sdmmc_stats(&fp, "sd", SDMMC_1);
+				_save_sdmmc_stats(&fp, "emmc", SDMMC_4);
+				f_close(&fp);
+				gfx_puts(&gfx_con, "\nDone!\n");
+			}
+			else
+				EPRINTF("\nError creating sdmmc_stats.txt file.");
+			sd_unmount();
+		}
+		btn_wait();
+	}
+}
+
 void print_tsec_key()
 {
 	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
 	gfx_con_setpos(&gfx_con, 0, 0);
 
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-
-	sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4);
+	const pkg1_cache_t *cache = pkg1_cache_get();
+	if (!cache)
+	{
+		EPRINTF("Failed to init eMMC.");
+		btn_wait();
+		return;
+	}
 
-	// Read package1.
-	u8 *pkg1 = (u8 *)malloc(0x40000);
-	sdmmc_storage_set_mmc_partition(&storage, 1);
-	sdmmc_storage_read(&storage, 0x100000 / NX_EMMC_BLOCKSIZE, 0x40000 / NX_EMMC_BLOCKSIZE, pkg1);
-	sdmmc_storage_end(&storage);
-	const pkg1_id_t *pkg1_id = pkg1_identify(pkg1);
-	if (!pkg1_id)
+	if (!cache->pkg1_id)
 	{
 		EPRINTFARGS("Unknown package1 version for reading\nTSEC firmware (= '%s').",
-			(char *)pkg1 + 0x10);
-		goto out_wait;
+			(char *)cache->pkg1 + 0x10);
+		btn_wait();
+		return;
 	}
 
 	u8 keys[0x10 * 3];
 	for (u32 i = 1; i <= 3; i++)
 	{
-		int res = tsec_query(keys + ((i - 1) * 0x10), i, pkg1 + pkg1_id->tsec_off);
+		int res = pkg1_cache_tsec_key(keys + ((i - 1) * 0x10), i);
 
 		gfx_printf(&gfx_con, "%kTSEC key %d: %k", 0xFF00DDFF, i, 0xFFCCCCCC);
 		if (res >= 0)
@@ -753,32 +943,67 @@ void print_tsec_key()
 				gfx_puts(&gfx_con, "\nDone!\n");
 			sd_unmount();
 		}
+		btn_wait();
 	}
-	else
+}
+
+void relaunch_payload()
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	if (!sd_mount())
 		goto out;
 
-out_wait:
-	btn_wait();
+	FIL fp;
+	if (f_open(&fp, "payload.bin", FA_READ) != FR_OK)
+	{
+		EPRINTF("Failed to open payload.bin.");
+		goto out;
+	}
+
+	u32 size = f_size(&fp);
+	if (!size || size > WARM_PAYLOAD_MAX_SIZE)
+	{
+		EPRINTFARGS("Payload size %d is not supported.", size);
+		f_close(&fp);
+		goto out;
+	}
+
+	// Outside the heap, nothing touches it until the payload has moved itself to IRAM.
+	u8 *buf = (u8 *)MEM_LAUNCH_START;
+	if (!sd_file_read_to(&fp, buf, size))
+	{
+		EPRINTF("Failed to read payload.bin.");
+		f_close(&fp);
+		goto out;
+	}
+	f_close(&fp);
+
+	gfx_printf(&gfx_con, "Relaunching payload (%d KB)...\n", size >> 10);
+
+	sd_end();
+	nx_emmc_end();
+
+	// DRAM, PMIC and the menu's panel stay up, the payload skips their bring-up if it knows the handover.
+	warm_relaunch(buf, WARM_SDRAM | WARM_PMIC | WARM_DISPLAY);
 
 out:
-	free(pkg1);
+	sd_unmount();
+	btn_wait();
 }
 
 void reboot_normal()
 {
-	sd_unmount();
-#ifdef MENU_LOGO_ENABLE
-	free(Kc_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
+	sd_end();
+	nx_emmc_end();
 	panic(0x21); // Bypass fuse programming in package1.
 }
 
 void reboot_rcm()
 {
-	sd_unmount();
-#ifdef MENU_LOGO_ENABLE
-	free(Kc_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
+	sd_end();
+	nx_emmc_end();
 	PMC(APBDEV_PMC_SCRATCH0) = 2; // Reboot into rcm.
 	PMC(0) |= 0x10;
 	while (1)
@@ -787,15 +1012,210 @@ void reboot_rcm()
 
 void power_off()
 {
-	sd_unmount();
-#ifdef MENU_LOGO_ENABLE
-	free(Kc_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
+	sd_end();
+	nx_emmc_end();
 	//TODO: we should probably make sure all regulators are powered off properly.
 	i2c_send_byte(I2C_5, 0x3C, MAX77620_REG_ONOFFCNFG1, MAX77620_ONOFFCNFG1_PWR_OFF);
 }
 
-int dump_emmc_verify(sdmmc_storage_t *storage, u32 lba_curr, char *outFilename, emmc_part_t *part)
+#define DUMP_MANIFEST_MAGIC 0x32414853 // "SHA2"
+#define DUMP_JOURNAL_MAGIC 0x4C4E524A  // "JRNL"
+#define DUMP_JOURNAL_INTERVAL 0x10000000 // Commit progress every 256MB.
+#define DUMP_NAME_MAX 128 // Longest backup path found on SD, terminator included.
+#define DUMP_PATH_MAX (DUMP_NAME_MAX + sizeof(".delta.sha256") - 1) // With the longest suffix added to it.
+
+typedef struct _dump_manifest_t
+{
+	u32 magic;
+	u32 chunk_sectors;
+	u32 num_chunks;
+	u32 rsvd;
+	u8  hashes[][0x20];
+} dump_manifest_t;
+
+#define CHUNK_SECTORS_MIN  512       // 256KB.
+#define CHUNK_SECTORS_MAX  32768     // 16MB.
+#define CHUNK_DRAM_BUDGET  0x4000000 // 64MB of transfer buffers.
+
+/*
+* Picks the transfer chunk for dump/restore/verify. A probe read measures the command overhead
+* against the bus rate and the chunk is made big enough to hide it. It is then aligned to the
+* SD card allocation unit and limited by the DRAM budget for numBufs buffers.
+*/
+static u32 _emmc_get_chunk_sectors(sdmmc_storage_t *storage, u32 lba, u32 totalSectors, u32 numBufs)
+{
+	u32 numSectors = 8192;
+	u8 *buf = (u8 *)dma_malloc(CHUNK_SECTORS_MIN * NX_EMMC_BLOCKSIZE);
+
+	// A single sector read is almost all overhead. The rest of a min chunk is pure transfer.
+	u32 timer = get_tmr_us();
+	int res = sdmmc_storage_read(storage, lba, 1, buf);
+	u32 overhead = get_tmr_us() - timer;
+	timer = get_tmr_us();
+	res = res && sdmmc_storage_read(storage, lba, CHUNK_SECTORS_MIN, buf);
+	u32 elapsed = get_tmr_us() - timer;
+	free(buf);
+
+	// Keep the overhead under 3% of each chunk.
+	if (res && elapsed > overhead)
+		numSectors = (u32)((u64)overhead * (CHUNK_SECTORS_MIN - 1) * 32 / (elapsed - overhead));
+
+	// SD writes are fastest in whole allocation units.
+	u32 au = sd_storage.ssr.au_size;
+	if (au && au <= CHUNK_SECTORS_MAX && !(au & (au - 1)))
+		numSectors = ALIGN(numSectors, au);
+
+	numSectors = MIN(numSectors, CHUNK_SECTORS_MAX);
+	numSectors = MIN(numSectors, CHUNK_DRAM_BUDGET / (numBufs * NX_EMMC_BLOCKSIZE));
+
+	// Keep it a power of two, so chunks never straddle split parts.
+	while (numSectors & (numSectors - 1))
+		numSectors &= numSectors - 1;
+	numSectors = MAX(numSectors, CHUNK_SECTORS_MIN);
+
+	// No point in buffering more than the whole partition.
+	return MIN(numSectors, totalSectors);
+}
+
+#define CLMT_INIT_ENTRIES 0x100
+
+/*
+* Builds the fast-seek cluster link map of an opened file, so seeks and cluster crossings
+* do not walk the FAT chain. Returns the map (free it after f_close) or NULL to stay on the chain.
+* Files with a map cannot grow, so drop it (fp->cltbl = NULL) before writing past their end.
+*/
+static DWORD *_sd_file_fastseek(FIL *fp)
+{
+	u32 entries = CLMT_INIT_ENTRIES;
+	DWORD *clmt = (DWORD *)malloc(entries * sizeof(DWORD));
+	clmt[0] = entries;
+	fp->cltbl = clmt;
+
+	int res = f_lseek(fp, CREATE_LINKMAP);
+	if (res == FR_NOT_ENOUGH_CORE)
+	{
+		// Fragmented file. The required size was returned in the first entry.
+		entries = clmt[0];
+		free(clmt);
+		clmt = (DWORD *)malloc(entries * sizeof(DWORD));
+		clmt[0] = entries;
+		fp->cltbl = clmt;
+		res = f_lseek(fp, CREATE_LINKMAP);
+	}
+
+	if (res)
+	{
+		fp->cltbl = NULL;
+		free(clmt);
+		return NULL;
+	}
+
+	return clmt;
+}
+
+/*
+* Direct-sector access to a contiguous (preallocated or NoFatChain) file. Data goes straight
+* between the buffers and the SD card and FatFs only gets the final position on sync.
+* Requests that are not whole sectors inside the allocated size fall back to FatFs.
+*/
+typedef struct _sd_stream_t
+{
+	FIL *fp;
+	DWORD sect; // First sector of the file, 0 if not streaming.
+	FSIZE_t pos;
+} sd_stream_t;
+
+static void _sd_stream_open(sd_stream_t *st, FIL *fp)
+{
+	st->fp = fp;
+	st->pos = f_tell(fp);
+	if (f_contiguous(fp, &st->sect) || (st->pos % NX_EMMC_BLOCKSIZE))
+		st->sect = 0;
+}
+
+// Hands the stream position back to FatFs.
+static int _sd_stream_sync(sd_stream_t *st)
+{
+	if (st->sect && f_tell(st->fp) != st->pos)
+		return f_lseek(st->fp, st->pos);
+
+	return FR_OK;
+}
+
+static int _sd_stream_direct(sd_stream_t *st, u32 size)
+{
+	return st->sect && !(size % NX_EMMC_BLOCKSIZE) && (st->pos + size <= f_size(st->fp));
+}
+
+static int _sd_stream_read(sd_stream_t *st, void *buf, u32 size)
+{
+	if (_sd_stream_direct(st, size))
+	{
+		if (!sdmmc_storage_read(&sd_storage, st->sect + (DWORD)(st->pos / NX_EMMC_BLOCKSIZE),
+			size / NX_EMMC_BLOCKSIZE, buf))
+			return FR_DISK_ERR;
+		st->pos += size;
+		return FR_OK;
+	}
+
+	int res = _sd_stream_sync(st);
+	if (!res)
+		res = f_read(st->fp, buf, size, NULL);
+	st->pos = f_tell(st->fp);
+
+	return res;
+}
+
+static int _sd_stream_write(sd_stream_t *st, void *buf, u32 size)
+{
+	if (_sd_stream_direct(st, size))
+	{
+		if (!sdmmc_storage_write(&sd_storage, st->sect + (DWORD)(st->pos / NX_EMMC_BLOCKSIZE),
+			size / NX_EMMC_BLOCKSIZE, buf))
+			return FR_DISK_ERR;
+		st->pos += size;
+		return FR_OK;
+	}
+
+	// Growing the file. It might not be contiguous anymore.
+	int res = _sd_stream_sync(st);
+	if (!res)
+		res = f_write(st->fp, buf, size, NULL);
+	st->pos = f_tell(st->fp);
+	st->sect = 0;
+
+	return res;
+}
+
+static int _sd_stream_skip(sd_stream_t *st, u32 size)
+{
+	if (_sd_stream_direct(st, size))
+	{
+		st->pos += size;
+		return FR_OK;
+	}
+
+	int res = f_lseek(st->fp, st->pos + size);
+	st->pos = f_tell(st->fp);
+
+	return res;
+}
+
+// Jobs that are better finished than stopped wait here for the charger, when the battery runs out.
+static void _emmc_power_wait()
+{
+	WPRINTF("\nBattery critical! Connect the charger to continue,\nor press POWER to continue anyway.");
+	while (!power_on_charger())
+	{
+		sensors_invalidate();
+		tui_sbar(&gfx_con, 1);
+		if (btn_wait_timeout(1000, BTN_POWER))
+			break;
+	}
+	sensors_invalidate();
+}
+
+int dump_emmc_verify(sdmmc_storage_t *storage, u32 lba_curr, char *outFilename, emmc_part_t *part, dump_manifest_t *manifest)
 {
 	FIL fp;
 	u32 prevPct = 200;
@@ -807,25 +1227,51 @@ int dump_emmc_verify(sdmmc_storage_t *storage, u32 lba_curr, char *outFilename,
 	if (f_open(&fp, outFilename, FA_READ) == FR_OK)
 	{
 		u32 totalSectorsVer = (u32)((u64)f_size(&fp) >> (u64)9);
+		DWORD *clmt = _sd_file_fastseek(&fp);
+
+		// Backup containers are verified against their expanded chunks.
+		nx_bak_hdr_t *bakHdr = nx_bak_hdr_read(&fp);
+		if (bakHdr)
+			totalSectorsVer = bakHdr->total_sectors;
+
+		// Raw backups are read straight from the card, if they are contiguous.
+		sd_stream_t st;
+		memset(&st, 0, sizeof(sd_stream_t));
+		if (!bakHdr)
+			_sd_stream_open(&st, &fp);
 
 		u32 numSectorsPerIter = 0;
-		if (totalSectorsVer > 0x200000)
-			numSectorsPerIter = 8192; //4MB Cache
+		if (manifest)
+			numSectorsPerIter = manifest->chunk_sectors;
+		else if (bakHdr)
+			numSectorsPerIter = bakHdr->chunk_sectors;
 		else
-			numSectorsPerIter = 512;  //256KB Cache
+			numSectorsPerIter = _emmc_get_chunk_sectors(storage, lba_curr, totalSectorsVer, 2);
 
-		u8 *bufEm = (u8 *)calloc(numSectorsPerIter, NX_EMMC_BLOCKSIZE);
-		u8 *bufSd = (u8 *)calloc(numSectorsPerIter, NX_EMMC_BLOCKSIZE);
+		u8 *bufEm = (u8 *)dma_calloc(numSectorsPerIter, NX_EMMC_BLOCKSIZE);
+		u8 *bufSd = (u8 *)dma_calloc(numSectorsPerIter, NX_EMMC_BLOCKSIZE);
+		u8 *bakWork = bakHdr ? (u8 *)malloc(nx_bak_work_size(bakHdr->format, bakHdr->chunk_sectors)) : NULL;
 
 		u32 pct = (u64)((u64)(lba_curr - part->lba_start) * 100u) / (u64)(part->lba_end - part->lba_start);
 		tui_pbar(&gfx_con, 0, gfx_con.y, pct, 0xFF96FF00, 0xFF155500);
 
+		tui_xfer_t xfer;
+		tui_xfer_init(&xfer, (u64)totalSectorsVer << 9);
+		power_gov_t gov;
+		power_gov_start(&gov, 0);
+
 		u32 num = 0;
+		u32 chunkIdx = 0;
+		u32 ioTimer;
 		while (totalSectorsVer > 0)
 		{
 			num = MIN(totalSectorsVer, numSectorsPerIter);
 
-			if (!sdmmc_storage_read(storage, lba_curr, num, bufEm))
+			// The eMMC side is already hashed in the manifest.
+			ioTimer = get_tmr_us();
+			res = !manifest && !sdmmc_storage_read(storage, lba_curr, num, bufEm);
+			tui_xfer_io(&xfer, TUI_XFER_EMMC, manifest ? 0 : num << 9, ioTimer);
+			if (res)
 			{
 				gfx_con.fntsz = 16;
 				EPRINTFARGS("\nFailed to read %d blocks (@LBA %08X),\nfrom eMMC!\n\nVerification failed..\n",
@@ -833,22 +1279,44 @@ int dump_emmc_verify(sdmmc_storage_t *storage, u32 lba_curr, char *outFilename,
 
 				free(bufEm);
 				free(bufSd);
+				free(bakHdr);
+				free(bakWork);
 				f_close(&fp);
+				free(clmt);
 				return 1;
 			}
-			if (f_read(&fp, bufSd, num << 9, NULL))
+			ioTimer = get_tmr_us();
+			if (bakHdr)
+				res = !nx_bak_chunk_read(&fp, bakHdr, chunkIdx, bufSd, bakWork);
+			else
+				res = _sd_stream_read(&st, bufSd, num << 9);
+			tui_xfer_io(&xfer, TUI_XFER_SD, num << 9, ioTimer);
+			if (res)
 			{
 				gfx_con.fntsz = 16;
 				EPRINTFARGS("\nFailed to read %d blocks (@LBA %08X),\nfrom sd card!\n\nVerification failed..\n", num, lba_curr);
 
 				free(bufEm);
 				free(bufSd);
+				free(bakHdr);
+				free(bakWork);
 				f_close(&fp);
+				free(clmt);
 				return 1;
 			}
 
-			switch (h_cfg.verification)
+			if (manifest)
 			{
+				ccplex_sha256(&hashSd, bufSd, num << 9);
+				res = chunkIdx >= manifest->num_chunks || memcmp(manifest->hashes[chunkIdx], hashSd, 0x20);
+			}
+			else if (ccplex_worker_cores())
+				res = ccplex_memcmp(bufEm, bufSd, num << 9); // A full compare costs less than sparse on the BPMP.
+			else switch (h_cfg.verification)
+			{
+			case 3:
+				res = memcmp(bufEm, bufSd, num << 9); // Word for word, through the burst compare.
+				break;
 			case 1:
 				res = memcmp32sparse((u32 *)bufEm, (u32 *)bufSd, num << 9);
 				break;
@@ -862,11 +1330,18 @@ int dump_emmc_verify(sdmmc_storage_t *storage, u32 lba_curr, char *outFilename,
 			if (res)
 			{
 				gfx_con.fntsz = 16;
-				EPRINTFARGS("\nSD card and eMMC data (@LBA %08X),\ndo not match!\n\nVerification failed..\n", lba_curr);
+				if (manifest)
+					EPRINTFARGS("\nBackup chunk %d (@LBA %08X),\ndoes not match its hash!\n\nVerification failed..\n",
+						chunkIdx, lba_curr);
+				else
+					EPRINTFARGS("\nSD card and eMMC data (@LBA %08X),\ndo not match!\n\nVerification failed..\n", lba_curr);
 
 				free(bufEm);
 				free(bufSd);
+				free(bakHdr);
+				free(bakWork);
 				f_close(&fp);
+				free(clmt);
 				return 1;
 			}
 
@@ -879,12 +1354,33 @@ int dump_emmc_verify(sdmmc_storage_t *storage, u32 lba_curr, char *outFilename,
 
 			lba_curr += num;
 			totalSectorsVer -= num;
+			chunkIdx++;
+			tui_xfer_show(&gfx_con, &xfer, gfx_con.y, xfer.total - ((u64)totalSectorsVer << 9), 0);
+
+			// The backup is done already, so a verify waits rather than failing it.
+			if (totalSectorsVer && power_gov_update(&gov, xfer.total - ((u64)totalSectorsVer << 9),
+				(u64)totalSectorsVer << 9) == POWER_GOV_CRITICAL)
+				_emmc_power_wait();
 		}
+		power_gov_end(&gov);
 		free(bufEm);
 		free(bufSd);
+		free(bakHdr);
+		free(bakWork);
 		f_close(&fp);
+		free(clmt);
+
+		// A truncated backup would otherwise pass on the chunks it still has.
+		if (manifest && chunkIdx != manifest->num_chunks)
+		{
+			gfx_con.fntsz = 16;
+			EPRINTFARGS("\nBackup has %d chunks, its hashes list %d!\n\nVerification failed..\n",
+				chunkIdx, manifest->num_chunks);
+			return 1;
+		}
 
 		tui_pbar(&gfx_con, 0, gfx_con.y, pct, 0xFFCCCCCC, 0xFF555555);
+		tui_xfer_show(&gfx_con, &xfer, gfx_con.y, xfer.total, 1);
 
 		return 0;
 	}
@@ -896,80 +1392,442 @@ int dump_emmc_verify(sdmmc_storage_t *storage, u32 lba_curr, char *outFilename,
 	}
 }
 
-int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
+// <filename><ext> into dst, which holds DUMP_PATH_MAX bytes. Returns 0 if it doesn't fit.
+static int _dump_path_ext(char *dst, const char *filename, const char *ext)
 {
-	static const u32 FAT32_FILESIZE_LIMIT = 0xFFFFFFFF;
-	static const u32 SECTORS_TO_MIB_COEFF = 11;
-
-	u32 multipartSplitSize = (1u << 31);
-	u32 totalSectors = part->lba_end - part->lba_start + 1;
-	u32 currPartIdx = 0;
-	u32 numSplitParts = 0;
-	u32 maxSplitParts = 0;
-	int isSmallSdCard = 0;
-	int partialDumpInProgress = 0;
-	int res = 0;
-	char *outFilename = sd_path;
-	u32 sdPathLen = strlen(sd_path);
+	u32 len = strlen(filename);
+	u32 extLen = strlen(ext);
 
-	FIL partialIdxFp;
-	char partialIdxFilename[12];
-	memcpy(partialIdxFilename, "partial.idx", 12);
+	if (len + extLen >= DUMP_PATH_MAX)
+		return 0;
+	memcpy(dst, filename, len);
+	memcpy(dst + len, ext, extLen + 1);
 
-	gfx_con.fntsz = 8;
-	gfx_printf(&gfx_con, "\nSD Card free space: %d MiB, Total backup size %d MiB\n\n",
-		sd_fs.free_clst * sd_fs.csize >> SECTORS_TO_MIB_COEFF,
-		totalSectors >> SECTORS_TO_MIB_COEFF);
+	return 1;
+}
 
-	// 1GB parts for sd cards 8GB and less.
-	if ((sd_storage.csd.capacity >> (20 - sd_storage.csd.read_blkbits)) <= 8192)
-		multipartSplitSize = (1u << 30);
-	// Maximum parts fitting the free space available.
-	maxSplitParts = (sd_fs.free_clst * sd_fs.csize) / (multipartSplitSize / 512);
+static int _dump_emmc_save_manifest(char *outFilename, dump_manifest_t *manifest)
+{
+	FIL fp;
+	char hashFilename[DUMP_PATH_MAX];
 
-	// Check if the USER partition or the RAW eMMC fits the sd card free space.
-	if (totalSectors > (sd_fs.free_clst * sd_fs.csize))
+	if (!_dump_path_ext(hashFilename, outFilename, ".sha256") ||
+		f_open(&fp, hashFilename, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return 0;
+	int res = f_write(&fp, manifest, sizeof(dump_manifest_t) + manifest->num_chunks * 0x20, NULL);
+	f_close(&fp);
+
+	return !res;
+}
+
+// Loads <filename>.sha256. Returns NULL if it doesn't exist or is not a manifest.
+static dump_manifest_t *_dump_emmc_load_manifest(char *filename)
+{
+	char hashFilename[DUMP_PATH_MAX];
+
+	if (!_dump_path_ext(hashFilename, filename, ".sha256"))
+		return NULL;
+
+	u32 size = 0;
+	dump_manifest_t *manifest = (dump_manifest_t *)sd_file_read(hashFilename, &size);
+	if (manifest && (size < sizeof(dump_manifest_t) || manifest->magic != DUMP_MANIFEST_MAGIC ||
+		!manifest->chunk_sectors || manifest->num_chunks != (size - sizeof(dump_manifest_t)) / 0x20 ||
+		(size - sizeof(dump_manifest_t)) % 0x20))
 	{
-		isSmallSdCard = 1;
+		free(manifest);
+		return NULL;
+	}
 
-		gfx_printf(&gfx_con, "%k\nSD card free space is smaller than total backup size.%k\n", 0xFFFFBA00, 0xFFCCCCCC);
+	return manifest;
+}
 
-		if (!maxSplitParts)
-		{
-			gfx_con.fntsz = 16;
-			EPRINTF("Not enough free space for Partial Backup.");
+// Identity of a base backup for its deltas. The start of the hash of its chunk hashes.
+static void _dump_manifest_id(dump_manifest_t *manifest, u32 *id)
+{
+	u8 hash[0x20];
+
+	se_calc_sha256(hash, manifest->hashes, manifest->num_chunks * 0x20);
+	memcpy(id, hash, 8);
+}
+
+// A delta and its manifest only apply to the base they were made against.
+static void _dump_emmc_drop_delta(char *outFilename)
+{
+	char deltaFilename[DUMP_PATH_MAX];
+
+	// A name that doesn't fit was never written either.
+	if (_dump_path_ext(deltaFilename, outFilename, ".delta"))
+		f_unlink(deltaFilename);
+	if (_dump_path_ext(deltaFilename, outFilename, ".delta.sha256"))
+		f_unlink(deltaFilename);
+}
+
+typedef struct _dump_journal_t
+{
+	u32 magic;
+	u32 part_idx;      // Split part in progress.
+	u32 lba_committed; // Everything before this LBA is safely on the SD card.
+	u32 lba_start;     // Partition the journal belongs to.
+	u32 lba_end;
+	u32 split_size;    // 0 if not split.
+	u32 chunk_sectors;
+	u32 format;
+	u32 decrypted;     // Backup holds BIS decrypted data.
+} dump_journal_t;
+
+static int _dump_emmc_journal_write(char *filename, dump_journal_t *jrnl)
+{
+	FIL fp;
+
+	if (f_open(&fp, filename, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return 0;
+	int res = f_write(&fp, jrnl, sizeof(dump_journal_t), NULL);
+	f_close(&fp);
+
+	return !res;
+}
+
+// Seeks past the committed sectors of a part and restores its chunk table and hashes.
+static int _dump_emmc_resume_part(FIL *fp, char *outFilename, u32 committedSectors, nx_bak_hdr_t *bakHdr,
+	dump_manifest_t *manifest)
+{
+	u32 chunkSectors = bakHdr ? bakHdr->chunk_sectors : (manifest ? manifest->chunk_sectors : 1);
+	u32 committedChunks = committedSectors / chunkSectors;
+	u64 offset = (u64)committedSectors * NX_EMMC_BLOCKSIZE;
 
+	if (bakHdr)
+	{
+		nx_bak_hdr_t *hdr = nx_bak_hdr_read(fp);
+		if (!hdr || hdr->hdr_size != bakHdr->hdr_size || hdr->chunk_sectors != chunkSectors)
+		{
+			free(hdr);
 			return 0;
 		}
+		memcpy(bakHdr->chunk_size, hdr->chunk_size, committedChunks * sizeof(u32));
+		free(hdr);
+
+		offset = bakHdr->hdr_size;
+		for (u32 i = 0; i < committedChunks; i++)
+			offset += ALIGN(bakHdr->chunk_size[i], NX_EMMC_BLOCKSIZE);
 	}
-	// Check if we are continuing a previous raw eMMC or USER partition backup in progress.
-	if (f_open(&partialIdxFp, partialIdxFilename, FA_READ) == FR_OK && totalSectors > (FAT32_FILESIZE_LIMIT / NX_EMMC_BLOCKSIZE))
+
+	if (manifest)
 	{
-		gfx_printf(&gfx_con, "%kFound Partial Backup in progress. Continuing...%k\n\n", 0xFFAEFD14, 0xFFCCCCCC);
+		dump_manifest_t *saved = _dump_emmc_load_manifest(outFilename);
+		if (!saved || saved->chunk_sectors != chunkSectors || saved->num_chunks < committedChunks)
+		{
+			free(saved);
+			return 0;
+		}
+		memcpy(manifest->hashes, saved->hashes, committedChunks * 0x20);
+		manifest->num_chunks = committedChunks;
+		free(saved);
+	}
 
-		partialDumpInProgress = 1;
-		// Force partial dumping, even if the card is larger.
-		isSmallSdCard = 1;
+	if (f_size(fp) < offset)
+		return 0;
 
-		f_read(&partialIdxFp, &currPartIdx, 4, NULL);
-		f_close(&partialIdxFp);
+	// Seek through a link map, so resuming deep into a big part does not walk its whole chain.
+	DWORD *clmt = _sd_file_fastseek(fp);
+	int res = f_lseek(fp, offset);
+	fp->cltbl = NULL;
+	free(clmt);
+
+	return !res && !f_truncate(fp);
+}
+
+/*
+* Allocates a new part as one contiguous extent, so writing it does not grow the FAT or the exFAT
+* bitmap cluster by cluster. If the free space is too fragmented, the part just grows as it is written.
+* The file must be empty and is truncated to its real size when closed.
+*/
+static int _dump_emmc_prealloc(FIL *fp, u32 numSectors, nx_bak_hdr_t *bakHdr)
+{
+	FSIZE_t size = (FSIZE_t)numSectors * NX_EMMC_BLOCKSIZE;
+	if (bakHdr)
+		size += bakHdr->hdr_size;
+
+	return f_expand(fp, size, 1) == FR_OK;
+}
+
+// eMMC transfers retried since boot, shown next to the progress bar.
+static u32 _emmc_retries = 0;
+// Hash manifests are written regardless of the verification mode, for the full backup job.
+static int _dump_force_manifest = 0;
+
+static int _dump_emmc_read_chunk(sdmmc_storage_t *storage, u32 lba_curr, u32 num, u8 *buf)
+{
+	int retryCount = 0;
+
+	while (!sdmmc_storage_read(storage, lba_curr, num, buf))
+	{
+		_emmc_retries++;
+		EPRINTFARGS("Error reading %d blocks @ LBA %08X,\nfrom eMMC (try %d), retrying...",
+			num, lba_curr, ++retryCount);
 
-		if (!maxSplitParts)
+		msleep(150);
+		if (retryCount >= 3)
 		{
 			gfx_con.fntsz = 16;
-			EPRINTF("Not enough free space for Partial Backup.");
+			EPRINTFARGS("\nFailed to read %d blocks @ LBA %08X\nfrom eMMC. Aborting..\n",
+				num, lba_curr);
+			EPRINTF("\nPress any key and try again...\n");
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// BIS crypto works on 16KiB sectors, numbered from the start of the partition.
+#define BIS_SECTOR_SIZE    0x4000
+#define BIS_SECTOR_BLOCKS  (BIS_SECTOR_SIZE / NX_EMMC_BLOCKSIZE)
+#define BIS_KEY_NONE       0xFF
+#define DUMP_BIS_KS_CRYPT  8
+#define DUMP_BIS_KS_TWEAK  9
 
+static int _hex2bin(u8 *dst, const char *src, u32 size)
+{
+	for (u32 i = 0; i < size * 2; i++)
+	{
+		char c = src[i] | 0x20;
+		u32 val;
+		if (c >= '0' && c <= '9')
+			val = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			val = c - 'a' + 10;
+		else
 			return 0;
+
+		if (i & 1)
+			dst[i >> 1] |= val;
+		else
+			dst[i >> 1] = val << 4;
+	}
+
+	return 1;
+}
+
+// Reads bis_key_00-02 (crypt key followed by tweak key) from a prod.keys file.
+static int _dump_load_bis_keys(u8 keys[3][0x20])
+{
+	u32 size = 0;
+	u32 found = 0;
+	char *txt = (char *)sd_file_read("prod.keys", &size);
+	if (!txt)
+		txt = (char *)sd_file_read("switch/prod.keys", &size);
+	if (!txt)
+		return 0;
+
+	char *end = txt + size;
+	for (char *line = txt; line < end;)
+	{
+		char *eol = memchr(line, '\n', end - line);
+		if (!eol)
+			eol = end;
+
+		if (eol - line > 10 && !memcmp(line, "bis_key_0", 9) && line[9] >= '0' && line[9] <= '2')
+		{
+			u32 idx = line[9] - '0';
+			char *val = line + 10;
+			while (val < eol && (*val == ' ' || *val == '\t' || *val == '='))
+				val++;
+			if (eol - val >= 0x40 && _hex2bin(keys[idx], val, 0x20))
+				found |= 1 << idx;
 		}
+		line = eol + 1;
+	}
+	free(txt);
+
+	return found == 7;
+}
+
+static u32 _dump_bis_key_idx(const char *name)
+{
+	if (!strcmp(name, "PRODINFO") || !strcmp(name, "PRODINFOF"))
+		return 0;
+	if (!strcmp(name, "SAFE"))
+		return 1;
+	// BIS key 3 is the same as 2 on every firmware.
+	if (!strcmp(name, "SYSTEM") || !strcmp(name, "USER"))
+		return 2;
+	return BIS_KEY_NONE;
+}
+
+#define EMMC_STAGE_STACK 0x4000 // FatFs, LZ and the error prints of the retry paths.
+
+/*
+* Each chunk of a backup or restore has an eMMC stage and an SD stage. They run as tasks, so each one
+* sleeps on the interrupt of its own controller while the other one works.
+*/
+typedef struct _emmc_stage_t
+{
+	sdmmc_storage_t *storage;
+	u32 lba;
+	u32 num;
+	u8 *buf;
+	tui_xfer_t *xfer;
+	int res;
+} emmc_stage_t;
+
+static void _emmc_stages_run(task_fn_t emmc, void *emmcArg, task_fn_t sd, void *sdArg)
+{
+	// The eMMC transfer is queued first. A stage without a free task slot runs right here and polls.
+	if (emmc && !task_create("emmc", emmc, emmcArg, EMMC_STAGE_STACK))
+		emmc(emmcArg);
+	if (sd && !task_create("sd", sd, sdArg, EMMC_STAGE_STACK))
+		sd(sdArg);
+	task_run();
+}
+
+// Reads the next chunk. On failure, retries it synchronously.
+static int _dump_emmc_fetch_task(void *arg)
+{
+	emmc_stage_t *stage = (emmc_stage_t *)arg;
+	u32 ioTimer = get_tmr_us();
+
+	stage->res = (sdmmc_storage_submit(stage->storage, stage->lba, stage->num, stage->buf, 0) &&
+		sdmmc_storage_complete(stage->storage)) || _dump_emmc_read_chunk(stage->storage, stage->lba, stage->num, stage->buf);
+	tui_xfer_io(stage->xfer, TUI_XFER_EMMC, NX_EMMC_BLOCKSIZE * stage->num, ioTimer);
+
+	return stage->res;
+}
+
+typedef struct _dump_write_stage_t
+{
+	FIL *fp;
+	sd_stream_t *st;
+	nx_bak_hdr_t *bakHdr;
+	u8 *bakWork;
+	dump_manifest_t *manifest;
+	const u8 *bisKey;
+	u32 bisSector; // First BIS sector of the chunk.
+	u32 chunkIdx;  // In the container of the part.
+	u8 *buf;
+	u32 num;
+	tui_xfer_t *xfer;
+	int decrypted;
+	int res;
+} dump_write_stage_t;
+
+// Decrypts and hashes the current chunk and writes it out.
+static int _dump_sd_write_task(void *arg)
+{
+	dump_write_stage_t *stage = (dump_write_stage_t *)arg;
+	dump_manifest_t *manifest = stage->manifest;
+	u32 size = NX_EMMC_BLOCKSIZE * stage->num;
+
+	stage->decrypted = !stage->bisKey || se_aes_xts_crypt(DUMP_BIS_KS_TWEAK, DUMP_BIS_KS_CRYPT, 0, stage->bisSector,
+		stage->buf, stage->buf, BIS_SECTOR_SIZE, stage->num / BIS_SECTOR_BLOCKS);
+	if (!stage->decrypted)
+		return 0;
+
+	// The cluster hashes the chunk while it gets written out.
+	u32 hashQueued = manifest && ccplex_sha256_submit(stage->buf, size);
+	if (manifest && !hashQueued)
+		se_calc_sha256(manifest->hashes[manifest->num_chunks++], stage->buf, size);
+
+	u32 ioTimer = get_tmr_us();
+	if (stage->bakHdr)
+		stage->res = nx_bak_chunk_write(stage->fp, stage->bakHdr, stage->chunkIdx, stage->buf, size, stage->bakWork);
+	else
+		stage->res = _sd_stream_write(stage->st, stage->buf, size);
+	tui_xfer_io(stage->xfer, TUI_XFER_SD, size, ioTimer);
+	if (hashQueued)
+		ccplex_sha256_finish(manifest->hashes[manifest->num_chunks++]);
+
+	return !stage->res;
+}
+
+static int _dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part, const u8 *bisKey)
+{
+	static const u32 FAT32_FILESIZE_LIMIT = 0xFFFFFFFF;
+	static const u32 SECTORS_TO_MIB_COEFF = 11;
+
+	u32 multipartSplitSize = (1u << 31);
+	u32 totalSectors = part->lba_end - part->lba_start + 1;
+	u32 currPartIdx = 0;
+	u32 numSplitParts = 0;
+	u32 maxSplitParts = 0;
+	int isSmallSdCard = 0;
+	int partialDumpInProgress = 0;
+	int res = 0;
+	char *outFilename = sd_path;
+	u32 sdPathLen = strlen(sd_path);
+
+	FIL partialIdxFp;
+	char partialIdxFilename[12];
+	memcpy(partialIdxFilename, "partial.idx", 12);
+	dump_journal_t jrnl;
+
+	gfx_con.fntsz = 8;
+	gfx_printf(&gfx_con, "\nSD Card free space: %d MiB, Total backup size %d MiB\n\n",
+		sd_fs->free_clst * sd_fs->csize >> SECTORS_TO_MIB_COEFF,
+		totalSectors >> SECTORS_TO_MIB_COEFF);
+
+	// Check if the USER partition or the RAW eMMC fits the sd card free space.
+	if (totalSectors > (sd_fs->free_clst * sd_fs->csize))
+	{
+		isSmallSdCard = 1;
+
+		gfx_printf(&gfx_con, "%k\nSD card free space is smaller than total backup size.%k\n", 0xFFFFBA00, 0xFFCCCCCC);
+	}
+
+	// Check if we are continuing a previous backup of this partition.
+	memset(&jrnl, 0, sizeof(dump_journal_t));
+	if (f_open(&partialIdxFp, partialIdxFilename, FA_READ) == FR_OK)
+	{
+		if (!f_read(&partialIdxFp, &jrnl, sizeof(dump_journal_t), NULL) && jrnl.magic == DUMP_JOURNAL_MAGIC &&
+			jrnl.lba_start == part->lba_start && jrnl.lba_end == part->lba_end &&
+			jrnl.decrypted == (bisKey != NULL) &&
+			jrnl.chunk_sectors && !(jrnl.chunk_sectors & (jrnl.chunk_sectors - 1)) &&
+			(jrnl.split_size || !isSmallSdCard))
+			partialDumpInProgress = 1;
+		f_close(&partialIdxFp);
+	}
+
+	// Parts must keep the size they were started with.
+	if (partialDumpInProgress && jrnl.split_size)
+		multipartSplitSize = jrnl.split_size;
+	// 1GB parts for sd cards 8GB and less.
+	else if ((sd_storage.csd.capacity >> (20 - sd_storage.csd.read_blkbits)) <= 8192)
+		multipartSplitSize = (1u << 30);
+	// Maximum parts fitting the free space available.
+	maxSplitParts = (sd_fs->free_clst * sd_fs->csize) / (multipartSplitSize / 512);
+
+	if (isSmallSdCard && !maxSplitParts)
+	{
+		gfx_con.fntsz = 16;
+		EPRINTF("Not enough free space for Partial Backup.");
 
+		return 0;
+	}
+
+	if (partialDumpInProgress)
+	{
+		gfx_printf(&gfx_con, "%kFound Partial Backup in progress. Continuing...%k\n\n", 0xFFAEFD14, 0xFFCCCCCC);
+
+		currPartIdx = jrnl.part_idx;
 		// Increase maxSplitParts to accommodate previously backed up parts.
 		maxSplitParts += currPartIdx;
 	}
-	else if (isSmallSdCard)
-		gfx_printf(&gfx_con, "%kPartial Backup enabled (with %d MiB parts)...%k\n\n", 0xFFFFBA00, multipartSplitSize >> 20, 0xFFCCCCCC);
+	else
+	{
+		memset(&jrnl, 0, sizeof(dump_journal_t));
+		jrnl.magic = DUMP_JOURNAL_MAGIC;
+		jrnl.lba_start = part->lba_start;
+		jrnl.lba_end = part->lba_end;
+		jrnl.lba_committed = part->lba_start;
+		jrnl.decrypted = bisKey != NULL;
+
+		if (isSmallSdCard)
+			gfx_printf(&gfx_con, "%kPartial Backup enabled (with %d MiB parts)...%k\n\n", 0xFFFFBA00, multipartSplitSize >> 20, 0xFFCCCCCC);
+	}
 
 	// Check if filesystem is FAT32 or the free space is smaller and backup in parts.
-	if (((sd_fs.fs_type != FS_EXFAT) && totalSectors > (FAT32_FILESIZE_LIMIT / NX_EMMC_BLOCKSIZE)) | isSmallSdCard)
+	if (((sd_fs->fs_type != FS_EXFAT) && totalSectors > (FAT32_FILESIZE_LIMIT / NX_EMMC_BLOCKSIZE)) | isSmallSdCard |
+		(partialDumpInProgress && jrnl.split_size))
 	{
 		u32 multipartSplitSectors = multipartSplitSize / NX_EMMC_BLOCKSIZE;
 		numSplitParts = (totalSectors + multipartSplitSectors - 1) / multipartSplitSectors;
@@ -1000,10 +1858,25 @@ int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
 		}
 	}
 
+	jrnl.split_size = numSplitParts ? multipartSplitSize : 0;
+
+	// Start of the part in progress and the point it was last committed at.
+	u32 lbaStartPart = part->lba_start + (numSplitParts ? currPartIdx * (multipartSplitSize / NX_EMMC_BLOCKSIZE) : 0);
+	u32 lbaResume = lbaStartPart;
+	if (partialDumpInProgress && jrnl.lba_committed > lbaStartPart && jrnl.lba_committed <= part->lba_end)
+		lbaResume = jrnl.lba_committed;
+
 	FIL fp;
 	gfx_con_getpos(&gfx_con, &gfx_con.savedx, &gfx_con.savedy);
 	gfx_printf(&gfx_con, "Filename: %s\n\n", outFilename);
-	res = f_open(&fp, outFilename, FA_CREATE_ALWAYS | FA_WRITE);
+	res = 1;
+	if (lbaResume != lbaStartPart)
+		res = f_open(&fp, outFilename, FA_OPEN_EXISTING | FA_READ | FA_WRITE);
+	if (res)
+	{
+		lbaResume = lbaStartPart;
+		res = f_open(&fp, outFilename, FA_CREATE_ALWAYS | FA_WRITE);
+	}
 	if (res)
 	{
 		gfx_con.fntsz = 16;
@@ -1011,42 +1884,132 @@ int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
 
 		return 0;
 	}
+	_dump_emmc_drop_delta(outFilename);
 
-	u32 numSectorsPerIter = 0;
-	if (totalSectors > 0x200000)
-		numSectorsPerIter = 8192;
-	else
-		numSectorsPerIter = 512;
-	u8 *buf = (u8 *)calloc(numSectorsPerIter, NX_EMMC_BLOCKSIZE);
+	// A backup in progress keeps its chunk size and format.
+	if (!partialDumpInProgress)
+	{
+		jrnl.chunk_sectors = _emmc_get_chunk_sectors(storage, part->lba_start, totalSectors,
+			h_cfg.backup_format == NX_BAK_FMT_LZ ? 3 : 2);
+		jrnl.format = h_cfg.backup_format;
+	}
+	u32 numSectorsPerIter = jrnl.chunk_sectors;
+	u32 bakFormat = jrnl.format;
+	gfx_printf(&gfx_con, "Chunk size: %d KiB\n\n", numSectorsPerIter >> 1);
+
+	// Chunks per part, for the hash manifest and the backup container header.
+	u32 maxPartSectors = numSplitParts ? (multipartSplitSize / NX_EMMC_BLOCKSIZE) : totalSectors;
+	u32 maxChunks = (maxPartSectors + numSectorsPerIter - 1) / numSectorsPerIter;
+	// The eMMC holds the encrypted data, so a decrypted backup can only be verified against its hashes.
+	u32 manifestSize = (h_cfg.verification == 2 || (bisKey && h_cfg.verification) || _dump_force_manifest) ?
+		(sizeof(dump_manifest_t) + maxChunks * 0x20) : 0;
+	u32 bakHdrSize = bakFormat ? nx_bak_hdr_size(numSectorsPerIter, maxPartSectors) : 0;
+	u32 bakWorkSize = nx_bak_work_size(bakFormat, numSectorsPerIter);
+
+	// Two buffers, so the eMMC read of the next chunk can be queued while the current one goes to SD.
+	u8 *buf = (u8 *)dma_calloc(numSectorsPerIter * 2 * NX_EMMC_BLOCKSIZE + manifestSize + bakHdrSize + bakWorkSize, 1);
+	u8 *bufs[2] = { buf, buf + numSectorsPerIter * NX_EMMC_BLOCKSIZE };
+	u32 bufIdx = 0;
+
+	// Chunk hashes of the current part, if full verification is enabled.
+	dump_manifest_t *manifest = NULL;
+	if (manifestSize)
+	{
+		manifest = (dump_manifest_t *)(buf + numSectorsPerIter * 2 * NX_EMMC_BLOCKSIZE);
+		manifest->magic = DUMP_MANIFEST_MAGIC;
+		manifest->chunk_sectors = numSectorsPerIter;
+	}
 
-	u32 lba_curr = part->lba_start;
-	u32 lbaStartPart = part->lba_start;
-	u32 bytesWritten = 0;
-	u32 prevPct = 200;
-	int retryCount = 0;
+	// Chunk table of the current part, if backing up to a container.
+	nx_bak_hdr_t *bakHdr = NULL;
+	if (bakHdrSize)
+		bakHdr = (nx_bak_hdr_t *)(buf + numSectorsPerIter * 2 * NX_EMMC_BLOCKSIZE + manifestSize);
+	u8 *bakWork = buf + numSectorsPerIter * 2 * NX_EMMC_BLOCKSIZE + manifestSize + bakHdrSize;
 
 	// Continue from where we left, if Partial Backup in progress.
-	if (partialDumpInProgress)
+	u32 lba_curr = lbaResume;
+	u64 bytesWritten = (u64)(lbaResume - lbaStartPart) * NX_EMMC_BLOCKSIZE;
+	u32 bytesUncommitted = 0;
+	u32 prevPct = 200;
+	totalSectors = part->lba_end + 1 - lba_curr;
+
+	// Reserve the container header. It is written when the part is closed.
+	if (bakHdr)
+		nx_bak_hdr_init(bakHdr, bakFormat, numSectorsPerIter, MIN(part->lba_end + 1 - lbaStartPart, maxPartSectors));
+	if (lbaResume == lbaStartPart)
+		_dump_emmc_prealloc(&fp, MIN(part->lba_end + 1 - lbaStartPart, maxPartSectors), bakHdr);
+	if (bakHdr)
+		f_lseek(&fp, bakHdr->hdr_size);
+
+	// Pick up the committed data of the part in progress.
+	if (lbaResume != lbaStartPart)
 	{
-		lba_curr += currPartIdx * (multipartSplitSize / NX_EMMC_BLOCKSIZE);
-		totalSectors -= currPartIdx * (multipartSplitSize / NX_EMMC_BLOCKSIZE);
-		lbaStartPart = lba_curr; // Update the start LBA for verification.
+		if (!_dump_emmc_resume_part(&fp, outFilename, lbaResume - lbaStartPart, bakHdr, manifest))
+		{
+			gfx_con.fntsz = 16;
+			EPRINTF("Failed to continue the Partial Backup.\nSelect the same option again to start over.\n");
+			f_unlink(partialIdxFilename);
+
+			free(buf);
+			f_close(&fp);
+			return 0;
+		}
+		gfx_printf(&gfx_con, "Continuing from %d MiB.\n\n", (lbaResume - part->lba_start) >> SECTORS_TO_MIB_COEFF);
 	}
 
+	// Raw parts are written straight to the card while they fit their preallocation.
+	sd_stream_t st;
+	memset(&st, 0, sizeof(sd_stream_t));
+	if (!bakHdr)
+		_sd_stream_open(&st, &fp);
+
 	u32 num = 0;
+	u32 numNext = 0;
 	u32 pct = 0;
+
+	if (bisKey)
+	{
+		se_aes_key_set(DUMP_BIS_KS_CRYPT, (void *)bisKey, 0x10);
+		se_aes_key_set(DUMP_BIS_KS_TWEAK, (void *)(bisKey + 0x10), 0x10);
+	}
+
+	tui_xfer_t xfer;
+	tui_xfer_init(&xfer, (u64)totalSectors << 9);
+	u32 retriesStart = _emmc_retries;
+	power_gov_t gov;
+	power_gov_start(&gov, 0);
+
+	// Prime the pipeline with the first chunk.
+	num = MIN(totalSectors, numSectorsPerIter);
+	u32 ioTimer = get_tmr_us();
+	if (!_dump_emmc_read_chunk(storage, lba_curr, num, bufs[bufIdx]))
+	{
+		free(buf);
+		f_close(&fp);
+		return 0;
+	}
+	tui_xfer_io(&xfer, TUI_XFER_EMMC, num << 9, ioTimer);
+
 	while (totalSectors > 0)
 	{
 		if (numSplitParts != 0 && bytesWritten >= multipartSplitSize)
 		{
+			if (bakHdr)
+				nx_bak_hdr_write(&fp, bakHdr);
+			// Give back the unused end of the preallocation.
+			_sd_stream_sync(&st);
+			f_truncate(&fp);
 			f_close(&fp);
 			memset(&fp, 0, sizeof(fp));
 			currPartIdx++;
 
+			if (manifest && !_dump_emmc_save_manifest(outFilename, manifest))
+				WPRINTF("\nError creating hash manifest.\n");
+
 			if (h_cfg.verification)
 			{
 				// Verify part.
-				if (dump_emmc_verify(storage, lbaStartPart, outFilename, part))
+				if (dump_emmc_verify(storage, lbaStartPart, outFilename, part, manifest))
 				{
 					EPRINTF("\nPress any key and try again...\n");
 
@@ -1054,6 +2017,8 @@ int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
 					return 0;
 				}
 			}
+			if (manifest)
+				manifest->num_chunks = 0;
 
 			if (numSplitParts >= 10 && currPartIdx < 10)
 			{
@@ -1063,24 +2028,20 @@ int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
 			else
 				itoa(currPartIdx, &outFilename[sdPathLen], 10);
 
-			// Always create partial.idx before next part, in case a fatal error occurs.
-			if (isSmallSdCard)
+			// Always commit the next part to the journal, in case a fatal error occurs.
+			jrnl.part_idx = currPartIdx;
+			jrnl.lba_committed = lba_curr;
+			if (!_dump_emmc_journal_write(partialIdxFilename, &jrnl))
 			{
-				// Create partial backup index file.
-				if (f_open(&partialIdxFp, partialIdxFilename, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK)
-				{
-					f_write(&partialIdxFp, &currPartIdx, 4, NULL);
-					f_close(&partialIdxFp);
-				}
-				else
-				{
-					gfx_con.fntsz = 16;
-					EPRINTF("\nError creating partial.idx file.\n");
+				gfx_con.fntsz = 16;
+				EPRINTF("\nError creating partial.idx file.\n");
 
-					free(buf);
-					return 0;
-				}
+				free(buf);
+				return 0;
+			}
 
+			if (isSmallSdCard)
+			{
 				// More parts to backup that do not currently fit the sd card free space or fatal error.
 				if (currPartIdx >= maxSplitParts)
 				{
@@ -1109,40 +2070,65 @@ int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
 				free(buf);
 				return 0;
 			}
+			_dump_emmc_drop_delta(outFilename);
 			bytesWritten = 0;
-		}
-
-		retryCount = 0;
-		num = MIN(totalSectors, numSectorsPerIter);
-		while (!sdmmc_storage_read(storage, lba_curr, num, buf))
-		{
-			EPRINTFARGS("Error reading %d blocks @ LBA %08X,\nfrom eMMC (try %d), retrying...",
-				num, lba_curr, ++retryCount);
+			bytesUncommitted = 0;
 
-			msleep(150);
-			if (retryCount >= 3)
-			{
-				gfx_con.fntsz = 16;
-				EPRINTFARGS("\nFailed to read %d blocks @ LBA %08X\nfrom eMMC. Aborting..\n",
-					num, lba_curr);
-				EPRINTF("\nPress any key and try again...\n");
-
-				free(buf);
-				f_close(&fp);
-				return 0;
-			}
+			if (bakHdr)
+				nx_bak_hdr_init(bakHdr, bakFormat, numSectorsPerIter, MIN(totalSectors, maxPartSectors));
+			_dump_emmc_prealloc(&fp, MIN(totalSectors, maxPartSectors), bakHdr);
+			if (bakHdr)
+				f_lseek(&fp, bakHdr->hdr_size);
+			else
+				_sd_stream_open(&st, &fp);
 		}
-		res = f_write(&fp, buf, NX_EMMC_BLOCKSIZE * num, NULL);
-		if (res)
+
+		// Fetch the next chunk into the idle buffer, while the current one is decrypted, hashed and written.
+		numNext = MIN(totalSectors - num, numSectorsPerIter);
+		emmc_stage_t fetch;
+		fetch.storage = storage;
+		fetch.lba = lba_curr + num;
+		fetch.num = numNext;
+		fetch.buf = bufs[bufIdx ^ 1];
+		fetch.xfer = &xfer;
+		fetch.res = 1;
+		dump_write_stage_t write;
+		write.fp = &fp;
+		write.st = &st;
+		write.bakHdr = bakHdr;
+		write.bakWork = bakWork;
+		write.manifest = manifest;
+		write.bisKey = bisKey;
+		write.bisSector = (lba_curr - part->lba_start) / BIS_SECTOR_BLOCKS;
+		write.chunkIdx = (lba_curr - lbaStartPart) / numSectorsPerIter;
+		write.buf = bufs[bufIdx];
+		write.num = num;
+		write.xfer = &xfer;
+		write.decrypted = 0;
+		write.res = 0;
+		_emmc_stages_run(numNext ? _dump_emmc_fetch_task : NULL, &fetch, _dump_sd_write_task, &write);
+
+		res = write.res;
+		if (!write.decrypted || res)
 		{
 			gfx_con.fntsz = 16;
-			EPRINTFARGS("\nFatal error (%d) when writing to SD Card", res);
+			if (!write.decrypted)
+				EPRINTFARGS("\nFailed to decrypt %d blocks @ LBA %08X", num, lba_curr);
+			else
+				EPRINTFARGS("\nFatal error (%d) when writing to SD Card", res);
 			EPRINTF("\nPress any key and try again...\n");
 
 			free(buf);
 			f_close(&fp);
 			return 0;
 		}
+		if (!fetch.res)
+		{
+			free(buf);
+			f_close(&fp);
+			return 0;
+		}
+
 		pct = (u64)((u64)(lba_curr - part->lba_start) * 100u) / (u64)(part->lba_end - part->lba_start);
 		if (pct != prevPct)
 		{
@@ -1152,25 +2138,73 @@ int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
 
 		lba_curr += num;
 		totalSectors -= num;
-		bytesWritten += num * NX_EMMC_BLOCKSIZE;
+		bytesWritten += (u64)num * NX_EMMC_BLOCKSIZE;
+		bytesUncommitted += num * NX_EMMC_BLOCKSIZE;
 
-		// Force a flush after a lot of data if not splitting.
-		if (numSplitParts == 0 && bytesWritten >= multipartSplitSize)
+		xfer.retries = _emmc_retries - retriesStart;
+		tui_xfer_show(&gfx_con, &xfer, gfx_con.y, xfer.total - ((u64)totalSectors << 9), 0);
+
+		// Out of battery, the progress gets committed now and the backup continues after charging.
+		int battCritical = totalSectors && power_gov_update(&gov, xfer.total - ((u64)totalSectors << 9),
+			(u64)totalSectors << 9) == POWER_GOV_CRITICAL;
+
+		// Commit the progress every so often, so an interrupted backup continues from here.
+		if ((bytesUncommitted >= DUMP_JOURNAL_INTERVAL || battCritical) && totalSectors)
 		{
-			f_sync(&fp);
-			bytesWritten = 0;
+			if (bakHdr)
+				nx_bak_hdr_write(&fp, bakHdr);
+			if (manifest)
+				_dump_emmc_save_manifest(outFilename, manifest);
+			if (!f_sync(&fp))
+			{
+				jrnl.part_idx = currPartIdx;
+				jrnl.lba_committed = lba_curr;
+				_dump_emmc_journal_write(partialIdxFilename, &jrnl);
+			}
+			bytesUncommitted = 0;
 		}
-	}
-	tui_pbar(&gfx_con, 0, gfx_con.y, 100, 0xFFCCCCCC, 0xFF555555);
 
-	// Backup operation ended successfully.
-	free(buf);
-	f_close(&fp);
+		if (battCritical)
+		{
+			power_gov_end(&gov);
+
+			gfx_con.fntsz = 16;
+			EPRINTF("\nBattery critical! Backup paused.\n\nCharge and select the SAME option again to continue.\n");
+
+			free(buf);
+			f_close(&fp);
+			return 0;
+		}
+
+		// Force a flush after a lot of data if not splitting.
+		if (numSplitParts == 0 && bytesWritten >= multipartSplitSize)
+		{
+			f_sync(&fp);
+			bytesWritten = 0;
+		}
+
+		// Swap buffers.
+		bufIdx ^= 1;
+		num = numNext;
+	}
+	tui_pbar(&gfx_con, 0, gfx_con.y, 100, 0xFFCCCCCC, 0xFF555555);
+	tui_xfer_show(&gfx_con, &xfer, gfx_con.y, xfer.total, 1);
+	power_gov_end(&gov);
+
+	// Backup operation ended successfully.
+	if (bakHdr)
+		nx_bak_hdr_write(&fp, bakHdr);
+	_sd_stream_sync(&st);
+	f_truncate(&fp);
+	f_close(&fp);
+
+	if (manifest && !_dump_emmc_save_manifest(outFilename, manifest))
+		WPRINTF("\nError creating hash manifest.\n");
 
 	if (h_cfg.verification)
 	{
 		// Verify last part or single file backup.
-		if (dump_emmc_verify(storage, lbaStartPart, outFilename, part))
+		if (dump_emmc_verify(storage, lbaStartPart, outFilename, part, manifest))
 		{
 			EPRINTF("\nPress any key and try again...\n");
 
@@ -1180,18 +2214,231 @@ int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
 		else
 			tui_pbar(&gfx_con, 0, gfx_con.y, 100, 0xFF96FF00, 0xFF155500);
 	}
+	free(buf);
 
 	gfx_con.fntsz = 16;
 	// Remove partial backup index file if no fatal errors occurred.
+	f_unlink(partialIdxFilename);
 	if (isSmallSdCard)
 	{
-		f_unlink(partialIdxFilename);
 		gfx_printf(&gfx_con, "%k\n\nYou can now join the files\nand get the complete eMMC RAW GPP backup.", 0xFFCCCCCC);
 	}
 	gfx_puts(&gfx_con, "\n\n");
 
 	return 1;
 }
+int dump_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part, const u8 *bisKey)
+{
+	u32 timer = get_tmr_ms();
+	u32 retries = _emmc_retries;
+
+	int res = _dump_emmc_part(sd_path, storage, part, bisKey);
+	statlog_op(STATLOG_OP_BACKUP, STATLOG_DEV_EMMC, part->name, res, (part->lba_end - part->lba_start + 1) >> 1,
+		get_tmr_ms() - timer, _emmc_retries - retries);
+
+	return res;
+}
+
+// Writes the chunks of numSectors that changed since the base manifest to <outFilename>.delta.
+static int _dump_emmc_delta(sdmmc_storage_t *storage, u32 lba_curr, u32 numSectors, char *outFilename,
+	dump_manifest_t *base, emmc_part_t *part, u32 *changedSectors)
+{
+	FIL fp;
+	char deltaFilename[DUMP_PATH_MAX];
+	u32 chunkSectors = base->chunk_sectors;
+	u32 numChunks = (numSectors + chunkSectors - 1) / chunkSectors;
+	u32 deltaSize = nx_delta_hdr_size(chunkSectors, numSectors);
+	u32 prevPct = 200;
+	int res = 0;
+
+	if (!_dump_path_ext(deltaFilename, outFilename, ".delta"))
+	{
+		gfx_con.fntsz = 16;
+		EPRINTFARGS("Filename %s is too long.\n", outFilename);
+
+		return 0;
+	}
+	gfx_printf(&gfx_con, "Filename: %s\n\n", deltaFilename);
+
+	if (f_open(&fp, deltaFilename, FA_CREATE_ALWAYS | FA_WRITE))
+	{
+		gfx_con.fntsz = 16;
+		EPRINTFARGS("Error creating file %s.\n", deltaFilename);
+
+		return 0;
+	}
+
+	// Double buffer, changed chunk index and the hashes of the current state.
+	u8 *buf = (u8 *)dma_calloc(chunkSectors * 2 * NX_EMMC_BLOCKSIZE + deltaSize + sizeof(dump_manifest_t) + numChunks * 0x20, 1);
+	u8 *bufs[2] = { buf, buf + chunkSectors * NX_EMMC_BLOCKSIZE };
+	u32 bufIdx = 0;
+
+	nx_delta_hdr_t *delta = (nx_delta_hdr_t *)(buf + chunkSectors * 2 * NX_EMMC_BLOCKSIZE);
+	nx_delta_hdr_init(delta, chunkSectors, numSectors);
+	_dump_manifest_id(base, delta->base_id);
+	dump_manifest_t *manifest = (dump_manifest_t *)(buf + chunkSectors * 2 * NX_EMMC_BLOCKSIZE + deltaSize);
+	manifest->magic = DUMP_MANIFEST_MAGIC;
+	manifest->chunk_sectors = chunkSectors;
+
+	f_lseek(&fp, deltaSize);
+
+	u32 num = MIN(numSectors, chunkSectors);
+	u32 numNext = 0;
+	u32 pct = 0;
+	if (!_dump_emmc_read_chunk(storage, lba_curr, num, bufs[bufIdx]))
+	{
+		free(buf);
+		f_close(&fp);
+		return 0;
+	}
+
+	for (u32 chunkIdx = 0; numSectors > 0; chunkIdx++)
+	{
+		numNext = MIN(numSectors - num, chunkSectors);
+		if (numNext)
+			sdmmc_storage_submit(storage, lba_curr + num, numNext, bufs[bufIdx ^ 1], 0);
+
+		// Only chunks with a different hash than the base go to the delta.
+		ccplex_sha256(manifest->hashes[manifest->num_chunks++], bufs[bufIdx], NX_EMMC_BLOCKSIZE * num);
+		if (chunkIdx >= base->num_chunks || memcmp(manifest->hashes[chunkIdx], base->hashes[chunkIdx], 0x20))
+		{
+			delta->chunk_idx[delta->num_changed++] = chunkIdx;
+			*changedSectors += num;
+			res = f_write(&fp, bufs[bufIdx], NX_EMMC_BLOCKSIZE * num, NULL);
+		}
+		if (res)
+		{
+			if (numNext)
+				sdmmc_storage_complete(storage);
+
+			gfx_con.fntsz = 16;
+			EPRINTFARGS("\nFatal error (%d) when writing to SD Card", res);
+			EPRINTF("\nPress any key and try again...\n");
+
+			free(buf);
+			f_close(&fp);
+			return 0;
+		}
+
+		if (numNext && !sdmmc_storage_complete(storage) &&
+			!_dump_emmc_read_chunk(storage, lba_curr + num, numNext, bufs[bufIdx ^ 1]))
+		{
+			free(buf);
+			f_close(&fp);
+			return 0;
+		}
+
+		pct = (u64)((u64)(lba_curr - part->lba_start) * 100u) / (u64)(part->lba_end - part->lba_start);
+		if (pct != prevPct)
+		{
+			tui_pbar(&gfx_con, 0, gfx_con.y, pct, 0xFFCCCCCC, 0xFF555555);
+			prevPct = pct;
+		}
+
+		lba_curr += num;
+		numSectors -= num;
+		bufIdx ^= 1;
+		num = numNext;
+	}
+
+	f_lseek(&fp, 0);
+	res = f_write(&fp, delta, deltaSize, NULL);
+	f_close(&fp);
+
+	// The hashes of the current state allow verifying a restore of base and delta.
+	if (res || !_dump_emmc_save_manifest(deltaFilename, manifest))
+	{
+		gfx_con.fntsz = 16;
+		EPRINTF("\nError writing delta index.\n");
+
+		free(buf);
+		return 0;
+	}
+	free(buf);
+
+	return 1;
+}
+
+// Incremental backup of a part, against the hash manifest of a previous full backup of it.
+int dump_emmc_part_incr(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
+{
+	static const u32 SECTORS_TO_MIB_COEFF = 11;
+
+	u32 totalSectors = part->lba_end - part->lba_start + 1;
+	u32 lba_curr = part->lba_start;
+	u32 sdPathLen = strlen(sd_path);
+	u32 currPartIdx = 0;
+	u32 numDigits = 0;
+	u32 changedSectors = 0;
+	char *outFilename = sd_path;
+
+	gfx_con.fntsz = 8;
+
+	// The base is either a single file or split parts.
+	dump_manifest_t *manifest = _dump_emmc_load_manifest(outFilename);
+	if (!manifest)
+	{
+		for (numDigits = 2; numDigits > 0; numDigits--)
+		{
+			memcpy(outFilename + sdPathLen, numDigits == 2 ? ".00" : ".0", numDigits + 2);
+			manifest = _dump_emmc_load_manifest(outFilename);
+			if (manifest)
+				break;
+		}
+		if (!manifest)
+			outFilename[sdPathLen] = 0;
+	}
+
+	while (totalSectors > 0)
+	{
+		if (!manifest)
+		{
+			gfx_con.fntsz = 16;
+			EPRINTFARGS("No base backup manifest for\n%s\n\nDo a full backup with full verification first.\n", outFilename);
+
+			return 0;
+		}
+
+		u32 partSectors = MIN(totalSectors, manifest->num_chunks * manifest->chunk_sectors);
+		if (!numDigits && partSectors < totalSectors)
+		{
+			gfx_con.fntsz = 16;
+			EPRINTF("Base backup does not match the partition size.\n");
+
+			free(manifest);
+			return 0;
+		}
+
+		int res = _dump_emmc_delta(storage, lba_curr, partSectors, outFilename, manifest, part, &changedSectors);
+		free(manifest);
+		if (!res)
+			return 0;
+
+		lba_curr += partSectors;
+		totalSectors -= partSectors;
+
+		// Next split part of the base.
+		if (totalSectors)
+		{
+			currPartIdx++;
+			if (numDigits == 2 && currPartIdx < 10)
+			{
+				outFilename[sdPathLen + 1] = '0';
+				itoa(currPartIdx, &outFilename[sdPathLen + 2], 10);
+			}
+			else
+				itoa(currPartIdx, &outFilename[sdPathLen + 1], 10);
+			manifest = _dump_emmc_load_manifest(outFilename);
+		}
+	}
+	tui_pbar(&gfx_con, 0, gfx_con.y, 100, 0xFFCCCCCC, 0xFF555555);
+
+	gfx_con.fntsz = 16;
+	gfx_printf(&gfx_con, "\n\nChanged since base: %d MiB\n\n", changedSectors >> SECTORS_TO_MIB_COEFF);
+
+	return 1;
+}
+
 
 typedef enum
 {
@@ -1199,13 +2446,50 @@ typedef enum
 	PART_SYSTEM = (1 << 1),
 	PART_USER =   (1 << 2),
 	PART_RAW =    (1 << 3),
-	PART_GP_ALL = (1 << 7)
+	PART_INCR =   (1 << 4),
+	PART_DECRYPT = (1 << 5),
+	PART_FULL =   (1 << 6),
+	PART_GP_ALL = (1 << 7),
+	PART_DIFF =   (1 << 8)
 } emmcPartType_t;
 
+#define DUMP_FULL_MANIFEST "full_backup.ini"
+
+/*
+* The full backup job describes its outputs in an ini next to them. Every dumped file gets a
+* section, with its chunk hashes in <file>.sha256 (.00.sha256, ... for split parts).
+*/
+static int _dump_full_open(FIL *fp, sdmmc_storage_t *storage)
+{
+	char path[80];
+
+	emmcsn_path_impl(path, "", DUMP_FULL_MANIFEST, storage);
+	if (f_open(fp, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return 0;
+
+	f_printf(fp, "[backup]\nserial=%08X\ncid=", storage->cid.serial);
+	for (u32 i = 0; i < 0x10; i++)
+		f_printf(fp, "%02X", storage->raw_cid[i]);
+	f_printf(fp, "\nboot_sectors=%u\nraw_sectors=%u\nverification=%u\nhash=sha256\n\n",
+		(storage->ext_csd.boot_mult << 17) / NX_EMMC_BLOCKSIZE, storage->sec_cnt, h_cfg.verification);
+
+	return 1;
+}
+
+static void _dump_full_part(FIL *fp, const char *sdPath, emmc_part_t *part, u32 mmcPart, int res, u32 elapsed)
+{
+	f_printf(fp, "[%s]\nfile=%s\nmmc_part=%u\nlba_start=%u\nsectors=%u\ntime_ms=%u\nresult=%u\n\n",
+		part->name, sdPath, mmcPart, part->lba_start, part->lba_end - part->lba_start + 1, elapsed, res ? 1 : 0);
+	f_sync(fp);
+}
+
 static void dump_emmc_selected(emmcPartType_t dumpType)
 {
 	int res = 0;
 	u32 timer = 0;
+	// The whole dump, hashing and verification included, runs at the boosted clock.
+	u32 clk = bpmp_clk_boost();
+	sdram_perf_mode(1);
 	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
 	tui_sbar(&gfx_con, 1);
 	gfx_con_setpos(&gfx_con, 0, 0);
@@ -1213,28 +2497,50 @@ static void dump_emmc_selected(emmcPartType_t dumpType)
 	if (!sd_mount())
 		goto out;
 
+	// Verification and hashing go to the A57 cluster when it comes up.
+	ccplex_worker_start();
+
 	gfx_puts(&gfx_con, "Checking for available free space...\n\n");
 	// Get SD Card free space for Partial Backup.
-	f_getfree("", &sd_fs.free_clst, NULL);
+	f_getfree("", &sd_fs->free_clst, NULL);
 
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-	if (!sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4))
+	sdmmc_storage_t *storage = nx_emmc_open(0);
+	if (!storage)
 	{
 		EPRINTF("Failed to init eMMC.");
 		goto out;
 	}
 
+	u8 bisKeys[3][0x20];
+	if ((dumpType & PART_DECRYPT) && !_dump_load_bis_keys(bisKeys))
+	{
+		EPRINTF("Failed to load the BIS keys from prod.keys.");
+		nx_emmc_close();
+		goto out;
+	}
+
 	int i = 0;
 	char sdPath[80];
 	// Create Restore folders, if they do not exist.
-	emmcsn_path_impl(sdPath, "/Restore", "", &storage);
-	emmcsn_path_impl(sdPath, "/Restore/Partitions", "", &storage);
+	emmcsn_path_impl(sdPath, "/Restore", "", storage);
+	emmcsn_path_impl(sdPath, "/Restore/Partitions", "", storage);
+
+	// One session for everything, described by a single manifest.
+	FIL fullFp;
+	int fullOpen = 0;
+	u32 partTimer = 0;
+	if (dumpType & PART_FULL)
+	{
+		_dump_force_manifest = 1;
+		fullOpen = _dump_full_open(&fullFp, storage);
+		if (!fullOpen)
+			WPRINTF("Failed to create the backup manifest.\n");
+	}
 
 	timer = get_tmr_s();
 	if (dumpType & PART_BOOT)
 	{
-		const u32 BOOT_PART_SIZE = storage.ext_csd.boot_mult << 17;
+		const u32 BOOT_PART_SIZE = storage->ext_csd.boot_mult << 17;
 
 		emmc_part_t bootPart;
 		memset(&bootPart, 0, sizeof(bootPart));
@@ -1249,44 +2555,73 @@ static void dump_emmc_selected(emmcPartType_t dumpType)
 			gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i,
 				bootPart.name, bootPart.lba_start, bootPart.lba_end, 0xFFCCCCCC);
 
-			sdmmc_storage_set_mmc_partition(&storage, i + 1);
+			sdmmc_storage_set_mmc_partition(storage, i + 1);
 
-			emmcsn_path_impl(sdPath, "", bootPart.name, &storage);
-			res = dump_emmc_part(sdPath, &storage, &bootPart);
+			emmcsn_path_impl(sdPath, "", bootPart.name, storage);
+			partTimer = get_tmr_ms();
+			res = dump_emmc_part(sdPath, storage, &bootPart, NULL);
+			if (fullOpen)
+				_dump_full_part(&fullFp, sdPath, &bootPart, i + 1, res, get_tmr_ms() - partTimer);
+			if (!res && (dumpType & PART_FULL))
+				break;
 		}
 	}
 
+	// A full backup is only useful if every part made it.
+	if (!res && (dumpType & PART_FULL))
+		goto full_done;
+
 	if ((dumpType & PART_SYSTEM) || (dumpType & PART_USER) || (dumpType & PART_RAW))
 	{
-		sdmmc_storage_set_mmc_partition(&storage, 0);
+		sdmmc_storage_set_mmc_partition(storage, 0);
 
 		if ((dumpType & PART_SYSTEM) || (dumpType & PART_USER))
 		{
 			LIST_INIT(gpt);
-			nx_emmc_gpt_parse(&gpt, &storage);
+			nx_emmc_gpt_parse(&gpt, storage);
 			LIST_FOREACH_ENTRY(emmc_part_t, part, &gpt, link)
 			{
 				if ((dumpType & PART_USER) == 0 && !strcmp(part->name, "USER"))
 					continue;
 				if ((dumpType & PART_SYSTEM) == 0 && strcmp(part->name, "USER"))
 					continue;
+				// Only the BIS partitions are encrypted.
+				u32 bisIdx = _dump_bis_key_idx(part->name);
+				if ((dumpType & PART_DECRYPT) && bisIdx == BIS_KEY_NONE)
+					continue;
 
 				gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i++,
 					part->name, part->lba_start, part->lba_end, 0xFFCCCCCC);
 
-				emmcsn_path_impl(sdPath, "/Partitions", part->name, &storage);
-				res = dump_emmc_part(sdPath, &storage, part);
+				if (dumpType & PART_DECRYPT)
+				{
+					emmcsn_path_impl(sdPath, "/Decrypted", part->name, storage);
+					res = dump_emmc_part(sdPath, storage, part, bisKeys[bisIdx]);
+				}
+				else
+				{
+					emmcsn_path_impl(sdPath, "/Partitions", part->name, storage);
+					res = (dumpType & PART_INCR) ? dump_emmc_part_incr(sdPath, storage, part) :
+						dump_emmc_part(sdPath, storage, part, NULL);
+				}
 				// If a part failed, don't continue.
 				if (!res)
 					break;
 			}
 			nx_emmc_gpt_free(&gpt);
+
+			if (dumpType & PART_DECRYPT)
+			{
+				se_aes_key_clear(DUMP_BIS_KS_CRYPT);
+				se_aes_key_clear(DUMP_BIS_KS_TWEAK);
+				memset(bisKeys, 0, sizeof(bisKeys));
+			}
 		}
 
 		if (dumpType & PART_RAW)
 		{
 			// Get GP partition size dynamically.
-			const u32 RAW_AREA_NUM_SECTORS = storage.sec_cnt;
+			const u32 RAW_AREA_NUM_SECTORS = storage->sec_cnt;
 
 			emmc_part_t rawPart;
 			memset(&rawPart, 0, sizeof(rawPart));
@@ -1297,287 +2632,2827 @@ static void dump_emmc_selected(emmcPartType_t dumpType)
 				gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i++,
 					rawPart.name, rawPart.lba_start, rawPart.lba_end, 0xFFCCCCCC);
 
-				emmcsn_path_impl(sdPath, "", rawPart.name, &storage);
-				res = dump_emmc_part(sdPath, &storage, &rawPart);
+				emmcsn_path_impl(sdPath, "", rawPart.name, storage);
+				partTimer = get_tmr_ms();
+				res = (dumpType & PART_INCR) ? dump_emmc_part_incr(sdPath, storage, &rawPart) :
+					dump_emmc_part(sdPath, storage, &rawPart, NULL);
+				if (fullOpen)
+					_dump_full_part(&fullFp, sdPath, &rawPart, 0, res, get_tmr_ms() - partTimer);
 			}
 		}
 	}
 
-	gfx_putc(&gfx_con, '\n');
-	timer = get_tmr_s() - timer;
-	gfx_printf(&gfx_con, "Time taken: %dm %ds.\n", timer / 60, timer % 60);
-	sdmmc_storage_end(&storage);
-	if (res && h_cfg.verification)
-		gfx_printf(&gfx_con, "\n%kFinished and verified!%k\nPress any key...\n", 0xFF96FF00, 0xFFCCCCCC);
-	else if (res)
-		gfx_printf(&gfx_con, "\nFinished! Press any key...\n");
+full_done:
+	if (dumpType & PART_FULL)
+	{
+		_dump_force_manifest = 0;
+		if (fullOpen)
+		{
+			f_printf(&fullFp, "[result]\ntime_s=%u\nok=%u\n", get_tmr_s() - timer, res ? 1 : 0);
+			f_close(&fullFp);
+		}
+	}
+
+	gfx_putc(&gfx_con, '\n');
+	timer = get_tmr_s() - timer;
+	gfx_printf(&gfx_con, "Time taken: %dm %ds.\n", timer / 60, timer % 60);
+	nx_emmc_close();
+	if (res && h_cfg.verification)
+		gfx_printf(&gfx_con, "\n%kFinished and verified!%k\nPress any key...\n", 0xFF96FF00, 0xFFCCCCCC);
+	else if (res)
+		gfx_printf(&gfx_con, "\nFinished! Press any key...\n");
+
+out:
+	ccplex_worker_stop();
+	sdram_perf_mode(0);
+	bpmp_clk_rate_set(clk);
+	sd_unmount();
+	btn_wait();
+}
+
+// Re-hashes every backup with a manifest in the folder against it. The eMMC is not touched.
+static int _verify_sd_backup_dir(char *path, u32 *numFiles)
+{
+	DIR dir;
+	FILINFO fno;
+	int res = 1;
+	u32 pathLen = strlen(path);
+
+	if (f_opendir(&dir, path) != FR_OK)
+		return 1;
+
+	while (res && f_readdir(&dir, &fno) == FR_OK && fno.fname[0])
+	{
+		// The backup is named as its manifest without the extension.
+		u32 nameLen = strlen(fno.fname);
+		if ((fno.fattrib & AM_DIR) || nameLen <= 7 || strcmp(fno.fname + nameLen - 7, ".sha256") ||
+			pathLen + nameLen + 2 > DUMP_NAME_MAX)
+			continue;
+		path[pathLen] = '/';
+		memcpy(path + pathLen + 1, fno.fname, nameLen - 7);
+		path[pathLen + nameLen - 6] = 0;
+
+		dump_manifest_t *manifest = _dump_emmc_load_manifest(path);
+		if (!manifest)
+			WPRINTFARGS("Invalid hashes of %s, skipping...\n", path);
+		else
+		{
+			gfx_printf(&gfx_con, "%k%s%k\n", 0xFF00DDFF, path, 0xFFCCCCCC);
+
+			emmc_part_t part;
+			memset(&part, 0, sizeof(part));
+			part.lba_end = MAX(manifest->num_chunks, 1) * manifest->chunk_sectors;
+
+			res = !dump_emmc_verify(NULL, 0, path, &part, manifest);
+			free(manifest);
+			(*numFiles)++;
+		}
+		path[pathLen] = 0;
+	}
+	f_closedir(&dir);
+
+	return res;
+}
+
+void verify_sd_backup()
+{
+	static const char *dirs[] = { "", "/Partitions", "/Restore", "/Restore/Partitions" };
+
+	int res = 1;
+	u32 numFiles = 0;
+	char path[DUMP_NAME_MAX];
+	u32 clk = bpmp_clk_boost();
+	sdram_perf_mode(1);
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	tui_sbar(&gfx_con, 1);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	if (!sd_mount())
+		goto out;
+
+	// Hashing goes to the A57 cluster when it comes up.
+	ccplex_worker_start();
+
+	gfx_puts(&gfx_con, "Checking backups against their hashes...\n\n");
+	gfx_con.fntsz = 8;
+	u32 timer = get_tmr_s();
+	for (u32 i = 0; res && i < sizeof(dirs) / sizeof(char *); i++)
+	{
+		// Backups and what is staged for restore.
+		emmcsn_path_impl(path, (char *)dirs[i], "", NULL);
+		path[strlen(path) - 1] = 0;
+		res = _verify_sd_backup_dir(path, &numFiles);
+	}
+	gfx_con.fntsz = 16;
+
+	timer = get_tmr_s() - timer;
+	gfx_printf(&gfx_con, "\nTime taken: %dm %ds.\n", timer / 60, timer % 60);
+	if (!numFiles)
+		WPRINTF("\nNo backups with hashes found.\nPress any key...\n");
+	else if (res)
+		gfx_printf(&gfx_con, "\n%k%d backups verified!%k\nPress any key...\n", 0xFF96FF00, numFiles, 0xFFCCCCCC);
+	else
+		EPRINTF("\nBackup is corrupted, do not restore it!\nPress any key...\n");
+
+out:
+	ccplex_worker_stop();
+	sdram_perf_mode(0);
+	bpmp_clk_rate_set(clk);
+	sd_unmount();
+	btn_wait();
+}
+
+void dump_emmc_system() { dump_emmc_selected(PART_SYSTEM); }
+void dump_emmc_user() { dump_emmc_selected(PART_USER); }
+void dump_emmc_boot() { dump_emmc_selected(PART_BOOT); }
+void dump_emmc_rawnand() { dump_emmc_selected(PART_RAW); }
+void dump_emmc_full() { dump_emmc_selected(PART_BOOT | PART_RAW | PART_FULL); }
+void dump_emmc_system_incr() { dump_emmc_selected(PART_SYSTEM | PART_INCR); }
+void dump_emmc_user_incr() { dump_emmc_selected(PART_USER | PART_INCR); }
+void dump_emmc_rawnand_incr() { dump_emmc_selected(PART_RAW | PART_INCR); }
+void dump_emmc_system_dec() { dump_emmc_selected(PART_SYSTEM | PART_DECRYPT); }
+void dump_emmc_user_dec() { dump_emmc_selected(PART_USER | PART_DECRYPT); }
+
+#define EMMC_FILES_LIST      "emmc_files.txt"
+#define EMMC_FILES_MAX_DEPTH 8
+#define EMMC_FILES_BUF_SIZE  0x400000
+
+typedef struct _emmc_files_t
+{
+	char src[256];
+	char dst[256];
+	u8 *buf;
+	u32 files;
+	u64 bytes;
+} emmc_files_t;
+
+// Creates every missing folder leading to path.
+static void _emmc_files_mkdirs(char *path)
+{
+	for (char *p = path + 1; *p; p++)
+	{
+		if (*p != '/')
+			continue;
+		*p = 0;
+		f_mkdir(path);
+		*p = '/';
+	}
+}
+
+static int _emmc_files_copy_file(emmc_files_t *ctx)
+{
+	FIL in, out;
+	UINT br, bw;
+
+	if (f_open(&in, ctx->src, FA_READ) != FR_OK)
+		return 0;
+	_emmc_files_mkdirs(ctx->dst);
+	if (f_open(&out, ctx->dst, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+	{
+		f_close(&in);
+		return 0;
+	}
+
+	gfx_printf(&gfx_con, "%s\n", ctx->src + 2);
+
+	int res = 1;
+	while (res)
+	{
+		if (f_read(&in, ctx->buf, EMMC_FILES_BUF_SIZE, &br) != FR_OK)
+			res = 0;
+		else if (!br)
+			break;
+		else if (f_write(&out, ctx->buf, br, &bw) != FR_OK || bw != br)
+			res = 0;
+		else
+			ctx->bytes += br;
+	}
+
+	f_close(&out);
+	f_close(&in);
+	if (res)
+		ctx->files++;
+
+	return res;
+}
+
+// Copies ctx->src to ctx->dst, descending into folders.
+static int _emmc_files_copy(emmc_files_t *ctx, u32 depth)
+{
+	FILINFO fno;
+	if (ctx->src[3] && f_stat(ctx->src, &fno) != FR_OK)
+	{
+		EPRINTFARGS("%s not found.", ctx->src + 2);
+		return 0;
+	}
+	// The root of a volume has no entry of its own.
+	if (ctx->src[3] && !(fno.fattrib & AM_DIR))
+		return _emmc_files_copy_file(ctx);
+
+	_emmc_files_mkdirs(ctx->dst);
+	f_mkdir(ctx->dst);
+
+	DIR *dir = (DIR *)malloc(sizeof(DIR));
+	if (f_opendir(dir, ctx->src) != FR_OK)
+	{
+		free(dir);
+		return 0;
+	}
+
+	int res = 1;
+	u32 src_len = strlen(ctx->src);
+	u32 dst_len = strlen(ctx->dst);
+	while (res && f_readdir(dir, &fno) == FR_OK && fno.fname[0])
+	{
+		u32 name_len = strlen(fno.fname);
+		if (src_len + name_len + 2 > sizeof(ctx->src) || dst_len + name_len + 2 > sizeof(ctx->dst))
+			continue;
+
+		// Only the root already ends with a slash.
+		u32 slash = ctx->src[src_len - 1] != '/';
+		ctx->src[src_len] = '/';
+		memcpy(ctx->src + src_len + slash, fno.fname, name_len + 1);
+		ctx->dst[dst_len] = '/';
+		memcpy(ctx->dst + dst_len + 1, fno.fname, name_len + 1);
+
+		if (!(fno.fattrib & AM_DIR))
+			res = _emmc_files_copy_file(ctx);
+		else if (depth + 1 < EMMC_FILES_MAX_DEPTH)
+			res = _emmc_files_copy(ctx, depth + 1);
+
+		ctx->src[src_len] = 0;
+		ctx->dst[dst_len] = 0;
+	}
+
+	f_closedir(dir);
+	free(dir);
+
+	return res;
+}
+
+// Copies the "PARTITION:/path" entries of emmc_files.txt (PRODINFOF by default) to Backup/<sn>/Files.
+void dump_emmc_files()
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	u32 clk = bpmp_clk_boost();
+	emmc_files_t *ctx = NULL;
+	char *list = NULL;
+	u32 size = 0;
+	u8 bisKeys[3][0x20];
+
+	if (!sd_mount())
+		goto out;
+
+	if (!_dump_load_bis_keys(bisKeys))
+	{
+		EPRINTF("Failed to load the BIS keys from prod.keys.");
+		goto out;
+	}
+
+	list = (char *)sd_file_read(EMMC_FILES_LIST, &size);
+	if (!list)
+	{
+		gfx_puts(&gfx_con, "No " EMMC_FILES_LIST ", copying PRODINFOF.\n\n");
+		size = 12;
+		list = (char *)malloc(size);
+		memcpy(list, "PRODINFOF:/\n", size);
+	}
+
+	ctx = (emmc_files_t *)malloc(sizeof(emmc_files_t));
+	ctx->buf = (u8 *)dma_malloc(EMMC_FILES_BUF_SIZE);
+	ctx->files = 0;
+	ctx->bytes = 0;
+
+	char root[64];
+	emmcsn_path_impl(root, "/Files", "", NULL);
+
+	u32 timer = get_tmr_ms();
+	int res = 1;
+	char entry[256];
+	char *end = list + size;
+	for (char *line = list; line < end;)
+	{
+		char *eol = memchr(line, '\n', end - line);
+		if (!eol)
+			eol = end;
+		u32 len = eol - line;
+		while (len && (line[len - 1] == '\r' || line[len - 1] == ' '))
+			len--;
+		// Strip the trailing slash of folders, the root keeps its own.
+		if (len > 1 && line[len - 1] == '/' && line[len - 2] != ':')
+			len--;
+
+		char *sep = memchr(line, ':', len);
+		int skip = *line == '#' || !sep || sep + 1 == line + len || sep[1] != '/' || len >= sizeof(entry);
+		if (!skip)
+		{
+			memcpy(entry, line, len);
+			entry[len] = 0;
+			sep = entry + (sep - line);
+			*sep = 0;
+		}
+		line = eol + 1;
+		if (skip)
+			continue;
+
+		char *path = sep + 1;
+		u32 bisIdx = _dump_bis_key_idx(entry);
+		if (bisIdx == BIS_KEY_NONE)
+		{
+			EPRINTFARGS("%s has no FAT volume.", entry);
+			res = 0;
+		}
+		else if (strlen(root) + strlen(entry) + strlen(path) >= sizeof(ctx->dst))
+		{
+			EPRINTFARGS("%s:%s is too long.", entry, path);
+			res = 0;
+		}
+		else if (!nx_emmc_fs_mount(entry, bisKeys[bisIdx], 0))
+		{
+			EPRINTFARGS("Failed to mount %s.", entry);
+			res = 0;
+		}
+		else
+		{
+			memcpy(ctx->src, NX_EMMC_FS_PATH, 3);
+			strcat(ctx->src, path);
+			strcpy(ctx->dst, root);
+			strcat(ctx->dst, entry);
+			if (path[1])
+				strcat(ctx->dst, path);
+			res &= _emmc_files_copy(ctx, 0);
+			nx_emmc_fs_unmount();
+		}
+	}
+	timer = get_tmr_ms() - timer;
+
+	gfx_printf(&gfx_con, "\n%s%d files, %d KiB in %d ms.\n", res ? "" : "Some entries failed. ",
+		ctx->files, (u32)(ctx->bytes >> 10), timer);
+	gfx_printf(&gfx_con, "%kSaved to %s%k\n", 0xFF96FF00, root, 0xFFCCCCCC);
+
+out:
+	if (ctx)
+	{
+		free(ctx->buf);
+		free(ctx);
+	}
+	free(list);
+	bpmp_clk_rate_set(clk);
+	sd_unmount();
+	gfx_puts(&gfx_con, "\nPress any key...\n");
+	btn_wait();
+}
+
+static int _restore_emmc_write_chunk(sdmmc_storage_t *storage, u32 lba_curr, u32 num, u8 *buf)
+{
+	int retryCount = 0;
+
+	while (!sdmmc_storage_write(storage, lba_curr, num, buf))
+	{
+		_emmc_retries++;
+		EPRINTFARGS("Error writing %d blocks @ LBA %08X\nto eMMC (try %d), retrying...",
+			num, lba_curr, ++retryCount);
+
+		msleep(150);
+		if (retryCount >= 3)
+		{
+			gfx_con.fntsz = 16;
+			EPRINTFARGS("\nFailed to write %d blocks @ LBA %08X\nfrom eMMC. Aborting..\n",
+				num, lba_curr);
+			EPRINTF("\nYour device may be in an inoperative state!\n\nPress any key and try again...\n");
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// Sources of a restore. A delta of an incremental backup overrides chunks of the base backup.
+typedef struct _restore_src_t
+{
+	FIL fp;
+	DWORD *clmt;
+	sd_stream_t st;
+	nx_bak_hdr_t *bakHdr;
+	u8 *bakWork;
+	FIL deltaFp;
+	nx_delta_hdr_t *delta;
+	u32 deltaPos;
+	// Split backups are read part after part, from the numbered files next to the base name.
+	char path[96];
+	u32 pathLen;
+	u32 digits;
+	u32 numParts;
+	u32 splitSectors;
+	u32 partIdx;
+	u32 partLeft;
+	u32 partChunk;
+} restore_src_t;
+
+static void _restore_src_part_name(restore_src_t *src, u32 idx)
+{
+	char *name = src->path + src->pathLen;
+
+	*name++ = '.';
+	if (src->digits == 2 && idx < 10)
+		*name++ = '0';
+	itoa(idx, name, 10);
+}
+
+static int _restore_src_open(restore_src_t *src, u32 idx)
+{
+	if (src->numParts)
+		_restore_src_part_name(src, idx);
+
+	int res = f_open(&src->fp, src->path, FA_READ);
+	if (res)
+		return res;
+
+	// Chunk seeks of containers and delta skips go through the link map.
+	src->clmt = _sd_file_fastseek(&src->fp);
+
+	// Check if the backup is a container and get its expanded size.
+	src->bakHdr = nx_bak_hdr_read(&src->fp);
+	if (!src->bakHdr)
+		_sd_stream_open(&src->st, &src->fp);
+
+	src->partIdx = idx;
+	src->partLeft = src->bakHdr ? src->bakHdr->total_sectors : (u32)((u64)f_size(&src->fp) >> (u64)9);
+	src->partChunk = 0;
+
+	return FR_OK;
+}
+
+static void _restore_src_close(restore_src_t *src)
+{
+	free(src->bakHdr);
+	src->bakHdr = NULL;
+	f_close(&src->fp);
+	free(src->clmt);
+	src->clmt = NULL;
+}
+
+// Finds the backup, or the parts of a split one, and gets its expanded size.
+static int _restore_src_find(restore_src_t *src, u32 *totalSectors)
+{
+	FILINFO fno;
+
+	*totalSectors = 0;
+	src->pathLen = strlen(src->path);
+	if (f_stat(src->path, &fno) == FR_OK)
+	{
+		int res = _restore_src_open(src, 0);
+		if (!res)
+			*totalSectors = src->splitSectors = src->partLeft;
+
+		return res;
+	}
+
+	// Parts are named .0, .1... or .00, .01... if there are more than 9.
+	for (src->digits = 2; src->digits; src->digits--)
+	{
+		src->numParts = 1;
+		_restore_src_part_name(src, 0);
+		if (f_stat(src->path, &fno) == FR_OK)
+			break;
+	}
+	if (!src->digits)
+	{
+		src->numParts = 0;
+		src->path[src->pathLen] = 0;
+
+		return FR_NO_FILE;
+	}
+
+	// All parts must be the same kind of backup and all but the last one the same size.
+	u32 format = 0;
+	u32 chunkSectors = 0;
+	for (u32 idx = 0; ; idx++)
+	{
+		_restore_src_part_name(src, idx);
+		if (idx && f_stat(src->path, &fno) != FR_OK)
+			break;
+
+		int res = _restore_src_open(src, idx);
+		if (res)
+			return res;
+
+		u32 partFormat = src->bakHdr ? src->bakHdr->format : 0;
+		u32 partChunkSectors = src->bakHdr ? src->bakHdr->chunk_sectors : 0;
+		int mismatch = 0;
+		if (!idx)
+		{
+			format = partFormat;
+			chunkSectors = partChunkSectors;
+			src->splitSectors = src->partLeft;
+		}
+		else
+			mismatch = partFormat != format || partChunkSectors != chunkSectors ||
+				src->partLeft > src->splitSectors || *totalSectors != src->splitSectors * idx;
+
+		*totalSectors += src->partLeft;
+		_restore_src_close(src);
+
+		if (mismatch)
+		{
+			EPRINTFARGS("Split part %s\ndoes not match the previous parts.\n", src->path);
+
+			return FR_INVALID_OBJECT;
+		}
+		src->numParts = idx + 1;
+	}
+
+	return _restore_src_open(src, 0);
+}
+
+// Sectors of the next chunk. Chunks never cross into the next part of a split backup.
+static u32 _restore_src_chunk(restore_src_t *src, u32 totalSectors, u32 chunkSectors)
+{
+	u32 partLeft = src->partLeft ? src->partLeft : src->splitSectors;
+
+	return MIN(MIN(totalSectors, chunkSectors), partLeft);
+}
+
+static int _restore_emmc_read_sd(restore_src_t *src, u32 chunkIdx, u8 *buf, u32 num, int *isZero)
+{
+	*isZero = 0;
+
+	// Move on to the next part, while the eMMC is still busy with the previous chunk.
+	if (!src->partLeft)
+	{
+		_restore_src_close(src);
+		if (src->partIdx + 1 >= src->numParts || _restore_src_open(src, src->partIdx + 1))
+			return FR_NO_FILE;
+	}
+
+	int inDelta = src->delta && src->deltaPos < src->delta->num_changed &&
+		src->delta->chunk_idx[src->deltaPos] == chunkIdx;
+
+	if (inDelta && !src->bakHdr)
+	{
+		// Skip the outdated chunk of the base.
+		if (_sd_stream_skip(&src->st, NX_EMMC_BLOCKSIZE * num))
+			return FR_INT_ERR;
+	}
+	else if (!src->bakHdr)
+	{
+		if (_sd_stream_read(&src->st, buf, NX_EMMC_BLOCKSIZE * num))
+			return FR_INT_ERR;
+	}
+	else
+	{
+		switch (nx_bak_chunk_read(&src->fp, src->bakHdr, src->partChunk, buf, src->bakWork))
+		{
+		case 2:
+			*isZero = 1;
+		case 1:
+			break;
+		default:
+			return FR_INT_ERR;
+		}
+	}
+
+	if (inDelta)
+	{
+		*isZero = 0;
+		if (nx_delta_chunk_read(&src->deltaFp, src->delta, &src->deltaPos, chunkIdx, buf) != 1)
+			return FR_INT_ERR;
+	}
+
+	src->partChunk++;
+	src->partLeft -= num;
+
+	// Zero stretches of raw backups take the same fast path as sparse chunks.
+	if (!*isZero && !src->bakHdr)
+		*isZero = nx_bak_is_zero(buf, NX_EMMC_BLOCKSIZE * num);
+
+	return FR_OK;
+}
+
+// Trims a zero range, or writes zeroes over it if TRIM failed.
+static int _restore_emmc_trim(sdmmc_storage_t *storage, u32 lba, u32 num, u32 chunkSectors)
+{
+	if (sdmmc_storage_trim(storage, lba, num))
+		return 1;
+
+	u8 *zeroBuf = (u8 *)dma_calloc(chunkSectors * NX_EMMC_BLOCKSIZE, 1);
+	while (num)
+	{
+		u32 cnt = MIN(num, chunkSectors);
+		if (!_restore_emmc_write_chunk(storage, lba, cnt, zeroBuf))
+		{
+			free(zeroBuf);
+			return 0;
+		}
+		lba += cnt;
+		num -= cnt;
+	}
+	free(zeroBuf);
+
+	return 1;
+}
+
+// Checks the restored eMMC chunks against the hashes of an incremental backup.
+static int _restore_emmc_verify_hashes(sdmmc_storage_t *storage, u32 lba_curr, emmc_part_t *part, dump_manifest_t *manifest)
+{
+	u32 totalSectors = part->lba_end - part->lba_start + 1;
+	u8 *buf = (u8 *)dma_malloc(manifest->chunk_sectors * NX_EMMC_BLOCKSIZE);
+	u8 hash[0x20];
+	u32 prevPct = 200;
+	u32 pct = 0;
+
+	for (u32 chunkIdx = 0; totalSectors > 0; chunkIdx++)
+	{
+		u32 num = MIN(totalSectors, manifest->chunk_sectors);
+
+		if (!sdmmc_storage_read(storage, lba_curr, num, buf))
+		{
+			gfx_con.fntsz = 16;
+			EPRINTFARGS("\nFailed to read %d blocks (@LBA %08X),\nfrom eMMC!\n\nVerification failed..\n",
+				num, lba_curr);
+
+			free(buf);
+			return 1;
+		}
+
+		se_calc_sha256(hash, buf, NX_EMMC_BLOCKSIZE * num);
+		if (chunkIdx >= manifest->num_chunks || memcmp(manifest->hashes[chunkIdx], hash, 0x20))
+		{
+			gfx_con.fntsz = 16;
+			EPRINTFARGS("\neMMC data (@LBA %08X),\ndoes not match the backup!\n\nVerification failed..\n", lba_curr);
+
+			free(buf);
+			return 1;
+		}
+
+		pct = (u64)((u64)(lba_curr - part->lba_start) * 100u) / (u64)(part->lba_end - part->lba_start);
+		if (pct != prevPct)
+		{
+			tui_pbar(&gfx_con, 0, gfx_con.y, pct, 0xFF96FF00, 0xFF155500);
+			prevPct = pct;
+		}
+
+		lba_curr += num;
+		totalSectors -= num;
+	}
+	free(buf);
+
+	return 0;
+}
+
+// Verifies against the backup, part after part if it is split.
+static int _restore_emmc_verify_parts(sdmmc_storage_t *storage, u32 lba_curr, restore_src_t *src, emmc_part_t *part)
+{
+	if (!src->numParts)
+		return dump_emmc_verify(storage, lba_curr, src->path, part, NULL);
+
+	for (u32 idx = 0; idx < src->numParts; idx++)
+	{
+		_restore_src_part_name(src, idx);
+		if (dump_emmc_verify(storage, lba_curr, src->path, part, NULL))
+			return 1;
+		lba_curr += src->splitSectors;
+	}
+
+	return 0;
+}
+
+// Differential restore, chunks the eMMC already holds are not written again.
+static int _restore_diff = 0;
+
+/*
+* Restores of many partitions share one buffer pool, and the backup of the next partition is
+* found and opened while the last write of the current one is still in flight.
+*/
+typedef struct _restore_queue_t
+{
+	u8 *pool;
+	u32 pool_size;
+	char queued[96];    // Backup of the next partition, empty if there is none.
+	char next_path[96]; // The one opened ahead.
+	int next_opened;
+	int next_res;
+	u32 next_sectors;
+	u32 next_idx;
+	restore_src_t srcs[2]; // The one taken stays in use until its partition is verified.
+} restore_queue_t;
+
+static restore_queue_t *_restore_queue = NULL;
+
+static u8 *_restore_buf_get(u32 size)
+{
+	if (!_restore_queue)
+		return (u8 *)dma_calloc(size, 1);
+
+	if (_restore_queue->pool_size < size)
+	{
+		free(_restore_queue->pool);
+		_restore_queue->pool = (u8 *)dma_malloc(size);
+		_restore_queue->pool_size = size;
+	}
+	return _restore_queue->pool;
+}
+
+static void _restore_buf_put(u8 *buf)
+{
+	if (!_restore_queue)
+		free(buf);
+}
+
+static void _restore_queue_prefetch()
+{
+	restore_queue_t *q = _restore_queue;
+	if (!q || !q->queued[0] || q->next_opened)
+		return;
+
+	// Errors are kept for the partition itself to report.
+	restore_src_t *src = &q->srcs[q->next_idx];
+	memset(src, 0, sizeof(restore_src_t));
+	strcpy(src->path, q->queued);
+	strcpy(q->next_path, q->queued);
+	q->queued[0] = 0;
+	q->next_res = _restore_src_find(src, &q->next_sectors);
+	q->next_opened = 1;
+}
+
+// A source opened for a partition that was not restored after all.
+static void _restore_queue_drop()
+{
+	restore_queue_t *q = _restore_queue;
+	if (q->next_opened && !q->next_res)
+		_restore_src_close(&q->srcs[q->next_idx]);
+	q->next_opened = 0;
+}
+
+static int _restore_queue_take(const char *path, restore_src_t **src, u32 *sectors, int *res)
+{
+	restore_queue_t *q = _restore_queue;
+	if (!q || !q->next_opened)
+		return 0;
+	if (strcmp(q->next_path, path))
+	{
+		_restore_queue_drop();
+		return 0;
+	}
+
+	*src = &q->srcs[q->next_idx];
+	*sectors = q->next_sectors;
+	*res = q->next_res;
+	q->next_idx ^= 1;
+	q->next_opened = 0;
+
+	return 1;
+}
+
+static void _restore_queue_start()
+{
+	_restore_queue = (restore_queue_t *)calloc(1, sizeof(restore_queue_t));
+}
+
+static void _restore_queue_next(const char *path)
+{
+	if (path)
+		strcpy(_restore_queue->queued, path);
+	else
+		_restore_queue->queued[0] = 0;
+}
+
+static void _restore_queue_end()
+{
+	_restore_queue_drop();
+	free(_restore_queue->pool);
+	free(_restore_queue);
+	_restore_queue = NULL;
+}
+
+// Writes the current chunk. On failure, retries it synchronously.
+static int _restore_emmc_write_task(void *arg)
+{
+	emmc_stage_t *stage = (emmc_stage_t *)arg;
+	u32 ioTimer = get_tmr_us();
+
+	stage->res = (sdmmc_storage_submit(stage->storage, stage->lba, stage->num, stage->buf, 1) &&
+		sdmmc_storage_complete(stage->storage)) || _restore_emmc_write_chunk(stage->storage, stage->lba, stage->num, stage->buf);
+	tui_xfer_io(stage->xfer, TUI_XFER_EMMC, NX_EMMC_BLOCKSIZE * stage->num, ioTimer);
+
+	return stage->res;
+}
+
+typedef struct _restore_read_stage_t
+{
+	restore_src_t *src;
+	u32 chunkIdx;
+	u8 *buf;
+	u32 num;  // 0 if the next chunk is already in.
+	int *isZero;
+	int last; // Nothing is left to read for this partition.
+	tui_xfer_t *xfer;
+	int res;
+} restore_read_stage_t;
+
+// Reads the next chunk into the idle buffer.
+static int _restore_sd_read_task(void *arg)
+{
+	restore_read_stage_t *stage = (restore_read_stage_t *)arg;
+
+	if (stage->num)
+	{
+		u32 ioTimer = get_tmr_us();
+		stage->res = _restore_emmc_read_sd(stage->src, stage->chunkIdx, stage->buf, stage->num, stage->isZero);
+		tui_xfer_io(stage->xfer, TUI_XFER_SD, NX_EMMC_BLOCKSIZE * stage->num, ioTimer);
+	}
+
+	// Nothing left to read here, so get the next partition's backup ready meanwhile.
+	if (stage->last)
+		_restore_queue_prefetch();
+
+	return !stage->res;
+}
+
+static int _restore_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
+{
+	static const u32 SECTORS_TO_MIB_COEFF = 11;
+
+	u32 totalSectors = part->lba_end - part->lba_start + 1;
+	u32 lbaStartPart = part->lba_start;
+	int res = 0;
+	char *outFilename = sd_path;
+
+	gfx_con.fntsz = 8;
+
+	restore_src_t srcLocal;
+	restore_src_t *src = &srcLocal;
+	gfx_printf(&gfx_con, "\nFilename: %s\n", outFilename);
+
+	// The backup may have been opened already, while the previous partition finished.
+	u32 backupSectors = 0;
+	if (!_restore_queue_take(outFilename, &src, &backupSectors, &res))
+	{
+		memset(src, 0, sizeof(restore_src_t));
+		strcpy(src->path, outFilename);
+		res = _restore_src_find(src, &backupSectors);
+	}
+	if (res)
+	{
+		WPRINTFARGS("Error (%d) while opening backup. Continuing...\n", res);
+		gfx_con.fntsz = 16;
+
+		return 0;
+	}
+	if (src->numParts)
+		gfx_printf(&gfx_con, "Split backup in %d parts.\n", src->numParts);
+
+	//TODO: Should we keep this check?
+	if (backupSectors != totalSectors)
+	{
+		gfx_con.fntsz = 16;
+		EPRINTF("Size of the SD Card backup does not match,\neMMC's selected part size.\n");
+		_restore_src_close(src);
+
+		return 0;
+	}
+	else
+		gfx_printf(&gfx_con, "\nTotal restore size: %d MiB.\n\n", backupSectors >> SECTORS_TO_MIB_COEFF);
+
+	// Apply the changes of an incremental backup, if there is one.
+	char deltaFilename[DUMP_PATH_MAX];
+	if (!_dump_path_ext(deltaFilename, outFilename, ".delta"))
+	{
+		gfx_con.fntsz = 16;
+		EPRINTFARGS("Filename %s is too long.\n", outFilename);
+		_restore_src_close(src);
+
+		return 0;
+	}
+	if (f_open(&src->deltaFp, deltaFilename, FA_READ) == FR_OK)
+	{
+		src->delta = nx_delta_hdr_read(&src->deltaFp);
+
+		// The delta must have been made against this very backup, which its manifest identifies.
+		u32 baseId[2] = { 0, 0 };
+		dump_manifest_t *base = _dump_emmc_load_manifest(outFilename);
+		int hasBase = base != NULL;
+		if (base)
+			_dump_manifest_id(base, baseId);
+		free(base);
+
+		if (!src->delta || !hasBase || memcmp(src->delta->base_id, baseId, sizeof(baseId)) ||
+			src->delta->total_sectors != totalSectors ||
+			(src->bakHdr && src->bakHdr->chunk_sectors != src->delta->chunk_sectors) ||
+			(src->numParts > 1 && (src->splitSectors % src->delta->chunk_sectors)))
+		{
+			gfx_con.fntsz = 16;
+			EPRINTFARGS("Delta %s\ndoes not match its base backup.\n", deltaFilename);
+			free(src->delta);
+			f_close(&src->deltaFp);
+			_restore_src_close(src);
+
+			return 0;
+		}
+		gfx_printf(&gfx_con, "%kApplying %d changed chunks from delta.%k\n\n", 0xFF00DDFF, src->delta->num_changed, 0xFFCCCCCC);
+	}
+
+	u32 numSectorsPerIter = 0;
+	if (src->delta)
+		numSectorsPerIter = src->delta->chunk_sectors;
+	else if (src->bakHdr)
+		numSectorsPerIter = src->bakHdr->chunk_sectors;
+	else
+		numSectorsPerIter = _emmc_get_chunk_sectors(storage, part->lba_start, totalSectors, 2);
+	gfx_printf(&gfx_con, "Chunk size: %d KiB\n\n", numSectorsPerIter >> 1);
+
+	// Two buffers, so the SD read of the next chunk can be done while the current one goes to eMMC.
+	// A differential restore reads the eMMC chunk into a third one meanwhile instead.
+	u32 numBufs = _restore_diff ? 3 : 2;
+	u32 bakWorkSize = src->bakHdr ? nx_bak_work_size(src->bakHdr->format, src->bakHdr->chunk_sectors) : 0;
+	u8 *buf = _restore_buf_get(numSectorsPerIter * numBufs * NX_EMMC_BLOCKSIZE + bakWorkSize);
+	u8 *bufs[2] = { buf, buf + numSectorsPerIter * NX_EMMC_BLOCKSIZE };
+	u8 *cmpBuf = buf + numSectorsPerIter * 2 * NX_EMMC_BLOCKSIZE;
+	src->bakWork = buf + numSectorsPerIter * numBufs * NX_EMMC_BLOCKSIZE;
+	u32 bufIdx = 0;
+	u32 sectorsMatched = 0;
+
+	u32 lba_curr = part->lba_start;
+	u64 bytesWritten = 0;
+	u32 prevPct = 200;
+
+	u32 num = 0;
+	u32 numNext = 0;
+	u32 pct = 0;
+	u32 chunkIdx = 0;
+	int isZero[2] = { 0, 0 };
+	int skipWrite = 0;
+	int trimmed = 0;
+	int prefetched = 0;
+
+	// Consecutive zero chunks are trimmed as one range, before the next data write.
+	int canTrim = sdmmc_storage_can_trim(storage);
+	u32 trimLba = 0;
+	u32 trimNum = 0;
+
+	tui_xfer_t xfer;
+	tui_xfer_init(&xfer, (u64)totalSectors << 9);
+	u32 retriesStart = _emmc_retries;
+	power_gov_t gov;
+	power_gov_start(&gov, 0);
+
+	// Prime the pipeline with the first chunk.
+	num = _restore_src_chunk(src, totalSectors, numSectorsPerIter);
+	u32 ioTimer = get_tmr_us();
+	res = _restore_emmc_read_sd(src, chunkIdx++, bufs[bufIdx], num, &isZero[bufIdx]);
+	tui_xfer_io(&xfer, TUI_XFER_SD, NX_EMMC_BLOCKSIZE * num, ioTimer);
+	while (totalSectors > 0)
+	{
+		if (res)
+		{
+			gfx_con.fntsz = 16;
+			EPRINTFARGS("\nFatal error (%d) when reading from SD Card", res);
+			EPRINTF("\nYour device may be in an inoperative state!\n\nPress any key and try again now...\n");
+
+			_restore_buf_put(buf);
+			free(src->delta);
+			f_close(&src->deltaFp);
+			_restore_src_close(src);
+			return 0;
+		}
+
+		skipWrite = 0;
+		trimmed = 0;
+		prefetched = 0;
+		if (_restore_diff)
+		{
+			// Compare against what the eMMC holds, while the next chunk comes from SD.
+			ioTimer = get_tmr_us();
+			int queued = sdmmc_storage_submit(storage, lba_curr, num, cmpBuf, 0);
+			tui_xfer_io(&xfer, TUI_XFER_EMMC, 0, ioTimer);
+
+			numNext = _restore_src_chunk(src, totalSectors - num, numSectorsPerIter);
+			ioTimer = get_tmr_us();
+			if (numNext)
+				res = _restore_emmc_read_sd(src, chunkIdx++, bufs[bufIdx ^ 1], numNext, &isZero[bufIdx ^ 1]);
+			tui_xfer_io(&xfer, TUI_XFER_SD, NX_EMMC_BLOCKSIZE * numNext, ioTimer);
+			prefetched = 1;
+
+			// A failed read only costs the write it could have saved.
+			ioTimer = get_tmr_us();
+			int readOk = queued ? sdmmc_storage_complete(storage) : 0;
+			if (!readOk)
+				readOk = sdmmc_storage_read(storage, lba_curr, num, cmpBuf);
+			tui_xfer_io(&xfer, TUI_XFER_EMMC, NX_EMMC_BLOCKSIZE * num, ioTimer);
+
+			// Sparse chunks of containers leave the buffer as it was.
+			if (readOk && isZero[bufIdx])
+				skipWrite = nx_bak_is_zero(cmpBuf, NX_EMMC_BLOCKSIZE * num);
+			else if (readOk)
+				skipWrite = !memcmp(cmpBuf, bufs[bufIdx], NX_EMMC_BLOCKSIZE * num);
+			if (skipWrite)
+				sectorsMatched += num;
+			else if (isZero[bufIdx] && !canTrim)
+				memset(bufs[bufIdx], 0, NX_EMMC_BLOCKSIZE * num);
+		}
+
+		// Zero chunks are trimmed, or only written if the eMMC does not already hold zeroes.
+		if (!skipWrite && isZero[bufIdx] && canTrim)
+		{
+			if (!trimNum)
+				trimLba = lba_curr;
+			trimNum += num;
+			skipWrite = 1;
+			trimmed = 1;
+		}
+		else if (!skipWrite && isZero[bufIdx] && !_restore_diff)
+		{
+			ioTimer = get_tmr_us();
+			skipWrite = sdmmc_storage_read(storage, lba_curr, num, bufs[bufIdx]);
+			tui_xfer_io(&xfer, TUI_XFER_EMMC, NX_EMMC_BLOCKSIZE * num, ioTimer);
+			skipWrite = skipWrite && nx_bak_is_zero(bufs[bufIdx], NX_EMMC_BLOCKSIZE * num);
+			if (!skipWrite)
+				memset(bufs[bufIdx], 0, NX_EMMC_BLOCKSIZE * num);
+		}
+
+		// The range must stay contiguous, so any chunk that is not trimmed ends it.
+		if (trimNum && (!trimmed || totalSectors == num))
+		{
+			ioTimer = get_tmr_us();
+			int trimRes = _restore_emmc_trim(storage, trimLba, trimNum, numSectorsPerIter);
+			tui_xfer_io(&xfer, TUI_XFER_EMMC, NX_EMMC_BLOCKSIZE * trimNum, ioTimer);
+			trimNum = 0;
+			if (!trimRes)
+			{
+				_restore_buf_put(buf);
+				free(src->delta);
+				f_close(&src->deltaFp);
+				_restore_src_close(src);
+				return 0;
+			}
+		}
+
+		// Write the current chunk and read the next one into the idle buffer meanwhile.
+		if (!prefetched)
+			numNext = _restore_src_chunk(src, totalSectors - num, numSectorsPerIter);
+		emmc_stage_t write;
+		write.storage = storage;
+		write.lba = lba_curr;
+		write.num = num;
+		write.buf = bufs[bufIdx];
+		write.xfer = &xfer;
+		write.res = 1;
+		restore_read_stage_t read;
+		read.src = src;
+		read.chunkIdx = chunkIdx;
+		read.buf = bufs[bufIdx ^ 1];
+		read.num = prefetched ? 0 : numNext;
+		read.isZero = &isZero[bufIdx ^ 1];
+		read.last = totalSectors == num;
+		read.xfer = &xfer;
+		read.res = 0;
+		if (read.num)
+			chunkIdx++;
+		_emmc_stages_run(skipWrite ? NULL : _restore_emmc_write_task, &write,
+			(read.num || read.last) ? _restore_sd_read_task : NULL, &read);
+
+		if (!prefetched)
+			res = read.res;
+		if (!write.res)
+		{
+			_restore_buf_put(buf);
+			free(src->delta);
+			f_close(&src->deltaFp);
+			_restore_src_close(src);
+			return 0;
+		}
+
+		pct = (u64)((u64)(lba_curr - part->lba_start) * 100u) / (u64)(part->lba_end - part->lba_start);
+		if (pct != prevPct)
+		{
+			tui_pbar(&gfx_con, 0, gfx_con.y, pct, 0xFFCCCCCC, 0xFF555555);
+			prevPct = pct;
+		}
+
+		lba_curr += num;
+		totalSectors -= num;
+		bytesWritten += (u64)num * NX_EMMC_BLOCKSIZE;
+
+		xfer.retries = _emmc_retries - retriesStart;
+		tui_xfer_show(&gfx_con, &xfer, gfx_con.y, xfer.total - ((u64)totalSectors << 9), 0);
+
+		// A half restored eMMC doesn't boot, so wait for the charger instead of stopping.
+		if (totalSectors && power_gov_update(&gov, xfer.total - ((u64)totalSectors << 9),
+			(u64)totalSectors << 9) == POWER_GOV_CRITICAL)
+			_emmc_power_wait();
+
+		// Swap buffers.
+		bufIdx ^= 1;
+		num = numNext;
+	}
+	power_gov_end(&gov);
+	tui_pbar(&gfx_con, 0, gfx_con.y, 100, 0xFFCCCCCC, 0xFF555555);
+	tui_xfer_show(&gfx_con, &xfer, gfx_con.y, xfer.total, 1);
+	if (_restore_diff)
+	{
+		u32 sectorsRestored = part->lba_end - part->lba_start + 1;
+		gfx_printf(&gfx_con, "\n\n%kDifferential: %d MiB written, %d MiB already matched.%k\n", 0xFF00DDFF,
+			(sectorsRestored - sectorsMatched) >> SECTORS_TO_MIB_COEFF, sectorsMatched >> SECTORS_TO_MIB_COEFF, 0xFFCCCCCC);
+	}
+
+	// Restore operation ended successfully.
+	_restore_buf_put(buf);
+	_restore_src_close(src);
+
+	// Base and delta together can only be verified against the hashes of the incremental backup.
+	dump_manifest_t *manifest = NULL;
+	if (src->delta)
+	{
+		free(src->delta);
+		f_close(&src->deltaFp);
+		manifest = _dump_emmc_load_manifest(deltaFilename);
+	}
+
+	if (h_cfg.verification && src->delta && !manifest)
+		WPRINTF("\nNo delta hashes found, skipping verification.\n");
+	else if (h_cfg.verification)
+	{
+		// Verify restored data.
+		if (manifest ? _restore_emmc_verify_hashes(storage, lbaStartPart, part, manifest) :
+			_restore_emmc_verify_parts(storage, lbaStartPart, src, part))
+		{
+			EPRINTF("\nPress any key and try again...\n");
+
+			free(manifest);
+			return 0;
+		}
+		else
+			tui_pbar(&gfx_con, 0, gfx_con.y, 100, 0xFF96FF00, 0xFF155500);
+	}
+	free(manifest);
+
+	gfx_con.fntsz = 16;
+	gfx_puts(&gfx_con, "\n\n");
+
+	return 1;
+}
+
+int restore_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
+{
+	u32 timer = get_tmr_ms();
+	u32 retries = _emmc_retries;
+
+	int res = _restore_emmc_part(sd_path, storage, part);
+	// BOOT0 may now hold another package1. A failed or cancelled restore can have written part of it.
+	pkg1_cache_drop();
+	statlog_op(STATLOG_OP_RESTORE, STATLOG_DEV_EMMC, part->name, res > 0, (part->lba_end - part->lba_start + 1) >> 1,
+		get_tmr_ms() - timer, _emmc_retries - retries);
+
+	return res;
+}
+
+static void restore_emmc_selected(emmcPartType_t restoreType)
+{
+	int res = 0;
+	u32 timer = 0;
+	u32 clk = bpmp_clk_rate_get();
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	tui_sbar(&gfx_con, 1);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	gfx_printf(&gfx_con, "%kThis is a dangerous operation\nand may render your device inoperative!\n\n", 0xFFFFDD00);
+	gfx_printf(&gfx_con, "Are you really sure?\n\n%k", 0xFFCCCCCC);
+	if ((restoreType & PART_BOOT) || (restoreType & PART_GP_ALL))
+	{
+		gfx_puts(&gfx_con, "The mode you selected will only restore\nthe ");
+		if (restoreType & PART_BOOT)
+			gfx_puts(&gfx_con, "boot ");
+		gfx_puts(&gfx_con, "partitions that it can find.\n");
+		gfx_puts(&gfx_con, "If it is not found, it will be skipped\nand continue with the next.\n\n");
+	}
+	gfx_con_getpos(&gfx_con, &gfx_con.savedx, &gfx_con.savedy);
+
+	u8 value = 10;
+	while (value > 0)
+	{
+		gfx_con_setpos(&gfx_con, gfx_con.savedx, gfx_con.savedy);
+		gfx_printf(&gfx_con, "%kWait... (%ds)    %k", 0xFF888888, value, 0xFFCCCCCC);
+		msleep(1000);
+		value--;
+	}
+	gfx_con_setpos(&gfx_con, gfx_con.savedx, gfx_con.savedy);
+
+	gfx_puts(&gfx_con, "Press POWER to Continue.\nPress VOL to go to the menu.\n\n\n");
+
+	u32 btn = btn_wait();
+	if (!(btn & BTN_POWER))
+		goto out;
+
+	clk = bpmp_clk_boost();
+	sdram_perf_mode(1);
+
+	if (!sd_mount())
+		goto out;
+
+	ccplex_worker_start();
+
+	sdmmc_storage_t *storage = nx_emmc_open(0);
+	if (!storage)
+	{
+		EPRINTF("Failed to init eMMC.");
+		goto out;
+	}
+
+	int i = 0;
+	char sdPath[80];
+
+	// Let the eMMC cache absorb the writes and commit them with one flush at the end.
+	if (h_cfg.restore_cache)
+	{
+		if (sdmmc_storage_set_cache(storage, 1))
+			gfx_printf(&gfx_con, "%keMMC write cache enabled.%k\n\n", 0xFF00DDFF, 0xFFCCCCCC);
+		storage->use_cmd23 = 1;
+	}
+
+	_restore_diff = !!(restoreType & PART_DIFF);
+	if (_restore_diff)
+		gfx_printf(&gfx_con, "%kDifferential, only changed chunks are written.%k\n\n", 0xFF00DDFF, 0xFFCCCCCC);
+
+	timer = get_tmr_s();
+	if (restoreType & PART_BOOT)
+	{
+		const u32 BOOT_PART_SIZE = storage->ext_csd.boot_mult << 17;
+
+		emmc_part_t bootPart;
+		memset(&bootPart, 0, sizeof(bootPart));
+		bootPart.lba_start = 0;
+		bootPart.lba_end = (BOOT_PART_SIZE / NX_EMMC_BLOCKSIZE) - 1;
+		for (i = 0; i < 2; i++)
+		{
+			memcpy(bootPart.name, "BOOT", 4);
+			bootPart.name[4] = (u8)('0' + i);
+			bootPart.name[5] = 0;
+
+			gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i,
+				bootPart.name, bootPart.lba_start, bootPart.lba_end, 0xFFCCCCCC);
+
+			sdmmc_storage_set_mmc_partition(storage, i + 1);
+
+			// Boot partitions hold the BCTs and package1, so keep their writes atomic.
+			storage->reliable_write = storage->use_cmd23;
+			emmcsn_path_impl(sdPath, "/Restore", bootPart.name, storage);
+			res = restore_emmc_part(sdPath, storage, &bootPart);
+			storage->reliable_write = 0;
+		}
+	}
+
+	if (restoreType & PART_GP_ALL)
+	{
+		sdmmc_storage_set_mmc_partition(storage, 0);
+
+		LIST_INIT(gpt);
+		nx_emmc_gpt_parse(&gpt, storage);
+		_restore_queue_start();
+		LIST_FOREACH_ENTRY(emmc_part_t, part, &gpt, link)
+		{
+			gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i++,
+				part->name, part->lba_start, part->lba_end, 0xFFCCCCCC);
+
+			// Queue the next partition's backup, it is opened during the last write of this one.
+			char nextPath[96];
+			if (part->link.next != &gpt)
+			{
+				emmcsn_path_impl(nextPath, "/Restore/Partitions/", CONTAINER_OF(part->link.next, emmc_part_t, link)->name, storage);
+				_restore_queue_next(nextPath);
+			}
+			else
+				_restore_queue_next(NULL);
+
+			emmcsn_path_impl(sdPath, "/Restore/Partitions/", part->name, storage);
+			res = restore_emmc_part(sdPath, storage, part);
+		}
+		_restore_queue_end();
+		nx_emmc_gpt_free(&gpt);
+	}
+
+	if (restoreType & PART_RAW)
+	{
+		// Get GP partition size dynamically.
+		const u32 RAW_AREA_NUM_SECTORS = storage->sec_cnt;
+
+		emmc_part_t rawPart;
+		memset(&rawPart, 0, sizeof(rawPart));
+		rawPart.lba_start = 0;
+		rawPart.lba_end = RAW_AREA_NUM_SECTORS - 1;
+		strcpy(rawPart.name, "rawnand.bin");
+		{
+			gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i++,
+				rawPart.name, rawPart.lba_start, rawPart.lba_end, 0xFFCCCCCC);
+
+			emmcsn_path_impl(sdPath, "/Restore", rawPart.name, storage);
+			res = restore_emmc_part(sdPath, storage, &rawPart);
+		}
+	}
+
+	if (h_cfg.restore_cache)
+	{
+		storage->use_cmd23 = 0;
+		if (!sdmmc_storage_flush_cache(storage))
+		{
+			EPRINTF("\nFailed to flush the eMMC cache!\n");
+			res = 0;
+		}
+		sdmmc_storage_set_cache(storage, 0);
+	}
+
+	_restore_diff = 0;
+
+	gfx_putc(&gfx_con, '\n');
+	timer = get_tmr_s() - timer;
+	gfx_printf(&gfx_con, "Time taken: %dm %ds.\n", timer / 60, timer % 60);
+	nx_emmc_close();
+	if (res && h_cfg.verification)
+		gfx_printf(&gfx_con, "\n%kFinished and verified!%k\nPress any key...\n", 0xFF96FF00, 0xFFCCCCCC);
+	else if (res)
+		gfx_printf(&gfx_con, "\nFinished! Press any key...\n");
+
+out:
+	ccplex_worker_stop();
+	sdram_perf_mode(0);
+	bpmp_clk_rate_set(clk);
+	sd_unmount();
+	btn_wait();
+}
+
+void restore_emmc_boot() { restore_emmc_selected(PART_BOOT); }
+void restore_emmc_rawnand() { restore_emmc_selected(PART_RAW); }
+void restore_emmc_gpp_parts() { restore_emmc_selected(PART_GP_ALL); }
+void restore_emmc_rawnand_diff() { restore_emmc_selected(PART_RAW | PART_DIFF); }
+void restore_emmc_gpp_parts_diff() { restore_emmc_selected(PART_GP_ALL | PART_DIFF); }
+
+/*
+* eMMC over USB. The host sends 64 byte commands on the bulk OUT pipe and sectors stream
+* on the pipe of their direction. A 16 byte reply ends every command, and being a short
+* packet it also cuts a read stream short on failure.
+*/
+
+#define USB_NAND_MAGIC     0x4E4D4D45 // "EMMN"
+#define USB_NAND_CMD_LIST  1
+#define USB_NAND_CMD_READ  2
+#define USB_NAND_CMD_WRITE 3
+#define USB_NAND_CMD_DONE  4
+#define USB_NAND_OK        0
+#define USB_NAND_EINVAL    1
+#define USB_NAND_EIO       2
+#define USB_NAND_EPERM     3
+#define USB_NAND_CHUNK     USBD_XFER_MAX
+#define USB_NAND_MAX_PARTS 64
+#define USB_NAND_XFER_MS   10000 // Not shorter than the host's transfer timeout.
+
+typedef struct _usb_nand_cmd_t
+{
+	u32 magic;
+	u32 cmd;
+	u32 lba;         // Relative to the partition.
+	u32 num_sectors;
+	char part[48];
+} usb_nand_cmd_t;
+
+typedef struct _usb_nand_rsp_t
+{
+	u32 magic;
+	u32 status;
+	u32 value;
+	u32 rsvd;
+} usb_nand_rsp_t;
+
+typedef struct _usb_nand_part_t
+{
+	char name[40];
+	u32 phys;        // eMMC partition, also in the listing for the host's reference.
+	u32 num_sectors;
+	u32 lba_start;   // Device side only.
+} usb_nand_part_t;
+
+static int _usb_nand_reply(u32 status, u32 value)
+{
+	usb_nand_rsp_t *rsp = (usb_nand_rsp_t *)dma_malloc(sizeof(usb_nand_rsp_t));
+	rsp->magic = USB_NAND_MAGIC;
+	rsp->status = status;
+	rsp->value = value;
+	rsp->rsvd = 0;
+
+	int res = usbd_xfer_start(1, rsp, sizeof(usb_nand_rsp_t)) &&
+		usbd_xfer_wait(1, USB_NAND_XFER_MS) == sizeof(usb_nand_rsp_t);
+	if (!res)
+		usbd_xfer_cancel(1);
+
+	free(rsp);
+	return res;
+}
+
+static u32 _usb_nand_parts(usb_nand_part_t *parts, sdmmc_storage_t *storage, link_t *gpt)
+{
+	u32 num = 0;
+	const u32 BOOT_PART_SECTORS = (storage->ext_csd.boot_mult << 17) / NX_EMMC_BLOCKSIZE;
+
+	memset(parts, 0, USB_NAND_MAX_PARTS * sizeof(usb_nand_part_t));
+	for (u32 i = 0; i < 2; i++)
+	{
+		strcpy(parts[num].name, i ? "BOOT1" : "BOOT0");
+		parts[num].phys = i + 1;
+		parts[num++].num_sectors = BOOT_PART_SECTORS;
+	}
+	strcpy(parts[num].name, "rawnand");
+	parts[num++].num_sectors = storage->sec_cnt;
+
+	LIST_FOREACH_ENTRY(emmc_part_t, part, gpt, link)
+	{
+		if (num == USB_NAND_MAX_PARTS)
+			break;
+		strncpy(parts[num].name, (const char *)part->name, sizeof(parts[num].name) - 1);
+		parts[num].lba_start = part->lba_start;
+		parts[num++].num_sectors = part->lba_end - part->lba_start + 1;
+	}
+
+	return num;
+}
+
+static int _usb_nand_list(usb_nand_part_t *parts, u32 num_parts)
+{
+	u32 size = num_parts * sizeof(usb_nand_part_t);
+	u8 *buf = (u8 *)dma_malloc(size);
+	memcpy(buf, parts, size);
+	for (u32 i = 0; i < num_parts; i++)
+		((usb_nand_part_t *)buf)[i].lba_start = 0;
+
+	int res = _usb_nand_reply(USB_NAND_OK, num_parts) && usbd_xfer_start(1, buf, size) &&
+		usbd_xfer_wait(1, USB_NAND_XFER_MS) == (int)size;
+	if (!res)
+		usbd_xfer_cancel(1);
+
+	free(buf);
+	return res;
+}
+
+// Keeps one chunk on the bus while the next one moves through the eMMC.
+static int _usb_nand_read(sdmmc_storage_t *storage, u32 lba, u32 num_sectors, u8 *bufs[2])
+{
+	u32 chunk_sectors = USB_NAND_CHUNK / NX_EMMC_BLOCKSIZE;
+	u32 idx = 0;
+	int res = 1;
+	int queued = 0;
+
+	while (num_sectors)
+	{
+		u32 num = MIN(num_sectors, chunk_sectors);
+		if (!_dump_emmc_read_chunk(storage, lba, num, bufs[idx]))
+		{
+			res = 0;
+			break;
+		}
+
+		if (queued && usbd_xfer_wait(1, USB_NAND_XFER_MS) < 0)
+		{
+			queued = 0;
+			res = 0;
+			break;
+		}
+		queued = usbd_xfer_start(1, bufs[idx], num * NX_EMMC_BLOCKSIZE);
+		if (!queued)
+		{
+			res = 0;
+			break;
+		}
+
+		lba += num;
+		num_sectors -= num;
+		idx ^= 1;
+	}
+
+	if (queued && usbd_xfer_wait(1, USB_NAND_XFER_MS) < 0)
+		res = 0;
+	if (!res)
+		usbd_xfer_cancel(1);
+
+	return res;
+}
+
+// Receives the next chunk while the last one is written.
+static int _usb_nand_write(sdmmc_storage_t *storage, u32 lba, u32 num_sectors, u8 *bufs[2])
+{
+	u32 chunk_sectors = USB_NAND_CHUNK / NX_EMMC_BLOCKSIZE;
+	u32 idx = 0;
+	u32 num = MIN(num_sectors, chunk_sectors);
+
+	if (!usbd_xfer_start(0, bufs[idx], num * NX_EMMC_BLOCKSIZE))
+		return 0;
+
+	while (num_sectors)
+	{
+		if (usbd_xfer_wait(0, USB_NAND_XFER_MS) != (int)(num * NX_EMMC_BLOCKSIZE))
+			break;
+
+		u32 curr = num;
+		num_sectors -= curr;
+		num = MIN(num_sectors, chunk_sectors);
+		if (num_sectors && !usbd_xfer_start(0, bufs[idx ^ 1], num * NX_EMMC_BLOCKSIZE))
+			return 0;
+
+		if (!_restore_emmc_write_chunk(storage, lba, curr, bufs[idx]))
+			break;
+
+		lba += curr;
+		idx ^= 1;
+	}
+
+	if (num_sectors)
+		usbd_xfer_cancel(0);
+
+	return !num_sectors;
+}
+
+static void usb_nand_stream(int writable)
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	tui_sbar(&gfx_con, 1);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	link_t gpt;
+	list_init(&gpt);
+	usb_nand_part_t *parts = NULL;
+	usb_nand_cmd_t *cmd = NULL;
+	u8 *bufs[2] = { NULL, NULL };
+	u32 clk = bpmp_clk_rate_get();
+
+	if (writable)
+	{
+		gfx_printf(&gfx_con, "%kThe host will be able to write to the eMMC\nand may render your device inoperative!\n\n", 0xFFFFDD00);
+		gfx_printf(&gfx_con, "%kPress POWER to Continue.\nPress VOL to go to the menu.\n\n", 0xFFCCCCCC);
+		if (!(btn_wait() & BTN_POWER))
+			return;
+	}
+
+	clk = bpmp_clk_boost();
+	sdram_perf_mode(1);
+
+	sdmmc_storage_t *storage = nx_emmc_open(0);
+	if (!storage)
+	{
+		EPRINTF("Failed to init eMMC.");
+		goto out;
+	}
+	nx_emmc_gpt_parse(&gpt, storage);
+	parts = (usb_nand_part_t *)malloc(USB_NAND_MAX_PARTS * sizeof(usb_nand_part_t));
+	u32 num_parts = _usb_nand_parts(parts, storage, &gpt);
+	nx_emmc_close();
+
+	if (!usbd_init())
+	{
+		EPRINTF("USB controller is not set up.\nLaunch hekate over RCM to use USB.");
+		goto out;
+	}
+
+	cmd = (usb_nand_cmd_t *)dma_malloc(sizeof(usb_nand_cmd_t));
+	bufs[0] = (u8 *)dma_malloc(USB_NAND_CHUNK);
+	bufs[1] = (u8 *)dma_malloc(USB_NAND_CHUNK);
+
+	gfx_printf(&gfx_con, "%kUSB %s mode, %d partitions.%k\n\n", 0xFF00DDFF,
+		writable ? "read/write" : "read-only", num_parts, 0xFFCCCCCC);
+	gfx_puts(&gfx_con, "Waiting for the host...\nPress VOL to stop.\n\n");
+
+	int configured = 0;
+	int done = 0;
+	while (!done)
+	{
+		if (btn_read() & (BTN_VOL_UP | BTN_VOL_DOWN))
+			break;
+
+		if (!usbd_poll())
+		{
+			configured = 0;
+			continue;
+		}
+		if (!configured)
+		{
+			configured = 1;
+			gfx_printf(&gfx_con, "Host connected (%s-speed).\n", usbd_max_packet() == 512 ? "high" : "full");
+		}
+
+		if (!usbd_xfer_start(0, cmd, sizeof(usb_nand_cmd_t)))
+			continue;
+		int size;
+		// Short waits keep the buttons responsive while the host is idle.
+		while ((size = usbd_xfer_wait(0, 100)) == USBD_XFER_PENDING)
+		{
+			if (btn_read() & (BTN_VOL_UP | BTN_VOL_DOWN))
+			{
+				usbd_xfer_cancel(0);
+				done = 1;
+				break;
+			}
+		}
+		if (done || size != sizeof(usb_nand_cmd_t) || cmd->magic != USB_NAND_MAGIC)
+			continue;
+
+		usb_nand_part_t *part = NULL;
+		for (u32 i = 0; i < num_parts && !part; i++)
+			if (!strncmp(parts[i].name, cmd->part, sizeof(parts[i].name)))
+				part = &parts[i];
+
+		switch (cmd->cmd)
+		{
+		case USB_NAND_CMD_LIST:
+			_usb_nand_list(parts, num_parts);
+			break;
+		case USB_NAND_CMD_READ:
+		case USB_NAND_CMD_WRITE:
+			if (!part || !cmd->num_sectors || cmd->lba >= part->num_sectors ||
+				cmd->num_sectors > part->num_sectors - cmd->lba)
+			{
+				_usb_nand_reply(USB_NAND_EINVAL, 0);
+				break;
+			}
+			if (cmd->cmd == USB_NAND_CMD_WRITE && !writable)
+			{
+				_usb_nand_reply(USB_NAND_EPERM, 0);
+				break;
+			}
+
+			storage = nx_emmc_open(part->phys);
+			if (!storage)
+			{
+				_usb_nand_reply(USB_NAND_EIO, 0);
+				break;
+			}
+			if (!_usb_nand_reply(USB_NAND_OK, cmd->num_sectors))
+			{
+				nx_emmc_close();
+				break;
+			}
+
+			gfx_printf(&gfx_con, "%s %s @ %08X, %d sectors... ", cmd->cmd == USB_NAND_CMD_READ ? "Reading" : "Writing",
+				part->name, cmd->lba, cmd->num_sectors);
+			u32 timer = get_tmr_ms();
+			int res;
+			if (cmd->cmd == USB_NAND_CMD_READ)
+				res = _usb_nand_read(storage, part->lba_start + cmd->lba, cmd->num_sectors, bufs);
+			else
+			{
+				res = _usb_nand_write(storage, part->lba_start + cmd->lba, cmd->num_sectors, bufs);
+				// BOOT0 may now hold another package1. Only it, BOOT1 and rawnand start at sector 0.
+				if (!part->lba_start)
+					pkg1_cache_drop();
+			}
+			nx_emmc_close();
+
+			timer = MAX(get_tmr_ms() - timer, 1);
+			if (res)
+				gfx_printf(&gfx_con, "%d KiB/s\n", (u32)((u64)cmd->num_sectors * NX_EMMC_BLOCKSIZE / timer * 1000 / 1024));
+			else
+				gfx_puts(&gfx_con, "failed\n");
+			_usb_nand_reply(res ? USB_NAND_OK : USB_NAND_EIO, 0);
+			break;
+		case USB_NAND_CMD_DONE:
+			_usb_nand_reply(USB_NAND_OK, 0);
+			done = 1;
+			break;
+		default:
+			_usb_nand_reply(USB_NAND_EINVAL, 0);
+			break;
+		}
+	}
+
+	usbd_end();
+	gfx_puts(&gfx_con, "\nUSB detached.\n");
+
+out:
+	free(bufs[0]);
+	free(bufs[1]);
+	free(cmd);
+	free(parts);
+	nx_emmc_gpt_free(&gpt);
+	sdram_perf_mode(0);
+	bpmp_clk_rate_set(clk);
+	gfx_puts(&gfx_con, "\nPress any key...\n");
+	btn_wait();
+}
+
+void dump_emmc_usb() { usb_nand_stream(0); }
+void restore_emmc_usb() { usb_nand_stream(1); }
+
+#define BENCH_SEQ_SIZE 0x2000000 // 32MB per sequential test.
+#define BENCH_RND_SIZE 0x800000  // 8MB per random test.
+#define BENCH_NUM_SIZES 4
+
+static const u32 _bench_sizes[BENCH_NUM_SIZES] = { 8, 128, 1024, 8192 }; // 4KB - 4MB.
+static u32 _bench_seed = 0x2545F491;
+
+static u32 _bench_rand()
+{
+	_bench_seed ^= _bench_seed << 13;
+	_bench_seed ^= _bench_seed >> 17;
+	_bench_seed ^= _bench_seed << 5;
+
+	return _bench_seed;
+}
+
+typedef struct _bench_dev_t
+{
+	const char *name;
+	sdmmc_storage_t *storage;
+	FIL *fp;         // Writes go to this file if set, otherwise read data is rewritten in place.
+	u32 lba_start;
+	u32 num_sectors;
+} bench_dev_t;
+
+static void _bench_csv_put(FIL *csv, const char *str, u32 val, int last)
+{
+	char lbuf[16];
+
+	if (str)
+		f_puts(str, csv);
+	else
+	{
+		itoa(val, lbuf, 10);
+		f_puts(lbuf, csv);
+	}
+	f_puts(last ? "\n" : ",", csv);
+}
+
+static int _bench_run(bench_dev_t *dev, FIL *csv, const char *part, u32 is_write, u32 is_random, u8 *buf)
+{
+	const char *test = is_random ? (is_write ? "rnd_write" : "rnd_read") : (is_write ? "seq_write" : "seq_read");
+	u32 area = (is_write && dev->fp) ? (BENCH_SEQ_SIZE >> 9) : dev->num_sectors;
+
+	gfx_printf(&gfx_con, " %s %s", is_random ? "RND" : "SEQ", is_write ? "W" : "R");
+
+	for (u32 i = 0; i < BENCH_NUM_SIZES; i++)
+	{
+		u32 num = _bench_sizes[i];
+		if (area < num)
+			break;
+
+		u32 ops = (is_random ? BENCH_RND_SIZE : BENCH_SEQ_SIZE) / (num << 9);
+		if (!is_random)
+			ops = MIN(ops, area / num);
+
+		u32 elapsed = 0;
+		for (u32 op = 0; op < ops; op++)
+		{
+			u32 sector = (is_random ? (_bench_rand() % (area / num)) : op) * num;
+			int res = 1;
+			u32 timer;
+
+			if (!is_write)
+			{
+				timer = get_tmr_us();
+				res = sdmmc_storage_read(dev->storage, dev->lba_start + sector, num, buf);
+			}
+			else if (dev->fp)
+			{
+				f_lseek(dev->fp, (u64)sector << 9);
+				timer = get_tmr_us();
+				res = !f_write(dev->fp, buf, num << 9, NULL);
+			}
+			else
+			{
+				// Writing back what was just read keeps the data intact.
+				res = sdmmc_storage_read(dev->storage, dev->lba_start + sector, num, buf);
+				timer = get_tmr_us();
+				res = res && sdmmc_storage_write(dev->storage, dev->lba_start + sector, num, buf);
+			}
+			if (res && dev->fp && is_write && op == ops - 1)
+				res = !f_sync(dev->fp);
+			elapsed += get_tmr_us() - timer;
+
+			if (!res)
+			{
+				EPRINTFARGS("\n%s %s failed @ %08X!", dev->name, test, dev->lba_start + sector);
+				return 0;
+			}
+		}
+		elapsed = MAX(elapsed, 1);
+
+		// Bytes per us is MB/s.
+		u32 rate = (u32)((u64)ops * (num << 9) * 100 / elapsed);
+		u32 iops = (u32)((u64)ops * 1000000 / elapsed);
+		gfx_printf(&gfx_con, " %4dK %d.%02d", num >> 1, rate / 100, rate % 100);
+
+		_bench_csv_put(csv, dev->name, 0, 0);
+		_bench_csv_put(csv, part, 0, 0);
+		_bench_csv_put(csv, test, 0, 0);
+		_bench_csv_put(csv, NULL, num << 9, 0);
+		_bench_csv_put(csv, NULL, ops, 0);
+		_bench_csv_put(csv, NULL, elapsed, 0);
+		_bench_csv_put(csv, NULL, rate, 0);
+		_bench_csv_put(csv, NULL, iops, 0);
+		_bench_csv_put(csv, NULL, dev->storage->csd.busspeed, 1);
+	}
+	gfx_puts(&gfx_con, " MB/s\n");
+
+	return 1;
+}
+
+static int _bench_part(bench_dev_t *dev, FIL *csv, const char *part, u32 do_write, u8 *buf)
+{
+	gfx_printf(&gfx_con, "%k%s%k\n", 0xFF00DDFF, part, 0xFFCCCCCC);
+
+	// File backed devices are only used for writes.
+	if (!dev->fp && (!_bench_run(dev, csv, part, 0, 0, buf) || !_bench_run(dev, csv, part, 0, 1, buf)))
+		return 0;
+	if (do_write && (!_bench_run(dev, csv, part, 1, 0, buf) || !_bench_run(dev, csv, part, 1, 1, buf)))
+		return 0;
+
+	return 1;
+}
+
+static int _bench_open_csv(FIL *csv, char *path)
+{
+	if (f_open(csv, path, FA_CREATE_ALWAYS | FA_WRITE))
+	{
+		EPRINTFARGS("Error creating %s.", path);
+		return 0;
+	}
+	f_puts("device,partition,test,req_size,ops,time_us,mbps_x100,iops,bus_mbps\n", csv);
+
+	return 1;
+}
+
+void bench_emmc()
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+	u32 clk = bpmp_clk_boost();
+
+	FIL csv;
+	char path[64];
+	u8 *buf = (u8 *)dma_malloc(_bench_sizes[BENCH_NUM_SIZES - 1] << 9);
+
+	if (!sd_mount())
+		goto out;
+
+	sdmmc_storage_t *storage = nx_emmc_open(0);
+	if (!storage)
+	{
+		EPRINTF("Failed to init eMMC.");
+		goto out;
+	}
+
+	emmcsn_path_impl(path, "/Dumps", "bench_emmc.csv", storage);
+	if (!_bench_open_csv(&csv, path))
+	{
+		nx_emmc_close();
+		goto out;
+	}
+
+	gfx_con.fntsz = 8;
+	gfx_printf(&gfx_con, "%keMMC bus: %d MB/s, 8-bit%k\n", 0xFF00DDFF, storage->csd.busspeed, 0xFFCCCCCC);
+
+	// Writes rewrite live USER sectors, so a power loss mid-test can corrupt the NAND.
+	gfx_printf(&gfx_con, "%kThe write test rewrites data in place on USER.\nA power loss during it may corrupt your eMMC!%k\n", 0xFFFFDD00, 0xFFCCCCCC);
+	gfx_puts(&gfx_con, "Press POWER to include the write test.\nPress VOL to run the read tests only.\n\n");
+	u32 do_write = btn_wait() & BTN_POWER;
+
+	bench_dev_t dev = { "emmc", storage, NULL, 0, (storage->ext_csd.boot_mult << 17) / NX_EMMC_BLOCKSIZE };
+	int res = 1;
+
+	sdmmc_storage_set_mmc_partition(storage, 1);
+	res = _bench_part(&dev, &csv, "BOOT0", 0, buf);
+	sdmmc_storage_set_mmc_partition(storage, 2);
+	res = res && _bench_part(&dev, &csv, "BOOT1", 0, buf);
+
+	sdmmc_storage_set_mmc_partition(storage, 0);
+	LIST_INIT(gpt);
+	nx_emmc_gpt_parse(&gpt, storage);
+	LIST_FOREACH_ENTRY(emmc_part_t, part, &gpt, link)
+	{
+		if (!res)
+			break;
+		dev.lba_start = part->lba_start;
+		dev.num_sectors = part->lba_end - part->lba_start + 1;
+		res = _bench_part(&dev, &csv, part->name, do_write && !strcmp(part->name, "USER"), buf);
+	}
+	nx_emmc_gpt_free(&gpt);
+
+	f_close(&csv);
+	nx_emmc_close();
+	gfx_con.fntsz = 16;
+
+	if (res)
+		gfx_printf(&gfx_con, "\n%kResults saved to %s%k\n", 0xFF96FF00, path, 0xFFCCCCCC);
+
+out:
+	free(buf);
+	sd_unmount();
+	bpmp_clk_rate_set(clk);
+	gfx_puts(&gfx_con, "\nPress any key...\n");
+	btn_wait();
+}
+
+void bench_sd()
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+	u32 clk = bpmp_clk_boost();
+
+	FIL csv;
+	FIL fp;
+	char path[64];
+	u8 *buf = (u8 *)dma_malloc(_bench_sizes[BENCH_NUM_SIZES - 1] << 9);
+
+	if (!sd_mount())
+		goto out;
+
+	emmcsn_path_impl(path, "/Dumps", "bench_sd.csv", NULL);
+	if (!_bench_open_csv(&csv, path))
+		goto out;
+
+	// Writes go to a scratch file, so the volume stays intact.
+	emmcsn_path_impl(path, "/Dumps", "bench_sd.tmp", NULL);
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_READ | FA_WRITE))
+	{
+		EPRINTFARGS("Error creating %s.", path);
+		f_close(&csv);
+		goto out;
+	}
+	memset(buf, 0xA5, _bench_sizes[BENCH_NUM_SIZES - 1] << 9);
+
+	gfx_con.fntsz = 8;
+	gfx_printf(&gfx_con, "%kSD bus: %d MB/s, %d-bit, U%d, AU %d KiB%k\n", 0xFF00DDFF,
+		sd_storage.csd.busspeed, sd_storage.ssr.bus_width, sd_storage.ssr.uhs_grade,
+		sd_storage.ssr.au_size >> 1, 0xFFCCCCCC);
+	gfx_puts(&gfx_con, "Writes go through a 32MB file.\n\n");
+
+	bench_dev_t dev = { "sd", &sd_storage, NULL, 0, sd_storage.sec_cnt };
+	int res = _bench_part(&dev, &csv, "RAW", 0, buf);
+	dev.fp = &fp;
+	res = res && _bench_part(&dev, &csv, "FILE", 1, buf);
+
+	f_close(&fp);
+	f_unlink(path);
+	f_close(&csv);
+	gfx_con.fntsz = 16;
+
+	if (res)
+		gfx_printf(&gfx_con, "\n%kResults saved to bench_sd.csv%k\n", 0xFF96FF00, 0xFFCCCCCC);
+
+out:
+	free(buf);
+	sd_unmount();
+	bpmp_clk_rate_set(clk);
+	gfx_puts(&gfx_con, "\nPress any key...\n");
+	btn_wait();
+}
+
+// Decompresses one BLZ section with the given decoder into buf. Returns the time taken in us, 0 on failure.
+static u32 _bench_blz_run(int (*uncompress)(unsigned char *, unsigned int, const blz_footer *),
+	const u8 *comp, u32 comp_size, u8 *buf, u32 size)
+{
+	blz_footer footer;
+	const blz_footer *footer_ptr = blz_get_footer(comp, comp_size, &footer);
+	if (!footer_ptr)
+		return 0;
+
+	u32 num_comp = (const u8 *)footer_ptr - comp;
+	memcpy(buf, comp, num_comp);
+	memset(buf + num_comp, 0, size - num_comp);
+
+	u32 start = get_tmr_us();
+	if (!uncompress(buf, comp_size, &footer))
+		return 0;
+
+	return MAX(get_tmr_us() - start, 1);
+}
+
+void bench_blz()
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+	u32 clk = bpmp_clk_boost();
+
+	char path[64];
+	u32 size;
+	u8 *ini1 = NULL;
+
+	if (!sd_mount())
+		goto out;
+
+	// The INI1 of this console, as saved by "Dump package1/2".
+	emmcsn_path_impl(path, "/pkg2", "ini1.bin", NULL);
+	ini1 = (u8 *)sd_file_read(path, &size);
+	if (!ini1 || size < sizeof(pkg2_ini1_t) || ((pkg2_ini1_t *)ini1)->magic != INI1_MAGIC)
+	{
+		EPRINTF("No ini1.bin found. Dump package1/2 first.");
+		goto out;
+	}
+
+	gfx_con.fntsz = 8;
+	gfx_printf(&gfx_con, "%kKIP1 sections: reference vs fast decoder%k\n\n", 0xFF00DDFF, 0xFFCCCCCC);
+
+	u32 total_size = 0, total_ref = 0, total_fast = 0, errors = 0;
+	u8 *ptr = ini1 + sizeof(pkg2_ini1_t);
+	for (u32 i = 0; i < ((pkg2_ini1_t *)ini1)->num_procs && ptr + sizeof(pkg2_kip1_t) <= ini1 + size; i++)
+	{
+		pkg2_kip1_t *kip1 = (pkg2_kip1_t *)ptr;
+		const u8 *sect = kip1->data;
+		for (u32 j = 0; j < KIP1_NUM_SECTIONS; j++)
+		{
+			u32 comp_size = kip1->sections[j].size_comp;
+			u32 decomp_size = kip1->sections[j].size_decomp;
+			if (j < 3 && (kip1->flags & (1 << j)) && comp_size && decomp_size >= comp_size)
+			{
+				u8 *ref = (u8 *)malloc(decomp_size);
+				u8 *buf = (u8 *)malloc(decomp_size);
+				u32 t_ref = _bench_blz_run(blz_uncompress_inplace_ref, sect, comp_size, ref, decomp_size);
+				u32 t_fast = _bench_blz_run(blz_uncompress_inplace, sect, comp_size, buf, decomp_size);
+				int ok = t_ref && t_fast && !memcmp(ref, buf, decomp_size);
+				free(ref);
+				free(buf);
+
+				gfx_printf(&gfx_con, "%s sect %d: %7d B, ref %7d us, fast %7d us %s\n", (char *)kip1->name, j, decomp_size,
+					t_ref, t_fast, ok ? "ok" : "MISMATCH");
+				if (!ok)
+					errors++;
+				total_size += decomp_size;
+				total_ref += t_ref;
+				total_fast += t_fast;
+			}
+			sect += comp_size;
+		}
+		ptr = (u8 *)sect;
+	}
+
+	if (total_ref && total_fast)
+		gfx_printf(&gfx_con, "\n%kTotal %d KB: reference %d KB/s, fast %d KB/s%k\n", errors ? 0xFFFF0000 : 0xFF96FF00,
+			total_size >> 10, (u32)((u64)total_size * 1000000 / total_ref) >> 10,
+			(u32)((u64)total_size * 1000000 / total_fast) >> 10, 0xFFCCCCCC);
+	if (errors)
+		EPRINTFARGS("%d sections decoded differently!", errors);
+	gfx_con.fntsz = 16;
+
+out:
+	free(ini1);
+	sd_unmount();
+	bpmp_clk_rate_set(clk);
+	gfx_puts(&gfx_con, "\nPress any key...\n");
+	btn_wait();
+}
+
+typedef struct _bench_mem_t
+{
+	const char *name;
+	u32 dst_off;
+	u32 src_off;
+	u32 size;
+} bench_mem_t;
+
+static u32 _bench_mem_run(u32 op, int fast, u8 *dst, u8 *src, u32 size, u32 iters)
+{
+	u32 start = get_tmr_us();
+	for (u32 i = 0; i < iters; i++)
+	{
+		switch (op)
+		{
+		case 0:
+			fast ? __wrap_memcpy(dst, src, size) : __real_memcpy(dst, src, size);
+			break;
+		case 1:
+			fast ? __wrap_memset(dst, i, size) : __real_memset(dst, i, size);
+			break;
+		case 2:
+			fast ? __wrap_memcmp(dst, src, size) : __real_memcmp(dst, src, size);
+			break;
+		}
+	}
+
+	return MAX(get_tmr_us() - start, 1);
+}
+
+void bench_memops()
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+	u32 clk = bpmp_clk_boost();
+
+	static const bench_mem_t tests[] = {
+		{ "aligned 1MB  ", 0, 0, 0x100000 },
+		{ "unaligned 1MB", 1, 3, 0x100000 },
+		{ "mixed 1MB    ", 1, 2, 0x100000 },
+		{ "sector 512B  ", 0, 0, 0x200 },
+		{ "small 61B    ", 3, 3, 61 }
+	};
+	static const char *ops[] = { "memcpy", "memset", "memcmp" };
+
+	// Two 1MB buffers plus room for the offsets.
+	u8 *dst = (u8 *)malloc(0x100000 + 0x40);
+	u8 *src = (u8 *)malloc(0x100000 + 0x40);
+	u8 *chk = (u8 *)malloc(0x100000 + 0x40);
+	for (u32 i = 0; i < 0x100000 + 0x40; i++)
+		src[i] = i * 13 + (i >> 9);
+
+	gfx_con.fntsz = 8;
+	gfx_printf(&gfx_con, "%kToolchain vs LDM/STM burst routines (MB/s)%k\n\n", 0xFF00DDFF, 0xFFCCCCCC);
+
+	u32 errors = 0;
+	for (u32 op = 0; op < 3; op++)
+	{
+		for (u32 i = 0; i < sizeof(tests) / sizeof(bench_mem_t); i++)
+		{
+			u8 *d = dst + tests[i].dst_off;
+			u8 *s = src + tests[i].src_off;
+			u32 size = tests[i].size;
+			// Same amount of data for every size.
+			u32 iters = MAX(0x400000 / size, 1);
+
+			if (op == 2)
+				__real_memcpy(d, s, size);
+			u32 t_ref = _bench_mem_run(op, 0, d, s, size, iters);
+			if (op != 2)
+				__real_memcpy(chk, d, size);
+			u32 t_fast = _bench_mem_run(op, 1, d, s, size, iters);
+
+			// Both must leave the same result behind and agree on the comparison.
+			int ok;
+			if (op == 2)
+			{
+				d[size - 1] ^= 0x80;
+				ok = !__wrap_memcmp(d, s, size - 1) &&
+					(__wrap_memcmp(d, s, size) > 0) == (__real_memcmp(d, s, size) > 0);
+			}
+			else
+				ok = !__real_memcmp(chk, d, size);
+			if (!ok)
+				errors++;
+
+			u64 bytes = (u64)size * iters;
+			gfx_printf(&gfx_con, "%s %s: %4d -> %4d %s\n", ops[op], tests[i].name,
+				(u32)(bytes * 1000000 / t_ref >> 20), (u32)(bytes * 1000000 / t_fast >> 20), ok ? "ok" : "MISMATCH");
+		}
+	}
+
+	if (errors)
+		EPRINTFARGS("\n%d results differ!", errors);
+	gfx_con.fntsz = 16;
+
+	free(dst);
+	free(src);
+	free(chk);
+	bpmp_clk_rate_set(clk);
+	gfx_puts(&gfx_con, "\nPress any key...\n");
+	btn_wait();
+}
+
+#define BENCH_CORE_BUF_SIZE 0x100000
+#define BENCH_CORE_WARMUP   2
+#define BENCH_CORE_PUTC_NUM 1024
+
+typedef struct _bench_core_t
+{
+	const char *name;
+	const char *unit;
+	int (*run)(u32 iter, u32 size);
+	u32 size;  // Units processed per call.
+	u32 iters; // Timed calls, after BENCH_CORE_WARMUP untimed ones.
+} bench_core_t;
+
+typedef struct _bench_core_res_t
+{
+	u32 total_us;
+	u32 best_us;
+	int ok;
+} bench_core_res_t;
+
+static struct
+{
+	u8 *src;
+	u8 *dst;
+	u8 *blz;
+	u32 blz_size;
+	u8 *lz;
+	u32 lz_size;
+	sdmmc_storage_t *emmc;
+	u8 ctr[0x10];
+	u32 sink;
+} _bcore;
+
+/*
+* Builds a BLZ stream of size bytes that decodes to a 16 byte period pattern, random literals
+* and matches mixed like in KIP1 code. Written backwards, the same way the decoder reads it,
+* so comp needs room for 2 * size bytes.
+*/
+static u32 _bench_blz_gen(u8 *comp, u8 *pattern, u32 size)
+{
+	u32 out = size;
+	u32 pos = 0;
+	u32 ctl_pos = 0;
+	u32 ctl = 0;
+	u32 tok = 8;
+
+	for (u32 i = 0; i < size; i++)
+		pattern[i] = (i & 0xF) * 0x1D + 0x35;
+
+	// Compressed bytes in read order go to the end of the buffer first.
+	u8 *stream = comp + size;
+	while (out)
+	{
+		if (tok == 8)
+		{
+			if (pos)
+				stream[ctl_pos] = ctl;
+			ctl_pos = pos++;
+			ctl = 0;
+			tok = 0;
+		}
+
+		// Only matches at the bottom, so output never catches up with unread input.
+		u32 len = (_bench_rand() & 0xF) + 3;
+		if (out <= 18)
+			len = out;
+		else if (out - len < 3)
+			len = out - 3;
+		if (out + 32 > size || (out > 64 && (_bench_rand() & 3) == 0))
+			stream[pos++] = pattern[--out];
+		else
+		{
+			// Offset 32 hits the same pattern byte and is longer than any match, so nothing overlaps.
+			u32 val = ((len - 3) << 12) | (32 - 3);
+			stream[pos++] = val >> 8;
+			stream[pos++] = val & 0xFF;
+			out -= len;
+			ctl |= 0x80 >> tok;
+		}
+		tok++;
+	}
+	stream[ctl_pos] = ctl;
+
+	for (u32 i = 0; i < pos; i++)
+		comp[pos - 1 - i] = stream[i];
+
+	blz_footer footer;
+	footer.cmp_and_hdr_size = pos + sizeof(blz_footer);
+	footer.header_size = sizeof(blz_footer);
+	footer.addl_size = size - footer.cmp_and_hdr_size;
+	memcpy(comp + pos, &footer, sizeof(blz_footer));
+
+	return pos + sizeof(blz_footer);
+}
+
+static int _bench_core_aes_ecb(u32 iter, u32 size)
+{
+	return se_aes_crypt_ecb(DUMP_BIS_KS_CRYPT, 1, _bcore.dst, size, _bcore.src, size);
+}
+
+static int _bench_core_aes_ctr(u32 iter, u32 size)
+{
+	return se_aes_crypt_ctr(DUMP_BIS_KS_CRYPT, _bcore.dst, size, _bcore.src, size, _bcore.ctr);
+}
+
+static int _bench_core_aes_xts(u32 iter, u32 size)
+{
+	return se_aes_xts_crypt(DUMP_BIS_KS_TWEAK, DUMP_BIS_KS_CRYPT, 0, (u64)iter * (size / 0x4000),
+		_bcore.dst, _bcore.src, 0x4000, size / 0x4000);
+}
+
+static int _bench_core_sha256(u32 iter, u32 size)
+{
+	return se_calc_sha256(_bcore.dst, _bcore.src, size);
+}
+
+static int _bench_core_memcpy(u32 iter, u32 size)
+{
+	memcpy(_bcore.dst, _bcore.src, size);
+
+	return 1;
+}
+
+static int _bench_core_memset(u32 iter, u32 size)
+{
+	memset(_bcore.dst, iter, size);
+
+	return 1;
+}
+
+static int _bench_core_memcmp32sparse(u32 iter, u32 size)
+{
+	// Equal buffers, the worst case.
+	return !memcmp32sparse((u32 *)_bcore.src, (u32 *)_bcore.src, size);
+}
+
+static int _bench_core_crc32c(u32 iter, u32 size)
+{
+	_bcore.sink ^= crc32c(_bcore.src, size);
+
+	return 1;
+}
+
+// The first (warmup) call of a decoder also checks its output.
+static int _bench_core_blz(u32 iter, u32 size)
+{
+	int res = blz_uncompress_srcdest(_bcore.blz, _bcore.blz_size, _bcore.dst, size);
+
+	return res && (iter || !memcmp(_bcore.dst, _bcore.blz + BENCH_CORE_BUF_SIZE, size));
+}
+
+static int _bench_core_lz(u32 iter, u32 size)
+{
+	LZ_Uncompress(_bcore.lz, _bcore.dst, _bcore.lz_size);
+
+	return iter || !memcmp(_bcore.dst, _bcore.src, size);
+}
+
+static int _bench_core_gfx_putc(u32 iter, u32 size)
+{
+	gfx_con_setpos(&gfx_con, 0, 0);
+	for (u32 i = 0; i < size; i++)
+		gfx_putc(&gfx_con, 'A' + (i + iter) % 26);
+
+	return 1;
+}
+
+static int _bench_core_gfx_clear(u32 iter, u32 size)
+{
+	// A new color every call, clears of clean rows are skipped.
+	gfx_clear_grey(&gfx_ctxt, (iter & 1) ? 0x1B : 0x30);
+
+	return 1;
+}
+
+#define BENCH_CORE_HEAP_SLOTS 256
+
+// Allocates mixed sizes, frees every other block and fills the holes again, then releases all of it.
+static int _bench_core_heap_churn(u32 iter, u32 size)
+{
+	void **slots = (void **)_bcore.dst;
+	heap_stats_t before, after;
+
+	heap_get_stats(&before, 0);
+	for (u32 i = 0; i < size; i++)
+	{
+		u32 idx = i % BENCH_CORE_HEAP_SLOTS;
+		if (i >= BENCH_CORE_HEAP_SLOTS && ((idx ^ (i / BENCH_CORE_HEAP_SLOTS)) & 1))
+			free(slots[idx]);
+		else if (i >= BENCH_CORE_HEAP_SLOTS)
+			continue;
+		slots[idx] = malloc(16 << (_bench_rand() % 12));
+	}
+	for (u32 i = 0; i < BENCH_CORE_HEAP_SLOTS; i++)
+		free(slots[i]);
+	heap_get_stats(&after, 0);
+
+	// Everything must be back, or a block leaked or got merged wrongly.
+	return after.used == before.used && after.allocs == before.allocs;
+}
+
+// Once the first pass saves it, this reads hekate_ipl.ini.bin, the parse cache on SD. Not the menu's copy in memory.
+static int _bench_core_ini_parse(u32 iter, u32 size)
+{
+	LIST_INIT(sections);
+	int res = ini_parse(&sections, "hekate_ipl.ini");
+	ini_free(&sections);
+
+	return res;
+}
+
+static int _bench_core_emmc_read(u32 iter, u32 size)
+{
+	return _bcore.emmc && sdmmc_storage_read(_bcore.emmc, iter * (size >> 9), size >> 9, _bcore.dst);
+}
+
+static int _bench_core_sd_read(u32 iter, u32 size)
+{
+	return sdmmc_storage_read(&sd_storage, iter * (size >> 9), size >> 9, _bcore.dst);
+}
+
+static const bench_core_t _bench_core_tests[] = {
+	{ "se_aes_ecb",     "B",    _bench_core_aes_ecb,         BENCH_CORE_BUF_SIZE,   16 },
+	{ "se_aes_ctr",     "B",    _bench_core_aes_ctr,         BENCH_CORE_BUF_SIZE,   16 },
+	{ "se_aes_xts",     "B",    _bench_core_aes_xts,         BENCH_CORE_BUF_SIZE,   16 },
+	{ "se_sha256",      "B",    _bench_core_sha256,          BENCH_CORE_BUF_SIZE,   16 },
+	{ "memcpy",         "B",    _bench_core_memcpy,          BENCH_CORE_BUF_SIZE,   32 },
+	{ "memset",         "B",    _bench_core_memset,          BENCH_CORE_BUF_SIZE,   32 },
+	{ "memcmp32sparse", "B",    _bench_core_memcmp32sparse,  BENCH_CORE_BUF_SIZE,   32 },
+	{ "crc32c",         "B",    _bench_core_crc32c,          BENCH_CORE_BUF_SIZE,   8 },
+	{ "blz_srcdest",    "B",    _bench_core_blz,             BENCH_CORE_BUF_SIZE,   8 },
+	{ "lz_uncompress",  "B",    _bench_core_lz,              BENCH_CORE_BUF_SIZE,   8 },
+	{ "gfx_putc",       "char", _bench_core_gfx_putc,        BENCH_CORE_PUTC_NUM,   16 },
+	{ "gfx_clear",      "B",    _bench_core_gfx_clear,       720 * 1280 * 4,        8 },
+	{ "heap_churn",     "op",   _bench_core_heap_churn,      BENCH_CORE_HEAP_SLOTS * 8, 16 },
+	{ "ini_parse",      "file", _bench_core_ini_parse,       1,                     16 },
+	{ "emmc_seq_read",  "B",    _bench_core_emmc_read,       BENCH_CORE_BUF_SIZE,   32 },
+	{ "sd_seq_read",    "B",    _bench_core_sd_read,         BENCH_CORE_BUF_SIZE,   32 }
+};
+
+#define BENCH_CORE_NUM (sizeof(_bench_core_tests) / sizeof(bench_core_t))
+
+static void _bench_core_run(const bench_core_t *test, bench_core_res_t *res)
+{
+	res->total_us = 0;
+	res->best_us = 0xFFFFFFFF;
+	res->ok = 1;
+
+	for (u32 i = 0; i < BENCH_CORE_WARMUP + test->iters && res->ok; i++)
+	{
+		u32 start = get_tmr_us();
+		res->ok = test->run(i, test->size);
+		u32 elapsed = get_tmr_us() - start;
+
+		if (i < BENCH_CORE_WARMUP)
+			continue;
+		res->total_us += elapsed;
+		res->best_us = MIN(res->best_us, elapsed);
+	}
+	res->total_us = MAX(res->total_us, 1);
+	res->best_us = MAX(res->best_us, 1);
+}
+
+void bench_core()
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+	u32 clk = bpmp_clk_boost();
+
+	static bench_core_res_t results[BENCH_CORE_NUM];
+	FIL csv;
+	char path[64];
+	u32 lz_work = ALIGN(LZ_COMPRESS_BOUND(BENCH_CORE_BUF_SIZE), 4);
+
+	memset(&_bcore, 0, sizeof(_bcore));
+	_bcore.src = (u8 *)dma_malloc(BENCH_CORE_BUF_SIZE);
+	_bcore.dst = (u8 *)dma_malloc(BENCH_CORE_BUF_SIZE);
+	_bcore.blz = (u8 *)malloc(BENCH_CORE_BUF_SIZE * 2);
+	_bcore.lz = (u8 *)malloc(lz_work + LZ_WORK_SIZE);
+
+	if (!sd_mount())
+		goto out;
+
+	emmcsn_path_impl(path, "/Dumps", "bench_core.csv", NULL);
+	if (f_open(&csv, path, FA_CREATE_ALWAYS | FA_WRITE))
+	{
+		EPRINTFARGS("Error creating %s.", path);
+		goto out;
+	}
+
+	gfx_con.fntsz = 8;
+	gfx_puts(&gfx_con, "Preparing test data...\n");
+
+	// Same data the memops bench uses, compressible but not trivially.
+	for (u32 i = 0; i < BENCH_CORE_BUF_SIZE; i++)
+		_bcore.src[i] = i * 13 + (i >> 9);
+	_bcore.lz_size = LZ_CompressFast(_bcore.src, _bcore.lz, BENCH_CORE_BUF_SIZE, (unsigned int *)(_bcore.lz + lz_work));
+	// The decoded pattern stays behind the stream as the reference.
+	_bcore.blz_size = _bench_blz_gen(_bcore.blz, _bcore.dst, BENCH_CORE_BUF_SIZE);
+	memcpy(_bcore.blz + BENCH_CORE_BUF_SIZE, _bcore.dst, BENCH_CORE_BUF_SIZE);
+
+	u32 key[8];
+	for (u32 i = 0; i < 8; i++)
+		key[i] = _bench_rand();
+	se_aes_key_set(DUMP_BIS_KS_CRYPT, key, 0x10);
+	se_aes_key_set(DUMP_BIS_KS_TWEAK, key + 4, 0x10);
+
+	_bcore.emmc = nx_emmc_open(0);
+
+	for (u32 i = 0; i < BENCH_CORE_NUM; i++)
+	{
+		gfx_con_setpos(&gfx_con, 0, 16);
+		gfx_printf(&gfx_con, "Running %s...        \n", _bench_core_tests[i].name);
+		_bench_core_run(&_bench_core_tests[i], &results[i]);
+	}
+
+	if (_bcore.emmc)
+		nx_emmc_close();
+	se_aes_key_clear(DUMP_BIS_KS_CRYPT);
+	se_aes_key_clear(DUMP_BIS_KS_TWEAK);
+
+	// The gfx tests draw over the console, so results are shown at the end.
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+	gfx_printf(&gfx_con, "%kCore primitives, %d warmup calls, rates in K units/s%k\n\n", 0xFF00DDFF, BENCH_CORE_WARMUP, 0xFFCCCCCC);
+
+	f_puts("test,unit,size,iters,total_us,best_us,kunits_per_s,ok\n", &csv);
+	for (u32 i = 0; i < BENCH_CORE_NUM; i++)
+	{
+		const bench_core_t *test = &_bench_core_tests[i];
+		bench_core_res_t *res = &results[i];
+		u32 rate = (u32)((u64)test->size * test->iters * 1000000 / res->total_us >> 10);
+
+		gfx_printf(&gfx_con, "%s:", test->name);
+		gfx_con_setpos(&gfx_con, 136, gfx_con.y);
+		if (res->ok)
+			gfx_printf(&gfx_con, "%7d K%s/s, best call %7d us\n", rate, test->unit, res->best_us);
+		else
+			gfx_printf(&gfx_con, "%kfailed%k\n", 0xFFFF0000, 0xFFCCCCCC);
+
+		_bench_csv_put(&csv, test->name, 0, 0);
+		_bench_csv_put(&csv, test->unit, 0, 0);
+		_bench_csv_put(&csv, NULL, test->size, 0);
+		_bench_csv_put(&csv, NULL, test->iters, 0);
+		_bench_csv_put(&csv, NULL, res->total_us, 0);
+		_bench_csv_put(&csv, NULL, res->best_us, 0);
+		_bench_csv_put(&csv, NULL, rate, 0);
+		_bench_csv_put(&csv, NULL, res->ok, 1);
+	}
+	f_close(&csv);
+	gfx_con.fntsz = 16;
+
+	gfx_printf(&gfx_con, "\n%kResults saved to bench_core.csv%k\n", 0xFF96FF00, 0xFFCCCCCC);
 
 out:
+	free(_bcore.src);
+	free(_bcore.dst);
+	free(_bcore.blz);
+	free(_bcore.lz);
 	sd_unmount();
+	bpmp_clk_rate_set(clk);
+	gfx_puts(&gfx_con, "\nPress any key...\n");
 	btn_wait();
 }
 
-void dump_emmc_system() { dump_emmc_selected(PART_SYSTEM); }
-void dump_emmc_user() { dump_emmc_selected(PART_USER); }
-void dump_emmc_boot() { dump_emmc_selected(PART_BOOT); }
-void dump_emmc_rawnand() { dump_emmc_selected(PART_RAW); }
+#define BENCH_DRAM_BW_SIZE   0x1000000 // 16MB per buffer and pass.
+#define BENCH_DRAM_BW_PASSES 4
+#define BENCH_DRAM_LOAD_SIZE 0x800000  // Per SE or SDMMC DMA job running next to the CPU.
+#define BENCH_DRAM_WALK_SIZE 0x400000  // Data line test on the start of the region.
+#define BENCH_DRAM_MIN_SIZE  (BENCH_DRAM_BW_SIZE * 3)
 
-int restore_emmc_part(char *sd_path, sdmmc_storage_t *storage, emmc_part_t *part)
+typedef struct _bench_dram_t
 {
-	static const u32 SECTORS_TO_MIB_COEFF = 11;
-
-	u32 totalSectors = part->lba_end - part->lba_start + 1;
-	u32 lbaStartPart = part->lba_start;
-	int res = 0;
-	char *outFilename = sd_path;
-
-	gfx_con.fntsz = 8;
-
-	FIL fp;
-	gfx_printf(&gfx_con, "\nFilename: %s\n", outFilename);
+	u8 *base;
+	u32 size;
+	u8 *src;
+	u8 *dst;
+	u8 *load;
+	sdmmc_storage_t *emmc;
+	u32 errors;
+	u32 err_addr; // First failing word.
+	u32 err_val;
+	u32 err_exp;
+} bench_dram_t;
+
+// Readback must come from DRAM, not from the BPMP cache.
+static void _bench_dram_sync(void *buf, u32 size)
+{
+	bpmp_cache_clean(buf, size);
+	bpmp_cache_invalidate(buf, size);
+}
 
-	res = f_open(&fp, outFilename, FA_READ);
-	if (res)
+static void _bench_dram_error(bench_dram_t *ctx, vu32 *addr, u32 val, u32 exp)
+{
+	if (!ctx->errors++)
 	{
-		WPRINTFARGS("Error (%d) while opening backup. Continuing...\n", res);
-		gfx_con.fntsz = 16;
-
-		return 0;
+		ctx->err_addr = (u32)addr;
+		ctx->err_val = val;
+		ctx->err_exp = exp;
 	}
-	//TODO: Should we keep this check?
-	else if (((u32)((u64)f_size(&fp) >> (u64)9)) != totalSectors)
-	{
-		gfx_con.fntsz = 16;
-		EPRINTF("Size of the SD Card backup does not match,\neMMC's selected part size.\n");
-		f_close(&fp);
+}
 
-		return 0;
-	}
-	else
-		gfx_printf(&gfx_con, "\nTotal restore size: %d MiB.\n\n", ((u32)((u64)f_size(&fp) >> (u64)9)) >> SECTORS_TO_MIB_COEFF);
+// Starts a DMA job that competes with the CPU for the EMC. Returns what will be moved.
+static u32 _bench_dram_load_start(bench_dram_t *ctx, u32 load)
+{
+	if (load == 1 && se_aes_crypt_ecb_submit(DUMP_BIS_KS_CRYPT, 1, ctx->load, BENCH_DRAM_LOAD_SIZE / 2,
+		ctx->load + BENCH_DRAM_LOAD_SIZE / 2, BENCH_DRAM_LOAD_SIZE / 2))
+		return BENCH_DRAM_LOAD_SIZE;
+	if (load == 2 && ctx->emmc &&
+		sdmmc_storage_submit(ctx->emmc, 0, BENCH_DRAM_LOAD_SIZE / NX_EMMC_BLOCKSIZE, ctx->load, 0))
+		return BENCH_DRAM_LOAD_SIZE;
 
-	u32 numSectorsPerIter = 0;
-	if (totalSectors > 0x200000)
-		numSectorsPerIter = 8192; //4MB Cache
-	else
-		numSectorsPerIter = 512;  //256KB Cache
+	return 0;
+}
 
-	u8 *buf = (u8 *)calloc(numSectorsPerIter, NX_EMMC_BLOCKSIZE);
+static void _bench_dram_load_finish(bench_dram_t *ctx, u32 load)
+{
+	if (load == 1)
+		se_complete();
+	else if (load == 2)
+		sdmmc_storage_complete(ctx->emmc);
+}
 
-	u32 lba_curr = part->lba_start;
-	u32 bytesWritten = 0;
-	u32 prevPct = 200;
-	int retryCount = 0;
+/*
+* Sequential CPU streams with the LDM/STM burst routines: 0 read, 1 write, 2 copy. Optional load
+* 1 runs SE AES and 2 eMMC reads next to it. Returns CPU bytes per second, load bytes in loadBw.
+*/
+static u32 _bench_dram_bw(bench_dram_t *ctx, u32 op, u32 load, u32 *loadBw)
+{
+	u64 bytes = 0;
+	u64 loadBytes = 0;
+	u32 loadUs = 0;
 
-	u32 num = 0;
-	u32 pct = 0;
-	while (totalSectors > 0)
+	// Equal buffers, so the comparison reads both to the end.
+	__wrap_memcpy(ctx->dst, ctx->src, BENCH_DRAM_BW_SIZE);
+	_bench_dram_sync(ctx->src, BENCH_DRAM_BW_SIZE * 2);
+
+	u32 timer = get_tmr_us();
+	for (u32 pass = 0; pass < BENCH_DRAM_BW_PASSES; pass++)
 	{
-		retryCount = 0;
-		num = MIN(totalSectors, numSectorsPerIter);
+		u32 loadTimer = get_tmr_us();
+		u32 loadSize = load ? _bench_dram_load_start(ctx, load) : 0;
 
-		res = f_read(&fp, buf, NX_EMMC_BLOCKSIZE * num, NULL);
-		if (res)
+		switch (op)
 		{
-			gfx_con.fntsz = 16;
-			EPRINTFARGS("\nFatal error (%d) when reading from SD Card", res);
-			EPRINTF("\nYour device may be in an inoperative state!\n\nPress any key and try again now...\n");
-
-			free(buf);
-			f_close(&fp);
-			return 0;
+		case 0:
+			ctx->errors += __wrap_memcmp(ctx->dst, ctx->src, BENCH_DRAM_BW_SIZE) != 0;
+			bytes += BENCH_DRAM_BW_SIZE * 2;
+			break;
+		case 1:
+			__wrap_memset(ctx->dst, pass, BENCH_DRAM_BW_SIZE);
+			bytes += BENCH_DRAM_BW_SIZE;
+			break;
+		case 2:
+			__wrap_memcpy(ctx->dst, ctx->src, BENCH_DRAM_BW_SIZE);
+			bytes += BENCH_DRAM_BW_SIZE * 2;
+			break;
 		}
-		while (!sdmmc_storage_write(storage, lba_curr, num, buf))
-		{
-			EPRINTFARGS("Error writing %d blocks @ LBA %08X\nto eMMC (try %d), retrying...",
-				num, lba_curr, ++retryCount);
-
-			msleep(150);
-			if (retryCount >= 3)
-			{
-				gfx_con.fntsz = 16;
-				EPRINTFARGS("\nFailed to write %d blocks @ LBA %08X\nfrom eMMC. Aborting..\n",
-					num, lba_curr);
-				EPRINTF("\nYour device may be in an inoperative state!\n\nPress any key and try again...\n");
 
-				free(buf);
-				f_close(&fp);
-				return 0;
-			}
-		}
-		pct = (u64)((u64)(lba_curr - part->lba_start) * 100u) / (u64)(part->lba_end - part->lba_start);
-		if (pct != prevPct)
+		if (loadSize)
 		{
-			tui_pbar(&gfx_con, 0, gfx_con.y, pct, 0xFFCCCCCC, 0xFF555555);
-			prevPct = pct;
+			_bench_dram_load_finish(ctx, load);
+			loadBytes += loadSize;
+			loadUs += get_tmr_us() - loadTimer;
 		}
-
-		lba_curr += num;
-		totalSectors -= num;
-		bytesWritten += num * NX_EMMC_BLOCKSIZE;
 	}
-	tui_pbar(&gfx_con, 0, gfx_con.y, 100, 0xFFCCCCCC, 0xFF555555);
+	timer = MAX(get_tmr_us() - timer, 1);
 
-	// Restore operation ended successfully.
-	free(buf);
-	f_close(&fp);
+	if (loadBw)
+		*loadBw = loadUs ? (u32)(loadBytes * 1000000 / loadUs) : 0;
 
-	if (h_cfg.verification)
+	return (u32)(bytes * 1000000 / timer);
+}
+
+// Walking ones and zeroes, each word starts one bit further, so every data line toggles next to its neighbours.
+static void _bench_dram_walk(bench_dram_t *ctx)
+{
+	vu32 *buf = (vu32 *)ctx->base;
+	u32 num = BENCH_DRAM_WALK_SIZE / 4;
+
+	for (u32 inv = 0; inv < 2; inv++)
 	{
-		// Verify restored data.
-		if (dump_emmc_verify(storage, lbaStartPart, outFilename, part))
+		for (u32 bit = 0; bit < 32; bit++)
 		{
-			EPRINTF("\nPress any key and try again...\n");
+			u32 mask = inv ? 0xFFFFFFFF : 0;
+			for (u32 i = 0; i < num; i++)
+				buf[i] = (1u << ((bit + i) & 31)) ^ mask;
+			_bench_dram_sync((void *)buf, BENCH_DRAM_WALK_SIZE);
 
-			free(buf);
-			return 0;
+			for (u32 i = 0; i < num; i++)
+			{
+				u32 exp = (1u << ((bit + i) & 31)) ^ mask;
+				if (buf[i] != exp)
+					_bench_dram_error(ctx, &buf[i], buf[i], exp);
+			}
 		}
-		else
-			tui_pbar(&gfx_con, 0, gfx_con.y, 100, 0xFF96FF00, 0xFF155500);
 	}
-
-	gfx_con.fntsz = 16;
-	gfx_puts(&gfx_con, "\n\n");
-
-	return 1;
 }
 
-static void restore_emmc_selected(emmcPartType_t restoreType)
+// Every word holds its own address, then its complement, which catches shorted or stuck address lines.
+static void _bench_dram_addr(bench_dram_t *ctx)
 {
-	int res = 0;
-	u32 timer = 0;
-	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
-	tui_sbar(&gfx_con, 1);
-	gfx_con_setpos(&gfx_con, 0, 0);
+	vu32 *buf = (vu32 *)ctx->base;
+	u32 num = ctx->size / 4;
 
-	gfx_printf(&gfx_con, "%kThis is a dangerous operation\nand may render your device inoperative!\n\n", 0xFFFFDD00);
-	gfx_printf(&gfx_con, "Are you really sure?\n\n%k", 0xFFCCCCCC);
-	if ((restoreType & PART_BOOT) || (restoreType & PART_GP_ALL))
+	for (u32 inv = 0; inv < 2; inv++)
 	{
-		gfx_puts(&gfx_con, "The mode you selected will only restore\nthe ");
-		if (restoreType & PART_BOOT)
-			gfx_puts(&gfx_con, "boot ");
-		gfx_puts(&gfx_con, "partitions that it can find.\n");
-		gfx_puts(&gfx_con, "If it is not found, it will be skipped\nand continue with the next.\n\n");
-	}
-	gfx_con_getpos(&gfx_con, &gfx_con.savedx, &gfx_con.savedy);
+		u32 mask = inv ? 0xFFFFFFFF : 0;
+		for (u32 i = 0; i < num; i++)
+			buf[i] = (u32)&buf[i] ^ mask;
+		_bench_dram_sync((void *)buf, ctx->size);
 
-	u8 value = 10;
-	while (value > 0)
-	{
-		gfx_con_setpos(&gfx_con, gfx_con.savedx, gfx_con.savedy);
-		gfx_printf(&gfx_con, "%kWait... (%ds)    %k", 0xFF888888, value, 0xFFCCCCCC);
-		msleep(1000);
-		value--;
+		for (u32 i = 0; i < num; i++)
+		{
+			u32 exp = (u32)&buf[i] ^ mask;
+			if (buf[i] != exp)
+				_bench_dram_error(ctx, &buf[i], buf[i], exp);
+		}
 	}
-	gfx_con_setpos(&gfx_con, gfx_con.savedx, gfx_con.savedy);
+}
 
-	gfx_puts(&gfx_con, "Press POWER to Continue.\nPress VOL to go to the menu.\n\n\n");
+static void _bench_dram_report(FIL *csv, const char *test, u32 size, u32 value, const char *unit)
+{
+	gfx_printf(&gfx_con, "%s:", test);
+	gfx_con_setpos(&gfx_con, 200, gfx_con.y);
+	gfx_printf(&gfx_con, "%7d %s\n", value, unit);
+
+	_bench_csv_put(csv, test, 0, 0);
+	_bench_csv_put(csv, NULL, size, 0);
+	_bench_csv_put(csv, NULL, value, 0);
+	_bench_csv_put(csv, unit, 0, 1);
+}
 
-	u32 btn = btn_wait();
-	if (!(btn & BTN_POWER))
-		goto out;
+void bench_dram()
+{
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+	u32 clk = bpmp_clk_boost();
 
+	static const char *ops[] = { "read", "write", "copy" };
+	static const char *loads[] = { "", " + SE", " + eMMC" };
+	bench_dram_t ctx;
+	FIL csv;
+	char path[64];
+	char name[32];
+
+	memset(&ctx, 0, sizeof(ctx));
 	if (!sd_mount())
 		goto out;
 
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-	if (!sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4))
+	// The largest span the IPL and its heaps leave free, whole MiBs of it.
+	u32 start;
+	u32 size = memmap_largest_free(&start);
+	u32 aligned = ALIGN(start, 0x100000);
+	size = size > aligned - start ? (size - (aligned - start)) & ~0xFFFFF : 0;
+	if (size < BENCH_DRAM_MIN_SIZE || !memmap_reserve("dram test", aligned, size))
 	{
-		EPRINTF("Failed to init eMMC.");
+		EPRINTF("Not enough free DRAM to test.");
 		goto out;
 	}
-
-	int i = 0;
-	char sdPath[80];
-
-	timer = get_tmr_s();
-	if (restoreType & PART_BOOT)
+	ctx.base = (u8 *)aligned;
+	ctx.size = size;
+	ctx.src = ctx.base;
+	ctx.dst = ctx.base + BENCH_DRAM_BW_SIZE;
+	ctx.load = ctx.base + BENCH_DRAM_BW_SIZE * 2;
+
+	u32 id = sdram_get_id();
+	strcpy(name, "bench_dram_");
+	itoa(id, name + strlen(name), 10);
+	strcat(name, ".csv");
+	emmcsn_path_impl(path, "/Dumps", name, NULL);
+	if (f_open(&csv, path, FA_CREATE_ALWAYS | FA_WRITE))
 	{
-		const u32 BOOT_PART_SIZE = storage.ext_csd.boot_mult << 17;
-
-		emmc_part_t bootPart;
-		memset(&bootPart, 0, sizeof(bootPart));
-		bootPart.lba_start = 0;
-		bootPart.lba_end = (BOOT_PART_SIZE / NX_EMMC_BLOCKSIZE) - 1;
-		for (i = 0; i < 2; i++)
-		{
-			memcpy(bootPart.name, "BOOT", 4);
-			bootPart.name[4] = (u8)('0' + i);
-			bootPart.name[5] = 0;
-
-			gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i,
-				bootPart.name, bootPart.lba_start, bootPart.lba_end, 0xFFCCCCCC);
-
-			sdmmc_storage_set_mmc_partition(&storage, i + 1);
-
-			emmcsn_path_impl(sdPath, "/Restore", bootPart.name, &storage);
-			res = restore_emmc_part(sdPath, &storage, &bootPart);
-		}
+		EPRINTFARGS("Error creating %s.", path);
+		memmap_free(ctx.base);
+		goto out;
 	}
+	f_puts("test,size,value,unit\n", &csv);
 
-	if (restoreType & PART_GP_ALL)
-	{
-		sdmmc_storage_set_mmc_partition(&storage, 0);
-
-		LIST_INIT(gpt);
-		nx_emmc_gpt_parse(&gpt, &storage);
-		LIST_FOREACH_ENTRY(emmc_part_t, part, &gpt, link)
-		{
-			gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i++,
-				part->name, part->lba_start, part->lba_end, 0xFFCCCCCC);
+	gfx_con.fntsz = 8;
+	gfx_printf(&gfx_con, "%kSDRAM id %d, testing %d MiB @ %08X%k\n\n", 0xFF00DDFF, id, size >> 20, aligned, 0xFFCCCCCC);
 
-			emmcsn_path_impl(sdPath, "/Restore/Partitions/", part->name, &storage);
-			res = restore_emmc_part(sdPath, &storage, part);
-		}
-		nx_emmc_gpt_free(&gpt);
-	}
+	u32 key[4];
+	for (u32 i = 0; i < 4; i++)
+		key[i] = _bench_rand();
+	se_aes_key_set(DUMP_BIS_KS_CRYPT, key, 0x10);
+	ctx.emmc = nx_emmc_open(0);
 
-	if (restoreType & PART_RAW)
+	// CPU streams alone, then with each DMA engine pulling on the EMC as well.
+	char test[32];
+	for (u32 load = 0; load < 3; load++)
 	{
-		// Get GP partition size dynamically.
-		const u32 RAW_AREA_NUM_SECTORS = storage.sec_cnt;
-
-		emmc_part_t rawPart;
-		memset(&rawPart, 0, sizeof(rawPart));
-		rawPart.lba_start = 0;
-		rawPart.lba_end = RAW_AREA_NUM_SECTORS - 1;
-		strcpy(rawPart.name, "rawnand.bin");
+		if (load == 2 && !ctx.emmc)
+			break;
+		for (u32 op = 0; op < 3; op++)
 		{
-			gfx_printf(&gfx_con, "%k%02d: %s (%07X-%07X)%k\n", 0xFF00DDFF, i++,
-				rawPart.name, rawPart.lba_start, rawPart.lba_end, 0xFFCCCCCC);
-
-			emmcsn_path_impl(sdPath, "/Restore", rawPart.name, &storage);
-			res = restore_emmc_part(sdPath, &storage, &rawPart);
+			u32 loadBw = 0;
+			u32 bw = _bench_dram_bw(&ctx, op, load, &loadBw);
+			strcpy(test, ops[op]);
+			strcat(test, loads[load]);
+			_bench_dram_report(&csv, test, BENCH_DRAM_BW_SIZE, bw >> 10, "KiB/s");
+			if (load)
+			{
+				strcpy(test, loads[load] + 3);
+				strcat(test, " DMA next to ");
+				strcat(test, ops[op]);
+				_bench_dram_report(&csv, test, BENCH_DRAM_LOAD_SIZE, loadBw >> 10, "KiB/s");
+			}
 		}
 	}
+	if (ctx.emmc)
+		nx_emmc_close();
+	se_aes_key_clear(DUMP_BIS_KS_CRYPT);
+	u32 bwErrors = ctx.errors;
+	ctx.errors = 0;
+
+	gfx_puts(&gfx_con, "\nWalking ones/zeroes...\n");
+	_bench_dram_walk(&ctx);
+	u32 walkErrors = ctx.errors;
+	_bench_dram_report(&csv, "walking ones", BENCH_DRAM_WALK_SIZE, walkErrors, "errors");
+
+	gfx_puts(&gfx_con, "Address in address...\n");
+	ctx.errors = 0;
+	_bench_dram_addr(&ctx);
+	_bench_dram_report(&csv, "address in address", size, ctx.errors, "errors");
+	ctx.errors += walkErrors + bwErrors;
+	f_close(&csv);
+	memmap_free(ctx.base);
+	gfx_con.fntsz = 16;
 
-	gfx_putc(&gfx_con, '\n');
-	timer = get_tmr_s() - timer;
-	gfx_printf(&gfx_con, "Time taken: %dm %ds.\n", timer / 60, timer % 60);
-	sdmmc_storage_end(&storage);
-	if (res && h_cfg.verification)
-		gfx_printf(&gfx_con, "\n%kFinished and verified!%k\nPress any key...\n", 0xFF96FF00, 0xFFCCCCCC);
-	else if (res)
-		gfx_printf(&gfx_con, "\nFinished! Press any key...\n");
+	if (ctx.errors)
+		EPRINTFARGS("\n%d errors, first @ %08X: %08X, expected %08X!", ctx.errors,
+			ctx.err_addr, ctx.err_val, ctx.err_exp);
+	else
+		gfx_printf(&gfx_con, "\n%kNo errors. Results saved to %s%k\n", 0xFF96FF00, name, 0xFFCCCCCC);
 
 out:
 	sd_unmount();
+	bpmp_clk_rate_set(clk);
+	gfx_puts(&gfx_con, "\nPress any key...\n");
 	btn_wait();
 }
 
-void restore_emmc_boot() { restore_emmc_selected(PART_BOOT); }
-void restore_emmc_rawnand() { restore_emmc_selected(PART_RAW); }
-void restore_emmc_gpp_parts() { restore_emmc_selected(PART_GP_ALL); }
-
 void dump_packages12()
 {
-	u8 *pkg1 = (u8 *)calloc(1, 0x40000);
+	u8 *pkg1 = (u8 *)dma_calloc(1, 0x40000);
 	u8 *warmboot = (u8 *)calloc(1, 0x40000);
 	u8 *secmon = (u8 *)calloc(1, 0x40000);
 	u8 *loader = (u8 *)calloc(1, 0x40000);
 	u8 *pkg2 = NULL;
+	sdmmc_storage_t *storage = NULL;
+	LIST_INIT(gpt);
 
 	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
 	gfx_con_setpos(&gfx_con, 0, 0);
@@ -1585,37 +5460,45 @@ void dump_packages12()
 	if (!sd_mount())
 		goto out;
 
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-	if (!sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4))
+	storage = nx_emmc_open(0);
+	if (!storage)
 	{
 		EPRINTF("Failed to init eMMC.");
 		goto out;
 	}
-	sdmmc_storage_set_mmc_partition(&storage, 1);
 
-	// Read package1.
-	sdmmc_storage_read(&storage, 0x100000 / NX_EMMC_BLOCKSIZE, 0x40000 / NX_EMMC_BLOCKSIZE, pkg1);
-	const pkg1_id_t *pkg1_id = pkg1_identify(pkg1);
-	const pk11_hdr_t *hdr = (pk11_hdr_t *)(pkg1 + pkg1_id->pkg11_off + 0x20);
+	// Package1 and the keyblob come from the session cache, decrypted here on copies.
+	const pkg1_cache_t *cache = pkg1_cache_get();
+	if (!cache)
+	{
+		EPRINTF("Failed to read package1.");
+		goto out;
+	}
+	memcpy(pkg1, cache->pkg1, PKG1_CACHE_SIZE);
+	const pkg1_id_t *pkg1_id = cache->pkg1_id;
 	if (!pkg1_id)
 	{
 		gfx_con.fntsz = 8;
 		EPRINTFARGS("Unknown package1 version for reading\nTSEC firmware (= '%s').", (char *)pkg1 + 0x10);
 		goto out;
 	}
+	const pk11_hdr_t *hdr = (pk11_hdr_t *)(pkg1 + pkg1_id->pkg11_off + 0x20);
 
 	if (!h_cfg.se_keygen_done)
 	{
-		// Read keyblob.
-		u8 *keyblob = (u8 *)calloc(NX_EMMC_BLOCKSIZE, 1);
-		sdmmc_storage_read(&storage, 0x180000 / NX_EMMC_BLOCKSIZE + pkg1_id->kb, 1, keyblob);
+		u8 *keyblob = (u8 *)malloc(NX_EMMC_BLOCKSIZE);
+		memcpy(keyblob, cache->keyblob, NX_EMMC_BLOCKSIZE);
 
 		// Decrypt.
-		keygen(keyblob, pkg1_id->kb, (u8 *)pkg1 + pkg1_id->tsec_off);
+		int keysOk = keygen(keyblob, pkg1_id->kb);
+		free(keyblob);
+		if (!keysOk)
+		{
+			EPRINTF("Failed to generate keys (corrupt keyblob?).");
+			goto out;
+		}
 
 		h_cfg.se_keygen_done = 1;
-		free(keyblob);
 	}
 	pkg1_decrypt(pkg1_id, pkg1);
 
@@ -1632,49 +5515,48 @@ void dump_packages12()
 
 	char path[64];
 	// Dump package1.1.
-	emmcsn_path_impl(path, "/pkg1", "pkg1_decr.bin", &storage);
+	emmcsn_path_impl(path, "/pkg1", "pkg1_decr.bin", storage);
 	if (sd_save_to_file(pkg1, 0x40000, path))
 		goto out;
 	gfx_puts(&gfx_con, "\nFull package1 dumped to pkg1_decr.bin\n");
 
 	// Dump nxbootloader.
-	emmcsn_path_impl(path, "/pkg1", "nxloader.bin", &storage);
+	emmcsn_path_impl(path, "/pkg1", "nxloader.bin", storage);
 	if (sd_save_to_file(loader, hdr->ldr_size, path))
 		goto out;
 	gfx_puts(&gfx_con, "NX Bootloader dumped to nxloader.bin\n");
 
 	// Dump secmon.
-	emmcsn_path_impl(path, "/pkg1", "secmon.bin", &storage);
+	emmcsn_path_impl(path, "/pkg1", "secmon.bin", storage);
 	if (sd_save_to_file(secmon, hdr->sm_size, path))
 		goto out;
 	gfx_puts(&gfx_con, "Secure Monitor dumped to secmon.bin\n");
 
 	// Dump warmboot.
-	emmcsn_path_impl(path, "/pkg1", "warmboot.bin", &storage);
+	emmcsn_path_impl(path, "/pkg1", "warmboot.bin", storage);
 	if (sd_save_to_file(warmboot, hdr->wb_size, path))
 		goto out;
 	gfx_puts(&gfx_con, "Warmboot dumped to warmboot.bin\n\n\n");
 
 	// Dump package2.1.
-	sdmmc_storage_set_mmc_partition(&storage, 0);
+	sdmmc_storage_set_mmc_partition(storage, 0);
 	// Parse eMMC GPT.
-	LIST_INIT(gpt);
-	nx_emmc_gpt_parse(&gpt, &storage);
+	nx_emmc_gpt_parse(&gpt, storage);
 	// Find package2 partition.
 	emmc_part_t *pkg2_part = nx_emmc_part_find(&gpt, "BCPKG2-1-Normal-Main");
 	if (!pkg2_part)
 		goto out;
 
 	// Read in package2 header and get package2 real size.
-	u8 *tmp = (u8 *)malloc(NX_EMMC_BLOCKSIZE);
-	nx_emmc_part_read(&storage, pkg2_part, 0x4000 / NX_EMMC_BLOCKSIZE, 1, tmp);
+	u8 *tmp = (u8 *)dma_malloc(NX_EMMC_BLOCKSIZE);
+	nx_emmc_part_read(storage, pkg2_part, 0x4000 / NX_EMMC_BLOCKSIZE, 1, tmp);
 	u32 *hdr_pkg2_raw = (u32 *)(tmp + 0x100);
 	u32 pkg2_size = hdr_pkg2_raw[0] ^ hdr_pkg2_raw[2] ^ hdr_pkg2_raw[3];
 	free(tmp);
 	// Read in package2.
 	u32 pkg2_size_aligned = ALIGN(pkg2_size, NX_EMMC_BLOCKSIZE);
-	pkg2 = malloc(pkg2_size_aligned);
-	nx_emmc_part_read(&storage, pkg2_part, 0x4000 / NX_EMMC_BLOCKSIZE, 
+	pkg2 = dma_malloc(pkg2_size_aligned);
+	nx_emmc_part_read(storage, pkg2_part, 0x4000 / NX_EMMC_BLOCKSIZE, 
 		pkg2_size_aligned / NX_EMMC_BLOCKSIZE, pkg2);
 	// Decrypt package2 and parse KIP1 blobs in INI1 section.
 	pkg2_hdr_t *pkg2_hdr = pkg2_decrypt(pkg2);
@@ -1686,37 +5568,103 @@ void dump_packages12()
 	gfx_printf(&gfx_con, "%kINI1 size:     %k0x%05X\n\n", 0xFFC7EA46, 0xFFCCCCCC, pkg2_hdr->sec_size[PKG2_SEC_INI1]);
 
 	// Dump pkg2.1.
-	emmcsn_path_impl(path, "/pkg2", "pkg2_decr.bin", &storage);
+	emmcsn_path_impl(path, "/pkg2", "pkg2_decr.bin", storage);
 	if (sd_save_to_file(pkg2, pkg2_hdr->sec_size[PKG2_SEC_KERNEL] + pkg2_hdr->sec_size[PKG2_SEC_INI1], path))
 		goto out;
 	gfx_puts(&gfx_con, "\nFull package2 dumped to pkg2_decr.bin\n");
 
 	// Dump kernel.
-	emmcsn_path_impl(path, "/pkg2", "kernel.bin", &storage);
+	emmcsn_path_impl(path, "/pkg2", "kernel.bin", storage);
 	if (sd_save_to_file(pkg2_hdr->data, pkg2_hdr->sec_size[PKG2_SEC_KERNEL], path))
 		goto out;
 	gfx_puts(&gfx_con, "Kernel dumped to kernel.bin\n");
 
 	// Dump INI1.
-	emmcsn_path_impl(path, "/pkg2", "ini1.bin", &storage);
+	emmcsn_path_impl(path, "/pkg2", "ini1.bin", storage);
 	if (sd_save_to_file(pkg2_hdr->data + pkg2_hdr->sec_size[PKG2_SEC_KERNEL],
 		pkg2_hdr->sec_size[PKG2_SEC_INI1], path))
 		goto out;
 	gfx_puts(&gfx_con, "INI1 kip1 package dumped to ini1.bin\n");
 
-	gfx_puts(&gfx_con, "\nDone. Press any key...\n");
+	gfx_puts(&gfx_con, "\nDone. Press any key...\n");
+
+out:
+	free(pkg1);
+	free(secmon);
+	free(warmboot);
+	free(loader);
+	free(pkg2);
+	nx_emmc_gpt_free(&gpt);
+	if (storage)
+		nx_emmc_close();
+	sd_unmount();
+
+	btn_wait();
+}
+
+// hekate_ipl.ini as parsed ahead by the idle scheduler, reused while the file is unchanged.
+LIST_INIT_STATIC(_ini_sections);
+static FILINFO _ini_fno;
+static int _ini_loaded = 0;
+
+static link_t *_ini_sections_get()
+{
+	FILINFO fno, cache_fno;
+
+	if (f_stat("hekate_ipl.ini", &fno) != FR_OK)
+		fno.fsize = 0;
+
+	// Keyed on size and time. Saving the config removes the parse cache, which catches rewrites within the 2s FAT time.
+	if (_ini_loaded && fno.fsize == _ini_fno.fsize && fno.fdate == _ini_fno.fdate && fno.ftime == _ini_fno.ftime &&
+		f_stat("hekate_ipl.ini.bin", &cache_fno) == FR_OK)
+		return &_ini_sections;
+
+	ini_free(&_ini_sections);
+	_ini_loaded = 0;
+
+	if (!fno.fsize || !ini_parse(&_ini_sections, "hekate_ipl.ini"))
+		return NULL;
+
+	memcpy(&_ini_fno, &fno, sizeof(FILINFO));
+	_ini_loaded = 1;
+
+	return &_ini_sections;
+}
+
+static int _idle_ini(u32 *state)
+{
+	// Mounting is the expensive part, so it gets its own step.
+	if (!*state)
+	{
+		if (!sd_mount())
+			return IDLE_TASK_FAIL;
+		(*state)++;
+		return IDLE_TASK_MORE;
+	}
+
+	return _ini_sections_get() ? IDLE_TASK_DONE : IDLE_TASK_FAIL;
+}
+
+static int _idle_gpt(u32 *state)
+{
+	LIST_INIT(gpt);
+
+	sdmmc_storage_t *storage = nx_emmc_open(0);
+	if (!storage)
+		return IDLE_TASK_FAIL;
 
-out:
-	free(pkg1);
-	free(secmon);
-	free(warmboot);
-	free(loader);
-	free(pkg2);
+	nx_emmc_gpt_parse(&gpt, storage);
+	int res = gpt.next != &gpt;
 	nx_emmc_gpt_free(&gpt);
-	sdmmc_storage_end(&storage);
-	sd_unmount();
+	nx_emmc_close();
 
-	btn_wait();
+	return res ? IDLE_TASK_DONE : IDLE_TASK_FAIL;
+}
+
+static int _idle_sensors(u32 *state)
+{
+	sensors_refresh();
+	return IDLE_TASK_DONE;
 }
 
 void launch_firmware()
@@ -1724,14 +5672,14 @@ void launch_firmware()
 	u8 max_entries = 61;
 
 	ini_sec_t *cfg_sec = NULL;
-	LIST_INIT(ini_sections);
+	link_t *ini_sections;
 
 	gfx_clear_grey(&gfx_ctxt, 0x1B);
 	gfx_con_setpos(&gfx_con, 0, 0);
 
 	if (sd_mount())
 	{
-		if (ini_parse(&ini_sections, "hekate_ipl.ini"))
+		if ((ini_sections = _ini_sections_get()))
 		{
 			// Build configuration menu.
 			ment_t *ments = (ment_t *)malloc(sizeof(ment_t) * (max_entries + 3));
@@ -1740,7 +5688,7 @@ void launch_firmware()
 			ments[1].type = MENT_CHGLINE;
 
 			u32 i = 2;
-			LIST_FOREACH_ENTRY(ini_sec_t, ini_sec, &ini_sections, link)
+			LIST_FOREACH_ENTRY(ini_sec_t, ini_sec, ini_sections, link)
 			{
 				if (!strcmp(ini_sec->name, "config") ||
 					ini_sec->type == INI_COMMENT || ini_sec->type == INI_NEWLINE)
@@ -1765,7 +5713,6 @@ void launch_firmware()
 				if (!cfg_sec)
 				{
 					free(ments);
-					ini_free(&ini_sections);
 					sd_unmount();
 					return;
 				}
@@ -1773,7 +5720,6 @@ void launch_firmware()
 			else
 				EPRINTF("No launch configurations found.");
 			free(ments);
-			ini_free(&ini_sections);
 		}
 		else
 			EPRINTF("Could not find or open 'hekate_ipl.ini'.\nMake sure it exists in SD Card!.");
@@ -1788,17 +5734,8 @@ void launch_firmware()
 		if (!(btn & BTN_POWER))
 			goto out;
 	}
-#ifdef MENU_LOGO_ENABLE
-	free(Kc_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
 	if (!hos_launch(cfg_sec))
-	{
-#ifdef MENU_LOGO_ENABLE
-		Kc_MENU_LOGO = (u8 *)malloc(0x6000);
-		blz_uncompress_srcdest(Kc_MENU_LOGO_blz, SZ_MENU_LOGO_BLZ, Kc_MENU_LOGO, SZ_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
 		EPRINTF("Failed to launch firmware.");
-	}
 
 out:;
 	ini_free_section(cfg_sec);
@@ -1807,31 +5744,202 @@ out:;
 	btn_wait();
 }
 
+static int display_ready = 0;
+
+static void _config_load_u32(ini_sec_t *sec, const char *key, u32 *val)
+{
+	char *str = ini_get_val(sec, key);
+	if (str)
+		*val = atoi(str);
+}
+
+static int display_started = 0;
+
+// Starts the panel bring-up. Its fixed delays then pass while startup reads the SD card, see _display_poll.
+static void _display_start()
+{
+	if (display_started)
+		return;
+	display_started = 1;
+
+	// A relaunching instance hands the panel over already up.
+	if (!(warm_flags() & WARM_DISPLAY))
+		display_init_start();
+
+#ifdef MENU_LOGO_ENABLE
+	// Decompressed and converted once, it stays resident outside the heap across launch attempts.
+	u8 *logo = (u8 *)malloc(ALIGN(SZ_MENU_LOGO, 0x10));
+	blz_uncompress_srcdest(Kc_MENU_LOGO_blz, SZ_MENU_LOGO_BLZ, logo, SZ_MENU_LOGO);
+	for (u32 i = 0; i < SZ_MENU_LOGO / 3; i++)
+		Kc_MENU_LOGO[i] = logo[i * 3 + 2] | (logo[i * 3 + 1] << 8) | (logo[i * 3] << 16);
+	free(logo);
+#endif //MENU_LOGO_ENABLE
+}
+
+// Advances a started bring-up without waiting. Returns 1 once the panel is up.
+static int _display_poll()
+{
+	if (display_ready)
+		return 1;
+	if (!display_started)
+		return 0;
+
+	if (warm_flags() & WARM_DISPLAY)
+		display_resume_framebuffer();
+	else
+	{
+		if (!display_init_poll())
+			return 0;
+		display_init_framebuffer();
+	}
+
+	display_ready = 1;
+	return 1;
+}
+
+static void _display_poll_sleep()
+{
+	_display_poll();
+}
+
+// Bring up the panel on first use, waiting for what startup did not overlap.
+static void _display_bringup()
+{
+	_display_start();
+	while (!_display_poll())
+		;
+}
+
+#define BOOTLOGO_CHUNK_SIZE 0x40000
+
+typedef struct _bootlogo_bmp_t
+{
+	u32 offset;
+	u32 size_x;
+	u32 size_y;
+	u32 pos_x;
+	u32 pos_y;
+} bootlogo_bmp_t;
+
+static int _bootlogo_parse(const u8 *hdr, u32 fileSize, bootlogo_bmp_t *bmp)
+{
+	// Get values manually to avoid unaligned access.
+	bmp->offset = hdr[10] | hdr[11] << 8 | hdr[12] << 16 | hdr[13] << 24;
+	bmp->size_x = hdr[18] | hdr[19] << 8 | hdr[20] << 16 | hdr[21] << 24;
+	bmp->size_y = hdr[22] | hdr[23] << 8 | hdr[24] << 16 | hdr[25] << 24;
+
+	// Sanity check.
+	if (hdr[0] != 'B' || hdr[1] != 'M' || hdr[28] != 32 ||
+		!bmp->size_x || bmp->size_x > 720 || !bmp->size_y || bmp->size_y > 1280 ||
+		bmp->offset > fileSize || (fileSize - bmp->offset) / 4 / bmp->size_x < bmp->size_y)
+		return 0;
+
+	// Center logo if res < 720x1280.
+	bmp->pos_x = (720  - bmp->size_x) >> 1;
+	bmp->pos_y = (1280 - bmp->size_y) >> 1;
+
+	return 1;
+}
+
+static void _bootlogo_draw(bootlogo_bmp_t *bmp, const u32 *rows, u32 row, u32 num)
+{
+	// Get background color from 1st pixel.
+	if (!row && (bmp->size_x < 720 || bmp->size_y < 1280))
+		gfx_clear_color(&gfx_ctxt, rows[0]);
+
+	gfx_render_bmp_argb_rows(&gfx_ctxt, rows, bmp->size_x, bmp->size_y, bmp->pos_x, bmp->pos_y, row, num);
+}
+
+/*
+* Draws a 32-bit BMP bootlogo, optionally BLZ compressed. Plain ones are streamed to the
+* framebuffer a few rows at a time, compressed ones are small enough to be read whole.
+*/
+static int _bootlogo_render(char *path)
+{
+	FIL fp;
+	bootlogo_bmp_t bmp;
+	u8 hdr[0x20];
+	int res = 0;
+
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+		return 0;
+	u32 fileSize = f_size(&fp);
+
+	if (!sd_file_read_to(&fp, hdr, sizeof(hdr)))
+		goto out;
+
+	if (hdr[0] == 'B' && hdr[1] == 'M')
+	{
+		if (!_bootlogo_parse(hdr, fileSize, &bmp) || f_lseek(&fp, bmp.offset) != FR_OK)
+			goto out;
+
+		u32 rowBytes = bmp.size_x * 4;
+		u32 chunkRows = MIN(bmp.size_y, BOOTLOGO_CHUNK_SIZE / rowBytes);
+		u32 *rows = (u32 *)dma_malloc(chunkRows * rowBytes);
+
+		res = 1;
+		for (u32 row = 0; row < bmp.size_y; row += chunkRows)
+		{
+			u32 num = MIN(chunkRows, bmp.size_y - row);
+			if (!sd_file_read_to(&fp, rows, num * rowBytes))
+			{
+				res = 0;
+				break;
+			}
+			_bootlogo_draw(&bmp, rows, row, num);
+		}
+		free(rows);
+	}
+	else
+	{
+		// BLZ compressed BMP, decompressed in place. The footer is at the end.
+		blz_footer footer;
+		if (fileSize < sizeof(blz_footer) || f_lseek(&fp, fileSize - sizeof(blz_footer)) != FR_OK ||
+			!sd_file_read_to(&fp, &footer, sizeof(blz_footer)) ||
+			footer.cmp_and_hdr_size > fileSize || footer.addl_size > 0x400000)
+			goto out;
+
+		u32 size = fileSize + footer.addl_size;
+		u8 *bitmap = (u8 *)dma_malloc(ALIGN(size, 0x10));
+		if (f_lseek(&fp, 0) == FR_OK && sd_file_read_to(&fp, bitmap, fileSize) &&
+			blz_uncompress_inplace(bitmap, fileSize, &footer) && _bootlogo_parse(bitmap, size, &bmp))
+		{
+			// Avoid unaligned access from BM 2-byte MAGIC and remove header.
+			memmove(bitmap, bitmap + bmp.offset, bmp.size_x * bmp.size_y * 4);
+			_bootlogo_draw(&bmp, (u32 *)bitmap, 0, bmp.size_y);
+			res = 1;
+		}
+		free(bitmap);
+	}
+
+out:
+	f_close(&fp);
+
+	return res;
+}
+
 void auto_launch_firmware()
 {
 	u8 *BOOTLOGO = NULL;
-	struct _bmp_data
-	{
-		u32 size;
-		u32 size_x;
-		u32 size_y;
-		u32 offset;
-		u32 pos_x;
-		u32 pos_y;
-	};
-
-	struct _bmp_data bmpData;
 	int backlightEnabled = 0;
 	int bootlogoFound = 0;
+	int headless = 0;
 	char *bootlogoCustomEntry = NULL;
 
 	ini_sec_t *cfg_sec = NULL;
 	LIST_INIT(ini_sections);
 
+	int launch_failed = 0;
 	gfx_con.mute = 1;
+	gfx_con_log_reset();
+
+	// The panel's power sequencing runs in the sleeps of the SD card init and mount.
+	_display_start();
+	sleep_set_hook(_display_poll_sleep);
 
 	if (sd_mount())
 	{
+		_display_poll();
 		if (ini_parse(&ini_sections, "hekate_ipl.ini"))
 		{
 			u32 configEntry = 0;
@@ -1846,17 +5954,13 @@ void auto_launch_firmware()
 					if (!strcmp(ini_sec->name, "config"))
 					{
 						configEntry = 1;
-						LIST_FOREACH_ENTRY(ini_kv_t, kv, &ini_sec->kvs, link)
-						{
-							if (!strcmp("autoboot", kv->key))
-								h_cfg.autoboot = atoi(kv->val);
-							else if (!strcmp("bootwait", kv->key))
-								h_cfg.bootwait = atoi(kv->val);
-							else if (!strcmp("customlogo", kv->key))
-								h_cfg.customlogo = atoi(kv->val);
-							else if (!strcmp("verification", kv->key))
-								h_cfg.verification = atoi(kv->val);
-						}
+						_config_load_u32(ini_sec, "autoboot", &h_cfg.autoboot);
+						_config_load_u32(ini_sec, "bootwait", &h_cfg.bootwait);
+						_config_load_u32(ini_sec, "customlogo", &h_cfg.customlogo);
+						_config_load_u32(ini_sec, "verification", &h_cfg.verification);
+						_config_load_u32(ini_sec, "backupformat", &h_cfg.backup_format);
+						_config_load_u32(ini_sec, "restorecache", &h_cfg.restore_cache);
+						_config_load_u32(ini_sec, "fastboot", &h_cfg.fastboot);
 						boot_entry_id++;
 						continue;
 					}
@@ -1864,11 +5968,7 @@ void auto_launch_firmware()
 					if (h_cfg.autoboot == boot_entry_id && configEntry)
 					{
 						cfg_sec = ini_clone_section(ini_sec);
-						LIST_FOREACH_ENTRY(ini_kv_t, kv, &cfg_sec->kvs, link)
-						{
-							if (!strcmp("logopath", kv->key))
-								bootlogoCustomEntry = kv->val;
-						}
+						bootlogoCustomEntry = ini_get_val(cfg_sec, "logopath");
 						break;
 					}
 					boot_entry_id++;
@@ -1891,74 +5991,35 @@ void auto_launch_firmware()
 	else
 		goto out;
 
+	// Without a custom logo there is nothing worth showing, so the bring-up stays where it got to.
+	sleep_set_hook(NULL);
+	headless = h_cfg.fastboot && !h_cfg.customlogo;
+	if (!headless)
+		_display_bringup();
+
 	if (h_cfg.customlogo)
 	{
-		u8 *bitmap = NULL;
-		if (bootlogoCustomEntry != NULL) // Check if user set custom logo path at the boot entry.
-		{
-			bitmap = (u8 *)sd_file_read(bootlogoCustomEntry);
-			if (bitmap == NULL) // Custom entry bootlogo not found, trying default custom one.
-				bitmap = (u8 *)sd_file_read("bootlogo.bmp");
-		}
-		else // User has not set a custom logo path.
-			bitmap = (u8 *)sd_file_read("bootlogo.bmp");
-
-		if (bitmap != NULL)
-		{
-			// Get values manually to avoid unaligned access.
-			bmpData.size = bitmap[2] | bitmap[3] << 8 |
-				bitmap[4] << 16 | bitmap[5] << 24;
-			bmpData.offset = bitmap[10] | bitmap[11] << 8 |
-				bitmap[12] << 16 | bitmap[13] << 24;
-			bmpData.size_x = bitmap[18] | bitmap[19] << 8 |
-				bitmap[20] << 16 | bitmap[21] << 24;
-			bmpData.size_y = bitmap[22] | bitmap[23] << 8 |
-				bitmap[24] << 16 | bitmap[25] << 24;
-			// Sanity check.
-			if (bitmap[0] == 'B' &&
-				bitmap[1] == 'M' &&
-				bitmap[28] == 32 && //
-				bmpData.size_x <= 720 &&
-				bmpData.size_y <= 1280)
-			{
-				if ((bmpData.size - bmpData.offset) <= 0x400000)
-				{
-					// Avoid unaligned access from BM 2-byte MAGIC and remove header.
-					BOOTLOGO = (u8 *)malloc(0x400000);
-					memcpy(BOOTLOGO, bitmap + bmpData.offset, bmpData.size - bmpData.offset);
-					free(bitmap);
-					// Center logo if res < 720x1280.
-					bmpData.pos_x = (720  - bmpData.size_x) >> 1;
-					bmpData.pos_y = (1280 - bmpData.size_y) >> 1;
-					// Get background color from 1st pixel.
-					if (bmpData.size_x < 720 || bmpData.size_y < 1280)
-						gfx_clear_color(&gfx_ctxt, *(u32 *)BOOTLOGO);
-
-					bootlogoFound = 1;
-				}
-			}
-			else
-				free(bitmap);
-		}
+		// Check if user set custom logo path at the boot entry, otherwise try the default custom one.
+		if (bootlogoCustomEntry != NULL)
+			bootlogoFound = _bootlogo_render(bootlogoCustomEntry);
+		if (!bootlogoFound)
+			bootlogoFound = _bootlogo_render("bootlogo.bmp");
 	}
 
 	// Render boot logo.
-	if (bootlogoFound)
-	{
-		gfx_render_bmp_argb(&gfx_ctxt, (u32 *)BOOTLOGO, bmpData.size_x, bmpData.size_y,
-			bmpData.pos_x, bmpData.pos_y);
-	}
-	else
+	if (!bootlogoFound && !headless)
 	{
 		BOOTLOGO = (void *)malloc(0x4000);
 		blz_uncompress_srcdest(BOOTLOGO_BLZ, SZ_BOOTLOGO_BLZ, BOOTLOGO, SZ_BOOTLOGO);
 		gfx_set_rect_grey(&gfx_ctxt, BOOTLOGO, X_BOOTLOGO, Y_BOOTLOGO, 326, 544);
 		free(BOOTLOGO);
 	}
-	free(BOOTLOGO);
 
-	display_backlight(1);
-	backlightEnabled = 1;
+	if (!headless)
+	{
+		display_backlight(1);
+		backlightEnabled = 1;
+	}
 
 	// Wait before booting. If VOL- is pressed go into bootloader menu.
 	u32 btn = btn_wait_timeout(h_cfg.bootwait * 1000, BTN_VOL_DOWN);
@@ -1968,19 +6029,15 @@ void auto_launch_firmware()
 
 	ini_free(&ini_sections);
 
-#ifdef MENU_LOGO_ENABLE
-	free(Kc_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
-	if (!hos_launch(cfg_sec))
-	{
-		// Failed to launch firmware.
-#ifdef MENU_LOGO_ENABLE
-		Kc_MENU_LOGO = (u8 *)malloc(ALIGN(SZ_MENU_LOGO, 0x10));
-		blz_uncompress_srcdest(Kc_MENU_LOGO_blz, SZ_MENU_LOGO_BLZ, Kc_MENU_LOGO, SZ_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
-	}
+	// Only returns if launching the firmware failed.
+	hos_launch(cfg_sec);
+	launch_failed = 1;
 
 out:
+	// Interrupted or failed fast boot, the menu needs the panel.
+	sleep_set_hook(NULL);
+	_display_bringup();
+
 	gfx_clear_grey(&gfx_ctxt, 0x1B);
 	ini_free(&ini_sections);
 	ini_free_section(cfg_sec);
@@ -1990,36 +6047,44 @@ out:
 
 	if (!backlightEnabled)
 		display_backlight(1);
+
+	// Only now is the muted output of the launch worth drawing.
+	if (launch_failed && gfx_con_log_count())
+	{
+		gfx_con_setpos(&gfx_con, 0, 0);
+		gfx_con_log_replay(&gfx_con);
+		EPRINTF("Failed to launch firmware.");
+		gfx_puts(&gfx_con, "\nPress any key...\n");
+		btn_wait();
+		gfx_clear_grey(&gfx_ctxt, 0x1B);
+	}
 }
 
 void toggle_autorcm()
 {
-	sdmmc_storage_t storage;
-	sdmmc_t sdmmc;
-
 	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
 	gfx_con_setpos(&gfx_con, 0, 0);
 
-	if (!sdmmc_storage_init_mmc(&storage, &sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4))
+	sdmmc_storage_t *storage = nx_emmc_open(1);
+	if (!storage)
 	{
 		EPRINTF("Failed to init eMMC.");
 		goto out;
 	}
 
-	u8 *tempbuf = (u8 *)malloc(0x200);
-	sdmmc_storage_set_mmc_partition(&storage, 1);
+	u8 *tempbuf = (u8 *)dma_malloc(0x200);
 
 	int i, sect = 0;
 	for (i = 0; i < 4; i++)
 	{
 		sect = (0x200 + (0x4000 * i)) / NX_EMMC_BLOCKSIZE;
-		sdmmc_storage_read(&storage, sect, 1, tempbuf);
+		sdmmc_storage_read(storage, sect, 1, tempbuf);
 		tempbuf[0x10] ^= 0x77; // !IMPORTANT: DO NOT CHANGE! XOR by arbitrary number to corrupt.
-		sdmmc_storage_write(&storage, sect, 1, tempbuf);
+		sdmmc_storage_write(storage, sect, 1, tempbuf);
 	}
 
 	free(tempbuf);
-	sdmmc_storage_end(&storage);
+	nx_emmc_close();
 
 	gfx_printf(&gfx_con, "%kAutoRCM mode toggled!%k\n\nPress any key...\n", 0xFF96FF00, 0xFFCCCCCC);
 
@@ -2027,12 +6092,18 @@ out:
 	btn_wait();
 }
 
-int fix_attributes(char *path, u32 *total, u32 is_root, u32 check_first_run)
+#define FIX_ATTR_MAX_DEPTH 32
+
+/*
+* Clears the archive bit of everything under path. The walk is iterative, with one open directory
+* per level, and each bit is cleared in the entry just read. The dirty directory sectors are
+* written once, when the walk is done. Folders too deep or with too long a path are reported and
+* counted in skipped.
+*/
+int fix_attributes(char *path, u32 *total, u32 *scanned, u32 *skipped, u32 is_root, u32 check_first_run)
 {
 	FRESULT res;
-	DIR dir;
-	u32 dirLength = 0;
-	static FILINFO fno;
+	FILINFO fno;
 
 	if (check_first_run)
 	{
@@ -2049,50 +6120,80 @@ int fix_attributes(char *path, u32 *total, u32 is_root, u32 check_first_run)
 		}
 	}
 
+	DIR *dirs = (DIR *)malloc(sizeof(DIR) * FIX_ATTR_MAX_DEPTH);
+	u32 dirLength[FIX_ATTR_MAX_DEPTH];
+	int depth = 0;
+
 	// Open directory.
-	res = f_opendir(&dir, path);
+	res = f_opendir(&dirs[0], path);
 	if (res != FR_OK)
+	{
+		free(dirs);
 		return res;
+	}
+	dirLength[0] = strlen(path);
 
-	dirLength = strlen(path);
-	for (;;)
+	while (depth >= 0)
 	{
+		DIR *dir = &dirs[depth];
+
 		// Clear file or folder path.
-		path[dirLength] = 0;
+		path[dirLength[depth]] = 0;
 
 		// Read a directory item.
-		res = f_readdir(&dir, &fno);
+		res = f_readdir(dir, &fno);
 
-		// Break on error or end of dir.
+		// Leave the directory on error or end of dir.
 		if (res != FR_OK || fno.fname[0] == 0)
-			break;
+		{
+			if (!depth)
+				f_syncdir(dir);
+			f_closedir(dir);
+			depth--;
+			if (res != FR_OK)
+				break;
+			continue;
+		}
+		*scanned = *scanned + 1;
 
 		// Skip official Nintendo dir.
-		if (is_root && !strcmp(fno.fname, "Nintendo"))
+		if (is_root && !depth && !strcmp(fno.fname, "Nintendo"))
 			continue;
 
-		// Set new directory or file.
-		memcpy(&path[dirLength], "/", 1);
-		memcpy(&path[dirLength + 1], fno.fname, strlen(fno.fname) + 1);
-
 		// Check if archive bit is set.
 		if (fno.fattrib & AM_ARC)
 		{
 			*(u32 *)total = *(u32 *)total + 1;
-			f_chmod(path, 0, AM_ARC);
+			f_dirchmod(dir, 0, AM_ARC);
 		}
 
 		// Is it a directory?
-		if (fno.fattrib & AM_DIR)
+		u32 nameLength = strlen(fno.fname);
+		if (!(fno.fattrib & AM_DIR))
+			continue;
+		if (depth + 1 < FIX_ATTR_MAX_DEPTH && dirLength[depth] + 1 + nameLength < 255)
 		{
-			// Enter the directory.
-			res = fix_attributes(path, total, 0, 0);
-			if (res != FR_OK)
-				break;
+			// Set new directory and enter it.
+			path[dirLength[depth]] = '/';
+			memcpy(&path[dirLength[depth] + 1], fno.fname, nameLength + 1);
+			if (f_opendir(&dirs[depth + 1], path) == FR_OK)
+			{
+				dirLength[depth + 1] = dirLength[depth] + 1 + nameLength;
+				depth++;
+				continue;
+			}
+			path[dirLength[depth]] = 0;
 		}
+		*skipped = *skipped + 1;
+		WPRINTFARGS("Skipped %s/%s", path, fno.fname);
 	}
 
-	f_closedir(&dir);
+	// Unwind after an error, keeping the bits cleared so far.
+	if (depth >= 0)
+		f_syncdir(&dirs[0]);
+	while (depth >= 0)
+		f_closedir(&dirs[depth--]);
+	free(dirs);
 
 	return res;
 }
@@ -2122,8 +6223,19 @@ void fix_sd_attr(u32 type)
 		}
 
 		gfx_printf(&gfx_con, "Traversing all %s files!\nThis may take some time, please wait...\n\n", label);
-		fix_attributes(path, &total, !type, type);
-		gfx_printf(&gfx_con, "%kTotal archive bits cleared: %d!%k\n\nDone! Press any key...", 0xFF96FF00, total, 0xFFCCCCCC);
+		u32 scanned = 0;
+		u32 skipped = 0;
+		u32 timer = get_tmr_ms();
+		fix_attributes(path, &total, &scanned, &skipped, !type, type);
+		timer = get_tmr_ms() - timer;
+		DWORD hits, misses;
+		f_wincache_stats(&hits, &misses);
+		gfx_printf(&gfx_con, "%kTotal archive bits cleared: %d!%k\n", 0xFF96FF00, total, 0xFFCCCCCC);
+		if (skipped)
+			WPRINTFARGS("%d folders were skipped and may keep their archive bits.", skipped);
+		gfx_printf(&gfx_con, "Scanned %d files in %d ms (%d files/s).\n", scanned, timer,
+			(u32)((u64)scanned * 1000 / (timer ? timer : 1)));
+		gfx_printf(&gfx_con, "FAT/dir sector cache: %d hits, %d misses.\n\nDone! Press any key...", hits, misses);
 		sd_unmount();
 	}
 	btn_wait();
@@ -2132,55 +6244,55 @@ void fix_sd_attr(u32 type)
 void fix_sd_all_attr() { fix_sd_attr(0); }
 void fix_sd_switch_attr() { fix_sd_attr(1); }
 
-void print_fuel_gauge_info()
+void print_fuel_gauge_info(const u16 *regs)
 {
 	int value = 0;
 
 	gfx_printf(&gfx_con, "%kFuel Gauge IC Info:\n%k", 0xFF00DDFF, 0xFFCCCCCC);
 
-	max17050_get_property(MAX17050_Age, &value);
+	max17050_get_property_regs(regs, MAX17050_Age, &value);
 	gfx_printf(&gfx_con, "Age:                    %3d%\n", value);
 
-	max17050_get_property(MAX17050_RepSOC, &value);
+	max17050_get_property_regs(regs, MAX17050_RepSOC, &value);
 	gfx_printf(&gfx_con, "Capacity now:           %3d%\n", value >> 8);
 
-	max17050_get_property(MAX17050_RepCap, &value);
+	max17050_get_property_regs(regs, MAX17050_RepCap, &value);
 	gfx_printf(&gfx_con, "Capacity now:           %4d mAh\n", value);
 
-	max17050_get_property(MAX17050_FullCAP, &value);
+	max17050_get_property_regs(regs, MAX17050_FullCAP, &value);
 	gfx_printf(&gfx_con, "Capacity full:          %4d mAh\n", value);
 
-	max17050_get_property(MAX17050_DesignCap, &value);
+	max17050_get_property_regs(regs, MAX17050_DesignCap, &value);
 	gfx_printf(&gfx_con, "Capacity (design):      %4d mAh\n", value);
 
-	max17050_get_property(MAX17050_Current, &value);
+	max17050_get_property_regs(regs, MAX17050_Current, &value);
 	if (value >= 0)
 		gfx_printf(&gfx_con, "Current now:            %d mA\n", value / 1000);
 	else
 		gfx_printf(&gfx_con, "Current now:            -%d mA\n", ~value / 1000);
 
-	max17050_get_property(MAX17050_AvgCurrent, &value);
+	max17050_get_property_regs(regs, MAX17050_AvgCurrent, &value);
 	if (value >= 0)
 		gfx_printf(&gfx_con, "Current average:        %d mA\n", value / 1000);
 	else
 		gfx_printf(&gfx_con, "Current average:        -%d mA\n", ~value / 1000);
 
-	max17050_get_property(MAX17050_VCELL, &value);
+	max17050_get_property_regs(regs, MAX17050_VCELL, &value);
 	gfx_printf(&gfx_con, "Voltage now:            %4d mV\n", value);
 
-	max17050_get_property(MAX17050_OCVInternal, &value);
+	max17050_get_property_regs(regs, MAX17050_OCVInternal, &value);
 	gfx_printf(&gfx_con, "Voltage open-circuit:   %4d mV\n", value);
 
-	max17050_get_property(MAX17050_MinVolt, &value);
+	max17050_get_property_regs(regs, MAX17050_MinVolt, &value);
 	gfx_printf(&gfx_con, "Min voltage reached:    %4d mV\n", value);
 
-	max17050_get_property(MAX17050_MaxVolt, &value);
+	max17050_get_property_regs(regs, MAX17050_MaxVolt, &value);
 	gfx_printf(&gfx_con, "Max voltage reached:    %4d mV\n", value);
 
-	max17050_get_property(MAX17050_V_empty, &value);
+	max17050_get_property_regs(regs, MAX17050_V_empty, &value);
 	gfx_printf(&gfx_con, "Empty voltage (design): %4d mV\n", value);
 
-	max17050_get_property(MAX17050_TEMP, &value);
+	max17050_get_property_regs(regs, MAX17050_TEMP, &value);
 	if (value >= 0)
 		gfx_printf(&gfx_con, "Battery temperature:    %d.%d oC\n", value / 10, value % 10);
 	else
@@ -2190,25 +6302,32 @@ void print_fuel_gauge_info()
 void print_battery_charger_info()
 {
 	int value = 0;
+	u8 regs[BQ24193_NUM_REGS];
+
+	if (bq24193_read_regs(regs))
+	{
+		EPRINTF("\n\nFailed to read the battery charger IC.");
+		return;
+	}
 
 	gfx_printf(&gfx_con, "%k\n\nBattery Charger IC Info:\n%k", 0xFF00DDFF, 0xFFCCCCCC);
 
-	bq24193_get_property(BQ24193_InputVoltageLimit, &value);
+	bq24193_get_property_regs(regs, BQ24193_InputVoltageLimit, &value);
 	gfx_printf(&gfx_con, "Input voltage limit:       %4d mV\n", value);
 
-	bq24193_get_property(BQ24193_InputCurrentLimit, &value);
+	bq24193_get_property_regs(regs, BQ24193_InputCurrentLimit, &value);
 	gfx_printf(&gfx_con, "Input current limit:       %4d mA\n", value);
 
-	bq24193_get_property(BQ24193_SystemMinimumVoltage, &value);
+	bq24193_get_property_regs(regs, BQ24193_SystemMinimumVoltage, &value);
 	gfx_printf(&gfx_con, "Min voltage limit:         %4d mV\n", value);
 
-	bq24193_get_property(BQ24193_FastChargeCurrentLimit, &value);
+	bq24193_get_property_regs(regs, BQ24193_FastChargeCurrentLimit, &value);
 	gfx_printf(&gfx_con, "Fast charge current limit: %4d mA\n", value);
 
-	bq24193_get_property(BQ24193_ChargeVoltageLimit, &value);
+	bq24193_get_property_regs(regs, BQ24193_ChargeVoltageLimit, &value);
 	gfx_printf(&gfx_con, "Charge voltage limit:      %4d mV\n", value);
 
-	bq24193_get_property(BQ24193_ChargeStatus, &value);
+	bq24193_get_property_regs(regs, BQ24193_ChargeStatus, &value);
 	gfx_printf(&gfx_con, "Charge status:             ");
 	switch (value)
 	{
@@ -2228,7 +6347,7 @@ void print_battery_charger_info()
 		gfx_printf(&gfx_con, "Unknown (%d)\n", value);
 		break;
 	}
-	bq24193_get_property(BQ24193_TempStatus, &value);
+	bq24193_get_property_regs(regs, BQ24193_TempStatus, &value);
 	gfx_printf(&gfx_con, "Temperature status:        ");
 	switch (value)
 	{
@@ -2258,20 +6377,22 @@ void print_battery_info()
 	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
 	gfx_con_setpos(&gfx_con, 0, 0);
 
-	print_fuel_gauge_info();
+	// One burst for the whole register map, decoded and dumped below.
+	u8 *buf = (u8 *)calloc(MAX17050_NUM_REGS, 2);
+	if (max17050_read_regs((u16 *)buf, 0, MAX17050_NUM_REGS))
+	{
+		EPRINTF("Failed to read the fuel gauge IC.");
+		free(buf);
+		btn_wait();
+		return;
+	}
 
-	print_battery_charger_info();
+	print_fuel_gauge_info((const u16 *)buf);
 
-	u8 *buf = (u8 *)malloc(0x100 * 2);
+	print_battery_charger_info();
 
 	gfx_printf(&gfx_con, "%k\n\nBattery Fuel Gauge Registers:\n%k", 0xFF00DDFF, 0xFFCCCCCC);
 
-	for (int i = 0; i < 0x200; i += 2)
-	{
-		i2c_recv_buf_small(buf + i, 2, I2C_1, 0x36, i >> 1);
-		usleep(2500);
-	}
-
 	gfx_hexdump(&gfx_con, 0, (u8 *)buf, 0x200);
 
 	gfx_puts(&gfx_con, "\nPress POWER to dump them to SD Card.\nPress VOL to go to the menu.\n");
@@ -2296,6 +6417,182 @@ void print_battery_info()
 	free(buf);
 }
 
+#define STATLOG_VIEW_RECS 12
+
+void print_statlog()
+{
+	static const char *ops[] = { "backup", "restore" };
+	// Large enough for any record, older records are overwritten while reading.
+	static u32 recs[STATLOG_VIEW_RECS][sizeof(statlog_boot_t) / sizeof(u32)];
+
+	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+	gfx_con_setpos(&gfx_con, 0, 0);
+
+	// Mounting logs what is still pending.
+	if (!sd_mount())
+		goto out;
+
+	FIL fp;
+	if (f_open(&fp, STATLOG_LOG_PATH, FA_READ) != FR_OK)
+	{
+		EPRINTF("No " STATLOG_LOG_PATH " found.");
+		goto out;
+	}
+
+	u32 total = 0;
+	statlog_hdr_t hdr;
+	UINT br;
+	while (!f_read(&fp, &hdr, sizeof(hdr), &br) && br == sizeof(hdr))
+	{
+		if (hdr.size < sizeof(hdr) || hdr.size > sizeof(recs[0]) || (hdr.size & 3))
+			break;
+
+		u8 *rec = (u8 *)recs[total % STATLOG_VIEW_RECS];
+		memcpy(rec, &hdr, sizeof(hdr));
+		if (f_read(&fp, rec + sizeof(hdr), hdr.size - sizeof(hdr), &br) || br != hdr.size - sizeof(hdr))
+			break;
+		total++;
+	}
+	f_close(&fp);
+
+	gfx_con.fntsz = 8;
+	gfx_printf(&gfx_con, "%k%d records, last %d:%k\n\n", 0xFF00DDFF, total, MIN(total, STATLOG_VIEW_RECS), 0xFFCCCCCC);
+
+	for (u32 i = total > STATLOG_VIEW_RECS ? total - STATLOG_VIEW_RECS : 0; i < total; i++)
+	{
+		statlog_hdr_t *rec = (statlog_hdr_t *)recs[i % STATLOG_VIEW_RECS];
+		if (rec->type == STATLOG_REC_BOOT)
+		{
+			statlog_boot_t *boot = (statlog_boot_t *)rec;
+			gfx_printf(&gfx_con, "%k#%d boot%k kb %d, %s\n", 0xFF00DDFF, rec->seq, 0xFFCCCCCC, boot->kb, boot->ok ? "ok" : "FAILED");
+			gfx_printf(&gfx_con, " total %d ms, keygen %d ms, pkg2 %d KiB, kernel %d KiB\n",
+				boot->total_us / 1000, boot->keygen_us / 1000, boot->pkg2_size >> 10, boot->kernel_size >> 10);
+			gfx_printf(&gfx_con, " eMMC errors %d, retries %d\n stages (ms):", boot->emmc_errors, boot->emmc_retries);
+			for (u32 j = 0; j < boot->num_stages && j < BOOTPROF_MAX_STAGES; j++)
+				gfx_printf(&gfx_con, " %d", boot->stage_us[j] / 1000);
+			gfx_puts(&gfx_con, "\n\n");
+		}
+		else if (rec->type == STATLOG_REC_OP)
+		{
+			statlog_op_t *op = (statlog_op_t *)rec;
+			u32 rate = (u32)((u64)op->size_kb * 1000 / MAX(op->elapsed_ms, 1));
+			gfx_printf(&gfx_con, "%k#%d %s%k %s, %s\n", 0xFF00DDFF, rec->seq, op->op <= STATLOG_OP_RESTORE ? ops[op->op] : "?",
+				0xFFCCCCCC, op->name, op->ok ? "ok" : "FAILED");
+			gfx_printf(&gfx_con, " %d MiB in %d s, %d KiB/s, %d retries\n\n",
+				op->size_kb >> 10, op->elapsed_ms / 1000, rate, op->retries);
+		}
+	}
+	gfx_con.fntsz = 16;
+
+out:
+	sd_unmount();
+	btn_wait();
+}
+
+static u32 _heap_tracing = 0;
+
+static void _print_heap_stats(const char *name, const heap_stats_t *st)
+{
+	gfx_printf(&gfx_con, "%k%s (%08X):%k\n", 0xFF00DDFF, name, st->start, 0xFFCCCCCC);
+	gfx_printf(&gfx_con, " Used:         %d KiB (peak %d KiB)\n", st->used >> 10, st->peak >> 10);
+	gfx_printf(&gfx_con, " Top:          %d KiB\n", (st->top - st->start) >> 10);
+	gfx_printf(&gfx_con, " Allocations:  %d live, %d total\n", st->allocs, st->total_allocs);
+	gfx_printf(&gfx_con, " Free blocks:  %d, %d KiB, largest %d KiB\n", st->free_blocks, st->free_bytes >> 10, st->largest_free >> 10);
+	gfx_puts(&gfx_con, " Free by size:");
+	for (u32 i = 0; i < HEAP_NUM_BINS; i++)
+		if (st->bins[i])
+			gfx_printf(&gfx_con, " %X:%d", 1u << i, st->bins[i]);
+	gfx_puts(&gfx_con, "\n\n");
+}
+
+static void _save_heap_stats(FIL *fp, const char *name, const heap_stats_t *st)
+{
+	f_printf(fp, "[%s]\nstart=%08X\ntop=%u\nused=%u\npeak=%u\nallocs=%u\ntotal_allocs=%u\n",
+		name, st->start, st->top - st->start, st->used, st->peak, st->allocs, st->total_allocs);
+	f_printf(fp, "free_blocks=%u\nfree_bytes=%u\nlargest_free=%u\n", st->free_blocks, st->free_bytes, st->largest_free);
+	for (u32 i = 0; i < HEAP_NUM_BINS; i++)
+		if (st->bins[i])
+			f_printf(fp, "bin_%X=%u\n", 1u << i, st->bins[i]);
+	f_puts("\n", fp);
+}
+
+void print_heap_info()
+{
+	heap_stats_t st[2];
+
+	while (1)
+	{
+		gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
+		gfx_con_setpos(&gfx_con, 0, 0);
+
+		heap_get_stats(&st[0], 0);
+		heap_get_stats(&st[1], 1);
+		_print_heap_stats("Main heap", &st[0]);
+		_print_heap_stats("DMA heap", &st[1]);
+
+		u32 spanStart = 0;
+		u32 span = memmap_largest_free(&spanStart);
+		gfx_printf(&gfx_con, "%kLargest free DRAM span:%k %d MiB @ %08X\n\n", 0xFF00DDFF, 0xFFCCCCCC, span >> 20, spanStart);
+
+		gfx_printf(&gfx_con, "%kAllocation trace: %s%k\n\n", 0xFF00DDFF, _heap_tracing ? "ON" : "OFF", 0xFFCCCCCC);
+		gfx_puts(&gfx_con, "Press POWER to dump the stats and trace to SD Card.\n");
+		gfx_puts(&gfx_con, "Press VOL+ to toggle the trace.\nPress VOL- to go to the menu.\n");
+
+		u32 btn = btn_wait();
+		if (btn & BTN_VOL_UP)
+		{
+			_heap_tracing = !_heap_tracing;
+			if (_heap_tracing)
+				heap_trace_start();
+			else
+				heap_trace_stop();
+			continue;
+		}
+		if (!(btn & BTN_POWER))
+			break;
+
+		if (sd_mount())
+		{
+			char path[64];
+			FIL fp;
+			emmcsn_path_impl(path, "/Dumps", "heap_stats.txt", NULL);
+			if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK)
+			{
+				_save_heap_stats(&fp, "heap", &st[0]);
+				_save_heap_stats(&fp, "dma_heap", &st[1]);
+
+				f_puts("[memmap]\n", &fp);
+				const memmap_region_t *region;
+				for (u32 i = 0; (region = memmap_get(i)) != NULL; i++)
+					f_printf(&fp, "%s=%08X-%08X\n", region->name, region->start, region->end);
+				f_puts("\n", &fp);
+
+				// Oldest record first. Tags resolve to call sites through the linker map.
+				heap_trace_t *trace = (heap_trace_t *)malloc(HEAP_TRACE_ENTRIES * sizeof(heap_trace_t));
+				u32 cnt = heap_trace_get(trace, HEAP_TRACE_ENTRIES);
+				f_puts("[trace]\n", &fp);
+				for (u32 i = 0; i < cnt; i++)
+				{
+					if (trace[i].size)
+						f_printf(&fp, "alloc %08X %u %08X\n", trace[i].addr, trace[i].size, trace[i].tag);
+					else
+						f_printf(&fp, "free  %08X %08X\n", trace[i].addr, trace[i].tag);
+				}
+				free(trace);
+
+				f_close(&fp);
+				gfx_puts(&gfx_con, "\nDone!\n");
+			}
+			else
+				EPRINTFARGS("Error creating %s.", path);
+			sd_unmount();
+		}
+
+		btn_wait();
+		break;
+	}
+}
+
 /* void fix_fuel_gauge_configuration()
 {
 	gfx_clear_partial_grey(&gfx_ctxt, 0x1B, 0, 1256);
@@ -2463,6 +6760,7 @@ ment_t ment_options[] = {
 	MDEF_HANDLER("Auto boot", config_autoboot),
 	MDEF_HANDLER("Boot time delay", config_bootdelay),
 	MDEF_HANDLER("Custom boot logo", config_customlogo),
+	MDEF_HANDLER("Fast boot", config_fastboot),
 	MDEF_END()
 };
 
@@ -2482,9 +6780,12 @@ ment_t ment_cinfo[] = {
 	MDEF_CAPTION("-- Storage Info --", 0xFF0AB9E6),
 	MDEF_HANDLER("Print eMMC info", print_mmc_info),
 	MDEF_HANDLER("Print SD Card info", print_sdcard_info),
+	MDEF_HANDLER("Print SDMMC statistics", print_sdmmc_stats),
 	MDEF_CHGLINE(),
 	MDEF_CAPTION("------ Misc ------", 0xFF0AB9E6),
 	MDEF_HANDLER("Print battery info", print_battery_info),
+	MDEF_HANDLER("Print heap info", print_heap_info),
+	MDEF_HANDLER("Print stats log", print_statlog),
 	MDEF_END()
 };
 menu_t menu_cinfo = {
@@ -2523,6 +6824,12 @@ ment_t ment_restore[] = {
 	MDEF_CHGLINE(),
 	MDEF_CAPTION("-- GPP Partitions --", 0xFF0AB9E6),
 	MDEF_HANDLER("Restore GPP partitions", restore_emmc_gpp_parts),
+	MDEF_CHGLINE(),
+	MDEF_CAPTION("--- Differential ---", 0xFF0AB9E6),
+	MDEF_HANDLER("Restore eMMC RAW GPP changes", restore_emmc_rawnand_diff),
+	MDEF_HANDLER("Restore GPP partition changes", restore_emmc_gpp_parts_diff),
+	MDEF_CHGLINE(),
+	MDEF_HANDLER("Restore eMMC over USB", restore_emmc_usb),
 	MDEF_END()
 };
 
@@ -2537,10 +6844,23 @@ ment_t ment_backup[] = {
 	MDEF_CAPTION("------ Full --------", 0xFF0AB9E6),
 	MDEF_HANDLER("Backup eMMC BOOT0/1", dump_emmc_boot),
 	MDEF_HANDLER("Backup eMMC RAW GPP", dump_emmc_rawnand),
+	MDEF_HANDLER("Backup eMMC BOOT0/1 + RAW GPP", dump_emmc_full),
 	MDEF_CHGLINE(),
 	MDEF_CAPTION("-- GPP Partitions --", 0xFF0AB9E6),
 	MDEF_HANDLER("Backup eMMC SYS", dump_emmc_system),
 	MDEF_HANDLER("Backup eMMC USER", dump_emmc_user),
+	MDEF_CHGLINE(),
+	MDEF_CAPTION("--- Incremental ----", 0xFF0AB9E6),
+	MDEF_HANDLER("Backup eMMC RAW GPP changes", dump_emmc_rawnand_incr),
+	MDEF_HANDLER("Backup eMMC SYS changes", dump_emmc_system_incr),
+	MDEF_HANDLER("Backup eMMC USER changes", dump_emmc_user_incr),
+	MDEF_CHGLINE(),
+	MDEF_HANDLER("Backup eMMC SYS decrypted", dump_emmc_system_dec),
+	MDEF_HANDLER("Backup eMMC USER decrypted", dump_emmc_user_dec),
+	MDEF_HANDLER("Copy files from eMMC partitions", dump_emmc_files),
+	MDEF_HANDLER("Backup eMMC over USB", dump_emmc_usb),
+	MDEF_CHGLINE(),
+	MDEF_HANDLER("Verify backups on SD only", verify_sd_backup),
 	MDEF_END()
 };
 
@@ -2556,9 +6876,17 @@ ment_t ment_tools[] = {
 	MDEF_MENU("Backup", &menu_backup),
 	MDEF_MENU("Restore", &menu_restore),
 	MDEF_HANDLER("Verification options", config_verification),
+	MDEF_HANDLER("Backup format options", config_backup_format),
+	MDEF_HANDLER("Restore write mode", config_restore_cache),
 	MDEF_CHGLINE(),
 	MDEF_CAPTION("-------- Misc --------", 0xFF0AB9E6),
 	MDEF_HANDLER("Dump package1/2", dump_packages12),
+	MDEF_HANDLER("Benchmark eMMC", bench_emmc),
+	MDEF_HANDLER("Benchmark SD Card", bench_sd),
+	MDEF_HANDLER("Benchmark KIP1 decompression", bench_blz),
+	MDEF_HANDLER("Benchmark memory routines", bench_memops),
+	MDEF_HANDLER("Benchmark core primitives", bench_core),
+	MDEF_HANDLER("Benchmark and test DRAM", bench_dram),
 	MDEF_HANDLER("Fix battery de-sync", fix_battery_desync),
 	MDEF_HANDLER("Unset archive bit (switch folder)", fix_sd_switch_attr),
 	MDEF_HANDLER("Unset archive bit (all sd files)", fix_sd_all_attr),
@@ -2584,6 +6912,7 @@ ment_t ment_top[] = {
 	MDEF_CAPTION("---------------", 0xFF444444),
 	MDEF_HANDLER("Reboot (Normal)", reboot_normal),
 	MDEF_HANDLER("Reboot (RCM)", reboot_rcm),
+	MDEF_HANDLER("Relaunch payload.bin", relaunch_payload),
 	MDEF_HANDLER("Power off", power_off),
 	MDEF_CAPTION("---------------", 0xFF444444),
 	MDEF_HANDLER("About", about),
@@ -2601,23 +6930,26 @@ void ipl_main()
 	config_hw();
 
 	//Pivot the stack so we have enough space.
-	pivot_stack(0x90010000);
-
-	//Tegra/Horizon configuration goes to 0x80000000+, package2 goes to 0xA9800000, we place our heap in between.
-	heap_init(0x90020000);
+	pivot_stack(MEM_STACK_TOP);
+
+	//Tegra/Horizon configuration goes to 0x80000000+, package2 goes to 0xA9800000, we place our heaps in between.
+	memmap_init();
+	heap_init(MEM_HEAP_START);
+	//Buffers for the SDMMC/SE/TSEC engines get their own arena so they never share cache lines with CPU data.
+	dma_heap_init(DMA_HEAP_START);
+	//Code in IRAM and everything in DRAM below the CCPLEX mailbox goes through the BPMP cache from now on.
+	bpmp_cache_enable();
+	trace_init();
+	trace_event("ipl start", get_tmr_us(), 0);
 
 	//uart_send(UART_C, (u8 *)0x40000000, 0x10000);
 	//uart_wait_idle(UART_C, UART_TX_IDLE);
 
-	display_init();
+	// Display is brought up by auto_launch_firmware, overlapped with the SD card init.
+	// The framebuffer address is fixed, so drawing before bring-up is harmless.
 	//display_color_screen(0xAABBCCDD);
-	u32 *fb = display_init_framebuffer();
-	gfx_init_ctxt(&gfx_ctxt, fb, 720, 1280, 768);
-
-#ifdef MENU_LOGO_ENABLE
-	Kc_MENU_LOGO = (u8 *)malloc(0x6000);
-	blz_uncompress_srcdest(Kc_MENU_LOGO_blz, SZ_MENU_LOGO_BLZ, Kc_MENU_LOGO, SZ_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
+	gfx_init_ctxt(&gfx_ctxt, (u32 *)DISPLAY_FB_ADDR, 720, 1280, 768);
+	gfx_init_back_buffer(&gfx_ctxt, (u32 *)DISPLAY_FB_BACK_ADDR);
 
 	gfx_con_init(&gfx_con, &gfx_ctxt);
 
@@ -2627,6 +6959,12 @@ void ipl_main()
 	// Load saved configuration and auto boot if enabled.
 	auto_launch_firmware();
 
+	// Work the menu would otherwise do on "Launch", done while it waits for input.
+	idle_add("idle sensors", _idle_sensors, SENSORS_MAX_AGE_MS);
+	idle_add("idle ini", _idle_ini, 0);
+	idle_add("idle pkg1", pkg1_cache_prefetch, 0);
+	idle_add("idle gpt", _idle_gpt, 0);
+
 	while (1)
 		tui_do_menu(&gfx_con, &menu_top);
 
@@ -43,73 +43,43 @@
 
 #define MAX17050_VMAX_TOLERANCE 50 /* 50 mV */
 
-int max17050_get_property(enum MAX17050_reg reg, int *value)
+static int _max17050_decode(enum MAX17050_reg reg, u16 data, int *value)
 {
-	u16 data;
-
 	switch (reg)
 	{
 	case MAX17050_Age: // Age (percent). Based on 100% x (FullCAP Register/DesignCap).
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_Age);
 		*value = data >> 8; /* Show MSB. 1% increments */
 		break;
 	case MAX17050_Cycles: // Cycle count.
-		i2c_recv_buf_small((u8 *)value, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_Cycles);
+	case MAX17050_RepSOC: // Capacity %.
+		*value = data;
 		break;
 	case MAX17050_MinVolt: // Voltage max/min
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_MinMaxVolt);
 		*value = (data & 0xff) * 20; /* Voltage MIN. Units of 20mV */
 		break;
 	case MAX17050_MaxVolt: // Voltage max/min
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_MinMaxVolt);
 		*value = (data >> 8) * 20; /* Voltage MAX. Units of LSB = 20mV */
 		break;
 	case MAX17050_V_empty: // Voltage min design.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_V_empty);
 		*value = (data >> 7) * 10; /* Units of LSB = 10mV */
 		break;
 	case MAX17050_VCELL: // Voltage now.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_VCELL);
-		*value = data * 625 / 8 / 1000;
-		break;
 	case MAX17050_AvgVCELL: // Voltage avg.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_AvgVCELL);
-		*value = data * 625 / 8 / 1000;
-		break;
 	case MAX17050_OCVInternal: // Voltage ocv.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_OCVInternal);
 		*value = data * 625 / 8 / 1000;
 		break;
-	case MAX17050_RepSOC: // Capacity %.
-		i2c_recv_buf_small((u8 *)value, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_RepSOC);
-		break;
 	case MAX17050_DesignCap: // Charge full design.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_DesignCap);
-		data = data * 5 / 10;
-		*value = data;
-		break;
 	case MAX17050_FullCAP: // Charge full.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_FullCAP);
-		data = data * 5 / 10;
-		*value = data;
-		break;
 	case MAX17050_RepCap: // Charge now.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_RepCap);
 		data = data * 5 / 10;
 		*value = data;
 		break;
 	case MAX17050_TEMP: // Temp.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_TEMP);
 		*value = (s16)data;
 		*value = *value * 10 / 256;
 		break;
 	case MAX17050_Current: // Current now.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_Current);
-		*value = (s16)data;
-		*value *= 1562500 / MAX17050_DEFAULT_SNS_RESISTOR;
-		break;
 	case MAX17050_AvgCurrent: // Current avg.
-		i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, MAX17050_AvgCurrent);
 		*value = (s16)data;
 		*value *= 1562500 / MAX17050_DEFAULT_SNS_RESISTOR;
 		break;
@@ -119,6 +89,41 @@ int max17050_get_property(enum MAX17050_reg reg, int *value)
 	return 0;
 }
 
+static u32 _max17050_prop_reg(enum MAX17050_reg reg)
+{
+	// Min/max voltage are custom IDs packed in one register.
+	if (reg == MAX17050_MinVolt || reg == MAX17050_MaxVolt)
+		return MAX17050_MinMaxVolt;
+	return reg;
+}
+
+int max17050_get_property(enum MAX17050_reg reg, int *value)
+{
+	u16 data;
+
+	if (!i2c_recv_buf_small((u8 *)&data, 2, I2C_1, MAXIM17050_I2C_ADDR, _max17050_prop_reg(reg)))
+		return -1;
+
+	return _max17050_decode(reg, data, value);
+}
+
+int max17050_read_regs(u16 *regs, u32 start, u32 count)
+{
+	if (!count || start + count > MAX17050_NUM_REGS)
+		return -1;
+
+	// The gauge auto-increments, registers go out LSB first.
+	if (!i2c_recv_buf((u8 *)(regs + start), count * 2, I2C_1, MAXIM17050_I2C_ADDR, start))
+		return -1;
+
+	return 0;
+}
+
+int max17050_get_property_regs(const u16 *regs, enum MAX17050_reg reg, int *value)
+{
+	return _max17050_decode(reg, regs[_max17050_prop_reg(reg)], value);
+}
+
 static int _max17050_write_verify_reg(u8 reg, u16 value)
 {
 	int retries = 8;
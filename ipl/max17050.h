@@ -24,6 +24,8 @@
 #ifndef __MAX17050_H_
 #define __MAX17050_H_
 
+#include "types.h"
+
 #define MAX17050_STATUS_BattAbsent    (1 << 3)
 #define MAX17050_DEFAULT_SNS_RESISTOR 10000
 
@@ -34,6 +36,8 @@
 
 #define MAXIM17050_I2C_ADDR 0x36
 
+#define MAX17050_NUM_REGS 0x100
+
 enum MAX17050_reg {
 	MAX17050_STATUS		= 0x00,
 	MAX17050_VALRT_Th	= 0x01,
@@ -122,6 +126,12 @@ enum MAX17050_reg {
 };
 
 int max17050_get_property(enum MAX17050_reg reg, int *value);
+/*
+ * Burst read registers [start, start + count) into regs, which is indexed
+ * by register. A full snapshot is MAX17050_NUM_REGS words in one transfer.
+ */
+int max17050_read_regs(u16 *regs, u32 start, u32 count);
+int max17050_get_property_regs(const u16 *regs, enum MAX17050_reg reg, int *value);
 int max17050_fix_configuration();
 
 #endif /* __MAX17050_H_ */
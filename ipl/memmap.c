@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+
+#include "memmap.h"
+#include "ccplex.h"
+
+static memmap_region_t _regions[MEMMAP_MAX_REGIONS];
+static u32 _num_regions = 0;
+
+// Regions are kept sorted by start, so gaps are found in one walk.
+static int _memmap_insert(const char *name, u32 start, u32 end, u32 fixed)
+{
+	if (end < start || _num_regions >= MEMMAP_MAX_REGIONS)
+		return 0;
+
+	u32 idx = 0;
+	while (idx < _num_regions && _regions[idx].start <= start)
+		idx++;
+
+	// Must not touch the neighbors.
+	if ((idx && _regions[idx - 1].end >= start) || (idx < _num_regions && _regions[idx].start <= end))
+		return 0;
+
+	memmove(&_regions[idx + 1], &_regions[idx], (_num_regions - idx) * sizeof(memmap_region_t));
+	_regions[idx].name = name;
+	_regions[idx].start = start;
+	_regions[idx].end = end;
+	_regions[idx].fixed = fixed;
+	_num_regions++;
+
+	return 1;
+}
+
+void memmap_init()
+{
+	_num_regions = 0;
+
+	_memmap_insert("hos",      MEM_HOS_START,      MEM_STACK_BOTTOM - 1,   1);
+	_memmap_insert("stack",    MEM_STACK_BOTTOM,   MEM_STACK_TOP - 1,      1);
+	_memmap_insert("records",  MEM_RECORDS_START,  MEM_HEAP_START - 1,     1);
+	_memmap_insert("heap",     MEM_HEAP_START,     MEM_DMA_HEAP_START - 1, 1);
+	_memmap_insert("dma heap", MEM_DMA_HEAP_START, MEM_LAUNCH_START - 1,   1);
+	_memmap_insert("launch",   MEM_LAUNCH_START,   MEM_PKG2_START - 1,     1);
+	_memmap_insert("pkg2",     MEM_PKG2_START,     MEM_PKG2_END - 1,       1);
+	_memmap_insert("display",  MEM_DISPLAY_START,  MEM_CCPLEX_START - 1,   1);
+	_memmap_insert("ccplex",   MEM_CCPLEX_START,   MEM_CCPLEX_START + sizeof(ccplex_mbox_t) - 1, 1);
+	_memmap_insert("bct",      MEM_BCT_ADDR,       MEM_BCT_ADDR + MEM_BCT_SIZE - 1, 1);
+}
+
+int memmap_reserve(const char *name, u32 start, u32 size)
+{
+	if (!size || start + size - 1 < start)
+		return 0;
+
+	return _memmap_insert(name, start, start + size - 1, 0);
+}
+
+// Free span of [MEM_DRAM_START, MEM_CARVE_END) right before region idx, or after the last one.
+static u32 _memmap_gap(u32 idx, u32 *start)
+{
+	u32 pos = MEM_DRAM_START;
+	if (idx && _regions[idx - 1].end >= MEM_CARVE_END - 1)
+		return 0;
+	if (idx && _regions[idx - 1].end >= MEM_DRAM_START)
+		pos = _regions[idx - 1].end + 1;
+
+	u32 next = (idx < _num_regions) ? MIN(_regions[idx].start, MEM_CARVE_END) : MEM_CARVE_END;
+	*start = pos;
+
+	return (next > pos) ? next - pos : 0;
+}
+
+void *memmap_alloc(const char *name, u32 size, u32 align)
+{
+	u32 start;
+
+	if (!size || !align || (align & (align - 1)))
+		return NULL;
+
+	for (u32 i = 0; i <= _num_regions; i++)
+	{
+		u32 gap = _memmap_gap(i, &start);
+		u32 base = ALIGN(start, align);
+		if (gap && base >= start && base - start < gap && gap - (base - start) >= size)
+			return _memmap_insert(name, base, base + size - 1, 0) ? (void *)base : NULL;
+	}
+
+	return NULL;
+}
+
+void memmap_free(void *buf)
+{
+	for (u32 i = 0; i < _num_regions; i++)
+	{
+		if (_regions[i].start == (u32)buf && !_regions[i].fixed)
+		{
+			_num_regions--;
+			memmove(&_regions[i], &_regions[i + 1], (_num_regions - i) * sizeof(memmap_region_t));
+			return;
+		}
+	}
+}
+
+u32 memmap_largest_free(u32 *start)
+{
+	u32 gapStart;
+	u32 largest = 0;
+
+	for (u32 i = 0; i <= _num_regions; i++)
+	{
+		u32 gap = _memmap_gap(i, &gapStart);
+		if (gap > largest)
+		{
+			largest = gap;
+			if (start)
+				*start = gapStart;
+		}
+	}
+
+	return largest;
+}
+
+const memmap_region_t *memmap_find(const void *buf, u32 size)
+{
+	u32 start = (u32)buf;
+	u32 end = start + (size ? size - 1 : 0);
+
+	for (u32 i = 0; i < _num_regions && _regions[i].start <= start; i++)
+		if (end >= start && _regions[i].end >= end)
+			return &_regions[i];
+
+	return NULL;
+}
+
+const memmap_region_t *memmap_get(u32 idx)
+{
+	return idx < _num_regions ? &_regions[idx] : NULL;
+}
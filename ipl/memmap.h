@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _MEMMAP_H_
+#define _MEMMAP_H_
+
+#include "types.h"
+
+/*
+ * Physical memory layout. Horizon's configuration goes to 0x80000000+,
+ * package2 to 0xA9800000, our stack, records and heaps sit in between.
+ */
+#define MEM_DRAM_START     0x80000000
+#define MEM_HOS_START      0x80000000
+#define MEM_STACK_BOTTOM   0x90000000
+#define MEM_STACK_TOP      0x90010000 // Pivoted stack grows down from here.
+#define MEM_RECORDS_START  0x90010000 // Trace ring, console log, warm state, stats log and boot profile.
+#define MEM_HEAP_START     0x90020000
+#define MEM_DMA_HEAP_START 0x98000000
+#define MEM_LAUNCH_START   0xA0000000
+#define MEM_PKG2_START     0xA9800000
+#define MEM_PKG2_END       0xB0000000 // Package2 is built up to here.
+#define MEM_DISPLAY_START  0xC0000000 // Framebuffers and logo.
+#define MEM_CCPLEX_START   0xC8000000 // CCPLEX mailbox. Uncached for the BPMP from here up.
+/*! Carved buffers stay cached for the BPMP and usable by CCPLEX jobs. */
+#define MEM_CARVE_END      MEM_DISPLAY_START
+
+/*! IRAM copy of the BCT, read by the secure monitor on launch. */
+#define MEM_BCT_ADDR       0x4003D000
+#define MEM_BCT_SIZE       0x3000
+
+#define MEMMAP_MAX_REGIONS 24
+
+typedef struct _memmap_region_t
+{
+	const char *name;
+	u32 start;
+	u32 end;   // Last byte, so a region can reach the top of the address space.
+	u32 fixed; // Part of the layout above, never released.
+} memmap_region_t;
+
+/*! Registers the fixed layout. Needs no heap, so it runs before everything else. */
+void memmap_init();
+/*! Reserves [start, start + size). Returns 0 if it overlaps another region or wraps. */
+int memmap_reserve(const char *name, u32 start, u32 size);
+/*! Carves a free DRAM span below MEM_CARVE_END, aligned to align (power of 2). NULL if none fits. */
+void *memmap_alloc(const char *name, u32 size, u32 align);
+/*! Releases a carved or reserved span by its start. Fixed regions stay. */
+void memmap_free(void *buf);
+/*! Size of the largest free span below MEM_CARVE_END and its start, if start is not NULL. */
+u32 memmap_largest_free(u32 *start);
+/*! Returns the region holding all of [buf, buf + size), or NULL if the range crosses regions. */
+const memmap_region_t *memmap_find(const void *buf, u32 size);
+/*! Region by index, in address order. NULL past the last one. */
+const memmap_region_t *memmap_get(u32 idx);
+
+#endif
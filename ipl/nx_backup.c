@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "nx_backup.h"
+#include "heap.h"
+#include "lz.h"
+
+#define ALIGN_SECTOR(x) (((x) + 511) & ~511)
+
+u32 nx_bak_hdr_size(u32 chunk_sectors, u32 total_sectors)
+{
+	u32 num_chunks = (total_sectors + chunk_sectors - 1) / chunk_sectors;
+
+	return ALIGN_SECTOR(sizeof(nx_bak_hdr_t) + num_chunks * sizeof(u32));
+}
+
+void nx_bak_hdr_init(nx_bak_hdr_t *hdr, u32 format, u32 chunk_sectors, u32 total_sectors)
+{
+	u32 hdr_size = nx_bak_hdr_size(chunk_sectors, total_sectors);
+
+	memset(hdr, 0, hdr_size);
+	hdr->magic = NX_BAK_MAGIC;
+	hdr->format = format;
+	hdr->hdr_size = hdr_size;
+	hdr->chunk_sectors = chunk_sectors;
+	hdr->total_sectors = total_sectors;
+	hdr->num_chunks = (total_sectors + chunk_sectors - 1) / chunk_sectors;
+}
+
+// Returns NULL if the file is not a backup container.
+nx_bak_hdr_t *nx_bak_hdr_read(FIL *fp)
+{
+	nx_bak_hdr_t tmp;
+
+	f_lseek(fp, 0);
+	if (f_read(fp, &tmp, sizeof(nx_bak_hdr_t), NULL) || tmp.magic != NX_BAK_MAGIC ||
+		!tmp.chunk_sectors || tmp.hdr_size > NX_BAK_HDR_MAX ||
+		tmp.num_chunks > (NX_BAK_HDR_MAX - sizeof(nx_bak_hdr_t)) / sizeof(u32) ||
+		tmp.num_chunks != (tmp.total_sectors + tmp.chunk_sectors - 1) / tmp.chunk_sectors ||
+		tmp.hdr_size < sizeof(nx_bak_hdr_t) + tmp.num_chunks * sizeof(u32))
+	{
+		f_lseek(fp, 0);
+		return NULL;
+	}
+
+	nx_bak_hdr_t *hdr = (nx_bak_hdr_t *)malloc(tmp.hdr_size);
+	f_lseek(fp, 0);
+	if (f_read(fp, hdr, tmp.hdr_size, NULL))
+	{
+		free(hdr);
+		f_lseek(fp, 0);
+		return NULL;
+	}
+
+	return hdr;
+}
+
+// Writes the header at the start of the file and seeks back to where it was.
+int nx_bak_hdr_write(FIL *fp, nx_bak_hdr_t *hdr)
+{
+	FSIZE_t pos = f_tell(fp);
+	int res;
+
+	f_lseek(fp, 0);
+	res = f_write(fp, hdr, hdr->hdr_size, NULL);
+	if (pos > hdr->hdr_size)
+		f_lseek(fp, pos);
+
+	return !res;
+}
+
+// Size of the work buffer chunk reads/writes need. Only compressed formats use one.
+u32 nx_bak_work_size(u32 format, u32 chunk_sectors)
+{
+	if (format != NX_BAK_FMT_LZ)
+		return 0;
+
+	return ALIGN_SECTOR(LZ_COMPRESS_BOUND(chunk_sectors << 9)) + LZ_WORK_SIZE;
+}
+
+int nx_bak_is_zero(const void *buf, u32 size)
+{
+	const u32 *buf32 = (const u32 *)buf;
+
+	for (u32 i = 0; i < (size >> 2); i++)
+		if (buf32[i])
+			return 0;
+
+	return 1;
+}
+
+// Chunks must be written in order. work is nx_bak_work_size() bytes. Returns the FatFs result.
+int nx_bak_chunk_write(FIL *fp, nx_bak_hdr_t *hdr, u32 idx, const void *buf, u32 size, void *work)
+{
+	if (idx >= hdr->num_chunks)
+		return FR_INVALID_PARAMETER;
+
+	if (hdr->format == NX_BAK_FMT_SPARSE && nx_bak_is_zero(buf, size))
+	{
+		hdr->chunk_size[idx] = 0;
+		return FR_OK;
+	}
+
+	if (hdr->format == NX_BAK_FMT_LZ)
+	{
+		u8 *out = (u8 *)work;
+		u32 comp_size = LZ_CompressFast((const u8 *)buf, out, size,
+			(u32 *)(out + ALIGN_SECTOR(LZ_COMPRESS_BOUND(hdr->chunk_sectors << 9))));
+
+		// Store it compressed only if it saves at least a sector.
+		if (ALIGN_SECTOR(comp_size) < size)
+		{
+			memset(out + comp_size, 0, ALIGN_SECTOR(comp_size) - comp_size);
+			hdr->chunk_size[idx] = comp_size;
+			return f_write(fp, out, ALIGN_SECTOR(comp_size), NULL);
+		}
+	}
+
+	hdr->chunk_size[idx] = size;
+	return f_write(fp, buf, ALIGN_SECTOR(size), NULL);
+}
+
+// Chunks must be read in order. Returns 0 on error, 1 on data and 2 on a zero chunk.
+int nx_bak_chunk_read(FIL *fp, nx_bak_hdr_t *hdr, u32 idx, void *buf, void *work)
+{
+	if (idx >= hdr->num_chunks)
+		return 0;
+
+	u32 size = MIN(hdr->chunk_sectors, hdr->total_sectors - idx * hdr->chunk_sectors) << 9;
+	u32 stored = hdr->chunk_size[idx];
+
+	if (!stored)
+	{
+		memset(buf, 0, size);
+		return 2;
+	}
+
+	if (stored > size)
+		return 0;
+
+	if (stored < size)
+	{
+		if (hdr->format != NX_BAK_FMT_LZ || f_read(fp, work, ALIGN_SECTOR(stored), NULL))
+			return 0;
+		LZ_Uncompress((const u8 *)work, (u8 *)buf, stored);
+	}
+	else if (f_read(fp, buf, ALIGN_SECTOR(stored), NULL))
+		return 0;
+
+	return 1;
+}
+
+u32 nx_delta_hdr_size(u32 chunk_sectors, u32 total_sectors)
+{
+	u32 num_chunks = (total_sectors + chunk_sectors - 1) / chunk_sectors;
+
+	return ALIGN_SECTOR(sizeof(nx_delta_hdr_t) + num_chunks * sizeof(u32));
+}
+
+void nx_delta_hdr_init(nx_delta_hdr_t *hdr, u32 chunk_sectors, u32 total_sectors)
+{
+	u32 hdr_size = nx_delta_hdr_size(chunk_sectors, total_sectors);
+
+	memset(hdr, 0, hdr_size);
+	hdr->magic = NX_DELTA_MAGIC;
+	hdr->hdr_size = hdr_size;
+	hdr->chunk_sectors = chunk_sectors;
+	hdr->total_sectors = total_sectors;
+}
+
+// Returns NULL if the file is not a delta.
+nx_delta_hdr_t *nx_delta_hdr_read(FIL *fp)
+{
+	nx_delta_hdr_t tmp;
+
+	f_lseek(fp, 0);
+	if (f_read(fp, &tmp, sizeof(nx_delta_hdr_t), NULL) || tmp.magic != NX_DELTA_MAGIC || !tmp.chunk_sectors ||
+		tmp.hdr_size > NX_BAK_HDR_MAX || tmp.hdr_size != nx_delta_hdr_size(tmp.chunk_sectors, tmp.total_sectors))
+		return NULL;
+
+	nx_delta_hdr_t *hdr = (nx_delta_hdr_t *)malloc(tmp.hdr_size);
+	f_lseek(fp, 0);
+	if (f_read(fp, hdr, tmp.hdr_size, NULL))
+	{
+		free(hdr);
+		return NULL;
+	}
+
+	return hdr;
+}
+
+/*
+* Chunks must be asked for in order, pos tracks the next changed chunk.
+* Returns 0 if the chunk is unchanged, 1 if it was read and -1 on error.
+*/
+int nx_delta_chunk_read(FIL *fp, nx_delta_hdr_t *hdr, u32 *pos, u32 idx, void *buf)
+{
+	if (*pos >= hdr->num_changed || hdr->chunk_idx[*pos] != idx)
+		return 0;
+
+	u32 size = MIN(hdr->chunk_sectors, hdr->total_sectors - idx * hdr->chunk_sectors) << 9;
+
+	if (f_lseek(fp, hdr->hdr_size + (u64)*pos * (hdr->chunk_sectors << 9)) || f_read(fp, buf, size, NULL))
+		return -1;
+	(*pos)++;
+
+	return 1;
+}
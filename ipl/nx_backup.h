@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NX_BACKUP_H_
+#define _NX_BACKUP_H_
+
+#include "types.h"
+#include "ff.h"
+
+#define NX_BAK_MAGIC   0x4B42584E // "NXBK"
+#define NX_DELTA_MAGIC 0x4C44584E // "NXDL"
+
+// Largest header read from a file. Covers a 128GB partition in 256KB chunks.
+#define NX_BAK_HDR_MAX 0x200000
+
+#define NX_BAK_FMT_RAW    0
+#define NX_BAK_FMT_SPARSE 1
+#define NX_BAK_FMT_LZ     2
+
+/*
+* Chunked backup container. The header and chunk table are followed by the stored chunks.
+* A chunk with size 0 is all zeroes and takes no space. Stored chunks are padded to 512 bytes.
+* In LZ format, a chunk stored with a size smaller than the chunk is LZ77 compressed.
+*/
+typedef struct _nx_bak_hdr_t
+{
+	u32 magic;
+	u32 format;
+	u32 hdr_size;      // Header and chunk table, in bytes. Sector aligned.
+	u32 chunk_sectors;
+	u32 total_sectors;
+	u32 num_chunks;
+	u32 rsvd[2];
+	u32 chunk_size[];  // Stored size of each chunk, in bytes.
+} nx_bak_hdr_t;
+
+/*
+* Incremental backup delta. The header and the sorted indices of the changed chunks
+* are followed by the changed chunks, each chunk_sectors long except for the last one.
+*/
+typedef struct _nx_delta_hdr_t
+{
+	u32 magic;
+	u32 hdr_size;      // Header and chunk index, in bytes. Sector aligned.
+	u32 chunk_sectors;
+	u32 total_sectors; // Sectors of the base backup file it applies to.
+	u32 num_changed;
+	u32 base_id[2];    // Identity of the base backup, from its hash manifest.
+	u32 rsvd;
+	u32 chunk_idx[];
+} nx_delta_hdr_t;
+
+u32 nx_bak_hdr_size(u32 chunk_sectors, u32 total_sectors);
+void nx_bak_hdr_init(nx_bak_hdr_t *hdr, u32 format, u32 chunk_sectors, u32 total_sectors);
+nx_bak_hdr_t *nx_bak_hdr_read(FIL *fp);
+int nx_bak_hdr_write(FIL *fp, nx_bak_hdr_t *hdr);
+u32 nx_bak_work_size(u32 format, u32 chunk_sectors);
+int nx_bak_is_zero(const void *buf, u32 size);
+int nx_bak_chunk_write(FIL *fp, nx_bak_hdr_t *hdr, u32 idx, const void *buf, u32 size, void *work);
+int nx_bak_chunk_read(FIL *fp, nx_bak_hdr_t *hdr, u32 idx, void *buf, void *work);
+
+u32 nx_delta_hdr_size(u32 chunk_sectors, u32 total_sectors);
+void nx_delta_hdr_init(nx_delta_hdr_t *hdr, u32 chunk_sectors, u32 total_sectors);
+nx_delta_hdr_t *nx_delta_hdr_read(FIL *fp);
+int nx_delta_chunk_read(FIL *fp, nx_delta_hdr_t *hdr, u32 *pos, u32 idx, void *buf);
+
+#endif
@@ -20,51 +20,452 @@
 #include "heap.h"
 #include "list.h"
 
-void nx_emmc_gpt_parse(link_t *gpt, sdmmc_storage_t *storage)
+// Parsed GPT, kept for the whole session and revalidated against the header CRC.
+#define NX_GPT_HASH_SLOTS 64
+
+static emmc_part_t *_gpt_parts = NULL;
+static u32 _gpt_num_parts = 0;
+static u32 _gpt_hdr_crc32 = 0;
+static u8 _gpt_hash[NX_GPT_HASH_SLOTS]; // Part index + 1, 0 for empty slots.
+static u32 _gpt_refs = 0;   // Lists handed out that link the cached entries.
+static int _gpt_stale = 0;  // Freed once the last list linking it is.
+
+static u32 _nx_emmc_name_hash(const char *name)
 {
-	u8 *buf = (u8 *)malloc(NX_GPT_NUM_BLOCKS * NX_EMMC_BLOCKSIZE);
+	// FNV-1a.
+	u32 hash = 0x811C9DC5;
+	while (*name)
+	{
+		hash ^= (u8)*name++;
+		hash *= 0x01000193;
+	}
+	return hash;
+}
 
-	sdmmc_storage_read(storage, NX_GPT_FIRST_LBA, NX_GPT_NUM_BLOCKS, buf);
+static void _nx_emmc_gpt_cache_free()
+{
+	// Lists still walk the entries, so they go when the last one is freed.
+	if (_gpt_refs)
+	{
+		_gpt_stale = 1;
+		return;
+	}
+
+	for (u32 i = 0; i < _gpt_num_parts; i++)
+		nx_emmc_part_cache_disable(&_gpt_parts[i]);
+	free(_gpt_parts);
+	_gpt_parts = NULL;
+	_gpt_num_parts = 0;
+	_gpt_stale = 0;
+}
+
+// Reads the GPT into a new array of entries. Returns NULL if it could not be read.
+static emmc_part_t *_nx_emmc_gpt_read(sdmmc_storage_t *storage, u32 *num_parts_out, u32 *hdr_crc32)
+{
+	u8 *buf = (u8 *)dma_malloc(NX_GPT_NUM_BLOCKS * NX_EMMC_BLOCKSIZE);
+
+	if (!sdmmc_storage_read(storage, NX_GPT_FIRST_LBA, NX_GPT_NUM_BLOCKS, buf))
+	{
+		free(buf);
+		return NULL;
+	}
 
 	gpt_header_t *hdr = (gpt_header_t *)buf;
-	for (u32 i = 0; i < hdr->num_part_ents; i++)
+	u32 num_parts = hdr->num_part_ents;
+	u32 max_parts = ((NX_GPT_NUM_BLOCKS + NX_GPT_FIRST_LBA - hdr->part_ent_lba) * NX_EMMC_BLOCKSIZE) / sizeof(gpt_entry_t);
+	if (hdr->part_ent_lba < NX_GPT_FIRST_LBA + 1 || hdr->part_ent_lba >= NX_GPT_FIRST_LBA + NX_GPT_NUM_BLOCKS)
+		num_parts = 0;
+	else if (num_parts > max_parts)
+		num_parts = max_parts;
+	if (num_parts >= NX_GPT_HASH_SLOTS)
+		num_parts = NX_GPT_HASH_SLOTS - 1;
+
+	emmc_part_t *parts = (emmc_part_t *)malloc(sizeof(emmc_part_t) * MAX(num_parts, 1));
+	for (u32 i = 0; i < num_parts; i++)
 	{
 		gpt_entry_t *ent = (gpt_entry_t *)(buf + (hdr->part_ent_lba - 1) * NX_EMMC_BLOCKSIZE + i * sizeof(gpt_entry_t));
-		emmc_part_t *part = (emmc_part_t *)malloc(sizeof(emmc_part_t));
+		emmc_part_t *part = &parts[i];
 		part->lba_start = ent->lba_start;
 		part->lba_end = ent->lba_end;
 		part->attrs = ent->attrs;
+		part->cache = NULL;
 
 		//HACK
-		for (u32 i = 0; i < 36; i++)
-			part->name[i] = ent->name[i];
+		for (u32 j = 0; j < 36; j++)
+			part->name[j] = ent->name[j];
 		part->name[36] = 0;
-
-		list_append(gpt, &part->link);
 	}
 
+	*num_parts_out = num_parts;
+	*hdr_crc32 = hdr->crc32;
 	free(buf);
+	return parts;
+}
+
+static int _nx_emmc_gpt_cache_fill(sdmmc_storage_t *storage)
+{
+	_gpt_parts = _nx_emmc_gpt_read(storage, &_gpt_num_parts, &_gpt_hdr_crc32);
+	if (!_gpt_parts)
+		return 0;
+
+	memset(_gpt_hash, 0, sizeof(_gpt_hash));
+	for (u32 i = 0; i < _gpt_num_parts; i++)
+	{
+		// Open addressing with linear probing. Keep the first entry on duplicate names.
+		u32 slot = _nx_emmc_name_hash(_gpt_parts[i].name) & (NX_GPT_HASH_SLOTS - 1);
+		while (_gpt_hash[slot])
+			slot = (slot + 1) & (NX_GPT_HASH_SLOTS - 1);
+		_gpt_hash[slot] = i + 1;
+	}
+
+	return 1;
+}
+
+void nx_emmc_gpt_parse(link_t *gpt, sdmmc_storage_t *storage)
+{
+	list_init(gpt);
+
+	// Only the header is read if the GPT did not change since it was cached.
+	int valid = 0;
+	if (_gpt_parts && !_gpt_stale)
+	{
+		gpt_header_t *hdr = (gpt_header_t *)dma_malloc(NX_EMMC_BLOCKSIZE);
+		valid = sdmmc_storage_read(storage, NX_GPT_FIRST_LBA, 1, hdr) && hdr->crc32 == _gpt_hdr_crc32;
+		free(hdr);
+	}
+	if (!valid)
+		_nx_emmc_gpt_cache_free();
+
+	// An entry links into a single list, so a list already handed out makes this one a private copy.
+	if (_gpt_refs)
+	{
+		u32 num_parts = _gpt_num_parts;
+		u32 hdr_crc32;
+		emmc_part_t *parts;
+		if (valid)
+		{
+			parts = (emmc_part_t *)malloc(sizeof(emmc_part_t) * MAX(num_parts, 1));
+			memcpy(parts, _gpt_parts, sizeof(emmc_part_t) * num_parts);
+		}
+		else
+			parts = _nx_emmc_gpt_read(storage, &num_parts, &hdr_crc32);
+		if (!parts)
+			return;
+
+		for (u32 i = 0; i < num_parts; i++)
+		{
+			parts[i].cache = NULL;
+			list_append(gpt, &parts[i].link);
+		}
+		if (!num_parts)
+			free(parts);
+		return;
+	}
+
+	if (!_gpt_parts && !_nx_emmc_gpt_cache_fill(storage))
+		return;
+
+	for (u32 i = 0; i < _gpt_num_parts; i++)
+		list_append(gpt, &_gpt_parts[i].link);
+	if (_gpt_num_parts)
+		_gpt_refs++;
 }
 
 void nx_emmc_gpt_free(link_t *gpt)
 {
-	LIST_FOREACH_SAFE(iter, gpt)
-		free(CONTAINER_OF(iter, emmc_part_t, link));
+	if (gpt->next == gpt)
+		return;
+
+	// Entries are owned by the GPT cache, unless the list is a private copy.
+	emmc_part_t *first = CONTAINER_OF(gpt->next, emmc_part_t, link);
+	if (first == _gpt_parts)
+	{
+		if (!--_gpt_refs && _gpt_stale)
+			_nx_emmc_gpt_cache_free();
+	}
+	else
+	{
+		LIST_FOREACH_ENTRY(emmc_part_t, part, gpt, link)
+			nx_emmc_part_cache_disable(part);
+		free(first);
+	}
+	list_init(gpt);
 }
 
 emmc_part_t *nx_emmc_part_find(link_t *gpt, const char *name)
 {
+	if (_gpt_parts && gpt->next != gpt && CONTAINER_OF(gpt->next, emmc_part_t, link) == &_gpt_parts[0])
+	{
+		u32 slot = _nx_emmc_name_hash(name) & (NX_GPT_HASH_SLOTS - 1);
+		while (_gpt_hash[slot])
+		{
+			emmc_part_t *part = &_gpt_parts[_gpt_hash[slot] - 1];
+			if (!strcmp(part->name, name))
+				return part;
+			slot = (slot + 1) & (NX_GPT_HASH_SLOTS - 1);
+		}
+		return NULL;
+	}
+
 	LIST_FOREACH_ENTRY(emmc_part_t, part, gpt, link)
 		if (!strcmp(part->name, name))
 			return part;
 	return NULL;
 }
 
+// Shared eMMC session. The controller stays initialized between users until nx_emmc_end.
+static sdmmc_t _emmc_sdmmc;
+static sdmmc_storage_t _emmc_storage;
+static int _emmc_initialized = 0;
+static u32 _emmc_refs = 0;
+
+// Image storages standing in for the whole eMMC, indexed by partition.
+#define NX_EMMC_IMAGE_PARTS 3
+
+static sdmmc_storage_t _image_storage[NX_EMMC_IMAGE_PARTS];
+static u32 _image_parts = 0; // Bitmask of the attached partitions.
+
+void nx_emmc_image_attach(u32 partition, sdmmc_extmap_t *map)
+{
+	if (partition >= NX_EMMC_IMAGE_PARTS)
+		return;
+
+	sdmmc_storage_t *storage = &_image_storage[partition];
+	memset(storage, 0, sizeof(sdmmc_storage_t));
+	if (map)
+	{
+		storage->extmap = map;
+		storage->has_sector_access = 1;
+		storage->sec_cnt = map->num_sectors;
+		storage->partition = partition;
+		_image_parts |= 1 << partition;
+	}
+	else
+		_image_parts &= ~(1 << partition);
+
+	// The cached GPT belongs to the device it was read from.
+	_nx_emmc_gpt_cache_free();
+}
+
+int nx_emmc_image_attached()
+{
+	return _image_parts != 0;
+}
+
+sdmmc_storage_t *nx_emmc_open(u32 partition)
+{
+	// An image replaces the eMMC as a whole, partitions it lacks are not taken from the real one.
+	if (_image_parts)
+	{
+		if (partition >= NX_EMMC_IMAGE_PARTS || !(_image_parts & (1 << partition)))
+			return NULL;
+		_emmc_refs++;
+		return &_image_storage[partition];
+	}
+
+	if (!_emmc_initialized)
+	{
+		if (!sdmmc_storage_init_mmc(&_emmc_storage, &_emmc_sdmmc, SDMMC_4, SDMMC_BUS_WIDTH_8, 4))
+			return NULL;
+		_emmc_initialized = 1;
+	}
+
+	if (!sdmmc_storage_set_mmc_partition(&_emmc_storage, partition))
+		return NULL;
+
+	_emmc_refs++;
+	return &_emmc_storage;
+}
+
+void nx_emmc_close()
+{
+	if (_emmc_refs)
+		_emmc_refs--;
+}
+
+int nx_emmc_end()
+{
+	// Do not pull the controller from under a user.
+	if (_emmc_refs)
+		return 0;
+
+	if (_emmc_initialized)
+	{
+		sdmmc_storage_end(&_emmc_storage);
+		_emmc_initialized = 0;
+		_nx_emmc_gpt_cache_free();
+	}
+	return 1;
+}
+
+/*
+* Optional write-through LRU block cache, for many small reads on the same partition.
+*/
+
+int nx_emmc_part_cache_enable(emmc_part_t *part, u32 size)
+{
+	nx_emmc_part_cache_disable(part);
+
+	u32 num_slots = size / (NX_EMMC_CACHE_BLOCK_SECTORS * NX_EMMC_BLOCKSIZE);
+	if (num_slots < NX_EMMC_CACHE_READAHEAD)
+		return 0;
+
+	emmc_cache_t *cache = (emmc_cache_t *)calloc(sizeof(emmc_cache_t), 1);
+	cache->num_slots = num_slots;
+	cache->tags = (u32 *)malloc(num_slots * sizeof(u32));
+	cache->stamps = (u32 *)calloc(num_slots, sizeof(u32));
+	cache->data = (u8 *)dma_malloc(num_slots * NX_EMMC_CACHE_BLOCK_SECTORS * NX_EMMC_BLOCKSIZE);
+	memset(cache->tags, 0xFF, num_slots * sizeof(u32));
+	cache->next_block = 0xFFFFFFFF;
+
+	part->cache = cache;
+	return 1;
+}
+
+void nx_emmc_part_cache_disable(emmc_part_t *part)
+{
+	emmc_cache_t *cache = part->cache;
+	if (!cache)
+		return;
+
+	free(cache->data);
+	free(cache->stamps);
+	free(cache->tags);
+	free(cache);
+	part->cache = NULL;
+}
+
+static int _nx_emmc_cache_lookup(emmc_cache_t *cache, u32 block)
+{
+	for (u32 i = 0; i < cache->num_slots; i++)
+		if (cache->tags[i] == block)
+			return i;
+	return -1;
+}
+
+static u32 _nx_emmc_cache_victim(emmc_cache_t *cache)
+{
+	u32 victim = 0;
+	for (u32 i = 0; i < cache->num_slots; i++)
+	{
+		if (cache->tags[i] == 0xFFFFFFFF)
+			return i;
+		if (cache->stamps[i] < cache->stamps[victim])
+			victim = i;
+	}
+	return victim;
+}
+
+static u8 *_nx_emmc_cache_slot_data(emmc_cache_t *cache, u32 slot)
+{
+	return cache->data + slot * NX_EMMC_CACHE_BLOCK_SECTORS * NX_EMMC_BLOCKSIZE;
+}
+
+// Reads blocks that are not cached. On a sequential pattern the following blocks are prefetched in the same transfer.
+static int _nx_emmc_cache_fill(sdmmc_storage_t *storage, emmc_part_t *part, u32 block)
+{
+	emmc_cache_t *cache = part->cache;
+	u32 num_blocks = (part->lba_end - part->lba_start + 1) / NX_EMMC_CACHE_BLOCK_SECTORS;
+
+	u32 num = 1;
+	if (block == cache->next_block)
+	{
+		while (num < NX_EMMC_CACHE_READAHEAD && block + num < num_blocks &&
+			_nx_emmc_cache_lookup(cache, block + num) < 0)
+			num++;
+	}
+
+	u32 num_sectors = num * NX_EMMC_CACHE_BLOCK_SECTORS;
+	u8 *buf = (u8 *)dma_malloc(num_sectors * NX_EMMC_BLOCKSIZE);
+	if (!sdmmc_storage_read(storage, part->lba_start + block * NX_EMMC_CACHE_BLOCK_SECTORS, num_sectors, buf))
+	{
+		free(buf);
+		return 0;
+	}
+
+	for (u32 i = 0; i < num; i++)
+	{
+		u32 slot = _nx_emmc_cache_victim(cache);
+		cache->tags[slot] = block + i;
+		// Read-ahead blocks start as the oldest, so unused prefetches are evicted first.
+		cache->stamps[slot] = i ? 0 : ++cache->clock;
+		memcpy(_nx_emmc_cache_slot_data(cache, slot), buf + i * NX_EMMC_CACHE_BLOCK_SECTORS * NX_EMMC_BLOCKSIZE,
+			NX_EMMC_CACHE_BLOCK_SECTORS * NX_EMMC_BLOCKSIZE);
+	}
+
+	free(buf);
+	return 1;
+}
+
+static int _nx_emmc_cache_read(sdmmc_storage_t *storage, emmc_part_t *part, u32 sector_off, u32 num_sectors, u8 *buf)
+{
+	emmc_cache_t *cache = part->cache;
+
+	while (num_sectors)
+	{
+		u32 block = sector_off / NX_EMMC_CACHE_BLOCK_SECTORS;
+		u32 off = sector_off % NX_EMMC_CACHE_BLOCK_SECTORS;
+		u32 num = MIN(num_sectors, NX_EMMC_CACHE_BLOCK_SECTORS - off);
+
+		// Blocks past the partition end can not be cached.
+		if (part->lba_start + (block + 1) * NX_EMMC_CACHE_BLOCK_SECTORS - 1 > part->lba_end)
+			return sdmmc_storage_read(storage, part->lba_start + sector_off, num_sectors, buf);
+
+		int slot = _nx_emmc_cache_lookup(cache, block);
+		if (slot >= 0)
+			cache->hits++;
+		else
+		{
+			cache->misses++;
+			if (!_nx_emmc_cache_fill(storage, part, block))
+				return 0;
+			slot = _nx_emmc_cache_lookup(cache, block);
+		}
+		cache->stamps[slot] = ++cache->clock;
+		cache->next_block = block + 1;
+
+		memcpy(buf, _nx_emmc_cache_slot_data(cache, slot) + off * NX_EMMC_BLOCKSIZE, num * NX_EMMC_BLOCKSIZE);
+		buf += num * NX_EMMC_BLOCKSIZE;
+		sector_off += num;
+		num_sectors -= num;
+	}
+
+	return 1;
+}
+
+// Keeps cached blocks in sync with data already written to the eMMC.
+static void _nx_emmc_cache_update(emmc_part_t *part, u32 sector_off, u32 num_sectors, const u8 *buf)
+{
+	emmc_cache_t *cache = part->cache;
+
+	for (u32 i = 0; i < cache->num_slots; i++)
+	{
+		u32 block = cache->tags[i];
+		if (block == 0xFFFFFFFF)
+			continue;
+
+		u32 start = block * NX_EMMC_CACHE_BLOCK_SECTORS;
+		u32 end = start + NX_EMMC_CACHE_BLOCK_SECTORS;
+		if (end <= sector_off || start >= sector_off + num_sectors)
+			continue;
+
+		u32 from = MAX(start, sector_off);
+		u32 to = MIN(end, sector_off + num_sectors);
+		memcpy(_nx_emmc_cache_slot_data(cache, i) + (from - start) * NX_EMMC_BLOCKSIZE,
+			buf + (from - sector_off) * NX_EMMC_BLOCKSIZE, (to - from) * NX_EMMC_BLOCKSIZE);
+	}
+}
+
 int nx_emmc_part_read(sdmmc_storage_t *storage, emmc_part_t *part, u32 sector_off, u32 num_sectors, void *buf)
 {
 	// The last LBA is inclusive.
 	if (part->lba_start + sector_off > part->lba_end)
 		return 0;
+
+	// Bulk reads go straight to the bus.
+	if (part->cache && num_sectors < NX_EMMC_CACHE_READAHEAD * NX_EMMC_CACHE_BLOCK_SECTORS)
+		return _nx_emmc_cache_read(storage, part, sector_off, num_sectors, (u8 *)buf);
+
 	return sdmmc_storage_read(storage, part->lba_start + sector_off, num_sectors, buf);
 }
 
@@ -73,5 +474,17 @@ int nx_emmc_part_write(sdmmc_storage_t *storage, emmc_part_t *part, u32 sector_o
 	// The last LBA is inclusive.
 	if (part->lba_start + sector_off > part->lba_end)
 		return 0;
-	return sdmmc_storage_write(storage, part->lba_start + sector_off, num_sectors, buf);
+
+	if (!sdmmc_storage_write(storage, part->lba_start + sector_off, num_sectors, buf))
+	{
+		// Partially written, so the cached copy can not be trusted.
+		if (part->cache)
+			memset(part->cache->tags, 0xFF, part->cache->num_slots * sizeof(u32));
+		return 0;
+	}
+
+	if (part->cache)
+		_nx_emmc_cache_update(part, sector_off, num_sectors, (const u8 *)buf);
+
+	return 1;
 }
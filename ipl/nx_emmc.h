@@ -54,18 +54,43 @@ typedef struct _gpt_header_t
 #define NX_GPT_NUM_BLOCKS 33
 #define NX_EMMC_BLOCKSIZE 512
 
+#define NX_EMMC_CACHE_BLOCK_SECTORS 8 // 4KiB cache blocks.
+#define NX_EMMC_CACHE_READAHEAD     8 // Cache blocks fetched on sequential misses.
+
+typedef struct _emmc_cache_t
+{
+	u32 num_slots;
+	u32 *tags;   // Cache block index per slot, 0xFFFFFFFF if empty.
+	u32 *stamps; // LRU age per slot.
+	u8 *data;
+	u32 clock;
+	u32 next_block; // Expected block of a sequential read.
+	u32 hits;
+	u32 misses;
+} emmc_cache_t;
+
 typedef struct _emmc_part_t
 {
 	u32 lba_start;
 	u32 lba_end;
 	u64 attrs;
 	s8 name[37];
+	emmc_cache_t *cache;
 	link_t link;
 } emmc_part_t;
 
+/*! Serves partition (0: user area, 1: BOOT0, 2: BOOT1) from map while attached, NULL detaches it. */
+void nx_emmc_image_attach(u32 partition, sdmmc_extmap_t *map);
+/*! Returns 1 if nx_emmc_open() hands out image storages instead of the eMMC. */
+int nx_emmc_image_attached();
+sdmmc_storage_t *nx_emmc_open(u32 partition);
+void nx_emmc_close();
+int nx_emmc_end();
 void nx_emmc_gpt_parse(link_t *gpt, sdmmc_storage_t *storage);
 void nx_emmc_gpt_free(link_t *gpt);
 emmc_part_t *nx_emmc_part_find(link_t *gpt, const char *name);
+int nx_emmc_part_cache_enable(emmc_part_t *part, u32 size);
+void nx_emmc_part_cache_disable(emmc_part_t *part);
 int nx_emmc_part_read(sdmmc_storage_t *storage, emmc_part_t *part, u32 sector_off, u32 num_sectors, void *buf);
 int nx_emmc_part_write(sdmmc_storage_t *storage, emmc_part_t *part, u32 sector_off, u32 num_sectors, void *buf);
 
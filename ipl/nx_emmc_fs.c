@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "nx_emmc_fs.h"
+#include "ff.h"
+#include "heap.h"
+#include "nx_emmc.h"
+#include "se.h"
+#include "util.h"
+
+#define NX_EMMC_FS_BLOCK_SIZE (NX_EMMC_FS_BLOCK_SECTORS * NX_EMMC_BLOCKSIZE)
+
+typedef struct _nx_emmc_fs_t
+{
+	sdmmc_storage_t *storage;
+	link_t gpt;
+	emmc_part_t *part;
+	u32 num_blocks;
+	int writable;
+	u32 tags[NX_EMMC_FS_CACHE_SLOTS];   // Block per slot, 0xFFFFFFFF if empty.
+	u32 stamps[NX_EMMC_FS_CACHE_SLOTS]; // LRU age per slot.
+	u32 clock;
+	u8 *data;   // Decrypted blocks, one per slot.
+	u8 *bounce; // Encrypted copy of a block being written.
+} nx_emmc_fs_t;
+
+static nx_emmc_fs_t _efs;
+static FATFS _efs_fat;
+
+static int _nx_emmc_fs_read_blocks(u32 blk, u32 num, u8 *buf)
+{
+	if (blk + num > _efs.num_blocks)
+		return 0;
+
+	if (!nx_emmc_part_read(_efs.storage, _efs.part, blk * NX_EMMC_FS_BLOCK_SECTORS, num * NX_EMMC_FS_BLOCK_SECTORS, buf))
+		return 0;
+
+	// The tweak is the block index from the partition start.
+	return se_aes_xts_crypt(NX_EMMC_FS_KS_TWEAK, NX_EMMC_FS_KS_CRYPT, 0, blk, buf, buf, NX_EMMC_FS_BLOCK_SIZE, num);
+}
+
+static void _nx_emmc_fs_cache_drop(u32 blk)
+{
+	for (u32 i = 0; i < NX_EMMC_FS_CACHE_SLOTS; i++)
+		if (_efs.tags[i] == blk)
+			_efs.tags[i] = 0xFFFFFFFF;
+}
+
+// Returns the decrypted block from the cache, reading it in on a miss unless it is about to be overwritten.
+static u8 *_nx_emmc_fs_cache_get(u32 blk, int load)
+{
+	if (blk >= _efs.num_blocks)
+		return NULL;
+
+	u32 slot = 0;
+	for (u32 i = 0; i < NX_EMMC_FS_CACHE_SLOTS; i++)
+	{
+		if (_efs.tags[i] == blk)
+		{
+			_efs.stamps[i] = ++_efs.clock;
+			return _efs.data + i * NX_EMMC_FS_BLOCK_SIZE;
+		}
+		if (_efs.tags[i] == 0xFFFFFFFF || (s32)(_efs.stamps[i] - _efs.stamps[slot]) < 0)
+			slot = i;
+	}
+
+	u8 *data = _efs.data + slot * NX_EMMC_FS_BLOCK_SIZE;
+	_efs.tags[slot] = 0xFFFFFFFF;
+	if (load && !_nx_emmc_fs_read_blocks(blk, 1, data))
+		return NULL;
+
+	_efs.tags[slot] = blk;
+	_efs.stamps[slot] = ++_efs.clock;
+
+	return data;
+}
+
+DRESULT nx_emmc_fs_read(u8 *buf, u32 sector, u32 count)
+{
+	if (!_efs.storage)
+		return RES_NOTRDY;
+
+	while (count)
+	{
+		u32 blk = sector / NX_EMMC_FS_BLOCK_SECTORS;
+		u32 off = sector % NX_EMMC_FS_BLOCK_SECTORS;
+		u32 num;
+
+		// Whole blocks are read and decrypted in place in one go. Writes go through, so the cache is never newer.
+		if (!off && count >= NX_EMMC_FS_BLOCK_SECTORS && dma_buf_ok(buf))
+		{
+			num = count - count % NX_EMMC_FS_BLOCK_SECTORS;
+			if (!_nx_emmc_fs_read_blocks(blk, num / NX_EMMC_FS_BLOCK_SECTORS, buf))
+				return RES_ERROR;
+		}
+		else
+		{
+			u8 *data = _nx_emmc_fs_cache_get(blk, 1);
+			if (!data)
+				return RES_ERROR;
+			num = MIN(count, NX_EMMC_FS_BLOCK_SECTORS - off);
+			memcpy(buf, data + off * NX_EMMC_BLOCKSIZE, num * NX_EMMC_BLOCKSIZE);
+		}
+
+		buf += num * NX_EMMC_BLOCKSIZE;
+		sector += num;
+		count -= num;
+	}
+
+	return RES_OK;
+}
+
+DRESULT nx_emmc_fs_write(const u8 *buf, u32 sector, u32 count)
+{
+	if (!_efs.storage)
+		return RES_NOTRDY;
+	if (!_efs.writable)
+		return RES_WRPRT;
+
+	while (count)
+	{
+		u32 blk = sector / NX_EMMC_FS_BLOCK_SECTORS;
+		u32 off = sector % NX_EMMC_FS_BLOCK_SECTORS;
+		u32 num = MIN(count, NX_EMMC_FS_BLOCK_SECTORS - off);
+
+		// The rest of a partially written block has to be kept.
+		u8 *data = _nx_emmc_fs_cache_get(blk, num != NX_EMMC_FS_BLOCK_SECTORS);
+		if (!data)
+			return RES_ERROR;
+		memcpy(data + off * NX_EMMC_BLOCKSIZE, buf, num * NX_EMMC_BLOCKSIZE);
+
+		if (!se_aes_xts_crypt(NX_EMMC_FS_KS_TWEAK, NX_EMMC_FS_KS_CRYPT, 1, blk, _efs.bounce, data, NX_EMMC_FS_BLOCK_SIZE, 1) ||
+			!nx_emmc_part_write(_efs.storage, _efs.part, blk * NX_EMMC_FS_BLOCK_SECTORS, NX_EMMC_FS_BLOCK_SECTORS, _efs.bounce))
+		{
+			// The cached copy no longer matches the eMMC.
+			_nx_emmc_fs_cache_drop(blk);
+			return RES_ERROR;
+		}
+
+		buf += num * NX_EMMC_BLOCKSIZE;
+		sector += num;
+		count -= num;
+	}
+
+	return RES_OK;
+}
+
+DSTATUS nx_emmc_fs_status()
+{
+	if (!_efs.storage)
+		return STA_NOINIT;
+
+	return _efs.writable ? 0 : STA_PROTECT;
+}
+
+int nx_emmc_fs_mount(const char *part_name, const u8 *bis_key, int writable)
+{
+	nx_emmc_fs_unmount();
+
+	_efs.storage = nx_emmc_open(0);
+	if (!_efs.storage)
+		return 0;
+
+	list_init(&_efs.gpt);
+	nx_emmc_gpt_parse(&_efs.gpt, _efs.storage);
+	_efs.part = nx_emmc_part_find(&_efs.gpt, part_name);
+	if (!_efs.part)
+	{
+		nx_emmc_fs_unmount();
+		return 0;
+	}
+
+	_efs.num_blocks = (_efs.part->lba_end - _efs.part->lba_start + 1) / NX_EMMC_FS_BLOCK_SECTORS;
+	_efs.writable = writable;
+	memset(_efs.tags, 0xFF, sizeof(_efs.tags));
+	memset(_efs.stamps, 0, sizeof(_efs.stamps));
+	_efs.clock = 0;
+	_efs.data = (u8 *)dma_malloc((NX_EMMC_FS_CACHE_SLOTS + 1) * NX_EMMC_FS_BLOCK_SIZE);
+	_efs.bounce = _efs.data + NX_EMMC_FS_CACHE_SLOTS * NX_EMMC_FS_BLOCK_SIZE;
+
+	se_aes_key_set(NX_EMMC_FS_KS_CRYPT, (void *)bis_key, 0x10);
+	se_aes_key_set(NX_EMMC_FS_KS_TWEAK, (void *)(bis_key + 0x10), 0x10);
+
+	if (f_mount(&_efs_fat, NX_EMMC_FS_PATH, 1) != FR_OK)
+	{
+		nx_emmc_fs_unmount();
+		return 0;
+	}
+
+	return 1;
+}
+
+void nx_emmc_fs_unmount()
+{
+	if (!_efs.storage)
+		return;
+
+	f_mount(NULL, NX_EMMC_FS_PATH, 0);
+	free(_efs.data);
+	nx_emmc_gpt_free(&_efs.gpt);
+	nx_emmc_close();
+	memset(&_efs, 0, sizeof(nx_emmc_fs_t));
+
+	// Leave no BIS key behind in the engine.
+	se_aes_key_clear(NX_EMMC_FS_KS_CRYPT);
+	se_aes_key_clear(NX_EMMC_FS_KS_TWEAK);
+}
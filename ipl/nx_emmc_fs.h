@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NX_EMMC_FS_H_
+#define _NX_EMMC_FS_H_
+
+#include "types.h"
+#include "diskio.h"
+
+#define NX_EMMC_FS_DRV  1
+#define NX_EMMC_FS_PATH "1:"
+
+// Same slots as the eMMC dump tools, which never run while a partition is mounted.
+#define NX_EMMC_FS_KS_CRYPT 8
+#define NX_EMMC_FS_KS_TWEAK 9
+
+#define NX_EMMC_FS_BLOCK_SECTORS 32 // BIS crypto works on 16KiB sectors.
+#define NX_EMMC_FS_CACHE_SLOTS   16
+
+/*! Mounts the FAT of a GPP partition as NX_EMMC_FS_PATH, bis_key being its crypt key followed by its tweak key. */
+int nx_emmc_fs_mount(const char *part_name, const u8 *bis_key, int writable);
+void nx_emmc_fs_unmount();
+DSTATUS nx_emmc_fs_status();
+DRESULT nx_emmc_fs_read(u8 *buf, u32 sector, u32 count);
+DRESULT nx_emmc_fs_write(const u8 *buf, u32 sector, u32 count);
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "nx_image.h"
+#include "ff.h"
+#include "diskio.h"
+#include "heap.h"
+#include "nx_emmc.h"
+#include "pkg1_cache.h"
+#include "util.h"
+
+extern sdmmc_storage_t sd_storage;
+extern void *sd_file_read(char *path, u32 *fsize);
+extern int sd_save_to_file(void *buf, u32 size, const char *filename);
+
+#define NX_IMAGE_PATH_MAX 128
+
+static sdmmc_extmap_t *_image_maps[2]; // User area and BOOT0, in eMMC partition order.
+
+static void _nx_image_part_path(char *out, const char *path, int split, u32 idx)
+{
+	strcpy(out, path);
+	if (!split)
+		return;
+
+	u32 len = strlen(out);
+	out[len++] = '.';
+	out[len++] = '0' + idx / 10;
+	out[len++] = '0' + idx % 10;
+	out[len] = 0;
+}
+
+// Serial and FAT layout of the volume. A reformatted card can hold a same-sized part elsewhere.
+static u32 _nx_image_vol_stamp(FATFS *fs)
+{
+	u32 rec[7] = { 0, fs->fs_type, fs->csize, fs->n_fatent, fs->volbase, fs->fatbase, fs->database };
+
+	// The serial is only in the boot sector, at an offset that depends on the FAT type.
+	u8 *buf = (u8 *)dma_malloc(NX_EMMC_BLOCKSIZE);
+	if (disk_read(fs->pdrv, buf, fs->volbase, 1) == RES_OK)
+		memcpy(&rec[0], buf + (fs->fs_type == FS_EXFAT ? 100 : (fs->fs_type == FS_FAT32 ? 67 : 39)), sizeof(u32));
+	free(buf);
+
+	return crc32c(rec, sizeof(rec));
+}
+
+// Number of parts (0 if none is usable), and a stamp that changes when any of them is rewritten or moved.
+static u32 _nx_image_parts(const char *path, int *split, u32 *stamp)
+{
+	char part[NX_IMAGE_PATH_MAX];
+	FILINFO fno;
+	FIL fp;
+	u32 num_parts = 0;
+
+	*stamp = 0;
+	*split = f_stat(path, &fno) != FR_OK;
+
+	while (num_parts < NX_IMAGE_MAX_PARTS)
+	{
+		_nx_image_part_path(part, path, *split, num_parts);
+		if (f_stat(part, &fno) != FR_OK || f_open(&fp, part, FA_READ) != FR_OK)
+			break;
+		// Extents end on sector boundaries only.
+		if (fno.fsize % NX_EMMC_BLOCKSIZE)
+		{
+			f_close(&fp);
+			return 0;
+		}
+
+		if (!num_parts)
+			*stamp = _nx_image_vol_stamp(fp.obj.fs);
+		u32 rec[4] = { (u32)(fno.fsize / NX_EMMC_BLOCKSIZE), fno.fdate, fno.ftime, fp.obj.sclust };
+		*stamp = crc32c_update(*stamp, rec, sizeof(rec));
+		f_close(&fp);
+		num_parts++;
+
+		if (!*split)
+			break;
+	}
+
+	return num_parts;
+}
+
+static void _nx_image_map_add(sdmmc_extmap_t *map, u32 *max_extents, u32 target, u32 num_sectors)
+{
+	sdmmc_extent_t *last = map->num_extents ? &map->extents[map->num_extents - 1] : NULL;
+
+	// Consecutive parts are usually written back to back.
+	if (last && last->target + last->num_sectors == target)
+		last->num_sectors += num_sectors;
+	else
+	{
+		if (map->num_extents == *max_extents)
+		{
+			*max_extents *= 2;
+			sdmmc_extent_t *extents = (sdmmc_extent_t *)malloc(*max_extents * sizeof(sdmmc_extent_t));
+			memcpy(extents, map->extents, map->num_extents * sizeof(sdmmc_extent_t));
+			free(map->extents);
+			map->extents = extents;
+		}
+
+		sdmmc_extent_t *ext = &map->extents[map->num_extents++];
+		ext->sector = map->num_sectors;
+		ext->num_sectors = num_sectors;
+		ext->target = target;
+	}
+
+	map->num_sectors += num_sectors;
+}
+
+static int _nx_image_map_file(sdmmc_extmap_t *map, u32 *max_extents, const char *path)
+{
+	FIL fp;
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+		return 0;
+
+	FATFS *fs = fp.obj.fs;
+	u32 left = f_size(&fp) / NX_EMMC_BLOCKSIZE;
+
+	// Cluster link map: its size, then (clusters, first cluster) per fragment, zero terminated.
+	u32 tbl_size = 64;
+	DWORD *tbl;
+	FRESULT res;
+	while (1)
+	{
+		tbl = (DWORD *)malloc(tbl_size * sizeof(DWORD));
+		tbl[0] = tbl_size;
+		fp.cltbl = tbl;
+		res = f_lseek(&fp, CREATE_LINKMAP);
+		if (res != FR_NOT_ENOUGH_CORE)
+			break;
+
+		// The required size is left in the table.
+		tbl_size = tbl[0];
+		free(tbl);
+	}
+	f_close(&fp);
+
+	if (res == FR_OK)
+	{
+		for (DWORD *frag = tbl + 1; *frag && left; frag += 2)
+		{
+			u32 num_sectors = MIN(left, frag[0] * fs->csize);
+			_nx_image_map_add(map, max_extents, fs->database + (frag[1] - 2) * fs->csize, num_sectors);
+			left -= num_sectors;
+		}
+	}
+
+	free(tbl);
+	return res == FR_OK && !left;
+}
+
+static sdmmc_extmap_t *_nx_image_map_load(char *map_path, u32 stamp)
+{
+	u32 size;
+	u8 *buf = (u8 *)sd_file_read(map_path, &size);
+	if (!buf)
+		return NULL;
+
+	sdmmc_extmap_t *map = NULL;
+	nx_image_map_hdr_t *hdr = (nx_image_map_hdr_t *)buf;
+	sdmmc_extent_t *extents = (sdmmc_extent_t *)(buf + sizeof(nx_image_map_hdr_t));
+
+	if (size < sizeof(nx_image_map_hdr_t) || hdr->magic != NX_IMAGE_MAP_MAGIC || hdr->stamp != stamp ||
+		!hdr->num_extents || size != sizeof(nx_image_map_hdr_t) + hdr->num_extents * sizeof(sdmmc_extent_t))
+		goto out;
+
+	// The extents must tile the image in order.
+	u32 sector = 0;
+	for (u32 i = 0; i < hdr->num_extents; i++)
+	{
+		if (extents[i].sector != sector || !extents[i].num_sectors)
+			goto out;
+		sector += extents[i].num_sectors;
+	}
+	if (sector != hdr->num_sectors)
+		goto out;
+
+	map = (sdmmc_extmap_t *)malloc(sizeof(sdmmc_extmap_t));
+	map->target = &sd_storage;
+	map->num_sectors = hdr->num_sectors;
+	map->num_extents = hdr->num_extents;
+	map->extents = (sdmmc_extent_t *)malloc(hdr->num_extents * sizeof(sdmmc_extent_t));
+	memcpy(map->extents, extents, hdr->num_extents * sizeof(sdmmc_extent_t));
+
+out:
+	free(buf);
+	return map;
+}
+
+static void _nx_image_map_save(const char *map_path, const sdmmc_extmap_t *map, u32 stamp)
+{
+	u32 size = sizeof(nx_image_map_hdr_t) + map->num_extents * sizeof(sdmmc_extent_t);
+	u8 *buf = (u8 *)malloc(size);
+
+	nx_image_map_hdr_t *hdr = (nx_image_map_hdr_t *)buf;
+	hdr->magic = NX_IMAGE_MAP_MAGIC;
+	hdr->stamp = stamp;
+	hdr->num_sectors = map->num_sectors;
+	hdr->num_extents = map->num_extents;
+	memcpy(buf + sizeof(nx_image_map_hdr_t), map->extents, map->num_extents * sizeof(sdmmc_extent_t));
+
+	// Only saves walking the FAT next time, the map is used either way.
+	sd_save_to_file(buf, size, map_path);
+	free(buf);
+}
+
+sdmmc_extmap_t *nx_image_map(const char *path)
+{
+	char part[NX_IMAGE_PATH_MAX];
+	int split;
+	u32 stamp;
+
+	if (strlen(path) + 4 >= NX_IMAGE_PATH_MAX)
+		return NULL;
+
+	u32 num_parts = _nx_image_parts(path, &split, &stamp);
+	if (!num_parts)
+		return NULL;
+
+	strcpy(part, path);
+	strcat(part, ".map");
+	sdmmc_extmap_t *map = _nx_image_map_load(part, stamp);
+	if (map)
+		return map;
+
+	// Resolve every part's clusters once.
+	u32 max_extents = 16;
+	map = (sdmmc_extmap_t *)calloc(1, sizeof(sdmmc_extmap_t));
+	map->target = &sd_storage;
+	map->extents = (sdmmc_extent_t *)malloc(max_extents * sizeof(sdmmc_extent_t));
+
+	for (u32 i = 0; i < num_parts; i++)
+	{
+		_nx_image_part_path(part, path, split, i);
+		if (!_nx_image_map_file(map, &max_extents, part))
+		{
+			nx_image_map_free(map);
+			return NULL;
+		}
+	}
+
+	if (!map->num_sectors)
+	{
+		nx_image_map_free(map);
+		return NULL;
+	}
+
+	strcpy(part, path);
+	strcat(part, ".map");
+	_nx_image_map_save(part, map, stamp);
+
+	return map;
+}
+
+void nx_image_map_free(sdmmc_extmap_t *map)
+{
+	if (!map)
+		return;
+
+	free(map->extents);
+	free(map);
+}
+
+int nx_image_attach(const char *dir)
+{
+	char path[NX_IMAGE_PATH_MAX];
+	u32 len = strlen(dir);
+
+	nx_image_detach();
+
+	if (len + 13 > NX_IMAGE_PATH_MAX)
+		return 0;
+
+	memcpy(path, dir, len);
+	strcpy(path + len, "/rawnand.bin");
+	_image_maps[0] = nx_image_map(path);
+	strcpy(path + len, "/BOOT0");
+	_image_maps[1] = nx_image_map(path);
+
+	if (!_image_maps[0] || !_image_maps[1])
+	{
+		nx_image_detach();
+		return 0;
+	}
+
+	for (u32 i = 0; i < 2; i++)
+		nx_emmc_image_attach(i, _image_maps[i]);
+	// Package1 and its TSEC keys were cached from the eMMC.
+	pkg1_cache_drop();
+
+	return 1;
+}
+
+void nx_image_detach()
+{
+	int attached = nx_emmc_image_attached();
+
+	for (u32 i = 0; i < 2; i++)
+	{
+		if (attached)
+			nx_emmc_image_attach(i, NULL);
+		nx_image_map_free(_image_maps[i]);
+		_image_maps[i] = NULL;
+	}
+
+	if (attached)
+		pkg1_cache_drop();
+}
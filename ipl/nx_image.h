@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _NX_IMAGE_H_
+#define _NX_IMAGE_H_
+
+#include "types.h"
+#include "sdmmc.h"
+
+#define NX_IMAGE_MAP_MAGIC 0x50414D58 // "XMAP"
+#define NX_IMAGE_MAX_PARTS 64         // Split parts, name.00 to name.63.
+
+/*! Extent map cached next to an image as <image>.map, followed by its extents. */
+typedef struct _nx_image_map_hdr_t
+{
+	u32 magic;
+	u32 stamp; // Over size, date and time of every part, a rewritten image gets mapped again.
+	u32 num_sectors;
+	u32 num_extents;
+} nx_image_map_hdr_t;
+
+/*! Resolves the SD card sectors of path, or of its split parts path.00, path.01 and so on. NULL on failure. */
+sdmmc_extmap_t *nx_image_map(const char *path);
+void nx_image_map_free(sdmmc_extmap_t *map);
+/*! Serves BOOT0 and the user area from dir/BOOT0 and dir/rawnand.bin instead of the eMMC. */
+int nx_image_attach(const char *dir);
+/*! Goes back to the eMMC. */
+void nx_image_detach();
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+
+#include "pkg1_cache.h"
+#include "heap.h"
+#include "idle.h"
+#include "nx_emmc.h"
+#include "sdmmc.h"
+#include "tsec.h"
+
+static pkg1_cache_t _pkg1_cache;
+
+static int _pkg1_cache_load()
+{
+	sdmmc_storage_t *storage = nx_emmc_open(1);
+	if (!storage)
+		return 0;
+
+	if (!_pkg1_cache.pkg1)
+	{
+		_pkg1_cache.pkg1 = (u8 *)dma_malloc(PKG1_CACHE_SIZE);
+		_pkg1_cache.keyblob = (u8 *)dma_malloc(NX_EMMC_BLOCKSIZE);
+	}
+
+	int res = sdmmc_storage_read(storage, 0x100000 / NX_EMMC_BLOCKSIZE, PKG1_CACHE_SIZE / NX_EMMC_BLOCKSIZE, _pkg1_cache.pkg1);
+	if (res)
+	{
+		_pkg1_cache.pkg1_id = pkg1_identify(_pkg1_cache.pkg1);
+		if (_pkg1_cache.pkg1_id)
+			res = sdmmc_storage_read(storage, 0x180000 / NX_EMMC_BLOCKSIZE + _pkg1_cache.pkg1_id->kb, 1, _pkg1_cache.keyblob);
+	}
+	nx_emmc_close();
+
+	_pkg1_cache.loaded = res;
+	_pkg1_cache.tsec_done = 0;
+
+	return res;
+}
+
+const pkg1_cache_t *pkg1_cache_get()
+{
+	if (!_pkg1_cache.loaded && !_pkg1_cache_load())
+		return NULL;
+
+	return &_pkg1_cache;
+}
+
+int pkg1_cache_tsec_key(u8 *key, u32 rev)
+{
+	if (!rev || rev > PKG1_CACHE_TSEC_REVS || !pkg1_cache_get() || !_pkg1_cache.pkg1_id)
+		return -1;
+
+	u32 idx = rev - 1;
+	if (!(_pkg1_cache.tsec_done & (1 << idx)))
+	{
+		_pkg1_cache.tsec_res[idx] = tsec_query(_pkg1_cache.tsec_keys[idx], rev,
+			_pkg1_cache.pkg1 + _pkg1_cache.pkg1_id->tsec_off);
+		_pkg1_cache.tsec_done |= 1 << idx;
+	}
+
+	memcpy(key, _pkg1_cache.tsec_keys[idx], 0x10);
+
+	return _pkg1_cache.tsec_res[idx];
+}
+
+void pkg1_cache_drop()
+{
+	_pkg1_cache.loaded = 0;
+	_pkg1_cache.pkg1_id = NULL;
+	_pkg1_cache.tsec_done = 0;
+	memset(_pkg1_cache.tsec_keys, 0, sizeof(_pkg1_cache.tsec_keys));
+}
+
+int pkg1_cache_prefetch(u32 *state)
+{
+	// eMMC power-up first, a no-op if the session is already up.
+	if (!*state)
+	{
+		if (!nx_emmc_open(1))
+			return IDLE_TASK_FAIL;
+		nx_emmc_close();
+		(*state)++;
+		return IDLE_TASK_MORE;
+	}
+
+	return pkg1_cache_get() ? IDLE_TASK_DONE : IDLE_TASK_FAIL;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _PKG1_CACHE_H_
+#define _PKG1_CACHE_H_
+
+#include "types.h"
+#include "pkg1.h"
+
+#define PKG1_CACHE_SIZE 0x40000
+#define PKG1_CACHE_TSEC_REVS 3
+
+/*
+ * Package1, its keyblob and the TSEC keys, read once per power-on and
+ * shared by every consumer. Buffers stay allocated for the session.
+ */
+typedef struct _pkg1_cache_t
+{
+	u32 loaded;
+	u8 *pkg1;                 // As read from BOOT0, consumers decrypt a copy.
+	const pkg1_id_t *pkg1_id; // NULL if the version is unknown.
+	u8 *keyblob;              // Encrypted keyblob for pkg1_id->kb.
+	u32 tsec_done;            // Bit per queried TSEC key revision.
+	int tsec_res[PKG1_CACHE_TSEC_REVS];
+	u8 tsec_keys[PKG1_CACHE_TSEC_REVS][0x10];
+} pkg1_cache_t;
+
+/*! Returns the cache, reading BOOT0 on first use. NULL if the eMMC read failed. */
+const pkg1_cache_t *pkg1_cache_get();
+/*! TSEC key of revision rev (1-3), the firmware runs once per revision. Returns tsec_query's result. */
+int pkg1_cache_tsec_key(u8 *key, u32 rev);
+/*! Forgets the contents, e.g. after BOOT0 was written. */
+void pkg1_cache_drop();
+/*! Idle task filling the cache ahead of the first consumer. */
+int pkg1_cache_prefetch(u32 *state);
+
+#endif
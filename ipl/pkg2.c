@@ -23,13 +23,15 @@
 #include "heap.h"
 #include "se.h"
 #include "blz.h"
+#include "ff.h"
+#include "util.h"
 
 #include "gfx.h"
 
 extern gfx_con_t gfx_con;
+extern void *sd_file_read(char *path, u32 *fsize);
 
-/*#include "util.h"
-#define DPRINTF(...) gfx_printf(&gfx_con, __VA_ARGS__)
+/*#define DPRINTF(...) gfx_printf(&gfx_con, __VA_ARGS__)
 #define DEBUG_PRINTING*/
 #define DPRINTF(...)
 
@@ -428,18 +430,96 @@ static u32 _pkg2_calc_kip1_size(pkg2_kip1_t *kip1)
 	return size;
 }
 
-void pkg2_parse_kips(link_t *info, pkg2_hdr_t *pkg2)
+static void _pkg2_ctr_add(u8 *ctr, u32 blocks)
+{
+	// 128-bit big-endian counter.
+	for (int i = 0xF; i >= 0 && blocks; i--)
+	{
+		u32 sum = ctr[i] + (blocks & 0xFF);
+		ctr[i] = sum & 0xFF;
+		blocks = (blocks >> 8) + (sum >> 8);
+	}
+}
+
+// CTR-crypts size bytes at off of a section, in place. The header must be decrypted.
+static void _pkg2_crypt_range(pkg2_hdr_t *hdr, u32 sec, u32 off, u32 size)
+{
+	if (!size)
+		return;
+
+	u8 *base = hdr->data;
+	for (u32 i = 0; i < sec; i++)
+		base += hdr->sec_size[i];
+
+	u8 ctr[0x10];
+	memcpy(ctr, &hdr->sec_ctr[sec * 0x10], 0x10);
+	_pkg2_ctr_add(ctr, off >> 4);
+
+	// A partial first block goes through a bounce block, so its neighbour bytes are left alone.
+	u32 head = off & 0xF;
+	if (head)
+	{
+		u8 block[0x10] __attribute__((aligned(4)));
+		u32 cnt = MIN(0x10 - head, size);
+		memset(block, 0, 0x10);
+		memcpy(block + head, base + off, cnt);
+		se_aes_crypt_ctr(8, block, 0x10, block, 0x10, ctr);
+		memcpy(base + off, block + head, cnt);
+
+		off += cnt;
+		size -= cnt;
+		_pkg2_ctr_add(ctr, 1);
+	}
+
+	if (size)
+		se_aes_crypt_ctr(8, base + off, size, base + off, size, ctr);
+}
+
+static void _pkg2_kip_decrypt(pkg2_kip1_info_t *ki)
+{
+	if (!ki->pkg2 || ki->body_plain)
+		return;
+
+	_pkg2_crypt_range(ki->pkg2, PKG2_SEC_INI1, ki->ini1_off + sizeof(pkg2_kip1_t), ki->size - sizeof(pkg2_kip1_t));
+	ki->body_plain = 1;
+}
+
+static void _pkg2_kip_info_init(pkg2_kip1_info_t *ki, pkg2_kip1_t *kip1)
+{
+	ki->kip1 = kip1;
+	ki->size = _pkg2_calc_kip1_size(kip1);
+	ki->pkg2 = NULL;
+	ki->ini1_off = 0;
+	ki->body_plain = 0;
+	ki->from_ini1 = 0;
+	ki->hashed = 0;
+}
+
+// With ini1_encrypted, only the INI1 and KIP headers get decrypted. The bodies follow on demand.
+void pkg2_parse_kips(link_t *info, pkg2_hdr_t *pkg2, arena_t *arena, int ini1_encrypted)
 {
 	u8 *ptr = pkg2->data + pkg2->sec_size[PKG2_SEC_KERNEL];
 	pkg2_ini1_t *ini1 = (pkg2_ini1_t *)ptr;
 	ptr += sizeof(pkg2_ini1_t);
 
+	if (ini1_encrypted)
+		_pkg2_crypt_range(pkg2, PKG2_SEC_INI1, 0, sizeof(pkg2_ini1_t));
+
 	for (u32 i = 0; i < ini1->num_procs; i++)
 	{
 		pkg2_kip1_t *kip1 = (pkg2_kip1_t *)ptr;
-		pkg2_kip1_info_t *ki = (pkg2_kip1_info_t *)malloc(sizeof(pkg2_kip1_info_t));
-		ki->kip1 = kip1;
-		ki->size = _pkg2_calc_kip1_size(kip1);
+		u32 ini1_off = ptr - (u8 *)ini1;
+		if (ini1_encrypted)
+			_pkg2_crypt_range(pkg2, PKG2_SEC_INI1, ini1_off, sizeof(pkg2_kip1_t));
+
+		pkg2_kip1_info_t *ki = (pkg2_kip1_info_t *)arena_alloc(arena, sizeof(pkg2_kip1_info_t));
+		_pkg2_kip_info_init(ki, kip1);
+		ki->from_ini1 = 1;
+		if (ini1_encrypted)
+		{
+			ki->pkg2 = pkg2;
+			ki->ini1_off = ini1_off;
+		}
 		list_append(info, &ki->link);
 		ptr += ki->size;
 DPRINTF(" kip1 %d:%s @ %08X (%08X)\n", i, kip1->name, (u32)kip1, ki->size);
@@ -459,36 +539,36 @@ void pkg2_replace_kip(link_t *info, u64 tid, pkg2_kip1_t *kip1)
 	LIST_FOREACH_ENTRY(pkg2_kip1_info_t, ki, info, link)
 		if (ki->kip1->tid == tid)
 		{
-			ki->kip1 = kip1;
-			ki->size = _pkg2_calc_kip1_size(kip1);
+			_pkg2_kip_info_init(ki, kip1);
 DPRINTF("replaced kip (new size %08X)\n", ki->size);
 			return;
 		}
 }
 
-void pkg2_add_kip(link_t *info, pkg2_kip1_t *kip1)
+void pkg2_add_kip(link_t *info, pkg2_kip1_t *kip1, arena_t *arena)
 {
-	pkg2_kip1_info_t *ki = (pkg2_kip1_info_t *)malloc(sizeof(pkg2_kip1_info_t));
-	ki->kip1 = kip1;
-	ki->size = _pkg2_calc_kip1_size(kip1);
+	pkg2_kip1_info_t *ki = (pkg2_kip1_info_t *)arena_alloc(arena, sizeof(pkg2_kip1_info_t));
+	_pkg2_kip_info_init(ki, kip1);
 DPRINTF("added kip (size %08X)\n", ki->size);
 	list_append(info, &ki->link);
 }
 
-void pkg2_merge_kip(link_t *info, pkg2_kip1_t *kip1)
+void pkg2_merge_kip(link_t *info, pkg2_kip1_t *kip1, arena_t *arena)
 {
 	if (pkg2_has_kip(info, kip1->tid))
 		pkg2_replace_kip(info, kip1->tid, kip1);
 	else
-		pkg2_add_kip(info, kip1);
+		pkg2_add_kip(info, kip1, arena);
 }
 
-int pkg2_decompress_kip(pkg2_kip1_info_t* ki, u32 sectsToDecomp)
+int pkg2_decompress_kip(pkg2_kip1_info_t* ki, u32 sectsToDecomp, arena_t *arena)
 {
 	u32 compClearMask = ~sectsToDecomp;
 	if ((ki->kip1->flags & compClearMask) == ki->kip1->flags)
 		return 0; // Already decompressed, nothing to do.
 
+	_pkg2_kip_decrypt(ki);
+
 	pkg2_kip1_t hdr;
 	memcpy(&hdr, ki->kip1, sizeof(hdr));
 	
@@ -503,7 +583,9 @@ int pkg2_decompress_kip(pkg2_kip1_info_t* ki, u32 sectsToDecomp)
 			newKipSize += hdr.sections[sectIdx].size_comp;
 	}
 
-	pkg2_kip1_t* newKip = malloc(newKipSize);	
+	pkg2_kip1_t* newKip = arena_alloc(arena, newKipSize);
+	if (!newKip)
+		return 1;
 	unsigned char* dstDataPtr = newKip->data;
 	const unsigned char* srcDataPtr = ki->kip1->data;
 	for (u32 sectIdx=0; sectIdx<KIP1_NUM_SECTIONS; sectIdx++)
@@ -527,8 +609,7 @@ int pkg2_decompress_kip(pkg2_kip1_info_t* ki, u32 sectsToDecomp)
 		gfx_printf(&gfx_con, "Decomping %s KIP1 sect %d of size %d...\n", (const char*)hdr.name, sectIdx, compSize);
 		if (blz_uncompress_srcdest(srcDataPtr, compSize, dstDataPtr, outputSize) == 0)
 		{
-			gfx_printf(&gfx_con, "%kERROR decomping sect %d of %s KIP!%k\n", 0xFFFF0000, sectIdx, (char*)hdr.name, 0xFFCCCCCC);			
-			free(newKip);
+			gfx_printf(&gfx_con, "%kERROR decomping sect %d of %s KIP!%k\n", 0xFFFF0000, sectIdx, (char*)hdr.name, 0xFFCCCCCC);
 
 			return 1;
 		}
@@ -545,14 +626,394 @@ int pkg2_decompress_kip(pkg2_kip1_info_t* ki, u32 sectsToDecomp)
 	memcpy(newKip, &hdr, sizeof(hdr));
 	newKipSize = dstDataPtr-(unsigned char*)(newKip);
 
-	free(ki->kip1);
+	// The old one is either inside package2 or in the launch arena, nothing to free.
 	ki->kip1 = newKip;
 	ki->size = newKipSize;
+	ki->pkg2 = NULL;
+
+	return 0;
+}
+
+// Finished KIPs on SD, keyed by the hash of the original, the contents and the names of the patches applied.
+#define KIP1_CACHE_DIR "kip_cache"
+#define KIP1_CACHE_MAGIC 0x3143504B // KPC1.
+
+typedef struct _kip1_cache_hdr_t
+{
+	u32 magic;
+	u32 size;
+	u8 key[0x20];
+	u8 hash[0x20];
+} kip1_cache_hdr_t;
+
+static void _pkg2_kip_cache_key(u8 *key, const void *srcHash, u32 patchCrc, char **patches, u32 numPatches, u32 kipPatches)
+{
+	se_sha256_ctx_t ctx;
+	u32 size = 0x24;
+	for (u32 i = 0; i < numPatches; i++)
+		if (kipPatches & (1u << i))
+			size += strlen(patches[i]) + 1;
+
+	se_sha256_init(&ctx, size);
+	u8 buf[0x40] __attribute__((aligned(4)));
+	u32 pos = 0x24;
+	memcpy(buf, srcHash, 0x20);
+	memcpy(buf + 0x20, &patchCrc, 4);
+	for (u32 i = 0; i < numPatches; i++)
+	{
+		if (!(kipPatches & (1u << i)))
+			continue;
+
+		// Names are fed through a block sized buffer, every chunk but the last must be a full block.
+		for (const char *p = patches[i]; ; p++)
+		{
+			buf[pos++] = *p ? *p : ',';
+			if (pos == sizeof(buf))
+			{
+				se_sha256_update(&ctx, buf, pos);
+				pos = 0;
+			}
+			if (!*p)
+				break;
+		}
+	}
+	if (pos)
+		se_sha256_update(&ctx, buf, pos);
+	se_sha256_final(&ctx, key);
+}
+
+static void _pkg2_kip_cache_path(char *path, const u8 *key)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	memcpy(path, KIP1_CACHE_DIR "/", sizeof(KIP1_CACHE_DIR));
+	path += sizeof(KIP1_CACHE_DIR);
+	for (u32 i = 0; i < 8; i++)
+	{
+		*path++ = hex[key[i] >> 4];
+		*path++ = hex[key[i] & 0xF];
+	}
+	memcpy(path, ".kip", 5);
+}
+
+static int _pkg2_kip_cache_load(pkg2_kip1_info_t *ki, const u8 *key, arena_t *arena)
+{
+	FIL fp;
+	UINT br;
+	char path[40];
+	kip1_cache_hdr_t hdr;
+	u32 hash[8];
+
+	_pkg2_kip_cache_path(path, key);
+	if (f_open(&fp, path, FA_READ) != FR_OK)
+		return 0;
+
+	int res = 0;
+	if (f_read(&fp, &hdr, sizeof(hdr), &br) != FR_OK || br != sizeof(hdr) ||
+		hdr.magic != KIP1_CACHE_MAGIC || memcmp(hdr.key, key, 0x20) ||
+		hdr.size < sizeof(pkg2_kip1_t) || hdr.size != f_size(&fp) - sizeof(hdr))
+		goto out;
+
+	pkg2_kip1_t *kip1 = (pkg2_kip1_t *)arena_alloc(arena, hdr.size);
+	if (!kip1 || f_read(&fp, kip1, hdr.size, &br) != FR_OK || br != hdr.size)
+		goto out;
+
+	if (!se_calc_sha256(hash, kip1, hdr.size) || memcmp(hash, hdr.hash, 0x20))
+		goto out;
+
+	ki->kip1 = kip1;
+	ki->size = hdr.size;
+	ki->pkg2 = NULL;
+	res = 1;
+
+out:;
+	f_close(&fp);
+	return res;
+}
+
+static void _pkg2_kip_cache_save(pkg2_kip1_info_t *ki, const u8 *key)
+{
+	FIL fp;
+	UINT bw;
+	char path[40];
+	kip1_cache_hdr_t hdr;
+
+	hdr.magic = KIP1_CACHE_MAGIC;
+	hdr.size = ki->size;
+	memcpy(hdr.key, key, 0x20);
+	if (!se_calc_sha256(hdr.hash, ki->kip1, ki->size))
+		return;
+
+	f_mkdir(KIP1_CACHE_DIR);
+	_pkg2_kip_cache_path(path, key);
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return;
+
+	int res = f_write(&fp, &hdr, sizeof(hdr), &bw) == FR_OK && bw == sizeof(hdr) &&
+		f_write(&fp, ki->kip1, ki->size, &bw) == FR_OK && bw == ki->size;
+	f_close(&fp);
+
+	// Never leave a partial entry behind.
+	if (!res)
+		f_unlink(path);
+}
+
+// Resident patch database. Loaded from KIP1_PATCH_DB_PATH, else built from _kip_ids.
+#define KIP1_DB_MAX_KIP_NAMES 8
+
+typedef struct _kip1_db_t
+{
+	kip1_db_hdr_t hdr;
+	char (*names)[KIP1_PATCH_NAME_LEN];
+	kip1_db_kip_t *kips;
+	kip1_db_patch_t *patches;
+	u8 *data;
+	// Distinct KIP names with every patch name they know, so KIPs that cannot match are never hashed.
+	u32 num_kip_names;
+	char kip_names[KIP1_DB_MAX_KIP_NAMES][12];
+	u32 kip_masks[KIP1_DB_MAX_KIP_NAMES];
+	// Source, to notice a changed file, and a CRC32C of its contents for the KIP cache keys.
+	u8 *buf;
+	u32 crc;
+	u32 from_sd;
+	u32 fsize;
+	u16 fdate;
+	u16 ftime;
+} kip1_db_t;
+
+static kip1_db_t _kip_db;
+
+static u32 _pkg2_kip_db_size(const kip1_db_hdr_t *hdr)
+{
+	return sizeof(kip1_db_hdr_t) + hdr->num_names * KIP1_PATCH_NAME_LEN + hdr->num_kips * sizeof(kip1_db_kip_t) +
+		hdr->num_patches * sizeof(kip1_db_patch_t) + hdr->data_size;
+}
+
+static void _pkg2_kip_db_map(kip1_db_t *db, u8 *buf)
+{
+	db->buf = buf;
+	memcpy(&db->hdr, buf, sizeof(kip1_db_hdr_t));
+	db->names = (char (*)[KIP1_PATCH_NAME_LEN])(buf + sizeof(kip1_db_hdr_t));
+	db->kips = (kip1_db_kip_t *)(db->names + db->hdr.num_names);
+	db->patches = (kip1_db_patch_t *)(db->kips + db->hdr.num_kips);
+	db->data = (u8 *)(db->patches + db->hdr.num_patches);
+
+	db->num_kip_names = 0;
+	for (u32 i = 0; i < db->hdr.num_kips; i++)
+	{
+		u32 j;
+		for (j = 0; j < db->num_kip_names; j++)
+			if (!strncmp(db->kip_names[j], db->kips[i].name, 12))
+				break;
+
+		if (j == KIP1_DB_MAX_KIP_NAMES)
+		{
+			// Too many to tell apart, every KIP gets hashed.
+			db->num_kip_names = KIP1_DB_MAX_KIP_NAMES + 1;
+			return;
+		}
+		if (j == db->num_kip_names)
+		{
+			memcpy(db->kip_names[j], db->kips[i].name, 12);
+			db->kip_masks[j] = 0;
+			db->num_kip_names++;
+		}
+		db->kip_masks[j] |= db->kips[i].names;
+	}
+}
+
+static int _pkg2_kip_db_load(kip1_db_t *db, u8 *buf, u32 size)
+{
+	kip1_db_hdr_t *hdr = (kip1_db_hdr_t *)buf;
+
+	if (size < sizeof(kip1_db_hdr_t) || hdr->magic != KIP1_PATCH_DB_MAGIC ||
+		hdr->num_names > KIP1_PATCH_DB_MAX_NAMES || hdr->num_kips > 0x1000 || hdr->num_patches > 0x10000 ||
+		hdr->data_size > size || _pkg2_kip_db_size(hdr) != size)
+		return 0;
+
+	_pkg2_kip_db_map(db, buf);
+
+	for (u32 i = 0; i < db->hdr.num_names; i++)
+		if (db->names[i][KIP1_PATCH_NAME_LEN - 1])
+			return 0;
+
+	u32 validNames = (db->hdr.num_names < 32) ? ((1u << db->hdr.num_names) - 1) : 0xFFFFFFFF;
+	for (u32 i = 0; i < db->hdr.num_kips; i++)
+	{
+		const kip1_db_kip_t *kip = &db->kips[i];
+		if ((kip->names & ~validNames) || kip->num_patches > db->hdr.num_patches ||
+			kip->first_patch > db->hdr.num_patches - kip->num_patches ||
+			(i && memcmp(db->kips[i - 1].hash, kip->hash, sizeof(kip->hash)) >= 0))
+			return 0;
+	}
+
+	for (u32 i = 0; i < db->hdr.num_patches; i++)
+	{
+		const kip1_db_patch_t *patch = &db->patches[i];
+		if (patch->name_idx >= db->hdr.num_names || GET_KIP_PATCH_SECTION(patch->offset) >= KIP1_NUM_SECTIONS ||
+			!patch->length || patch->length > db->hdr.data_size / 2 ||
+			patch->data_off > db->hdr.data_size - patch->length * 2)
+			return 0;
+	}
+
+	return 1;
+}
+
+static u32 _pkg2_kip_db_intern(const char **names, u32 *numNames, const char *name)
+{
+	for (u32 i = 0; i < *numNames; i++)
+		if (!strcmp(names[i], name))
+			return i;
+
+	if (*numNames == KIP1_PATCH_DB_MAX_NAMES || strlen(name) >= KIP1_PATCH_NAME_LEN)
+		return KIP1_PATCH_DB_MAX_NAMES;
+
+	names[*numNames] = name;
+	return (*numNames)++;
+}
+
+static void _pkg2_kip_db_build(kip1_db_t *db)
+{
+	const u32 numKips = sizeof(_kip_ids) / sizeof(_kip_ids[0]);
+	const char *names[KIP1_PATCH_DB_MAX_NAMES];
+	kip1_db_hdr_t hdr;
+
+	// Count everything first, the layout depends on it.
+	memset(&hdr, 0, sizeof(kip1_db_hdr_t));
+	hdr.magic = KIP1_PATCH_DB_MAGIC;
+	hdr.num_kips = numKips;
+	for (u32 i = 0; i < numKips; i++)
+	{
+		for (const kip1_patchset_t *ps = _kip_ids[i].patchset; ps && ps->name; ps++)
+		{
+			_pkg2_kip_db_intern(names, &hdr.num_names, ps->name);
+			for (const kip1_patch_t *patch = ps->patches; patch && patch->length; patch++)
+			{
+				hdr.num_patches++;
+				hdr.data_size += patch->length * 2;
+			}
+		}
+	}
+
+	u8 *buf = (u8 *)calloc(_pkg2_kip_db_size(&hdr), 1);
+	memcpy(buf, &hdr, sizeof(kip1_db_hdr_t));
+	_pkg2_kip_db_map(db, buf);
+	for (u32 i = 0; i < hdr.num_names; i++)
+		strcpy(db->names[i], names[i]);
+
+	u32 patchIdx = 0;
+	u32 dataOff = 0;
+	for (u32 i = 0; i < numKips; i++)
+	{
+		kip1_db_kip_t *kip = &db->kips[i];
+		memcpy(kip->hash, _kip_ids[i].hash, sizeof(kip->hash));
+		strncpy(kip->name, _kip_ids[i].name, sizeof(kip->name));
+		kip->first_patch = patchIdx;
+
+		for (const kip1_patchset_t *ps = _kip_ids[i].patchset; ps && ps->name; ps++)
+		{
+			u32 nameIdx = _pkg2_kip_db_intern(names, &hdr.num_names, ps->name);
+			if (nameIdx == KIP1_PATCH_DB_MAX_NAMES)
+				continue;
+			kip->names |= 1u << nameIdx;
+
+			for (const kip1_patch_t *patch = ps->patches; patch && patch->length; patch++)
+			{
+				kip1_db_patch_t *dbPatch = &db->patches[patchIdx++];
+				dbPatch->offset = patch->offset;
+				dbPatch->length = patch->length;
+				dbPatch->name_idx = nameIdx;
+				dbPatch->data_off = dataOff;
+				memcpy(db->data + dataOff, patch->srcData, patch->length);
+				memcpy(db->data + dataOff + patch->length, patch->dstData, patch->length);
+				dataOff += patch->length * 2;
+			}
+		}
+		kip->num_patches = patchIdx - kip->first_patch;
+	}
+
+	// Lookups are binary searches over the hashes.
+	for (u32 i = 1; i < numKips; i++)
+	{
+		kip1_db_kip_t tmp = db->kips[i];
+		u32 j = i;
+		for (; j && memcmp(db->kips[j - 1].hash, tmp.hash, sizeof(tmp.hash)) > 0; j--)
+			db->kips[j] = db->kips[j - 1];
+		db->kips[j] = tmp;
+	}
+
+	_pkg2_kip_db_map(db, buf);
+}
+
+static const kip1_db_t *_pkg2_kip_db_get()
+{
+	FILINFO fno;
+	int onSd = f_stat(KIP1_PATCH_DB_PATH, &fno) == FR_OK;
+
+	// Keep the resident one, unless its source changed.
+	if (_kip_db.buf && _kip_db.from_sd == (u32)onSd && (!onSd ||
+		(_kip_db.fsize == fno.fsize && _kip_db.fdate == fno.fdate && _kip_db.ftime == fno.ftime)))
+		return &_kip_db;
+
+	free(_kip_db.buf);
+	memset(&_kip_db, 0, sizeof(kip1_db_t));
+	if (onSd)
+	{
+		u32 size = 0;
+		u8 *buf = (u8 *)sd_file_read(KIP1_PATCH_DB_PATH, &size);
+		if (buf && _pkg2_kip_db_load(&_kip_db, buf, size))
+		{
+			_kip_db.crc = crc32c(buf, size);
+			_kip_db.from_sd = 1;
+			_kip_db.fsize = fno.fsize;
+			_kip_db.fdate = fno.fdate;
+			_kip_db.ftime = fno.ftime;
+			return &_kip_db;
+		}
+
+		gfx_printf(&gfx_con, "%kInvalid %s, using built-in patches%k\n", 0xFFFFDD00, KIP1_PATCH_DB_PATH, 0xFFCCCCCC);
+		free(buf);
+		memset(&_kip_db, 0, sizeof(kip1_db_t));
+	}
+	_pkg2_kip_db_build(&_kip_db);
+	_kip_db.crc = crc32c(_kip_db.buf, _pkg2_kip_db_size(&_kip_db.hdr));
+
+	return &_kip_db;
+}
+
+static u32 _pkg2_kip_db_name_mask(const kip1_db_t *db, const u8 *kipName)
+{
+	if (db->num_kip_names > KIP1_DB_MAX_KIP_NAMES)
+		return 0xFFFFFFFF;
+
+	for (u32 i = 0; i < db->num_kip_names; i++)
+		if (!strncmp(db->kip_names[i], (const char *)kipName, 12))
+			return db->kip_masks[i];
 
 	return 0;
 }
 
-const char* pkg2_patch_kips(link_t *info, char* patchNames)
+static const kip1_db_kip_t *_pkg2_kip_db_find(const kip1_db_t *db, const void *hash)
+{
+	u32 lo = 0;
+	u32 hi = db->hdr.num_kips;
+
+	while (lo < hi)
+	{
+		u32 mid = (lo + hi) / 2;
+		int res = memcmp(db->kips[mid].hash, hash, sizeof(db->kips[mid].hash));
+		if (!res)
+			return &db->kips[mid];
+		if (res < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+const char* pkg2_patch_kips(link_t *info, char* patchNames, arena_t *arena)
 {
 	if (patchNames == NULL || patchNames[0] == 0)
 		return NULL;
@@ -606,126 +1067,147 @@ const char* pkg2_patch_kips(link_t *info, char* patchNames)
 		DPRINTF("Requested patch: '%s'\n", patches[i]);
 	}
 
-	u32 shaBuf[32/sizeof(u32)];
-	LIST_FOREACH_ENTRY(pkg2_kip1_info_t, ki, info, link)
+	const kip1_db_t *db = _pkg2_kip_db_get();
+
+	// Requested patches as interned name bits. Names the database does not know are never applied.
+	u32 requested = 0;
+	u32 reqMasks[KIP1_PATCH_DB_MAX_NAMES];
+	memset(reqMasks, 0, sizeof(reqMasks));
+	for (u32 i = 0; i < numPatches; i++)
 	{
-		shaBuf[0] = 0; // sha256 for this kip not yet calculated.
-		for (u32 currKipIdx=0; currKipIdx<(sizeof(_kip_ids)/sizeof(_kip_ids[0])); currKipIdx++)
+		for (u32 nameIdx = 0; nameIdx < db->hdr.num_names; nameIdx++)
 		{
-			if (strncmp((const char*)ki->kip1->name, _kip_ids[currKipIdx].name, sizeof(ki->kip1->name)) != 0)
-				continue;
-
-			u32 bitsAffected = 0;
-			kip1_patchset_t* currPatchset = _kip_ids[currKipIdx].patchset;
-			while (currPatchset != NULL && currPatchset->name != NULL)
+			if (!strcmp(db->names[nameIdx], patches[i]))
 			{
-				for (u32 i=0; i<numPatches; i++)
-				{
-					if (strcmp(currPatchset->name, patches[i]) != 0)
-					{
-						bitsAffected = i + 1;
-						break;
-					}
-				}
-				currPatchset++;
+				requested |= 1u << nameIdx;
+				reqMasks[nameIdx] |= 1u << i;
+				break;
 			}
+		}
+	}
+
+	LIST_FOREACH_ENTRY(pkg2_kip1_info_t, ki, info, link)
+	{
+		// Dont bother even hashing this KIP if we dont have any patches enabled for it.
+		if (!(_pkg2_kip_db_name_mask(db, ki->kip1->name) & requested))
+			continue;
 
-			// Dont bother even hashing this KIP if we dont have any patches enabled for it.
-			if (bitsAffected == 0)
+		// A boot plan may know the hash already, then the body is only decrypted if it gets patched.
+		if (!ki->hashed)
+		{
+			_pkg2_kip_decrypt(ki);
+			if (!se_calc_sha256(ki->hash, ki->kip1, ki->size))
 				continue;
+			ki->hashed = 1;
+		}
 
-			if (shaBuf[0] == 0)
-			{
-				if (!se_calc_sha256(shaBuf, ki->kip1, ki->size))
-					memset(shaBuf, 0, sizeof(shaBuf));
-			}			
+		const kip1_db_kip_t *kip = _pkg2_kip_db_find(db, ki->hash);
+		u32 kipNames = kip ? (kip->names & requested) : 0;
+		if (!kipNames)
+			continue;
+
+		// One pass over its patches finds the sections to decompress and the names that change anything.
+		// What they write goes into the cache key, so a patch changed under the same name is not served stale.
+		// So does the database they come from, a reloaded one never hits entries made with another.
+		const kip1_db_patch_t *kipPatchList = &db->patches[kip->first_patch];
+		u32 bitsAffected = 0;
+		u32 namesWithData = 0;
+		u32 patchCrc = db->crc;
+		for (u32 i = 0; i < kip->num_patches; i++)
+		{
+			if (!(kipNames & (1u << kipPatchList[i].name_idx)))
+				continue;
+			bitsAffected |= 1u << GET_KIP_PATCH_SECTION(kipPatchList[i].offset);
+			namesWithData |= 1u << kipPatchList[i].name_idx;
+			patchCrc = crc32c_update(patchCrc, &kipPatchList[i].offset, sizeof(kipPatchList[i].offset));
+			patchCrc = crc32c_update(patchCrc, &kipPatchList[i].length, sizeof(kipPatchList[i].length));
+			patchCrc = crc32c_update(patchCrc, db->data + kipPatchList[i].data_off, kipPatchList[i].length * 2);
+		}
 
-			if (memcmp(shaBuf, _kip_ids[currKipIdx].hash, sizeof(_kip_ids[0].hash)) != 0)
+		// Which of the requested patches this KIP gets.
+		u32 kipPatches = 0;
+		for (u32 nameIdx = 0; nameIdx < db->hdr.num_names; nameIdx++)
+		{
+			if (!(kipNames & (1u << nameIdx)))
 				continue;
 
-			// Find out which sections are affected by the enabled patches, to know which to decompress.
-			bitsAffected = 0;
-			currPatchset = _kip_ids[currKipIdx].patchset;
-			while (currPatchset != NULL && currPatchset->name != NULL)
+			kipPatches |= reqMasks[nameIdx];
+			if (!(namesWithData & (1u << nameIdx)))
 			{
-				if (currPatchset->patches != NULL)
-				{
-					for (u32 currEnabIdx=0; currEnabIdx<numPatches; currEnabIdx++)
-					{
-						if (strcmp(currPatchset->name, patches[currEnabIdx]))
-							continue;
-
-						for (const kip1_patch_t* currPatch=currPatchset->patches; currPatch != NULL && currPatch->length != 0; currPatch++)
-							bitsAffected |= 1u << GET_KIP_PATCH_SECTION(currPatch->offset);
-					}
-				}		
-				currPatchset++;
+				gfx_printf(&gfx_con, "Patch '%s' not necessary for %s KIP1\n", db->names[nameIdx], (const char*)ki->kip1->name);
+				patchesApplied |= reqMasks[nameIdx];
 			}
+		}
 
-			// Got patches to apply to this kip, have to decompress it.
+		if (!bitsAffected)
+			continue;
+
+		// A previous boot may have stored the finished KIP already.
+		u8 cacheKey[0x20];
+		_pkg2_kip_cache_key(cacheKey, ki->hash, patchCrc, patches, numPatches, kipPatches);
+		if (_pkg2_kip_cache_load(ki, cacheKey, arena))
+		{
+			gfx_printf(&gfx_con, "Loaded patched %s KIP1 from cache\n", (const char*)ki->kip1->name);
+			patchesApplied |= kipPatches;
+			continue;
+		}
+
+		// Got patches to apply to this kip, have to decompress it.
 #ifdef DEBUG_PRINTING
-			u32 preDecompTime = get_tmr_us();
+		u32 preDecompTime = get_tmr_us();
 #endif
-			if (pkg2_decompress_kip(ki, bitsAffected))
-				return (const char*)ki->kip1->name; // Failed to decompress.
+		if (pkg2_decompress_kip(ki, bitsAffected, arena))
+			return (const char*)ki->kip1->name; // Failed to decompress.
 
 #ifdef DEBUG_PRINTING
-			u32 postDecompTime = get_tmr_us();
-			if (!se_calc_sha256(shaBuf, ki->kip1, ki->size))
-				memset(shaBuf, 0, sizeof(shaBuf));
+		u32 postDecompTime = get_tmr_us();
+		u32 shaBuf[32/sizeof(u32)];
+		if (!se_calc_sha256(shaBuf, ki->kip1, ki->size))
+			memset(shaBuf, 0, sizeof(shaBuf));
 
-			DPRINTF("%dms %s KIP1 size %d hash %08X\n", (postDecompTime-preDecompTime)/1000, ki->kip1->name, (int)ki->size, __builtin_bswap32(shaBuf[0]));
+		DPRINTF("%dms %s KIP1 size %d hash %08X\n", (postDecompTime-preDecompTime)/1000, ki->kip1->name, (int)ki->size, __builtin_bswap32(shaBuf[0]));
 #endif
 
-			currPatchset = _kip_ids[currKipIdx].patchset;
-			while (currPatchset != NULL && currPatchset->name != NULL)
+		u32 sectOff[KIP1_NUM_SECTIONS];
+		u32 off = 0;
+		for (u32 currSectIdx = 0; currSectIdx < KIP1_NUM_SECTIONS; currSectIdx++)
+		{
+			sectOff[currSectIdx] = off;
+			off += ki->kip1->sections[currSectIdx].size_comp;
+		}
+
+		u32 prevName = KIP1_PATCH_DB_MAX_NAMES;
+		u32 prevSect = KIP1_NUM_SECTIONS;
+		for (u32 i = 0; i < kip->num_patches; i++)
+		{
+			const kip1_db_patch_t *currPatch = &kipPatchList[i];
+			if (!(kipNames & (1u << currPatch->name_idx)))
+				continue;
+
+			u32 currSectIdx = GET_KIP_PATCH_SECTION(currPatch->offset);
+			if (currPatch->name_idx != prevName || currSectIdx != prevSect)
 			{
-				for (u32 currEnabIdx=0; currEnabIdx<numPatches; currEnabIdx++)
-				{
-					if (strcmp(currPatchset->name, patches[currEnabIdx]))
-						continue;
-
-					u32 appliedMask = 1u << currEnabIdx;
-					if (currPatchset->patches == NULL)
-					{
-						gfx_printf(&gfx_con, "Patch '%s' not necessary for %s KIP1\n", currPatchset->name, (const char*)ki->kip1->name);
-						patchesApplied |= appliedMask;
-						break;
-					}
-
-					unsigned char* kipSectData = ki->kip1->data;
-					for (u32 currSectIdx=0; currSectIdx<KIP1_NUM_SECTIONS; currSectIdx++)
-					{
-						if (bitsAffected & (1u << currSectIdx))
-						{
-							gfx_printf(&gfx_con, "Applying patch '%s' on %s KIP1 sect %d\n", currPatchset->name, (const char*)ki->kip1->name, currSectIdx);
-							for (const kip1_patch_t* currPatch=currPatchset->patches;currPatch != NULL && currPatch->length != 0; currPatch++)
-							{
-								if (GET_KIP_PATCH_SECTION(currPatch->offset) != currSectIdx)
-									continue;
-
-								u32 currOffset = GET_KIP_PATCH_OFFSET(currPatch->offset);
-								if (memcmp(&kipSectData[currOffset], currPatch->srcData, currPatch->length) != 0)
-								{
-									gfx_printf(&gfx_con, "%kDATA MISMATCH FOR PATCH AT OFFSET 0x%x!!!%k\n", 0xFFFF0000, currOffset, 0xFFCCCCCC);
-									return currPatchset->name; // MUST stop here as kip is likely corrupt.
-								}
-								else
-								{
-									DPRINTF("Patching %d bytes at offset 0x%x\n", currPatch->length, currOffset);
-									memcpy(&kipSectData[currOffset], currPatch->dstData, currPatch->length);
-								}
-							}
-						}
-						kipSectData += ki->kip1->sections[currSectIdx].size_comp;
-					}
-					
-					patchesApplied |= appliedMask;
-					break;
-				}
-				currPatchset++;
+				gfx_printf(&gfx_con, "Applying patch '%s' on %s KIP1 sect %d\n", db->names[currPatch->name_idx], (const char*)ki->kip1->name, currSectIdx);
+				prevName = currPatch->name_idx;
+				prevSect = currSectIdx;
 			}
+
+			u32 currOffset = GET_KIP_PATCH_OFFSET(currPatch->offset);
+			unsigned char* kipSectData = ki->kip1->data + sectOff[currSectIdx];
+			const u8 *srcData = db->data + currPatch->data_off;
+			if (currOffset + currPatch->length > ki->kip1->sections[currSectIdx].size_comp ||
+				memcmp(&kipSectData[currOffset], srcData, currPatch->length) != 0)
+			{
+				gfx_printf(&gfx_con, "%kDATA MISMATCH FOR PATCH AT OFFSET 0x%x!!!%k\n", 0xFFFF0000, currOffset, 0xFFCCCCCC);
+				return db->names[currPatch->name_idx]; // MUST stop here as kip is likely corrupt.
+			}
+
+			DPRINTF("Patching %d bytes at offset 0x%x\n", currPatch->length, currOffset);
+			memcpy(&kipSectData[currOffset], srcData + currPatch->length, currPatch->length);
 		}
+		patchesApplied |= kipPatches;
+
+		_pkg2_kip_cache_save(ki, cacheKey);
 	}
 
 	for (u32 i=0; i<numPatches; i++)
@@ -737,38 +1219,72 @@ const char* pkg2_patch_kips(link_t *info, char* patchNames)
 	return NULL;
 }
 
-pkg2_hdr_t *pkg2_decrypt(void *data)
+/*
+ * Decrypts package2 in place as it arrives. avail is how many bytes from the start of the
+ * package are in memory and done how many are already decrypted, so it can be called after
+ * every chunk of a read while the next one is still in flight. Sections outside sec_mask
+ * are skipped and stay encrypted.
+ */
+int pkg2_decrypt_partial(void *data, u32 *done, u32 avail, u32 sec_mask)
 {
 	u8 *pdata = (u8 *)data;
-	
-	// Skip signature.
-	pdata += 0x100;
-
-	pkg2_hdr_t *hdr = (pkg2_hdr_t *)pdata;
-
-	// Skip header.
-	pdata += sizeof(pkg2_hdr_t);
+	pkg2_hdr_t *hdr = (pkg2_hdr_t *)(pdata + 0x100);
+	u32 off = 0x100 + sizeof(pkg2_hdr_t);
 
 	// Decrypt header.
-	se_aes_crypt_ctr(8, hdr, sizeof(pkg2_hdr_t), hdr, sizeof(pkg2_hdr_t), hdr);
-	//gfx_hexdump(&gfx_con, (u32)hdr, hdr, 0x100);
+	if (*done < off)
+	{
+		if (avail < off)
+			return 1;
 
-	if (hdr->magic != PKG2_MAGIC)
-		return NULL;
+		se_aes_crypt_ctr(8, hdr, sizeof(pkg2_hdr_t), hdr, sizeof(pkg2_hdr_t), hdr);
+		//gfx_hexdump(&gfx_con, (u32)hdr, hdr, 0x100);
+
+		if (hdr->magic != PKG2_MAGIC)
+			return 0;
+		*done = off;
+	}
 
 	for (u32 i = 0; i < 4; i++)
 	{
-DPRINTF("sec %d has size %08X\n", i, hdr->sec_size[i]);
-		if (!hdr->sec_size[i])
-			continue;
+		u32 sec_end = off + hdr->sec_size[i];
+		if (!(sec_mask & (1 << i)))
+		{
+			if (*done < sec_end)
+				*done = sec_end;
+		}
+		else if (*done < sec_end && avail > *done)
+		{
+			// Only whole blocks, unless the section is complete.
+			u32 to = MIN(avail, sec_end);
+			if (to != sec_end)
+				to = *done + ((to - *done) & 0xFFFFFFF0);
 
-		se_aes_crypt_ctr(8, pdata, hdr->sec_size[i], pdata, hdr->sec_size[i], &hdr->sec_ctr[i * 0x10]);
-		//gfx_hexdump(&gfx_con, (u32)pdata, pdata, 0x100);
+			if (to > *done)
+			{
+				u8 ctr[0x10];
+				memcpy(ctr, &hdr->sec_ctr[i * 0x10], 0x10);
+				_pkg2_ctr_add(ctr, (*done - off) >> 4);
+
+				se_aes_crypt_ctr(8, pdata + *done, to - *done, pdata + *done, to - *done, ctr);
+				*done = to;
+			}
+		}
 
-		pdata += hdr->sec_size[i];
+		off = sec_end;
 	}
 
-	return hdr;
+	return 1;
+}
+
+pkg2_hdr_t *pkg2_decrypt(void *data)
+{
+	u32 done = 0;
+
+	if (!pkg2_decrypt_partial(data, &done, 0xFFFFFFFF, PKG2_SEC_MASK_ALL))
+		return NULL;
+
+	return (pkg2_hdr_t *)((u8 *)data + 0x100);
 }
 
 void pkg2_build_encrypt(void *dst, void *kernel, u32 kernel_size, link_t *kips_info)
@@ -787,13 +1303,16 @@ void pkg2_build_encrypt(void *dst, void *kernel, u32 kernel_size, link_t *kips_i
 	hdr->base = 0x10000000;
 DPRINTF("kernel @ %08X (%08X)\n", (u32)kernel, kernel_size);
 
-	// Kernel.
-	memcpy(pdst, kernel, kernel_size);
+	// Kernel. It might have been loaded in place already.
+	if (pdst != kernel)
+		memcpy(pdst, kernel, kernel_size);
 	hdr->sec_size[PKG2_SEC_KERNEL] = kernel_size;
 	hdr->sec_off[PKG2_SEC_KERNEL] = 0x10000000;
-	se_aes_crypt_ctr(8, pdst, kernel_size, pdst, kernel_size, &hdr->sec_ctr[PKG2_SEC_KERNEL * 0x10]);
+	// Encrypt the kernel in the background while the KIPs are copied behind it.
+	u8 *kernel_dst = pdst;
+	int kernel_async = se_aes_crypt_ctr_submit(8, kernel_dst, kernel_size, kernel_dst, kernel_size,
+		&hdr->sec_ctr[PKG2_SEC_KERNEL * 0x10]);
 	pdst += kernel_size;
-DPRINTF("kernel encrypted\n");
 
 	// INI1.
 	u32 ini1_size = sizeof(pkg2_ini1_t);
@@ -812,6 +1331,13 @@ DPRINTF("adding kip1 '%s' @ %08X (%08X)\n", ki->kip1->name, (u32)ki->kip1, ki->s
 	ini1->size = ini1_size;
 	hdr->sec_size[PKG2_SEC_INI1] = ini1_size;
 	hdr->sec_off[PKG2_SEC_INI1] = 0x14080000;
+
+	if (kernel_async)
+		se_complete();
+	else
+		se_aes_crypt_ctr(8, kernel_dst, kernel_size, kernel_dst, kernel_size, &hdr->sec_ctr[PKG2_SEC_KERNEL * 0x10]);
+DPRINTF("kernel encrypted\n");
+
 	se_aes_crypt_ctr(8, ini1, ini1_size, ini1, ini1_size, &hdr->sec_ctr[PKG2_SEC_INI1 * 0x10]);
 DPRINTF("INI1 encrypted\n");
 
@@ -822,3 +1348,100 @@ DPRINTF("INI1 encrypted\n");
 	*(u32 *)hdr->ctr = 0x100 + sizeof(pkg2_hdr_t) + kernel_size + ini1_size;
 }
 
+/*
+ * Rebuilds a package2 that was read to PKG2_LOAD_ADDR and decrypted only where needed.
+ * KIPs that keep their offset are left in place and only what was decrypted of them is encrypted
+ * again. The others are moved or copied into place, INI1 can grow into the free memory behind it.
+ * The section counters are kept, so untouched data stays valid as it is.
+ */
+int pkg2_build_encrypt_inplace(pkg2_hdr_t *hdr, int kernel_plain, link_t *kips_info)
+{
+	pkg2_kip1_info_t *kips[PKG2_MAX_KIPS];
+	u32 dst_off[PKG2_MAX_KIPS];
+	u32 kernel_size = hdr->sec_size[PKG2_SEC_KERNEL];
+	u8 *ini1_base = hdr->data + kernel_size;
+
+	// New layout.
+	u32 num_kips = 0;
+	u32 ini1_size = sizeof(pkg2_ini1_t);
+	LIST_FOREACH_ENTRY(pkg2_kip1_info_t, ki, kips_info, link)
+	{
+		if (num_kips == PKG2_MAX_KIPS)
+			return 0;
+		kips[num_kips] = ki;
+		dst_off[num_kips++] = ini1_size;
+		ini1_size += ki->size;
+	}
+
+	// KIPs that move get decrypted first, before anything overwrites them.
+	for (u32 i = 0; i < num_kips; i++)
+		if (kips[i]->pkg2 && kips[i]->ini1_off != dst_off[i])
+			_pkg2_kip_decrypt(kips[i]);
+
+	// Move in-place KIPs towards the end back to front, then those towards the start front to back.
+	for (int i = num_kips - 1; i >= 0; i--)
+		if (kips[i]->pkg2 && kips[i]->ini1_off < dst_off[i])
+		{
+			memmove(ini1_base + dst_off[i], kips[i]->kip1, kips[i]->size);
+			kips[i]->kip1 = (pkg2_kip1_t *)(ini1_base + dst_off[i]);
+		}
+	for (u32 i = 0; i < num_kips; i++)
+		if (kips[i]->pkg2 && kips[i]->ini1_off > dst_off[i])
+		{
+			memmove(ini1_base + dst_off[i], kips[i]->kip1, kips[i]->size);
+			kips[i]->kip1 = (pkg2_kip1_t *)(ini1_base + dst_off[i]);
+		}
+
+	// Replaced, added or decompressed KIPs.
+	for (u32 i = 0; i < num_kips; i++)
+		if (!kips[i]->pkg2)
+		{
+DPRINTF("adding kip1 '%s' @ %08X (%08X)\n", kips[i]->kip1->name, (u32)kips[i]->kip1, kips[i]->size);
+			memcpy(ini1_base + dst_off[i], kips[i]->kip1, kips[i]->size);
+			kips[i]->kip1 = (pkg2_kip1_t *)(ini1_base + dst_off[i]);
+		}
+
+	// Encrypt what is plaintext now. An untouched KIP only has its header decrypted.
+	for (u32 i = 0; i < num_kips; i++)
+	{
+		pkg2_kip1_info_t *ki = kips[i];
+		u32 size = ki->size;
+		if (ki->pkg2 && ki->ini1_off == dst_off[i] && !ki->body_plain)
+			size = sizeof(pkg2_kip1_t);
+		_pkg2_crypt_range(hdr, PKG2_SEC_INI1, dst_off[i], size);
+
+		ki->pkg2 = NULL;
+	}
+
+	pkg2_ini1_t *ini1 = (pkg2_ini1_t *)ini1_base;
+	memset(ini1, 0, sizeof(pkg2_ini1_t));
+	ini1->magic = INI1_MAGIC;
+	ini1->size = ini1_size;
+	ini1->num_procs = num_kips;
+	_pkg2_crypt_range(hdr, PKG2_SEC_INI1, 0, sizeof(pkg2_ini1_t));
+DPRINTF("INI1 encrypted\n");
+
+	if (kernel_plain)
+		_pkg2_crypt_range(hdr, PKG2_SEC_KERNEL, 0, kernel_size);
+DPRINTF("kernel encrypted\n");
+
+	// Header, with the original section counters.
+	u8 sec_ctr[0x20];
+	memcpy(sec_ctr, hdr->sec_ctr, 0x20);
+	memset(hdr, 0, sizeof(pkg2_hdr_t));
+	memcpy(hdr->sec_ctr, sec_ctr, 0x20);
+	hdr->magic = PKG2_MAGIC;
+	hdr->base = 0x10000000;
+	hdr->sec_size[PKG2_SEC_KERNEL] = kernel_size;
+	hdr->sec_off[PKG2_SEC_KERNEL] = 0x10000000;
+	hdr->sec_size[PKG2_SEC_INI1] = ini1_size;
+	hdr->sec_off[PKG2_SEC_INI1] = 0x14080000;
+
+	memset((u8 *)hdr - 0x100, 0, 0x100);
+	*(u32 *)hdr->ctr = 0x100 + sizeof(pkg2_hdr_t) + kernel_size + ini1_size;
+	se_aes_crypt_ctr(8, hdr, sizeof(pkg2_hdr_t), hdr, sizeof(pkg2_hdr_t), hdr);
+	memset(hdr->ctr, 0 , 0x10);
+	*(u32 *)hdr->ctr = 0x100 + sizeof(pkg2_hdr_t) + kernel_size + ini1_size;
+
+	return 1;
+}
@@ -20,6 +20,7 @@
 
 #include "types.h"
 #include "list.h"
+#include "heap.h"
 
 #define PKG2_MAGIC 0x31324B50
 #define PKG2_SEC_BASE 0x80000000
@@ -67,6 +68,14 @@ typedef struct _pkg2_hdr_t
 	u8 data[];
 } pkg2_hdr_t;
 
+// The rebuilt package2 and where its kernel ends up (after the signature and the header).
+#define PKG2_LOAD_ADDR ((void *)MEM_PKG2_START)
+#define PKG2_KERNEL_SLOT ((void *)(MEM_PKG2_START + 0x100 + sizeof(pkg2_hdr_t)))
+// The kernel does not load more initial processes than that.
+#define PKG2_MAX_KIPS 0x50
+
+#define PKG2_SEC_MASK_ALL 0xF
+
 typedef struct _pkg2_ini1_t
 {
 	u32 magic;
@@ -104,6 +113,14 @@ typedef struct _pkg2_kip1_info_t
 {
 	pkg2_kip1_t *kip1;
 	u32 size;
+	// Set while the KIP sits in an in-place package2: its offset in INI1 and whether its body was decrypted.
+	// The header is always decrypted.
+	pkg2_hdr_t *pkg2;
+	u32 ini1_off;
+	u32 body_plain;
+	u32 from_ini1; // Came with package2, not merged in from SD.
+	u32 hashed;    // hash holds the SHA-256 of the KIP as found, computed or taken from a boot plan.
+	u8 hash[0x20];
 	link_t link;
 } pkg2_kip1_info_t;
 
@@ -134,15 +151,53 @@ typedef struct _kip1_id_t
 	kip1_patchset_t* patchset;
 } kip1_id_t;
 
-void pkg2_parse_kips(link_t *info, pkg2_hdr_t *pkg2);
+/*
+ * KIP patch database on SD, used instead of the built-in table when present.
+ * Layout: header, num_names interned patch names, num_kips KIPs sorted by hash,
+ * num_patches patches grouped by KIP, then data_size bytes of patch data.
+ */
+#define KIP1_PATCH_DB_PATH      "kip_patches.bin"
+#define KIP1_PATCH_DB_MAGIC     0x4244504B // KPDB.
+#define KIP1_PATCH_DB_MAX_NAMES 32 // One bit each.
+#define KIP1_PATCH_NAME_LEN     16
+
+typedef struct _kip1_db_hdr_t
+{
+	u32 magic;
+	u32 num_names;
+	u32 num_kips;
+	u32 num_patches;
+	u32 data_size;
+} kip1_db_hdr_t;
+
+typedef struct _kip1_db_kip_t
+{
+	u8 hash[16];      // Start of the SHA-256 of the KIP as found in package2.
+	char name[12];
+	u32 names;        // Every patch name known for this KIP, even if it needs no patching.
+	u32 first_patch;
+	u32 num_patches;
+} kip1_db_kip_t;
+
+typedef struct _kip1_db_patch_t
+{
+	u32 offset;   // Section and offset, like kip1_patch_t.
+	u32 length;
+	u32 name_idx;
+	u32 data_off; // Source bytes, followed by as many replacement bytes.
+} kip1_db_patch_t;
+
+void pkg2_parse_kips(link_t *info, pkg2_hdr_t *pkg2, arena_t *arena, int ini1_encrypted);
 int pkg2_has_kip(link_t *info, u64 tid);
 void pkg2_replace_kip(link_t *info, u64 tid, pkg2_kip1_t *kip1);
-void pkg2_add_kip(link_t *info, pkg2_kip1_t *kip1);
-void pkg2_merge_kip(link_t *info, pkg2_kip1_t *kip1);
-const char* pkg2_patch_kips(link_t *info, char* patchNames);
+void pkg2_add_kip(link_t *info, pkg2_kip1_t *kip1, arena_t *arena);
+void pkg2_merge_kip(link_t *info, pkg2_kip1_t *kip1, arena_t *arena);
+const char* pkg2_patch_kips(link_t *info, char* patchNames, arena_t *arena);
 
 const pkg2_kernel_id_t *pkg2_identify(u32 id);
+int pkg2_decrypt_partial(void *data, u32 *done, u32 avail, u32 sec_mask);
 pkg2_hdr_t *pkg2_decrypt(void *data);
 void pkg2_build_encrypt(void *dst, void *kernel, u32 kernel_size, link_t *kips_info);
+int pkg2_build_encrypt_inplace(pkg2_hdr_t *hdr, int kernel_plain, link_t *kips_info);
 
 #endif
@@ -45,6 +45,7 @@
 #define APBDEV_PMC_UTMIP_PAD_CFG1 0x4C4
 #define APBDEV_PMC_UTMIP_PAD_CFG3 0x4CC
 #define APBDEV_PMC_DDR_CNTRL 0x4E4
+#define APBDEV_PMC_SCRATCH117 0x6F4
 #define APBDEV_PMC_SCRATCH188 0x810
 #define APBDEV_PMC_SCRATCH190 0x818
 #define APBDEV_PMC_SCRATCH200 0x840
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "power.h"
+#include "bpmp.h"
+#include "sdram.h"
+#include "sensors.h"
+#include "util.h"
+
+static void _power_gov_apply(u32 level)
+{
+	if (level == POWER_GOV_FULL)
+	{
+		bpmp_clk_boost();
+		sdram_perf_mode(1);
+	}
+	else
+	{
+		bpmp_clk_rate_set(BPMP_CLK_NORMAL);
+		sdram_perf_mode(0);
+	}
+}
+
+static int _power_gov_fits(power_gov_t *gov, const sensors_t *sensors, u64 done, u64 left, u32 now)
+{
+	u32 elapsed = now - gov->start_ms;
+	u64 moved = done - gov->start_done;
+	int drain = -sensors->batt_curr;
+
+	// No estimate until the job has run for a while.
+	if (elapsed < POWER_GOV_INTERVAL_MS || !moved || drain <= 0 || !sensors->batt_percent)
+		return 1;
+
+	u64 secs_left = left * elapsed / moved / 1000;
+	u64 need = (u64)drain * secs_left / 3600000; // mAh.
+
+	// RepCap counts down to empty, the reserve is its share of the RepSOC.
+	u32 reserve = (u64)sensors->batt_cap * POWER_GOV_CRIT_SOC / sensors->batt_percent;
+	if ((u32)sensors->batt_cap <= reserve)
+		return 0;
+
+	return need * POWER_GOV_MARGIN <= sensors->batt_cap - reserve;
+}
+
+int power_on_charger()
+{
+	const sensors_t *sensors = sensors_get(SENSORS_MAX_AGE_MS);
+
+	// Pre-charge, fast charge and termination done all mean there is input power.
+	if ((sensors->valid & SENSORS_CHRG_VALID) && sensors->chrg_status)
+		return 1;
+
+	return (sensors->valid & SENSORS_BATT_VALID) && sensors->batt_curr > 0;
+}
+
+void power_gov_start(power_gov_t *gov, u64 done)
+{
+	gov->level = POWER_GOV_FULL;
+	gov->start_ms = get_tmr_ms();
+	gov->start_done = done;
+
+	// Charger and reserve are checked on the first update.
+	gov->check_ms = gov->start_ms - POWER_GOV_INTERVAL_MS;
+}
+
+u32 power_gov_update(power_gov_t *gov, u64 done, u64 left)
+{
+	u32 now = get_tmr_ms();
+	if (now - gov->check_ms < POWER_GOV_INTERVAL_MS)
+		return gov->level;
+	gov->check_ms = now;
+
+	const sensors_t *sensors = sensors_get(SENSORS_MAX_AGE_MS);
+
+	// A fuel gauge that doesn't answer gets the benefit of the doubt, like the boost does.
+	u32 level = gov->level;
+	if (!(sensors->valid & SENSORS_BATT_VALID) || power_on_charger())
+		level = POWER_GOV_FULL;
+	else if (sensors->batt_percent < POWER_GOV_CRIT_SOC ||
+		(sensors->batt_volt && sensors->batt_volt < POWER_GOV_CRIT_VCELL))
+		level = POWER_GOV_CRITICAL;
+	// Once slowed down, only the charger brings the speed back, so it doesn't flap.
+	else if (level == POWER_GOV_FULL && !_power_gov_fits(gov, sensors, done, left, now))
+		level = POWER_GOV_SAVE;
+	else if (level == POWER_GOV_CRITICAL)
+		level = POWER_GOV_SAVE;
+
+	// Applied every time, as a nested job (a verify within a backup) may have moved the clocks.
+	_power_gov_apply(level);
+	gov->level = level;
+
+	return level;
+}
+
+void power_gov_end(power_gov_t *gov)
+{
+	if (gov->level != POWER_GOV_FULL)
+		_power_gov_apply(POWER_GOV_FULL);
+	gov->level = POWER_GOV_FULL;
+}
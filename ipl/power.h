@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _POWER_H_
+#define _POWER_H_
+
+#include "types.h"
+
+/*! Governor levels, from the fastest to stopping. */
+#define POWER_GOV_FULL     0 // On charger or with charge to spare: boosted BPMP and EMC.
+#define POWER_GOV_SAVE     1 // The job would eat into the reserve: base clocks, DRAM power saving back on.
+#define POWER_GOV_CRITICAL 2 // Checkpoint and stop, or wait for the charger.
+
+/*! How often the job estimate is redone. The sensor cache refreshes on the same period. */
+#define POWER_GOV_INTERVAL_MS 5000
+/*! Reserve kept for the console to boot and charge (1/256% units and mV). */
+#define POWER_GOV_CRIT_SOC   (3 << 8)
+#define POWER_GOV_CRIT_VCELL 3300
+/*! The remaining job has to fit this many times into the charge above the reserve. */
+#define POWER_GOV_MARGIN 2
+
+typedef struct _power_gov_t
+{
+	u32 level;
+	u32 start_ms;
+	u32 check_ms;
+	u64 start_done;
+} power_gov_t;
+
+/*! Starts governing a job. The caller has the clocks boosted already. */
+void power_gov_start(power_gov_t *gov, u64 done);
+/*! Re-evaluates every POWER_GOV_INTERVAL_MS, with bytes done and left, and applies the level. Returns it. */
+u32 power_gov_update(power_gov_t *gov, u64 done, u64 left);
+/*! The job ended. Puts back the boosted clocks if they were lowered. */
+void power_gov_end(power_gov_t *gov);
+/*! Returns 1 when external power is connected. */
+int power_on_charger();
+
+#endif
@@ -21,6 +21,7 @@
 #include "sd.h"
 #include "util.h"
 #include "heap.h"
+#include "trace.h"
 
 /*#include "gfx.h"
 extern gfx_ctxt_t gfx_ctxt;
@@ -28,6 +29,25 @@ extern gfx_con_t gfx_con;
 #define DPRINTF(...) gfx_printf(&gfx_con, __VA_ARGS__)*/
 #define DPRINTF(...)
 
+// Last eMMC mode that switched successfully and the tap found by its tuning.
+static u32 _mmc_best_type = 0;
+static struct
+{
+	u32 valid;
+	u8 cid[0x10];
+	u32 tap;
+} _mmc_tap_cache = { 0 };
+
+// Last SD card mode that worked, per card, and the tap found by its tuning.
+static struct
+{
+	u32 valid;
+	u8 cid[0x10];
+	u32 type;
+	u32 tap_valid;
+	u32 tap;
+} _sd_mode_cache = { 0 };
+
 static inline u32 unstuff_bits(u32 *resp, u32 start, u32 size)
 {
 	const u32 mask = (size < 32 ? 1 << size : 0) - 1;
@@ -128,8 +148,39 @@ static int _sdmmc_storage_check_status(sdmmc_storage_t *storage)
 	return _sdmmc_storage_get_status(storage, &tmp, 0);
 }
 
-static int _sdmmc_storage_readwrite_ex(sdmmc_storage_t *storage, u32 *blkcnt_out, u32 sector, u32 num_sectors, void *buf, u32 is_write)
+// Pre-defined multi-block transfer, so no CMD12 is needed.
+static int _sdmmc_storage_set_block_count(sdmmc_storage_t *storage, u32 num_sectors, u32 is_write)
+{
+	u32 arg = num_sectors & 0xFFFF;
+	if (is_write && storage->reliable_write)
+		arg |= 1u << 31;
+	return _sdmmc_storage_execute_cmd_type1(storage, MMC_SET_BLOCK_COUNT, arg, 0, R1_STATE_TRAN);
+}
+
+static int _sd_storage_execute_app_cmd_type1(sdmmc_storage_t *storage, u32 *resp, u32 cmd, u32 arg, u32 check_busy, u32 expected_state);
+
+// Tells the SD card how many blocks are coming, so it can pre-erase them.
+static int _sd_storage_set_wr_blk_erase_count(sdmmc_storage_t *storage, u32 num_sectors)
+{
+	u32 tmp = 0;
+	return _sd_storage_execute_app_cmd_type1(storage, &tmp, SD_APP_SET_WR_BLK_ERASE_COUNT, num_sectors & 0x7FFFFF, 0, R1_STATE_TRAN);
+}
+
+// On failure, err_out gets the controller errors of the failed command. The recovery commands clear them.
+static int _sdmmc_storage_readwrite_ex(sdmmc_storage_t *storage, u32 *blkcnt_out, u32 *status_out, u32 *err_out,
+	u32 sector, u32 num_sectors, void *buf, u32 is_write)
 {
+	if (storage->use_cmd23 && !_sdmmc_storage_set_block_count(storage, num_sectors, is_write))
+	{
+		*err_out = sdmmc_get_error(storage->sdmmc);
+		_sdmmc_storage_get_status(storage, status_out, 0);
+		return 0;
+	}
+
+	// Not fatal, the card just loses the hint.
+	if (is_write && storage->sd_pre_erase && num_sectors > 1)
+		_sd_storage_set_wr_blk_erase_count(storage, num_sectors);
+
 	sdmmc_cmd_t cmdbuf;
 	sdmmc_init_cmd(&cmdbuf, is_write ? MMC_WRITE_MULTIPLE_BLOCK : MMC_READ_MULTIPLE_BLOCK, sector, SDMMC_RSP_TYPE_1, 0);
 
@@ -139,13 +190,15 @@ static int _sdmmc_storage_readwrite_ex(sdmmc_storage_t *storage, u32 *blkcnt_out
 	reqbuf.blksize = 512;
 	reqbuf.is_write = is_write;
 	reqbuf.is_multi_block = 1;
-	reqbuf.is_auto_cmd12 = 1;
+	reqbuf.is_auto_cmd12 = !storage->use_cmd23;
+	reqbuf.sg_cnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, blkcnt_out))
 	{
+		*err_out = sdmmc_get_error(storage->sdmmc);
 		u32 tmp = 0;
 		sdmmc_stop_transmission(storage->sdmmc, &tmp);
-		_sdmmc_storage_get_status(storage, &tmp, 0);
+		_sdmmc_storage_get_status(storage, status_out, 0);
 		return 0;
 	}
 	return 1;
@@ -153,51 +206,237 @@ static int _sdmmc_storage_readwrite_ex(sdmmc_storage_t *storage, u32 *blkcnt_out
 
 int sdmmc_storage_end(sdmmc_storage_t *storage)
 {
+	// Do not lose cached writes on power down.
+	if (storage->cache_enabled)
+		sdmmc_storage_flush_cache(storage);
+
 	if (!_sdmmc_storage_go_idle_state(storage))
 		return 0;
 	sdmmc_end(storage->sdmmc);
 	return 1;
 }
 
+#define SDMMC_RW_RETRIES 10
+
 static int _sdmmc_storage_readwrite(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf, u32 is_write)
 {
 	u8 *bbuf = (u8 *)buf;
+	u32 retries = SDMMC_RW_RETRIES;
+	u32 crc_errors = 0;
+	u32 backoff = 10;
+	int res = 1;
 
 	while (num_sectors)
 	{
 		u32 blkcnt = 0;
-		//Retry 9 times on error.
-		u32 retries = 10;
-		do
-		{
-			if (_sdmmc_storage_readwrite_ex(storage, &blkcnt, sector, MIN(num_sectors, 0xFFFF), bbuf, is_write))
-				goto out;
-			else
-				retries--;
+		u32 status = 0;
+		u32 err = 0;
+		u32 cnt = MIN(num_sectors, 0xFFFF);
+		// Keep each write inside one allocation unit of the SD card.
+		if (is_write && storage->write_align)
+			cnt = MIN(cnt, storage->write_align - (sector & (storage->write_align - 1)));
 
-			msleep(100);
-		} while (retries);
-		return 0;
+		int ok = _sdmmc_storage_readwrite_ex(storage, &blkcnt, &status, &err, sector, cnt, bbuf, is_write);
 
-out:;
 		DPRINTF("readwrite: %08X\n", blkcnt);
 		sector += blkcnt;
 		num_sectors -= blkcnt;
 		bbuf += 512 * blkcnt;
+
+		if (ok)
+			continue;
+
+		trace_event(is_write ? "sdmmc write err" : "sdmmc read err", sector, status);
+
+		// Resume from the blocks the controller completed. Progress resets the retry budget.
+		if (blkcnt)
+		{
+			retries = SDMMC_RW_RETRIES;
+			backoff = 10;
+		}
+
+		// Card state errors do not go away by retrying.
+		if (status & (R1_OUT_OF_RANGE | R1_ADDRESS_ERROR | R1_WP_VIOLATION))
+		{
+			res = 0;
+			break;
+		}
+
+		if (!--retries)
+		{
+			res = 0;
+			break;
+		}
+		sdmmc_get_stats(storage->sdmmc->id)->rw_retries++;
+
+		if (err & SDMMC_ERR_CRC_MASK)
+		{
+			// Repeated CRC errors point to a marginal bus. Continue at half clock for the rest of the transfer.
+			if (++crc_errors >= 2)
+				sdmmc_set_clock_slowdown(storage->sdmmc, 1);
+			msleep(1);
+		}
+		else
+		{
+			// Timeouts and busy cards need time, back off up to 320ms.
+			msleep(backoff);
+			backoff = MIN(backoff << 1, 320);
+		}
+	}
+
+	sdmmc_set_clock_slowdown(storage->sdmmc, 0);
+	return res;
+}
+
+#define SDMMC_BOUNCE_SECTORS 64
+
+// ADMA cannot reach buffers that are not 8-byte aligned. Move those through a DMA buffer instead.
+static int _sdmmc_storage_readwrite_bounce(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf, u32 is_write)
+{
+	u8 *bbuf = (u8 *)buf;
+	u8 *bounce = (u8 *)dma_malloc(MIN(num_sectors, SDMMC_BOUNCE_SECTORS) * 512);
+	int res = 1;
+
+	while (num_sectors)
+	{
+		u32 cnt = MIN(num_sectors, SDMMC_BOUNCE_SECTORS);
+		if (is_write)
+			memcpy(bounce, bbuf, cnt * 512);
+		if (!_sdmmc_storage_readwrite(storage, sector, cnt, bounce, is_write))
+		{
+			res = 0;
+			break;
+		}
+		if (!is_write)
+			memcpy(bbuf, bounce, cnt * 512);
+
+		sector += cnt;
+		num_sectors -= cnt;
+		bbuf += cnt * 512;
+	}
+
+	free(bounce);
+	return res;
+}
+
+static int _sdmmc_storage_extmap_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, u8 *buf)
+{
+	const sdmmc_extmap_t *map = storage->extmap;
+	if (sector >= map->num_sectors || num_sectors > map->num_sectors - sector)
+		return 0;
+
+	// Last extent starting at or before the sector.
+	u32 lo = 0;
+	u32 hi = map->num_extents;
+	while (hi - lo > 1)
+	{
+		u32 mid = (lo + hi) / 2;
+		if (map->extents[mid].sector <= sector)
+			lo = mid;
+		else
+			hi = mid;
 	}
+
+	// One multi-block read per extent touched.
+	for (const sdmmc_extent_t *ext = &map->extents[lo]; num_sectors; ext++)
+	{
+		u32 off = sector - ext->sector;
+		u32 cnt = MIN(num_sectors, ext->num_sectors - off);
+		if (!sdmmc_storage_read(map->target, ext->target + off, cnt, buf))
+			return 0;
+
+		sector += cnt;
+		num_sectors -= cnt;
+		buf += cnt * 512;
+	}
+
 	return 1;
 }
 
 int sdmmc_storage_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf)
 {
+	if (storage->extmap)
+		return _sdmmc_storage_extmap_read(storage, sector, num_sectors, (u8 *)buf);
+	if ((u32)buf & (DMA_ALIGN - 1))
+		return _sdmmc_storage_readwrite_bounce(storage, sector, num_sectors, buf, 0);
 	return _sdmmc_storage_readwrite(storage, sector, num_sectors, buf, 0);
 }
 
 int sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf)
 {
+	// Images are only booted from.
+	if (storage->extmap)
+		return 0;
+	if ((u32)buf & (DMA_ALIGN - 1))
+		return _sdmmc_storage_readwrite_bounce(storage, sector, num_sectors, buf, 1);
 	return _sdmmc_storage_readwrite(storage, sector, num_sectors, buf, 1);
 }
 
+/*
+* Asynchronous transfers. Only one request per controller can be in flight.
+*/
+
+int sdmmc_storage_submit(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf, u32 is_write)
+{
+	if (!num_sectors || num_sectors > 0xFFFF)
+		return 0;
+	// The target controller is shared with FatFs, callers fall back to blocking reads.
+	if (storage->extmap)
+		return 0;
+
+	if (storage->use_cmd23 && !_sdmmc_storage_set_block_count(storage, num_sectors, is_write))
+		return 0;
+	if (is_write && storage->sd_pre_erase && num_sectors > 1)
+		_sd_storage_set_wr_blk_erase_count(storage, num_sectors);
+
+	sdmmc_cmd_t cmdbuf;
+	sdmmc_init_cmd(&cmdbuf, is_write ? MMC_WRITE_MULTIPLE_BLOCK : MMC_READ_MULTIPLE_BLOCK, sector, SDMMC_RSP_TYPE_1, 0);
+
+	sdmmc_req_t reqbuf;
+	reqbuf.buf = buf;
+	reqbuf.num_sectors = num_sectors;
+	reqbuf.blksize = 512;
+	reqbuf.is_write = is_write;
+	reqbuf.is_multi_block = 1;
+	reqbuf.is_auto_cmd12 = !storage->use_cmd23;
+	reqbuf.sg_cnt = 0;
+
+	if (!sdmmc_execute_cmd_async(storage->sdmmc, &cmdbuf, &reqbuf))
+	{
+		u32 tmp = 0;
+		sdmmc_stop_transmission(storage->sdmmc, &tmp);
+		_sdmmc_storage_get_status(storage, &tmp, 0);
+		return 0;
+	}
+	return 1;
+}
+
+int sdmmc_storage_poll(sdmmc_storage_t *storage)
+{
+	if (storage->extmap || !storage->sdmmc->req_pending)
+		return SDMMC_ASYNC_ERROR;
+
+	int res = sdmmc_poll_cmd(storage->sdmmc, 0);
+	if (res == SDMMC_ASYNC_ERROR)
+	{
+		u32 tmp = 0;
+		sdmmc_stop_transmission(storage->sdmmc, &tmp);
+		_sdmmc_storage_get_status(storage, &tmp, 0);
+	}
+	return res;
+}
+
+int sdmmc_storage_complete(sdmmc_storage_t *storage)
+{
+	int res;
+	do
+	{
+		res = sdmmc_storage_poll(storage);
+	} while (res == SDMMC_ASYNC_PENDING);
+
+	return res == SDMMC_ASYNC_DONE;
+}
+
 /*
 * MMC specific functions.
 */
@@ -320,6 +559,13 @@ static void _mmc_storage_parse_ext_csd(sdmmc_storage_t *storage, u8 *buf)
 	storage->ext_csd.bkops = buf[EXT_CSD_BKOPS_SUPPORT];
 	storage->ext_csd.bkops_en = buf[EXT_CSD_BKOPS_EN];
 	storage->ext_csd.bkops_status = buf[EXT_CSD_BKOPS_STATUS];
+	storage->ext_csd.pwr_cl_52_195 = buf[EXT_CSD_PWR_CL_52_195];
+	storage->ext_csd.pwr_cl_200_195 = buf[EXT_CSD_PWR_CL_200_195];
+	storage->ext_csd.pwr_cl_ddr_200_360 = buf[EXT_CSD_PWR_CL_DDR_200_360];
+	storage->ext_csd.erased_mem_cont = buf[EXT_CSD_ERASED_MEM_CONT];
+	storage->ext_csd.sec_feature = buf[EXT_CSD_SEC_FEATURE_SUPPORT];
+	storage->ext_csd.trim_mult = buf[EXT_CSD_TRIM_MULT];
+	storage->ext_csd.cache_size = *(u32 *)&buf[EXT_CSD_CACHE_SIZE];
 
 	storage->sec_cnt  = *(u32 *)&buf[EXT_CSD_SEC_CNT];
 }
@@ -336,6 +582,7 @@ static int _mmc_storage_get_ext_csd(sdmmc_storage_t *storage, void *buf)
 	reqbuf.is_write = 0;
 	reqbuf.is_multi_block = 0;
 	reqbuf.is_auto_cmd12 = 0;
+	reqbuf.sg_cnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, 0))
 		return 0;
@@ -399,8 +646,28 @@ static int _mmc_storage_enable_HS200(sdmmc_storage_t *storage)
 		return 0;
 	if (!sdmmc_setup_clock(storage->sdmmc, 3))
 		return 0;
+
+	// Reuse the tap of the last tuning of this chip, if a data transfer still works with it.
+	if (_mmc_tap_cache.valid && !memcmp(_mmc_tap_cache.cid, storage->raw_cid, 0x10))
+	{
+		u8 *buf = (u8 *)dma_malloc(512);
+		sdmmc_set_tuned_tap(storage->sdmmc, _mmc_tap_cache.tap);
+		int res = _mmc_storage_get_ext_csd(storage, buf);
+		free(buf);
+		if (res)
+		{
+			DPRINTF("[MMC] switched to HS200 (cached tap)\n");
+			storage->csd.busspeed = 200;
+			return _sdmmc_storage_check_status(storage);
+		}
+		_mmc_tap_cache.valid = 0;
+	}
+
 	if (!sdmmc_config_tuning(storage->sdmmc, 3, MMC_SEND_TUNING_BLOCK_HS200))
 		return 0;
+	memcpy(_mmc_tap_cache.cid, storage->raw_cid, 0x10);
+	_mmc_tap_cache.tap = sdmmc_get_tuned_tap(storage->sdmmc);
+	_mmc_tap_cache.valid = 1;
 	DPRINTF("[MMC] switched to HS200\n");
 	storage->csd.busspeed = 200;
 	return _sdmmc_storage_check_status(storage);
@@ -424,27 +691,48 @@ static int _mmc_storage_enable_HS400(sdmmc_storage_t *storage)
 	return _sdmmc_storage_check_status(storage);
 }
 
+// Power class for the selected mode, from the EXT_CSD power class fields of the bus width in use.
+static void _mmc_storage_set_power_class(sdmmc_storage_t *storage, u32 pwr_cl)
+{
+	if (sdmmc_get_bus_width(storage->sdmmc) == SDMMC_BUS_WIDTH_8)
+		pwr_cl = (pwr_cl & EXT_CSD_PWR_CL_8BIT_MASK) >> EXT_CSD_PWR_CL_8BIT_SHIFT;
+	else
+		pwr_cl = (pwr_cl & EXT_CSD_PWR_CL_4BIT_MASK) >> EXT_CSD_PWR_CL_4BIT_SHIFT;
+
+	if (!pwr_cl)
+		return;
+
+	if (_mmc_storage_switch(storage, SDMMC_SWITCH(MMC_SWITCH_MODE_WRITE_BYTE, EXT_CSD_POWER_CLASS, pwr_cl)) &&
+		_sdmmc_storage_check_status(storage))
+		DPRINTF("[MMC] power class set to %d\n", pwr_cl);
+}
+
+// Switches to the fastest mode the chip supports, up to type (4: HS400, 3: HS200, 2: HS52).
 static int _mmc_storage_enable_highspeed(sdmmc_storage_t *storage, u32 card_type, u32 type)
 {
-	//TODO: this should be a config item.
-	//---v
-	if (!1 || sdmmc_get_voltage(storage->sdmmc) != SDMMC_POWER_1_8)
+	u32 bus_width = sdmmc_get_bus_width(storage->sdmmc);
+
+	if (sdmmc_get_voltage(storage->sdmmc) != SDMMC_POWER_1_8)
 		goto out;
 
-	if (sdmmc_get_bus_width(storage->sdmmc) == SDMMC_BUS_WIDTH_8 &&
-		card_type & EXT_CSD_CARD_TYPE_HS400_1_8V &&
-		type == 4)
+	if (type >= 4 && bus_width == SDMMC_BUS_WIDTH_8 && card_type & EXT_CSD_CARD_TYPE_HS400_1_8V)
+	{
+		_mmc_storage_set_power_class(storage, storage->ext_csd.pwr_cl_ddr_200_360);
 		return _mmc_storage_enable_HS400(storage);
+	}
 
-	if (sdmmc_get_bus_width(storage->sdmmc) == SDMMC_BUS_WIDTH_8 ||
-		(sdmmc_get_bus_width(storage->sdmmc) == SDMMC_BUS_WIDTH_4
-		&& card_type & EXT_CSD_CARD_TYPE_HS200_1_8V
-		&& (type == 4 || type == 3)))
+	if (type >= 3 && bus_width != SDMMC_BUS_WIDTH_1 && card_type & EXT_CSD_CARD_TYPE_HS200_1_8V)
+	{
+		_mmc_storage_set_power_class(storage, storage->ext_csd.pwr_cl_200_195);
 		return _mmc_storage_enable_HS200(storage);
+	}
 
 out:;
 	if (card_type & EXT_CSD_CARD_TYPE_HS_52)
+	{
+		_mmc_storage_set_power_class(storage, storage->ext_csd.pwr_cl_52_195);
 		return _mmc_storage_enable_HS(storage, 1);
+	}
 	return 1;
 }
 
@@ -455,7 +743,8 @@ static int _mmc_storage_enable_bkops(sdmmc_storage_t *storage)
 	return _sdmmc_storage_check_status(storage);
 }
 
-int sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32 bus_width, u32 type)
+// Returns 1 on success, 0 on failure and -1 if only the high speed mode switch failed.
+static int _mmc_storage_init(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32 bus_width, u32 type)
 {
 	memset(storage, 0, sizeof(sdmmc_storage_t));
 	storage->sdmmc = sdmmc;
@@ -512,7 +801,7 @@ int sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32
 		return 0;
 	DPRINTF("[MMC] switched buswidth\n");
 
-	u8 *ext_csd = (u8 *)malloc(512);
+	u8 *ext_csd = (u8 *)dma_malloc(512);
 	if (!_mmc_storage_get_ext_csd(storage, ext_csd))
 	{
 		free(ext_csd);
@@ -535,7 +824,7 @@ int sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32
 		DPRINTF("[MMC] BKOPS disabled\n");
 
 	if (!_mmc_storage_enable_highspeed(storage, storage->ext_csd.card_type, type))
-		return 0;
+		return -1;
 	DPRINTF("[MMC] succesfully switched to highspeed mode\n");
 
 	sdmmc_sd_clock_ctrl(storage->sdmmc, 1);
@@ -543,8 +832,99 @@ int sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32
 	return 1;
 }
 
+int sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32 bus_width, u32 type)
+{
+	// Start from the last mode that worked and step down if a mode fails to switch or tune.
+	if (_mmc_best_type && _mmc_best_type < type)
+		type = _mmc_best_type;
+
+	while (1)
+	{
+		int res = _mmc_storage_init(storage, sdmmc, id, bus_width, type);
+		if (res == 1)
+		{
+			_mmc_best_type = type;
+			return 1;
+		}
+
+		sdmmc_end(sdmmc);
+		if (!res || type <= 2)
+			return 0;
+
+		DPRINTF("[MMC] mode %d failed, falling back\n", type);
+		_mmc_tap_cache.valid = 0;
+		type--;
+	}
+}
+
+// Waits for the end of a long busy period (flush, trim) by polling the card state.
+static int _mmc_storage_wait_busy(sdmmc_storage_t *storage, u32 timeout_ms)
+{
+	u32 timeout = get_tmr_ms() + timeout_ms;
+	while (!_sdmmc_storage_check_status(storage))
+	{
+		if (get_tmr_ms() > timeout)
+			return 0;
+		msleep(1);
+	}
+	return 1;
+}
+
+int sdmmc_storage_set_cache(sdmmc_storage_t *storage, int enable)
+{
+	if (!storage->ext_csd.cache_size || !enable == !storage->cache_enabled)
+		return 0;
+
+	// Disabling the cache also flushes it.
+	if (!_mmc_storage_switch(storage, SDMMC_SWITCH(MMC_SWITCH_MODE_WRITE_BYTE, EXT_CSD_CACHE_CTRL, enable ? 1 : 0)))
+		return 0;
+	if (!_mmc_storage_wait_busy(storage, 5000))
+		return 0;
+
+	storage->cache_enabled = enable;
+	return 1;
+}
+
+int sdmmc_storage_flush_cache(sdmmc_storage_t *storage)
+{
+	if (!storage->cache_enabled)
+		return 1;
+
+	if (!_mmc_storage_switch(storage, SDMMC_SWITCH(MMC_SWITCH_MODE_WRITE_BYTE, EXT_CSD_FLUSH_CACHE, 1)))
+		return 0;
+	return _mmc_storage_wait_busy(storage, 5000);
+}
+
+// TRIM is only used where trimmed blocks read back as zeroes.
+int sdmmc_storage_can_trim(sdmmc_storage_t *storage)
+{
+	return (storage->ext_csd.sec_feature & EXT_CSD_SEC_GB_CL_EN) && !storage->ext_csd.erased_mem_cont;
+}
+
+int sdmmc_storage_trim(sdmmc_storage_t *storage, u32 sector, u32 num_sectors)
+{
+	if (!num_sectors || !sdmmc_storage_can_trim(storage))
+		return 0;
+
+	if (!_sdmmc_storage_execute_cmd_type1(storage, MMC_ERASE_GROUP_START, sector, 0, R1_STATE_TRAN))
+		return 0;
+	if (!_sdmmc_storage_execute_cmd_type1(storage, MMC_ERASE_GROUP_END, sector + num_sectors - 1, 0, R1_STATE_TRAN))
+		return 0;
+
+	// The card stays busy while trimming, so poll its state instead of waiting on DAT0.
+	u32 tmp = 0;
+	if (!_sdmmc_storage_execute_cmd_type1_ex(storage, &tmp, MMC_ERASE, MMC_TRIM_ARG, 0, 0x10, 0))
+		return 0;
+
+	// TRIM_MULT is in 300ms units per erase group. Allow a few seconds more for large ranges.
+	return _mmc_storage_wait_busy(storage, 3000 + MAX(storage->ext_csd.trim_mult, 1) * 300);
+}
+
 int sdmmc_storage_set_mmc_partition(sdmmc_storage_t *storage, u32 partition)
 {
+	if (storage->partition == partition)
+		return 1;
+
 	if (!_mmc_storage_switch(storage, SDMMC_SWITCH(MMC_SWITCH_MODE_WRITE_BYTE, EXT_CSD_PART_CONFIG, partition)))
 		return 0;
 	if (!_sdmmc_storage_check_status(storage))
@@ -700,6 +1080,7 @@ int _sd_storage_get_scr(sdmmc_storage_t *storage, u8 *buf)
 	reqbuf.is_write = 0;
 	reqbuf.is_multi_block = 0;
 	reqbuf.is_auto_cmd12 = 0;
+	reqbuf.sg_cnt = 0;
 
 	if (!_sd_storage_execute_app_cmd(storage, R1_STATE_TRAN, 0, &cmdbuf, &reqbuf, 0))
 		return 0;
@@ -732,6 +1113,7 @@ int _sd_storage_switch_get(sdmmc_storage_t *storage, void *buf)
 	reqbuf.is_write = 0;
 	reqbuf.is_multi_block = 0;
 	reqbuf.is_auto_cmd12 = 0;
+	reqbuf.sg_cnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, 0))
 		return 0;
@@ -756,6 +1138,7 @@ int _sd_storage_switch(sdmmc_storage_t *storage, void *buf, int mode, int group,
 	reqbuf.is_write = 0;
 	reqbuf.is_multi_block = 0;
 	reqbuf.is_auto_cmd12 = 0;
+	reqbuf.sg_cnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, 0))
 		return 0;
@@ -829,6 +1212,7 @@ int _sd_storage_enable_highspeed_low_volt(sdmmc_storage_t *storage, u32 type, u8
 		return 0;
 	//gfx_hexdump(&gfx_con, 0, (u8 *)buf, 64);
 
+	// Highest supported mode not faster than type. Order: SDR104, SDR50, DDR50, SDR12.
 	u32 hs_type = 0;
 	switch (type)
 	{
@@ -851,6 +1235,17 @@ int _sd_storage_enable_highspeed_low_volt(sdmmc_storage_t *storage, u32 type, u8
 			storage->csd.busspeed = 50;
 			break;
 		}
+		//Fall through.
+	case 12:
+		if (buf[13] & SD_MODE_UHS_DDR50)
+		{
+			type = 12;
+			hs_type = UHS_DDR50_BUS_SPEED;
+			DPRINTF("[SD] Bus speed set to DDR50\n");
+			storage->csd.busspeed = 50;
+			break;
+		}
+		//Fall through.
 	case 8:
 		if (!(buf[13] & SD_MODE_UHS_SDR12))
 			return 0;
@@ -863,13 +1258,39 @@ int _sd_storage_enable_highspeed_low_volt(sdmmc_storage_t *storage, u32 type, u8
 		return 0;
 		break;
 	}
+	storage->bus_type = type;
 
 	if (!_sd_storage_enable_highspeed(storage, hs_type, buf))
 		return 0;
 	if (!sdmmc_setup_clock(storage->sdmmc, type))
 		return 0;
-	if (!sdmmc_config_tuning(storage->sdmmc, type, MMC_SEND_TUNING_BLOCK))
-		return 0;
+
+	// Only SDR50 and SDR104 need tuning.
+	if (type == 10 || type == 11)
+	{
+		// Reuse the tap of the last tuning of this card, if a data transfer still works with it.
+		int tuned = 0;
+		if (_sd_mode_cache.valid && _sd_mode_cache.tap_valid && _sd_mode_cache.type == type &&
+			!memcmp(_sd_mode_cache.cid, storage->raw_cid, 0x10))
+		{
+			sdmmc_set_tuned_tap(storage->sdmmc, _sd_mode_cache.tap);
+			tuned = _sd_storage_switch_get(storage, buf);
+			if (tuned)
+				DPRINTF("[SD] using cached tap\n");
+			else
+				_sd_mode_cache.tap_valid = 0;
+		}
+
+		if (!tuned)
+		{
+			if (!sdmmc_config_tuning(storage->sdmmc, type, MMC_SEND_TUNING_BLOCK))
+				return 0;
+			storage->tuned_tap = sdmmc_get_tuned_tap(storage->sdmmc);
+		}
+		else
+			storage->tuned_tap = _sd_mode_cache.tap;
+	}
+
 	return _sdmmc_storage_check_status(storage);
 }
 
@@ -888,6 +1309,9 @@ int _sd_storage_enable_highspeed_high_volt(sdmmc_storage_t *storage, u8 *buf)
 	return sdmmc_setup_clock(storage->sdmmc, 7);
 }
 
+// AU sizes 12MB - 64MB, in sectors.
+static const u32 _sd_au_large[5] = { 24576, 32768, 49152, 65536, 131072 };
+
 static void _sd_storage_parse_ssr(sdmmc_storage_t *storage)
 {
 	// unstuff_bits supports only 4 u32 so break into 2 x 16byte groups
@@ -930,6 +1354,15 @@ static void _sd_storage_parse_ssr(sdmmc_storage_t *storage)
 	storage->ssr.video_class = unstuff_bits(raw_ssr1, 384 - 384, 8);
 
 	storage->ssr.app_class = unstuff_bits(raw_ssr2, 336 - 256, 4);
+
+	// UHS cards report the AU in their own field.
+	u32 au = unstuff_bits(raw_ssr1, 392 - 384, 4);
+	if (!au)
+		au = unstuff_bits(raw_ssr1, 428 - 384, 4);
+	if (au <= 0xA)
+		storage->ssr.au_size = au ? (32 << (au - 1)) : 0; // 16KB - 8MB.
+	else
+		storage->ssr.au_size = _sd_au_large[au - 0xB];
 }
 
 static int _sd_storage_get_ssr(sdmmc_storage_t *storage, u8 *buf)
@@ -944,6 +1377,7 @@ static int _sd_storage_get_ssr(sdmmc_storage_t *storage, u8 *buf)
 	reqbuf.is_write = 0;
 	reqbuf.is_multi_block = 0;
 	reqbuf.is_auto_cmd12 = 0;
+	reqbuf.sg_cnt = 0;
 
 	if (!(storage->csd.cmdclass & CCC_APP_SPEC))
 	{
@@ -1009,8 +1443,44 @@ static void _sd_storage_parse_csd(sdmmc_storage_t *storage)
 	}
 }
 
-int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32 bus_width, u32 type)
+// Fallback order of the SD bus modes: SDR104, SDR50, DDR50, HS.
+static u32 _sd_storage_mode_rank(u32 type)
+{
+	switch (type)
+	{
+	case 11:
+		return 4;
+	case 10:
+		return 3;
+	case 12:
+		return 2;
+	case 7:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static u32 _sd_storage_next_mode(u32 type)
 {
+	switch (type)
+	{
+	case 11:
+		return 10;
+	case 10:
+		return 12;
+	case 12:
+		return 7;
+	default:
+		return 0;
+	}
+}
+
+// Returns 1 on success, 0 on failure and -1 if the requested bus mode failed to switch, tune or transfer.
+// If a lower mode is cached for this card and needs a power cycle, type is updated and -2 is returned.
+static int _sd_storage_init(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32 bus_width, u32 *ptype)
+{
+	u32 type = *ptype;
 	int is_version_1 = 0;
 
 	memset(storage, 0, sizeof(sdmmc_storage_t));
@@ -1031,7 +1501,7 @@ int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32
 		return 0;
 	DPRINTF("[SD] after send if cond\n");
 
-	if (!_sd_storage_get_op_cond(storage, is_version_1, bus_width == SDMMC_BUS_WIDTH_4 && type == 11))
+	if (!_sd_storage_get_op_cond(storage, is_version_1, bus_width == SDMMC_BUS_WIDTH_4 && type >= 8))
 		return 0;
 	DPRINTF("[SD] got op cond\n");
 
@@ -1040,6 +1510,17 @@ int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32
 	DPRINTF("[SD] got cid\n");
 	_sd_storage_parse_cid(storage);
 
+	// Start from the last mode that worked on this card.
+	if (_sd_mode_cache.valid && !memcmp(_sd_mode_cache.cid, storage->raw_cid, 0x10) &&
+		_sd_storage_mode_rank(_sd_mode_cache.type) < _sd_storage_mode_rank(type))
+	{
+		type = _sd_mode_cache.type;
+		*ptype = type;
+		// Leaving 1.8V signaling needs a power cycle.
+		if (storage->is_low_voltage && type < 8)
+			return -2;
+	}
+
 	if (!_sd_storage_get_rca(storage))
 		return 0;
 	DPRINTF("[SD] got rca (= %04X)\n", storage->rca);
@@ -1083,7 +1564,7 @@ int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32
 		return 0;
 	DPRINTF("[SD] cleared card detect\n");
 
-	u8 *buf = (u8 *)malloc(512);
+	u8 *buf = (u8 *)dma_malloc(512);
 	if (!_sd_storage_get_scr(storage, buf))
 		return 0;
 	//gfx_hexdump(&gfx_con, 0, storage->raw_scr, 8);
@@ -1108,7 +1589,7 @@ int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32
 		if (!_sd_storage_enable_highspeed_low_volt(storage, type, buf))
 		{
 			free(buf);
-			return 0;
+			return -1;
 		}
 		DPRINTF("[SD] enabled highspeed (low voltage)\n");
 	}
@@ -1121,18 +1602,62 @@ int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32
 		}
 		DPRINTF("[SD] enabled highspeed (high voltage)\n");
 		storage->csd.busspeed = 25;
+		storage->bus_type = 7;
 	}
+	else
+		storage->bus_type = 6;
 
 	sdmmc_sd_clock_ctrl(sdmmc, 1);
 
 	// Parse additional card info from sd status.
+	// In UHS modes this is the first data read at full speed, so a failure means a bad bus mode.
 	if (_sd_storage_get_ssr(storage, buf))
 		DPRINTF("[SD] got sd status\n");
+	else if (storage->is_low_voltage)
+	{
+		free(buf);
+		return -1;
+	}
+
+	// Multi-block writes are pre-announced and split at AU boundaries.
+	storage->sd_pre_erase = 1;
+	if (storage->ssr.au_size && !(storage->ssr.au_size & (storage->ssr.au_size - 1)))
+		storage->write_align = storage->ssr.au_size;
 
 	free(buf);
 	return 1;
 }
 
+int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32 bus_width, u32 type)
+{
+	while (1)
+	{
+		int res = _sd_storage_init(storage, sdmmc, id, bus_width, &type);
+		if (res == 1)
+		{
+			memcpy(_sd_mode_cache.cid, storage->raw_cid, 0x10);
+			_sd_mode_cache.type = storage->bus_type;
+			_sd_mode_cache.tap = storage->tuned_tap;
+			_sd_mode_cache.tap_valid = storage->bus_type == 10 || storage->bus_type == 11;
+			_sd_mode_cache.valid = 1;
+			return 1;
+		}
+
+		sdmmc_end(sdmmc);
+		if (!res)
+			return 0;
+
+		if (res == -1)
+		{
+			DPRINTF("[SD] mode %d failed, falling back\n", type);
+			_sd_mode_cache.valid = 0;
+			type = _sd_storage_next_mode(type);
+			if (!type)
+				return 0;
+		}
+	}
+}
+
 /*
 * Gamecard specific functions.
 */
@@ -1150,6 +1675,7 @@ int _gc_storage_custom_cmd(sdmmc_storage_t *storage, void *buf)
 	reqbuf.is_write = 1;
 	reqbuf.is_multi_block = 0;
 	reqbuf.is_auto_cmd12 = 0;
+	reqbuf.sg_cnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, 0))
 	{
@@ -63,6 +63,13 @@ typedef struct _mmc_ext_csd
 	u16 dev_version;
 	u8  boot_mult;
 	u8  rpmb_mult;
+	u8  pwr_cl_52_195;      /* 200 */
+	u8  pwr_cl_200_195;     /* 236 */
+	u8  pwr_cl_ddr_200_360; /* 253 */
+	u8  erased_mem_cont;    /* 181 */
+	u8  sec_feature;        /* 231 */
+	u8  trim_mult;          /* 232 */
+	u32 cache_size;         /* 249 */
 } mmc_ext_csd_t;
 
 typedef struct _sd_scr
@@ -80,8 +87,26 @@ typedef struct _sd_ssr
 	u8 uhs_grade;
 	u8 video_class;
 	u8 app_class;
+	u32 au_size; /* In sectors */
 } sd_ssr_t;
 
+/*! Run of image sectors stored contiguously on the target storage. */
+typedef struct _sdmmc_extent_t
+{
+	u32 sector; // First image sector.
+	u32 num_sectors;
+	u32 target; // Its sector on the target storage.
+} sdmmc_extent_t;
+
+/*! Image backed by another storage, e.g. a file on the SD card. Read-only. */
+typedef struct _sdmmc_extmap_t
+{
+	struct _sdmmc_storage_t *target;
+	u32 num_sectors;
+	u32 num_extents;
+	sdmmc_extent_t *extents; // Sorted and without gaps, starting at image sector 0.
+} sdmmc_extmap_t;
+
 /*! SDMMC storage context. */
 typedef struct _sdmmc_storage_t
 {
@@ -91,6 +116,14 @@ typedef struct _sdmmc_storage_t
 	u32 sec_cnt;
 	int is_low_voltage;
 	u32 partition;
+	u32 bus_type;
+	u32 tuned_tap;
+	int use_cmd23;
+	int reliable_write;
+	int cache_enabled;
+	int sd_pre_erase; // Announce multi-block writes with ACMD23.
+	u32 write_align;  // Split writes at this boundary (sectors, power of 2), 0 if unused.
+	sdmmc_extmap_t *extmap; // Set for image storages, transfers are remapped onto extmap->target.
 	u8  raw_cid[0x10];
 	u8  raw_csd[0x10];
 	u8  raw_scr[8];
@@ -105,6 +138,13 @@ typedef struct _sdmmc_storage_t
 int sdmmc_storage_end(sdmmc_storage_t *storage);
 int sdmmc_storage_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf);
 int sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf);
+int sdmmc_storage_set_cache(sdmmc_storage_t *storage, int enable);
+int sdmmc_storage_flush_cache(sdmmc_storage_t *storage);
+int sdmmc_storage_can_trim(sdmmc_storage_t *storage);
+int sdmmc_storage_trim(sdmmc_storage_t *storage, u32 sector, u32 num_sectors);
+int sdmmc_storage_submit(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf, u32 is_write);
+int sdmmc_storage_poll(sdmmc_storage_t *storage);
+int sdmmc_storage_complete(sdmmc_storage_t *storage);
 int sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32 bus_width, u32 type);
 int sdmmc_storage_set_mmc_partition(sdmmc_storage_t *storage, u32 partition);
 int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 id, u32 bus_width, u32 type);
@@ -18,6 +18,7 @@
 #include <string.h>
 
 #include "sdmmc.h"
+#include "bpmp.h"
 #include "util.h"
 #include "clock.h"
 #include "mmc.h"
@@ -26,6 +27,9 @@
 #include "pmc.h"
 #include "pinmux.h"
 #include "gpio.h"
+#include "heap.h"
+#include "irq.h"
+#include "task.h"
 
 /*#include "gfx.h"
 extern gfx_ctxt_t gfx_ctxt;
@@ -41,6 +45,70 @@ static const u32 _sdmmc_bases[4] = {
 	0x700B0600,
 };
 
+/*! ADMA2 descriptor tables, allocated on first use. */
+static sdmmc_adma_desc_t *_sdmmc_adma_tables[4];
+
+/*! Telemetry, not cleared by sdmmc_init() so it covers every session of a controller. */
+static sdmmc_stats_t _sdmmc_stats[4];
+
+sdmmc_stats_t *sdmmc_get_stats(u32 id)
+{
+	return &_sdmmc_stats[id];
+}
+
+void sdmmc_clear_stats(u32 id)
+{
+	memset(&_sdmmc_stats[id], 0, sizeof(sdmmc_stats_t));
+}
+
+static void _sdmmc_stats_cmd(sdmmc_t *sdmmc, u32 cmd, u32 start_us, int ok)
+{
+	sdmmc_stats_t *stats = &_sdmmc_stats[sdmmc->id];
+	u32 elapsed = get_tmr_us() - start_us;
+	u32 cls;
+
+	switch (cmd)
+	{
+	case MMC_READ_SINGLE_BLOCK:
+	case MMC_READ_MULTIPLE_BLOCK:
+		cls = SDMMC_STATS_READ;
+		break;
+	case MMC_WRITE_BLOCK:
+	case MMC_WRITE_MULTIPLE_BLOCK:
+		cls = SDMMC_STATS_WRITE;
+		break;
+	case MMC_SEND_STATUS:
+		cls = SDMMC_STATS_STATUS;
+		break;
+	case MMC_SWITCH:
+		cls = SDMMC_STATS_SWITCH;
+		break;
+	default:
+		cls = SDMMC_STATS_OTHER;
+		break;
+	}
+
+	sdmmc_cmd_stats_t *st = &stats->cmds[cls];
+	u32 bucket = 0;
+	while (bucket < SDMMC_STATS_BUCKETS - 1 && (elapsed >> (bucket + 1)))
+		bucket++;
+	st->hist[bucket]++;
+	st->count++;
+	st->total_us += elapsed;
+	st->max_us = MAX(st->max_us, elapsed);
+
+	if (ok)
+		return;
+
+	st->errors++;
+	if (sdmmc->err_status & SDMMC_ERR_CRC_MASK)
+		stats->crc_errors++;
+	if (sdmmc->err_status & SDMMC_ERR_TIMEOUT_MASK)
+		stats->timeouts++;
+	if (sdmmc->err_status & TEGRA_MMC_ERRINTSTS_ADMA_ERROR)
+		stats->adma_errors++;
+}
+
 int sdmmc_get_voltage(sdmmc_t *sdmmc)
 {
 	u32 p = sdmmc->regs->pwrcon;
@@ -95,6 +163,7 @@ u32 sdmmc_get_bus_width(sdmmc_t *sdmmc)
 
 void sdmmc_set_bus_width(sdmmc_t *sdmmc, u32 bus_width)
 {
+	_sdmmc_stats[sdmmc->id].bus_width = bus_width;
 	if (bus_width == SDMMC_BUS_WIDTH_1)
 		sdmmc->regs->hostctl &= ~(TEGRA_MMC_HOSTCTL_4BIT | TEGRA_MMC_HOSTCTL_8BIT);
 	else if (bus_width == SDMMC_BUS_WIDTH_4)
@@ -112,6 +181,71 @@ void sdmmc_get_venclkctl(sdmmc_t *sdmmc)
 	sdmmc->venclkctl_set = 1;
 }
 
+u32 sdmmc_get_error(sdmmc_t *sdmmc)
+{
+	return sdmmc->err_status;
+}
+
+// Halves the card clock and keeps the bus timing, to get through marginal transfers.
+void sdmmc_set_clock_slowdown(sdmmc_t *sdmmc, int enable)
+{
+	if (!enable == !sdmmc->clk_slowdown)
+		return;
+	if (enable)
+		_sdmmc_stats[sdmmc->id].clk_slowdowns++;
+
+	int should_enable_sd_clock = 0;
+	if (sdmmc->regs->clkcon & TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE)
+	{
+		should_enable_sd_clock = 1;
+		sdmmc->regs->clkcon &= ~TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
+	}
+
+	u32 div;
+	if (enable)
+	{
+		// 10-bit divider N, clock = base / 2N. 0 is the base clock.
+		sdmmc->clk_saved_div = ((sdmmc->regs->clkcon >> 8) & 0xFF) | (((sdmmc->regs->clkcon >> 6) & 3) << 8);
+		sdmmc->clk_saved_divisor = sdmmc->divisor;
+		div = sdmmc->clk_saved_div ? MIN(sdmmc->clk_saved_div << 1, 0x3FF) : 1;
+		sdmmc->divisor = (sdmmc->divisor + 1) >> 1;
+	}
+	else
+	{
+		div = sdmmc->clk_saved_div;
+		sdmmc->divisor = sdmmc->clk_saved_divisor;
+	}
+	sdmmc->regs->clkcon = (sdmmc->regs->clkcon & 0x3F) | ((div & 0xFF) << 8) | (((div >> 8) & 3) << 6);
+	sdmmc->clk_slowdown = enable;
+
+	if (should_enable_sd_clock)
+		sdmmc->regs->clkcon |= TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
+}
+
+u32 sdmmc_get_tuned_tap(sdmmc_t *sdmmc)
+{
+	return (sdmmc->regs->venclkctl >> 16) & 0xFF;
+}
+
+// Programs a tap found by an earlier tuning, instead of running the tuning procedure again.
+void sdmmc_set_tuned_tap(sdmmc_t *sdmmc, u32 tap)
+{
+	int should_enable_sd_clock = 0;
+	if (sdmmc->regs->clkcon & TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE)
+	{
+		should_enable_sd_clock = 1;
+		sdmmc->regs->clkcon &= ~TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
+	}
+
+	sdmmc->regs->venclkctl = (sdmmc->regs->venclkctl & 0xFF00FFFF) | ((tap & 0xFF) << 16);
+	sdmmc->regs->hostctl2 |= SDHCI_CTRL_TUNED_CLK;
+	_sdmmc_stats[sdmmc->id].tuning_cached++;
+	_sdmmc_stats[sdmmc->id].tuned_tap = tap & 0xFF;
+
+	if (should_enable_sd_clock)
+		sdmmc->regs->clkcon |= TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
+}
+
 static int _sdmmc_config_ven_ceata_clk(sdmmc_t *sdmmc, u32 id)
 {
 	u32 tap_val = 0;
@@ -229,6 +363,10 @@ int sdmmc_setup_clock(sdmmc_t *sdmmc, u32 type)
 		sdmmc->regs->hostctl2  = (sdmmc->regs->hostctl2 & SDHCI_CTRL_UHS_MASK) | UHS_SDR12_BUS_SPEED;
 		sdmmc->regs->hostctl2 |= SDHCI_CTRL_VDD_180;
 		break;
+	case 12:
+		sdmmc->regs->hostctl2  = (sdmmc->regs->hostctl2 & SDHCI_CTRL_UHS_MASK) | UHS_DDR50_BUS_SPEED;
+		sdmmc->regs->hostctl2 |= SDHCI_CTRL_VDD_180;
+		break;
 	case 10:
 		//T210 Errata for SDR50, the host must be set to SDR104.
 		sdmmc->regs->hostctl2  = (sdmmc->regs->hostctl2 & SDHCI_CTRL_UHS_MASK) | UHS_SDR104_BUS_SPEED;
@@ -251,6 +389,9 @@ int sdmmc_setup_clock(sdmmc_t *sdmmc, u32 type)
 	if (div > 0xFF)
 		divisor = div >> 8;
 	sdmmc->regs->clkcon = (sdmmc->regs->clkcon & 0x3F) | (div << 8) | (divisor << 6);
+	sdmmc->clk_slowdown = 0;
+	_sdmmc_stats[sdmmc->id].bus_type = type;
+	_sdmmc_stats[sdmmc->id].bus_khz = sdmmc->divisor;
 
 	//Enable the SD clock again.
 	if (should_enable_sd_clock)
@@ -371,7 +512,7 @@ int sdmmc_get_rsp(sdmmc_t *sdmmc, u32 *rsp, u32 size, u32 type)
 	return 1;
 }
 
-static void _sdmmc_reset(sdmmc_t *sdmmc)
+static void _sdmmc_reset_lines(sdmmc_t *sdmmc)
 {
 	sdmmc->regs->swrst |= 
 		TEGRA_MMC_SWRST_SW_RESET_FOR_CMD_LINE | TEGRA_MMC_SWRST_SW_RESET_FOR_DAT_LINE;
@@ -381,6 +522,13 @@ static void _sdmmc_reset(sdmmc_t *sdmmc)
 		;
 }
 
+// Error recovery. Tuning resets the lines as part of every attempt, those are not counted.
+static void _sdmmc_reset(sdmmc_t *sdmmc)
+{
+	_sdmmc_stats[sdmmc->id].resets++;
+	_sdmmc_reset_lines(sdmmc);
+}
+
 static int _sdmmc_wait_prnsts_type0(sdmmc_t *sdmmc, u32 wait_dat)
 {
 	_sdmmc_get_clkcon(sdmmc);
@@ -411,15 +559,24 @@ static int _sdmmc_wait_prnsts_type1(sdmmc_t *sdmmc)
 {
 	_sdmmc_get_clkcon(sdmmc);
 
+	if (sdmmc->regs->prnsts & 0x100000)
+		return 1;
+
+	u32 start = get_tmr_us();
+	int res = 1;
 	u32 timeout = get_tmr_ms() + 2000;
 	while (!(sdmmc->regs->prnsts & 0x100000)) //DAT0 line level.
 		if (get_tmr_ms() > timeout)
 		{
 			_sdmmc_reset(sdmmc);
-			return 0;
+			res = 0;
+			break;
 		}
 
-	return 1;
+	_sdmmc_stats[sdmmc->id].busy_waits++;
+	_sdmmc_stats[sdmmc->id].busy_us += get_tmr_us() - start;
+
+	return res;
 }
 
 static int _sdmmc_setup_read_small_block(sdmmc_t *sdmmc)
@@ -505,7 +662,7 @@ static int _sdmmc_config_tuning_once(sdmmc_t *sdmmc, u32 cmd)
 	_sdmmc_parse_cmd_48(sdmmc, cmd);
 	_sdmmc_get_clkcon(sdmmc);
 	usleep(1);
-	_sdmmc_reset(sdmmc);
+	_sdmmc_reset_lines(sdmmc);
 	sdmmc->regs->clkcon |= TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
 	_sdmmc_get_clkcon(sdmmc);
 
@@ -521,7 +678,7 @@ static int _sdmmc_config_tuning_once(sdmmc_t *sdmmc, u32 cmd)
 			return 1;
 		}
 	}
-	_sdmmc_reset(sdmmc);
+	_sdmmc_reset_lines(sdmmc);
 	sdmmc->regs->norintstsen &= 0xFFDF;
 	_sdmmc_get_clkcon(sdmmc);
 	usleep((1000 * 8 + sdmmc->divisor - 1) / sdmmc->divisor);
@@ -556,15 +713,22 @@ int sdmmc_config_tuning(sdmmc_t *sdmmc, u32 type, u32 cmd)
 	sdmmc->regs->field_1C0 |= 0x20000;
 	sdmmc->regs->hostctl2  |= SDHCI_CTRL_EXEC_TUNING;
 
+	sdmmc_stats_t *stats = &_sdmmc_stats[sdmmc->id];
+	stats->tunings++;
 	for (u32 i = 0; i < max; i++)
 	{
 		_sdmmc_config_tuning_once(sdmmc, cmd);
+		stats->tuning_iters++;
 		if (!(sdmmc->regs->hostctl2 & SDHCI_CTRL_EXEC_TUNING))
 			break;
 	}
 
 	if (sdmmc->regs->hostctl2 & SDHCI_CTRL_TUNED_CLK)
+	{
+		stats->tuned_tap = sdmmc_get_tuned_tap(sdmmc);
 		return 1;
+	}
+	stats->tuning_fails++;
 	return 0;
 }
 
@@ -588,7 +752,7 @@ static int _sdmmc_enable_internal_clock(sdmmc_t *sdmmc)
 		return 0;
 
 	sdmmc->regs->hostctl2 |= SDHCI_ADDRESSING_64BIT_EN;
-	sdmmc->regs->hostctl &= 0xE7;
+	sdmmc->regs->hostctl = (sdmmc->regs->hostctl & 0xE7) | TEGRA_MMC_HOSTCTL_DMASEL_ADMA2;
 	sdmmc->regs->timeoutcon = (sdmmc->regs->timeoutcon & 0xF0) | 0xE;
 
 	return 1;
@@ -670,18 +834,18 @@ static void _sdmmc_autocal_execute(sdmmc_t *sdmmc, u32 power)
 static void _sdmmc_enable_interrupts(sdmmc_t *sdmmc)
 {
 	sdmmc->regs->norintstsen |= 0xB;
-	sdmmc->regs->errintstsen |= 0x17F;
+	sdmmc->regs->errintstsen |= 0x17F | TEGRA_MMC_ERRINTSTS_ADMA_ERROR;
 	sdmmc->regs->norintsts = sdmmc->regs->norintsts;
 	sdmmc->regs->errintsts = sdmmc->regs->errintsts;
 }
 
 static void _sdmmc_mask_interrupts(sdmmc_t *sdmmc)
 {
-	sdmmc->regs->errintstsen &= 0xFE80;
+	sdmmc->regs->errintstsen &= 0xFE80 & ~TEGRA_MMC_ERRINTSTS_ADMA_ERROR;
 	sdmmc->regs->norintstsen &= 0xFFF4;
 }
 
-static int _sdmmc_check_mask_interrupt(sdmmc_t *sdmmc, u16 *pout, u16 mask)
+static int IRAM_FAST _sdmmc_check_mask_interrupt(sdmmc_t *sdmmc, u16 *pout, u16 mask)
 {
 	u16 norintsts = sdmmc->regs->norintsts;
 	u16 errintsts = sdmmc->regs->errintsts;
@@ -694,6 +858,7 @@ static int _sdmmc_check_mask_interrupt(sdmmc_t *sdmmc, u16 *pout, u16 mask)
 	//Check for error interrupt.
 	if (norintsts & TEGRA_MMC_NORINTSTS_ERR_INTERRUPT)
 	{
+		sdmmc->err_status |= errintsts;
 		sdmmc->regs->errintsts = errintsts;
 		return SDMMC_MASKINT_ERROR;
 	}
@@ -706,6 +871,45 @@ static int _sdmmc_check_mask_interrupt(sdmmc_t *sdmmc, u16 *pout, u16 mask)
 	return SDMMC_MASKINT_NOERROR;
 }
 
+static const u32 _sdmmc_irqs[] = { IRQ_SDMMC1, IRQ_SDMMC2, IRQ_SDMMC3, IRQ_SDMMC4 };
+static sdmmc_t *_sdmmc_irq_owners[4];
+
+static void _sdmmc_irq(u32 irq)
+{
+	// The status stays for the waiter, only the line goes down.
+	for (u32 i = 0; i < 4; i++)
+	{
+		if (_sdmmc_irqs[i] == irq && _sdmmc_irq_owners[i])
+		{
+			_sdmmc_irq_owners[i]->regs->norintsigen = 0;
+			_sdmmc_irq_owners[i]->regs->errintsigen = 0;
+		}
+	}
+}
+
+// Inside a task, sleeps until one of mask or an error is raised, or us passed. Elsewhere the caller keeps polling.
+static void _sdmmc_wait_irq(sdmmc_t *sdmmc, u16 mask, u32 us)
+{
+	if (!task_current())
+		return;
+
+	u32 irq = _sdmmc_irqs[sdmmc->id];
+	if (!irq_request(irq, _sdmmc_irq))
+	{
+		task_yield();
+		return;
+	}
+	_sdmmc_irq_owners[sdmmc->id] = sdmmc;
+
+	// Taken before arming, so a status that is already up wakes us right away.
+	u32 seen = irq_count(irq);
+	sdmmc->regs->errintsigen = 0xFFFF;
+	sdmmc->regs->norintsigen = mask;
+	task_wait_irq(irq, seen, us);
+	sdmmc->regs->norintsigen = 0;
+	sdmmc->regs->errintsigen = 0;
+}
+
 static int _sdmmc_wait_request(sdmmc_t *sdmmc)
 {
 	_sdmmc_get_clkcon(sdmmc);
@@ -718,9 +922,12 @@ static int _sdmmc_wait_request(sdmmc_t *sdmmc)
 			break;
 		if (res != SDMMC_MASKINT_NOERROR || get_tmr_ms() > timeout)
 		{
+			if (res == SDMMC_MASKINT_NOERROR)
+				sdmmc->err_status |= SDMMC_ERR_SW_TIMEOUT;
 			_sdmmc_reset(sdmmc);
 			return 0;
 		}
+		_sdmmc_wait_irq(sdmmc, TEGRA_MMC_NORINTSTS_CMD_COMPLETE, 1000);
 	}
 
 	return 1;
@@ -763,7 +970,9 @@ int sdmmc_stop_transmission(sdmmc_t *sdmmc, u32 *rsp)
 		usleep((8000 + sdmmc->divisor - 1) / sdmmc->divisor);
 	}
 
+	u32 start = get_tmr_us();
 	int res = _sdmmc_stop_transmission_inner(sdmmc, rsp);
+	_sdmmc_stats_cmd(sdmmc, MMC_STOP_TRANSMISSION, start, res);
 	usleep((8000 + sdmmc->divisor - 1) / sdmmc->divisor);
 	if (should_disable_sd_clock)
 		sdmmc->regs->clkcon &= ~TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
@@ -771,6 +980,54 @@ int sdmmc_stop_transmission(sdmmc_t *sdmmc, u32 *rsp)
 	return res;
 }
 
+static int _sdmmc_adma_add(sdmmc_adma_desc_t *table, u32 *idx, u32 addr, u32 size)
+{
+	//Check alignment.
+	if (addr << 29)
+		return 0;
+
+	while (size)
+	{
+		if (*idx >= SDMMC_ADMA_MAX_DESCS)
+			return 0;
+
+		u32 len = MIN(size, SDMMC_ADMA_DESC_MAX_LEN);
+		table[*idx].attr = TEGRA_MMC_ADMA_DESC_VALID | TEGRA_MMC_ADMA_DESC_ACT_TRAN;
+		table[*idx].len = len & 0xFFFF; //0 means 64KB.
+		table[*idx].addr_lo = addr;
+		table[*idx].addr_hi = 0;
+		table[*idx].rsvd = 0;
+
+		addr += len;
+		size -= len;
+		(*idx)++;
+	}
+
+	return 1;
+}
+
+// Keeps the BPMP cache coherent with every buffer of a descriptor table.
+static void _sdmmc_adma_sync(sdmmc_adma_desc_t *table, int is_read)
+{
+	u32 total = 0, num = 0;
+	do
+	{
+		total += table[num].len ? table[num].len : 0x10000;
+	} while (!(table[num++].attr & TEGRA_MMC_ADMA_DESC_END) && num < SDMMC_ADMA_MAX_DESCS);
+
+	// A big transfer takes a single whole-cache operation.
+	if (total > BPMP_CACHE_RANGE_MAX)
+		num = 1;
+	for (u32 i = 0; i < num; i++)
+	{
+		u32 len = num == 1 ? total : (table[i].len ? table[i].len : 0x10000);
+		if (is_read)
+			bpmp_cache_invalidate((void *)table[i].addr_lo, len);
+		else
+			bpmp_cache_clean((void *)table[i].addr_lo, len);
+	}
+}
+
 static int _sdmmc_config_dma(sdmmc_t *sdmmc, u32 *blkcnt_out, sdmmc_req_t *req)
 {
 	if (!req->blksize || !req->num_sectors)
@@ -779,18 +1036,46 @@ static int _sdmmc_config_dma(sdmmc_t *sdmmc, u32 *blkcnt_out, sdmmc_req_t *req)
 	u32 blkcnt = req->num_sectors;
 	if (blkcnt >= 0xFFFF)
 		blkcnt = 0xFFFF;
-	u32 admaaddr = (u32)req->buf;
 
-	//Check alignment.
-	if (admaaddr << 29)
+	if (!_sdmmc_adma_tables[sdmmc->id])
+		_sdmmc_adma_tables[sdmmc->id] = (sdmmc_adma_desc_t *)dma_malloc(SDMMC_ADMA_MAX_DESCS * sizeof(sdmmc_adma_desc_t));
+	sdmmc_adma_desc_t *table = _sdmmc_adma_tables[sdmmc->id];
+
+	//The engine fetches descriptors as 32-bit words.
+	if (!table)
+		return 0;
+	if ((u32)table & 3)
+	{
+		free(table);
+		_sdmmc_adma_tables[sdmmc->id] = NULL;
 		return 0;
+	}
 
-	sdmmc->regs->admaaddr = admaaddr;
-	sdmmc->regs->admaaddr_hi = 0;
+	//Build the descriptor table for the whole transfer.
+	u32 idx = 0;
+	u32 size = blkcnt * req->blksize;
+	if (req->sg_cnt)
+	{
+		for (u32 i = 0; i < req->sg_cnt && size; i++)
+		{
+			u32 len = MIN(size, req->sg[i].size);
+			if (!_sdmmc_adma_add(table, &idx, (u32)req->sg[i].buf, len))
+				return 0;
+			size -= len;
+		}
+		if (size)
+			return 0;
+	}
+	else if (!_sdmmc_adma_add(table, &idx, (u32)req->buf, size))
+		return 0;
+	table[idx - 1].attr |= TEGRA_MMC_ADMA_DESC_END;
+	_sdmmc_adma_sync(table, !req->is_write);
+	bpmp_cache_clean(table, idx * sizeof(sdmmc_adma_desc_t));
 
-	sdmmc->dma_addr_next = (admaaddr + 0x80000) & 0xFFF80000;
+	sdmmc->regs->admaaddr = (u32)table;
+	sdmmc->regs->admaaddr_hi = 0;
 
-	sdmmc->regs->blksize = req->blksize | 0x7000;
+	sdmmc->regs->blksize = req->blksize;
 	sdmmc->regs->blkcnt = blkcnt;
 
 	if (blkcnt_out)
@@ -811,7 +1096,7 @@ static int _sdmmc_config_dma(sdmmc_t *sdmmc, u32 *blkcnt_out, sdmmc_req_t *req)
 	return 1;
 }
 
-static int _sdmmc_update_dma(sdmmc_t *sdmmc)
+static int IRAM_FAST _sdmmc_update_dma(sdmmc_t *sdmmc)
 {
 	u16 blkcnt = 0;
 	do
@@ -820,38 +1105,30 @@ static int _sdmmc_update_dma(sdmmc_t *sdmmc)
 		u32 timeout = get_tmr_ms() + 1500;
 		do
 		{
-			int res = 0;
-			while (1)
-			{
-				u16 intr = 0;
-				res = _sdmmc_check_mask_interrupt(sdmmc, &intr, 
-					TEGRA_MMC_NORINTSTS_XFER_COMPLETE | TEGRA_MMC_NORINTSTS_DMA_INTERRUPT);
-				if (res < 0)
-					break;
-				if (intr & TEGRA_MMC_NORINTSTS_XFER_COMPLETE)
-					return 1; //Transfer complete.
-				if (intr & TEGRA_MMC_NORINTSTS_DMA_INTERRUPT)
-				{
-					//Update DMA.
-					sdmmc->regs->admaaddr = sdmmc->dma_addr_next;
-					sdmmc->regs->admaaddr_hi = 0;
-					sdmmc->dma_addr_next += 0x80000;
-				}
-			}
+			u16 intr = 0;
+			int res = _sdmmc_check_mask_interrupt(sdmmc, &intr, TEGRA_MMC_NORINTSTS_XFER_COMPLETE);
+			if (res == SDMMC_MASKINT_MASKED)
+				return 1; //Transfer complete.
 			if (res != SDMMC_MASKINT_NOERROR)
 			{
+				sdmmc->xfer_left = sdmmc->regs->blkcnt;
 				_sdmmc_reset(sdmmc);
 				return 0;
 			}
+			_sdmmc_wait_irq(sdmmc, TEGRA_MMC_NORINTSTS_XFER_COMPLETE | TEGRA_MMC_NORINTSTS_DMA_INTERRUPT, 1000);
 		} while (get_tmr_ms() < timeout);
 	} while (sdmmc->regs->blkcnt != blkcnt);
 
+	sdmmc->err_status |= SDMMC_ERR_SW_TIMEOUT;
+	sdmmc->xfer_left = sdmmc->regs->blkcnt;
 	_sdmmc_reset(sdmmc);
 	return 0;
 }
 
 static int _sdmmc_execute_cmd_inner(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out)
 {
+	// Errors are per command, so a failure here is not blamed on the previous one.
+	sdmmc->err_status = 0;
 	int has_req_or_check_busy = req || cmd->check_busy;
 	if (!_sdmmc_wait_prnsts_type0(sdmmc, has_req_or_check_busy))
 		return 0;
@@ -860,7 +1137,10 @@ static int _sdmmc_execute_cmd_inner(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_
 	int is_data_present = 0;
 	if (req)
 	{
-		_sdmmc_config_dma(sdmmc, &blkcnt, req);
+		// A misaligned buffer would be silently rejected by the ADMA engine.
+		if (!_sdmmc_config_dma(sdmmc, &blkcnt, req))
+			return 0;
+		sdmmc->xfer_left = blkcnt;
 		_sdmmc_enable_interrupts(sdmmc);
 		is_data_present = 1;
 	}
@@ -888,6 +1168,10 @@ static int _sdmmc_execute_cmd_inner(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_
 
 	_sdmmc_mask_interrupts(sdmmc);
 
+	// Whatever the controller managed to write, the CPU must not see stale lines of it.
+	if (req && !req->is_write)
+		_sdmmc_adma_sync(_sdmmc_adma_tables[sdmmc->id], 1);
+
 	if (res)
 	{
 		if (req)
@@ -901,6 +1185,12 @@ static int _sdmmc_execute_cmd_inner(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_
 		if (cmd->check_busy || req)
 			return _sdmmc_wait_prnsts_type1(sdmmc);
 	}
+	else if (req && blkcnt_out)
+	{
+		// Blocks that made it before the error. The last one counted may be the bad one, so it is not reported.
+		u32 done = blkcnt - MIN(sdmmc->xfer_left, blkcnt);
+		*blkcnt_out = done ? done - 1 : 0;
+	}
 
 	return res;
 }
@@ -1045,7 +1335,7 @@ void sdmmc_init_cmd(sdmmc_cmd_t *cmdbuf, u16 cmd, u32 arg, u32 rsp_type, u32 che
 
 int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out)
 {
-	if (!sdmmc->sd_clock_enabled)
+	if (!sdmmc->sd_clock_enabled || sdmmc->req_pending)
 		return 0;
 
 	//Recalibrate periodically for SDMMC1.
@@ -1061,7 +1351,9 @@ int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *b
 		usleep((8000 + sdmmc->divisor - 1) / sdmmc->divisor);
 	}
 
+	u32 start = get_tmr_us();
 	int res = _sdmmc_execute_cmd_inner(sdmmc, cmd, req, blkcnt_out);
+	_sdmmc_stats_cmd(sdmmc, cmd->cmd, start, res);
 	usleep((8000 + sdmmc->divisor - 1) / sdmmc->divisor);
 	if (should_disable_sd_clock)
 		sdmmc->regs->clkcon &= ~TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
@@ -1069,6 +1361,126 @@ int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *b
 	return res;
 }
 
+static void _sdmmc_async_end(sdmmc_t *sdmmc)
+{
+	if (sdmmc->req_pending && sdmmc->req_is_read)
+		_sdmmc_adma_sync(_sdmmc_adma_tables[sdmmc->id], 1);
+	usleep((8000 + sdmmc->divisor - 1) / sdmmc->divisor);
+	if (sdmmc->req_disable_sd_clock)
+		sdmmc->regs->clkcon &= ~TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
+	sdmmc->req_pending = 0;
+}
+
+/*
+* Starts a data request and returns once the command is accepted.
+* The transfer itself is then driven by sdmmc_poll_cmd().
+*/
+int sdmmc_execute_cmd_async(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req)
+{
+	if (!sdmmc->sd_clock_enabled || sdmmc->req_pending || !req)
+		return 0;
+
+	//Recalibrate periodically for SDMMC1.
+	if (sdmmc->id == SDMMC_1 && sdmmc->no_sd)
+		_sdmmc_autocal_execute(sdmmc, sdmmc_get_voltage(sdmmc));
+
+	sdmmc->req_disable_sd_clock = 0;
+	if (!(sdmmc->regs->clkcon & TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE))
+	{
+		sdmmc->req_disable_sd_clock = 1;
+		sdmmc->regs->clkcon |= TEGRA_MMC_CLKCON_SD_CLOCK_ENABLE;
+		_sdmmc_get_clkcon(sdmmc);
+		usleep((8000 + sdmmc->divisor - 1) / sdmmc->divisor);
+	}
+
+	sdmmc->req_cmd = cmd->cmd;
+	sdmmc->req_start_us = get_tmr_us();
+	sdmmc->err_status = 0;
+	if (!_sdmmc_wait_prnsts_type0(sdmmc, 1) || !_sdmmc_config_dma(sdmmc, &sdmmc->req_blkcnt, req))
+	{
+		_sdmmc_stats_cmd(sdmmc, cmd->cmd, sdmmc->req_start_us, 0);
+		_sdmmc_async_end(sdmmc);
+		return 0;
+	}
+
+	_sdmmc_enable_interrupts(sdmmc);
+	_sdmmc_parse_cmdbuf(sdmmc, cmd, 1);
+
+	if (!_sdmmc_wait_request(sdmmc))
+	{
+		_sdmmc_stats_cmd(sdmmc, cmd->cmd, sdmmc->req_start_us, 0);
+		_sdmmc_mask_interrupts(sdmmc);
+		_sdmmc_async_end(sdmmc);
+		return 0;
+	}
+
+	if (cmd->rsp_type)
+	{
+		sdmmc->expected_rsp_type = cmd->rsp_type;
+		_sdmmc_cache_rsp(sdmmc, sdmmc->rsp, 0x10, cmd->rsp_type);
+	}
+
+	sdmmc->req_auto_cmd12 = req->is_auto_cmd12;
+	sdmmc->req_blkcnt_last = sdmmc->regs->blkcnt;
+	sdmmc->req_timeout = get_tmr_ms() + 1500;
+	sdmmc->req_is_read = !req->is_write;
+	sdmmc->req_pending = 1;
+
+	return 1;
+}
+
+/*
+* Services a request started by sdmmc_execute_cmd_async() without blocking.
+*/
+int IRAM_FAST sdmmc_poll_cmd(sdmmc_t *sdmmc, u32 *blkcnt_out)
+{
+	if (!sdmmc->req_pending)
+		return SDMMC_ASYNC_ERROR;
+
+	int res = _sdmmc_check_mask_interrupt(sdmmc, 0, TEGRA_MMC_NORINTSTS_XFER_COMPLETE);
+
+	if (res == SDMMC_MASKINT_MASKED)
+	{
+		//Transfer complete.
+		_sdmmc_mask_interrupts(sdmmc);
+		if (sdmmc->req_auto_cmd12)
+			sdmmc->rsp3 = sdmmc->regs->rspreg3;
+		if (blkcnt_out)
+			*blkcnt_out = sdmmc->req_blkcnt;
+		res = _sdmmc_wait_prnsts_type1(sdmmc);
+		_sdmmc_stats_cmd(sdmmc, sdmmc->req_cmd, sdmmc->req_start_us, res);
+		_sdmmc_async_end(sdmmc);
+
+		return res ? SDMMC_ASYNC_DONE : SDMMC_ASYNC_ERROR;
+	}
+	else if (res == SDMMC_MASKINT_NOERROR)
+	{
+		//Restart the timeout as long as blocks keep moving.
+		if (sdmmc->regs->blkcnt != sdmmc->req_blkcnt_last)
+		{
+			sdmmc->req_blkcnt_last = sdmmc->regs->blkcnt;
+			sdmmc->req_timeout = get_tmr_ms() + 1500;
+		}
+		else if (get_tmr_ms() > sdmmc->req_timeout)
+		{
+			sdmmc->err_status |= SDMMC_ERR_SW_TIMEOUT;
+			res = SDMMC_MASKINT_ERROR;
+		}
+	}
+
+	if (res == SDMMC_MASKINT_ERROR)
+	{
+		_sdmmc_stats_cmd(sdmmc, sdmmc->req_cmd, sdmmc->req_start_us, 0);
+		_sdmmc_reset(sdmmc);
+		_sdmmc_mask_interrupts(sdmmc);
+		_sdmmc_async_end(sdmmc);
+
+		return SDMMC_ASYNC_ERROR;
+	}
+
+	return SDMMC_ASYNC_PENDING;
+}
+
 int sdmmc_enable_low_voltage(sdmmc_t *sdmmc)
 {
 	if(sdmmc->id != SDMMC_1)
@@ -49,6 +49,11 @@
 #define SDMMC_MASKINT_NOERROR -1
 #define SDMMC_MASKINT_ERROR   -2
 
+/*! SDMMC asynchronous request status. */
+#define SDMMC_ASYNC_DONE     1
+#define SDMMC_ASYNC_PENDING  0
+#define SDMMC_ASYNC_ERROR   -1
+
 /*! SDMMC host control 2 */
 #define SDHCI_CTRL_UHS_MASK			0xFFF8
 #define SDHCI_CTRL_VDD_330			0xFFF7
@@ -68,9 +73,83 @@
 #define UHS_DDR50_BUS_SPEED		4
 #define HS400_BUS_SPEED 		5
 
+/*! SDMMC error status, errintsts bits and driver timeouts. */
+#define SDMMC_ERR_CMD_TIMEOUT   0x1
+#define SDMMC_ERR_CMD_CRC       0x2
+#define SDMMC_ERR_CMD_END_BIT   0x4
+#define SDMMC_ERR_DATA_TIMEOUT  0x10
+#define SDMMC_ERR_DATA_CRC      0x20
+#define SDMMC_ERR_DATA_END_BIT  0x40
+#define SDMMC_ERR_SW_TIMEOUT    0x10000
+#define SDMMC_ERR_CRC_MASK      (SDMMC_ERR_CMD_CRC | SDMMC_ERR_CMD_END_BIT | SDMMC_ERR_DATA_CRC | SDMMC_ERR_DATA_END_BIT)
+#define SDMMC_ERR_TIMEOUT_MASK  (SDMMC_ERR_CMD_TIMEOUT | SDMMC_ERR_DATA_TIMEOUT | SDMMC_ERR_SW_TIMEOUT)
+
 /*! Helper for SWITCH command argument. */
 #define SDMMC_SWITCH(mode, index, value) (((mode) << 24) | ((index) << 16) | ((value) << 8))
 
+/*! SDMMC ADMA2 limits. */
+#define SDMMC_ADMA_DESC_MAX_LEN 0x10000
+#define SDMMC_ADMA_MAX_DESCS    1024
+
+/*! SDMMC ADMA2 descriptor (128-bit, host version 4 with 64-bit addressing). */
+typedef struct _sdmmc_adma_desc_t
+{
+	u16 attr;
+	u16 len;
+	u32 addr_lo;
+	u32 addr_hi;
+	u32 rsvd;
+} sdmmc_adma_desc_t;
+
+/*! SDMMC telemetry command classes. */
+#define SDMMC_STATS_READ    0 // CMD17/18.
+#define SDMMC_STATS_WRITE   1 // CMD24/25.
+#define SDMMC_STATS_STATUS  2 // CMD13.
+#define SDMMC_STATS_SWITCH  3 // CMD6.
+#define SDMMC_STATS_OTHER   4
+#define SDMMC_STATS_CLASSES 5
+/*! Latency histogram buckets. Bucket n counts commands taking [2^n, 2^(n + 1)) us, the last one everything above. */
+#define SDMMC_STATS_BUCKETS 20
+
+/*! SDMMC per command class timing. */
+typedef struct _sdmmc_cmd_stats_t
+{
+	u32 count;
+	u32 errors;
+	u32 total_us;
+	u32 max_us;
+	u32 hist[SDMMC_STATS_BUCKETS];
+} sdmmc_cmd_stats_t;
+
+/*! SDMMC controller telemetry, kept across sdmmc_init(). */
+typedef struct _sdmmc_stats_t
+{
+	sdmmc_cmd_stats_t cmds[SDMMC_STATS_CLASSES];
+	u32 crc_errors;
+	u32 timeouts;
+	u32 adma_errors;
+	u32 resets;
+	u32 busy_waits;    // DAT0 held low by the card after a command.
+	u32 busy_us;
+	u32 rw_retries;    // Retried read/write requests.
+	u32 clk_slowdowns; // Transfers continued at half clock.
+	u32 tunings;
+	u32 tuning_fails;
+	u32 tuning_iters;  // Tuning commands sent over all tunings.
+	u32 tuning_cached; // Taps reused from an earlier tuning.
+	u32 tuned_tap;
+	u32 bus_type;      // Clock type of the last sdmmc_setup_clock().
+	u32 bus_khz;
+	u32 bus_width;
+} sdmmc_stats_t;
+
+/*! SDMMC scatter/gather entry. */
+typedef struct _sdmmc_sg_t
+{
+	void *buf;
+	u32 size;
+} sdmmc_sg_t;
+
 /*! SDMMC controller context. */
 typedef struct _sdmmc_t
 {
@@ -83,9 +162,22 @@ typedef struct _sdmmc_t
 	int venclkctl_set;
 	u32 venclkctl_tap;
 	u32 expected_rsp_type;
-	u32 dma_addr_next;
 	u32 rsp[4];
 	u32 rsp3;
+	int req_pending;
+	int req_is_read;
+	int req_auto_cmd12;
+	int req_disable_sd_clock;
+	u32 req_blkcnt;
+	u32 req_blkcnt_last;
+	u32 req_timeout;
+	u32 err_status;
+	u32 xfer_left;
+	int clk_slowdown;
+	u32 clk_saved_div;
+	u32 clk_saved_divisor;
+	u32 req_cmd;
+	u32 req_start_us;
 } sdmmc_t;
 
 /*! SDMMC command. */
@@ -106,13 +198,19 @@ typedef struct _sdmmc_req_t
 	int is_write;
 	int is_multi_block;
 	int is_auto_cmd12;
+	sdmmc_sg_t *sg;
+	u32 sg_cnt;
 } sdmmc_req_t;
 
 int sdmmc_get_voltage(sdmmc_t *sdmmc);
 u32 sdmmc_get_bus_width(sdmmc_t *sdmmc);
 void sdmmc_set_bus_width(sdmmc_t *sdmmc, u32 bus_width);
 void sdmmc_get_venclkctl(sdmmc_t *sdmmc);
+u32 sdmmc_get_tuned_tap(sdmmc_t *sdmmc);
+void sdmmc_set_tuned_tap(sdmmc_t *sdmmc, u32 tap);
 int sdmmc_setup_clock(sdmmc_t *sdmmc, u32 type);
+void sdmmc_set_clock_slowdown(sdmmc_t *sdmmc, int enable);
+u32 sdmmc_get_error(sdmmc_t *sdmmc);
 void sdmmc_sd_clock_ctrl(sdmmc_t *sdmmc, int no_sd);
 int sdmmc_get_rsp(sdmmc_t *sdmmc, u32 *rsp, u32 size, u32 type);
 int sdmmc_config_tuning(sdmmc_t *sdmmc, u32 type, u32 cmd);
@@ -121,6 +219,10 @@ int sdmmc_init(sdmmc_t *sdmmc, u32 id, u32 power, u32 bus_width, u32 type, int n
 void sdmmc_end(sdmmc_t *sdmmc);
 void sdmmc_init_cmd(sdmmc_cmd_t *cmdbuf, u16 cmd, u32 arg, u32 rsp_type, u32 check_busy);
 int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out);
+int sdmmc_execute_cmd_async(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req);
+int sdmmc_poll_cmd(sdmmc_t *sdmmc, u32 *blkcnt_out);
 int sdmmc_enable_low_voltage(sdmmc_t *sdmmc);
+sdmmc_stats_t *sdmmc_get_stats(u32 id);
+void sdmmc_clear_stats(u32 id);
 
 #endif
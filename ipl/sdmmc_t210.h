@@ -28,6 +28,9 @@
 #define TEGRA_MMC_HOSTCTL_1BIT 0x00
 #define TEGRA_MMC_HOSTCTL_4BIT 0x02
 #define TEGRA_MMC_HOSTCTL_8BIT 0x20
+#define TEGRA_MMC_HOSTCTL_DMASEL_SDMA 0x00
+#define TEGRA_MMC_HOSTCTL_DMASEL_ADMA2 0x10
+#define TEGRA_MMC_HOSTCTL_DMASEL_MASK 0x18
 
 #define TEGRA_MMC_CLKCON_INTERNAL_CLOCK_ENABLE 0x1
 #define TEGRA_MMC_CLKCON_INTERNAL_CLOCK_STABLE 0x2
@@ -63,6 +66,14 @@
 
 #define TEGRA_MMC_NORINTSTSEN_BUFFER_READ_READY 0x20
 
+#define TEGRA_MMC_ERRINTSTS_ADMA_ERROR 0x200
+
+#define TEGRA_MMC_ADMA_DESC_VALID 0x1
+#define TEGRA_MMC_ADMA_DESC_END 0x2
+#define TEGRA_MMC_ADMA_DESC_INT 0x4
+#define TEGRA_MMC_ADMA_DESC_ACT_TRAN 0x20
+#define TEGRA_MMC_ADMA_DESC_ACT_LINK 0x30
+
 typedef struct _t210_sdmmc_t
 {
 	vu32 sysad;
@@ -39,6 +39,11 @@ static u32 _get_sdram_id()
 	return (fuse_read_odm(4) & 0x38) >> 3;
 }
 
+u32 sdram_get_id()
+{
+	return _get_sdram_id();
+}
+
 static void _sdram_config(const sdram_params_t *params)
 {
 	PMC(0x45C) = (((4 * params->emc_pmc_scratch1 >> 2) + 0x80000000) ^ 0xFFFF) & 0xC000FFFF;
@@ -494,9 +499,25 @@ const void *sdram_get_params()
 	//TODO: sdram_id should be in [0, 7].
 
 #ifdef CONFIG_SDRAM_COMPRESS_CFG
-	u8 *buf = (u8 *)0x40030000;
-	LZ_Uncompress(_dram_cfg_lz, buf, sizeof(_dram_cfg_lz));
-	return (const void *)&buf[sizeof(sdram_params_t) * _get_sdram_id()];
+	// Only the base set is unpacked and the selected ID patched on top, once per boot.
+	static u32 *params = NULL;
+	if (params)
+		return params;
+
+	u32 *buf = (u32 *)0x40030000;
+	LZ_Uncompress(_dram_cfg_lz, (u8 *)buf, sizeof(_dram_cfg_lz));
+
+	const u32 *patch = &_dram_cfg_patches[_dram_cfg_patch_offs[_get_sdram_id()]];
+	for (u32 runs = *patch++; runs; runs--)
+	{
+		u32 off = *patch >> 16;
+		u32 words = *patch++ & 0xFFFF;
+		while (words--)
+			buf[off++] = *patch++;
+	}
+
+	params = buf;
+	return params;
 #else
 	return _dram_cfgs[_get_sdram_id()];
 #endif
@@ -522,3 +543,35 @@ void sdram_init()
 
 	_sdram_config(params);
 }
+
+/*
+* Keeps DRAM out of power-down and self-refresh while enabled. Every
+* idle gap otherwise pays the exit latency on the next access.
+* The frequency itself stays at the one sdram_init() trained.
+*/
+static u32 _emc_cfg_saved = 0;
+
+void sdram_perf_mode(int enable)
+{
+	if (enable == !!_emc_cfg_saved)
+		return;
+
+	u32 cfg;
+	if (enable)
+	{
+		_emc_cfg_saved = EMC(EMC_CFG);
+		cfg = _emc_cfg_saved & ~(EMC_CFG_DYN_SELF_REF | EMC_CFG_DRAM_ACPD | EMC_CFG_DRAM_CLKSTOP_SR | EMC_CFG_DRAM_CLKSTOP_PD);
+	}
+	else
+	{
+		cfg = _emc_cfg_saved;
+		_emc_cfg_saved = 0;
+	}
+
+	// EMC_CFG is shadowed, latch it with a timing update.
+	EMC(EMC_CFG) = cfg;
+	EMC(EMC_TIMING_CONTROL) = 1;
+	u32 timeout = get_tmr_us() + 1000;
+	while ((EMC(EMC_EMC_STATUS) & EMC_STATUS_TIMING_UPDATE_STALLED) && get_tmr_us() < timeout)
+		;
+}
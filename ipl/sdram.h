@@ -20,5 +20,7 @@
 void sdram_init();
 const void *sdram_get_params();
 void sdram_lp0_save_params(const void *params);
+void sdram_perf_mode(int enable);
+u32 sdram_get_id();
 
 #endif
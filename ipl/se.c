@@ -19,9 +19,12 @@
 #include <string.h>
 
 #include "se.h"
+#include "bpmp.h"
 #include "heap.h"
+#include "irq.h"
 #include "t210.h"
 #include "se_t210.h"
+#include "task.h"
 #include "util.h"
 
 typedef struct _se_ll_t
@@ -31,20 +34,56 @@ typedef struct _se_ll_t
 	vu32 size;
 } se_ll_t;
 
-static void _gf256_mul_x(void *block)
+// The engine only runs one operation at a time, so one set of descriptors and bounce block is enough.
+static se_ll_t _se_ll_dst IRAM_FAST_BSS __attribute__((aligned(0x10)));
+static se_ll_t _se_ll_src IRAM_FAST_BSS __attribute__((aligned(0x10)));
+static u8 _se_block[0x10] IRAM_FAST_BSS __attribute__((aligned(0x10)));
+// Output of the running operation, dropped from the BPMP cache once it's done.
+static void *_se_out = NULL;
+static u32 _se_out_size = 0;
+
+// CMAC subkeys K1 and K2 of each key slot. Dropped whenever the slot's key changes.
+static u8 _se_cmac_subkeys[16][2][0x10] __attribute__((aligned(4)));
+static u32 _se_cmac_valid = 0;
+
+// Tweak stream of one XTS run and the encrypted sector numbers it is expanded from.
+#define SE_XTS_CHUNK_SIZE 0x4000
+#define SE_XTS_MAX_SECS   (SE_XTS_CHUNK_SIZE / 0x200)
+static u32 *_se_xts_tweaks = NULL;
+
+// The one operation that may be left running on the engine by a *_submit() call.
+typedef struct _se_job_t
 {
-	u8 *pdata = (u8 *)block;
-	u32 carry = 0;
+	u32 pending;
+	int res;
+	se_sha256_ctx_t *sha;
+} se_job_t;
+
+static se_job_t _se_job = { 0 };
+
+// Multiplies the XTS tweak by x in GF(2^128), little-endian as IEEE P1619 wants it.
+static void _gf256_mul_x_le(u32 *dst, const u32 *src)
+{
+	u32 carry = src[3] >> 31;
+	dst[3] = (src[3] << 1) | (src[2] >> 31);
+	dst[2] = (src[2] << 1) | (src[1] >> 31);
+	dst[1] = (src[1] << 1) | (src[0] >> 31);
+	dst[0] = (src[0] << 1) ^ (carry ? 0x87 : 0);
+}
 
-	for (u32 i = 0xF; i >= 0; i--)
+// Doubles a block in GF(2^128), big-endian as CMAC (NIST SP 800-38B) wants it.
+static void _gf256_mul_x_be(u8 *dst, const u8 *src)
+{
+	u32 carry = 0;
+	for (int i = 0xF; i >= 0; i--)
 	{
-		u8 b = pdata[i];
-		pdata[i] = (b << 1) | carry;
+		u8 b = src[i];
+		dst[i] = (b << 1) | carry;
 		carry = b >> 7;
 	}
 
 	if (carry)
-		pdata[0xF] ^= 0x87;
+		dst[0xF] ^= 0x87;
 }
 
 static void _se_ll_init(se_ll_t *ll, u32 addr, u32 size)
@@ -60,10 +99,33 @@ static void _se_ll_set(se_ll_t *dst, se_ll_t *src)
 	SE(SE_OUT_LL_ADDR_REG_OFFSET) = (u32)dst;
 }
 
-static int _se_wait()
+static void _se_irq(u32 irq)
+{
+	// The status stays for _se_wait, only the line goes down.
+	SE(SE_INT_ENABLE_REG_OFFSET) = 0;
+}
+
+static int IRAM_FAST _se_wait()
 {
+	// A task sleeps on the done interrupt while the others run.
+	if (task_current() && irq_request(IRQ_SE, _se_irq))
+	{
+		while (1)
+		{
+			u32 seen = irq_count(IRQ_SE);
+			SE(SE_INT_ENABLE_REG_OFFSET) = SE_INT_OP_DONE(INT_SET);
+			if (SE(SE_INT_STATUS_REG_OFFSET) & SE_INT_OP_DONE(INT_SET))
+				break;
+			task_wait_irq(IRQ_SE, seen, 1000);
+		}
+		SE(SE_INT_ENABLE_REG_OFFSET) = 0;
+	}
+
 	while (!(SE(SE_INT_STATUS_REG_OFFSET) & SE_INT_OP_DONE(INT_SET)))
 		;
+	bpmp_cache_invalidate(_se_out, _se_out_size);
+	_se_out = NULL;
+	_se_out_size = 0;
 	if (SE(SE_INT_STATUS_REG_OFFSET) & SE_INT_ERROR(INT_SET) ||
 		SE(SE_STATUS_0) & 3 ||
 		SE(SE_ERR_STATUS_0) != 0)
@@ -71,41 +133,75 @@ static int _se_wait()
 	return 1;
 }
 
-static int _se_execute(u32 op, void *dst, u32 dst_size, const void *src, u32 src_size)
+static void IRAM_FAST _se_start(u32 op, void *dst, u32 dst_size, const void *src, u32 src_size)
 {
 	se_ll_t *ll_dst = NULL, *ll_src = NULL;
 
 	if (dst)
 	{
-		ll_dst = (se_ll_t *)malloc(sizeof(se_ll_t));
+		ll_dst = &_se_ll_dst;
 		_se_ll_init(ll_dst, (u32)dst, dst_size);
 	}
 
 	if (src)
 	{
-		ll_src = (se_ll_t *)malloc(sizeof(se_ll_t));
+		ll_src = &_se_ll_src;
 		_se_ll_init(ll_src, (u32)src, src_size);
 	}
 
 	_se_ll_set(ll_dst, ll_src);
 
+	// The engine reads the descriptors and the input from DRAM.
+	bpmp_cache_clean(&_se_ll_dst, sizeof(se_ll_t));
+	bpmp_cache_clean(&_se_ll_src, sizeof(se_ll_t));
+	bpmp_cache_clean(src, src ? src_size : 0);
+	_se_out = dst;
+	_se_out_size = dst ? dst_size : 0;
+
 	SE(SE_ERR_STATUS_0) = SE(SE_ERR_STATUS_0);
 	SE(SE_INT_STATUS_REG_OFFSET) = SE(SE_INT_STATUS_REG_OFFSET);
 	SE(SE_OPERATION_REG_OFFSET) = SE_OPERATION(op);
+}
+
+static int _se_execute(u32 op, void *dst, u32 dst_size, const void *src, u32 src_size)
+{
+	_se_start(op, dst, dst_size, src, src_size);
 
-	int res = _se_wait();
+	return _se_wait();
+}
 
-	if (src)
-		free(ll_src);
-	if (dst)
-		free(ll_dst);
+static void _se_sha256_save(se_sha256_ctx_t *ctx)
+{
+	ctx->msg_left[0] = SE(SE_SHA_MSG_LEFT_REG_OFFSET);
+	ctx->msg_left[1] = SE(0x218);
+	for (u32 i = 0; i < 8; i++)
+		ctx->hash[i] = SE(SE_HASH_RESULT_REG_OFFSET + (i << 2));
+	ctx->started = 1;
+}
 
-	return res;
+// Waits for a submitted operation, so that its registers can be reprogrammed.
+static void _se_job_finish()
+{
+	if (!_se_job.pending)
+		return;
+
+	_se_job.res = _se_wait();
+	if (_se_job.sha)
+		_se_sha256_save(_se_job.sha);
+	_se_job.sha = NULL;
+	_se_job.pending = 0;
+}
+
+static void _se_job_start(u32 op, void *dst, u32 dst_size, const void *src, u32 src_size)
+{
+	_se_job.pending = 1;
+	_se_job.res = 0;
+	_se_start(op, dst, dst_size, src, src_size);
 }
 
 static int _se_execute_one_block(u32 op, void *dst, u32 dst_size, const void *src, u32 src_size)
 {
-	u8 *block = (u8 *)malloc(0x10);
+	u8 *block = _se_block;
 	memset(block, 0, 0x10);
 
 	SE(SE_BLOCK_COUNT_REG_OFFSET) = 0;
@@ -113,8 +209,7 @@ static int _se_execute_one_block(u32 op, void *dst, u32 dst_size, const void *sr
 	memcpy(block, src, src_size);
 	int res = _se_execute(op, block, 0x10, block, 0x10);
 	memcpy(dst, block, dst_size);
-	
-	free(block);
+
 	return res;
 }
 
@@ -127,6 +222,7 @@ static void _se_aes_ctr_set(void *ctr)
 
 void se_rsa_acc_ctrl(u32 rs, u32 flags)
 {
+	_se_job_finish();
 	if (flags & 0x7F)
 		SE(SE_RSA_KEYTABLE_ACCESS_REG_OFFSET + 4 * rs) = (((flags >> 4) & 4) | (flags & 3)) ^ 7;
 	if (flags & 0x80)
@@ -135,6 +231,7 @@ void se_rsa_acc_ctrl(u32 rs, u32 flags)
 
 void se_key_acc_ctrl(u32 ks, u32 flags)
 {
+	_se_job_finish();
 	if (flags & 0x7F)
 		SE(SE_KEY_TABLE_ACCESS_REG_OFFSET + 4 * ks) = ~flags;
 	if (flags & 0x80)
@@ -144,6 +241,8 @@ void se_key_acc_ctrl(u32 ks, u32 flags)
 void se_aes_key_set(u32 ks, void *key, u32 size)
 {
 	u32 *data = (u32 *)key;
+	_se_job_finish();
+	_se_cmac_valid &= ~(1 << ks);
 	for (u32 i = 0; i < size / 4; i++)
 	{
 		SE(SE_KEYTABLE_REG_OFFSET) = SE_KEYTABLE_SLOT(ks) | i;
@@ -153,6 +252,8 @@ void se_aes_key_set(u32 ks, void *key, u32 size)
 
 void se_aes_key_clear(u32 ks)
 {
+	_se_job_finish();
+	_se_cmac_valid &= ~(1 << ks);
 	for (u32 i = 0; i < TEGRA_SE_AES_MAX_KEY_SIZE / 4; i++)
 	{
 		SE(SE_KEYTABLE_REG_OFFSET) = SE_KEYTABLE_SLOT(ks) | i;
@@ -160,8 +261,21 @@ void se_aes_key_clear(u32 ks)
 	}
 }
 
+static void _se_aes_iv_clear(u32 ks)
+{
+	for (u32 i = 0; i < 4; i++)
+	{
+		SE(SE_KEYTABLE_REG_OFFSET) = SE_KEYTABLE_SLOT(ks) | SE_KEYTABLE_QUAD(QUAD_ORG_IV) | SE_KEYTABLE_PKT(i);
+		SE(SE_KEYTABLE_DATA0_REG_OFFSET) = 0;
+		SE(SE_KEYTABLE_REG_OFFSET) = SE_KEYTABLE_SLOT(ks) | SE_KEYTABLE_QUAD(QUAD_UPDTD_IV) | SE_KEYTABLE_PKT(i);
+		SE(SE_KEYTABLE_DATA0_REG_OFFSET) = 0;
+	}
+}
+
 int se_aes_unwrap_key(u32 ks_dst, u32 ks_src, const void *input)
 {
+	_se_job_finish();
+	_se_cmac_valid &= ~(1 << ks_dst);
 	SE(SE_CONFIG_REG_OFFSET) = SE_CONFIG_DEC_ALG(ALG_AES_DEC) | SE_CONFIG_DST(DST_KEYTAB);
 	SE(SE_CRYPTO_REG_OFFSET) = SE_CRYPTO_KEY_INDEX(ks_src) | SE_CRYPTO_CORE_SEL(CORE_DECRYPT);
 	SE(SE_CRYPTO_KEYTABLE_DST_REG_OFFSET) = SE_CRYPTO_KEYTABLE_DST_KEY_INDEX(ks_dst);
@@ -170,6 +284,7 @@ int se_aes_unwrap_key(u32 ks_dst, u32 ks_src, const void *input)
 
 int se_aes_crypt_block_ecb(u32 ks, u32 enc, void *dst, const void *src)
 {
+	_se_job_finish();
 	if (enc)
 	{
 		SE(SE_CONFIG_REG_OFFSET) = SE_CONFIG_ENC_ALG(ALG_AES_ENC) | SE_CONFIG_DST(DST_MEMORY);
@@ -184,13 +299,119 @@ int se_aes_crypt_block_ecb(u32 ks, u32 enc, void *dst, const void *src)
 	return _se_execute(OP_START, dst, 0x10, src, 0x10);
 }
 
-int se_aes_crypt_ctr(u32 ks, void *dst, u32 dst_size, const void *src, u32 src_size, void *ctr)
+static void _se_aes_ecb_config(u32 ks, u32 enc, u32 src_size)
+{
+	if (enc)
+	{
+		SE(SE_CONFIG_REG_OFFSET) = SE_CONFIG_ENC_ALG(ALG_AES_ENC) | SE_CONFIG_DST(DST_MEMORY);
+		SE(SE_CRYPTO_REG_OFFSET) = SE_CRYPTO_KEY_INDEX(ks) | SE_CRYPTO_CORE_SEL(CORE_ENCRYPT);
+	}
+	else
+	{
+		SE(SE_CONFIG_REG_OFFSET) = SE_CONFIG_DEC_ALG(ALG_AES_DEC) | SE_CONFIG_DST(DST_MEMORY);
+		SE(SE_CRYPTO_REG_OFFSET) = SE_CRYPTO_KEY_INDEX(ks) | SE_CRYPTO_CORE_SEL(CORE_DECRYPT);
+	}
+	SE(SE_BLOCK_COUNT_REG_OFFSET) = (src_size >> 4) - 1;
+}
+
+int se_aes_crypt_ecb(u32 ks, u32 enc, void *dst, u32 dst_size, const void *src, u32 src_size)
+{
+	_se_job_finish();
+	_se_aes_ecb_config(ks, enc, src_size);
+	return _se_execute(OP_START, dst, dst_size, src, src_size);
+}
+
+// Sizes must be a non-zero multiple of 0x10.
+int se_aes_crypt_ecb_submit(u32 ks, u32 enc, void *dst, u32 dst_size, const void *src, u32 src_size)
+{
+	if (!src_size || (src_size & 0xF) || dst_size < src_size)
+		return 0;
+
+	_se_job_finish();
+	_se_aes_ecb_config(ks, enc, src_size);
+	_se_job_start(OP_START, dst, dst_size, src, src_size);
+
+	return 1;
+}
+
+static int _se_aes_cmac_subkeys(u32 ks)
+{
+	if (_se_cmac_valid & (1 << ks))
+		return 1;
+
+	// L = AES(K, 0), K1 = L * x, K2 = K1 * x.
+	u8 *k1 = _se_cmac_subkeys[ks][0];
+	u8 *k2 = _se_cmac_subkeys[ks][1];
+	memset(k1, 0, 0x10);
+	if (!se_aes_crypt_block_ecb(ks, 1, k1, k1))
+		return 0;
+	_gf256_mul_x_be(k1, k1);
+	_gf256_mul_x_be(k2, k1);
+
+	_se_cmac_valid |= 1 << ks;
+	return 1;
+}
+
+int se_aes_cmac(u32 ks, void *dst, u32 dst_size, const void *src, u32 src_size)
+{
+	_se_job_finish();
+	if (!_se_aes_cmac_subkeys(ks))
+		return 0;
+
+	// CBC-MAC into the hash registers. The chaining value carries over between operations in the updated IV.
+	u32 crypto = SE_CRYPTO_KEY_INDEX(ks) | SE_CRYPTO_INPUT_SEL(INPUT_AHB) | SE_CRYPTO_XOR_POS(XOR_TOP) |
+		SE_CRYPTO_VCTRAM_SEL(VCTRAM_AESOUT) | SE_CRYPTO_HASH(HASH_ENABLE) | SE_CRYPTO_CORE_SEL(CORE_ENCRYPT);
+	SE(SE_CONFIG_REG_OFFSET) = SE_CONFIG_ENC_ALG(ALG_AES_ENC) | SE_CONFIG_DST(DST_HASHREG);
+	SE(SE_CRYPTO_REG_OFFSET) = crypto;
+	_se_aes_iv_clear(ks);
+
+	// Everything but the last block in one operation.
+	u32 num_blocks = (src_size + 0xF) >> 4;
+	if (num_blocks > 1)
+	{
+		SE(SE_BLOCK_COUNT_REG_OFFSET) = num_blocks - 2;
+		if (!_se_execute(OP_START, NULL, 0, src, (num_blocks - 1) << 4))
+			return 0;
+		SE(SE_CRYPTO_REG_OFFSET) = crypto | SE_CRYPTO_IV_SEL(IV_UPDATED);
+	}
+
+	// The last block is padded and masked with K2 if partial, or masked with K1 if complete.
+	u8 *last = _se_block;
+	u32 last_off = num_blocks ? (num_blocks - 1) << 4 : 0;
+	u32 last_size = src_size - last_off;
+	const u8 *subkey = _se_cmac_subkeys[ks][last_size == 0x10 ? 0 : 1];
+	memset(last, 0, 0x10);
+	memcpy(last, (const u8 *)src + last_off, last_size);
+	if (last_size < 0x10)
+		last[last_size] = 0x80;
+	for (u32 i = 0; i < 0x10; i++)
+		last[i] ^= subkey[i];
+
+	SE(SE_BLOCK_COUNT_REG_OFFSET) = 0;
+	if (!_se_execute(OP_START, NULL, 0, last, 0x10))
+		return 0;
+
+	u32 mac[4];
+	for (u32 i = 0; i < 4; i++)
+		mac[i] = SE(SE_HASH_RESULT_REG_OFFSET + (i << 2));
+	memcpy(dst, mac, MIN(dst_size, 0x10));
+
+	return 1;
+}
+
+static void _se_aes_ctr_config(u32 ks, void *ctr)
 {
 	SE(SE_SPARE_0_REG_OFFSET) = 1;
 	SE(SE_CONFIG_REG_OFFSET) = SE_CONFIG_ENC_ALG(ALG_AES_ENC) | SE_CONFIG_DST(DST_MEMORY);
 	SE(SE_CRYPTO_REG_OFFSET) = SE_CRYPTO_KEY_INDEX(ks) | SE_CRYPTO_CORE_SEL(CORE_ENCRYPT) |
 		SE_CRYPTO_XOR_POS(XOR_BOTTOM) | SE_CRYPTO_INPUT_SEL(INPUT_LNR_CTR) | SE_CRYPTO_CTR_VAL(1);
 	_se_aes_ctr_set(ctr);
+}
+
+int se_aes_crypt_ctr(u32 ks, void *dst, u32 dst_size, const void *src, u32 src_size, void *ctr)
+{
+	_se_job_finish();
+	_se_aes_ctr_config(ks, ctr);
 
 	u32 src_size_aligned = src_size & 0xFFFFFFF0;
 	u32 src_size_delta = src_size & 0xF;
@@ -210,79 +431,192 @@ int se_aes_crypt_ctr(u32 ks, void *dst, u32 dst_size, const void *src, u32 src_s
 	return 1;
 }
 
-int se_aes_xts_crypt_sec(u32 ks1, u32 ks2, u32 enc, u64 sec, void *dst, void *src, u32 secsize)
+// Sizes must be a non-zero multiple of 0x10. The counter is consumed before returning.
+int se_aes_crypt_ctr_submit(u32 ks, void *dst, u32 dst_size, const void *src, u32 src_size, void *ctr)
 {
-	int res = 0;
-	u8 *tweak = (u8 *)malloc(0x10);
-	u8 *pdst = (u8 *)dst;
-	u8 *psrc = (u8 *)src;
+	if (!src_size || (src_size & 0xF) || dst_size < src_size)
+		return 0;
 
-	//Generate tweak.
-	for (int i = 0xF; i >= 0; i--)
+	_se_job_finish();
+	_se_aes_ctr_config(ks, ctr);
+	SE(SE_BLOCK_COUNT_REG_OFFSET) = (src_size >> 4) - 1;
+	_se_job_start(OP_START, dst, dst_size, src, src_size);
+
+	return 1;
+}
+
+static void _se_xor_words(u32 *dst, const u32 *src, const u32 *tweak, u32 size)
+{
+	for (u32 i = 0; i < size / 4; i += 4)
+	{
+		dst[i] = src[i] ^ tweak[i];
+		dst[i + 1] = src[i + 1] ^ tweak[i + 1];
+		dst[i + 2] = src[i + 2] ^ tweak[i + 2];
+		dst[i + 3] = src[i + 3] ^ tweak[i + 3];
+	}
+}
+
+// One run of sectors that fits the tweak buffer: two ECB operations in total, whatever the sector count.
+static int _se_aes_xts_crypt_run(u32 ks1, u32 ks2, u32 enc, u64 sec, u32 *dst, const u32 *src, u32 secsize, u32 num_secs)
+{
+	u32 *stream = _se_xts_tweaks;
+	u32 *tweak0 = _se_xts_tweaks + SE_XTS_CHUNK_SIZE / 4;
+
+	// Encrypt all the big-endian sector numbers at once.
+	memset(tweak0, 0, num_secs * 0x10);
+	for (u32 i = 0; i < num_secs; i++)
 	{
-		tweak[i] = sec & 0xFF;
-		sec >>= 8;
+		u64 n = sec + i;
+		tweak0[i * 4 + 2] = byte_swap_32((u32)(n >> 32));
+		tweak0[i * 4 + 3] = byte_swap_32((u32)n);
 	}
-	if (!se_aes_crypt_block_ecb(ks1, 1, tweak, tweak))
-		goto out;
+	if (!se_aes_crypt_ecb(ks1, 1, tweak0, num_secs * 0x10, tweak0, num_secs * 0x10))
+		return 0;
 
-	//We are assuming a 0x10-aligned sector size in this implementation.
-	for (u32 i = 0; i < secsize / 0x10; i++)
+	// Expand every sector's tweak into the stream.
+	for (u32 i = 0; i < num_secs; i++)
 	{
-		for (u32 j = 0; j < 0x10; j++)
-			pdst[j] = psrc[j] ^ tweak[j];
-		if (!se_aes_crypt_block_ecb(ks2, enc, pdst, pdst))
-			goto out;
-		for (u32 j = 0; j < 0x10; j++)
-			pdst[j] = pdst[j] ^ tweak[j];
-		_gf256_mul_x(tweak);
-		psrc += 0x10;
-		pdst += 0x10;
+		u32 *t = stream + i * (secsize / 4);
+		memcpy(t, &tweak0[i * 4], 0x10);
+		for (u32 j = 4; j < secsize / 4; j += 4)
+			_gf256_mul_x_le(&t[j], &t[j - 4]);
 	}
 
-	res = 1;
+	u32 size = secsize * num_secs;
+	_se_xor_words(dst, src, stream, size);
+	if (!se_aes_crypt_ecb(ks2, enc, dst, size, dst, size))
+		return 0;
+	_se_xor_words(dst, dst, stream, size);
 
-out:;
-	free(tweak);
-	return res;
+	return 1;
 }
 
+//Buffers must be word aligned and the sector size a multiple of 0x10 up to SE_XTS_CHUNK_SIZE.
 int se_aes_xts_crypt(u32 ks1, u32 ks2, u32 enc, u64 sec, void *dst, void *src, u32 secsize, u32 num_secs)
 {
 	u8 *pdst = (u8 *)dst;
 	u8 *psrc = (u8 *)src;
 
-	for (u32 i = 0; i < num_secs; i++)
-		if (!se_aes_xts_crypt_sec(ks1, ks2, enc, sec + i, pdst + secsize * i, psrc + secsize * i, secsize))
+	if (!secsize || secsize > SE_XTS_CHUNK_SIZE || (secsize & 0xF))
+		return 0;
+
+	if (!_se_xts_tweaks)
+		_se_xts_tweaks = (u32 *)dma_malloc(SE_XTS_CHUNK_SIZE + SE_XTS_MAX_SECS * 0x10);
+
+	u32 secs_per_run = MIN(SE_XTS_CHUNK_SIZE / secsize, SE_XTS_MAX_SECS);
+	while (num_secs)
+	{
+		u32 cnt = MIN(num_secs, secs_per_run);
+		if (!_se_aes_xts_crypt_run(ks1, ks2, enc, sec, (u32 *)pdst, (const u32 *)psrc, secsize, cnt))
 			return 0;
 
+		sec += cnt;
+		num_secs -= cnt;
+		pdst += secsize * cnt;
+		psrc += secsize * cnt;
+	}
+
 	return 1;
 }
 
-// se_calc_sha256() was derived from Atmosphère's se_calculate_sha256.
-int se_calc_sha256(void *dst, const void *src, u32 src_size)
+int se_aes_xts_crypt_sec(u32 ks1, u32 ks2, u32 enc, u64 sec, void *dst, void *src, u32 secsize)
 {
-	int res;
-	// Setup config for SHA256, size = BITS(src_size).
+	return se_aes_xts_crypt(ks1, ks2, enc, sec, dst, src, secsize, 1);
+}
+
+void se_sha256_init(se_sha256_ctx_t *ctx, u64 total_size)
+{
+	memset(ctx, 0, sizeof(se_sha256_ctx_t));
+	ctx->total_size = total_size;
+	ctx->msg_left[0] = (u32)(total_size << 3);
+	ctx->msg_left[1] = (u32)(total_size >> 29);
+}
+
+static void _se_sha256_config(se_sha256_ctx_t *ctx)
+{
+	// Setup config for SHA256, size = BITS(total_size).
 	SE(SE_CONFIG_REG_OFFSET) = SE_CONFIG_ENC_MODE(MODE_SHA256) | SE_CONFIG_ENC_ALG(ALG_SHA) | SE_CONFIG_DST(DST_HASHREG);
-	SE(SE_SHA_CONFIG_REG_OFFSET) = 1;
-	SE(SE_SHA_MSG_LENGTH_REG_OFFSET) = (u32)(src_size << 3);
-	SE(0x208) = 0;
+	SE(SE_SHA_CONFIG_REG_OFFSET) = ctx->started ? SHA_CONTINUE : SHA_INIT_HASH;
+	SE(SE_SHA_MSG_LENGTH_REG_OFFSET) = (u32)(ctx->total_size << 3);
+	SE(0x208) = (u32)(ctx->total_size >> 29);
 	SE(0x20C) = 0;
 	SE(0x210) = 0;
-	SE(SE_SHA_MSG_LEFT_REG_OFFSET) = (u32)(src_size << 3);
-	SE(0x218) = 0;
-   	SE(0x21C) = 0;
+	SE(SE_SHA_MSG_LEFT_REG_OFFSET) = ctx->msg_left[0];
+	SE(0x218) = ctx->msg_left[1];
+	SE(0x21C) = 0;
 	SE(0x220) = 0;
 
+	// Restore the intermediate hash, another operation may have used the engine.
+	if (ctx->started)
+		for (u32 i = 0; i < 8; i++)
+			SE(SE_HASH_RESULT_REG_OFFSET + (i << 2)) = ctx->hash[i];
+}
+
+// Chunks must be a multiple of the SHA256 block size (64 bytes), except the last one.
+int se_sha256_update(se_sha256_ctx_t *ctx, const void *src, u32 src_size)
+{
+	_se_job_finish();
+	_se_sha256_config(ctx);
+
 	// Trigger the operation.
-	res = _se_execute(OP_START, NULL, 0, src, src_size);
+	int res = _se_execute(OP_START, NULL, 0, src, src_size);
+
+	// Save state for the next chunk.
+	_se_sha256_save(ctx);
+
+	return res;
+}
+
+// Same as se_sha256_update(), but the state is only saved into ctx when the job completes.
+int se_sha256_update_submit(se_sha256_ctx_t *ctx, const void *src, u32 src_size)
+{
+	_se_job_finish();
+	_se_sha256_config(ctx);
+	_se_job.sha = ctx;
+	_se_job_start(OP_START, NULL, 0, src, src_size);
+
+	return 1;
+}
+
+int se_sha256_final(se_sha256_ctx_t *ctx, void *dst)
+{
+	// A submitted last chunk only lands in ctx once its job is done.
+	_se_job_finish();
 
 	// Copy output hash.
 	u32 *dst32 = (u32 *)dst;
 	for (u32 i = 0; i < 8; i++)
-		dst32[i] = byte_swap_32(SE(SE_HASH_RESULT_REG_OFFSET + (i << 2)));
+		dst32[i] = byte_swap_32(ctx->hash[i]);
+
+	// Whole message must have been hashed.
+	return ctx->started && !ctx->msg_left[0] && !ctx->msg_left[1];
+}
+
+// se_calc_sha256() was derived from Atmosphère's se_calculate_sha256.
+int se_calc_sha256(void *dst, const void *src, u32 src_size)
+{
+	se_sha256_ctx_t ctx;
+
+	se_sha256_init(&ctx, src_size);
+	int res = se_sha256_update(&ctx, src, src_size);
+	se_sha256_final(&ctx, dst);
 
 	return res;
 }
 
+// Returns 1 once the submitted operation is done. Never blocks.
+int se_poll()
+{
+	if (!_se_job.pending)
+		return 1;
+
+	return (SE(SE_INT_STATUS_REG_OFFSET) & SE_INT_OP_DONE(INT_SET)) ? 1 : 0;
+}
+
+// Waits for the submitted operation and returns its result.
+int se_complete()
+{
+	_se_job_finish();
+
+	return _se_job.res;
+}
@@ -19,13 +19,33 @@
 
 #include "types.h"
 
+typedef struct _se_sha256_ctx_t
+{
+	u64 total_size;
+	u32 msg_left[2];
+	u32 hash[8];
+	int started;
+} se_sha256_ctx_t;
+
 void se_rsa_acc_ctrl(u32 rs, u32 flags);
 void se_key_acc_ctrl(u32 ks, u32 flags);
 void se_aes_key_set(u32 ks, void *key, u32 size);
 void se_aes_key_clear(u32 ks);
 int se_aes_unwrap_key(u32 ks_dst, u32 ks_src, const void *input);
 int se_aes_crypt_block_ecb(u32 ks, u32 enc, void *dst, const void *src);
+int se_aes_crypt_ecb(u32 ks, u32 enc, void *dst, u32 dst_size, const void *src, u32 src_size);
+int se_aes_crypt_ecb_submit(u32 ks, u32 enc, void *dst, u32 dst_size, const void *src, u32 src_size);
+int se_aes_cmac(u32 ks, void *dst, u32 dst_size, const void *src, u32 src_size);
 int se_aes_crypt_ctr(u32 ks, void *dst, u32 dst_size, const void *src, u32 src_size, void *ctr);
+int se_aes_crypt_ctr_submit(u32 ks, void *dst, u32 dst_size, const void *src, u32 src_size, void *ctr);
+int se_aes_xts_crypt_sec(u32 ks1, u32 ks2, u32 enc, u64 sec, void *dst, void *src, u32 secsize);
+int se_aes_xts_crypt(u32 ks1, u32 ks2, u32 enc, u64 sec, void *dst, void *src, u32 secsize, u32 num_secs);
 int se_calc_sha256(void *dst, const void *src, u32 src_size);
+void se_sha256_init(se_sha256_ctx_t *ctx, u64 total_size);
+int se_sha256_update(se_sha256_ctx_t *ctx, const void *src, u32 src_size);
+int se_sha256_update_submit(se_sha256_ctx_t *ctx, const void *src, u32 src_size);
+int se_sha256_final(se_sha256_ctx_t *ctx, void *dst);
+int se_poll();
+int se_complete();
 
 #endif
@@ -233,6 +233,8 @@
 #define SE_SHA_CONFIG_REG_OFFSET	0x200
 #define SHA_DISABLE		0
 #define SHA_ENABLE		1
+#define SHA_CONTINUE	0
+#define SHA_INIT_HASH	1
 
 #define SE_SHA_MSG_LENGTH_REG_OFFSET	0x204
 #define SE_SHA_MSG_LEFT_REG_OFFSET		0x214
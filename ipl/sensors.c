@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "sensors.h"
+#include "bq24193.h"
+#include "max17050.h"
+#include "util.h"
+
+static sensors_t _sensors;
+
+const sensors_t *sensors_refresh()
+{
+	u16 regs[MAX17050_AvgCurrent + 1];
+	u8 chrg[BQ24193_NUM_REGS];
+
+	_sensors.valid = 0;
+
+	// RepCap through AvgCurrent covers everything but the charger in one burst.
+	if (!max17050_read_regs(regs, MAX17050_RepCap, MAX17050_AvgCurrent - MAX17050_RepCap + 1))
+	{
+		int value = 0;
+		max17050_get_property_regs(regs, MAX17050_RepCap, &_sensors.batt_cap);
+		max17050_get_property_regs(regs, MAX17050_RepSOC, &value);
+		_sensors.batt_percent = value;
+		max17050_get_property_regs(regs, MAX17050_VCELL, &_sensors.batt_volt);
+		max17050_get_property_regs(regs, MAX17050_AvgCurrent, &_sensors.batt_curr);
+		max17050_get_property_regs(regs, MAX17050_TEMP, &_sensors.batt_temp);
+		_sensors.valid |= SENSORS_BATT_VALID;
+	}
+
+	if (!bq24193_read_regs(chrg))
+	{
+		bq24193_get_property_regs(chrg, BQ24193_ChargeStatus, &_sensors.chrg_status);
+		_sensors.valid |= SENSORS_CHRG_VALID;
+	}
+
+	_sensors.timestamp_ms = get_tmr_ms();
+
+	return &_sensors;
+}
+
+const sensors_t *sensors_get(u32 max_age_ms)
+{
+	if (!_sensors.timestamp_ms || get_tmr_ms() - _sensors.timestamp_ms >= max_age_ms)
+		return sensors_refresh();
+
+	return &_sensors;
+}
+
+void sensors_invalidate()
+{
+	_sensors.timestamp_ms = 0;
+}
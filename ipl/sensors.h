@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _SENSORS_H_
+#define _SENSORS_H_
+
+#include "types.h"
+
+/*! Default age after which a cached snapshot gets re-read. */
+#define SENSORS_MAX_AGE_MS 5000
+
+#define SENSORS_BATT_VALID (1 << 0)
+#define SENSORS_CHRG_VALID (1 << 1)
+
+typedef struct _sensors_t
+{
+	u32 valid;        // SENSORS_*_VALID of the last refresh.
+	u32 timestamp_ms; // When the last refresh happened.
+	u32 batt_percent; // RepSOC, 1/256% units.
+	int batt_cap;     // RepCap, mAh.
+	int batt_volt;    // mV.
+	int batt_curr;    // Average, uA.
+	int batt_temp;    // 0.1 oC.
+	int chrg_status;  // BQ24193_ChargeStatus.
+} sensors_t;
+
+/*! Re-read the fuel gauge and charger now. */
+const sensors_t *sensors_refresh();
+/*! Return the cached snapshot, refreshing it first when older than max_age_ms. */
+const sensors_t *sensors_get(u32 max_age_ms);
+/*! Force the next sensors_get to refresh, e.g. after touching the charger. */
+void sensors_invalidate();
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "statlog.h"
+#include "sdmmc.h"
+#include "util.h"
+#include "ff.h"
+
+extern int sd_mounted;
+
+typedef struct _statlog_buf_t
+{
+	u32 magic;
+	u32 crc;
+	u32 seq;
+	u32 used;
+	u8 data[STATLOG_SIZE - 16];
+} statlog_buf_t;
+
+static statlog_buf_t *_statlog = (statlog_buf_t *)STATLOG_ADDR;
+
+static u32 _statlog_crc()
+{
+	return crc32c(&_statlog->seq, 8 + MIN(_statlog->used, sizeof(_statlog->data)));
+}
+
+// A buffer left by an earlier payload is kept if intact, so its records are logged by this one.
+static void _statlog_check()
+{
+	if (_statlog->magic == STATLOG_MAGIC && _statlog->used <= sizeof(_statlog->data) && _statlog->crc == _statlog_crc())
+		return;
+
+	memset(_statlog, 0, 16);
+	_statlog->magic = STATLOG_MAGIC;
+	_statlog->crc = _statlog_crc();
+}
+
+static void *_statlog_alloc(u32 type, u32 size)
+{
+	_statlog_check();
+
+	size = ALIGN(size, 4);
+	// Full until the next mount, newer records are dropped.
+	if (_statlog->used + size > sizeof(_statlog->data))
+		return NULL;
+
+	statlog_hdr_t *hdr = (statlog_hdr_t *)&_statlog->data[_statlog->used];
+	memset(hdr, 0, size);
+	hdr->size = size;
+	hdr->type = type;
+	hdr->version = STATLOG_VERSION;
+	hdr->seq = _statlog->seq++;
+
+	return hdr;
+}
+
+static void _statlog_commit(statlog_hdr_t *hdr)
+{
+	_statlog->used += hdr->size;
+	_statlog->crc = _statlog_crc();
+}
+
+void statlog_boot(int ok, u32 kb, u32 pkg2_size, u32 kernel_size)
+{
+	const bootprof_t *prof = bootprof_peek();
+	if (!prof)
+		return;
+
+	u32 num = MIN(prof->num_stages, BOOTPROF_MAX_STAGES);
+	statlog_boot_t *rec = (statlog_boot_t *)_statlog_alloc(STATLOG_REC_BOOT,
+		sizeof(statlog_boot_t) - (BOOTPROF_MAX_STAGES - num) * sizeof(u32));
+	if (!rec)
+		return;
+
+	const sdmmc_stats_t *emmc = sdmmc_get_stats(SDMMC_4);
+	rec->total_us = prof->last_us - prof->start_us;
+	rec->pkg2_size = pkg2_size;
+	rec->kernel_size = kernel_size;
+	rec->emmc_errors = emmc->crc_errors + emmc->timeouts + emmc->adma_errors;
+	rec->emmc_retries = emmc->rw_retries;
+	rec->kb = kb;
+	rec->ok = ok;
+	rec->num_stages = num;
+	for (u32 i = 0; i < num; i++)
+	{
+		rec->stage_us[i] = prof->stages[i].elapsed_us;
+		if (!strcmp(prof->stages[i].name, "keygen"))
+			rec->keygen_us = prof->stages[i].elapsed_us;
+	}
+
+	_statlog_commit(&rec->hdr);
+}
+
+void statlog_op(u32 op, u32 dev, const char *name, int ok, u32 size_kb, u32 elapsed_ms, u32 retries)
+{
+	statlog_op_t *rec = (statlog_op_t *)_statlog_alloc(STATLOG_REC_OP, sizeof(statlog_op_t));
+	if (!rec)
+		return;
+
+	strncpy(rec->name, name, sizeof(rec->name) - 1);
+	rec->op = op;
+	rec->dev = dev;
+	rec->ok = ok;
+	rec->size_kb = size_kb;
+	rec->elapsed_ms = elapsed_ms;
+	rec->retries = retries;
+
+	_statlog_commit(&rec->hdr);
+}
+
+void statlog_flush()
+{
+	if (!sd_mounted)
+		return;
+
+	_statlog_check();
+	if (!_statlog->used)
+		return;
+
+	FIL fp;
+	if (f_open(&fp, STATLOG_LOG_PATH, FA_WRITE | FA_OPEN_APPEND) == FR_OK)
+	{
+		f_write(&fp, _statlog->data, _statlog->used, NULL);
+		f_close(&fp);
+	}
+
+	// Log them once, even if the write failed. Sequence numbers carry on.
+	_statlog->used = 0;
+	_statlog->crc = _statlog_crc();
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STATLOG_H_
+#define _STATLOG_H_
+
+#include "types.h"
+#include "bootprof.h"
+
+/*! Reserved DRAM below the boot profile, pending records outlive the launch like it. */
+#define STATLOG_ADDR 0x9001E000
+#define STATLOG_SIZE 0x1000
+#define STATLOG_MAGIC 0x474C5348 // HSLG.
+#define STATLOG_VERSION 1
+#define STATLOG_LOG_PATH "stats.bin"
+
+/*! Record types. */
+#define STATLOG_REC_BOOT 1
+#define STATLOG_REC_OP   2
+
+/*! Operations. */
+#define STATLOG_OP_BACKUP  0
+#define STATLOG_OP_RESTORE 1
+
+/*! Devices. */
+#define STATLOG_DEV_EMMC 0
+#define STATLOG_DEV_SD   1
+
+/*! Every record starts with this. size covers the header and is a multiple of 4. */
+typedef struct _statlog_hdr_t
+{
+	u16 size;
+	u8 type;
+	u8 version;
+	u32 seq;
+} statlog_hdr_t;
+
+/*! A HOS launch. Stages follow the order of hos_launch(), as many as ran. */
+typedef struct _statlog_boot_t
+{
+	statlog_hdr_t hdr;
+	u32 total_us;
+	u32 keygen_us;
+	u32 pkg2_size;
+	u32 kernel_size;
+	u32 emmc_errors;  // eMMC CRC, timeout and ADMA errors since power on.
+	u32 emmc_retries; // eMMC retried requests since power on.
+	u8 kb;
+	u8 ok;
+	u8 num_stages;
+	u8 rsvd;
+	u32 stage_us[BOOTPROF_MAX_STAGES];
+} statlog_boot_t;
+
+/*! A backup or restore of one partition. */
+typedef struct _statlog_op_t
+{
+	statlog_hdr_t hdr;
+	char name[20];
+	u8 op;
+	u8 dev;
+	u8 ok;
+	u8 rsvd;
+	u32 size_kb;
+	u32 elapsed_ms;
+	u32 retries;
+} statlog_op_t;
+
+/*! Queues a record of a HOS launch, from the boot profile as far as it got. */
+void statlog_boot(int ok, u32 kb, u32 pkg2_size, u32 kernel_size);
+/*! Queues a record of a long operation. */
+void statlog_op(u32 op, u32 dev, const char *name, int ok, u32 size_kb, u32 elapsed_ms, u32 retries);
+/*! Appends all queued records to STATLOG_LOG_PATH in one write. Needs the SD card mounted. */
+void statlog_flush();
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "task.h"
+#include "cluster.h"
+#include "heap.h"
+#include "irq.h"
+#include "t210.h"
+#include "util.h"
+
+// R4-R11 and LR, as task_switch() pops them.
+#define TASK_FRAME_WORDS 9
+
+static task_t _tasks[TASK_MAX_TASKS];
+static task_t *_task_cur = NULL;
+static u32 *_task_sched_sp;
+
+static void _task_main()
+{
+	task_t *t = _task_cur;
+	t->res = t->fn(t->arg);
+	t->done = 1;
+
+	// The scheduler frees the stack, this one never comes back.
+	task_switch(&t->sp, _task_sched_sp);
+	while (1)
+		;
+}
+
+task_t *task_create(const char *name, task_fn_t fn, void *arg, u32 stack_size)
+{
+	task_t *t = NULL;
+	for (u32 i = 0; i < TASK_MAX_TASKS && !t; i++)
+		if (!_tasks[i].fn)
+			t = &_tasks[i];
+	if (!t)
+		return NULL;
+
+	if (!stack_size)
+		stack_size = TASK_STACK_SIZE;
+	stack_size = ALIGN(stack_size, 8);
+
+	memset(t, 0, sizeof(task_t));
+	t->name = name;
+	t->fn = fn;
+	t->arg = arg;
+	t->stack = (u8 *)malloc(stack_size);
+	t->wait_irq = TASK_NO_IRQ;
+	t->wake_us = get_tmr_us();
+
+	// First switch "returns" into _task_main.
+	t->sp = (u32 *)(t->stack + stack_size) - TASK_FRAME_WORDS;
+	memset(t->sp, 0, TASK_FRAME_WORDS * 4);
+	t->sp[TASK_FRAME_WORDS - 1] = (u32)_task_main;
+
+	return t;
+}
+
+static int _task_ready(task_t *t, u32 now)
+{
+	if (t->wait_irq != TASK_NO_IRQ && irq_count(t->wait_irq) != t->irq_seen)
+		return 1;
+
+	return (s32)(now - t->wake_us) >= 0;
+}
+
+int task_run()
+{
+	int res = 1;
+
+	// Tasks can queue more tasks, but only the caller of the first run schedules them.
+	if (_task_cur)
+		return 0;
+
+	// Interrupts only wake tasks, so the CPU takes them only while tasks run.
+	irq_init();
+
+	while (1)
+	{
+		u32 active = 0;
+		u32 ran = 0;
+		u32 idle_us = HALT_COP_MAX_CNT;
+
+		for (u32 i = 0; i < TASK_MAX_TASKS; i++)
+		{
+			task_t *t = &_tasks[i];
+			if (!t->fn || t->done)
+				continue;
+			active++;
+
+			u32 now = get_tmr_us();
+			if (!_task_ready(t, now))
+			{
+				idle_us = MIN(idle_us, t->wake_us - now);
+				continue;
+			}
+
+			t->wait_irq = TASK_NO_IRQ;
+			_task_cur = t;
+			task_switch(&_task_sched_sp, t->sp);
+			_task_cur = NULL;
+			ran++;
+
+			if (t->done)
+			{
+				res &= t->res != 0;
+				free(t->stack);
+				t->fn = NULL;
+			}
+		}
+
+		if (!active)
+			break;
+
+		// Everybody waits, halt until an interrupt or the nearest wake up.
+		if (!ran && idle_us && irq_active())
+			FLOW_CTLR(FLOW_CTLR_HALT_COP_EVENTS) = HALT_COP_WAITEVENT | HALT_COP_LIC_IRQ | HALT_COP_USEC | idle_us;
+	}
+
+	irq_end();
+
+	return res;
+}
+
+task_t *task_current()
+{
+	return _task_cur;
+}
+
+void task_yield()
+{
+	task_t *t = _task_cur;
+	if (!t)
+		return;
+
+	t->wake_us = get_tmr_us();
+	task_switch(&t->sp, _task_sched_sp);
+}
+
+void task_sleep_us(u32 us)
+{
+	task_t *t = _task_cur;
+	if (!t)
+	{
+		usleep(us);
+		return;
+	}
+
+	t->wake_us = get_tmr_us() + us;
+	task_switch(&t->sp, _task_sched_sp);
+}
+
+void task_wait_irq(u32 irq, u32 seen, u32 us)
+{
+	task_t *t = _task_cur;
+	if (!t)
+		return;
+
+	t->wait_irq = irq;
+	t->irq_seen = seen;
+	t->wake_us = get_tmr_us() + us;
+	task_switch(&t->sp, _task_sched_sp);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TASK_H_
+#define _TASK_H_
+
+#include "types.h"
+
+#define TASK_MAX_TASKS  8
+#define TASK_STACK_SIZE 0x1000
+#define TASK_NO_IRQ     0xFFFFFFFF
+
+/*
+ * Cooperative tasks on the BPMP. They only switch in task_yield() and the
+ * waits built on it, which the storage, SE, I2C and button drivers call in
+ * their polling loops. Nothing below FatFs is re-entrant, so a device or
+ * volume belongs to one task at a time.
+ */
+typedef int (*task_fn_t)(void *arg);
+
+typedef struct _task_t
+{
+	const char *name;
+	task_fn_t fn;
+	void *arg;
+	u32 *sp;
+	u8 *stack;
+	u32 done;
+	int res;
+	u32 wake_us;
+	u32 wait_irq;
+	u32 irq_seen;
+} task_t;
+
+/*! Queues fn(arg) on its own stack, 0 uses TASK_STACK_SIZE. It starts in task_run(). */
+task_t *task_create(const char *name, task_fn_t fn, void *arg, u32 stack_size);
+/*! Runs the queued tasks until all of them return. Returns 1 if every one returned non-zero. */
+int task_run();
+/*! The running task, NULL outside of task_run(). */
+task_t *task_current();
+/*! Lets the other tasks run. Returns right away outside of a task. */
+void task_yield();
+/*! Yields for at least us. Outside of a task it is usleep(). */
+void task_sleep_us(u32 us);
+/*! Yields until irq was handled since seen (an irq_count() taken before arming the device) or us passed. */
+void task_wait_irq(u32 irq, u32 seen, u32 us);
+
+// start.S
+void task_switch(u32 **save_sp, u32 *sp);
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#ifdef TRACE_ENABLE
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "clock.h"
+#include "pinmux.h"
+#include "uart.h"
+#include "util.h"
+
+#define TRACE_REC_TEXT  0
+#define TRACE_REC_EVENT 1
+#define TRACE_REC_PAD   2
+
+/*
+* Records start word aligned and never wrap, a pad record fills the end of the ring instead.
+* The size field holds the unpadded length.
+* Only the producer moves the head and only the drain moves the tail.
+*/
+typedef struct _trace_rec_t
+{
+	u16 size;
+	u16 type;
+	u32 time_us;
+} trace_rec_t;
+
+typedef struct _trace_event_t
+{
+	trace_rec_t hdr;
+	const char *name;
+	u32 arg0;
+	u32 arg1;
+} trace_event_t;
+
+static u8 *_trace_ring = (u8 *)TRACE_ADDR;
+static volatile u32 _trace_head = 0;
+static volatile u32 _trace_tail = 0;
+static u32 _trace_on = 0;
+static u32 _trace_dropped = 0;
+
+// Line being sent by the drain.
+static char _trace_line[TRACE_TEXT_MAX + 32];
+static u32 _trace_line_len = 0;
+static u32 _trace_line_pos = 0;
+
+static char *_trace_putn(char *p, char *end, u32 v, int base, char fill, int fcnt)
+{
+	char buf[12];
+	static const char digits[] = "0123456789ABCDEF";
+	int n = 0;
+
+	do
+	{
+		buf[n++] = digits[v % base];
+		v /= base;
+	} while (v);
+
+	if (fill)
+		while (fcnt-- > n && p < end)
+			*p++ = fill;
+	while (n && p < end)
+		*p++ = buf[--n];
+
+	return p;
+}
+
+static u32 _trace_vfmt(char *out, u32 max, const char *fmt, va_list ap)
+{
+	char *p = out, *end = out + max;
+	int fill, fcnt;
+
+	while (*fmt && p < end)
+	{
+		if (*fmt != '%')
+		{
+			*p++ = *fmt++;
+			continue;
+		}
+
+		fmt++;
+		fill = 0;
+		fcnt = 0;
+		if ((*fmt >= '0' && *fmt <= '9') || *fmt == ' ')
+		{
+			fill = *fmt == '0' ? '0' : ' ';
+			fcnt = *fmt == ' ' ? 0 : *fmt - '0';
+			fmt++;
+			if (*fmt >= '0' && *fmt <= '9')
+			{
+				fcnt = *fmt - '0';
+				fmt++;
+			}
+		}
+
+		switch (*fmt)
+		{
+		case 'c':
+			*p++ = va_arg(ap, u32);
+			break;
+		case 's':
+		{
+			const char *s = va_arg(ap, const char *);
+			while (s && *s && p < end)
+				*p++ = *s++;
+			break;
+		}
+		case 'd':
+		{
+			int v = va_arg(ap, int);
+			if (v < 0)
+			{
+				*p++ = '-';
+				v = -v;
+			}
+			p = _trace_putn(p, end, v, 10, fill, fcnt);
+			break;
+		}
+		case 'u':
+			p = _trace_putn(p, end, va_arg(ap, u32), 10, fill, fcnt);
+			break;
+		case 'x':
+		case 'X':
+			p = _trace_putn(p, end, va_arg(ap, u32), 16, fill, fcnt);
+			break;
+		case '\0':
+			return p - out;
+		default:
+			*p++ = *fmt;
+			break;
+		}
+		fmt++;
+	}
+
+	return p - out;
+}
+
+static u32 _trace_fmt(char *out, u32 max, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	u32 len = _trace_vfmt(out, max, fmt, ap);
+	va_end(ap);
+
+	return len;
+}
+
+static trace_rec_t *_trace_reserve(u32 len)
+{
+	u32 size = ALIGN(len, 4);
+	u32 head = _trace_head;
+	u32 tail = _trace_tail;
+	u32 pad = 0;
+
+	// A record that doesn't fit before the end starts over at the beginning.
+	if (head + size > TRACE_SIZE)
+		pad = TRACE_SIZE - head;
+
+	u32 used = head >= tail ? head - tail : TRACE_SIZE - tail + head;
+	if (used + pad + size >= TRACE_SIZE || (pad && size >= tail))
+	{
+		_trace_dropped++;
+		return NULL;
+	}
+
+	if (pad)
+	{
+		trace_rec_t *rec = (trace_rec_t *)&_trace_ring[head];
+		rec->size = pad;
+		rec->type = TRACE_REC_PAD;
+		head = 0;
+	}
+
+	trace_rec_t *rec = (trace_rec_t *)&_trace_ring[head];
+	rec->size = len;
+	rec->time_us = get_tmr_us();
+
+	return rec;
+}
+
+static void _trace_commit(trace_rec_t *rec)
+{
+	_trace_head = ((u8 *)rec - _trace_ring + ALIGN(rec->size, 4)) % TRACE_SIZE;
+}
+
+void trace_init()
+{
+	pinmux_config_uart(UART_C);
+	clock_enable_uart(UART_C);
+	uart_init(UART_C, TRACE_BAUD);
+
+	_trace_head = 0;
+	_trace_tail = 0;
+	_trace_line_len = 0;
+	_trace_line_pos = 0;
+	_trace_dropped = 0;
+	_trace_on = 1;
+}
+
+void trace_printf(const char *fmt, ...)
+{
+	if (!_trace_on)
+		return;
+
+	char text[TRACE_TEXT_MAX];
+	va_list ap;
+	va_start(ap, fmt);
+	u32 len = _trace_vfmt(text, TRACE_TEXT_MAX, fmt, ap);
+	va_end(ap);
+
+	trace_rec_t *rec = _trace_reserve(sizeof(trace_rec_t) + len);
+	if (!rec)
+		return;
+	rec->type = TRACE_REC_TEXT;
+	memcpy(rec + 1, text, len);
+	_trace_commit(rec);
+}
+
+void trace_event(const char *name, u32 arg0, u32 arg1)
+{
+	if (!_trace_on)
+		return;
+
+	trace_event_t *ev = (trace_event_t *)_trace_reserve(sizeof(trace_event_t));
+	if (!ev)
+		return;
+	ev->hdr.type = TRACE_REC_EVENT;
+	ev->name = name;
+	ev->arg0 = arg0;
+	ev->arg1 = arg1;
+	_trace_commit(&ev->hdr);
+}
+
+// Formats the record at the tail into the line buffer and releases it.
+static int _trace_next_line()
+{
+	while (_trace_tail != _trace_head)
+	{
+		trace_rec_t *rec = (trace_rec_t *)&_trace_ring[_trace_tail];
+		u32 len = 0;
+
+		if (rec->type == TRACE_REC_TEXT)
+		{
+			len = _trace_fmt(_trace_line, 16, "[%u] ", rec->time_us);
+			memcpy(&_trace_line[len], rec + 1, rec->size - sizeof(trace_rec_t));
+			len += rec->size - sizeof(trace_rec_t);
+		}
+		else if (rec->type == TRACE_REC_EVENT)
+		{
+			trace_event_t *ev = (trace_event_t *)rec;
+			len = _trace_fmt(_trace_line, sizeof(_trace_line), "[%u] %s %x %x",
+				rec->time_us, ev->name, ev->arg0, ev->arg1);
+		}
+
+		_trace_tail = (_trace_tail + ALIGN(rec->size, 4)) % TRACE_SIZE;
+
+		if (len)
+		{
+			if (_trace_line[len - 1] != '\n')
+				_trace_line[len++] = '\n';
+			_trace_line_len = len;
+			_trace_line_pos = 0;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void trace_poll()
+{
+	if (!_trace_on)
+		return;
+
+	while (1)
+	{
+		if (_trace_line_pos == _trace_line_len && !_trace_next_line())
+			return;
+
+		u32 sent = uart_send_fifo(UART_C, (u8 *)&_trace_line[_trace_line_pos], _trace_line_len - _trace_line_pos);
+		_trace_line_pos += sent;
+		if (_trace_line_pos != _trace_line_len)
+			return;
+	}
+}
+
+void trace_flush()
+{
+	if (!_trace_on)
+		return;
+
+	if (_trace_dropped)
+	{
+		trace_printf("%u records dropped", _trace_dropped);
+		_trace_dropped = 0;
+	}
+
+	while (_trace_line_pos != _trace_line_len || _trace_tail != _trace_head)
+		trace_poll();
+	uart_wait_idle(UART_C, UART_TX_IDLE);
+}
+
+#endif //TRACE_ENABLE
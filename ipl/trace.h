@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "types.h"
+
+/*! Reserved DRAM between the stack and the boot profile, holds the trace ring. */
+#define TRACE_ADDR 0x90010000
+#define TRACE_SIZE 0x8000
+#define TRACE_BAUD 115200
+/*! Longest formatted text record. */
+#define TRACE_TEXT_MAX 96
+
+#ifdef TRACE_ENABLE
+
+/*! Sets up UART-C and an empty ring. Records before this are dropped. */
+void trace_init();
+/*! Queues a formatted text record (%c, %s, %d, %u, %x, with gfx_printf style padding). */
+void trace_printf(const char *fmt, ...);
+/*! Queues a binary event. name must be a string literal, it is only dereferenced when drained. */
+void trace_event(const char *name, u32 arg0, u32 arg1);
+/*! Moves queued records to the UART, as much as the TX FIFO takes without waiting. */
+void trace_poll();
+/*! Drains the whole ring, waiting on the UART. */
+void trace_flush();
+
+#else
+
+#define trace_init()
+#define trace_printf(...)
+#define trace_event(name, arg0, arg1)
+#define trace_poll()
+#define trace_flush()
+
+#endif //TRACE_ENABLE
+
+#endif
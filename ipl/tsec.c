@@ -17,9 +17,11 @@
 #include <string.h>
 
 #include "tsec.h"
+#include "bpmp.h"
 #include "clock.h"
 #include "t210.h"
 #include "heap.h"
+#include "task.h"
 #include "util.h"
 
 static int _tsec_dma_wait_idle()
@@ -27,8 +29,11 @@ static int _tsec_dma_wait_idle()
 	u32 timeout = get_tmr_ms() + 10000;
 
 	while (!(TSEC(0x1118) & 2))
+	{
 		if (get_tmr_ms() > timeout)
 			return 0;
+		task_yield();
+	}
 
 	return 1;
 }
@@ -73,10 +78,10 @@ int tsec_query(u8 *dst, u32 rev, void *fw)
 	}
 
 	//Load firmware.
-	u8 *fwbuf = (u8 *)malloc(0x2000);
-	u8 *fwbuf_aligned = (u8 *)ALIGN((u32)fwbuf + 0x1000, 0x100);
-	memcpy(fwbuf_aligned, fw, 0xF00);
-	TSEC(0x1110) = (u32)fwbuf_aligned >> 8;// tsec_dmatrfbase_r
+	u8 *fwbuf = (u8 *)dma_memalign(0x100, 0xF00);
+	memcpy(fwbuf, fw, 0xF00);
+	bpmp_cache_clean(fwbuf, 0xF00);
+	TSEC(0x1110) = (u32)fwbuf >> 8;// tsec_dmatrfbase_r
 	for (u32 addr = 0; addr < 0xF00; addr += 0x100)
 		if (!_tsec_dma_pa_to_internal_100(0, addr, addr))
 		{
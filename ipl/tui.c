@@ -15,14 +15,17 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
 #include "tui.h"
 #include "btn.h"
 #include "config.h"
-#include "max17050.h"
+#include "idle.h"
+#include "sensors.h"
 #include "util.h"
 
 #ifdef MENU_LOGO_ENABLE
-extern u8 *Kc_MENU_LOGO;
+extern u32 *Kc_MENU_LOGO;
 #define X_MENU_LOGO       119
 #define Y_MENU_LOGO        57
 #define X_POS_MENU_LOGO   577
@@ -42,20 +45,19 @@ void tui_sbar(gfx_con_t *con, int force_update)
 	con->fntsz = 16;
 	h_cfg.sbar_time_keeping = get_tmr_s();
 
-	u32 battPercent = 0;
-	int battVoltCurr = 0;
+	// Redraws only ever see the cached snapshot, I2C is touched at most every few seconds.
+	const sensors_t *sensors = sensors_get(SENSORS_MAX_AGE_MS);
+	u32 battPercent = sensors->batt_percent;
+	int battVoltCurr = sensors->batt_volt;
 
 	gfx_con_getpos(con, &con->savedx,  &con->savedy);
 	gfx_con_setpos(con, 0,  1260);
 
-	max17050_get_property(MAX17050_RepSOC, (int *)&battPercent);
-	max17050_get_property(MAX17050_VCELL, &battVoltCurr);
-
 	gfx_clear_partial_grey(con->gfx_ctxt, 0x30, 1256, 24);
 	gfx_printf(con, "%K%k Battery: %d.%d%% (%d mV) - Charge:", 0xFF303030, 0xFF888888,
 		(battPercent >> 8) & 0xFF, (battPercent & 0xFF) / 26, battVoltCurr);
 
-	max17050_get_property(MAX17050_AvgCurrent, &battVoltCurr);
+	battVoltCurr = sensors->batt_curr;
 
 	if (battVoltCurr >= 0)
 		gfx_printf(con, " %k+%d mA     %k%K\n",
@@ -93,23 +95,114 @@ void tui_pbar(gfx_con_t *con, int x, int y, u32 val, u32 fgcol, u32 bgcol)
 	tui_sbar(con, 0);
 }
 
+// The progress bar is updated every percent, the rates only a few times per second.
+#define TUI_XFER_INTERVAL_US 250000
+
+void tui_xfer_init(tui_xfer_t *xf, u64 total)
+{
+	memset(xf, 0, sizeof(tui_xfer_t));
+	xf->total = total;
+	xf->start_us = get_tmr_us();
+	xf->shown_us = xf->start_us;
+}
+
+void tui_xfer_io(tui_xfer_t *xf, u32 dev, u32 bytes, u32 start_us)
+{
+	xf->dev_bytes[dev] += bytes;
+	xf->dev_us[dev] += get_tmr_us() - start_us;
+}
+
+static u32 _tui_xfer_rate(u64 bytes, u32 us)
+{
+	// Bytes per us is MB/s, keep one decimal.
+	return us ? (u32)(bytes * 10 / us) : 0;
+}
+
+static void _tui_xfer_dev(gfx_con_t *con, tui_xfer_t *xf, u32 dev, const char *name)
+{
+	u32 cur = _tui_xfer_rate(xf->dev_bytes[dev] - xf->shown_bytes[dev], xf->dev_us[dev] - xf->shown_dev_us[dev]);
+	u32 avg = _tui_xfer_rate(xf->dev_bytes[dev], xf->dev_us[dev]);
+
+	gfx_printf(con, "%s%3d.%d/%3d.%d MB/s", name, cur / 10, cur % 10, avg / 10, avg % 10);
+
+	xf->shown_bytes[dev] = xf->dev_bytes[dev];
+	xf->shown_dev_us[dev] = xf->dev_us[dev];
+}
+
+void tui_xfer_show(gfx_con_t *con, tui_xfer_t *xf, int y, u64 done, int force)
+{
+	u32 now = get_tmr_us();
+	if (!force && now - xf->shown_us < TUI_XFER_INTERVAL_US)
+		return;
+	xf->shown_us = now;
+
+	u32 cx, cy;
+	u8 prevFontSize = con->fntsz;
+	u32 prevFg = con->fgcol, prevBg = con->bgcol;
+	int prevFill = con->fillbg;
+	gfx_con_getpos(con, &cx, &cy);
+
+	// Two small font lines right of the progress bar.
+	u32 eta = 0;
+	if (done && done < xf->total)
+		eta = (u32)((xf->total - done) * ((now - xf->start_us) / 1000) / done / 1000);
+
+	gfx_con_setpos(con, 8 * prevFontSize + 300, y);
+	con->fntsz = 8;
+	gfx_con_setcol(con, 0xFFCCCCCC, 1, 0xFF1B1B1B);
+	_tui_xfer_dev(con, xf, TUI_XFER_EMMC, "eMMC ");
+	gfx_printf(con, " ETA %3d:%02d", eta / 60, eta % 60);
+
+	gfx_con_setpos(con, 8 * prevFontSize + 300, y + 8);
+	_tui_xfer_dev(con, xf, TUI_XFER_SD, "SD   ");
+	gfx_printf(con, " %kRetry %d %k", xf->retries ? 0xFFFFDD00 : 0xFFCCCCCC, xf->retries, 0xFFCCCCCC);
+
+	con->fntsz = prevFontSize;
+	gfx_con_setcol(con, prevFg, prevFill, prevBg);
+	gfx_con_setpos(con, cx, cy);
+}
+
+static void _tui_draw_ment(gfx_con_t *con, menu_t *menu, int i, int selected)
+{
+	// Entries are laid out one per line after the caption and its blank line.
+	gfx_con_setpos(con, 0, menu->y + (i + 2) * con->fntsz);
+
+	if (selected)
+		gfx_con_setcol(con, 0xFF1B1B1B, 1, 0xFFCCCCCC);
+	else
+		gfx_con_setcol(con, 0xFFCCCCCC, 1, 0xFF1B1B1B);
+	if (menu->ents[i].type == MENT_CAPTION)
+		gfx_printf(con, "%k %s", menu->ents[i].color, menu->ents[i].caption);
+	else if (menu->ents[i].type != MENT_CHGLINE)
+		gfx_printf(con, " %s", menu->ents[i].caption);
+	if(menu->ents[i].type == MENT_MENU)
+		gfx_printf(con, "%k...", 0xFF0099EE);
+	gfx_printf(con, " \n");
+}
+
 void *tui_do_menu(gfx_con_t *con, menu_t *menu)
 {
-	int idx = 0, prev_idx = 0, cnt = 0x7FFFFFFF;
+	int idx = 0, prev_idx = 0, drawn_idx = 0, cnt = 0x7FFFFFFF;
+	int redraw = 1;
 
-	gfx_clear_partial_grey(con->gfx_ctxt, 0x1B, 0, 1256);
-	tui_sbar(con, 1);
+	while (1)
+	{
+		// Clear the screen only when entering the menu or coming back from a handler.
+		if (redraw)
+		{
+			gfx_frame_begin(con->gfx_ctxt);
+			gfx_clear_partial_grey(con->gfx_ctxt, 0x1B, 0, 1256);
+			tui_sbar(con, 1);
 
 #ifdef MENU_LOGO_ENABLE
-	gfx_set_rect_rgb(con->gfx_ctxt, Kc_MENU_LOGO,
-		X_MENU_LOGO, Y_MENU_LOGO, X_POS_MENU_LOGO, Y_POS_MENU_LOGO);
+			gfx_set_rect_argb(con->gfx_ctxt, Kc_MENU_LOGO,
+				X_MENU_LOGO, Y_MENU_LOGO, X_POS_MENU_LOGO, Y_POS_MENU_LOGO);
 #endif //MENU_LOGO_ENABLE
 
-	while (1)
-	{
-		gfx_con_setcol(con, 0xFFCCCCCC, 1, 0xFF1B1B1B);
-		gfx_con_setpos(con, menu->x, menu->y);
-		gfx_printf(con, "[%s]\n\n", menu->caption);
+			gfx_con_setcol(con, 0xFFCCCCCC, 1, 0xFF1B1B1B);
+			gfx_con_setpos(con, menu->x, menu->y);
+			gfx_printf(con, "[%s]\n\n", menu->caption);
+		}
 
 		// Skip caption or seperator lines selection.
 		while (menu->ents[idx].type == MENT_CAPTION ||
@@ -136,31 +229,33 @@ void *tui_do_menu(gfx_con_t *con, menu_t *menu)
 		}
 		prev_idx = idx;
 
-		// Draw the menu.
-		for (cnt = 0; menu->ents[cnt].type != MENT_END; cnt++)
+		// Draw the menu, or only the rows whose selection changed.
+		if (redraw)
 		{
-			if (cnt == idx)
-				gfx_con_setcol(con, 0xFF1B1B1B, 1, 0xFFCCCCCC);
-			else
-				gfx_con_setcol(con, 0xFFCCCCCC, 1, 0xFF1B1B1B);
-			if (menu->ents[cnt].type == MENT_CAPTION)
-				gfx_printf(con, "%k %s", menu->ents[cnt].color, menu->ents[cnt].caption);
-			else if (menu->ents[cnt].type != MENT_CHGLINE)
-				gfx_printf(con, " %s", menu->ents[cnt].caption);
-			if(menu->ents[cnt].type == MENT_MENU)
-				gfx_printf(con, "%k...", 0xFF0099EE);
-			gfx_printf(con, " \n");
-		}
-		gfx_con_setcol(con, 0xFFCCCCCC, 1, 0xFF1B1B1B);
-		gfx_putc(con, '\n');
+			for (cnt = 0; menu->ents[cnt].type != MENT_END; cnt++)
+				_tui_draw_ment(con, menu, cnt, cnt == idx);
+			gfx_con_setcol(con, 0xFFCCCCCC, 1, 0xFF1B1B1B);
+			gfx_putc(con, '\n');
 
-		// Print help and battery status.
-		gfx_con_getpos(con, &con->savedx,  &con->savedy);
-		gfx_con_setpos(con, 0,  1191);
-		gfx_printf(con, "%k VOL: Move up/down\n PWR: Select option%k", 0xFF555555, 0xFFCCCCCC);
+			// Print help.
+			gfx_con_getpos(con, &con->savedx,  &con->savedy);
+			gfx_con_setpos(con, 0,  1191);
+			gfx_printf(con, "%k VOL: Move up/down\n PWR: Select option%k", 0xFF555555, 0xFFCCCCCC);
+			gfx_frame_end(con->gfx_ctxt);
+		}
+		else if (idx != drawn_idx)
+		{
+			_tui_draw_ment(con, menu, drawn_idx, 0);
+			_tui_draw_ment(con, menu, idx, 1);
+			gfx_con_setcol(con, 0xFFCCCCCC, 1, 0xFF1B1B1B);
+		}
+		drawn_idx = idx;
+		redraw = 0;
 
-		// Wait for user command.
+		// Wait for user command. No handler runs meanwhile, so idle work may use the storage.
+		idle_enable(1);
 		u32 btn = btn_wait();
+		idle_enable(0);
 
 		if (btn & BTN_VOL_DOWN && idx < (cnt - 1))
 			idx++;
@@ -191,13 +286,10 @@ void *tui_do_menu(gfx_con_t *con, menu_t *menu)
 				break;
 			}
 			con->fntsz = 16;
-			gfx_clear_partial_grey(con->gfx_ctxt, 0x1B, 0, 1256);
-#ifdef MENU_LOGO_ENABLE
-			gfx_set_rect_rgb(con->gfx_ctxt, Kc_MENU_LOGO,
-				X_MENU_LOGO, Y_MENU_LOGO, X_POS_MENU_LOGO, Y_POS_MENU_LOGO);
-#endif //MENU_LOGO_ENABLE
+			redraw = 1;
 		}
-		tui_sbar(con, 0);
+		else
+			tui_sbar(con, 0);
 	}
 
 	return NULL;
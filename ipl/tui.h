@@ -58,8 +58,27 @@ typedef struct _menu_t
 #define MDEF_CAPTION(caption, color) { MENT_CAPTION, caption, color }
 #define MDEF_CHGLINE() {MENT_CHGLINE}
 
+#define TUI_XFER_EMMC 0
+#define TUI_XFER_SD   1
+
+typedef struct _tui_xfer_t
+{
+	u64 total;
+	u32 start_us;
+	u32 shown_us;
+	u32 retries;
+	// Bytes moved and time spent in calls, per device.
+	u64 dev_bytes[2];
+	u32 dev_us[2];
+	u64 shown_bytes[2];
+	u32 shown_dev_us[2];
+} tui_xfer_t;
+
 void tui_sbar(gfx_con_t *con, int force_update);
 void tui_pbar(gfx_con_t *con, int x, int y, u32 val, u32 fgcol, u32 bgcol);
+void tui_xfer_init(tui_xfer_t *xf, u64 total);
+void tui_xfer_io(tui_xfer_t *xf, u32 dev, u32 bytes, u32 start_us);
+void tui_xfer_show(gfx_con_t *con, tui_xfer_t *xf, int y, u64 done, int force);
 void *tui_do_menu(gfx_con_t *con, menu_t *menu);
 
 #endif
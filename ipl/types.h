@@ -26,6 +26,16 @@
 #define OFFSET_OF(t, m) ((u32)&((t *)NULL)->m)
 #define CONTAINER_OF(mp, t, mn) ((t *)((u32)mp - OFFSET_OF(t, mn)))
 
+#ifdef __arm__
+/*! Inner loops built in ARM state with inlining allowed, grouped by link.ld right after the entry point. */
+#define IRAM_FAST __attribute__((section(".text.fast"), target("arm"), optimize("inline-small-functions")))
+/*! Zero-initialized state of those loops, grouped ahead of the rest of .bss. */
+#define IRAM_FAST_BSS __attribute__((section(".bss.fast")))
+#else // Host build of the portable modules, see tools/host.
+#define IRAM_FAST
+#define IRAM_FAST_BSS
+#endif
+
 typedef char s8;
 typedef short s16;
 typedef int s32;
@@ -65,6 +65,21 @@ void uart_send(u32 idx, u8 *buf, u32 len)
 	};
 }
 
+u32 uart_send_fifo(u32 idx, u8 *buf, u32 len)
+{
+	uart_t *uart = (uart_t *)(UART_BASE + uart_baseoff[idx]);
+
+	u32 i;
+	for (i = 0; i != len; i++)
+	{
+		if (uart->UART_LSR & UART_TX_FIFO_FULL)
+			break;
+		uart->UART_THR_DLAB = buf[i];
+	}
+
+	return i;
+}
+
 void uart_recv(u32 idx, u8 *buf, u32 len)
 {
 	uart_t *uart = (uart_t *)(UART_BASE + uart_baseoff[idx]);
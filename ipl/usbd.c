@@ -0,0 +1,643 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "usbd.h"
+#include "bpmp.h"
+#include "clock.h"
+#include "heap.h"
+#include "t210.h"
+#include "util.h"
+
+/*! USB2 device controller registers. */
+#define USB2D_USBCMD           0x130
+#define  USBCMD_RS             (1 << 0)
+#define  USBCMD_RST            (1 << 1)
+#define  USBCMD_SUTW           (1 << 13)
+#define  USBCMD_ITC_MASK       (0xFF << 16)
+#define USB2D_USBSTS           0x134
+#define  USBSTS_PCI            (1 << 2)
+#define  USBSTS_URI            (1 << 6)
+#define USB2D_USBINTR          0x138
+#define USB2D_DEVICEADDR       0x144
+#define  DEVICEADDR_USBADRA    (1 << 24)
+#define USB2D_ENDPOINTLISTADDR 0x148
+#define USB2D_HOSTPC1_DEVLC    0x1B4
+#define  HOSTPC1_DEVLC_PHCD    (1 << 22)
+#define  HOSTPC1_DEVLC_PSPD(x) (((x) >> 25) & 3)
+#define USB2D_USBMODE          0x1F8
+#define  USBMODE_DEVICE        2
+#define  USBMODE_SLOM          (1 << 3)
+#define USB2D_ENDPTSETUPSTAT   0x208
+#define USB2D_ENDPTPRIME       0x20C
+#define USB2D_ENDPTFLUSH       0x210
+#define USB2D_ENDPTSTATUS      0x214
+#define USB2D_ENDPTCOMPLETE    0x218
+#define USB2D_ENDPTCTRL(n)     (0x21C + (n) * 4)
+#define  ENDPTCTRL_RXS         (1 << 0)
+#define  ENDPTCTRL_RXT_BULK    (2 << 2)
+#define  ENDPTCTRL_RXR         (1 << 6)
+#define  ENDPTCTRL_RXE         (1 << 7)
+#define  ENDPTCTRL_TXS         (1 << 16)
+#define  ENDPTCTRL_TXT_BULK    (2 << 18)
+#define  ENDPTCTRL_TXR         (1 << 22)
+#define  ENDPTCTRL_TXE         (1 << 23)
+
+#define PLLU_ENABLE     (1 << 30)
+#define PLLU_LOCK       (1 << 27)
+#define CLK_L_USBD      (1 << 22)
+
+#define PSPD_HIGH       2
+
+#define EP_BIT(ep, in)  (1 << ((ep) + ((in) ? 16 : 0)))
+#define EP_CTRL         0
+#define EP_BULK         1
+
+#define DQH_CAPS_MPL(x) ((x) << 16)
+#define DQH_CAPS_IOS    (1 << 15)
+#define DQH_CAPS_ZLT    (1 << 29) // No zero length termination, the protocol sizes every transfer.
+
+#define DTD_TERMINATE   1
+#define DTD_ACTIVE      0x80
+#define DTD_ERRORS      0x68 // Halted, data buffer and transaction errors.
+#define DTD_IOC         (1 << 15)
+#define DTD_BYTES(x)    ((x) << 16)
+#define DTD_LEFT(t)     (((t) >> 16) & 0x7FFF)
+
+#define USBD_EP0_SIZE   64
+#define USBD_EP0_BUF    0x100
+#define USBD_TIMEOUT    1000
+
+/*! Standard requests. */
+#define REQ_GET_STATUS        0
+#define REQ_CLEAR_FEATURE     1
+#define REQ_SET_FEATURE       3
+#define REQ_SET_ADDRESS       5
+#define REQ_GET_DESCRIPTOR    6
+#define REQ_GET_CONFIGURATION 8
+#define REQ_SET_CONFIGURATION 9
+#define REQ_GET_INTERFACE     10
+#define REQ_SET_INTERFACE     11
+
+#define DESC_DEVICE           1
+#define DESC_CONFIG           2
+#define DESC_STRING           3
+#define DESC_QUALIFIER        6
+#define DESC_OTHER_SPEED      7
+
+/*! Endpoint queue head, dQH. */
+typedef struct _usbd_dqh_t
+{
+	vu32 caps;
+	vu32 curr_dtd;
+	vu32 next_dtd;
+	vu32 token;
+	vu32 buf[5];
+	vu32 rsvd;
+	vu8 setup[8];
+	vu32 pad[4];
+} usbd_dqh_t;
+
+/*! Transfer descriptor, dTD. */
+typedef struct _usbd_dtd_t
+{
+	vu32 next;
+	vu32 token;
+	vu32 buf[5];
+	vu32 rsvd;
+} usbd_dtd_t;
+
+typedef struct _usbd_bulk_t
+{
+	usbd_dtd_t *dtds;
+	u32 num_dtds;
+	void *buf;
+	u32 size;
+	int active;
+} usbd_bulk_t;
+
+static const u8 _usbd_desc_device[18] = {
+	18, DESC_DEVICE, 0x00, 0x02, 0, 0, 0, USBD_EP0_SIZE,
+	USBD_VID & 0xFF, USBD_VID >> 8, USBD_PID & 0xFF, USBD_PID >> 8,
+	0x00, 0x01, 1, 2, 0, 1
+};
+
+static const u8 _usbd_desc_qualifier[10] = {
+	10, DESC_QUALIFIER, 0x00, 0x02, 0, 0, 0, USBD_EP0_SIZE, 1, 0
+};
+
+static const char *_usbd_strings[] = { "hekate", "hekate eMMC" };
+
+static usbd_dqh_t *_dqh = NULL; // EP0 out, EP0 in, EP1 out, EP1 in.
+static usbd_dtd_t *_ep0_dtd;
+static u8 *_ep0_buf;
+static usbd_bulk_t _bulk[2];
+static u32 _config = 0;
+static int _high_speed = 0;
+
+static usbd_dqh_t *_usbd_qh(u32 ep, int in)
+{
+	return &_dqh[ep * 2 + (in ? 1 : 0)];
+}
+
+static int _usbd_wait_clear(u32 reg, u32 mask)
+{
+	u32 timeout = get_tmr_ms() + USBD_TIMEOUT;
+	while (USB(reg) & mask)
+		if (get_tmr_ms() > timeout)
+			return 0;
+	return 1;
+}
+
+static void _usbd_flush(u32 mask)
+{
+	do
+	{
+		USB(USB2D_ENDPTFLUSH) = mask;
+		if (!_usbd_wait_clear(USB2D_ENDPTFLUSH, mask))
+			break;
+	} while (USB(USB2D_ENDPTSTATUS) & mask);
+}
+
+static void _usbd_prime(u32 ep, int in, usbd_dtd_t *dtd)
+{
+	usbd_dqh_t *qh = _usbd_qh(ep, in);
+	qh->next_dtd = (u32)dtd;
+	qh->token &= ~(DTD_ACTIVE | DTD_ERRORS);
+	bpmp_cache_clean(qh, sizeof(usbd_dqh_t));
+
+	USB(USB2D_ENDPTPRIME) = EP_BIT(ep, in);
+}
+
+static void _usbd_fill_dtd(usbd_dtd_t *dtd, void *buf, u32 size)
+{
+	u32 addr = (u32)buf;
+
+	dtd->next = DTD_TERMINATE;
+	dtd->token = DTD_BYTES(size) | DTD_ACTIVE;
+	dtd->buf[0] = addr;
+	for (u32 i = 1; i < 5; i++)
+		dtd->buf[i] = (addr & ~0xFFF) + i * 0x1000;
+	dtd->rsvd = 0;
+}
+
+static int _usbd_ep0_xfer(int in, const void *data, u32 size)
+{
+	if (size)
+	{
+		memcpy(_ep0_buf, data, size);
+		bpmp_cache_clean(_ep0_buf, size);
+	}
+
+	usbd_dtd_t *dtd = &_ep0_dtd[in ? 1 : 0];
+	_usbd_fill_dtd(dtd, _ep0_buf, size);
+	dtd->token |= DTD_IOC;
+	bpmp_cache_clean(dtd, sizeof(usbd_dtd_t));
+	_usbd_prime(EP_CTRL, in, dtd);
+
+	u32 bit = EP_BIT(EP_CTRL, in);
+	u32 timeout = get_tmr_ms() + USBD_TIMEOUT;
+	while (!(USB(USB2D_ENDPTCOMPLETE) & bit))
+	{
+		// A new setup packet aborts the stage, the host gave up on it.
+		if ((USB(USB2D_ENDPTSETUPSTAT) & 1) || get_tmr_ms() > timeout)
+		{
+			_usbd_flush(bit);
+			return 0;
+		}
+	}
+	USB(USB2D_ENDPTCOMPLETE) = bit;
+
+	bpmp_cache_invalidate(dtd, sizeof(usbd_dtd_t));
+	return !(dtd->token & (DTD_ACTIVE | DTD_ERRORS));
+}
+
+static void _usbd_ctrl_in(const void *data, u32 size, u32 length)
+{
+	// Data stage, then the host's zero length status.
+	if (_usbd_ep0_xfer(1, data, MIN(size, length)))
+		_usbd_ep0_xfer(0, NULL, 0);
+}
+
+static void _usbd_ctrl_ack()
+{
+	_usbd_ep0_xfer(1, NULL, 0);
+}
+
+static void _usbd_ctrl_stall()
+{
+	USB(USB2D_ENDPTCTRL(EP_CTRL)) |= ENDPTCTRL_RXS | ENDPTCTRL_TXS;
+}
+
+static u32 _usbd_bulk_packet(int high_speed)
+{
+	return high_speed ? 512 : 64;
+}
+
+static u32 _usbd_config_desc(u8 *buf, u8 type, int high_speed)
+{
+	u32 mps = _usbd_bulk_packet(high_speed);
+	const u8 desc[32] = {
+		// Configuration, self powered.
+		9, type, 32, 0, 1, 1, 0, 0xC0, 50,
+		// Vendor specific interface with a bulk pair.
+		9, 4, 0, 0, 2, 0xFF, 0, 0, 0,
+		7, 5, 0x80 | EP_BULK, 2, mps & 0xFF, mps >> 8, 0,
+		7, 5, EP_BULK, 2, mps & 0xFF, mps >> 8, 0
+	};
+	memcpy(buf, desc, sizeof(desc));
+	return sizeof(desc);
+}
+
+static u32 _usbd_string_desc(u8 *buf, u32 idx)
+{
+	if (!idx)
+	{
+		// US English only.
+		buf[0] = 4;
+		buf[1] = DESC_STRING;
+		buf[2] = 0x09;
+		buf[3] = 0x04;
+		return 4;
+	}
+	if (idx > sizeof(_usbd_strings) / sizeof(_usbd_strings[0]))
+		return 0;
+
+	const char *str = _usbd_strings[idx - 1];
+	u32 len = strlen(str);
+	buf[0] = 2 + len * 2;
+	buf[1] = DESC_STRING;
+	for (u32 i = 0; i < len; i++)
+	{
+		buf[2 + i * 2] = str[i];
+		buf[3 + i * 2] = 0;
+	}
+	return buf[0];
+}
+
+static void _usbd_bulk_reset()
+{
+	for (u32 in = 0; in < 2; in++)
+		_bulk[in].active = 0;
+}
+
+static void _usbd_configure(u32 config)
+{
+	_usbd_flush(EP_BIT(EP_BULK, 0) | EP_BIT(EP_BULK, 1));
+	_usbd_bulk_reset();
+
+	_config = config;
+	if (!config)
+	{
+		USB(USB2D_ENDPTCTRL(EP_BULK)) = 0;
+		return;
+	}
+
+	u32 mps = _usbd_bulk_packet(_high_speed);
+	for (u32 in = 0; in < 2; in++)
+	{
+		usbd_dqh_t *qh = _usbd_qh(EP_BULK, in);
+		memset((void *)qh, 0, sizeof(usbd_dqh_t));
+		qh->caps = DQH_CAPS_MPL(mps) | DQH_CAPS_ZLT;
+		qh->next_dtd = DTD_TERMINATE;
+		bpmp_cache_clean(qh, sizeof(usbd_dqh_t));
+	}
+
+	// Enable both directions with their data toggles reset.
+	USB(USB2D_ENDPTCTRL(EP_BULK)) = ENDPTCTRL_RXE | ENDPTCTRL_RXR | ENDPTCTRL_RXT_BULK |
+		ENDPTCTRL_TXE | ENDPTCTRL_TXR | ENDPTCTRL_TXT_BULK;
+}
+
+static void _usbd_bus_reset()
+{
+	USB(USB2D_ENDPTSETUPSTAT) = USB(USB2D_ENDPTSETUPSTAT);
+	USB(USB2D_ENDPTCOMPLETE) = USB(USB2D_ENDPTCOMPLETE);
+	_usbd_wait_clear(USB2D_ENDPTPRIME, 0xFFFFFFFF);
+	_usbd_flush(0xFFFFFFFF);
+
+	USB(USB2D_DEVICEADDR) = 0;
+	_config = 0;
+	USB(USB2D_ENDPTCTRL(EP_BULK)) = 0;
+	_usbd_bulk_reset();
+}
+
+static void _usbd_read_setup(u8 *setup)
+{
+	USB(USB2D_ENDPTSETUPSTAT) = 1;
+
+	// The tripwire drops if the controller overwrote the packet while it was copied.
+	usbd_dqh_t *qh = _usbd_qh(EP_CTRL, 0);
+	do
+	{
+		USB(USB2D_USBCMD) |= USBCMD_SUTW;
+		bpmp_cache_invalidate(qh, sizeof(usbd_dqh_t));
+		for (u32 i = 0; i < 8; i++)
+			setup[i] = qh->setup[i];
+	} while (!(USB(USB2D_USBCMD) & USBCMD_SUTW));
+	USB(USB2D_USBCMD) &= ~USBCMD_SUTW;
+}
+
+static void _usbd_handle_setup()
+{
+	u8 setup[8];
+	_usbd_read_setup(setup);
+	_usbd_flush(EP_BIT(EP_CTRL, 0) | EP_BIT(EP_CTRL, 1));
+
+	u8 type = setup[0];
+	u8 req = setup[1];
+	u16 value = setup[2] | (setup[3] << 8);
+	u16 index = setup[4] | (setup[5] << 8);
+	u16 length = setup[6] | (setup[7] << 8);
+
+	// Standard requests only, the bulk pair carries everything else.
+	if (type & 0x60)
+	{
+		_usbd_ctrl_stall();
+		return;
+	}
+
+	u8 *buf = (u8 *)malloc(USBD_EP0_BUF);
+	u32 size;
+
+	switch (req)
+	{
+	case REQ_GET_STATUS:
+		buf[0] = 0;
+		buf[1] = 0;
+		// Device status is self powered.
+		if ((type & 0x1F) == 0)
+			buf[0] = 1;
+		else if ((type & 0x1F) == 2 && (index & 0x7F) == EP_BULK)
+			buf[0] = !!(USB(USB2D_ENDPTCTRL(EP_BULK)) & ((index & 0x80) ? ENDPTCTRL_TXS : ENDPTCTRL_RXS));
+		_usbd_ctrl_in(buf, 2, length);
+		break;
+	case REQ_CLEAR_FEATURE:
+	case REQ_SET_FEATURE:
+		// Endpoint halt, clearing it also resets the data toggle.
+		if ((type & 0x1F) == 2 && !value && (index & 0x7F) == EP_BULK)
+		{
+			int in = !!(index & 0x80);
+			u32 stall = in ? ENDPTCTRL_TXS : ENDPTCTRL_RXS;
+			if (req == REQ_SET_FEATURE)
+				USB(USB2D_ENDPTCTRL(EP_BULK)) |= stall;
+			else
+				USB(USB2D_ENDPTCTRL(EP_BULK)) = (USB(USB2D_ENDPTCTRL(EP_BULK)) & ~stall) |
+					(in ? ENDPTCTRL_TXR : ENDPTCTRL_RXR);
+		}
+		_usbd_ctrl_ack();
+		break;
+	case REQ_SET_ADDRESS:
+		// Latched by the controller until the status stage completes.
+		USB(USB2D_DEVICEADDR) = ((value & 0x7F) << 25) | DEVICEADDR_USBADRA;
+		_usbd_ctrl_ack();
+		break;
+	case REQ_GET_DESCRIPTOR:
+		size = 0;
+		switch (value >> 8)
+		{
+		case DESC_DEVICE:
+			memcpy(buf, _usbd_desc_device, sizeof(_usbd_desc_device));
+			size = sizeof(_usbd_desc_device);
+			break;
+		case DESC_CONFIG:
+			size = _usbd_config_desc(buf, DESC_CONFIG, _high_speed);
+			break;
+		case DESC_OTHER_SPEED:
+			size = _usbd_config_desc(buf, DESC_OTHER_SPEED, !_high_speed);
+			break;
+		case DESC_QUALIFIER:
+			memcpy(buf, _usbd_desc_qualifier, sizeof(_usbd_desc_qualifier));
+			size = sizeof(_usbd_desc_qualifier);
+			break;
+		case DESC_STRING:
+			size = _usbd_string_desc(buf, value & 0xFF);
+			break;
+		}
+		if (size)
+			_usbd_ctrl_in(buf, size, length);
+		else
+			_usbd_ctrl_stall();
+		break;
+	case REQ_GET_CONFIGURATION:
+		buf[0] = _config;
+		_usbd_ctrl_in(buf, 1, length);
+		break;
+	case REQ_SET_CONFIGURATION:
+		if (value > 1)
+		{
+			_usbd_ctrl_stall();
+			break;
+		}
+		_usbd_configure(value);
+		_usbd_ctrl_ack();
+		break;
+	case REQ_GET_INTERFACE:
+		buf[0] = 0;
+		_usbd_ctrl_in(buf, 1, length);
+		break;
+	case REQ_SET_INTERFACE:
+		if (value)
+			_usbd_ctrl_stall();
+		else
+			_usbd_ctrl_ack();
+		break;
+	default:
+		_usbd_ctrl_stall();
+		break;
+	}
+
+	free(buf);
+}
+
+int usbd_init()
+{
+	// PLLU, the UTMI pads and the VBUS overrides are left set up by the bootrom's RCM session.
+	if ((CLOCK(CLK_RST_CONTROLLER_PLLU_BASE) & (PLLU_ENABLE | PLLU_LOCK)) != (PLLU_ENABLE | PLLU_LOCK) ||
+		!(CLOCK(CLK_RST_CONTROLLER_CLK_OUT_ENB_L) & CLK_L_USBD) ||
+		(CLOCK(CLK_RST_CONTROLLER_RST_DEVICES_L) & CLK_L_USBD))
+		return 0;
+
+	if (!_dqh)
+	{
+		// The queue head list must be 2KiB aligned.
+		_dqh = (usbd_dqh_t *)dma_memalign(0x800, 4 * sizeof(usbd_dqh_t));
+		_ep0_dtd = (usbd_dtd_t *)dma_memalign(0x40, 2 * sizeof(usbd_dtd_t));
+		_ep0_buf = (u8 *)dma_malloc(USBD_EP0_BUF);
+		for (u32 in = 0; in < 2; in++)
+			_bulk[in].dtds = (usbd_dtd_t *)dma_memalign(0x40, USBD_DTD_POOL * sizeof(usbd_dtd_t));
+	}
+
+	// Detach from the host and reset the controller, the PHY keeps its configuration.
+	USB(USB2D_USBCMD) &= ~USBCMD_RS;
+	msleep(2);
+	USB(USB2D_USBCMD) |= USBCMD_RST;
+	if (!_usbd_wait_clear(USB2D_USBCMD, USBCMD_RST))
+		return 0;
+
+	USB(USB2D_USBMODE) = USBMODE_DEVICE | USBMODE_SLOM;
+	USB(USB2D_HOSTPC1_DEVLC) &= ~HOSTPC1_DEVLC_PHCD;
+	USB(USB2D_USBINTR) = 0;
+
+	memset(_dqh, 0, 4 * sizeof(usbd_dqh_t));
+	for (u32 i = 0; i < 4; i++)
+		_dqh[i].next_dtd = DTD_TERMINATE;
+	_usbd_qh(EP_CTRL, 0)->caps = DQH_CAPS_MPL(USBD_EP0_SIZE) | DQH_CAPS_IOS | DQH_CAPS_ZLT;
+	_usbd_qh(EP_CTRL, 1)->caps = DQH_CAPS_MPL(USBD_EP0_SIZE) | DQH_CAPS_ZLT;
+	bpmp_cache_clean(_dqh, 4 * sizeof(usbd_dqh_t));
+	USB(USB2D_ENDPOINTLISTADDR) = (u32)_dqh;
+
+	_config = 0;
+	_high_speed = 0;
+	_usbd_bulk_reset();
+
+	USB(USB2D_USBSTS) = USB(USB2D_USBSTS);
+	// No interrupt threshold, completions post as soon as they happen.
+	USB(USB2D_USBCMD) = (USB(USB2D_USBCMD) & ~USBCMD_ITC_MASK) | USBCMD_RS;
+
+	return 1;
+}
+
+void usbd_end()
+{
+	if (!_dqh)
+		return;
+
+	_usbd_bus_reset();
+	USB(USB2D_USBCMD) &= ~USBCMD_RS;
+}
+
+int usbd_poll()
+{
+	u32 sts = USB(USB2D_USBSTS);
+
+	if (sts & USBSTS_URI)
+	{
+		USB(USB2D_USBSTS) = USBSTS_URI;
+		_usbd_bus_reset();
+	}
+	if (sts & USBSTS_PCI)
+	{
+		// Speed is settled once the port change after reset posts.
+		USB(USB2D_USBSTS) = USBSTS_PCI;
+		_high_speed = HOSTPC1_DEVLC_PSPD(USB(USB2D_HOSTPC1_DEVLC)) == PSPD_HIGH;
+	}
+
+	if (USB(USB2D_ENDPTSETUPSTAT) & 1)
+		_usbd_handle_setup();
+
+	return _config != 0;
+}
+
+u32 usbd_max_packet()
+{
+	return _usbd_bulk_packet(_high_speed);
+}
+
+int usbd_xfer_start(int in, void *buf, u32 size)
+{
+	in = !!in;
+	usbd_bulk_t *xfer = &_bulk[in];
+	if (!_config || xfer->active || !size || size > USBD_XFER_MAX)
+		return 0;
+
+	// Nothing dirty may be evicted over what the controller writes.
+	bpmp_cache_clean(buf, size);
+
+	u32 num_dtds = (size + USBD_DTD_SIZE - 1) / USBD_DTD_SIZE;
+	u8 *ptr = (u8 *)buf;
+	u32 left = size;
+	for (u32 i = 0; i < num_dtds; i++)
+	{
+		u32 chunk = MIN(left, USBD_DTD_SIZE);
+		usbd_dtd_t *dtd = &xfer->dtds[i];
+		_usbd_fill_dtd(dtd, ptr, chunk);
+		if (i + 1 < num_dtds)
+			dtd->next = (u32)&xfer->dtds[i + 1];
+		else
+			dtd->token |= DTD_IOC;
+		ptr += chunk;
+		left -= chunk;
+	}
+	bpmp_cache_clean(xfer->dtds, num_dtds * sizeof(usbd_dtd_t));
+
+	xfer->buf = buf;
+	xfer->size = size;
+	xfer->num_dtds = num_dtds;
+	xfer->active = 1;
+	_usbd_prime(EP_BULK, in, xfer->dtds);
+
+	return 1;
+}
+
+int usbd_xfer_wait(int in, u32 timeout_ms)
+{
+	in = !!in;
+	usbd_bulk_t *xfer = &_bulk[in];
+	if (!xfer->active)
+		return USBD_XFER_ERROR;
+
+	usbd_dtd_t *last = &xfer->dtds[xfer->num_dtds - 1];
+	u32 timeout = get_tmr_ms() + timeout_ms;
+	while (1)
+	{
+		// A short packet retires its descriptor early, so the chain is done once the last one is.
+		bpmp_cache_invalidate(last, sizeof(usbd_dtd_t));
+		if (!(last->token & DTD_ACTIVE))
+			break;
+
+		// A reset or deconfiguration drops the transfer.
+		if (!usbd_poll() || !xfer->active)
+		{
+			xfer->active = 0;
+			return USBD_XFER_ERROR;
+		}
+
+		if (get_tmr_ms() > timeout)
+			return USBD_XFER_PENDING;
+	}
+	USB(USB2D_ENDPTCOMPLETE) = EP_BIT(EP_BULK, in);
+	xfer->active = 0;
+
+	bpmp_cache_invalidate(xfer->dtds, xfer->num_dtds * sizeof(usbd_dtd_t));
+	u32 moved = 0;
+	u32 left = xfer->size;
+	for (u32 i = 0; i < xfer->num_dtds; i++)
+	{
+		u32 token = xfer->dtds[i].token;
+		u32 chunk = MIN(left, USBD_DTD_SIZE);
+		if (token & DTD_ERRORS)
+			return USBD_XFER_ERROR;
+		moved += chunk - DTD_LEFT(token);
+		left -= chunk;
+	}
+
+	if (!in)
+		bpmp_cache_invalidate(xfer->buf, xfer->size);
+
+	return moved;
+}
+
+void usbd_xfer_cancel(int in)
+{
+	in = !!in;
+	if (!_bulk[in].active)
+		return;
+
+	_usbd_flush(EP_BIT(EP_BULK, in));
+	USB(USB2D_ENDPTCOMPLETE) = EP_BIT(EP_BULK, in);
+	_bulk[in].active = 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _USBD_H_
+#define _USBD_H_
+
+#include "types.h"
+
+#define USBD_VID 0x1209
+#define USBD_PID 0x8B00
+
+#define USBD_DTD_SIZE   0x4000 // Bytes per transfer descriptor, any buffer alignment fits its 5 pages.
+#define USBD_DTD_POOL   64
+#define USBD_XFER_MAX   (USBD_DTD_SIZE * USBD_DTD_POOL)
+
+#define USBD_XFER_ERROR   -1 // Bus error, reset, disconnect or deconfigured.
+#define USBD_XFER_PENDING -2
+
+/*! Takes the USB2 device controller over from the bootrom's RCM session and attaches to the bus. */
+int usbd_init();
+void usbd_end();
+/*! Services the control endpoint. Returns 1 while the host has the device configured. */
+int usbd_poll();
+/*! Bulk packet size, 512 on high-speed and 64 on full-speed links. */
+u32 usbd_max_packet();
+/*! Queues a bulk transfer, in goes to the host. buf must be DMA-able and stay untouched until it completes. */
+int usbd_xfer_start(int in, void *buf, u32 size);
+/*! Returns the bytes moved, or USBD_XFER_PENDING once timeout_ms passes with the transfer still queued. */
+int usbd_xfer_wait(int in, u32 timeout_ms);
+void usbd_xfer_cancel(int in);
+
+#endif
@@ -16,6 +16,7 @@
 */
 
 #include "util.h"
+#include "heap.h"
 #include "t210.h"
 
 u32 get_tmr_s()
@@ -35,16 +36,43 @@ u32 get_tmr_us()
 	return TMR(0x10); //TIMERUS_CNTR_1US
 }
 
+static void (*_sleep_hook)() = NULL;
+static int _sleep_hook_busy = 0;
+
+void sleep_set_hook(void (*hook)())
+{
+	_sleep_hook = hook;
+}
+
+static inline void _sleep_hook_run()
+{
+	// The hook may sleep itself.
+	if (!_sleep_hook || _sleep_hook_busy)
+		return;
+
+	_sleep_hook_busy = 1;
+	_sleep_hook();
+	_sleep_hook_busy = 0;
+}
+
 void msleep(u32 milliseconds)
 {
 	u32 start = RTC(0x10) | (RTC(0xC)<< 10);
 	while (((RTC(0x10) | (RTC(0xC)<< 10)) - start) <= milliseconds)
-		;
+		_sleep_hook_run();
 }
 
 void usleep(u32 microseconds)
 {
 	u32 start = TMR(0x10);
+	// Short waits are polling loops with their own timeouts, leave them alone.
+	if (microseconds >= 1000)
+	{
+		while ((TMR(0x10) - start) <= microseconds)
+			_sleep_hook_run();
+		return;
+	}
+
 	while ((TMR(0x10) - start) <= microseconds)
 		;
 }
@@ -56,20 +84,86 @@ void exec_cfg(u32 *base, const cfg_op_t *ops, u32 num_ops)
 }
 
 #define CRC32C_POLY 0x82F63B78
-u32 crc32c(const void *buf, u32 len)
+
+// Slice-by-8 tables, built on first use. Table n advances a byte n positions further.
+static u32 *_crc32c_table = NULL;
+
+static int _crc32c_table_init()
 {
-	const u8 *cbuf = (const u8 *)buf;
-	u32 crc = 0xFFFFFFFF;
-	while (len--)
+	_crc32c_table = (u32 *)malloc(8 * 256 * sizeof(u32));
+	if (!_crc32c_table)
+		return 0;
+
+	for (u32 i = 0; i < 256; i++)
 	{
-		crc ^= *cbuf++;
-		for (int i = 0; i < 8; i++)
+		u32 crc = i;
+		for (int j = 0; j < 8; j++)
 			crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		_crc32c_table[i] = crc;
 	}
+
+	for (u32 i = 0; i < 256; i++)
+		for (u32 n = 1; n < 8; n++)
+		{
+			u32 prev = _crc32c_table[(n - 1) * 256 + i];
+			_crc32c_table[n * 256 + i] = (prev >> 8) ^ _crc32c_table[prev & 0xFF];
+		}
+
+	return 1;
+}
+
+// Continues the CRC of everything hashed so far. Start with crc = 0.
+u32 IRAM_FAST crc32c_update(u32 crc, const void *buf, u32 len)
+{
+	const u8 *cbuf = (const u8 *)buf;
+	crc = ~crc;
+
+	if (!_crc32c_table && !_crc32c_table_init())
+	{
+		while (len--)
+		{
+			crc ^= *cbuf++;
+			for (int i = 0; i < 8; i++)
+				crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		}
+		return ~crc;
+	}
+
+	const u32 *t = _crc32c_table;
+
+	// Head bytes up to word alignment.
+	while (len && ((u32)cbuf & 3))
+	{
+		crc = (crc >> 8) ^ t[(crc ^ *cbuf++) & 0xFF];
+		len--;
+	}
+
+	// 8 bytes per iteration, little-endian words.
+	const u32 *wbuf = (const u32 *)cbuf;
+	while (len >= 8)
+	{
+		u32 lo = *wbuf++ ^ crc;
+		u32 hi = *wbuf++;
+		crc = t[7 * 256 + (lo & 0xFF)] ^ t[6 * 256 + ((lo >> 8) & 0xFF)] ^
+			t[5 * 256 + ((lo >> 16) & 0xFF)] ^ t[4 * 256 + (lo >> 24)] ^
+			t[3 * 256 + (hi & 0xFF)] ^ t[2 * 256 + ((hi >> 8) & 0xFF)] ^
+			t[1 * 256 + ((hi >> 16) & 0xFF)] ^ t[hi >> 24];
+		len -= 8;
+	}
+
+	cbuf = (const u8 *)wbuf;
+	while (len--)
+		crc = (crc >> 8) ^ t[(crc ^ *cbuf++) & 0xFF];
+
 	return ~crc;
 }
 
-u32 memcmp32sparse(const u32 *buf1, const u32 *buf2, u32 len)
+u32 crc32c(const void *buf, u32 len)
+{
+	return crc32c_update(0, buf, len);
+}
+
+u32 IRAM_FAST memcmp32sparse(const u32 *buf1, const u32 *buf2, u32 len)
 {
 	u32 len32 = len / 4;
 
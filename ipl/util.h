@@ -29,16 +29,29 @@ typedef struct _cfg_op_t
 	u32 val;
 } cfg_op_t;
 
+/*! Leaves val in PMC scratch 200 and resets through the watchdog. */
+void panic(u32 val);
 u32 get_tmr_us();
 u32 get_tmr_ms();
 u32 get_tmr_s();
 void usleep(u32 ticks);
 void msleep(u32 milliseconds);
+/*! Runs hook repeatedly during sleeps of 1ms or more, NULL clears it. Sleeps are minimums, the hook may extend them. */
+void sleep_set_hook(void (*hook)());
 void exec_cfg(u32 *base, const cfg_op_t *ops, u32 num_ops);
 u32 crc32c(const void *buf, u32 len);
+u32 crc32c_update(u32 crc, const void *buf, u32 len);
 
 /* This is a faster implementation of memcmp that checks two u32 values */
 /* every 128 Bytes block. Intented only for Backup and Restore          */
 u32 memcmp32sparse(const u32 *buf1, const u32 *buf2, u32 len);
 
+/* memops.S replaces these through --wrap, the toolchain ones are the __real_* */
+void *__real_memcpy(void *dst, const void *src, u32 len);
+void *__real_memset(void *dst, int val, u32 len);
+int __real_memcmp(const void *buf1, const void *buf2, u32 len);
+void *__wrap_memcpy(void *dst, const void *src, u32 len);
+void *__wrap_memset(void *dst, int val, u32 len);
+int __wrap_memcmp(const void *buf1, const void *buf2, u32 len);
+
 #endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "warm.h"
+#include "bpmp.h"
+#include "ccplex.h"
+#include "clock.h"
+#include "irq.h"
+#include "mc.h"
+#include "pmc.h"
+#include "sdram.h"
+#include "t210.h"
+#include "trace.h"
+#include "util.h"
+
+static warm_state_t *_warm = (warm_state_t *)WARM_ADDR;
+static u32 _warm_flags = 0;
+
+static u32 _warm_crc()
+{
+	return crc32c(&_warm->flags, sizeof(warm_state_t) - 8);
+}
+
+// DRAM must not be touched before it is known to be trained, an access to it would hang.
+static int _warm_sdram_live()
+{
+	// MC and EMC clocked and out of reset.
+	if ((CLOCK(CLK_RST_CONTROLLER_CLK_OUT_ENB_H) & 0x2000001) != 0x2000001)
+		return 0;
+	if (CLOCK(CLK_RST_CONTROLLER_RST_DEVICES_H) & 0x2000001)
+		return 0;
+
+	// Sized and carved out by a previous config_hw(), both are cleared by a reset.
+	if (!MC(MC_EMEM_CFG))
+		return 0;
+
+	return MC(MC_VIDEO_PROTECT_REG_CTRL) == 1 && MC(MC_MTS_CARVEOUT_REG_CTRL) == 1;
+}
+
+u32 warm_check()
+{
+	_warm_flags = 0;
+
+	// Scratches survive a reset, so the magic alone does not prove anything.
+	if (PMC(APBDEV_PMC_SCRATCH117) != WARM_MAGIC)
+		return 0;
+	// One shot, a reset from here on is a cold boot again.
+	PMC(APBDEV_PMC_SCRATCH117) = 0;
+
+	if (!_warm_sdram_live())
+		return 0;
+
+	if (_warm->magic != WARM_MAGIC || _warm->crc != _warm_crc())
+		return 0;
+	if (_warm->emem_cfg != MC(MC_EMEM_CFG))
+		return 0;
+
+	_warm_flags = _warm->flags;
+	_warm->magic = 0;
+
+	return _warm_flags;
+}
+
+u32 warm_flags()
+{
+	return _warm_flags;
+}
+
+void warm_relaunch(void *buf, u32 flags)
+{
+	_warm->magic = WARM_MAGIC;
+	_warm->flags = flags;
+	_warm->emem_cfg = MC(MC_EMEM_CFG);
+	_warm->crc = _warm_crc();
+
+	trace_flush();
+
+	// The payload starts like it came from RCM, at the baseline clock with no job on the CCPLEX.
+	ccplex_worker_stop();
+	irq_end();
+	bpmp_clk_rate_set(BPMP_CLK_NORMAL);
+	sdram_perf_mode(0);
+	// It copies itself out of DRAM with the cache off, the state above must already be there.
+	bpmp_cache_disable();
+
+	PMC(APBDEV_PMC_SCRATCH117) = WARM_MAGIC;
+
+	void (*payload)() = (void (*)())buf;
+	payload();
+
+	while (1)
+		;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WARM_H_
+#define _WARM_H_
+
+#include "types.h"
+
+/*! Reserved DRAM between the trace ring and the stats log, holds the handed over state. */
+#define WARM_ADDR 0x9001D000
+#define WARM_MAGIC 0x4D524157 // "WARM"
+
+/*! Payload size limit, it relocates itself to 0x40008000 and must stay clear of the IRAM BCT. */
+#define WARM_PAYLOAD_MAX_SIZE (0x4003D000 - 0x40008000)
+
+// What the previous instance left configured.
+#define WARM_SDRAM   (1 << 0) // MC carveouts set up and DRAM trained.
+#define WARM_PMIC    (1 << 1) // PMIC FPS and SD0 voltage programmed.
+#define WARM_DISPLAY (1 << 2) // Panel up and scanning out the framebuffer.
+
+typedef struct _warm_state_t
+{
+	u32 magic;
+	u32 crc;
+	u32 flags;
+	u32 emem_cfg;
+} warm_state_t;
+
+/*! Checks for a state handed over by warm_relaunch() and consumes it. Returns its flags or 0 on a cold boot. */
+u32 warm_check();
+/*! Flags found by the last warm_check(). */
+u32 warm_flags();
+/*! Hands flags over and jumps to the payload at buf. Does not return. */
+void warm_relaunch(void *buf, u32 flags);
+
+#endif
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Host side of hekate's "Backup/Restore eMMC over USB" tools, needs pyusb.
+
+  emmc_usb.py list
+  emmc_usb.py read <partition> <file> [lba] [sectors]
+  emmc_usb.py write <partition> <file> [lba]
+"""
+
+import os
+import struct
+import sys
+
+import usb.core
+
+VID, PID = 0x1209, 0x8B00
+MAGIC = 0x4E4D4D45
+CMD_LIST, CMD_READ, CMD_WRITE, CMD_DONE = 1, 2, 3, 4
+STATUS = { 0: "ok", 1: "invalid request", 2: "eMMC I/O error", 3: "device is read-only" }
+CHUNK = 0x100000
+SECTOR = 512
+
+def open_dev():
+	dev = usb.core.find(idVendor=VID, idProduct=PID)
+	if dev is None:
+		sys.exit("hekate is not connected.")
+	dev.set_configuration()
+	return dev
+
+def cmd(dev, op, part="", lba=0, num=0):
+	dev.write(0x01, struct.pack("<IIII48s", MAGIC, op, lba, num, part.encode()), 5000)
+
+def reply(dev, data=None):
+	if data is None:
+		data = bytes(dev.read(0x81, 16, 5000))
+	magic, status, value, _ = struct.unpack("<IIII", data)
+	if magic != MAGIC:
+		sys.exit("Bad reply.")
+	if status:
+		sys.exit("Failed: " + STATUS.get(status, str(status)))
+	return value
+
+def parts(dev):
+	cmd(dev, CMD_LIST)
+	num = reply(dev)
+	data = bytes(dev.read(0x81, num * 52, 5000))
+	res = []
+	for i in range(num):
+		name, phys, sectors, _ = struct.unpack_from("<40sIII", data, i * 52)
+		res.append((name.rstrip(b"\0").decode(), phys, sectors))
+	return res
+
+def find(dev, name):
+	for p in parts(dev):
+		if p[0] == name:
+			return p
+	sys.exit("No partition " + name)
+
+def read(dev, name, path, lba, num):
+	if num is None:
+		num = find(dev, name)[2] - lba
+	cmd(dev, CMD_READ, name, lba, num)
+	reply(dev)
+	left = num * SECTOR
+	with open(path, "wb") as f:
+		while left:
+			data = bytes(dev.read(0x81, min(left, CHUNK), 10000))
+			# A short reply instead of sectors ends the stream early.
+			if len(data) == 16:
+				reply(dev, data)
+			f.write(data)
+			left -= len(data)
+			print("\r%d%%" % (100 - left * 100 // (num * SECTOR)), end="", flush=True)
+	print()
+	reply(dev)
+
+def write(dev, name, path, lba):
+	size = os.path.getsize(path)
+	if size % SECTOR:
+		sys.exit("Image is not sector aligned.")
+	num = size // SECTOR
+	cmd(dev, CMD_WRITE, name, lba, num)
+	reply(dev)
+	done = 0
+	with open(path, "rb") as f:
+		while done < size:
+			data = f.read(CHUNK)
+			try:
+				dev.write(0x01, data, 10000)
+			except usb.core.USBError:
+				break
+			done += len(data)
+			print("\r%d%%" % (done * 100 // size), end="", flush=True)
+	print()
+	reply(dev)
+
+def main():
+	if len(sys.argv) < 2:
+		sys.exit(__doc__)
+	dev = open_dev()
+	op = sys.argv[1]
+	if op == "list":
+		for name, phys, sectors in parts(dev):
+			print("%-40s %d %10d sectors (%d MiB)" % (name, phys, sectors, sectors * SECTOR >> 20))
+	elif op == "read":
+		lba = int(sys.argv[4], 0) if len(sys.argv) > 4 else 0
+		num = int(sys.argv[5], 0) if len(sys.argv) > 5 else None
+		read(dev, sys.argv[2], sys.argv[3], lba, num)
+	elif op == "write":
+		lba = int(sys.argv[4], 0) if len(sys.argv) > 4 else 0
+		write(dev, sys.argv[2], sys.argv[3], lba)
+	cmd(dev, CMD_DONE)
+	reply(dev)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,537 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+* Correctness and throughput of the portable ipl modules, built for the host by "make host-test".
+* Exact values (checksums, sizes, heap and RAM disk counters) go to the results file, which the
+* Makefile compares with tools/host/baseline.txt. Rates depend on the host and are only printed.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "shim.h"
+#include "blz.h"
+#include "ff.h"
+#include "heap.h"
+#include "ini.h"
+#include "lz.h"
+#include "util.h"
+
+#define BENCH_BUF_SIZE   0x100000 // 1MB.
+#define BENCH_HEAP_SLOTS 256
+#define BENCH_INI_SECS   400
+#define BENCH_FF_FILE    0x800000 // 8MB.
+#define BENCH_FF_CHUNK   0x8000
+#define BENCH_FF_SEEKS   1024
+#define BENCH_FF_FILES   256
+
+static FILE *_results;
+static int _failed = 0;
+static u32 _seed;
+
+static u8 _src[BENCH_BUF_SIZE];
+static u8 _dst[BENCH_BUF_SIZE * 2];
+static u8 _tmp[BENCH_BUF_SIZE * 2];
+static u32 _lz_work[LZ_WORK_SIZE / sizeof(u32)];
+
+static FATFS _fs;
+
+static u32 _rand()
+{
+	_seed = _seed * 1103515245 + 12345;
+	return _seed >> 8;
+}
+
+static u64 _now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void _result(const char *test, const char *key, u32 val)
+{
+	fprintf(_results, "%s %s %u\n", test, key, val);
+}
+
+static void _check(const char *test, const char *key, int ok)
+{
+	_result(test, key, ok ? 1 : 0);
+	if (!ok)
+	{
+		printf("%s: %s FAILED\n", test, key);
+		_failed = 1;
+	}
+}
+
+// In KB/s, or K units/s for counts.
+static void _rate(const char *test, const char *unit, u64 amount, u64 ns)
+{
+	printf("%-12s %-20s %10u K%s/s\n", test, "", (u32)(amount * 1000000000ull / 1024 / (ns ? ns : 1)), unit);
+}
+
+static void _rate_named(const char *test, const char *name, const char *unit, u64 amount, u64 ns)
+{
+	printf("%-12s %-20s %10u K%s/s\n", test, name, (u32)(amount * 1000000000ull / 1024 / (ns ? ns : 1)), unit);
+}
+
+// Words from a small dictionary with random bytes in between, compresses like config and code.
+static void _fill_text(u8 *buf, u32 size)
+{
+	static const char *words[] = { "kip1", "secmon", "warmboot", "atmosphere", "kernel", "=", "\n", "[", "]",
+		"0x0000", "patch", "fs", "loader", "sd:/", "boot", "nogc" };
+
+	u32 pos = 0;
+	while (pos < size)
+	{
+		const char *w = words[_rand() % 16];
+		u32 len = strlen(w);
+		if (!(_rand() & 7))
+		{
+			buf[pos++] = _rand();
+			continue;
+		}
+		for (u32 i = 0; i < len && pos < size; i++)
+			buf[pos++] = w[i];
+	}
+}
+
+static void _test_crc32c()
+{
+	const char *test = "crc32c";
+
+	_check(test, "check_value", crc32c("123456789", 9) == 0xE3069283);
+
+	_seed = 1;
+	for (u32 i = 0; i < BENCH_BUF_SIZE; i++)
+		_src[i] = _rand();
+
+	// Unaligned start, and the same value when continued in odd pieces.
+	u32 crc = crc32c(_src + 1, BENCH_BUF_SIZE - 1);
+	u32 part = crc32c_update(0, _src + 1, 3);
+	part = crc32c_update(part, _src + 4, 1001);
+	part = crc32c_update(part, _src + 1005, BENCH_BUF_SIZE - 1005);
+	_result(test, "crc", crc);
+	_check(test, "update_match", crc == part);
+
+	u64 ns = _now_ns();
+	for (u32 i = 0; i < 64; i++)
+		crc32c(_src, BENCH_BUF_SIZE);
+	_rate(test, "B", 64ull * BENCH_BUF_SIZE, _now_ns() - ns);
+}
+
+static void _test_lz()
+{
+	const char *test = "lz";
+
+	_seed = 2;
+	_fill_text(_src, BENCH_BUF_SIZE);
+
+	u64 ns = _now_ns();
+	u32 comp_size = LZ_CompressFast(_src, _tmp, BENCH_BUF_SIZE, _lz_work);
+	ns = _now_ns() - ns;
+	_rate_named(test, "compress", "B", BENCH_BUF_SIZE, ns);
+	_result(test, "comp_size", comp_size);
+	_result(test, "comp_crc", crc32c(_tmp, comp_size));
+
+	memset(_dst, 0, BENCH_BUF_SIZE);
+	LZ_Uncompress(_tmp, _dst, comp_size);
+	_check(test, "roundtrip", !memcmp(_src, _dst, BENCH_BUF_SIZE));
+
+	ns = _now_ns();
+	for (u32 i = 0; i < 32; i++)
+		LZ_Uncompress(_tmp, _dst, comp_size);
+	_rate_named(test, "uncompress", "B", 32ull * BENCH_BUF_SIZE, _now_ns() - ns);
+}
+
+// Same generator as the payload's core bench: a backwards stream the way KIP sections are packed.
+static u32 _blz_gen(u8 *comp, u8 *pattern, u32 size)
+{
+	u32 out = size;
+	u32 pos = 0;
+	u32 ctl_pos = 0;
+	u32 ctl = 0;
+	u32 tok = 8;
+
+	for (u32 i = 0; i < size; i++)
+		pattern[i] = (i & 0xF) * 0x1D + 0x35;
+
+	// Compressed bytes in read order go to the end of the buffer first.
+	u8 *stream = comp + size;
+	while (out)
+	{
+		if (tok == 8)
+		{
+			if (pos)
+				stream[ctl_pos] = ctl;
+			ctl_pos = pos++;
+			ctl = 0;
+			tok = 0;
+		}
+
+		// Only matches at the bottom, so output never catches up with unread input.
+		u32 len = (_rand() & 0xF) + 3;
+		if (out <= 18)
+			len = out;
+		else if (out - len < 3)
+			len = out - 3;
+		if (out + 32 > size || (out > 64 && (_rand() & 3) == 0))
+			stream[pos++] = pattern[--out];
+		else
+		{
+			// Offset 32 hits the same pattern byte and is longer than any match, so nothing overlaps.
+			u32 val = ((len - 3) << 12) | (32 - 3);
+			stream[pos++] = val >> 8;
+			stream[pos++] = val & 0xFF;
+			out -= len;
+			ctl |= 0x80 >> tok;
+		}
+		tok++;
+	}
+	stream[ctl_pos] = ctl;
+
+	for (u32 i = 0; i < pos; i++)
+		comp[pos - 1 - i] = stream[i];
+
+	blz_footer footer;
+	footer.cmp_and_hdr_size = pos + sizeof(blz_footer);
+	footer.header_size = sizeof(blz_footer);
+	footer.addl_size = size - footer.cmp_and_hdr_size;
+	memcpy(comp + pos, &footer, sizeof(blz_footer));
+
+	return pos + sizeof(blz_footer);
+}
+
+static void _test_blz()
+{
+	const char *test = "blz";
+	blz_footer footer;
+
+	_seed = 3;
+	u32 comp_size = _blz_gen(_tmp, _src, BENCH_BUF_SIZE);
+	_result(test, "comp_size", comp_size);
+
+	_check(test, "fast", blz_uncompress_srcdest(_tmp, comp_size, _dst, BENCH_BUF_SIZE) &&
+		!memcmp(_dst, _src, BENCH_BUF_SIZE));
+
+	// The reference decoder works in place on its own copy.
+	blz_get_footer(_tmp, comp_size, &footer);
+	memcpy(_dst, _tmp, comp_size - sizeof(blz_footer));
+	memset(_dst + comp_size - sizeof(blz_footer), 0, BENCH_BUF_SIZE - comp_size + sizeof(blz_footer));
+	_check(test, "reference", blz_uncompress_inplace_ref(_dst, comp_size, &footer) &&
+		!memcmp(_dst, _src, BENCH_BUF_SIZE));
+
+	u64 ns = _now_ns();
+	for (u32 i = 0; i < 32; i++)
+		blz_uncompress_srcdest(_tmp, comp_size, _dst, BENCH_BUF_SIZE);
+	_rate_named(test, "uncompress", "B", 32ull * BENCH_BUF_SIZE, _now_ns() - ns);
+
+	ns = _now_ns();
+	for (u32 i = 0; i < 32; i++)
+	{
+		memcpy(_dst, _tmp, comp_size - sizeof(blz_footer));
+		blz_uncompress_inplace_ref(_dst, comp_size, &footer);
+	}
+	_rate_named(test, "uncompress_ref", "B", 32ull * BENCH_BUF_SIZE, _now_ns() - ns);
+}
+
+static void _test_heap()
+{
+	const char *test = "heap";
+	static void *slots[BENCH_HEAP_SLOTS];
+	heap_stats_t before, after;
+
+	_seed = 4;
+	heap_get_stats(&before, 0);
+
+	// Mixed sizes and alignments, every other block replaced each round so holes keep opening.
+	u64 ns = _now_ns();
+	u32 ops = 0;
+	for (u32 round = 0; round < 64; round++)
+	{
+		for (u32 i = 0; i < BENCH_HEAP_SLOTS; i++)
+		{
+			if (round && ((i ^ round) & 1))
+				continue;
+			if (round)
+				free(slots[i]);
+			u32 size = 16 << (_rand() % 11);
+			size += _rand() % size;
+			slots[i] = (_rand() & 7) ? malloc(size) : memalign(0x100, size);
+			memset(slots[i], i, size > 64 ? 64 : size);
+			ops += round ? 2 : 1;
+		}
+	}
+	heap_stats_t mid;
+	heap_get_stats(&mid, 0);
+	for (u32 i = 0; i < BENCH_HEAP_SLOTS; i++)
+		free(slots[i]);
+	ns = _now_ns() - ns;
+	heap_get_stats(&after, 0);
+	_rate(test, "op", ops + BENCH_HEAP_SLOTS, ns);
+
+	_result(test, "peak", mid.peak - before.used);
+	_result(test, "top", mid.top - before.top);
+	_result(test, "free_blocks", mid.free_blocks);
+	_result(test, "largest_free", mid.largest_free);
+	_check(test, "released", after.used == before.used && after.allocs == before.allocs && after.top == before.top);
+}
+
+static int _write_file(const char *path, const void *buf, u32 size)
+{
+	FIL fp;
+	UINT bw = 0;
+
+	if (f_open(&fp, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		return 0;
+	FRESULT res = size ? f_write(&fp, buf, size, &bw) : FR_OK;
+	f_close(&fp);
+
+	return res == FR_OK && bw == size;
+}
+
+// Hashes everything a parse produced, in list order.
+static u32 _ini_hash(link_t *sections, u32 *num_secs, u32 *num_kvs)
+{
+	u32 crc = 0;
+	*num_secs = 0;
+	*num_kvs = 0;
+
+	LIST_FOREACH_ENTRY(ini_sec_t, sec, sections, link)
+	{
+		(*num_secs)++;
+		if (sec->name)
+			crc = crc32c_update(crc, sec->name, strlen(sec->name) + 1);
+		crc = crc32c_update(crc, &sec->type, sizeof(sec->type));
+		LIST_FOREACH_ENTRY(ini_kv_t, kv, &sec->kvs, link)
+		{
+			(*num_kvs)++;
+			crc = crc32c_update(crc, kv->key, strlen(kv->key) + 1);
+			crc = crc32c_update(crc, kv->val, strlen(kv->val) + 1);
+		}
+	}
+
+	return crc;
+}
+
+static void _test_ini()
+{
+	const char *test = "ini";
+	static link_t sections;
+	heap_stats_t before, after;
+	u32 num_secs, num_kvs, num_secs2, num_kvs2;
+
+	// A large boot config: [config] with a repeated key, then entries with comments and repeated kip1.
+	char *text = (char *)_src;
+	u32 len = 0;
+	len += sprintf(text + len, "[config]\nautoboot=1\nbootwait=3\nautoboot=2\n\n");
+	for (u32 i = 0; i < BENCH_INI_SECS; i++)
+	{
+		len += sprintf(text + len, "{-- Entry %u --}\n[Entry %u]\n", i, i);
+		len += sprintf(text + len, "warmboot=bootloader/payloads/warmboot_%u.bin\n", i);
+		len += sprintf(text + len, "secmon=bootloader/payloads/secmon_%u.bin\n", i);
+		for (u32 j = 0; j < 3; j++)
+			len += sprintf(text + len, "kip1=bootloader/kips/%u_%u.kip\n", i, j);
+		len += sprintf(text + len, "kip1patch=nosigchk,nogc\nlogopath=bootloader/res/%u.bmp\n\n", i);
+	}
+	_result(test, "text_size", len);
+
+	f_mkdir("bootloader");
+	_check(test, "write", _write_file("bootloader/hekate_ipl.ini", text, len));
+
+	heap_get_stats(&before, 0);
+
+	u64 ns = _now_ns();
+	list_init(&sections);
+	int res = ini_parse(&sections, "bootloader/hekate_ipl.ini");
+	_rate_named(test, "parse_text", "B", len, _now_ns() - ns);
+	u32 crc = _ini_hash(&sections, &num_secs, &num_kvs);
+	_check(test, "parse", res);
+	_result(test, "sections", num_secs);
+	_result(test, "kvs", num_kvs);
+	_result(test, "crc", crc);
+
+	// [config] keys take their last value, repeated kip1 keys are all visited in file order.
+	ini_sec_t *cfg = CONTAINER_OF(sections.next, ini_sec_t, link);
+	char *autoboot = ini_get_val(cfg, "autoboot");
+	_check(test, "last_wins", autoboot && !strcmp(autoboot, "2"));
+	ini_sec_t *entry = NULL;
+	LIST_FOREACH_ENTRY(ini_sec_t, sec, &sections, link)
+		if (sec->type == INI_CHOICE)
+			entry = sec;
+	u32 kips = 0;
+	for (ini_kv_t *kv = entry ? ini_kv_find(entry, "kip1") : NULL; kv; kv = ini_kv_find_next(kv))
+		kips++;
+	_check(test, "repeated_keys", kips == 3);
+	ini_free(&sections);
+
+	// The second parse comes from the cache the first one saved.
+	ns = _now_ns();
+	list_init(&sections);
+	res = ini_parse(&sections, "bootloader/hekate_ipl.ini");
+	_rate_named(test, "parse_cached", "B", len, _now_ns() - ns);
+	_check(test, "cache_match", res && _ini_hash(&sections, &num_secs2, &num_kvs2) == crc &&
+		num_secs2 == num_secs && num_kvs2 == num_kvs);
+	ini_free(&sections);
+
+	// No sections at all still releases its pool.
+	_write_file("bootloader/empty.ini", "", 0);
+	list_init(&sections);
+	ini_parse(&sections, "bootloader/empty.ini");
+	ini_free(&sections);
+
+	heap_get_stats(&after, 0);
+	_check(test, "released", after.used == before.used && after.allocs == before.allocs);
+}
+
+static void _test_ff()
+{
+	const char *test = "ff";
+	FIL fp;
+	UINT br;
+
+	_seed = 5;
+	for (u32 i = 0; i < BENCH_FF_CHUNK; i++)
+		_src[i] = _rand();
+
+	// Sequential write and read back, one chunk at a time like a backup.
+	u64 ns = _now_ns();
+	int ok = f_open(&fp, "big.bin", FA_CREATE_ALWAYS | FA_WRITE) == FR_OK;
+	for (u32 pos = 0; ok && pos < BENCH_FF_FILE; pos += BENCH_FF_CHUNK)
+	{
+		_src[0] = pos >> 15;
+		ok = f_write(&fp, _src, BENCH_FF_CHUNK, &br) == FR_OK && br == BENCH_FF_CHUNK;
+	}
+	f_close(&fp);
+	_rate_named(test, "seq_write", "B", BENCH_FF_FILE, _now_ns() - ns);
+	_check(test, "seq_write", ok);
+
+	u32 crc = 0;
+	ns = _now_ns();
+	ok = f_open(&fp, "big.bin", FA_READ) == FR_OK;
+	for (u32 pos = 0; ok && pos < BENCH_FF_FILE; pos += BENCH_FF_CHUNK)
+	{
+		ok = f_read(&fp, _dst, BENCH_FF_CHUNK, &br) == FR_OK && br == BENCH_FF_CHUNK;
+		crc = crc32c_update(crc, _dst, BENCH_FF_CHUNK);
+	}
+	_rate_named(test, "seq_read", "B", BENCH_FF_FILE, _now_ns() - ns);
+	_check(test, "seq_read", ok);
+	_result(test, "seq_crc", crc);
+
+	// Random 4KB reads, through the FAT chain, then through a cluster link map.
+	u32 offs[BENCH_FF_SEEKS];
+	for (u32 i = 0; i < BENCH_FF_SEEKS; i++)
+		offs[i] = (_rand() % (BENCH_FF_FILE / 0x1000)) * 0x1000;
+
+	u32 seek_crc[2] = { 0, 0 };
+	static DWORD clmt[256];
+	for (u32 fast = 0; ok && fast < 2; fast++)
+	{
+		if (fast)
+		{
+			clmt[0] = sizeof(clmt) / sizeof(DWORD);
+			fp.cltbl = clmt;
+			ok = f_lseek(&fp, CREATE_LINKMAP) == FR_OK;
+		}
+		ns = _now_ns();
+		for (u32 i = 0; ok && i < BENCH_FF_SEEKS; i++)
+		{
+			ok = f_lseek(&fp, offs[i]) == FR_OK && f_read(&fp, _dst, 0x1000, &br) == FR_OK && br == 0x1000;
+			seek_crc[fast] = crc32c_update(seek_crc[fast], _dst, 0x1000);
+		}
+		_rate_named(test, fast ? "seek_read_linkmap" : "seek_read", "op", BENCH_FF_SEEKS, _now_ns() - ns);
+	}
+	f_close(&fp);
+	_check(test, "seek_read", ok && seek_crc[0] == seek_crc[1]);
+	_result(test, "seek_crc", seek_crc[0]);
+
+	// Many long names in one directory, every other one removed, then a file that has to fill the holes.
+	char path[64];
+	f_mkdir("many");
+	ns = _now_ns();
+	for (u32 i = 0; ok && i < BENCH_FF_FILES; i++)
+	{
+		sprintf(path, "many/a long file name number %u.bin", i);
+		ok = _write_file(path, _src, 512 + (i % 7) * 1024);
+	}
+	for (u32 i = 0; ok && i < BENCH_FF_FILES; i += 2)
+	{
+		sprintf(path, "many/a long file name number %u.bin", i);
+		ok = f_unlink(path) == FR_OK;
+	}
+	_rate_named(test, "create_unlink", "op", BENCH_FF_FILES * 3 / 2, _now_ns() - ns);
+	_check(test, "files", ok && _write_file("many/fragmented.bin", _src, BENCH_FF_CHUNK));
+
+	DIR dir;
+	FILINFO fno;
+	u32 num = 0;
+	if (f_opendir(&dir, "many") == FR_OK)
+	{
+		while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0])
+			num++;
+		f_closedir(&dir);
+	}
+	_result(test, "dir_entries", num);
+
+	DWORD free_clst;
+	FATFS *fs;
+	f_getfree("", &free_clst, &fs);
+	_result(test, "free_clusters", free_clst);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <results file>\n", argv[0]);
+		return 1;
+	}
+
+	_results = fopen(argv[1], "w");
+	if (!_results)
+		return 1;
+
+	heap_init(host_heap_base());
+
+	_test_crc32c();
+	_test_lz();
+	_test_blz();
+	_test_heap();
+
+	host_disk_format();
+	if (f_mount(&_fs, "", 1) != FR_OK)
+	{
+		_check("ff", "mount", 0);
+		fclose(_results);
+		return 1;
+	}
+	_test_ini();
+	_test_ff();
+	f_mount(NULL, "", 1);
+
+	// Any change in how the modules touch the disk shows up here.
+	const host_disk_stats_t *st = host_disk_stats();
+	_result("disk", "reads", st->reads);
+	_result("disk", "writes", st->writes);
+	_result("disk", "sectors_read", st->sectors_read);
+	_result("disk", "sectors_written", st->sectors_written);
+
+	fclose(_results);
+
+	return _failed;
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+* What the portable ipl modules need from the rest of the payload, on the host:
+* a FAT32 RAM disk behind diskio, one fixed memmap region for the heap, panic and a silent console.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shim.h"
+#include "diskio.h"
+#include "gfx.h"
+#include "util.h"
+
+gfx_con_t gfx_con;
+gfx_ctxt_t gfx_ctxt;
+
+static u8 _host_heap[HOST_HEAP_SIZE] __attribute__((aligned(0x1000)));
+static memmap_region_t _host_heap_region;
+
+static u8 _ramdisk[HOST_DISK_SECTORS * HOST_SECTOR_SIZE] __attribute__((aligned(0x1000)));
+static host_disk_stats_t _ramdisk_stats;
+
+u32 host_heap_base()
+{
+	_host_heap_region.name = "host heap";
+	_host_heap_region.start = (u32)_host_heap;
+	_host_heap_region.end = (u32)_host_heap + HOST_HEAP_SIZE - 1;
+	_host_heap_region.fixed = 1;
+
+	return _host_heap_region.start;
+}
+
+const memmap_region_t *memmap_find(const void *buf, u32 size)
+{
+	u32 start = (u32)buf;
+	if (start >= _host_heap_region.start && start <= _host_heap_region.end &&
+		size <= _host_heap_region.end - start + 1)
+		return &_host_heap_region;
+
+	return NULL;
+}
+
+void panic(u32 val)
+{
+	fprintf(stderr, "panic %08X\n", val);
+	exit(2);
+}
+
+// FatFs only prints here on errors, the results already say what failed.
+void gfx_printf(gfx_con_t *con, const char *fmt, ...)
+{
+}
+
+static void _st16(u8 *buf, u32 off, u32 val)
+{
+	buf[off] = val;
+	buf[off + 1] = val >> 8;
+}
+
+static void _st32(u8 *buf, u32 off, u32 val)
+{
+	_st16(buf, off, val);
+	_st16(buf, off + 2, val >> 16);
+}
+
+// FAT32, one sector per cluster, as laid out by a PC formatter. FF_USE_MKFS is off in the payload.
+void host_disk_format()
+{
+	const u32 rsvd = 32;
+	const u32 fat_size = (HOST_DISK_SECTORS / 128) + 1;
+	u8 *bs = _ramdisk;
+
+	memset(_ramdisk, 0, sizeof(_ramdisk));
+	memset(&_ramdisk_stats, 0, sizeof(_ramdisk_stats));
+
+	memcpy(bs, "\xEB\x58\x90" "MSWIN4.1", 11);
+	_st16(bs, 11, HOST_SECTOR_SIZE);
+	bs[13] = 1;                         // Sectors per cluster.
+	_st16(bs, 14, rsvd);
+	bs[16] = 2;                         // FATs.
+	bs[21] = 0xF8;                      // Fixed media.
+	_st32(bs, 32, HOST_DISK_SECTORS);
+	_st32(bs, 36, fat_size);
+	_st32(bs, 44, 2);                   // Root directory cluster.
+	_st16(bs, 48, 1);                   // FSInfo sector.
+	_st16(bs, 50, 6);                   // Backup boot sector.
+	bs[64] = 0x80;
+	bs[66] = 0x29;
+	_st32(bs, 67, 0x12345678);          // Volume serial.
+	memcpy(bs + 71, "NO NAME    FAT32   ", 19);
+	_st16(bs, 510, 0xAA55);
+	memcpy(_ramdisk + 6 * HOST_SECTOR_SIZE, bs, HOST_SECTOR_SIZE);
+
+	// Free count unknown, FatFs counts on the first f_getfree.
+	u8 *fsi = _ramdisk + HOST_SECTOR_SIZE;
+	_st32(fsi, 0, 0x41615252);
+	_st32(fsi, 484, 0x61417272);
+	_st32(fsi, 488, 0xFFFFFFFF);
+	_st32(fsi, 492, 0xFFFFFFFF);
+	_st16(fsi, 510, 0xAA55);
+
+	// Media, reserved and the end of the root directory chain.
+	for (u32 i = 0; i < 2; i++)
+	{
+		u8 *fat = _ramdisk + (rsvd + i * fat_size) * HOST_SECTOR_SIZE;
+		_st32(fat, 0, 0x0FFFFFF8);
+		_st32(fat, 4, 0x0FFFFFFF);
+		_st32(fat, 8, 0x0FFFFFFF);
+	}
+}
+
+const host_disk_stats_t *host_disk_stats()
+{
+	return &_ramdisk_stats;
+}
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+	return pdrv ? STA_NOINIT : 0;
+}
+
+DSTATUS disk_status(BYTE pdrv)
+{
+	return pdrv ? STA_NOINIT : 0;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+	if (pdrv || sector > HOST_DISK_SECTORS || count > HOST_DISK_SECTORS - sector)
+		return RES_PARERR;
+
+	memcpy(buff, _ramdisk + sector * HOST_SECTOR_SIZE, count * HOST_SECTOR_SIZE);
+	_ramdisk_stats.reads++;
+	_ramdisk_stats.sectors_read += count;
+
+	return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+	if (pdrv || sector > HOST_DISK_SECTORS || count > HOST_DISK_SECTORS - sector)
+		return RES_PARERR;
+
+	memcpy(_ramdisk + sector * HOST_SECTOR_SIZE, buff, count * HOST_SECTOR_SIZE);
+	_ramdisk_stats.writes++;
+	_ramdisk_stats.sectors_written += count;
+
+	return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+	if (pdrv)
+		return RES_PARERR;
+
+	switch (cmd)
+	{
+	case CTRL_SYNC:
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(DWORD *)buff = HOST_DISK_SECTORS;
+		return RES_OK;
+	case GET_SECTOR_SIZE:
+		*(WORD *)buff = HOST_SECTOR_SIZE;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD *)buff = 1;
+		return RES_OK;
+	}
+
+	return RES_PARERR;
+}
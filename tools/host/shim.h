@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2018 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HOST_SHIM_H_
+#define _HOST_SHIM_H_
+
+#include "types.h"
+#include "memmap.h"
+
+#define HOST_HEAP_SIZE    0x2000000 // 32MB, the payload heap is smaller.
+#define HOST_SECTOR_SIZE  512
+#define HOST_DISK_SECTORS 0x20000   // 64MB, enough clusters for FAT32.
+
+/*! I/O that reached the RAM disk since the last format. */
+typedef struct _host_disk_stats_t
+{
+	u32 reads;
+	u32 writes;
+	u32 sectors_read;
+	u32 sectors_written;
+} host_disk_stats_t;
+
+/*! Sets up the fixed region heap_init() expects and returns its start. */
+u32 host_heap_base();
+/*! Lays an empty FAT32 volume on the RAM disk, pdrv 0. */
+void host_disk_format();
+const host_disk_stats_t *host_disk_stats();
+
+#endif